@@ -17,8 +17,8 @@
  * limitations under the License.
  */
 
-#ifndef FREERDP_CHANNEL_RDPGFX_CLIENT_COMMON_H
-#define FREERDP_CHANNEL_RDPGFX_CLIENT_COMMON_H
+#ifndef FREERDP_CHANNEL_RDPGFX_COMMON_H
+#define FREERDP_CHANNEL_RDPGFX_COMMON_H
 
 #include <winpr/crt.h>
 #include <winpr/stream.h>
@@ -40,5 +40,5 @@ int rdpgfx_write_rect16(wStream* s, RDPGFX_RECT16* rect16);
 int rdpgfx_read_color32(wStream* s, RDPGFX_COLOR32* color32);
 int rdpgfx_write_color32(wStream* s, RDPGFX_COLOR32* color32);
 
-#endif /* FREERDP_CHANNEL_RDPGFX_CLIENT_COMMON_H */
+#endif /* FREERDP_CHANNEL_RDPGFX_COMMON_H */
 
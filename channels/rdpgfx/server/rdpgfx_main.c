@@ -0,0 +1,868 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Graphics Pipeline Extension
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/print.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/channels/log.h>
+
+#include "rdpgfx_common.h"
+#include "rdpgfx_main.h"
+
+#define TAG CHANNELS_TAG("rdpgfx.server")
+
+static wStream* rdpgfx_server_packet_new(UINT16 cmdId, UINT32 pduLength)
+{
+	wStream* s;
+	RDPGFX_HEADER header;
+
+	header.flags = 0;
+	header.cmdId = cmdId;
+	header.pduLength = pduLength;
+
+	s = Stream_New(NULL, pduLength);
+
+	if (!s)
+		return NULL;
+
+	rdpgfx_write_header(s, &header);
+
+	return s;
+}
+
+/**
+ * Server to client PDUs are always wrapped in RDP_SEGMENTED_DATA, the client
+ * PDUs are sent as is. The bulk compressor keeps a history, so PDUs have to
+ * be compressed in the order they are written to the channel.
+ */
+
+static int rdpgfx_server_packet_send(RdpgfxServerContext* context, wStream* s)
+{
+	int status;
+	BOOL written;
+	UINT32 flags = 0;
+	UINT32 DstSize = 0;
+	BYTE* pDstData = NULL;
+	RdpgfxServerPrivate* priv = context->priv;
+
+	Stream_SealLength(s);
+
+	EnterCriticalSection(&(priv->lock));
+
+	status = zgfx_compress(priv->zgfx, Stream_Buffer(s), (UINT32) Stream_Length(s), &pDstData, &DstSize, &flags);
+
+	if (status >= 0)
+	{
+		written = WTSVirtualChannelWrite(priv->ChannelHandle, (PCHAR) pDstData, DstSize, NULL);
+		status = written ? 1 : -1;
+	}
+
+	LeaveCriticalSection(&(priv->lock));
+
+	free(pDstData);
+	Stream_Free(s, TRUE);
+
+	if (status < 0)
+		WLog_ERR(TAG, "failed to send graphics pipeline PDU");
+
+	return status;
+}
+
+static int rdpgfx_send_caps_confirm_pdu(RdpgfxServerContext* context, RDPGFX_CAPS_CONFIRM_PDU* capsConfirm)
+{
+	wStream* s;
+	RDPGFX_CAPSET* capsSet = capsConfirm->capsSet;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_CAPSCONFIRM, RDPGFX_HEADER_SIZE + RDPGFX_CAPSET_SIZE);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT32(s, capsSet->version); /* version (4 bytes) */
+	Stream_Write_UINT32(s, 4); /* capsDataLength (4 bytes) */
+	Stream_Write_UINT32(s, capsSet->flags); /* capsData (4 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_reset_graphics_pdu(RdpgfxServerContext* context, RDPGFX_RESET_GRAPHICS_PDU* pdu)
+{
+	int pad;
+	wStream* s;
+	UINT32 index;
+	MONITOR_DEF* monitor;
+
+	/* the PDU has a fixed size of 340 bytes, which leaves room for 16 monitors */
+
+	if (pdu->monitorCount > 16)
+		return -1;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_RESETGRAPHICS, 340);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT32(s, pdu->width); /* width (4 bytes) */
+	Stream_Write_UINT32(s, pdu->height); /* height (4 bytes) */
+	Stream_Write_UINT32(s, pdu->monitorCount); /* monitorCount (4 bytes) */
+
+	for (index = 0; index < pdu->monitorCount; index++)
+	{
+		monitor = &(pdu->monitorDefArray[index]);
+		Stream_Write_UINT32(s, monitor->left); /* left (4 bytes) */
+		Stream_Write_UINT32(s, monitor->top); /* top (4 bytes) */
+		Stream_Write_UINT32(s, monitor->right); /* right (4 bytes) */
+		Stream_Write_UINT32(s, monitor->bottom); /* bottom (4 bytes) */
+		Stream_Write_UINT32(s, monitor->flags); /* flags (4 bytes) */
+	}
+
+	pad = 340 - (RDPGFX_HEADER_SIZE + 12 + (pdu->monitorCount * 20));
+	Stream_Zero(s, pad); /* pad (total size is 340 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_start_frame_pdu(RdpgfxServerContext* context, RDPGFX_START_FRAME_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_STARTFRAME, RDPGFX_HEADER_SIZE + 8);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT32(s, pdu->timestamp); /* timestamp (4 bytes) */
+	Stream_Write_UINT32(s, pdu->frameId); /* frameId (4 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_end_frame_pdu(RdpgfxServerContext* context, RDPGFX_END_FRAME_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_ENDFRAME, RDPGFX_HEADER_SIZE + 4);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT32(s, pdu->frameId); /* frameId (4 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_wire_to_surface_1_pdu(RdpgfxServerContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+{
+	wStream* s;
+	RDPGFX_RECT16 destRect;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_WIRETOSURFACE_1, RDPGFX_HEADER_SIZE + 17 + cmd->length);
+
+	if (!s)
+		return -1;
+
+	destRect.left = (UINT16) cmd->left;
+	destRect.top = (UINT16) cmd->top;
+	destRect.right = (UINT16) cmd->right;
+	destRect.bottom = (UINT16) cmd->bottom;
+
+	Stream_Write_UINT16(s, cmd->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT16(s, cmd->codecId); /* codecId (2 bytes) */
+	Stream_Write_UINT8(s, cmd->format); /* pixelFormat (1 byte) */
+	rdpgfx_write_rect16(s, &destRect); /* destRect (8 bytes) */
+	Stream_Write_UINT32(s, cmd->length); /* bitmapDataLength (4 bytes) */
+	Stream_Write(s, cmd->data, cmd->length); /* bitmapData (variable) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_wire_to_surface_2_pdu(RdpgfxServerContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_WIRETOSURFACE_2, RDPGFX_HEADER_SIZE + 13 + cmd->length);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, cmd->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT16(s, cmd->codecId); /* codecId (2 bytes) */
+	Stream_Write_UINT32(s, cmd->contextId); /* codecContextId (4 bytes) */
+	Stream_Write_UINT8(s, cmd->format); /* pixelFormat (1 byte) */
+	Stream_Write_UINT32(s, cmd->length); /* bitmapDataLength (4 bytes) */
+	Stream_Write(s, cmd->data, cmd->length); /* bitmapData (variable) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+/**
+ * The progressive codecs keep their state in a codec context and are the only
+ * ones sent with RDPGFX_WIRE_TO_SURFACE_PDU_2, all others carry a destination
+ * rectangle.
+ */
+
+static int rdpgfx_send_surface_command(RdpgfxServerContext* context, RDPGFX_SURFACE_COMMAND* cmd)
+{
+	if ((cmd->codecId == RDPGFX_CODECID_CAPROGRESSIVE) || (cmd->codecId == RDPGFX_CODECID_CAPROGRESSIVE_V2))
+		return rdpgfx_send_wire_to_surface_2_pdu(context, cmd);
+
+	return rdpgfx_send_wire_to_surface_1_pdu(context, cmd);
+}
+
+static int rdpgfx_send_delete_encoding_context_pdu(RdpgfxServerContext* context, RDPGFX_DELETE_ENCODING_CONTEXT_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_DELETEENCODINGCONTEXT, RDPGFX_HEADER_SIZE + 6);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT32(s, pdu->codecContextId); /* codecContextId (4 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_create_surface_pdu(RdpgfxServerContext* context, RDPGFX_CREATE_SURFACE_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_CREATESURFACE, RDPGFX_HEADER_SIZE + 7);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT16(s, pdu->width); /* width (2 bytes) */
+	Stream_Write_UINT16(s, pdu->height); /* height (2 bytes) */
+	Stream_Write_UINT8(s, pdu->pixelFormat); /* RDPGFX_PIXELFORMAT (1 byte) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_delete_surface_pdu(RdpgfxServerContext* context, RDPGFX_DELETE_SURFACE_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_DELETESURFACE, RDPGFX_HEADER_SIZE + 2);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_solid_fill_pdu(RdpgfxServerContext* context, RDPGFX_SOLID_FILL_PDU* pdu)
+{
+	wStream* s;
+	UINT16 index;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_SOLIDFILL, RDPGFX_HEADER_SIZE + 8 + (pdu->fillRectCount * 8));
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+	rdpgfx_write_color32(s, &(pdu->fillPixel)); /* fillPixel (4 bytes) */
+	Stream_Write_UINT16(s, pdu->fillRectCount); /* fillRectCount (2 bytes) */
+
+	for (index = 0; index < pdu->fillRectCount; index++)
+		rdpgfx_write_rect16(s, &(pdu->fillRects[index])); /* fillRects (8 bytes each) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_surface_to_surface_pdu(RdpgfxServerContext* context, RDPGFX_SURFACE_TO_SURFACE_PDU* pdu)
+{
+	wStream* s;
+	UINT16 index;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_SURFACETOSURFACE, RDPGFX_HEADER_SIZE + 14 + (pdu->destPtsCount * 4));
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceIdSrc); /* surfaceIdSrc (2 bytes) */
+	Stream_Write_UINT16(s, pdu->surfaceIdDest); /* surfaceIdDest (2 bytes) */
+	rdpgfx_write_rect16(s, &(pdu->rectSrc)); /* rectSrc (8 bytes) */
+	Stream_Write_UINT16(s, pdu->destPtsCount); /* destPtsCount (2 bytes) */
+
+	for (index = 0; index < pdu->destPtsCount; index++)
+		rdpgfx_write_point16(s, &(pdu->destPts[index])); /* destPts (4 bytes each) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_surface_to_cache_pdu(RdpgfxServerContext* context, RDPGFX_SURFACE_TO_CACHE_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_SURFACETOCACHE, RDPGFX_HEADER_SIZE + 20);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT64(s, pdu->cacheKey); /* cacheKey (8 bytes) */
+	Stream_Write_UINT16(s, pdu->cacheSlot); /* cacheSlot (2 bytes) */
+	rdpgfx_write_rect16(s, &(pdu->rectSrc)); /* rectSrc (8 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_cache_to_surface_pdu(RdpgfxServerContext* context, RDPGFX_CACHE_TO_SURFACE_PDU* pdu)
+{
+	wStream* s;
+	UINT16 index;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_CACHETOSURFACE, RDPGFX_HEADER_SIZE + 6 + (pdu->destPtsCount * 4));
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->cacheSlot); /* cacheSlot (2 bytes) */
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT16(s, pdu->destPtsCount); /* destPtsCount (2 bytes) */
+
+	for (index = 0; index < pdu->destPtsCount; index++)
+		rdpgfx_write_point16(s, &(pdu->destPts[index])); /* destPts (4 bytes each) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_cache_import_reply_pdu(RdpgfxServerContext* context, RDPGFX_CACHE_IMPORT_REPLY_PDU* pdu)
+{
+	wStream* s;
+	UINT16 index;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_CACHEIMPORTREPLY, RDPGFX_HEADER_SIZE + 2 + (pdu->importedEntriesCount * 2));
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->importedEntriesCount); /* importedEntriesCount (2 bytes) */
+
+	for (index = 0; index < pdu->importedEntriesCount; index++)
+		Stream_Write_UINT16(s, pdu->cacheSlots[index]); /* cacheSlot (2 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_evict_cache_entry_pdu(RdpgfxServerContext* context, RDPGFX_EVICT_CACHE_ENTRY_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_EVICTCACHEENTRY, RDPGFX_HEADER_SIZE + 2);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->cacheSlot); /* cacheSlot (2 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_map_surface_to_output_pdu(RdpgfxServerContext* context, RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_MAPSURFACETOOUTPUT, RDPGFX_HEADER_SIZE + 12);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* reserved (2 bytes) */
+	Stream_Write_UINT32(s, pdu->outputOriginX); /* outputOriginX (4 bytes) */
+	Stream_Write_UINT32(s, pdu->outputOriginY); /* outputOriginY (4 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_send_map_surface_to_window_pdu(RdpgfxServerContext* context, RDPGFX_MAP_SURFACE_TO_WINDOW_PDU* pdu)
+{
+	wStream* s;
+
+	s = rdpgfx_server_packet_new(RDPGFX_CMDID_MAPSURFACETOWINDOW, RDPGFX_HEADER_SIZE + 18);
+
+	if (!s)
+		return -1;
+
+	Stream_Write_UINT16(s, pdu->surfaceId); /* surfaceId (2 bytes) */
+	Stream_Write_UINT64(s, pdu->windowId); /* windowId (8 bytes) */
+	Stream_Write_UINT32(s, pdu->mappedWidth); /* mappedWidth (4 bytes) */
+	Stream_Write_UINT32(s, pdu->mappedHeight); /* mappedHeight (4 bytes) */
+
+	return rdpgfx_server_packet_send(context, s);
+}
+
+static int rdpgfx_recv_caps_advertise_pdu(RdpgfxServerContext* context, wStream* s)
+{
+	int status = 1;
+	UINT16 index;
+	UINT32 capsDataLength;
+	RDPGFX_CAPSET* capsSet;
+	RDPGFX_CAPS_ADVERTISE_PDU pdu;
+
+	if (Stream_GetRemainingLength(s) < 2)
+		return -1;
+
+	Stream_Read_UINT16(s, pdu.capsSetCount); /* capsSetCount (2 bytes) */
+
+	if (Stream_GetRemainingLength(s) < (size_t) (pdu.capsSetCount * RDPGFX_CAPSET_SIZE))
+		return -1;
+
+	pdu.capsSets = (RDPGFX_CAPSET*) calloc(pdu.capsSetCount, sizeof(RDPGFX_CAPSET));
+
+	if (!pdu.capsSets)
+		return -1;
+
+	for (index = 0; index < pdu.capsSetCount; index++)
+	{
+		capsSet = &(pdu.capsSets[index]);
+
+		if (Stream_GetRemainingLength(s) < 8)
+		{
+			free(pdu.capsSets);
+			return -1;
+		}
+
+		Stream_Read_UINT32(s, capsSet->version); /* version (4 bytes) */
+		Stream_Read_UINT32(s, capsDataLength); /* capsDataLength (4 bytes) */
+
+		if ((capsDataLength < 4) || (Stream_GetRemainingLength(s) < capsDataLength))
+		{
+			free(pdu.capsSets);
+			return -1;
+		}
+
+		Stream_Read_UINT32(s, capsSet->flags); /* capsData (4 bytes) */
+		Stream_Seek(s, capsDataLength - 4);
+	}
+
+	WLog_DBG(TAG, "RecvCapsAdvertisePdu: capsSetCount: %d", pdu.capsSetCount);
+
+	if (context->CapsAdvertise)
+		status = context->CapsAdvertise(context, &pdu);
+
+	free(pdu.capsSets);
+
+	return status;
+}
+
+static int rdpgfx_recv_frame_acknowledge_pdu(RdpgfxServerContext* context, wStream* s)
+{
+	RDPGFX_FRAME_ACKNOWLEDGE_PDU pdu;
+
+	if (Stream_GetRemainingLength(s) < 12)
+		return -1;
+
+	Stream_Read_UINT32(s, pdu.queueDepth); /* queueDepth (4 bytes) */
+	Stream_Read_UINT32(s, pdu.frameId); /* frameId (4 bytes) */
+	Stream_Read_UINT32(s, pdu.totalFramesDecoded); /* totalFramesDecoded (4 bytes) */
+
+	WLog_DBG(TAG, "RecvFrameAcknowledgePdu: frameId: %d queueDepth: %d", pdu.frameId, pdu.queueDepth);
+
+	if (context->FrameAcknowledge)
+		context->FrameAcknowledge(context, &pdu);
+
+	return 1;
+}
+
+static int rdpgfx_recv_cache_import_offer_pdu(RdpgfxServerContext* context, wStream* s)
+{
+	UINT16 index;
+	RDPGFX_CACHE_ENTRY_METADATA* cacheEntry;
+	RDPGFX_CACHE_IMPORT_OFFER_PDU pdu;
+
+	if (Stream_GetRemainingLength(s) < 2)
+		return -1;
+
+	Stream_Read_UINT16(s, pdu.cacheEntriesCount); /* cacheEntriesCount (2 bytes) */
+
+	if (Stream_GetRemainingLength(s) < (size_t) (pdu.cacheEntriesCount * 12))
+		return -1;
+
+	pdu.cacheEntries = (RDPGFX_CACHE_ENTRY_METADATA*) calloc(pdu.cacheEntriesCount,
+			sizeof(RDPGFX_CACHE_ENTRY_METADATA));
+
+	if (!pdu.cacheEntries)
+		return -1;
+
+	for (index = 0; index < pdu.cacheEntriesCount; index++)
+	{
+		cacheEntry = &(pdu.cacheEntries[index]);
+		Stream_Read_UINT64(s, cacheEntry->cacheKey); /* cacheKey (8 bytes) */
+		Stream_Read_UINT32(s, cacheEntry->bitmapLength); /* bitmapLength (4 bytes) */
+	}
+
+	WLog_DBG(TAG, "RecvCacheImportOfferPdu: cacheEntriesCount: %d", pdu.cacheEntriesCount);
+
+	if (context->CacheImportOffer)
+		context->CacheImportOffer(context, &pdu);
+
+	free(pdu.cacheEntries);
+
+	return 1;
+}
+
+static int rdpgfx_server_receive_pdu(RdpgfxServerContext* context, wStream* s)
+{
+	int status;
+	size_t beg, end;
+	RDPGFX_HEADER header;
+
+	beg = Stream_GetPosition(s);
+
+	if (rdpgfx_read_header(s, &header) < 0)
+		return -1;
+
+	if ((header.pduLength < RDPGFX_HEADER_SIZE) ||
+			(Stream_GetRemainingLength(s) < (header.pduLength - RDPGFX_HEADER_SIZE)))
+		return -1;
+
+	switch (header.cmdId)
+	{
+		case RDPGFX_CMDID_CAPSADVERTISE:
+			status = rdpgfx_recv_caps_advertise_pdu(context, s);
+			break;
+
+		case RDPGFX_CMDID_FRAMEACKNOWLEDGE:
+			status = rdpgfx_recv_frame_acknowledge_pdu(context, s);
+			break;
+
+		case RDPGFX_CMDID_CACHEIMPORTOFFER:
+			status = rdpgfx_recv_cache_import_offer_pdu(context, s);
+			break;
+
+		default:
+			status = -1;
+			break;
+	}
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "Error while parsing GFX cmdId: %s (0x%04X)",
+				rdpgfx_get_cmd_id_string(header.cmdId), header.cmdId);
+		return -1;
+	}
+
+	end = Stream_GetPosition(s);
+
+	if (end != (beg + header.pduLength))
+	{
+		WLog_ERR(TAG, "Unexpected gfx pdu end: Actual: %d, Expected: %d",
+				(int) end, (int) (beg + header.pduLength));
+		Stream_SetPosition(s, (beg + header.pduLength));
+	}
+
+	return status;
+}
+
+static BOOL rdpgfx_server_open_channel(RdpgfxServerContext* context)
+{
+	DWORD Error;
+	HANDLE hEvent;
+	DWORD StartTick;
+	DWORD BytesReturned = 0;
+	PULONG pSessionId = NULL;
+	RdpgfxServerPrivate* priv = context->priv;
+
+	if (WTSQuerySessionInformationA(context->vcm, WTS_CURRENT_SESSION,
+			WTSSessionId, (LPSTR*) &pSessionId, &BytesReturned) == FALSE)
+	{
+		return FALSE;
+	}
+
+	priv->SessionId = (DWORD) *pSessionId;
+	WTSFreeMemory(pSessionId);
+
+	hEvent = WTSVirtualChannelManagerGetEventHandle(context->vcm);
+	StartTick = GetTickCount();
+
+	/* the dynamic channel can only be created once drdynvc is ready */
+
+	while (!priv->ChannelHandle)
+	{
+		if (WaitForSingleObject(priv->StopEvent, 0) == WAIT_OBJECT_0)
+			break;
+
+		WaitForSingleObject(hEvent, 1000);
+
+		priv->ChannelHandle = WTSVirtualChannelOpenEx(priv->SessionId,
+				RDPGFX_DVC_CHANNEL_NAME, WTS_CHANNEL_OPTION_DYNAMIC);
+
+		if (priv->ChannelHandle)
+			break;
+
+		Error = GetLastError();
+
+		if (Error == ERROR_NOT_FOUND)
+			break;
+
+		if (GetTickCount() - StartTick > 5000)
+			break;
+	}
+
+	return priv->ChannelHandle ? TRUE : FALSE;
+}
+
+static void* rdpgfx_server_thread(void* arg)
+{
+	wStream* s;
+	int status;
+	void* buffer;
+	DWORD nCount;
+	HANDLE events[8];
+	BOOL ready = FALSE;
+	HANDLE ChannelEvent;
+	DWORD BytesReturned = 0;
+	RdpgfxServerContext* context = (RdpgfxServerContext*) arg;
+	RdpgfxServerPrivate* priv = context->priv;
+
+	if (!rdpgfx_server_open_channel(context))
+	{
+		IFCALL(context->OpenResult, context, RDPGFX_SERVER_OPEN_RESULT_NOTSUPPORTED);
+		return NULL;
+	}
+
+	buffer = NULL;
+	ChannelEvent = NULL;
+
+	if (WTSVirtualChannelQuery(priv->ChannelHandle, WTSVirtualEventHandle, &buffer, &BytesReturned) == TRUE)
+	{
+		if (BytesReturned == sizeof(HANDLE))
+			CopyMemory(&ChannelEvent, buffer, sizeof(HANDLE));
+
+		WTSFreeMemory(buffer);
+	}
+
+	if (!ChannelEvent)
+	{
+		IFCALL(context->OpenResult, context, RDPGFX_SERVER_OPEN_RESULT_ERROR);
+		return NULL;
+	}
+
+	nCount = 0;
+	events[nCount++] = priv->StopEvent;
+	events[nCount++] = ChannelEvent;
+
+	/* wait for the client to confirm that the dynamic channel is open */
+
+	while (1)
+	{
+		if (WaitForMultipleObjects(nCount, events, FALSE, 100) == WAIT_OBJECT_0)
+		{
+			IFCALL(context->OpenResult, context, RDPGFX_SERVER_OPEN_RESULT_CLOSED);
+			break;
+		}
+
+		if (WTSVirtualChannelQuery(priv->ChannelHandle, WTSVirtualChannelReady, &buffer, &BytesReturned) == FALSE)
+		{
+			IFCALL(context->OpenResult, context, RDPGFX_SERVER_OPEN_RESULT_ERROR);
+			break;
+		}
+
+		ready = *((BOOL*) buffer);
+
+		WTSFreeMemory(buffer);
+
+		if (ready)
+		{
+			IFCALL(context->OpenResult, context, RDPGFX_SERVER_OPEN_RESULT_OK);
+			break;
+		}
+	}
+
+	s = Stream_New(NULL, 4096);
+
+	while (ready && s)
+	{
+		if (WaitForMultipleObjects(nCount, events, FALSE, INFINITE) == WAIT_OBJECT_0)
+			break;
+
+		WTSVirtualChannelRead(priv->ChannelHandle, 0, NULL, 0, &BytesReturned);
+
+		if (BytesReturned < 1)
+			continue;
+
+		Stream_SetPosition(s, 0);
+
+		if (!Stream_EnsureCapacity(s, BytesReturned))
+			break;
+
+		if (!WTSVirtualChannelRead(priv->ChannelHandle, 0, (PCHAR) Stream_Buffer(s),
+				(ULONG) Stream_Capacity(s), &BytesReturned))
+		{
+			break;
+		}
+
+		Stream_SetLength(s, BytesReturned);
+
+		while (Stream_GetRemainingLength(s) >= RDPGFX_HEADER_SIZE)
+		{
+			status = rdpgfx_server_receive_pdu(context, s);
+
+			if (status < 0)
+				break;
+		}
+	}
+
+	Stream_Free(s, TRUE);
+
+	return NULL;
+}
+
+static int rdpgfx_server_open(RdpgfxServerContext* context)
+{
+	RdpgfxServerPrivate* priv = context->priv;
+
+	if (priv->Thread)
+		return 0;
+
+	priv->StopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!priv->StopEvent)
+		return -1;
+
+	priv->Thread = CreateThread(NULL, 0,
+			(LPTHREAD_START_ROUTINE) rdpgfx_server_thread, (void*) context, 0, NULL);
+
+	if (!priv->Thread)
+	{
+		CloseHandle(priv->StopEvent);
+		priv->StopEvent = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int rdpgfx_server_close(RdpgfxServerContext* context)
+{
+	RdpgfxServerPrivate* priv = context->priv;
+
+	if (priv->Thread)
+	{
+		SetEvent(priv->StopEvent);
+		WaitForSingleObject(priv->Thread, INFINITE);
+		CloseHandle(priv->Thread);
+		CloseHandle(priv->StopEvent);
+		priv->Thread = NULL;
+		priv->StopEvent = NULL;
+	}
+
+	if (priv->ChannelHandle)
+	{
+		WTSVirtualChannelClose(priv->ChannelHandle);
+		priv->ChannelHandle = NULL;
+	}
+
+	zgfx_context_reset(priv->zgfx, FALSE);
+
+	return 0;
+}
+
+RdpgfxServerContext* rdpgfx_server_context_new(HANDLE vcm)
+{
+	RdpgfxServerContext* context;
+	RdpgfxServerPrivate* priv;
+
+	context = (RdpgfxServerContext*) calloc(1, sizeof(RdpgfxServerContext));
+
+	if (!context)
+		return NULL;
+
+	context->vcm = vcm;
+
+	context->Open = rdpgfx_server_open;
+	context->Close = rdpgfx_server_close;
+
+	context->ResetGraphics = rdpgfx_send_reset_graphics_pdu;
+	context->StartFrame = rdpgfx_send_start_frame_pdu;
+	context->EndFrame = rdpgfx_send_end_frame_pdu;
+	context->SurfaceCommand = rdpgfx_send_surface_command;
+	context->DeleteEncodingContext = rdpgfx_send_delete_encoding_context_pdu;
+	context->CreateSurface = rdpgfx_send_create_surface_pdu;
+	context->DeleteSurface = rdpgfx_send_delete_surface_pdu;
+	context->SolidFill = rdpgfx_send_solid_fill_pdu;
+	context->SurfaceToSurface = rdpgfx_send_surface_to_surface_pdu;
+	context->SurfaceToCache = rdpgfx_send_surface_to_cache_pdu;
+	context->CacheToSurface = rdpgfx_send_cache_to_surface_pdu;
+	context->CacheImportReply = rdpgfx_send_cache_import_reply_pdu;
+	context->EvictCacheEntry = rdpgfx_send_evict_cache_entry_pdu;
+	context->MapSurfaceToOutput = rdpgfx_send_map_surface_to_output_pdu;
+	context->MapSurfaceToWindow = rdpgfx_send_map_surface_to_window_pdu;
+	context->CapsConfirm = rdpgfx_send_caps_confirm_pdu;
+
+	priv = context->priv = (RdpgfxServerPrivate*) calloc(1, sizeof(RdpgfxServerPrivate));
+
+	if (!priv)
+		goto fail;
+
+	if (!InitializeCriticalSectionAndSpinCount(&(priv->lock), 4000))
+	{
+		free(priv);
+		context->priv = NULL;
+		goto fail;
+	}
+
+	priv->zgfx = zgfx_context_new(TRUE);
+
+	if (!priv->zgfx)
+	{
+		DeleteCriticalSection(&(priv->lock));
+		free(priv);
+		context->priv = NULL;
+		goto fail;
+	}
+
+	return context;
+
+fail:
+	free(context);
+	return NULL;
+}
+
+void rdpgfx_server_context_free(RdpgfxServerContext* context)
+{
+	if (!context)
+		return;
+
+	if (context->priv)
+	{
+		rdpgfx_server_close(context);
+
+		zgfx_context_free(context->priv->zgfx);
+		DeleteCriticalSection(&(context->priv->lock));
+
+		free(context->priv);
+	}
+
+	free(context);
+}
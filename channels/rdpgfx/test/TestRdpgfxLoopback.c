@@ -0,0 +1,642 @@
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+#include <winpr/wtsapi.h>
+#include <winpr/collections.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/dvc.h>
+#include <freerdp/channels/channels.h>
+#include <freerdp/client/rdpgfx.h>
+#include <freerdp/server/rdpgfx.h>
+
+/**
+ * The rdpgfx server runs against the in-tree rdpgfx client: a WtsApi table
+ * hands every server write to the client plugin, client writes are queued
+ * for the server channel thread to read.
+ */
+
+#ifdef STATIC_CHANNELS
+#define TEST_DVC_PLUGIN_ENTRY	rdpgfx_DVCPluginEntry
+#else
+#define TEST_DVC_PLUGIN_ENTRY	DVCPluginEntry
+#endif
+
+int TEST_DVC_PLUGIN_ENTRY(IDRDYNVC_ENTRY_POINTS* pEntryPoints);
+
+#define TEST_TIMEOUT		10000
+#define TEST_SURFACE_ID		7
+#define TEST_FRAME_ID		42
+#define TEST_OFFER_COUNT	1000
+
+struct test_loopback
+{
+	BOOL noEventHandle;
+	wQueue* serverInput;
+
+	IWTSPlugin* plugin;
+	IWTSListenerCallback* listenerCallback;
+	IWTSVirtualChannelCallback* channelCallback;
+
+	IDRDYNVC_ENTRY_POINTS entryPoints;
+	IWTSVirtualChannelManager channelMgr;
+	IWTSVirtualChannel channel;
+	IWTSListener listener;
+	rdpSettings* settings;
+
+	HANDLE openEvent;
+	HANDLE ackEvent;
+	HANDLE offerEvent;
+	RDPGFX_SERVER_OPEN_RESULT openResult;
+	UINT32 capsVersion;
+	UINT32 ackFrameId;
+	UINT16 offerCount;
+
+	int surfaces;
+	int fills;
+	UINT32 startFrameId;
+	UINT32 endFrameId;
+	RDPGFX_COLOR32 fillPixel;
+	RDPGFX_RECT16 fillRect;
+};
+
+static struct test_loopback g_Loopback;
+
+static WtsApiFunctionTable g_TestWtsApi;
+
+/* client side */
+
+static int test_client_channel_write(IWTSVirtualChannel* pChannel, UINT32 cbSize, BYTE* pBuffer, void* pReserved)
+{
+	wStream* s;
+
+	s = Stream_New(NULL, cbSize);
+
+	if (!s)
+		return -1;
+
+	Stream_Write(s, pBuffer, cbSize);
+	Stream_SealLength(s);
+
+	if (!Queue_Enqueue(g_Loopback.serverInput, s))
+	{
+		Stream_Free(s, TRUE);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_client_create_listener(IWTSVirtualChannelManager* pChannelMgr, const char* pszChannelName,
+		UINT32 ulFlags, IWTSListenerCallback* pListenerCallback, IWTSListener** ppListener)
+{
+	g_Loopback.listenerCallback = pListenerCallback;
+	*ppListener = &g_Loopback.listener;
+	return 0;
+}
+
+static int test_client_register_plugin(IDRDYNVC_ENTRY_POINTS* pEntryPoints, const char* name, IWTSPlugin* pPlugin)
+{
+	g_Loopback.plugin = pPlugin;
+	return 0;
+}
+
+static IWTSPlugin* test_client_get_plugin(IDRDYNVC_ENTRY_POINTS* pEntryPoints, const char* name)
+{
+	return g_Loopback.plugin;
+}
+
+static void* test_client_get_rdp_settings(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return g_Loopback.settings;
+}
+
+static int test_client_create_surface(RdpgfxClientContext* context, RDPGFX_CREATE_SURFACE_PDU* createSurface)
+{
+	if (createSurface->surfaceId == TEST_SURFACE_ID)
+		g_Loopback.surfaces++;
+
+	return 1;
+}
+
+static int test_client_start_frame(RdpgfxClientContext* context, RDPGFX_START_FRAME_PDU* startFrame)
+{
+	g_Loopback.startFrameId = startFrame->frameId;
+	return 1;
+}
+
+static int test_client_end_frame(RdpgfxClientContext* context, RDPGFX_END_FRAME_PDU* endFrame)
+{
+	g_Loopback.endFrameId = endFrame->frameId;
+	return 1;
+}
+
+static int test_client_solid_fill(RdpgfxClientContext* context, RDPGFX_SOLID_FILL_PDU* solidFill)
+{
+	if ((solidFill->surfaceId != TEST_SURFACE_ID) || (solidFill->fillRectCount != 1))
+		return -1;
+
+	g_Loopback.fills++;
+	g_Loopback.fillPixel = solidFill->fillPixel;
+	g_Loopback.fillRect = solidFill->fillRects[0];
+
+	return 1;
+}
+
+/* server side */
+
+static BOOL WINAPI test_WTSQuerySessionInformationA(HANDLE hServer, DWORD SessionId,
+		WTS_INFO_CLASS WTSInfoClass, LPSTR* ppBuffer, DWORD* pBytesReturned)
+{
+	ULONG* pSessionId;
+
+	if (WTSInfoClass != WTSSessionId)
+		return FALSE;
+
+	pSessionId = (ULONG*) malloc(sizeof(ULONG));
+
+	if (!pSessionId)
+		return FALSE;
+
+	*pSessionId = 1;
+	*ppBuffer = (LPSTR) pSessionId;
+	*pBytesReturned = sizeof(ULONG);
+
+	return TRUE;
+}
+
+static HANDLE WINAPI test_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualName, DWORD flags)
+{
+	int bAccept = 1;
+
+	/* the dynamic channel create request reaches the client listener */
+
+	if (g_Loopback.listenerCallback->OnNewChannelConnection(g_Loopback.listenerCallback,
+			&g_Loopback.channel, NULL, &bAccept, &g_Loopback.channelCallback) < 0)
+		return NULL;
+
+	g_Loopback.channelCallback->OnOpen(g_Loopback.channelCallback);
+
+	return (HANDLE) &g_Loopback.channel;
+}
+
+static BOOL WINAPI test_WTSVirtualChannelClose(HANDLE hChannelHandle)
+{
+	if (g_Loopback.channelCallback)
+	{
+		g_Loopback.channelCallback->OnClose(g_Loopback.channelCallback);
+		g_Loopback.channelCallback = NULL;
+	}
+
+	return TRUE;
+}
+
+static BOOL WINAPI test_WTSVirtualChannelRead(HANDLE hChannelHandle, ULONG TimeOut,
+		PCHAR Buffer, ULONG BufferSize, PULONG pBytesRead)
+{
+	wStream* s;
+
+	*pBytesRead = 0;
+	s = (wStream*) Queue_Peek(g_Loopback.serverInput);
+
+	if (!s)
+		return TRUE;
+
+	*pBytesRead = (ULONG) Stream_Length(s);
+
+	if (!Buffer || (BufferSize < *pBytesRead))
+		return FALSE;
+
+	CopyMemory(Buffer, Stream_Buffer(s), *pBytesRead);
+	Stream_Free((wStream*) Queue_Dequeue(g_Loopback.serverInput), TRUE);
+
+	return TRUE;
+}
+
+static BOOL WINAPI test_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
+		ULONG Length, PULONG pBytesWritten)
+{
+	wStream* s;
+	int status;
+
+	if (!g_Loopback.channelCallback)
+		return FALSE;
+
+	s = Stream_New(NULL, Length);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write(s, Buffer, Length);
+	Stream_SealLength(s);
+	Stream_SetPosition(s, 0);
+
+	status = g_Loopback.channelCallback->OnDataReceived(g_Loopback.channelCallback, s);
+
+	Stream_Free(s, TRUE);
+
+	if (pBytesWritten)
+		*pBytesWritten = Length;
+
+	return (status < 0) ? FALSE : TRUE;
+}
+
+static BOOL WINAPI test_WTSVirtualChannelQuery(HANDLE hChannelHandle, WTS_VIRTUAL_CLASS WtsVirtualClass,
+		PVOID* ppBuffer, DWORD* pBytesReturned)
+{
+	if (WtsVirtualClass == WTSVirtualEventHandle)
+	{
+		HANDLE* pEvent;
+
+		if (g_Loopback.noEventHandle)
+			return FALSE;
+
+		pEvent = (HANDLE*) malloc(sizeof(HANDLE));
+
+		if (!pEvent)
+			return FALSE;
+
+		*pEvent = Queue_Event(g_Loopback.serverInput);
+		*ppBuffer = pEvent;
+		*pBytesReturned = sizeof(HANDLE);
+
+		return TRUE;
+	}
+	else if (WtsVirtualClass == WTSVirtualChannelReady)
+	{
+		BOOL* pReady;
+
+		pReady = (BOOL*) malloc(sizeof(BOOL));
+
+		if (!pReady)
+			return FALSE;
+
+		*pReady = TRUE;
+		*ppBuffer = pReady;
+		*pBytesReturned = sizeof(BOOL);
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static VOID WINAPI test_WTSFreeMemory(PVOID pMemory)
+{
+	free(pMemory);
+}
+
+static void test_server_open_result(RdpgfxServerContext* context, RDPGFX_SERVER_OPEN_RESULT result)
+{
+	g_Loopback.openResult = result;
+	SetEvent(g_Loopback.openEvent);
+}
+
+static int test_server_caps_advertise(RdpgfxServerContext* context, RDPGFX_CAPS_ADVERTISE_PDU* capsAdvertise)
+{
+	RDPGFX_CAPS_CONFIRM_PDU pdu;
+
+	if (capsAdvertise->capsSetCount < 1)
+		return -1;
+
+	pdu.capsSet = &(capsAdvertise->capsSets[0]);
+	g_Loopback.capsVersion = pdu.capsSet->version;
+
+	return context->CapsConfirm(context, &pdu);
+}
+
+static int test_server_frame_acknowledge(RdpgfxServerContext* context, RDPGFX_FRAME_ACKNOWLEDGE_PDU* frameAcknowledge)
+{
+	g_Loopback.ackFrameId = frameAcknowledge->frameId;
+	SetEvent(g_Loopback.ackEvent);
+	return 1;
+}
+
+static int test_server_cache_import_offer(RdpgfxServerContext* context, RDPGFX_CACHE_IMPORT_OFFER_PDU* cacheImportOffer)
+{
+	g_Loopback.offerCount = cacheImportOffer->cacheEntriesCount;
+	SetEvent(g_Loopback.offerEvent);
+	return 1;
+}
+
+/**
+ * A cache import offer larger than the initial server read buffer,
+ * queued as if the client had written it.
+ */
+static BOOL test_queue_cache_import_offer(UINT16 count)
+{
+	UINT16 index;
+	wStream* s;
+	UINT32 pduLength = 8 + 2 + (count * 12);
+
+	s = Stream_New(NULL, pduLength);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT16(s, RDPGFX_CMDID_CACHEIMPORTOFFER); /* cmdId (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* flags (2 bytes) */
+	Stream_Write_UINT32(s, pduLength); /* pduLength (4 bytes) */
+	Stream_Write_UINT16(s, count); /* cacheEntriesCount (2 bytes) */
+
+	for (index = 0; index < count; index++)
+	{
+		Stream_Write_UINT64(s, index); /* cacheKey (8 bytes) */
+		Stream_Write_UINT32(s, 64 * 64 * 4); /* bitmapLength (4 bytes) */
+	}
+
+	Stream_SealLength(s);
+
+	if (!Queue_Enqueue(g_Loopback.serverInput, s))
+	{
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int test_rdpgfx_loopback_init(void)
+{
+	RdpgfxClientContext* gfx;
+
+	ZeroMemory(&g_Loopback, sizeof(g_Loopback));
+
+	g_Loopback.serverInput = Queue_New(TRUE, -1, -1);
+	g_Loopback.openEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_Loopback.ackEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_Loopback.offerEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_Loopback.settings = freerdp_settings_new(0);
+
+	if (!g_Loopback.serverInput || !g_Loopback.openEvent || !g_Loopback.ackEvent ||
+			!g_Loopback.offerEvent || !g_Loopback.settings)
+		return -1;
+
+	g_Loopback.entryPoints.RegisterPlugin = test_client_register_plugin;
+	g_Loopback.entryPoints.GetPlugin = test_client_get_plugin;
+	g_Loopback.entryPoints.GetRdpSettings = test_client_get_rdp_settings;
+	g_Loopback.channelMgr.CreateListener = test_client_create_listener;
+	g_Loopback.channel.Write = test_client_channel_write;
+
+	if ((TEST_DVC_PLUGIN_ENTRY(&g_Loopback.entryPoints) < 0) || !g_Loopback.plugin)
+		return -1;
+
+	gfx = (RdpgfxClientContext*) g_Loopback.plugin->pInterface;
+	gfx->CreateSurface = test_client_create_surface;
+	gfx->StartFrame = test_client_start_frame;
+	gfx->EndFrame = test_client_end_frame;
+	gfx->SolidFill = test_client_solid_fill;
+
+	if (g_Loopback.plugin->Initialize(g_Loopback.plugin, &g_Loopback.channelMgr) < 0)
+		return -1;
+
+	return 1;
+}
+
+static void test_rdpgfx_loopback_uninit(void)
+{
+	wStream* s;
+	void* gfx = NULL;
+
+	if (g_Loopback.plugin)
+	{
+		gfx = g_Loopback.plugin->pInterface;
+		g_Loopback.plugin->Terminated(g_Loopback.plugin);
+	}
+
+	free(gfx);
+
+	if (g_Loopback.serverInput)
+	{
+		while ((s = (wStream*) Queue_Dequeue(g_Loopback.serverInput)) != NULL)
+			Stream_Free(s, TRUE);
+
+		Queue_Free(g_Loopback.serverInput);
+	}
+
+	if (g_Loopback.openEvent)
+		CloseHandle(g_Loopback.openEvent);
+
+	if (g_Loopback.ackEvent)
+		CloseHandle(g_Loopback.ackEvent);
+
+	if (g_Loopback.offerEvent)
+		CloseHandle(g_Loopback.offerEvent);
+
+	freerdp_settings_free(g_Loopback.settings);
+}
+
+static int test_rdpgfx_loopback_frame(HANDLE vcm)
+{
+	int status = -1;
+	RDPGFX_RECT16 rect;
+	RDPGFX_SOLID_FILL_PDU solidFill;
+	RDPGFX_CREATE_SURFACE_PDU createSurface;
+	RDPGFX_START_FRAME_PDU startFrame;
+	RDPGFX_END_FRAME_PDU endFrame;
+	RdpgfxServerContext* context;
+
+	if (test_rdpgfx_loopback_init() < 0)
+		goto out;
+
+	context = rdpgfx_server_context_new(vcm);
+
+	if (!context)
+		goto out;
+
+	context->OpenResult = test_server_open_result;
+	context->CapsAdvertise = test_server_caps_advertise;
+	context->FrameAcknowledge = test_server_frame_acknowledge;
+	context->CacheImportOffer = test_server_cache_import_offer;
+
+	if (context->Open(context) < 0)
+		goto fail;
+
+	if (WaitForSingleObject(g_Loopback.openEvent, TEST_TIMEOUT) != WAIT_OBJECT_0)
+	{
+		printf("rdpgfx server did not report an open result\n");
+		goto fail;
+	}
+
+	if (g_Loopback.openResult != RDPGFX_SERVER_OPEN_RESULT_OK)
+	{
+		printf("rdpgfx server open result: %d\n", g_Loopback.openResult);
+		goto fail;
+	}
+
+	createSurface.surfaceId = TEST_SURFACE_ID;
+	createSurface.width = 64;
+	createSurface.height = 48;
+	createSurface.pixelFormat = PIXEL_FORMAT_XRGB_8888;
+
+	startFrame.timestamp = 0;
+	startFrame.frameId = TEST_FRAME_ID;
+
+	rect.left = 1;
+	rect.top = 2;
+	rect.right = 33;
+	rect.bottom = 44;
+
+	solidFill.surfaceId = TEST_SURFACE_ID;
+	solidFill.fillPixel.B = 0x11;
+	solidFill.fillPixel.G = 0x22;
+	solidFill.fillPixel.R = 0x33;
+	solidFill.fillPixel.XA = 0xFF;
+	solidFill.fillRectCount = 1;
+	solidFill.fillRects = &rect;
+
+	endFrame.frameId = TEST_FRAME_ID;
+
+	if ((context->CreateSurface(context, &createSurface) < 0) ||
+			(context->StartFrame(context, &startFrame) < 0) ||
+			(context->SolidFill(context, &solidFill) < 0) ||
+			(context->EndFrame(context, &endFrame) < 0))
+	{
+		printf("rdpgfx server failed to send a frame\n");
+		goto fail;
+	}
+
+	if ((g_Loopback.surfaces != 1) || (g_Loopback.fills != 1) ||
+			(g_Loopback.startFrameId != TEST_FRAME_ID) || (g_Loopback.endFrameId != TEST_FRAME_ID))
+	{
+		printf("rdpgfx client decoded surfaces: %d fills: %d frame: %u/%u\n", g_Loopback.surfaces,
+				g_Loopback.fills, g_Loopback.startFrameId, g_Loopback.endFrameId);
+		goto fail;
+	}
+
+	if ((g_Loopback.fillPixel.R != 0x33) || (g_Loopback.fillPixel.G != 0x22) ||
+			(g_Loopback.fillPixel.B != 0x11) || (g_Loopback.fillRect.left != 1) ||
+			(g_Loopback.fillRect.top != 2) || (g_Loopback.fillRect.right != 33) ||
+			(g_Loopback.fillRect.bottom != 44))
+	{
+		printf("rdpgfx client decoded a different solid fill\n");
+		goto fail;
+	}
+
+	if ((WaitForSingleObject(g_Loopback.ackEvent, TEST_TIMEOUT) != WAIT_OBJECT_0) ||
+			(g_Loopback.ackFrameId != TEST_FRAME_ID))
+	{
+		printf("rdpgfx server did not receive the frame acknowledgement\n");
+		goto fail;
+	}
+
+	if (!g_Loopback.capsVersion)
+	{
+		printf("rdpgfx server did not receive the client capabilities\n");
+		goto fail;
+	}
+
+	if (!test_queue_cache_import_offer(TEST_OFFER_COUNT))
+		goto fail;
+
+	if ((WaitForSingleObject(g_Loopback.offerEvent, TEST_TIMEOUT) != WAIT_OBJECT_0) ||
+			(g_Loopback.offerCount != TEST_OFFER_COUNT))
+	{
+		printf("rdpgfx server did not receive the cache import offer\n");
+		goto fail;
+	}
+
+	status = 1;
+
+fail:
+	context->Close(context);
+	rdpgfx_server_context_free(context);
+out:
+	test_rdpgfx_loopback_uninit();
+	return status;
+}
+
+static int test_rdpgfx_loopback_no_event(HANDLE vcm)
+{
+	int status = -1;
+	RdpgfxServerContext* context;
+
+	if (test_rdpgfx_loopback_init() < 0)
+		goto out;
+
+	g_Loopback.noEventHandle = TRUE;
+
+	context = rdpgfx_server_context_new(vcm);
+
+	if (!context)
+		goto out;
+
+	context->OpenResult = test_server_open_result;
+
+	if ((context->Open(context) < 0) ||
+			(WaitForSingleObject(g_Loopback.openEvent, TEST_TIMEOUT) != WAIT_OBJECT_0))
+	{
+		printf("rdpgfx server did not report an open result\n");
+		goto fail;
+	}
+
+	/* without a channel event handle the open has to fail */
+
+	if (g_Loopback.openResult != RDPGFX_SERVER_OPEN_RESULT_ERROR)
+	{
+		printf("rdpgfx server open result without event handle: %d\n", g_Loopback.openResult);
+		goto fail;
+	}
+
+	status = 1;
+
+fail:
+	context->Close(context);
+	rdpgfx_server_context_free(context);
+out:
+	test_rdpgfx_loopback_uninit();
+	return status;
+}
+
+int TestRdpgfxLoopback(int argc, char* argv[])
+{
+	int status = -1;
+	HANDLE vcm;
+	rdpContext context;
+	freerdp_peer peer;
+	PWtsApiFunctionTable wtsApi;
+
+	/**
+	 * The channel manager of a peer without a connection provides the event
+	 * handle the server waits on, the channel calls are redirected.
+	 */
+
+	wtsApi = FreeRDP_InitWtsApi();
+	CopyMemory(&g_TestWtsApi, wtsApi, sizeof(WtsApiFunctionTable));
+
+	g_TestWtsApi.pQuerySessionInformationA = test_WTSQuerySessionInformationA;
+	g_TestWtsApi.pVirtualChannelOpenEx = test_WTSVirtualChannelOpenEx;
+	g_TestWtsApi.pVirtualChannelClose = test_WTSVirtualChannelClose;
+	g_TestWtsApi.pVirtualChannelRead = test_WTSVirtualChannelRead;
+	g_TestWtsApi.pVirtualChannelWrite = test_WTSVirtualChannelWrite;
+	g_TestWtsApi.pVirtualChannelQuery = test_WTSVirtualChannelQuery;
+	g_TestWtsApi.pFreeMemory = test_WTSFreeMemory;
+
+	WTSRegisterWtsApiFunctionTable(&g_TestWtsApi);
+
+	ZeroMemory(&context, sizeof(context));
+	ZeroMemory(&peer, sizeof(peer));
+	context.peer = &peer;
+
+	vcm = WTSOpenServerA((LPSTR) &context);
+
+	if (!vcm || (vcm == INVALID_HANDLE_VALUE))
+		return -1;
+
+	if (test_rdpgfx_loopback_frame(vcm) < 0)
+		goto out;
+
+	if (test_rdpgfx_loopback_no_event(vcm) < 0)
+		goto out;
+
+	status = 0;
+
+out:
+	WTSCloseServer(vcm);
+	return status;
+}
@@ -22,6 +22,8 @@
 
 typedef struct _CLEAR_CONTEXT CLEAR_CONTEXT;
 
+#include <winpr/stream.h>
+
 #include <freerdp/api.h>
 #include <freerdp/types.h>
 
@@ -60,13 +62,28 @@ struct _CLEAR_CONTEXT
 	CLEAR_VBAR_ENTRY VBarStorage[32768];
 	UINT32 ShortVBarStorageCursor;
 	CLEAR_VBAR_ENTRY ShortVBarStorage[16384];
+
+	/* Compressor: hash tables into the caches above, which mirror the decoder */
+	wStream* Stream;
+	wStream* BandsStream;
+	wStream* SubcodecStream;
+	BOOL CacheReset;
+	UINT32 GlyphCacheCursor;
+	UINT32* GlyphHashTable;
+	UINT32* VBarHashTable;
+	UINT32* ShortVBarHashTable;
+	UINT32* ShortVBarSeen;
+	BYTE* BlockTypes;
+	UINT32* BlockColors;
+	UINT32 BlockCount;
 };
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-FREERDP_API int clear_compress(CLEAR_CONTEXT* clear, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize);
+FREERDP_API int clear_compress(CLEAR_CONTEXT* clear, BYTE* pSrcData, DWORD SrcFormat, int nSrcStep,
+		int nWidth, int nHeight, BYTE** ppDstData, UINT32* pDstSize);
 
 FREERDP_API int clear_decompress(CLEAR_CONTEXT* clear, BYTE* pSrcData, UINT32 SrcSize,
 		BYTE** ppDstData, DWORD DstFormat, int nDstStep, int nXDst, int nYDst, int nWidth, int nHeight);
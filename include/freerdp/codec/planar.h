@@ -95,6 +95,9 @@ struct _BITMAP_PLANAR_CONTEXT
 
 	UINT32 TempSize;
 	BYTE* TempBuffer;
+
+	UINT32 DecodeSize;
+	BYTE* DecodeBuffer;
 };
 
 FREERDP_API int freerdp_split_color_planes(BYTE* data, UINT32 format, int width, int height, int scanline, BYTE* planes[4]);
@@ -26,10 +26,13 @@ typedef struct _PROGRESSIVE_CONTEXT PROGRESSIVE_CONTEXT;
 #include <freerdp/types.h>
 
 #include <winpr/wlog.h>
+#include <winpr/pool.h>
+#include <winpr/stream.h>
 #include <winpr/collections.h>
 
 #include <freerdp/codec/rfx.h>
 #include <freerdp/codec/color.h>
+#include <freerdp/codec/region.h>
 
 #define RFX_SUBBAND_DIFFING				0x01
 
@@ -276,9 +279,14 @@ struct _PROGRESSIVE_SURFACE_CONTEXT
 	UINT32 gridHeight;
 	UINT32 gridSize;
 	RFX_PROGRESSIVE_TILE* tiles;
+
+	/* compressor: area which has not been sent at full quality yet */
+	REGION16 upgradeRegion;
 };
 typedef struct _PROGRESSIVE_SURFACE_CONTEXT PROGRESSIVE_SURFACE_CONTEXT;
 
+typedef struct _PROGRESSIVE_TILE_WORKER PROGRESSIVE_TILE_WORKER;
+
 struct _PROGRESSIVE_CONTEXT
 {
 	BOOL Compressor;
@@ -304,13 +312,26 @@ struct _PROGRESSIVE_CONTEXT
 	RFX_PROGRESSIVE_CODEC_QUANT quantProgValFull;
 
 	wHashTable* SurfaceContexts;
+
+	wStream* Stream;
+	UINT32 frameIndex;
+	BOOL SyncPending;
+
+	BOOL UseThreads;
+	UINT32 ThreadCount;
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	PROGRESSIVE_TILE_WORKER* workers;
 };
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-FREERDP_API int progressive_compress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize);
+FREERDP_API int progressive_compress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, DWORD SrcFormat, int nSrcStep,
+		int nWidth, int nHeight, const RECTANGLE_16* rects, int numRects, UINT16 surfaceId, BYTE** ppDstData, UINT32* pDstSize);
+FREERDP_API int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId,
+		BYTE** ppDstData, UINT32* pDstSize);
 
 FREERDP_API int progressive_decompress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UINT32 SrcSize,
 		BYTE** ppDstData, DWORD DstFormat, int nDstStep, int nXDst, int nYDst, int nWidth, int nHeight, UINT16 surfaceId);
@@ -319,6 +340,7 @@ FREERDP_API int progressive_create_surface_context(PROGRESSIVE_CONTEXT* progress
 FREERDP_API int progressive_delete_surface_context(PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId);
 
 FREERDP_API int progressive_context_reset(PROGRESSIVE_CONTEXT* progressive);
+FREERDP_API int progressive_context_set_thread_count(PROGRESSIVE_CONTEXT* progressive, UINT32 count);
 
 FREERDP_API PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor);
 FREERDP_API void progressive_context_free(PROGRESSIVE_CONTEXT* progressive);
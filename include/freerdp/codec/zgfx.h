@@ -28,6 +28,19 @@
 #define ZGFX_SEGMENTED_SINGLE			0xE0
 #define ZGFX_SEGMENTED_MULTIPART		0xE1
 
+#define ZGFX_SEGMENTED_MAXSIZE			65535
+
+/**
+ * Compression levels trade speed for ratio by bounding how hard the
+ * encoder searches for matches. Level 0 stores the data uncompressed,
+ * but still keeps the history in sync with the decoder.
+ */
+
+#define ZGFX_COMPRESSION_LEVEL_NONE		0
+#define ZGFX_COMPRESSION_LEVEL_FAST		1
+#define ZGFX_COMPRESSION_LEVEL_DEFAULT		5
+#define ZGFX_COMPRESSION_LEVEL_BEST		9
+
 struct _ZGFX_CONTEXT
 {
 	BOOL Compressor;
@@ -46,6 +59,15 @@ struct _ZGFX_CONTEXT
 	BYTE HistoryBuffer[2500000];
 	UINT32 HistoryIndex;
 	UINT32 HistoryBufferSize;
+
+	BYTE* pbOutputCurrent;
+	BYTE* pbOutputEnd;
+
+	UINT32 CompressionLevel;
+	UINT32* MatchHashTable;
+	UINT32* MatchChainTable;
+	BYTE LiteralBits[256];
+	UINT16 LiteralCodes[256];
 };
 typedef struct _ZGFX_CONTEXT ZGFX_CONTEXT;
 
@@ -56,6 +78,8 @@ extern "C" {
 FREERDP_API int zgfx_compress(ZGFX_CONTEXT* zgfx, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags);
 FREERDP_API int zgfx_decompress(ZGFX_CONTEXT* zgfx, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32 flags);
 
+FREERDP_API void zgfx_set_compression_level(ZGFX_CONTEXT* zgfx, DWORD CompressionLevel);
+
 FREERDP_API void zgfx_context_reset(ZGFX_CONTEXT* zgfx, BOOL flush);
 
 FREERDP_API ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor);
@@ -271,6 +271,8 @@ struct gdi_glyph
 };
 typedef struct gdi_glyph gdiGlyph;
 
+typedef struct gdi_bitmap_decoder gdiBitmapDecoder;
+
 struct rdp_gdi
 {
 	rdpContext* context;
@@ -291,6 +293,7 @@ struct rdp_gdi
 	gdiBitmap* drawing;
 	UINT32 bitmap_size;
 	BYTE* bitmap_buffer;
+	gdiBitmapDecoder* bitmapDecoder;
 	BYTE* primary_buffer;
 	GDI_COLOR textColor;
 	BYTE palette[256 * 4];
@@ -317,6 +320,8 @@ FREERDP_API void gdi_resize(rdpGdi* gdi, int width, int height);
 FREERDP_API int gdi_init(freerdp* instance, UINT32 flags, BYTE* buffer);
 FREERDP_API void gdi_free(freerdp* instance);
 
+FREERDP_API int gdi_set_bitmap_decode_threads(rdpGdi* gdi, UINT32 count);
+
 #ifdef __cplusplus
 }
 #endif
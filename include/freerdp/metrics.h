@@ -22,6 +22,88 @@
 
 #include <freerdp/api.h>
 
+/**
+ * Per-channel and per-codec counters are indexed by these slots. Channel slot 0
+ * is the MCS I/O channel (1003), which also carries fast-path traffic; the
+ * static virtual channels follow in channel id order, and the last slot
+ * collects the channel ids that do not fit, under METRICS_CHANNEL_ID_OTHER,
+ * which no MCS channel id can take.
+ */
+
+#define METRICS_CHANNEL_COUNT		32
+#define METRICS_CHANNEL_ID_OTHER	0x10000
+#define METRICS_FRAME_HISTORY		64
+
+#define METRICS_CODEC_RFX		0
+#define METRICS_CODEC_NSC		1
+#define METRICS_CODEC_PLANAR		2
+#define METRICS_CODEC_PROGRESSIVE	3
+#define METRICS_CODEC_CLEAR		4
+#define METRICS_CODEC_H264		5
+#define METRICS_CODEC_COUNT		6
+
+struct rdp_metrics_channel
+{
+	UINT64 ChannelId;
+	UINT64 BytesIn;
+	UINT64 PdusIn;
+	UINT64 BytesOut;
+	UINT64 PdusOut;
+};
+typedef struct rdp_metrics_channel RDP_METRICS_CHANNEL;
+
+struct rdp_metrics_codec
+{
+	UINT64 EncodeCount;
+	UINT64 EncodeTime; /* microseconds */
+	UINT64 DecodeCount;
+	UINT64 DecodeTime; /* microseconds */
+};
+typedef struct rdp_metrics_codec RDP_METRICS_CODEC;
+
+/**
+ * A consistent copy of the counters, see metrics_snapshot().
+ * Every field of the live counters is read atomically, but the
+ * counters are not frozen together while the copy is taken.
+ */
+
+struct rdp_metrics_snapshot
+{
+	UINT64 Timestamp; /* microseconds, metrics_get_timestamp() */
+
+	UINT64 TotalCompressedBytes;
+	UINT64 TotalUncompressedBytes;
+	UINT64 TotalCompressionTime;
+	UINT64 TotalCompressionWaitTime;
+	UINT64 CompressionQueueDepth;
+
+	UINT64 FastPathUpdatesOut;
+	UINT64 FastPathFragmentsOut;
+	UINT64 FastPathUpdatesIn;
+	UINT64 FastPathFragmentsIn;
+
+	UINT64 WriteBlockedCount;
+	UINT64 WriteBlockedTime; /* microseconds */
+
+	UINT64 RoundTripTime; /* milliseconds, last autodetect measurement */
+	UINT64 RoundTripTimeMin; /* milliseconds */
+	UINT64 RoundTripCount;
+	UINT64 Bandwidth; /* kbit/s, last autodetect measurement */
+
+	UINT64 FrameAckCount;
+	UINT64 FrameAckLatency; /* microseconds, total over FrameAckCount */
+	UINT64 FrameAckLatencyMax; /* microseconds */
+
+	RDP_METRICS_CHANNEL Channels[METRICS_CHANNEL_COUNT];
+	RDP_METRICS_CODEC Codecs[METRICS_CODEC_COUNT];
+};
+typedef struct rdp_metrics_snapshot rdpMetricsSnapshot;
+
+/**
+ * All counters are updated with interlocked operations and can be
+ * written from any thread; use metrics_snapshot() to read them.
+ */
+
 struct rdp_metrics
 {
 	rdpContext* context;
@@ -29,12 +111,66 @@ struct rdp_metrics
 	UINT64 TotalCompressedBytes;
 	UINT64 TotalUncompressedBytes;
 	double TotalCompressionRatio;
+
+	UINT64 TotalCompressionTime; /* microseconds spent in bulk compression */
+	UINT64 TotalCompressionWaitTime; /* microseconds the sender waited for the compression pipeline */
+	LONG CompressionQueueDepth; /* fragments handed to the compression pipeline and not finished yet */
+
+	UINT64 FastPathUpdatesOut;
+	UINT64 FastPathFragmentsOut;
+	UINT64 FastPathUpdatesIn;
+	UINT64 FastPathFragmentsIn;
+
+	UINT64 WriteBlockedCount;
+	UINT64 WriteBlockedTime;
+
+	UINT64 RoundTripTime;
+	UINT64 RoundTripTimeMin;
+	UINT64 RoundTripCount;
+	UINT64 Bandwidth;
+
+	UINT64 FrameAckCount;
+	UINT64 FrameAckLatency;
+	UINT64 FrameAckLatencyMax;
+	UINT64 FrameSentTime[METRICS_FRAME_HISTORY]; /* indexed by frameId % METRICS_FRAME_HISTORY */
+
+	RDP_METRICS_CHANNEL Channels[METRICS_CHANNEL_COUNT];
+	RDP_METRICS_CODEC Codecs[METRICS_CODEC_COUNT];
+
+	UINT64 NextDumpTime; /* see metrics_check_dump() */
 };
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API UINT64 metrics_get_timestamp(void);
 FREERDP_API double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32 CompressedBytes);
 
+FREERDP_API void metrics_add(UINT64* counter, UINT64 value);
+
+FREERDP_API void metrics_channel_read(rdpMetrics* metrics, UINT16 channelId, UINT32 length);
+FREERDP_API void metrics_channel_write(rdpMetrics* metrics, UINT16 channelId, UINT32 length);
+FREERDP_API void metrics_fastpath_read(rdpMetrics* metrics, UINT32 fragmentation);
+FREERDP_API void metrics_fastpath_write(rdpMetrics* metrics, UINT32 fragments);
+FREERDP_API void metrics_write_blocked(rdpMetrics* metrics, UINT64 elapsed);
+FREERDP_API void metrics_codec_encode(rdpMetrics* metrics, UINT32 codecId, UINT64 elapsed);
+FREERDP_API void metrics_codec_decode(rdpMetrics* metrics, UINT32 codecId, UINT64 elapsed);
+FREERDP_API void metrics_round_trip_time(rdpMetrics* metrics, UINT32 roundTripTime);
+FREERDP_API void metrics_bandwidth(rdpMetrics* metrics, UINT32 bandwidth);
+FREERDP_API void metrics_frame_sent(rdpMetrics* metrics, UINT32 frameId);
+FREERDP_API void metrics_frame_acknowledged(rdpMetrics* metrics, UINT32 frameId);
+
+FREERDP_API BOOL metrics_snapshot(rdpMetrics* metrics, rdpMetricsSnapshot* snapshot);
+FREERDP_API void metrics_dump(rdpMetrics* metrics);
+FREERDP_API void metrics_check_dump(rdpMetrics* metrics);
+
 FREERDP_API rdpMetrics* metrics_new(rdpContext* context);
 FREERDP_API void metrics_free(rdpMetrics* metrics);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* FREERDP_METRICS_H */
 
@@ -172,6 +172,35 @@ typedef pstatus_t (*__YUV420ToRGB_8u_P3AC4R_t)(
 	const BYTE* pSrc[3], INT32 srcStep[3],
 	BYTE* pDst, INT32 dstStep,
 	const prim_size_t* roi);
+typedef pstatus_t (*__RGBToYUV420_8u_P3AC4R_t)(
+	const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[3], INT32 dstStep[3],
+	const prim_size_t* roi);
+typedef pstatus_t (*__planarSplit_8u_AC4P4R_t)(
+	const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep,
+	UINT32 width, UINT32 height,
+	BOOL alpha);
+typedef pstatus_t (*__planarJoin_8u_P4AC4R_t)(
+	const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep,
+	UINT32 width, UINT32 height);
+typedef pstatus_t (*__planarDeltaEncode_8u_t)(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len);
+typedef pstatus_t (*__planarDeltaDecode_8u_t)(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len);
+typedef pstatus_t (*__planarFindRun_8u_t)(
+	const BYTE* pSrc,
+	INT32 len,
+	BYTE prev,
+	INT32* pOffset,
+	INT32* pLength);
 typedef pstatus_t (*__andC_32u_t)(
 	const UINT32 *pSrc,
 	UINT32 val,
@@ -219,6 +248,13 @@ typedef struct
 	__YCoCgToRGB_8u_AC4R_t YCoCgToRGB_8u_AC4R;
 	__RGB565ToARGB_16u32u_C3C4_t RGB565ToARGB_16u32u_C3C4;
 	__YUV420ToRGB_8u_P3AC4R_t YUV420ToRGB_8u_P3AC4R;
+	__RGBToYUV420_8u_P3AC4R_t RGBToYUV420_8u_P3AC4R;
+	/* RDP6 planar codec */
+	__planarSplit_8u_AC4P4R_t planarSplit_8u_AC4P4R;
+	__planarJoin_8u_P4AC4R_t planarJoin_8u_P4AC4R;
+	__planarDeltaEncode_8u_t planarDeltaEncode_8u;
+	__planarDeltaDecode_8u_t planarDeltaDecode_8u;
+	__planarFindRun_8u_t planarFindRun_8u;
 } primitives_t;
 
 #ifdef __cplusplus
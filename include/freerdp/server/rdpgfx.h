@@ -0,0 +1,117 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Graphics Pipeline Extension
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_SERVER_RDPGFX_H
+#define FREERDP_CHANNEL_SERVER_RDPGFX_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/channels/wtsvc.h>
+
+#include <freerdp/channels/rdpgfx.h>
+
+/**
+ * Server Interface
+ */
+
+typedef struct _rdpgfx_server_context RdpgfxServerContext;
+typedef struct _rdpgfx_server_private RdpgfxServerPrivate;
+
+typedef enum RDPGFX_SERVER_OPEN_RESULT
+{
+	RDPGFX_SERVER_OPEN_RESULT_OK = 0,
+	RDPGFX_SERVER_OPEN_RESULT_CLOSED = 1,
+	RDPGFX_SERVER_OPEN_RESULT_NOTSUPPORTED = 2,
+	RDPGFX_SERVER_OPEN_RESULT_ERROR = 3
+} RDPGFX_SERVER_OPEN_RESULT;
+
+typedef int (*psRdpgfxServerOpen)(RdpgfxServerContext* context);
+typedef int (*psRdpgfxServerClose)(RdpgfxServerContext* context);
+
+typedef int (*psRdpgfxResetGraphics)(RdpgfxServerContext* context, RDPGFX_RESET_GRAPHICS_PDU* resetGraphics);
+typedef int (*psRdpgfxStartFrame)(RdpgfxServerContext* context, RDPGFX_START_FRAME_PDU* startFrame);
+typedef int (*psRdpgfxEndFrame)(RdpgfxServerContext* context, RDPGFX_END_FRAME_PDU* endFrame);
+typedef int (*psRdpgfxSurfaceCommand)(RdpgfxServerContext* context, RDPGFX_SURFACE_COMMAND* cmd);
+typedef int (*psRdpgfxDeleteEncodingContext)(RdpgfxServerContext* context, RDPGFX_DELETE_ENCODING_CONTEXT_PDU* deleteEncodingContext);
+typedef int (*psRdpgfxCreateSurface)(RdpgfxServerContext* context, RDPGFX_CREATE_SURFACE_PDU* createSurface);
+typedef int (*psRdpgfxDeleteSurface)(RdpgfxServerContext* context, RDPGFX_DELETE_SURFACE_PDU* deleteSurface);
+typedef int (*psRdpgfxSolidFill)(RdpgfxServerContext* context, RDPGFX_SOLID_FILL_PDU* solidFill);
+typedef int (*psRdpgfxSurfaceToSurface)(RdpgfxServerContext* context, RDPGFX_SURFACE_TO_SURFACE_PDU* surfaceToSurface);
+typedef int (*psRdpgfxSurfaceToCache)(RdpgfxServerContext* context, RDPGFX_SURFACE_TO_CACHE_PDU* surfaceToCache);
+typedef int (*psRdpgfxCacheToSurface)(RdpgfxServerContext* context, RDPGFX_CACHE_TO_SURFACE_PDU* cacheToSurface);
+typedef int (*psRdpgfxCacheImportOffer)(RdpgfxServerContext* context, RDPGFX_CACHE_IMPORT_OFFER_PDU* cacheImportOffer);
+typedef int (*psRdpgfxCacheImportReply)(RdpgfxServerContext* context, RDPGFX_CACHE_IMPORT_REPLY_PDU* cacheImportReply);
+typedef int (*psRdpgfxEvictCacheEntry)(RdpgfxServerContext* context, RDPGFX_EVICT_CACHE_ENTRY_PDU* evictCacheEntry);
+typedef int (*psRdpgfxMapSurfaceToOutput)(RdpgfxServerContext* context, RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* surfaceToOutput);
+typedef int (*psRdpgfxMapSurfaceToWindow)(RdpgfxServerContext* context, RDPGFX_MAP_SURFACE_TO_WINDOW_PDU* surfaceToWindow);
+typedef int (*psRdpgfxCapsAdvertise)(RdpgfxServerContext* context, RDPGFX_CAPS_ADVERTISE_PDU* capsAdvertise);
+typedef int (*psRdpgfxCapsConfirm)(RdpgfxServerContext* context, RDPGFX_CAPS_CONFIRM_PDU* capsConfirm);
+typedef int (*psRdpgfxFrameAcknowledge)(RdpgfxServerContext* context, RDPGFX_FRAME_ACKNOWLEDGE_PDU* frameAcknowledge);
+
+typedef void (*psRdpgfxOpenResult)(RdpgfxServerContext* context, RDPGFX_SERVER_OPEN_RESULT result);
+
+struct _rdpgfx_server_context
+{
+	HANDLE vcm;
+	void* custom;
+
+	/* APIs called by the server */
+
+	psRdpgfxServerOpen Open;
+	psRdpgfxServerClose Close;
+
+	psRdpgfxResetGraphics ResetGraphics;
+	psRdpgfxStartFrame StartFrame;
+	psRdpgfxEndFrame EndFrame;
+	psRdpgfxSurfaceCommand SurfaceCommand;
+	psRdpgfxDeleteEncodingContext DeleteEncodingContext;
+	psRdpgfxCreateSurface CreateSurface;
+	psRdpgfxDeleteSurface DeleteSurface;
+	psRdpgfxSolidFill SolidFill;
+	psRdpgfxSurfaceToSurface SurfaceToSurface;
+	psRdpgfxSurfaceToCache SurfaceToCache;
+	psRdpgfxCacheToSurface CacheToSurface;
+	psRdpgfxCacheImportReply CacheImportReply;
+	psRdpgfxEvictCacheEntry EvictCacheEntry;
+	psRdpgfxMapSurfaceToOutput MapSurfaceToOutput;
+	psRdpgfxMapSurfaceToWindow MapSurfaceToWindow;
+	psRdpgfxCapsConfirm CapsConfirm;
+
+	/* callbacks registered by the server */
+
+	psRdpgfxOpenResult OpenResult;
+	psRdpgfxCapsAdvertise CapsAdvertise;
+	psRdpgfxCacheImportOffer CacheImportOffer;
+	psRdpgfxFrameAcknowledge FrameAcknowledge;
+
+	RdpgfxServerPrivate* priv;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FREERDP_API RdpgfxServerContext* rdpgfx_server_context_new(HANDLE vcm);
+FREERDP_API void rdpgfx_server_context_free(RdpgfxServerContext* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_CHANNEL_SERVER_RDPGFX_H */
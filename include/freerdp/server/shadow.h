@@ -31,6 +31,7 @@
 
 #include <freerdp/server/encomsp.h>
 #include <freerdp/server/remdesk.h>
+#include <freerdp/server/rdpgfx.h>
 
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/region.h>
@@ -44,7 +45,10 @@ typedef struct rdp_shadow_server rdpShadowServer;
 typedef struct rdp_shadow_screen rdpShadowScreen;
 typedef struct rdp_shadow_surface rdpShadowSurface;
 typedef struct rdp_shadow_encoder rdpShadowEncoder;
+typedef struct rdp_shadow_frame rdpShadowFrame;
 typedef struct rdp_shadow_capture rdpShadowCapture;
+typedef struct rdp_shadow_mailbox rdpShadowMailbox;
+typedef struct rdp_shadow_encoder_cache rdpShadowEncoderCache;
 typedef struct rdp_shadow_subsystem rdpShadowSubsystem;
 
 typedef struct _RDP_SHADOW_ENTRY_POINTS RDP_SHADOW_ENTRY_POINTS;
@@ -82,6 +86,7 @@ struct rdp_shadow_client
 	HANDLE StopEvent;
 	CRITICAL_SECTION lock;
 	REGION16 invalidRegion;
+	rdpShadowMailbox* mailbox;
 	rdpShadowServer* server;
 	rdpShadowSurface* lobby;
 	rdpShadowEncoder* encoder;
@@ -93,6 +98,10 @@ struct rdp_shadow_client
 	HANDLE vcm;
 	EncomspServerContext* encomsp;
 	RemdeskServerContext* remdesk;
+	RdpgfxServerContext* rdpgfx;
+	BOOL gfxReady;
+	BOOL gfxUpgrade;
+	UINT32 gfxCapsVersion;
 };
 
 struct rdp_shadow_server
@@ -105,12 +114,15 @@ struct rdp_shadow_server
 	rdpShadowSurface* surface;
 	rdpShadowCapture* capture;
 	rdpShadowSubsystem* subsystem;
+	rdpShadowEncoderCache* encoderCache;
 
 	DWORD port;
 	BOOL mayView;
 	BOOL mayInteract;
 	BOOL shareSubRect;
 	BOOL authentication;
+	BOOL clearCodec;
+	DWORD metricsInterval;
 	int selectedMonitor;
 	RECTANGLE_16 subRect;
 	char* ipcSocket;
@@ -143,11 +155,9 @@ struct _RDP_SHADOW_ENTRY_POINTS
 	int selectedMonitor; \
 	MONITOR_DEF monitors[16]; \
 	MONITOR_DEF virtualScreen; \
-	HANDLE updateEvent; \
 	BOOL suppressOutput; \
 	REGION16 invalidRegion; \
 	wMessagePipe* MsgPipe; \
-	SYNCHRONIZATION_BARRIER barrier; \
 	UINT32 pointerX; \
 	UINT32 pointerY; \
 	\
@@ -666,6 +666,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_LocalConnection					1602
 #define FreeRDP_AuthenticationOnly				1603
 #define FreeRDP_CredentialsFromStdin				1604
+#define FreeRDP_MetricsDumpInterval				1605
 #define FreeRDP_ComputerName					1664
 #define FreeRDP_ConnectionFile					1728
 #define FreeRDP_AssistanceFile					1729
@@ -757,6 +758,7 @@ typedef struct _RDPDR_PARALLEL RDPDR_PARALLEL;
 #define FreeRDP_RemoteFxCodecMode				3651
 #define FreeRDP_RemoteFxImageCodec				3652
 #define FreeRDP_RemoteFxCaptureFlags				3653
+#define FreeRDP_RemoteFxRlgrMode				3654
 #define FreeRDP_NSCodec						3712
 #define FreeRDP_NSCodecId					3713
 #define FreeRDP_FrameAcknowledge				3714
@@ -1076,7 +1078,8 @@ struct rdp_settings
 	ALIGN64 BOOL LocalConnection; /* 1602 */
 	ALIGN64 BOOL AuthenticationOnly; /* 1603 */
 	ALIGN64 BOOL CredentialsFromStdin; /* 1604 */
-	UINT64 padding1664[1664 - 1605]; /* 1605 */
+	ALIGN64 UINT32 MetricsDumpInterval; /* 1605 */
+	UINT64 padding1664[1664 - 1606]; /* 1606 */
 
 	/* Names */
 	ALIGN64 char* ComputerName; /* 1664 */
@@ -1273,7 +1276,8 @@ struct rdp_settings
 	ALIGN64 UINT32 RemoteFxCodecMode; /* 3651 */
 	ALIGN64 BOOL RemoteFxImageCodec; /* 3652 */
 	ALIGN64 UINT32 RemoteFxCaptureFlags; /* 3653 */
-	UINT64 padding3712[3712 - 3654]; /* 3654 */
+	ALIGN64 UINT32 RemoteFxRlgrMode; /* 3654 */
+	UINT64 padding3712[3712 - 3655]; /* 3655 */
 
 	/* NSCodec */
 	ALIGN64 BOOL NSCodec; /* 3712 */
@@ -822,9 +822,1026 @@ int clear_decompress(CLEAR_CONTEXT* clear, BYTE* pSrcData, UINT32 SrcSize,
 	return 1;
 }
 
-int clear_compress(CLEAR_CONTEXT* clear, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize)
+/**
+ * ClearCodec encoder
+ *
+ * The bitmap is split into blocks of 64 pixels by one band height. Blocks of
+ * a single color go into the residual layer, which is a plain run-length
+ * encoding of the whole bitmap where pixels covered by other layers extend
+ * the current run. Blocks with few colors are sent either as residual, as
+ * bands or as an RLEX subcodec, whichever is estimated to be the smallest.
+ * Bands work best for text: glyph columns repeat and become vBar cache hits.
+ * Remaining blocks with many colors are sent with NSCodec, or uncompressed
+ * when that is smaller.
+ *
+ * The encoder keeps the glyph and vBar caches in the same state as the
+ * decoder does, and indexes them with hash tables to find cache hits.
+ */
+
+#define CLEAR_BLOCK_WIDTH		64
+#define CLEAR_BAND_HEIGHT		52
+#define CLEAR_MAX_PALETTE_SIZE		127
+#define CLEAR_GLYPH_MAX_PIXELS		1024
+
+#define CLEAR_BLOCK_RESIDUAL		0
+#define CLEAR_BLOCK_BANDS		1
+#define CLEAR_BLOCK_RLEX		2
+#define CLEAR_BLOCK_IMAGE		3
+
+#define CLEAR_GLYPH_HASH_SIZE		8192
+#define CLEAR_VBAR_HASH_SIZE		65536
+#define CLEAR_SHORT_VBAR_HASH_SIZE	32768
+#define CLEAR_SHORT_VBAR_SEEN_SIZE	4096
+
+#define CLEAR_SUBCODEC_HEADER_SIZE	13
+
+static UINT32 clear_hash_pixels(const UINT32* pixels, UINT32 count)
+{
+	UINT32 i;
+	UINT32 hash = 2166136261 ^ count;
+
+	for (i = 0; i < count; i++)
+		hash = (hash ^ pixels[i]) * 16777619;
+
+	return hash;
+}
+
+static void clear_write_color(wStream* s, UINT32 color)
+{
+	Stream_Write_UINT8(s, color & 0xFF); /* blue */
+	Stream_Write_UINT8(s, (color >> 8) & 0xFF); /* green */
+	Stream_Write_UINT8(s, (color >> 16) & 0xFF); /* red */
+}
+
+static int clear_write_run_length(BYTE* pDst, UINT32 runLength)
+{
+	if (runLength < 0xFF)
+	{
+		if (pDst)
+			pDst[0] = (BYTE) runLength;
+
+		return 1;
+	}
+
+	if (runLength < 0xFFFF)
+	{
+		if (pDst)
+		{
+			pDst[0] = 0xFF;
+			*((UINT16*) &pDst[1]) = (UINT16) runLength;
+		}
+
+		return 3;
+	}
+
+	if (pDst)
+	{
+		pDst[0] = 0xFF;
+		*((UINT16*) &pDst[1]) = 0xFFFF;
+		*((UINT32*) &pDst[3]) = runLength;
+	}
+
+	return 7;
+}
+
+static BOOL clear_write_run(wStream* s, UINT32 color, UINT32 runLength)
+{
+	if (!Stream_EnsureRemainingCapacity(s, 10))
+		return FALSE;
+
+	clear_write_color(s, color);
+	Stream_Seek(s, clear_write_run_length(Stream_Pointer(s), runLength));
+
+	return TRUE;
+}
+
+static BOOL clear_vbar_entry_set(CLEAR_VBAR_ENTRY* entry, const UINT32* pixels, UINT32 count)
+{
+	UINT32* newPixels;
+
+	if (count > entry->size)
+	{
+		newPixels = (UINT32*) realloc(entry->pixels, count * 4);
+
+		if (!newPixels)
+			return FALSE;
+
+		entry->pixels = newPixels;
+		entry->size = count;
+	}
+
+	if (count)
+		CopyMemory(entry->pixels, pixels, count * 4);
+
+	entry->count = count;
+
+	return TRUE;
+}
+
+static int clear_vbar_lookup(CLEAR_VBAR_ENTRY* storage, UINT32* hashTable, UINT32 hashSize,
+		UINT32 hash, const UINT32* pixels, UINT32 count)
+{
+	UINT32 index;
+	CLEAR_VBAR_ENTRY* entry;
+
+	index = hashTable[hash % hashSize];
+
+	if (!index)
+		return -1;
+
+	entry = &storage[index - 1];
+
+	if (entry->count != count)
+		return -1;
+
+	if (count && (memcmp(entry->pixels, pixels, count * 4) != 0))
+		return -1;
+
+	return (int) (index - 1);
+}
+
+/**
+ * Counts the colors of a block, up to one more than the RLEX palette size,
+ * and returns the most frequent one.
+ */
+
+static int clear_count_colors(const UINT32* pSrc, int nSrcStep, int nWidth, int nHeight, UINT32* pColor)
+{
+	int x, y;
+	UINT32 slot;
+	UINT32 color;
+	UINT32 lastSlot = 0;
+	UINT32 maxCount = 0;
+	int numColors = 0;
+	UINT32 keys[256];
+	UINT32 counts[256];
+	const UINT32* pSrcPixel;
+
+	FillMemory(keys, sizeof(keys), 0xFF);
+	ZeroMemory(counts, sizeof(counts));
+
+	for (y = 0; (y < nHeight) && (numColors <= CLEAR_MAX_PALETTE_SIZE); y++)
+	{
+		pSrcPixel = &pSrc[y * nSrcStep];
+
+		for (x = 0; x < nWidth; x++)
+		{
+			color = pSrcPixel[x];
+
+			if (color == keys[lastSlot])
+			{
+				counts[lastSlot]++;
+				continue;
+			}
+
+			slot = (color * 2654435761U) >> 24;
+
+			while ((keys[slot] != color) && (keys[slot] != 0xFFFFFFFF))
+				slot = (slot + 1) & 0xFF;
+
+			if (keys[slot] == 0xFFFFFFFF)
+			{
+				if (numColors > CLEAR_MAX_PALETTE_SIZE)
+					break;
+
+				keys[slot] = color;
+				numColors++;
+			}
+
+			counts[slot]++;
+			lastSlot = slot;
+		}
+	}
+
+	for (slot = 0; slot < 256; slot++)
+	{
+		if (counts[slot] > maxCount)
+		{
+			maxCount = counts[slot];
+			*pColor = keys[slot];
+		}
+	}
+
+	return numColors;
+}
+
+static UINT32 clear_residual_cost(const UINT32* pSrc, int nSrcStep, int nWidth, int nHeight)
+{
+	int x, y;
+	UINT32 runs = 0;
+	const UINT32* pSrcPixel;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		pSrcPixel = &pSrc[y * nSrcStep];
+		runs++;
+
+		for (x = 1; x < nWidth; x++)
+		{
+			if (pSrcPixel[x] != pSrcPixel[x - 1])
+				runs++;
+		}
+	}
+
+	return runs * 4;
+}
+
+static void clear_get_vbar(const UINT32* pSrc, int nSrcStep, int nHeight, UINT32 colorBkg,
+		UINT32* vBar, UINT32* pYOn, UINT32* pYOff)
+{
+	int y;
+	UINT32 yOn = 0;
+	UINT32 yOff = 0;
+	BOOL found = FALSE;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		vBar[y] = pSrc[y * nSrcStep];
+
+		if (vBar[y] != colorBkg)
+		{
+			if (!found)
+				yOn = y;
+
+			yOff = y + 1;
+			found = TRUE;
+		}
+	}
+
+	*pYOn = yOn;
+	*pYOff = yOff;
+}
+
+static BOOL clear_row_is_blank(const UINT32* pSrc, int nWidth, UINT32 colorBkg)
+{
+	int x;
+
+	for (x = 0; x < nWidth; x++)
+	{
+		if (pSrc[x] != colorBkg)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Returns the end of the band starting at row y. Bands are cut where a line
+ * of text starts, so that the short vBars of a glyph are the same on every
+ * line and become cache hits.
+ */
+
+static int clear_band_end(const UINT32* pSrc, int nSrcStep, int nWidth, int y, int yEnd, UINT32 colorBkg)
+{
+	while ((y < yEnd) && clear_row_is_blank(&pSrc[y * nSrcStep], nWidth, colorBkg))
+		y++;
+
+	while ((y < yEnd) && !clear_row_is_blank(&pSrc[y * nSrcStep], nWidth, colorBkg))
+		y++;
+
+	while ((y < yEnd) && clear_row_is_blank(&pSrc[y * nSrcStep], nWidth, colorBkg))
+		y++;
+
+	return y;
+}
+
+/**
+ * Estimates the size of a block sent as bands from the current cache state.
+ * Short vBars seen earlier in the same frame are counted as cache hits too,
+ * as text usually repeats the same glyphs all over the screen.
+ */
+
+static UINT32 clear_bands_cost(CLEAR_CONTEXT* clear, const UINT32* pSrc, int nSrcStep,
+		int nWidth, int nHeight, UINT32 colorBkg)
+{
+	int x, y;
+	int yEnd;
+	UINT32 yOn;
+	UINT32 yOff;
+	UINT32 hash;
+	UINT32 cost = 0;
+	UINT32* seen = clear->ShortVBarSeen;
+	UINT32 vBar[CLEAR_BAND_HEIGHT];
+
+	for (y = 0; y < nHeight; y = yEnd)
+	{
+		yEnd = clear_band_end(pSrc, nSrcStep, nWidth, y, nHeight, colorBkg);
+		cost += 11;
+
+		for (x = 0; x < nWidth; x++)
+		{
+			clear_get_vbar(&pSrc[(y * nSrcStep) + x], nSrcStep, yEnd - y, colorBkg, vBar, &yOn, &yOff);
+
+			hash = clear_hash_pixels(vBar, yEnd - y);
+
+			if (clear_vbar_lookup(clear->VBarStorage, clear->VBarHashTable,
+					CLEAR_VBAR_HASH_SIZE, hash, vBar, yEnd - y) >= 0)
+			{
+				cost += 2;
+				continue;
+			}
+
+			hash = clear_hash_pixels(&vBar[yOn], yOff - yOn);
+
+			/* zero marks an empty slot in the table of short vBars seen in this frame */
+
+			if ((seen[hash % CLEAR_SHORT_VBAR_SEEN_SIZE] == (hash | 1)) || (clear_vbar_lookup(clear->ShortVBarStorage,
+					clear->ShortVBarHashTable, CLEAR_SHORT_VBAR_HASH_SIZE, hash,
+					&vBar[yOn], yOff - yOn) >= 0))
+			{
+				cost += 3;
+				continue;
+			}
+
+			seen[hash % CLEAR_SHORT_VBAR_SEEN_SIZE] = hash | 1;
+			cost += 2 + ((yOff - yOn) * 3);
+		}
+	}
+
+	return cost;
+}
+
+/**
+ * Encodes a block with the RLEX subcodec, or only computes the encoded size
+ * when pDst is NULL. Returns -1 if the block has too many colors.
+ */
+
+static int clear_rlex_encode(const UINT32* pSrc, int nSrcStep, int nWidth, int nHeight, BYTE* pDst)
+{
+	int x, y;
+	UINT32 i, j;
+	UINT32 slot;
+	UINT32 color;
+	UINT32 numBits;
+	UINT32 maxDepth;
+	UINT32 suiteDepth;
+	UINT32 runLength;
+	UINT32 pixelCount;
+	UINT32 paletteCount = 0;
+	int size;
+	UINT32 keys[256];
+	BYTE values[256];
+	UINT32 palette[CLEAR_MAX_PALETTE_SIZE];
+	BYTE indices[CLEAR_BLOCK_WIDTH * CLEAR_BAND_HEIGHT];
+
+	pixelCount = nWidth * nHeight;
+
+	if (pixelCount > sizeof(indices))
+		return -1;
+
+	FillMemory(keys, sizeof(keys), 0xFF);
+
+	/* palette in order of appearance, so that gradients form suites */
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			color = pSrc[(y * nSrcStep) + x];
+			slot = (color * 2654435761U) >> 24;
+
+			while ((keys[slot] != color) && (keys[slot] != 0xFFFFFFFF))
+				slot = (slot + 1) & 0xFF;
+
+			if (keys[slot] == 0xFFFFFFFF)
+			{
+				if (paletteCount >= CLEAR_MAX_PALETTE_SIZE)
+					return -1;
+
+				keys[slot] = color;
+				values[slot] = (BYTE) paletteCount;
+				palette[paletteCount++] = color;
+			}
+
+			indices[(y * nWidth) + x] = values[slot];
+		}
+	}
+
+	size = 1 + (paletteCount * 3);
+
+	if (pDst)
+	{
+		pDst[0] = (BYTE) paletteCount;
+
+		for (i = 0; i < paletteCount; i++)
+		{
+			pDst[1 + (i * 3) + 0] = palette[i] & 0xFF;
+			pDst[1 + (i * 3) + 1] = (palette[i] >> 8) & 0xFF;
+			pDst[1 + (i * 3) + 2] = (palette[i] >> 16) & 0xFF;
+		}
+	}
+
+	numBits = CLEAR_LOG2_FLOOR[paletteCount - 1] + 1;
+	maxDepth = CLEAR_8BIT_MASKS[8 - numBits];
+
+	/*
+	 * Each segment is a run of the start color followed by a suite of
+	 * consecutive palette entries, which begins with the start color again.
+	 */
+
+	i = 0;
+
+	while (i < pixelCount)
+	{
+		j = i;
+
+		while (((j + 1) < pixelCount) && (indices[j + 1] == indices[i]))
+			j++;
+
+		runLength = j - i;
+		suiteDepth = 0;
+
+		while (((j + 1) < pixelCount) && (suiteDepth < maxDepth) &&
+				(indices[j + 1] == (indices[j] + 1)))
+		{
+			suiteDepth++;
+			j++;
+		}
+
+		if (pDst)
+			pDst[size] = (BYTE) ((indices[i] + suiteDepth) | (suiteDepth << numBits));
+
+		size++;
+		size += clear_write_run_length(pDst ? &pDst[size] : NULL, runLength);
+
+		i = j + 1;
+	}
+
+	return size;
+}
+
+static void clear_write_subcodec_header(wStream* s, int x, int y, int nWidth, int nHeight,
+		UINT32 bitmapDataByteCount, BYTE subcodecId)
+{
+	Stream_Write_UINT16(s, x); /* xStart (2 bytes) */
+	Stream_Write_UINT16(s, y); /* yStart (2 bytes) */
+	Stream_Write_UINT16(s, nWidth); /* width (2 bytes) */
+	Stream_Write_UINT16(s, nHeight); /* height (2 bytes) */
+	Stream_Write_UINT32(s, bitmapDataByteCount); /* bitmapDataByteCount (4 bytes) */
+	Stream_Write_UINT8(s, subcodecId); /* subcodecId (1 byte) */
+}
+
+static int clear_encode_rlex(wStream* s, const UINT32* pSrc, int nSrcStep, int x, int y, int nWidth, int nHeight)
+{
+	int size;
+	const UINT32* pSrcPixel = &pSrc[(y * nSrcStep) + x];
+
+	size = clear_rlex_encode(pSrcPixel, nSrcStep, nWidth, nHeight, NULL);
+
+	if (size < 0)
+		return -1;
+
+	if (!Stream_EnsureRemainingCapacity(s, CLEAR_SUBCODEC_HEADER_SIZE + size))
+		return -1;
+
+	clear_write_subcodec_header(s, x, y, nWidth, nHeight, size, 2);
+	clear_rlex_encode(pSrcPixel, nSrcStep, nWidth, nHeight, Stream_Pointer(s));
+	Stream_Seek(s, size);
+
+	return 1;
+}
+
+static int clear_encode_image(CLEAR_CONTEXT* clear, wStream* s, const UINT32* pSrc, int nSrcStep,
+		int x, int y, int nWidth, int nHeight, BOOL lossy)
+{
+	int i, j;
+	size_t pos;
+	size_t size;
+	const UINT32* pSrcPixel;
+
+	pos = Stream_GetPosition(s);
+
+	if (lossy)
+	{
+		if (!Stream_EnsureRemainingCapacity(s, CLEAR_SUBCODEC_HEADER_SIZE))
+			return -1;
+
+		Stream_Seek(s, CLEAR_SUBCODEC_HEADER_SIZE);
+
+		/* the NSCodec encoder reads bottom-up bitmaps, start from the last row */
+
+		if (!nsc_compose_message(clear->nsc, s, (BYTE*) &pSrc[((y + nHeight - 1) * nSrcStep) + x],
+				nWidth, nHeight, -(nSrcStep * 4)))
+			return -1;
+
+		size = Stream_GetPosition(s) - pos - CLEAR_SUBCODEC_HEADER_SIZE;
+
+		if (size < (size_t) (nWidth * nHeight * 3))
+		{
+			Stream_SetPosition(s, pos);
+			clear_write_subcodec_header(s, x, y, nWidth, nHeight, (UINT32) size, 1);
+			Stream_Seek(s, size);
+			return 1;
+		}
+
+		Stream_SetPosition(s, pos);
+	}
+
+	size = nWidth * nHeight * 3;
+
+	if (!Stream_EnsureRemainingCapacity(s, CLEAR_SUBCODEC_HEADER_SIZE + size))
+		return -1;
+
+	clear_write_subcodec_header(s, x, y, nWidth, nHeight, (UINT32) size, 0);
+
+	for (j = 0; j < nHeight; j++)
+	{
+		pSrcPixel = &pSrc[((y + j) * nSrcStep) + x];
+
+		for (i = 0; i < nWidth; i++)
+			clear_write_color(s, pSrcPixel[i]);
+	}
+
+	return 1;
+}
+
+static int clear_encode_band(CLEAR_CONTEXT* clear, wStream* s, const UINT32* pSrc, int nSrcStep,
+		int xStart, int xEnd, int yStart, int yEnd, UINT32 colorBkg)
+{
+	int x;
+	int index;
+	UINT32 y;
+	UINT32 yOn;
+	UINT32 yOff;
+	UINT32 hash;
+	UINT32 shortHash;
+	UINT32 vBarHeight;
+	UINT32 vBar[CLEAR_BAND_HEIGHT];
+
+	vBarHeight = yEnd - yStart;
+
+	if (!Stream_EnsureRemainingCapacity(s, 11 + ((xEnd - xStart) * (2 + (vBarHeight * 3)))))
+		return -1;
+
+	Stream_Write_UINT16(s, xStart); /* xStart (2 bytes) */
+	Stream_Write_UINT16(s, xEnd - 1); /* xEnd (2 bytes) */
+	Stream_Write_UINT16(s, yStart); /* yStart (2 bytes) */
+	Stream_Write_UINT16(s, yEnd - 1); /* yEnd (2 bytes) */
+	clear_write_color(s, colorBkg); /* colorBkg (3 bytes) */
+
+	for (x = xStart; x < xEnd; x++)
+	{
+		clear_get_vbar(&pSrc[(yStart * nSrcStep) + x], nSrcStep, vBarHeight, colorBkg, vBar, &yOn, &yOff);
+
+		hash = clear_hash_pixels(vBar, vBarHeight);
+
+		index = clear_vbar_lookup(clear->VBarStorage, clear->VBarHashTable,
+				CLEAR_VBAR_HASH_SIZE, hash, vBar, vBarHeight);
+
+		if (index >= 0)
+		{
+			Stream_Write_UINT16(s, 0x8000 | index); /* VBAR_CACHE_HIT */
+			continue;
+		}
+
+		shortHash = clear_hash_pixels(&vBar[yOn], yOff - yOn);
+
+		index = clear_vbar_lookup(clear->ShortVBarStorage, clear->ShortVBarHashTable,
+				CLEAR_SHORT_VBAR_HASH_SIZE, shortHash, &vBar[yOn], yOff - yOn);
+
+		if (index >= 0)
+		{
+			Stream_Write_UINT16(s, 0x4000 | index); /* SHORT_VBAR_CACHE_HIT */
+			Stream_Write_UINT8(s, yOn);
+		}
+		else
+		{
+			Stream_Write_UINT16(s, yOn | (yOff << 8)); /* SHORT_VBAR_CACHE_MISS */
+
+			for (y = yOn; y < yOff; y++)
+				clear_write_color(s, vBar[y]);
+
+			index = clear->ShortVBarStorageCursor;
+
+			if (!clear_vbar_entry_set(&clear->ShortVBarStorage[index], &vBar[yOn], yOff - yOn))
+				return -1;
+
+			clear->ShortVBarHashTable[shortHash % CLEAR_SHORT_VBAR_HASH_SIZE] = index + 1;
+			clear->ShortVBarStorageCursor = (clear->ShortVBarStorageCursor + 1) % 16384;
+		}
+
+		/* the decoder stores the full vBar for both short vBar cases */
+
+		index = clear->VBarStorageCursor;
+
+		if (!clear_vbar_entry_set(&clear->VBarStorage[index], vBar, vBarHeight))
+			return -1;
+
+		clear->VBarHashTable[hash % CLEAR_VBAR_HASH_SIZE] = index + 1;
+		clear->VBarStorageCursor = (clear->VBarStorageCursor + 1) % 32768;
+	}
+
+	return 1;
+}
+
+static int clear_classify_block(CLEAR_CONTEXT* clear, const UINT32* pSrc, int nSrcStep,
+		int nWidth, int nHeight, UINT32* pColor)
+{
+	int numColors;
+	UINT32 bandsCost;
+	UINT32 rlexCost;
+	UINT32 residualCost;
+
+	*pColor = pSrc[0];
+	numColors = clear_count_colors(pSrc, nSrcStep, nWidth, nHeight, pColor);
+
+	if (numColors == 1)
+		return CLEAR_BLOCK_RESIDUAL;
+
+	bandsCost = clear_bands_cost(clear, pSrc, nSrcStep, nWidth, nHeight, *pColor);
+
+	if (numColors > CLEAR_MAX_PALETTE_SIZE)
+	{
+		/* anti-aliased text can exceed the palette but still compress well as bands */
+
+		if (bandsCost < (UINT32) (nWidth * nHeight))
+			return CLEAR_BLOCK_BANDS;
+
+		return CLEAR_BLOCK_IMAGE;
+	}
+
+	residualCost = clear_residual_cost(pSrc, nSrcStep, nWidth, nHeight);
+	rlexCost = clear_rlex_encode(pSrc, nSrcStep, nWidth, nHeight, NULL) + CLEAR_SUBCODEC_HEADER_SIZE;
+
+	if ((residualCost <= bandsCost) && (residualCost <= rlexCost))
+		return CLEAR_BLOCK_RESIDUAL;
+
+	if (bandsCost <= rlexCost)
+		return CLEAR_BLOCK_BANDS;
+
+	return CLEAR_BLOCK_RLEX;
+}
+
+static int clear_encode_bands(CLEAR_CONTEXT* clear, wStream* s, const UINT32* pSrc, int nSrcStep,
+		int xStart, int xEnd, int yStart, int yEnd, UINT32 colorBkg)
+{
+	int y;
+	int yNext;
+
+	for (y = yStart; y < yEnd; y = yNext)
+	{
+		yNext = clear_band_end(&pSrc[xStart], nSrcStep, xEnd - xStart, y, yEnd, colorBkg);
+
+		if (clear_encode_band(clear, s, pSrc, nSrcStep, xStart, xEnd, y, yNext, colorBkg) < 0)
+			return -1;
+	}
+
+	return 1;
+}
+
+/**
+ * Classifies the blocks of one band height and encodes the bands and
+ * subcodecs of that row. Bands are encoded before the next row is
+ * classified, so that its estimates see the vBars cached by this one.
+ */
+
+static int clear_encode_block_row(CLEAR_CONTEXT* clear, const UINT32* pSrc, int nWidth, int nHeight,
+		int nCols, int by, BOOL lossy)
+{
+	int x, y;
+	int bx;
+	int start;
+	int width;
+	int height;
+	BYTE* types;
+	UINT32* colors;
+
+	types = &clear->BlockTypes[by * nCols];
+	colors = &clear->BlockColors[by * nCols];
+
+	y = by * CLEAR_BAND_HEIGHT;
+	height = MIN(CLEAR_BAND_HEIGHT, nHeight - y);
+
+	for (bx = 0; bx < nCols; bx++)
+	{
+		x = bx * CLEAR_BLOCK_WIDTH;
+		width = MIN(CLEAR_BLOCK_WIDTH, nWidth - x);
+
+		types[bx] = clear_classify_block(clear, &pSrc[(y * nWidth) + x], nWidth, width, height, &colors[bx]);
+	}
+
+	for (bx = 0; bx < nCols; )
+	{
+		x = bx * CLEAR_BLOCK_WIDTH;
+		start = bx++;
+
+		if (types[start] == CLEAR_BLOCK_BANDS)
+		{
+			/* adjacent blocks with the same background share the bands */
+
+			while ((bx < nCols) && (types[bx] == CLEAR_BLOCK_BANDS) && (colors[bx] == colors[start]))
+				bx++;
+
+			width = MIN(bx * CLEAR_BLOCK_WIDTH, nWidth) - x;
+
+			if (clear_encode_bands(clear, clear->BandsStream, pSrc, nWidth, x, x + width,
+					y, y + height, colors[start]) < 0)
+				return -1;
+		}
+		else if (types[start] == CLEAR_BLOCK_RLEX)
+		{
+			width = MIN(CLEAR_BLOCK_WIDTH, nWidth - x);
+
+			if (clear_encode_rlex(clear->SubcodecStream, pSrc, nWidth, x, y, width, height) < 0)
+				return -1;
+		}
+		else if (types[start] == CLEAR_BLOCK_IMAGE)
+		{
+			while ((bx < nCols) && (types[bx] == CLEAR_BLOCK_IMAGE))
+				bx++;
+
+			width = MIN(bx * CLEAR_BLOCK_WIDTH, nWidth) - x;
+
+			if (clear_encode_image(clear, clear->SubcodecStream, pSrc, nWidth, x, y, width, height, lossy) < 0)
+				return -1;
+		}
+	}
+
+	return 1;
+}
+
+static int clear_encode_residual(CLEAR_CONTEXT* clear, wStream* s, const UINT32* pSrc,
+		int nWidth, int nHeight, int nCols, int nRows)
+{
+	int x, y;
+	int bx, by;
+	int xEnd;
+	int index;
+	UINT32 runColor;
+	UINT32 runLength = 0;
+	BOOL residual = FALSE;
+	const UINT32* pSrcPixel;
+
+	for (index = 0; index < (nCols * nRows); index++)
+	{
+		if (clear->BlockTypes[index] == CLEAR_BLOCK_RESIDUAL)
+			residual = TRUE;
+	}
+
+	/* bands and subcodecs cover the whole bitmap */
+
+	if (!residual)
+		return 1;
+
+	runColor = pSrc[0];
+
+	for (y = 0; y < nHeight; y++)
+	{
+		by = y / CLEAR_BAND_HEIGHT;
+		pSrcPixel = &pSrc[y * nWidth];
+
+		for (bx = 0; bx < nCols; bx++)
+		{
+			x = bx * CLEAR_BLOCK_WIDTH;
+			xEnd = MIN(x + CLEAR_BLOCK_WIDTH, nWidth);
+
+			/* pixels drawn by another layer extend the current run */
+
+			if (clear->BlockTypes[(by * nCols) + bx] != CLEAR_BLOCK_RESIDUAL)
+			{
+				runLength += (xEnd - x);
+				continue;
+			}
+
+			for (; x < xEnd; x++)
+			{
+				if (pSrcPixel[x] == runColor)
+				{
+					runLength++;
+					continue;
+				}
+
+				if (runLength && !clear_write_run(s, runColor, runLength))
+					return -1;
+
+				runColor = pSrcPixel[x];
+				runLength = 1;
+			}
+		}
+	}
+
+	if (!clear_write_run(s, runColor, runLength))
+		return -1;
+
+	return 1;
+}
+
+/**
+ * Compresses a bitmap into a ClearCodec stream which is returned in a buffer
+ * owned by the context, valid until the next call.
+ */
+
+int clear_compress(CLEAR_CONTEXT* clear, BYTE* pSrcData, DWORD SrcFormat, int nSrcStep,
+		int nWidth, int nHeight, BYTE** ppDstData, UINT32* pDstSize)
 {
+	int x, y;
+	int by;
+	int nCols;
+	int nRows;
+	BOOL invert;
+	BYTE* pSrcPixel;
+	UINT32* pixels;
+	UINT32 hash = 0;
+	UINT32 pixelCount;
+	UINT32 glyphIndex = 0;
+	UINT32* glyphSlot = NULL;
+	BYTE glyphFlags = 0;
+	BYTE seqNumber;
+	size_t residualOffset;
+	size_t bandsByteCount;
+	size_t subcodecByteCount;
+	CLEAR_GLYPH_ENTRY* glyphEntry;
+	wStream* s = clear->Stream;
+
+	if (!clear->Compressor || !pSrcData || !ppDstData || !pDstSize)
+		return -1;
+
+	if ((nWidth < 1) || (nHeight < 1) || (nWidth > 0xFFFF) || (nHeight > 0xFFFF))
+		return -1;
+
+	pixelCount = nWidth * nHeight;
+
+	if ((pixelCount * 4) > clear->TempSize)
+	{
+		BYTE* buffer = (BYTE*) realloc(clear->TempBuffer, pixelCount * 4);
+
+		if (!buffer)
+			return -1;
+
+		clear->TempBuffer = buffer;
+		clear->TempSize = pixelCount * 4;
+	}
+
+	nCols = (nWidth + CLEAR_BLOCK_WIDTH - 1) / CLEAR_BLOCK_WIDTH;
+	nRows = (nHeight + CLEAR_BAND_HEIGHT - 1) / CLEAR_BAND_HEIGHT;
+
+	if ((UINT32) (nCols * nRows) > clear->BlockCount)
+	{
+		BYTE* types = (BYTE*) realloc(clear->BlockTypes, nCols * nRows);
+		UINT32* colors = (UINT32*) realloc(clear->BlockColors, nCols * nRows * 4);
+
+		if (types)
+			clear->BlockTypes = types;
+
+		if (colors)
+			clear->BlockColors = colors;
+
+		if (!types || !colors)
+			return -1;
+
+		clear->BlockCount = nCols * nRows;
+	}
+
+	/* all layers work on 0x00RRGGBB pixels, the same as the decoder caches */
+
+	invert = FREERDP_PIXEL_FORMAT_IS_ABGR(SrcFormat) ? TRUE : FALSE;
+	pixels = (UINT32*) clear->TempBuffer;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		pSrcPixel = &pSrcData[y * nSrcStep];
+
+		if (!invert)
+		{
+			for (x = 0; x < nWidth; x++)
+			{
+				*pixels++ = RGB32(pSrcPixel[2], pSrcPixel[1], pSrcPixel[0]);
+				pSrcPixel += 4;
+			}
+		}
+		else
+		{
+			for (x = 0; x < nWidth; x++)
+			{
+				*pixels++ = RGB32(pSrcPixel[0], pSrcPixel[1], pSrcPixel[2]);
+				pSrcPixel += 4;
+			}
+		}
+	}
+
+	pixels = (UINT32*) clear->TempBuffer;
+
+	Stream_SetPosition(s, 0);
+
+	if (!Stream_EnsureRemainingCapacity(s, 16))
+		return -1;
+
+	if (clear->CacheReset)
+	{
+		glyphFlags |= CLEARCODEC_FLAG_CACHE_RESET;
+		clear->CacheReset = FALSE;
+	}
+
+	seqNumber = (BYTE) clear->seqNumber;
+	clear->seqNumber = (clear->seqNumber + 1) % 256;
+
+	if (pixelCount <= CLEAR_GLYPH_MAX_PIXELS)
+	{
+		hash = clear_hash_pixels(pixels, pixelCount);
+		glyphSlot = &clear->GlyphHashTable[hash % CLEAR_GLYPH_HASH_SIZE];
+
+		if (*glyphSlot)
+		{
+			glyphEntry = &clear->GlyphCache[*glyphSlot - 1];
+
+			if ((glyphEntry->count == pixelCount) &&
+					(memcmp(glyphEntry->pixels, pixels, pixelCount * 4) == 0))
+			{
+				glyphFlags |= CLEARCODEC_FLAG_GLYPH_INDEX | CLEARCODEC_FLAG_GLYPH_HIT;
+
+				Stream_Write_UINT8(s, glyphFlags);
+				Stream_Write_UINT8(s, seqNumber);
+				Stream_Write_UINT16(s, *glyphSlot - 1);
+
+				*ppDstData = Stream_Buffer(s);
+				*pDstSize = (UINT32) Stream_GetPosition(s);
+
+				return 1;
+			}
+		}
+
+		glyphFlags |= CLEARCODEC_FLAG_GLYPH_INDEX;
+		glyphIndex = clear->GlyphCacheCursor;
+		clear->GlyphCacheCursor = (clear->GlyphCacheCursor + 1) % 4000;
+	}
+
+	Stream_Write_UINT8(s, glyphFlags);
+	Stream_Write_UINT8(s, seqNumber);
+
+	if (glyphFlags & CLEARCODEC_FLAG_GLYPH_INDEX)
+		Stream_Write_UINT16(s, glyphIndex);
+
+	/* composition header, filled in once the layers are encoded */
+
+	Stream_Zero(s, 12);
+	residualOffset = Stream_GetPosition(s);
+
+	Stream_SetPosition(clear->BandsStream, 0);
+	Stream_SetPosition(clear->SubcodecStream, 0);
+	ZeroMemory(clear->ShortVBarSeen, CLEAR_SHORT_VBAR_SEEN_SIZE * 4);
+
+	for (by = 0; by < nRows; by++)
+	{
+		/* glyphs are cached by the decoder, they must not be lossy */
+
+		if (clear_encode_block_row(clear, pixels, nWidth, nHeight, nCols, by, glyphSlot ? FALSE : TRUE) < 0)
+			goto fail;
+	}
+
+	if (clear_encode_residual(clear, s, pixels, nWidth, nHeight, nCols, nRows) < 0)
+		goto fail;
+
+	bandsByteCount = Stream_GetPosition(clear->BandsStream);
+	subcodecByteCount = Stream_GetPosition(clear->SubcodecStream);
+
+	if (!Stream_EnsureRemainingCapacity(s, bandsByteCount + subcodecByteCount))
+		goto fail;
+
+	Stream_Write(s, Stream_Buffer(clear->BandsStream), bandsByteCount);
+	Stream_Write(s, Stream_Buffer(clear->SubcodecStream), subcodecByteCount);
+
+	*pDstSize = (UINT32) Stream_GetPosition(s);
+
+	Stream_SetPosition(s, residualOffset - 12);
+	Stream_Write_UINT32(s, (UINT32) (*pDstSize - residualOffset - bandsByteCount - subcodecByteCount)); /* residualByteCount (4 bytes) */
+	Stream_Write_UINT32(s, (UINT32) bandsByteCount); /* bandsByteCount (4 bytes) */
+	Stream_Write_UINT32(s, (UINT32) subcodecByteCount); /* subcodecByteCount (4 bytes) */
+	Stream_SetPosition(s, *pDstSize);
+
+	if (glyphSlot)
+	{
+		glyphEntry = &clear->GlyphCache[glyphIndex];
+
+		if (pixelCount > glyphEntry->size)
+		{
+			UINT32* glyphPixels = (UINT32*) realloc(glyphEntry->pixels, pixelCount * 4);
+
+			if (!glyphPixels)
+				goto fail;
+
+			glyphEntry->pixels = glyphPixels;
+			glyphEntry->size = pixelCount;
+		}
+
+		CopyMemory(glyphEntry->pixels, pixels, pixelCount * 4);
+		glyphEntry->count = pixelCount;
+
+		*glyphSlot = glyphIndex + 1;
+	}
+
+	*ppDstData = Stream_Buffer(s);
+
 	return 1;
+
+fail:
+	/**
+	 * The vBars and glyph of a failed message may already be in the encoder
+	 * caches but never reach the decoder. Start over with empty caches and
+	 * reuse the sequence number, the next message carries the cache reset.
+	 */
+	clear_context_reset(clear);
+	clear->seqNumber = seqNumber;
+	return -1;
 }
 
 int clear_context_reset(CLEAR_CONTEXT* clear)
@@ -832,6 +1849,18 @@ int clear_context_reset(CLEAR_CONTEXT* clear)
 	clear->seqNumber = 0;
 	clear->VBarStorageCursor = 0;
 	clear->ShortVBarStorageCursor = 0;
+
+	if (clear->Compressor)
+	{
+		/* forget the cache contents and have the decoder reset its cursors */
+
+		clear->CacheReset = TRUE;
+		clear->GlyphCacheCursor = 0;
+		ZeroMemory(clear->GlyphHashTable, CLEAR_GLYPH_HASH_SIZE * 4);
+		ZeroMemory(clear->VBarHashTable, CLEAR_VBAR_HASH_SIZE * 4);
+		ZeroMemory(clear->ShortVBarHashTable, CLEAR_SHORT_VBAR_HASH_SIZE * 4);
+	}
+
 	return 1;
 }
 
@@ -858,6 +1887,29 @@ CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
 		clear->TempSize = 512 * 512 * 4;
 		clear->TempBuffer = (BYTE*) malloc(clear->TempSize);
 
+		if (Compressor)
+		{
+			nsc_context_set_pixel_format(clear->nsc, RDP_PIXEL_FORMAT_B8G8R8A8);
+			clear->nsc->ColorLossLevel = 2;
+			clear->nsc->ChromaSubsamplingLevel = 0;
+
+			clear->Stream = Stream_New(NULL, 64 * 1024);
+			clear->BandsStream = Stream_New(NULL, 64 * 1024);
+			clear->SubcodecStream = Stream_New(NULL, 64 * 1024);
+			clear->GlyphHashTable = (UINT32*) calloc(CLEAR_GLYPH_HASH_SIZE, 4);
+			clear->VBarHashTable = (UINT32*) calloc(CLEAR_VBAR_HASH_SIZE, 4);
+			clear->ShortVBarHashTable = (UINT32*) calloc(CLEAR_SHORT_VBAR_HASH_SIZE, 4);
+			clear->ShortVBarSeen = (UINT32*) calloc(CLEAR_SHORT_VBAR_SEEN_SIZE, 4);
+
+			if (!clear->Stream || !clear->BandsStream || !clear->SubcodecStream ||
+					!clear->GlyphHashTable || !clear->VBarHashTable ||
+					!clear->ShortVBarHashTable || !clear->ShortVBarSeen)
+			{
+				clear_context_free(clear);
+				return NULL;
+			}
+		}
+
 		clear_context_reset(clear);
 	}
 
@@ -875,6 +1927,22 @@ void clear_context_free(CLEAR_CONTEXT* clear)
 
 	free(clear->TempBuffer);
 
+	if (clear->Stream)
+		Stream_Free(clear->Stream, TRUE);
+
+	if (clear->BandsStream)
+		Stream_Free(clear->BandsStream, TRUE);
+
+	if (clear->SubcodecStream)
+		Stream_Free(clear->SubcodecStream, TRUE);
+
+	free(clear->GlyphHashTable);
+	free(clear->VBarHashTable);
+	free(clear->ShortVBarHashTable);
+	free(clear->ShortVBarSeen);
+	free(clear->BlockTypes);
+	free(clear->BlockColors);
+
 	for (i = 0; i < 4000; i++)
 		free(clear->GlyphCache[i].pixels);
 
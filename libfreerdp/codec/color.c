@@ -26,6 +26,7 @@
 #include <stdlib.h>
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 
 #include <freerdp/api.h>
 #include <freerdp/log.h>
@@ -33,6 +34,13 @@
 #include <freerdp/primitives.h>
 #include <freerdp/codec/color.h>
 
+#include "color_types.h"
+#include "color_sse2.h"
+
+#ifndef COLOR_INIT_SIMD
+#define COLOR_INIT_SIMD(_rows) do { } while (0)
+#endif
+
 #define TAG FREERDP_TAG("color")
 
 int freerdp_get_pixel(BYTE* data, int x, int y, int width, int height, int bpp)
@@ -3271,16 +3279,236 @@ int freerdp_image32_copy(BYTE* pDstData, DWORD DstFormat, int nDstStep, int nXDs
 	return -1;
 }
 
+static void freerdp_image_copy_row32(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	MoveMemory(pDst, pSrc, nWidth * 4);
+}
+
+static void freerdp_image_copy_row24(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	MoveMemory(pDst, pSrc, nWidth * 3);
+}
+
+static void freerdp_image_copy_row16(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	MoveMemory(pDst, pSrc, nWidth * 2);
+}
+
+static void freerdp_image_copy_row_swap32(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+	BYTE a, r, g, b;
+	const UINT32* pSrcPixel = (const UINT32*) pSrc;
+	UINT32* pDstPixel = (UINT32*) pDst;
+
+	for (x = 0; x < nWidth; x++)
+	{
+		GetARGB32(a, r, g, b, pSrcPixel[x]);
+		pDstPixel[x] = ABGR32(a, r, g, b);
+	}
+}
+
+static void freerdp_image_copy_row_swap32_opaque(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+
+	for (x = 0; x < nWidth; x++)
+	{
+		pDst[0] = pSrc[2];
+		pDst[1] = pSrc[1];
+		pDst[2] = pSrc[0];
+		pDst[3] = 0xFF;
+
+		pSrc += 4;
+		pDst += 4;
+	}
+}
+
+static void freerdp_image_copy_row_rgb16_to_argb32(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+	BYTE r, g, b;
+	const UINT16* pSrcPixel = (const UINT16*) pSrc;
+	UINT32* pDstPixel = (UINT32*) pDst;
+
+	for (x = 0; x < nWidth; x++)
+	{
+		GetRGB16(r, g, b, pSrcPixel[x]);
+		pDstPixel[x] = ARGB32(0xFF, r, g, b);
+	}
+}
+
+static void freerdp_image_copy_row_rgb16_to_abgr32(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+	BYTE r, g, b;
+	const UINT16* pSrcPixel = (const UINT16*) pSrc;
+	UINT32* pDstPixel = (UINT32*) pDst;
+
+	for (x = 0; x < nWidth; x++)
+	{
+		GetRGB16(r, g, b, pSrcPixel[x]);
+		pDstPixel[x] = ABGR32(0xFF, r, g, b);
+	}
+}
+
+static void freerdp_image_copy_row_rgb24_to_argb32(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+
+	for (x = 0; x < nWidth; x++)
+	{
+		*pDst++ = *pSrc++;
+		*pDst++ = *pSrc++;
+		*pDst++ = *pSrc++;
+		*pDst++ = 0xFF;
+	}
+}
+
+static void freerdp_image_copy_row_rgb24_to_abgr32(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+
+	for (x = 0; x < nWidth; x++)
+	{
+		pDst[0] = pSrc[2];
+		pDst[1] = pSrc[1];
+		pDst[2] = pSrc[0];
+		pDst[3] = 0xFF;
+
+		pSrc += 3;
+		pDst += 4;
+	}
+}
+
+static FREERDP_IMAGE_COPY_ROWS g_ImageCopyRows;
+static INIT_ONCE g_ImageCopyRowsOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK freerdp_image_copy_init_rows(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	FREERDP_IMAGE_COPY_ROWS* rows = &g_ImageCopyRows;
+
+	rows->Swap32 = freerdp_image_copy_row_swap32;
+	rows->Swap32Opaque = freerdp_image_copy_row_swap32_opaque;
+	rows->RGB16ToARGB32 = freerdp_image_copy_row_rgb16_to_argb32;
+	rows->RGB16ToABGR32 = freerdp_image_copy_row_rgb16_to_abgr32;
+	rows->RGB24ToARGB32 = freerdp_image_copy_row_rgb24_to_argb32;
+	rows->RGB24ToABGR32 = freerdp_image_copy_row_rgb24_to_abgr32;
+
+	COLOR_INIT_SIMD(rows);
+
+	return TRUE;
+}
+
+/**
+ * Resolves a format pair to a row function for the conversions that sit on
+ * the client output paths. The selection mirrors freerdp_image16/24/32_copy,
+ * including which of them honour a vertical flip, so the result is identical;
+ * any other pair returns NULL and takes the per-bpp path.
+ */
+static pfnImageCopyRow freerdp_image_copy_get_row(DWORD DstFormat, DWORD SrcFormat, BOOL* vFlip)
+{
+	const FREERDP_IMAGE_COPY_ROWS* rows = &g_ImageCopyRows;
+	int srcBitsPerPixel = FREERDP_PIXEL_FORMAT_DEPTH(SrcFormat);
+	int srcBytesPerPixel = (FREERDP_PIXEL_FORMAT_BPP(SrcFormat) / 8);
+	int dstBitsPerPixel = FREERDP_PIXEL_FORMAT_DEPTH(DstFormat);
+	int dstBytesPerPixel = (FREERDP_PIXEL_FORMAT_BPP(DstFormat) / 8);
+	BOOL invert = (FREERDP_PIXEL_FORMAT_TYPE(SrcFormat) != FREERDP_PIXEL_FORMAT_TYPE(DstFormat));
+
+	if (!InitOnceExecuteOnce(&g_ImageCopyRowsOnce, freerdp_image_copy_init_rows, NULL, NULL))
+		return NULL;
+
+	*vFlip = (FREERDP_PIXEL_FORMAT_FLIP(SrcFormat) != FREERDP_PIXEL_FORMAT_FLIP(DstFormat));
+
+	if ((srcBytesPerPixel == dstBytesPerPixel) && !invert &&
+		(FREERDP_PIXEL_FORMAT_VIS(SrcFormat) == FREERDP_PIXEL_FORMAT_VIS(DstFormat)))
+	{
+		if (srcBytesPerPixel == 4)
+			return freerdp_image_copy_row32;
+		else if (srcBytesPerPixel == 3)
+			return freerdp_image_copy_row24;
+		else if ((srcBytesPerPixel == 2) && (srcBitsPerPixel == 16))
+			return freerdp_image_copy_row16;
+	}
+
+	if ((dstBytesPerPixel != 4) || ((dstBitsPerPixel != 32) && (dstBitsPerPixel != 24)))
+		return NULL;
+
+	if (srcBytesPerPixel == 4)
+	{
+		if (srcBitsPerPixel != 24)
+			return NULL;
+
+		if (dstBitsPerPixel == 32)
+		{
+			/* freerdp_image32_copy never flips into a destination with alpha */
+			*vFlip = FALSE;
+			return invert ? rows->Swap32 : freerdp_image_copy_row32;
+		}
+
+		return invert ? rows->Swap32Opaque : freerdp_image_copy_row32;
+	}
+	else if (srcBytesPerPixel == 3)
+	{
+		return invert ? rows->RGB24ToABGR32 : rows->RGB24ToARGB32;
+	}
+	else if ((srcBytesPerPixel == 2) && (srcBitsPerPixel == 16))
+	{
+		return invert ? rows->RGB16ToABGR32 : rows->RGB16ToARGB32;
+	}
+
+	return NULL;
+}
+
 int freerdp_image_copy(BYTE* pDstData, DWORD DstFormat, int nDstStep, int nXDst, int nYDst,
 		int nWidth, int nHeight, BYTE* pSrcData, DWORD SrcFormat, int nSrcStep, int nXSrc, int nYSrc, BYTE* palette)
 {
+	int y;
 	int status = -1;
+	BOOL vFlip = FALSE;
+	pfnImageCopyRow copyRow;
 	int srcBitsPerPixel;
 	int srcBytesPerPixel;
 
 	srcBitsPerPixel = FREERDP_PIXEL_FORMAT_DEPTH(SrcFormat);
 	srcBytesPerPixel = (FREERDP_PIXEL_FORMAT_BPP(SrcFormat) / 8);
 
+	copyRow = freerdp_image_copy_get_row(DstFormat, SrcFormat, &vFlip);
+
+	if (copyRow)
+	{
+		BYTE* pSrcPixel;
+		BYTE* pDstPixel;
+		int dstBytesPerPixel = (FREERDP_PIXEL_FORMAT_BPP(DstFormat) / 8);
+
+		if (nSrcStep < 0)
+			nSrcStep = srcBytesPerPixel * nWidth;
+
+		if (nDstStep < 0)
+			nDstStep = dstBytesPerPixel * nWidth;
+
+		pDstPixel = &pDstData[(nYDst * nDstStep) + (nXDst * dstBytesPerPixel)];
+
+		if (!vFlip)
+		{
+			pSrcPixel = &pSrcData[(nYSrc * nSrcStep) + (nXSrc * srcBytesPerPixel)];
+		}
+		else
+		{
+			pSrcPixel = &pSrcData[((nYSrc + nHeight - 1) * nSrcStep) + (nXSrc * srcBytesPerPixel)];
+			nSrcStep = -nSrcStep;
+		}
+
+		for (y = 0; y < nHeight; y++)
+		{
+			copyRow(pDstPixel, pSrcPixel, nWidth);
+			pSrcPixel = &pSrcPixel[nSrcStep];
+			pDstPixel = &pDstPixel[nDstStep];
+		}
+
+		return 1;
+	}
+
 	if (srcBytesPerPixel == 4)
 	{
 		status = freerdp_image32_copy(pDstData, DstFormat, nDstStep, nXDst, nYDst,
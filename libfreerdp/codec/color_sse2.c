@@ -0,0 +1,216 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Color Conversion Routines - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/color.h>
+
+#include "color_types.h"
+#include "color_sse2.h"
+
+/**
+ * Every row function produces exactly the pixels of the scalar loops in
+ * freerdp_image16/24/32_copy; the tails are converted the same way.
+ */
+
+static INLINE __m128i color_swap_rb32_sse2(__m128i v)
+{
+	__m128i ag = _mm_and_si128(v, _mm_set1_epi32((int) 0xFF00FF00));
+	__m128i rb = _mm_and_si128(v, _mm_set1_epi32(0x00FF00FF));
+
+	/* bytes 1 and 3 of rb are clear, so rotating by 16 swaps bytes 0 and 2 */
+	rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+
+	return _mm_or_si128(ag, rb);
+}
+
+static void color_copy_row_swap32_sse2(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+	UINT32 pixel;
+
+	for (x = 0; x + 4 <= nWidth; x += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*) &pSrc[x * 4]);
+		_mm_storeu_si128((__m128i*) &pDst[x * 4], color_swap_rb32_sse2(v));
+	}
+
+	for (; x < nWidth; x++)
+	{
+		pixel = ((const UINT32*) pSrc)[x];
+		((UINT32*) pDst)[x] = (pixel & 0xFF00FF00) |
+			((pixel & 0xFF) << 16) | ((pixel >> 16) & 0xFF);
+	}
+}
+
+static void color_copy_row_swap32_opaque_sse2(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	int x;
+	const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+
+	for (x = 0; x + 4 <= nWidth; x += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*) &pSrc[x * 4]);
+		v = _mm_or_si128(color_swap_rb32_sse2(v), alpha);
+		_mm_storeu_si128((__m128i*) &pDst[x * 4], v);
+	}
+
+	for (; x < nWidth; x++)
+	{
+		pDst[x * 4 + 0] = pSrc[x * 4 + 2];
+		pDst[x * 4 + 1] = pSrc[x * 4 + 1];
+		pDst[x * 4 + 2] = pSrc[x * 4 + 0];
+		pDst[x * 4 + 3] = 0xFF;
+	}
+}
+
+/**
+ * Expands eight RGB565 pixels to 8 bits per channel, replicating the top
+ * bits into the low ones like RGB_565_888.
+ */
+static INLINE void color_unpack_rgb565_sse2(__m128i p, __m128i* r, __m128i* g, __m128i* b)
+{
+	__m128i r5 = _mm_srli_epi16(p, 11);
+	__m128i g6 = _mm_and_si128(_mm_srli_epi16(p, 5), _mm_set1_epi16(0x3F));
+	__m128i b5 = _mm_and_si128(p, _mm_set1_epi16(0x1F));
+
+	*r = _mm_or_si128(_mm_slli_epi16(r5, 3), _mm_srli_epi16(r5, 2));
+	*g = _mm_or_si128(_mm_slli_epi16(g6, 2), _mm_srli_epi16(g6, 4));
+	*b = _mm_or_si128(_mm_slli_epi16(b5, 3), _mm_srli_epi16(b5, 2));
+}
+
+static void color_copy_row_rgb16_sse2(BYTE* pDst, const BYTE* pSrc, int nWidth, BOOL invert)
+{
+	int x;
+	BYTE r, g, b;
+	UINT16 pixel;
+	const __m128i alpha = _mm_set1_epi16((short) 0xFF00);
+
+	for (x = 0; x + 8 <= nWidth; x += 8)
+	{
+		__m128i R, G, B, lo, hi;
+
+		color_unpack_rgb565_sse2(_mm_loadu_si128((const __m128i*) &pSrc[x * 2]), &R, &G, &B);
+
+		/* each output pixel is the 16-bit pair (lo, hi) */
+		if (!invert)
+		{
+			lo = _mm_or_si128(B, _mm_slli_epi16(G, 8));
+			hi = _mm_or_si128(R, alpha);
+		}
+		else
+		{
+			lo = _mm_or_si128(R, _mm_slli_epi16(G, 8));
+			hi = _mm_or_si128(B, alpha);
+		}
+
+		_mm_storeu_si128((__m128i*) &pDst[x * 4], _mm_unpacklo_epi16(lo, hi));
+		_mm_storeu_si128((__m128i*) &pDst[x * 4 + 16], _mm_unpackhi_epi16(lo, hi));
+	}
+
+	for (; x < nWidth; x++)
+	{
+		pixel = ((const UINT16*) pSrc)[x];
+		GetRGB16(r, g, b, pixel);
+		((UINT32*) pDst)[x] = invert ? ABGR32(0xFF, r, g, b) : ARGB32(0xFF, r, g, b);
+	}
+}
+
+static void color_copy_row_rgb16_to_argb32_sse2(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	color_copy_row_rgb16_sse2(pDst, pSrc, nWidth, FALSE);
+}
+
+static void color_copy_row_rgb16_to_abgr32_sse2(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	color_copy_row_rgb16_sse2(pDst, pSrc, nWidth, TRUE);
+}
+
+/**
+ * Sixteen 24-bpp pixels are exactly three vectors: palignr lines each
+ * group of four up at the bottom of a register, so no load runs past the
+ * end of the row.
+ */
+static INLINE void color_copy_row_rgb24_ssse3(BYTE* pDst, const BYTE* pSrc, int nWidth,
+		const __m128i shuffle, BOOL invert)
+{
+	int x;
+	const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+
+	for (x = 0; x + 16 <= nWidth; x += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*) &pSrc[x * 3]);
+		__m128i b = _mm_loadu_si128((const __m128i*) &pSrc[x * 3 + 16]);
+		__m128i c = _mm_loadu_si128((const __m128i*) &pSrc[x * 3 + 32]);
+		__m128i* dst = (__m128i*) &pDst[x * 4];
+
+		_mm_storeu_si128(&dst[0], _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+		_mm_storeu_si128(&dst[1], _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+		_mm_storeu_si128(&dst[2], _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+		_mm_storeu_si128(&dst[3], _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+	}
+
+	for (; x < nWidth; x++)
+	{
+		pDst[x * 4 + 0] = pSrc[x * 3 + (invert ? 2 : 0)];
+		pDst[x * 4 + 1] = pSrc[x * 3 + 1];
+		pDst[x * 4 + 2] = pSrc[x * 3 + (invert ? 0 : 2)];
+		pDst[x * 4 + 3] = 0xFF;
+	}
+}
+
+static void color_copy_row_rgb24_to_argb32_ssse3(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+		6, 7, 8, -1, 9, 10, 11, -1);
+
+	color_copy_row_rgb24_ssse3(pDst, pSrc, nWidth, shuffle, FALSE);
+}
+
+static void color_copy_row_rgb24_to_abgr32_ssse3(BYTE* pDst, const BYTE* pSrc, int nWidth)
+{
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1,
+		8, 7, 6, -1, 11, 10, 9, -1);
+
+	color_copy_row_rgb24_ssse3(pDst, pSrc, nWidth, shuffle, TRUE);
+}
+
+void freerdp_image_copy_init_sse2(FREERDP_IMAGE_COPY_ROWS* rows)
+{
+	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	rows->Swap32 = color_copy_row_swap32_sse2;
+	rows->Swap32Opaque = color_copy_row_swap32_opaque_sse2;
+	rows->RGB16ToARGB32 = color_copy_row_rgb16_to_argb32_sse2;
+	rows->RGB16ToABGR32 = color_copy_row_rgb16_to_abgr32_sse2;
+
+	if (IsProcessorFeaturePresentEx(PF_EX_SSSE3))
+	{
+		rows->RGB24ToARGB32 = color_copy_row_rgb24_to_argb32_ssse3;
+		rows->RGB24ToABGR32 = color_copy_row_rgb24_to_abgr32_ssse3;
+	}
+}
@@ -0,0 +1,40 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Color Conversion Routines
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __COLOR_TYPES_H
+#define __COLOR_TYPES_H
+
+#include <freerdp/types.h>
+
+/**
+ * Converts nWidth pixels of a single row. freerdp_image_copy resolves a
+ * (SrcFormat, DstFormat) pair to one of these before walking the rows.
+ */
+typedef void (*pfnImageCopyRow)(BYTE* pDst, const BYTE* pSrc, int nWidth);
+
+struct _FREERDP_IMAGE_COPY_ROWS
+{
+	pfnImageCopyRow Swap32;		/* 32bpp, R and B swapped, alpha kept */
+	pfnImageCopyRow Swap32Opaque;	/* 32bpp, R and B swapped, alpha set to 0xFF */
+	pfnImageCopyRow RGB16ToARGB32;	/* RGB565 to ARGB32 */
+	pfnImageCopyRow RGB16ToABGR32;	/* RGB565 to ABGR32 */
+	pfnImageCopyRow RGB24ToARGB32;	/* 24bpp to 32bpp, byte order kept */
+	pfnImageCopyRow RGB24ToABGR32;	/* 24bpp to 32bpp, R and B swapped */
+};
+typedef struct _FREERDP_IMAGE_COPY_ROWS FREERDP_IMAGE_COPY_ROWS;
+
+#endif /* __COLOR_TYPES_H */
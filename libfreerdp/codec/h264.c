@@ -26,6 +26,7 @@
 #include <winpr/bitstream.h>
 
 #include <freerdp/primitives.h>
+#include <freerdp/codec/color.h>
 #include <freerdp/codec/h264.h>
 #include <freerdp/log.h>
 
@@ -40,6 +41,11 @@ static int dummy_decompress(H264_CONTEXT* h264, BYTE* pSrcData, UINT32 SrcSize)
 	return -1;
 }
 
+static int dummy_compress(H264_CONTEXT* h264, BYTE** ppDstData, UINT32* pDstSize)
+{
+	return -1;
+}
+
 static void dummy_uninit(H264_CONTEXT* h264)
 {
 
@@ -55,7 +61,8 @@ static H264_CONTEXT_SUBSYSTEM g_Subsystem_dummy =
 	"dummy",
 	dummy_init,
 	dummy_uninit,
-	dummy_decompress
+	dummy_decompress,
+	dummy_compress
 };
 
 /**
@@ -70,6 +77,8 @@ static H264_CONTEXT_SUBSYSTEM g_Subsystem_dummy =
 struct _H264_CONTEXT_OPENH264
 {
 	ISVCDecoder* pDecoder;
+	ISVCEncoder* pEncoder;
+	SEncParamExt EncParamExt;
 };
 typedef struct _H264_CONTEXT_OPENH264 H264_CONTEXT_OPENH264;
 
@@ -148,6 +157,159 @@ static int openh264_decompress(H264_CONTEXT* h264, BYTE* pSrcData, UINT32 SrcSiz
 	return 1;
 }
 
+/**
+ * The encoder is (re)initialized lazily, once the frame size is known and
+ * whenever it or the rate control mode changes. Bit rate and frame rate
+ * changes are applied on the fly.
+ */
+
+static int openh264_compress(H264_CONTEXT* h264, BYTE** ppDstData, UINT32* pDstSize)
+{
+	int i, j;
+	int status;
+	SFrameBSInfo info;
+	SSourcePicture pic;
+	SBitrateInfo bitrate;
+	H264_CONTEXT_OPENH264* sys = (H264_CONTEXT_OPENH264*) h264->pSystemData;
+
+	if (!sys->pEncoder)
+		return -1;
+
+	if (!h264->pYUVData[0] || !h264->pYUVData[1] || !h264->pYUVData[2])
+		return -1;
+
+	if ((sys->EncParamExt.iPicWidth != (int) h264->width) ||
+			(sys->EncParamExt.iPicHeight != (int) h264->height) ||
+			((sys->EncParamExt.iRCMode == RC_OFF_MODE) != (h264->RateControlMode == H264_RATECONTROL_CQP)) ||
+			((h264->RateControlMode == H264_RATECONTROL_CQP) &&
+				(sys->EncParamExt.sSpatialLayers[0].iDLayerQp != (int) h264->QP)))
+	{
+		status = (*sys->pEncoder)->GetDefaultParams(sys->pEncoder, &sys->EncParamExt);
+
+		if (status < 0)
+		{
+			WLog_ERR(TAG, "Failed to get OpenH264 default parameters (status=%d)", status);
+			return status;
+		}
+
+		sys->EncParamExt.iUsageType = SCREEN_CONTENT_REAL_TIME;
+		sys->EncParamExt.iPicWidth = h264->width;
+		sys->EncParamExt.iPicHeight = h264->height;
+		sys->EncParamExt.fMaxFrameRate = h264->FrameRate;
+		sys->EncParamExt.iMaxBitrate = UNSPECIFIED_BIT_RATE;
+		sys->EncParamExt.bEnableDenoise = 0;
+		sys->EncParamExt.bEnableLongTermReference = 0;
+		sys->EncParamExt.bEnableFrameSkip = 0;
+		sys->EncParamExt.iSpatialLayerNum = 1;
+		sys->EncParamExt.iMultipleThreadIdc = h264->NumberOfThreads;
+		sys->EncParamExt.sSpatialLayers[0].fFrameRate = h264->FrameRate;
+		sys->EncParamExt.sSpatialLayers[0].iVideoWidth = sys->EncParamExt.iPicWidth;
+		sys->EncParamExt.sSpatialLayers[0].iVideoHeight = sys->EncParamExt.iPicHeight;
+		sys->EncParamExt.sSpatialLayers[0].iMaxSpatialBitrate = sys->EncParamExt.iMaxBitrate;
+
+		switch (h264->RateControlMode)
+		{
+			case H264_RATECONTROL_VBR:
+				sys->EncParamExt.iRCMode = RC_BITRATE_MODE;
+				sys->EncParamExt.iTargetBitrate = h264->BitRate;
+				sys->EncParamExt.sSpatialLayers[0].iSpatialBitrate = sys->EncParamExt.iTargetBitrate;
+				break;
+
+			case H264_RATECONTROL_CQP:
+				sys->EncParamExt.iRCMode = RC_OFF_MODE;
+				sys->EncParamExt.sSpatialLayers[0].iDLayerQp = h264->QP;
+				break;
+		}
+
+		(*sys->pEncoder)->Uninitialize(sys->pEncoder);
+
+		status = (*sys->pEncoder)->InitializeExt(sys->pEncoder, &sys->EncParamExt);
+
+		if (status < 0)
+		{
+			WLog_ERR(TAG, "Failed to initialize OpenH264 encoder (status=%d)", status);
+			sys->EncParamExt.iPicWidth = 0;
+			return status;
+		}
+
+		status = (*sys->pEncoder)->GetOption(sys->pEncoder, ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, &sys->EncParamExt);
+
+		if (status < 0)
+		{
+			WLog_ERR(TAG, "Failed to get initial OpenH264 encoder parameters (status=%d)", status);
+			return status;
+		}
+	}
+	else if (h264->RateControlMode == H264_RATECONTROL_VBR)
+	{
+		if (sys->EncParamExt.iTargetBitrate != (int) h264->BitRate)
+		{
+			sys->EncParamExt.iTargetBitrate = h264->BitRate;
+			bitrate.iLayer = SPATIAL_LAYER_ALL;
+			bitrate.iBitrate = h264->BitRate;
+
+			status = (*sys->pEncoder)->SetOption(sys->pEncoder, ENCODER_OPTION_BITRATE, &bitrate);
+
+			if (status < 0)
+			{
+				WLog_ERR(TAG, "Failed to set OpenH264 encoder bitrate (status=%d)", status);
+				return status;
+			}
+		}
+
+		if (sys->EncParamExt.fMaxFrameRate != h264->FrameRate)
+		{
+			sys->EncParamExt.fMaxFrameRate = h264->FrameRate;
+
+			status = (*sys->pEncoder)->SetOption(sys->pEncoder, ENCODER_OPTION_FRAME_RATE, &sys->EncParamExt.fMaxFrameRate);
+
+			if (status < 0)
+			{
+				WLog_ERR(TAG, "Failed to set OpenH264 encoder framerate (status=%d)", status);
+				return status;
+			}
+		}
+	}
+
+	ZeroMemory(&info, sizeof(SFrameBSInfo));
+	ZeroMemory(&pic, sizeof(SSourcePicture));
+
+	pic.iPicWidth = h264->width;
+	pic.iPicHeight = h264->height;
+	pic.iColorFormat = videoFormatI420;
+
+	pic.iStride[0] = h264->iStride[0];
+	pic.iStride[1] = h264->iStride[1];
+	pic.iStride[2] = h264->iStride[2];
+
+	pic.pData[0] = h264->pYUVData[0];
+	pic.pData[1] = h264->pYUVData[1];
+	pic.pData[2] = h264->pYUVData[2];
+
+	status = (*sys->pEncoder)->EncodeFrame(sys->pEncoder, &pic, &info);
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "Failed to encode frame (status=%d)", status);
+		return status;
+	}
+
+	/* the NAL units of all layers are contiguous in the encoder buffer */
+
+	*ppDstData = info.sLayerInfo[0].pBsBuf;
+	*pDstSize = 0;
+
+	for (i = 0; i < info.iLayerNum; i++)
+	{
+		for (j = 0; j < info.sLayerInfo[i].iNalCount; j++)
+		{
+			*pDstSize += info.sLayerInfo[i].pNalLengthInByte[j];
+		}
+	}
+
+	return 1;
+}
+
 static void openh264_uninit(H264_CONTEXT* h264)
 {
 	H264_CONTEXT_OPENH264* sys = (H264_CONTEXT_OPENH264*) h264->pSystemData;
@@ -161,6 +323,13 @@ static void openh264_uninit(H264_CONTEXT* h264)
 			sys->pDecoder = NULL;
 		}
 
+		if (sys->pEncoder)
+		{
+			(*sys->pEncoder)->Uninitialize(sys->pEncoder);
+			WelsDestroySVCEncoder(sys->pEncoder);
+			sys->pEncoder = NULL;
+		}
+
 		free(sys);
 		h264->pSystemData = NULL;
 	}
@@ -184,6 +353,19 @@ static BOOL openh264_init(H264_CONTEXT* h264)
 
 	h264->pSystemData = (void*) sys;
 
+	if (h264->Compressor)
+	{
+		WelsCreateSVCEncoder(&sys->pEncoder);
+
+		if (!sys->pEncoder)
+		{
+			WLog_ERR(TAG, "Failed to create OpenH264 encoder");
+			goto EXCEPTION;
+		}
+
+		return TRUE;
+	}
+
 	WelsCreateDecoder(&sys->pDecoder);
 
 	if (!sys->pDecoder)
@@ -249,7 +431,8 @@ static H264_CONTEXT_SUBSYSTEM g_Subsystem_OpenH264 =
 	"OpenH264",
 	openh264_init,
 	openh264_uninit,
-	openh264_decompress
+	openh264_decompress,
+	openh264_compress
 };
 
 #endif
@@ -265,26 +448,38 @@ static H264_CONTEXT_SUBSYSTEM g_Subsystem_OpenH264 =
 
 struct _H264_CONTEXT_LIBAVCODEC
 {
-	AVCodec* codec;
+	const AVCodec* codec;
 	AVCodecContext* codecContext;
 	AVCodecParserContext* codecParser;
 	AVFrame* videoFrame;
+	AVPacket* packet;
+	int64_t pts;
 };
 typedef struct _H264_CONTEXT_LIBAVCODEC H264_CONTEXT_LIBAVCODEC;
 
 static int libavcodec_decompress(H264_CONTEXT* h264, BYTE* pSrcData, UINT32 SrcSize)
 {
 	int status;
-	int gotFrame = 0;
-	AVPacket packet;
 	H264_CONTEXT_LIBAVCODEC* sys = (H264_CONTEXT_LIBAVCODEC*) h264->pSystemData;
 
-	av_init_packet(&packet);
+	sys->packet->data = pSrcData;
+	sys->packet->size = SrcSize;
+
+	status = avcodec_send_packet(sys->codecContext, sys->packet);
+
+	sys->packet->data = NULL;
+	sys->packet->size = 0;
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "Failed to decode video frame (status=%d)", status);
+		return -1;
+	}
 
-	packet.data = pSrcData;
-	packet.size = SrcSize;
+	status = avcodec_receive_frame(sys->codecContext, sys->videoFrame);
 
-	status = avcodec_decode_video2(sys->codecContext, sys->videoFrame, &gotFrame, &packet);
+	if (status == AVERROR(EAGAIN))
+		return -2;
 
 	if (status < 0)
 	{
@@ -293,29 +488,153 @@ static int libavcodec_decompress(H264_CONTEXT* h264, BYTE* pSrcData, UINT32 SrcS
 	}
 
 #if 0
-	WLog_INFO(TAG, "libavcodec_decompress: frame decoded (status=%d, gotFrame=%d, width=%d, height=%d, Y=[%p,%d], U=[%p,%d], V=[%p,%d])",
-		status, gotFrame, sys->videoFrame->width, sys->videoFrame->height,
+	WLog_INFO(TAG, "libavcodec_decompress: frame decoded (status=%d, width=%d, height=%d, Y=[%p,%d], U=[%p,%d], V=[%p,%d])",
+		status, sys->videoFrame->width, sys->videoFrame->height,
 		sys->videoFrame->data[0], sys->videoFrame->linesize[0],
 		sys->videoFrame->data[1], sys->videoFrame->linesize[1],
 		sys->videoFrame->data[2], sys->videoFrame->linesize[2]);
 #endif
 
-	if (gotFrame)
+	h264->pYUVData[0] = sys->videoFrame->data[0];
+	h264->pYUVData[1] = sys->videoFrame->data[1];
+	h264->pYUVData[2] = sys->videoFrame->data[2];
+
+	h264->iStride[0] = sys->videoFrame->linesize[0];
+	h264->iStride[1] = sys->videoFrame->linesize[1];
+	h264->iStride[2] = sys->videoFrame->linesize[2];
+
+	h264->width = sys->videoFrame->width;
+	h264->height = sys->videoFrame->height;
+
+	return 1;
+}
+
+static int libavcodec_create_encoder(H264_CONTEXT* h264)
+{
+	int status;
+	char qp[16];
+	AVDictionary* options = NULL;
+	H264_CONTEXT_LIBAVCODEC* sys = (H264_CONTEXT_LIBAVCODEC*) h264->pSystemData;
+
+	avcodec_free_context(&sys->codecContext);
+
+	sys->codecContext = avcodec_alloc_context3(sys->codec);
+
+	if (!sys->codecContext)
+	{
+		WLog_ERR(TAG, "Failed to allocate libav codec context");
+		return -1;
+	}
+
+	sys->codecContext->width = h264->width;
+	sys->codecContext->height = h264->height;
+	sys->codecContext->time_base.num = 1;
+	sys->codecContext->time_base.den = (int) h264->FrameRate;
+	sys->codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+	sys->codecContext->max_b_frames = 0;
+	sys->codecContext->thread_count = h264->NumberOfThreads;
+
+	av_dict_set(&options, "preset", "veryfast", 0);
+	av_dict_set(&options, "tune", "zerolatency", 0);
+
+	switch (h264->RateControlMode)
+	{
+		case H264_RATECONTROL_VBR:
+			sys->codecContext->bit_rate = h264->BitRate;
+			sys->codecContext->rc_max_rate = h264->BitRate;
+			sys->codecContext->rc_buffer_size = h264->BitRate;
+			break;
+
+		case H264_RATECONTROL_CQP:
+			sprintf_s(qp, sizeof(qp), "%d", h264->QP);
+			av_dict_set(&options, "qp", qp, 0);
+			sys->codecContext->qmin = h264->QP;
+			sys->codecContext->qmax = h264->QP;
+			break;
+	}
+
+	status = avcodec_open2(sys->codecContext, sys->codec, &options);
+
+	av_dict_free(&options);
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "Failed to open libav encoder (status=%d)", status);
+		avcodec_free_context(&sys->codecContext);
+		return -1;
+	}
+
+	sys->pts = 0;
+
+	return 1;
+}
+
+/**
+ * libav cannot change the encoder parameters on the fly, the encoder is
+ * recreated whenever the frame size or the rate control settings change.
+ * The returned packet stays valid until the next call.
+ */
+
+static int libavcodec_compress(H264_CONTEXT* h264, BYTE** ppDstData, UINT32* pDstSize)
+{
+	int status;
+	H264_CONTEXT_LIBAVCODEC* sys = (H264_CONTEXT_LIBAVCODEC*) h264->pSystemData;
+
+	if (!sys->codec || !sys->videoFrame || !sys->packet)
+		return -1;
+
+	if (!sys->codecContext ||
+			(sys->codecContext->width != (int) h264->width) ||
+			(sys->codecContext->height != (int) h264->height) ||
+			(sys->codecContext->time_base.den != (int) h264->FrameRate) ||
+			((h264->RateControlMode == H264_RATECONTROL_VBR) &&
+				(sys->codecContext->bit_rate != (int) h264->BitRate)) ||
+			((h264->RateControlMode == H264_RATECONTROL_CQP) &&
+				(sys->codecContext->qmin != (int) h264->QP)))
 	{
-		h264->pYUVData[0] = sys->videoFrame->data[0];
-		h264->pYUVData[1] = sys->videoFrame->data[1];
-		h264->pYUVData[2] = sys->videoFrame->data[2];
+		if (libavcodec_create_encoder(h264) < 0)
+			return -1;
+	}
+
+	av_packet_unref(sys->packet);
 
-		h264->iStride[0] = sys->videoFrame->linesize[0];
-		h264->iStride[1] = sys->videoFrame->linesize[1];
-		h264->iStride[2] = sys->videoFrame->linesize[2];
+	sys->videoFrame->format = sys->codecContext->pix_fmt;
+	sys->videoFrame->width = sys->codecContext->width;
+	sys->videoFrame->height = sys->codecContext->height;
+	sys->videoFrame->pts = sys->pts++;
 
-		h264->width = sys->videoFrame->width;
-		h264->height = sys->videoFrame->height;
+	sys->videoFrame->data[0] = h264->pYUVData[0];
+	sys->videoFrame->data[1] = h264->pYUVData[1];
+	sys->videoFrame->data[2] = h264->pYUVData[2];
+
+	sys->videoFrame->linesize[0] = h264->iStride[0];
+	sys->videoFrame->linesize[1] = h264->iStride[1];
+	sys->videoFrame->linesize[2] = h264->iStride[2];
+
+	/* the frame is not reference counted, the encoder keeps a copy */
+
+	status = avcodec_send_frame(sys->codecContext, sys->videoFrame);
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "Failed to encode video frame (status=%d)", status);
+		return -1;
 	}
-	else
+
+	status = avcodec_receive_packet(sys->codecContext, sys->packet);
+
+	if (status == AVERROR(EAGAIN))
 		return -2;
 
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "Failed to encode video frame (status=%d)", status);
+		return -1;
+	}
+
+	*ppDstData = sys->packet->data;
+	*pDstSize = sys->packet->size;
+
 	return 1;
 }
 
@@ -326,21 +645,15 @@ static void libavcodec_uninit(H264_CONTEXT* h264)
 	if (!sys)
 		return;
 
-	if (sys->videoFrame)
-	{
-		av_free(sys->videoFrame);
-	}
+	av_packet_free(&sys->packet);
+	av_frame_free(&sys->videoFrame);
 
 	if (sys->codecParser)
 	{
 		av_parser_close(sys->codecParser);
 	}
 
-	if (sys->codecContext)
-	{
-		avcodec_close(sys->codecContext);
-		av_free(sys->codecContext);
-	}
+	avcodec_free_context(&sys->codecContext);
 
 	free(sys);
 	h264->pSystemData = NULL;
@@ -359,9 +672,40 @@ static BOOL libavcodec_init(H264_CONTEXT* h264)
 
 	h264->pSystemData = (void*) sys;
 
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 10, 100)
 	avcodec_register_all();
+#endif
 
-	sys->codec = avcodec_find_decoder(CODEC_ID_H264);
+	sys->packet = av_packet_alloc();
+
+	if (!sys->packet)
+	{
+		WLog_ERR(TAG, "Failed to allocate libav packet");
+		goto EXCEPTION;
+	}
+
+	if (h264->Compressor)
+	{
+		sys->codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+
+		if (!sys->codec)
+		{
+			WLog_ERR(TAG, "Failed to find libav H.264 encoder");
+			goto EXCEPTION;
+		}
+
+		sys->videoFrame = av_frame_alloc();
+
+		if (!sys->videoFrame)
+		{
+			WLog_ERR(TAG, "Failed to allocate libav frame");
+			goto EXCEPTION;
+		}
+
+		return TRUE;
+	}
+
+	sys->codec = avcodec_find_decoder(AV_CODEC_ID_H264);
 
 	if (!sys->codec)
 	{
@@ -377,10 +721,12 @@ static BOOL libavcodec_init(H264_CONTEXT* h264)
 		goto EXCEPTION;
 	}
 
-	if (sys->codec->capabilities & CODEC_CAP_TRUNCATED)
+#ifdef AV_CODEC_CAP_TRUNCATED
+	if (sys->codec->capabilities & AV_CODEC_CAP_TRUNCATED)
 	{
-		sys->codecContext->flags |= CODEC_FLAG_TRUNCATED;
+		sys->codecContext->flags |= AV_CODEC_FLAG_TRUNCATED;
 	}
+#endif
 
 	if (avcodec_open2(sys->codecContext, sys->codec, NULL) < 0)
 	{
@@ -388,7 +734,7 @@ static BOOL libavcodec_init(H264_CONTEXT* h264)
 		goto EXCEPTION;
 	}
 
-	sys->codecParser = av_parser_init(CODEC_ID_H264);
+	sys->codecParser = av_parser_init(AV_CODEC_ID_H264);
 
 	if (!sys->codecParser)
 	{
@@ -396,7 +742,7 @@ static BOOL libavcodec_init(H264_CONTEXT* h264)
 		goto EXCEPTION;
 	}
 
-	sys->videoFrame = avcodec_alloc_frame();
+	sys->videoFrame = av_frame_alloc();
 
 	if (!sys->videoFrame)
 	{
@@ -417,7 +763,8 @@ static H264_CONTEXT_SUBSYSTEM g_Subsystem_libavcodec =
 	"libavcodec",
 	libavcodec_init,
 	libavcodec_uninit,
-	libavcodec_decompress
+	libavcodec_decompress,
+	libavcodec_compress
 };
 
 #endif
@@ -487,9 +834,58 @@ int h264_decompress(H264_CONTEXT* h264, BYTE* pSrcData, UINT32 SrcSize,
 	return 1;
 }
 
-int h264_compress(H264_CONTEXT* h264, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize)
+/**
+ * Encodes a whole frame as an AVC420 bitstream. The frame is converted to
+ * I420 in buffers owned by the context and handed to the encoder backend.
+ * The output is owned by the backend and valid until the next call.
+ */
+
+int h264_compress(H264_CONTEXT* h264, BYTE* pSrcData, DWORD SrcFormat,
+		int nSrcStep, int nSrcWidth, int nSrcHeight, BYTE** ppDstData, UINT32* pDstSize)
 {
-	return 1;
+	int index;
+	prim_size_t roi;
+	primitives_t* prims = primitives_get();
+
+	if (!h264 || !h264->Compressor || !pSrcData || !ppDstData || !pDstSize)
+		return -1;
+
+	if ((nSrcWidth < 2) || (nSrcHeight < 2) || (FREERDP_PIXEL_FORMAT_BPP(SrcFormat) != 32) ||
+			FREERDP_PIXEL_FORMAT_IS_ABGR(SrcFormat))
+		return -1;
+
+	if ((h264->width != (UINT32) (nSrcWidth & ~1)) || (h264->height != (UINT32) (nSrcHeight & ~1)) || !h264->pYUVData[0])
+	{
+		/* the encoders want even dimensions and aligned rows */
+
+		h264->width = nSrcWidth & ~1;
+		h264->height = nSrcHeight & ~1;
+
+		h264->iStride[0] = (h264->width + 15) & ~15;
+		h264->iStride[1] = ((h264->width / 2) + 15) & ~15;
+		h264->iStride[2] = h264->iStride[1];
+
+		for (index = 0; index < 3; index++)
+		{
+			_aligned_free(h264->pYUVData[index]);
+
+			h264->pYUVData[index] = (BYTE*) _aligned_malloc(h264->iStride[index] *
+					(index ? (h264->height / 2) : h264->height), 16);
+
+			if (!h264->pYUVData[index])
+			{
+				h264->width = h264->height = 0;
+				return -1;
+			}
+		}
+	}
+
+	roi.width = h264->width;
+	roi.height = h264->height;
+
+	prims->RGBToYUV420_8u_P3AC4R(pSrcData, nSrcStep, h264->pYUVData, h264->iStride, &roi);
+
+	return h264->subsystem->Compress(h264, ppDstData, pDstSize);
 }
 
 BOOL h264_context_init(H264_CONTEXT* h264)
@@ -530,6 +926,16 @@ H264_CONTEXT* h264_context_new(BOOL Compressor)
 
 		h264->subsystem = &g_Subsystem_dummy;
 
+		if (Compressor)
+		{
+			/* Default compressor settings, may be changed by caller */
+			h264->BitRate = 1000000;
+			h264->FrameRate = 30;
+			h264->QP = 20;
+			h264->NumberOfThreads = 1;
+			h264->RateControlMode = H264_RATECONTROL_VBR;
+		}
+
 		if (!h264_context_init(h264))
 		{
 			free(h264);
@@ -546,6 +952,13 @@ void h264_context_free(H264_CONTEXT* h264)
 	{
 		h264->subsystem->Uninit(h264);
 
+		if (h264->Compressor)
+		{
+			_aligned_free(h264->pYUVData[0]);
+			_aligned_free(h264->pYUVData[1]);
+			_aligned_free(h264->pYUVData[2]);
+		}
+
 		free(h264);
 	}
 }
@@ -36,9 +36,10 @@
 #include "nsc_types.h"
 #include "nsc_encode.h"
 
-static void nsc_context_initialize_encode(NSC_CONTEXT* context)
+static BOOL nsc_context_initialize_encode(NSC_CONTEXT* context)
 {
 	int i;
+	BYTE* buffer;
 	UINT32 length;
 	UINT32 tempWidth;
 	UINT32 tempHeight;
@@ -52,7 +53,14 @@ static void nsc_context_initialize_encode(NSC_CONTEXT* context)
 	if (length > context->priv->PlaneBuffersLength)
 	{
 		for (i = 0; i < 5; i++)
-			context->priv->PlaneBuffers[i] = (BYTE*) realloc(context->priv->PlaneBuffers[i], length);
+		{
+			buffer = (BYTE*) realloc(context->priv->PlaneBuffers[i], length);
+
+			if (!buffer)
+				return FALSE;
+
+			context->priv->PlaneBuffers[i] = buffer;
+		}
 
 		context->priv->PlaneBuffersLength = length;
 	}
@@ -71,6 +79,8 @@ static void nsc_context_initialize_encode(NSC_CONTEXT* context)
 		context->OrgByteCount[2] = context->width * context->height;
 		context->OrgByteCount[3] = context->width * context->height;
 	}
+
+	return TRUE;
 }
 
 static void nsc_encode_argb_to_aycocg(NSC_CONTEXT* context, BYTE* data, int scanline)
@@ -493,7 +503,9 @@ int nsc_write_message(NSC_CONTEXT* context, wStream* s, NSC_MESSAGE* message)
 	totalPlaneByteCount = message->LumaPlaneByteCount + message->OrangeChromaPlaneByteCount +
 			message->GreenChromaPlaneByteCount + message->AlphaPlaneByteCount;
 
-	Stream_EnsureRemainingCapacity(s, 20 + totalPlaneByteCount);
+	if (!Stream_EnsureRemainingCapacity(s, 20 + totalPlaneByteCount))
+		return -1;
+
 	Stream_Write_UINT32(s, message->LumaPlaneByteCount); /* LumaPlaneByteCount (4 bytes) */
 	Stream_Write_UINT32(s, message->OrangeChromaPlaneByteCount); /* OrangeChromaPlaneByteCount (4 bytes) */
 	Stream_Write_UINT32(s, message->GreenChromaPlaneByteCount); /* GreenChromaPlaneByteCount (4 bytes) */
@@ -523,14 +535,16 @@ int nsc_message_free(NSC_CONTEXT* context, NSC_MESSAGE* message)
 	return 0;
 }
 
-void nsc_compose_message(NSC_CONTEXT* context, wStream* s, BYTE* data, int width, int height, int scanline)
+BOOL nsc_compose_message(NSC_CONTEXT* context, wStream* s, BYTE* data, int width, int height, int scanline)
 {
 	NSC_MESSAGE s_message = { 0 };
 	NSC_MESSAGE* message = &s_message;
 
 	context->width = width;
 	context->height = height;
-	nsc_context_initialize_encode(context);
+
+	if (!nsc_context_initialize_encode(context))
+		return FALSE;
 
 	/* ARGB to AYCoCg conversion, chroma subsampling and colorloss reduction */
 	PROFILER_ENTER(context->priv->prof_nsc_encode);
@@ -554,5 +568,5 @@ void nsc_compose_message(NSC_CONTEXT* context, wStream* s, BYTE* data, int width
 	message->ColorLossLevel = context->ColorLossLevel;
 	message->ChromaSubsamplingLevel = context->ChromaSubsamplingLevel;
 
-	nsc_write_message(context, s, message);
+	return (nsc_write_message(context, s, message) >= 0);
 }
@@ -81,55 +81,42 @@ static int planar_skip_plane_rle(const BYTE* pSrcData, UINT32 SrcSize, int nWidt
 	return (int) (pRLE - pSrcData);
 }
 
+/**
+ * Decodes one RLE plane into a contiguous nWidth x nHeight plane.  Each
+ * scanline is expanded first; every scanline but the first then holds delta
+ * values, which are resolved against the previous scanline in a single pass.
+ */
+
 static int planar_decompress_plane_rle(const BYTE* pSrcData, UINT32 SrcSize, BYTE* pDstData,
-		int nDstStep, int nXDst, int nYDst, int nWidth, int nHeight, int nChannel, BOOL vFlip)
+		int nWidth, int nHeight)
 {
 	int x, y;
 	BYTE* dstp;
-	UINT32 pixel;
+	BYTE value;
 	int cRawBytes;
 	int nRunLength;
-	int deltaValue;
-	int beg, end, inc;
 	BYTE controlByte;
-	BYTE* currentScanline;
-	BYTE* previousScanline;
 	const BYTE* srcp = pSrcData;
+	const BYTE* pEnd = &pSrcData[SrcSize];
+	const primitives_t* prims = primitives_get();
 
-	dstp = pDstData;
-	previousScanline = NULL;
-
-	if (vFlip)
-	{
-		beg = nHeight - 1;
-		end = -1;
-		inc = -1;
-	}
-	else
-	{
-		beg = 0;
-		end = nHeight;
-		inc = 1;
-	}
-
-	for (y = beg; y != end; y += inc)
+	for (y = 0; y < nHeight; y++)
 	{
-		dstp = &pDstData[((nYDst + y) * nDstStep) + (nXDst * 4) + nChannel];
+		dstp = &pDstData[y * nWidth];
 
-		pixel = 0;
-		currentScanline = dstp;
+		/* runs repeat the last raw byte of the scanline, or zero */
+		value = 0;
 
 		for (x = 0; x < nWidth; )
 		{
-			controlByte = *srcp;
-			srcp++;
-
-			if ((srcp - pSrcData) > SrcSize)
+			if (srcp >= pEnd)
 			{
 				WLog_ERR(TAG,  "error reading input buffer");
 				return -1;
 			}
 
+			controlByte = *srcp++;
+
 			nRunLength = PLANAR_CONTROL_BYTE_RUN_LENGTH(controlByte);
 			cRawBytes = PLANAR_CONTROL_BYTE_RAW_BYTES(controlByte);
 
@@ -144,136 +131,38 @@ static int planar_decompress_plane_rle(const BYTE* pSrcData, UINT32 SrcSize, BYT
 				cRawBytes = 0;
 			}
 
-			if (((dstp + (cRawBytes + nRunLength)) - currentScanline) > nWidth * 4)
+			if ((x + cRawBytes + nRunLength) > nWidth)
 			{
 				WLog_ERR(TAG,  "too many pixels in scanline");
 				return -1;
 			}
 
-			if (!previousScanline)
-			{
-				/* first scanline, absolute values */
-
-				while (cRawBytes > 0)
-				{
-					pixel = *srcp;
-					srcp++;
-
-					*dstp = pixel;
-					dstp += 4;
-					x++;
-					cRawBytes--;
-				}
-
-				while (nRunLength > 0)
-				{
-					*dstp = pixel;
-					dstp += 4;
-					x++;
-					nRunLength--;
-				}
-			}
-			else
+			if (cRawBytes > 0)
 			{
-				/* delta values relative to previous scanline */
-
-				while (cRawBytes > 0)
+				if ((pEnd - srcp) < cRawBytes)
 				{
-					deltaValue = *srcp;
-					srcp++;
-
-					if (deltaValue & 1)
-					{
-						deltaValue = deltaValue >> 1;
-						deltaValue = deltaValue + 1;
-						pixel = -deltaValue;
-					}
-					else
-					{
-						deltaValue = deltaValue >> 1;
-						pixel = deltaValue;
-					}
-
-					deltaValue = previousScanline[x * 4] + pixel;
-					*dstp = deltaValue;
-					dstp += 4;
-					x++;
-					cRawBytes--;
+					WLog_ERR(TAG,  "error reading input buffer");
+					return -1;
 				}
 
-				while (nRunLength > 0)
-				{
-					deltaValue = previousScanline[x * 4] + pixel;
-					*dstp = deltaValue;
-					dstp += 4;
-					x++;
-					nRunLength--;
-				}
+				CopyMemory(&dstp[x], srcp, cRawBytes);
+				srcp += cRawBytes;
+				x += cRawBytes;
+				value = dstp[x - 1];
 			}
-		}
-
-		previousScanline = currentScanline;
-	}
-
-	return (int) (srcp - pSrcData);
-}
-
-static int planar_decompress_planes_raw(const BYTE* pSrcData[4], int nSrcStep, BYTE* pDstData,
-		int nDstStep, int nXDst, int nYDst, int nWidth, int nHeight, BOOL alpha, BOOL vFlip)
-{
-	int x, y;
-	int beg, end, inc;
-	BYTE* pRGB = pDstData;
-	const BYTE* pR = pSrcData[0];
-	const BYTE* pG = pSrcData[1];
-	const BYTE* pB = pSrcData[2];
-	const BYTE* pA = pSrcData[3];
-
-	if (vFlip)
-	{
-		beg = nHeight - 1;
-		end = -1;
-		inc = -1;
-	}
-	else
-	{
-		beg = 0;
-		end = nHeight;
-		inc = 1;
-	}
-
-	if (alpha)
-	{
-		for (y = beg; y != end; y += inc)
-		{
-			pRGB = &pDstData[((nYDst + y) * nDstStep) + (nXDst * 4)];
 
-			for (x = 0; x < nWidth; x++)
+			if (nRunLength > 0)
 			{
-				*pRGB++ = *pB++;
-				*pRGB++ = *pG++;
-				*pRGB++ = *pR++;
-				*pRGB++ = *pA++;
+				FillMemory(&dstp[x], nRunLength, value);
+				x += nRunLength;
 			}
 		}
-	}
-	else
-	{
-		for (y = beg; y != end; y += inc)
-		{
-			pRGB = &pDstData[((nYDst + y) * nDstStep) + (nXDst * 4)];
 
-			for (x = 0; x < nWidth; x++)
-			{
-				*pRGB++ = *pB++;
-				*pRGB++ = *pG++;
-				*pRGB++ = *pR++;
-				*pRGB++ = 0xFF;
-			}
-		}
+		if (y > 0)
+			prims->planarDeltaDecode_8u(dstp, dstp - nWidth, dstp, nWidth);
 	}
 
-	return 1;
+	return (int) (srcp - pSrcData);
 }
 
 int planar_decompress(BITMAP_PLANAR_CONTEXT* planar, BYTE* pSrcData, UINT32 SrcSize,
@@ -283,6 +172,7 @@ int planar_decompress(BITMAP_PLANAR_CONTEXT* planar, BYTE* pSrcData, UINT32 SrcS
 	BOOL rle;
 	UINT32 cll;
 	BOOL alpha;
+	int index;
 	int status;
 	BYTE* srcp;
 	int subSize;
@@ -290,7 +180,7 @@ int planar_decompress(BITMAP_PLANAR_CONTEXT* planar, BYTE* pSrcData, UINT32 SrcS
 	int subHeight;
 	int planeSize;
 	BYTE* pDstData;
-	int rleSizes[4];
+	int rleSizes[4] = { 0, 0, 0, 0 };
 	int rawSizes[4];
 	int rawWidths[4];
 	int rawHeights[4];
@@ -298,7 +188,9 @@ int planar_decompress(BITMAP_PLANAR_CONTEXT* planar, BYTE* pSrcData, UINT32 SrcS
 	BOOL useTempBuffer;
 	int dstBitsPerPixel;
 	int dstBytesPerPixel;
-	const BYTE* planes[4];
+	const BYTE* planes[4] = { NULL, NULL, NULL, NULL };
+	BYTE* decodedPlanes[4];
+	const BYTE* argbPlanes[4];
 	UINT32 UncompressedSize;
 	const primitives_t* prims = primitives_get();
 
@@ -479,124 +371,101 @@ int planar_decompress(BITMAP_PLANAR_CONTEXT* planar, BYTE* pSrcData, UINT32 SrcS
 		}
 	}
 
-	if (!cll) /* RGB */
+	if (cll && cs)
 	{
-		if (!rle) /* RAW */
-		{
-			if (alpha)
-			{
-				planar_decompress_planes_raw(planes, nWidth, pDstData, nDstStep,
-						nXDst, nYDst, nWidth, nHeight, alpha, vFlip);
-
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2] + rawSizes[3];
-			}
-			else /* NoAlpha */
-			{
-				planar_decompress_planes_raw(planes, nWidth, pDstData, nDstStep,
-						nXDst, nYDst, nWidth, nHeight, alpha, vFlip);
-
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2];
-			}
+		WLog_ERR(TAG, "Chroma subsampling unimplemented");
+		return -1;
+	}
 
-			if ((SrcSize - (srcp - pSrcData)) == 1)
-				srcp++; /* pad */
-		}
-		else /* RLE */
+	if (!rle) /* RAW */
+	{
+		if ((UINT32) planeSize > planar->DecodeSize)
 		{
-			if (alpha)
-			{
-				status = planar_decompress_plane_rle(planes[3], rleSizes[3],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 3, vFlip); /* AlphaPlane */
+			planar->DecodeBuffer = _aligned_realloc(planar->DecodeBuffer, planeSize, 16);
+			planar->DecodeSize = planeSize;
+		}
 
-				status = planar_decompress_plane_rle(planes[0], rleSizes[0],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 2, vFlip); /* RedPlane */
+		if (!planar->DecodeBuffer)
+			return -1;
 
-				status = planar_decompress_plane_rle(planes[1], rleSizes[1],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 1, vFlip); /* GreenPlane */
+		/* raw planes without alpha are opaque */
 
-				status = planar_decompress_plane_rle(planes[2], rleSizes[2],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 0, vFlip); /* BluePlane */
+		if (!alpha)
+			FillMemory(planar->DecodeBuffer, planeSize, 0xFF);
 
-				srcp += rleSizes[0] + rleSizes[1] + rleSizes[2] + rleSizes[3];
-			}
-			else /* NoAlpha */
-			{
-				status = planar_decompress_plane_rle(planes[0], rleSizes[0],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 2, vFlip); /* RedPlane */
+		argbPlanes[0] = alpha ? planes[3] : planar->DecodeBuffer; /* AlphaPlane */
+		argbPlanes[1] = planes[0]; /* LumaOrRedPlane */
+		argbPlanes[2] = planes[1]; /* OrangeChromaOrGreenPlane */
+		argbPlanes[3] = planes[2]; /* GreenChromaOrBluePlane */
 
-				status = planar_decompress_plane_rle(planes[1], rleSizes[1],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 1, vFlip); /* GreenPlane */
+		srcp += rawSizes[0] + rawSizes[1] + rawSizes[2];
 
-				status = planar_decompress_plane_rle(planes[2], rleSizes[2],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 0, vFlip); /* BluePlane */
+		if (alpha)
+			srcp += rawSizes[3];
 
-				srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
-			}
-		}
+		if ((SrcSize - (srcp - pSrcData)) == 1)
+			srcp++; /* pad */
 	}
-	else /* YCoCg */
+	else /* RLE */
 	{
-		if (cs)
+		if ((UINT32) (planeSize * 4) > planar->DecodeSize)
 		{
-			WLog_ERR(TAG, "Chroma subsampling unimplemented");
-			return -1;
+			planar->DecodeBuffer = _aligned_realloc(planar->DecodeBuffer, planeSize * 4, 16);
+			planar->DecodeSize = planeSize * 4;
 		}
 
-		if (!rle) /* RAW */
-		{
-			if (alpha)
-			{
-				planar_decompress_planes_raw(planes, nWidth, pDstData, nDstStep,
-						nXDst, nYDst, nWidth, nHeight, alpha, vFlip);
+		if (!planar->DecodeBuffer)
+			return -1;
 
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2] + rawSizes[3];
-			}
-			else /* NoAlpha */
-			{
-				planar_decompress_planes_raw(planes, nWidth, pDstData, nDstStep,
-						nXDst, nYDst, nWidth, nHeight, alpha, vFlip);
+		for (index = 0; index < 4; index++)
+			decodedPlanes[index] = &planar->DecodeBuffer[planeSize * index];
 
-				srcp += rawSizes[0] + rawSizes[1] + rawSizes[2];
-			}
+		if (alpha)
+		{
+			if (planar_decompress_plane_rle(planes[3], rleSizes[3],
+					decodedPlanes[0], nWidth, nHeight) < 0) /* AlphaPlane */
+				return -1;
 
-			if ((SrcSize - (srcp - pSrcData)) == 1)
-				srcp++; /* pad */
+			srcp += rleSizes[3];
 		}
-		else /* RLE */
-		{
-			if (alpha)
-			{
-				status = planar_decompress_plane_rle(planes[3], rleSizes[3],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 3, vFlip); /* AlphaPlane */
 
-				status = planar_decompress_plane_rle(planes[0], rleSizes[0],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 2, vFlip); /* LumaPlane */
+		if (planar_decompress_plane_rle(planes[0], rleSizes[0],
+				decodedPlanes[1], nWidth, nHeight) < 0) /* LumaOrRedPlane */
+			return -1;
 
-				status = planar_decompress_plane_rle(planes[1], rleSizes[1],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 1, vFlip); /* OrangeChromaPlane */
+		if (planar_decompress_plane_rle(planes[1], rleSizes[1],
+				decodedPlanes[2], nWidth, nHeight) < 0) /* OrangeChromaOrGreenPlane */
+			return -1;
 
-				status = planar_decompress_plane_rle(planes[2], rleSizes[2],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 0, vFlip); /* GreenChromaPlane */
+		if (planar_decompress_plane_rle(planes[2], rleSizes[2],
+				decodedPlanes[3], nWidth, nHeight) < 0) /* GreenChromaOrBluePlane */
+			return -1;
 
-				srcp += rleSizes[0] + rleSizes[1] + rleSizes[2] + rleSizes[3];
-			}
-			else /* NoAlpha */
-			{
-				status = planar_decompress_plane_rle(planes[0], rleSizes[0],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 2, vFlip); /* LumaPlane */
+		srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
 
-				status = planar_decompress_plane_rle(planes[1], rleSizes[1],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 1, vFlip); /* OrangeChromaPlane */
+		/* RLE planes without alpha leave the destination alpha untouched */
 
-				status = planar_decompress_plane_rle(planes[2], rleSizes[2],
-						pDstData, nDstStep, nXDst, nYDst, nWidth, nHeight, 0, vFlip); /* GreenChromaPlane */
+		argbPlanes[0] = alpha ? decodedPlanes[0] : NULL;
+		argbPlanes[1] = decodedPlanes[1];
+		argbPlanes[2] = decodedPlanes[2];
+		argbPlanes[3] = decodedPlanes[3];
+	}
 
-				srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
-			}
-		}
+	if (vFlip)
+	{
+		prims->planarJoin_8u_P4AC4R(argbPlanes, nWidth,
+				&pDstData[((nYDst + nHeight - 1) * nDstStep) + (nXDst * 4)], -nDstStep,
+				nWidth, nHeight);
+	}
+	else
+	{
+		prims->planarJoin_8u_P4AC4R(argbPlanes, nWidth,
+				&pDstData[(nYDst * nDstStep) + (nXDst * 4)], nDstStep,
+				nWidth, nHeight);
+	}
 
+	if (cll) /* YCoCg */
 		prims->YCoCgToRGB_8u_AC4R(pDstData, nDstStep, pDstData, nDstStep, nWidth, nHeight, cll, alpha, FALSE);
-	}
 
 	status = (SrcSize == (srcp - pSrcData)) ? 1 : -1;
 
@@ -617,48 +486,17 @@ int planar_decompress(BITMAP_PLANAR_CONTEXT* planar, BYTE* pSrcData, UINT32 SrcS
 int freerdp_split_color_planes(BYTE* data, UINT32 format, int width, int height, int scanline, BYTE* planes[4])
 {
 	int bpp;
-	int i, j, k;
+	const primitives_t* prims = primitives_get();
 
-	k = 0;
 	bpp = FREERDP_PIXEL_FORMAT_BPP(format);
 
-	if (bpp == 32)
-	{
-		UINT32* pixel;
-
-		for (i = height - 1; i >= 0; i--)
-		{
-			pixel = (UINT32*) &data[scanline * i];
-
-			for (j = 0; j < width; j++)
-			{
-				GetARGB32(planes[0][k], planes[1][k], planes[2][k], planes[3][k], *pixel);
-				pixel++;
-				k++;
-			}
-		}
-	}
-	else if (bpp == 24)
-	{
-		UINT32* pixel;
+	if ((bpp != 32) && (bpp != 24))
+		return -1;
 
-		for (i = height - 1; i >= 0; i--)
-		{
-			pixel = (UINT32*) &data[scanline * i];
+	/* planes are stored bottom-up */
 
-			for (j = 0; j < width; j++)
-			{
-				GetRGB32(planes[1][k], planes[2][k], planes[3][k], *pixel);
-				planes[0][k] = 0xFF; /* A */
-				pixel++;
-				k++;
-			}
-		}
-	}
-	else
-	{
-		return -1;
-	}
+	prims->planarSplit_8u_AC4P4R(&data[scanline * (height - 1)], -scanline,
+			planes, width, width, height, (bpp == 32) ? TRUE : FALSE);
 
 	return 0;
 }
@@ -778,84 +616,47 @@ int freerdp_bitmap_planar_write_rle_bytes(BYTE* pInBuffer, int cRawBytes, int nR
 	return (pOutput - pOutBuffer);
 }
 
+/**
+ * Encodes one scanline.  Each run of at least three repeated bytes ends a
+ * segment, together with the raw bytes that precede it; shorter repetitions
+ * stay raw.  The first byte of a scanline is compared against zero.
+ */
+
 int freerdp_bitmap_planar_encode_rle_bytes(BYTE* pInBuffer, int inBufferSize, BYTE* pOutBuffer, int outBufferSize)
 {
-	BYTE symbol;
 	BYTE* pInput;
 	BYTE* pOutput;
-	BYTE* pBytes;
-	int cRawBytes;
-	int nRunLength;
-	int bSymbolMatch;
+	INT32 cRawBytes;
+	INT32 nRunLength;
 	int nBytesWritten;
 	int nTotalBytesWritten;
+	const primitives_t* prims = primitives_get();
 
-	symbol = 0;
-	cRawBytes = 0;
-	nRunLength = 0;
 	pInput = pInBuffer;
 	pOutput = pOutBuffer;
 	nTotalBytesWritten = 0;
 
-	if (!outBufferSize)
+	if (!outBufferSize || !inBufferSize)
 		return 0;
 
-	do
-	{
-		if (!inBufferSize)
-			break;
-
-		bSymbolMatch = (symbol == *pInput) ? TRUE : FALSE;
-		symbol = *pInput;
-		pInput++;
-		inBufferSize--;
-
-		if (nRunLength && !bSymbolMatch)
-		{
-			if (nRunLength < 3)
-			{
-				cRawBytes += nRunLength;
-				nRunLength = 0;
-			}
-			else
-			{
-				pBytes = pInput - (cRawBytes + nRunLength + 1);
-
-				nBytesWritten = freerdp_bitmap_planar_write_rle_bytes(pBytes,
-						cRawBytes, nRunLength, pOutput, outBufferSize);
-
-				nRunLength = 0;
-
-				if (!nBytesWritten || (nBytesWritten > outBufferSize))
-					return nRunLength;
-
-				nTotalBytesWritten += nBytesWritten;
-				outBufferSize -= nBytesWritten;
-				pOutput += nBytesWritten;
-				cRawBytes = 0;
-			}
-		}
-
-		nRunLength += bSymbolMatch;
-		cRawBytes += (!bSymbolMatch) ? TRUE : FALSE;
-	}
-	while (outBufferSize);
-
-	if (cRawBytes || nRunLength)
+	while (inBufferSize > 0)
 	{
-		pBytes = pInput - (cRawBytes + nRunLength);
+		prims->planarFindRun_8u(pInput, inBufferSize, (pInput == pInBuffer) ? 0 : pInput[-1],
+				&cRawBytes, &nRunLength);
 
-		nBytesWritten = freerdp_bitmap_planar_write_rle_bytes(pBytes,
+		nBytesWritten = freerdp_bitmap_planar_write_rle_bytes(pInput,
 				cRawBytes, nRunLength, pOutput, outBufferSize);
 
-		if (!nBytesWritten)
+		if (!nBytesWritten || (nBytesWritten > outBufferSize))
 			return 0;
 
 		nTotalBytesWritten += nBytesWritten;
-	}
+		outBufferSize -= nBytesWritten;
+		pOutput += nBytesWritten;
 
-	if (inBufferSize)
-		return 0;
+		pInput += cRawBytes + nRunLength;
+		inBufferSize -= cRawBytes + nRunLength;
+	}
 
 	return nTotalBytesWritten;
 }
@@ -962,33 +763,22 @@ int freerdp_bitmap_planar_compress_planes_rle(BYTE* inPlanes[4], int width, int
 
 BYTE* freerdp_bitmap_planar_delta_encode_plane(BYTE* inPlane, int width, int height, BYTE* outPlane)
 {
-	char s2c;
-	int delta;
-	int y, x;
-	BYTE *outPtr, *srcPtr, *prevLinePtr;
+	int y;
+	const primitives_t* prims = primitives_get();
 
 	if (!outPlane)
 		outPlane = (BYTE*) malloc(width * height);
 
+	if (!outPlane)
+		return NULL;
+
 	// first line is copied as is
 	CopyMemory(outPlane, inPlane, width);
 
-	outPtr = outPlane + width;
-	srcPtr = inPlane + width;
-	prevLinePtr = inPlane;
-
 	for (y = 1; y < height; y++)
 	{
-		for (x = 0; x < width; x++, outPtr++, srcPtr++, prevLinePtr++)
-		{
-			delta = *srcPtr - *prevLinePtr;
-
-			s2c = (delta >= 0) ? (char) delta : (char) (~((BYTE) (-delta)) + 1);
-
-			s2c = (s2c >= 0) ? (s2c << 1) : (char) (((~((BYTE) s2c) + 1) << 1) - 1);
-
-			*outPtr = (BYTE)s2c;
-		}
+		prims->planarDeltaEncode_8u(&inPlane[y * width], &inPlane[(y - 1) * width],
+				&outPlane[y * width], width);
 	}
 
 	return outPlane;
@@ -1207,6 +997,8 @@ void freerdp_bitmap_planar_context_free(BITMAP_PLANAR_CONTEXT* context)
 	free(context->planesBuffer);
 	free(context->deltaPlanesBuffer);
 	free(context->rlePlanesBuffer);
+	_aligned_free(context->TempBuffer);
+	_aligned_free(context->DecodeBuffer);
 
 	free(context);
 }
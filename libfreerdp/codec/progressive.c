@@ -23,6 +23,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 #include <winpr/bitstream.h>
 
 #include <freerdp/primitives.h>
@@ -30,11 +31,28 @@
 #include <freerdp/codec/progressive.h>
 #include <freerdp/log.h>
 
+#include "rfx_rlgr.h"
 #include "rfx_differential.h"
 #include "rfx_quantization.h"
 
 #define TAG FREERDP_TAG("codec.progressive")
 
+/**
+ * Tile decoding is spread over ThreadCount workers. Each worker owns its
+ * YCbCr planes and DWT buffer, so tiles never contend for the buffer pool.
+ */
+
+struct _PROGRESSIVE_TILE_WORKER
+{
+	PROGRESSIVE_CONTEXT* progressive;
+	PTP_WORK work;
+	UINT32 index;
+	UINT32 count;
+	int status;
+	BYTE* buffer; /* Y/Cb/Cr planes */
+	INT16* temp; /* DWT buffer */
+};
+
 const char* progressive_get_block_type_string(UINT16 blockType)
 {
 	switch (blockType)
@@ -262,8 +280,8 @@ PROGRESSIVE_SURFACE_CONTEXT* progressive_surface_context_new(UINT16 surfaceId, U
 	surface->id = surfaceId;
 	surface->width = width;
 	surface->height = height;
-	surface->gridWidth = (width + (width % 64)) / 64;
-	surface->gridHeight = (height + (height % 64)) / 64;
+	surface->gridWidth = (width + 63) / 64;
+	surface->gridHeight = (height + 63) / 64;
 	surface->gridSize = surface->gridWidth * surface->gridHeight;
 
 	surface->tiles = (RFX_PROGRESSIVE_TILE*) calloc(surface->gridSize, sizeof(RFX_PROGRESSIVE_TILE));
@@ -274,6 +292,8 @@ PROGRESSIVE_SURFACE_CONTEXT* progressive_surface_context_new(UINT16 surfaceId, U
 		return NULL;
 	}
 
+	region16_init(&(surface->upgradeRegion));
+
 	return surface;
 }
 
@@ -296,6 +316,8 @@ void progressive_surface_context_free(PROGRESSIVE_SURFACE_CONTEXT* surface)
 			_aligned_free(tile->current);
 	}
 
+	region16_uninit(&(surface->upgradeRegion));
+
 	free(surface->tiles);
 	free(surface);
 }
@@ -667,10 +689,9 @@ void progressive_rfx_decode_block(const primitives_t* prims, INT16* buffer, int
 }
 
 int progressive_rfx_decode_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMPONENT_CODEC_QUANT* shift,
-		const BYTE* data, int length, INT16* buffer, INT16* current, INT16* sign, BOOL diff)
+		const BYTE* data, int length, INT16* buffer, INT16* temp, INT16* current, INT16* sign, BOOL diff)
 {
 	int status;
-	INT16* temp;
 	const primitives_t* prims = primitives_get();
 
 	status = rfx_rlgr_decode(data, length, buffer, 4096, 1);
@@ -693,16 +714,13 @@ int progressive_rfx_decode_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMPO
 	progressive_rfx_decode_block(prims, &buffer[3951], 64, shift->HH3); /* HH3 */
 	progressive_rfx_decode_block(prims, &buffer[4015], 81, shift->LL3); /* LL3 */
 
-	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
-
 	progressive_rfx_dwt_2d_decode(buffer, temp, current, sign, diff);
 
-	BufferPool_Return(progressive->bufferPool, temp);
-
 	return 1;
 }
 
-int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROGRESSIVE_TILE* tile)
+int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROGRESSIVE_TILE* tile,
+		PROGRESSIVE_TILE_WORKER* worker)
 {
 	BOOL diff;
 	BYTE* pBuffer;
@@ -809,22 +827,23 @@ int progressive_decompress_tile_first(PROGRESSIVE_CONTEXT* progressive, RFX_PROG
 	pCurrent[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pCurrent[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	pBuffer = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	pBuffer = worker->buffer;
 	pSrcDst[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
 	pSrcDst[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pSrcDst[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	progressive_rfx_decode_component(progressive, &shiftY, tile->yData, tile->yLen, pSrcDst[0], pCurrent[0], pSign[0], diff); /* Y */
-	progressive_rfx_decode_component(progressive, &shiftCb, tile->cbData, tile->cbLen, pSrcDst[1], pCurrent[1], pSign[1], diff); /* Cb */
-	progressive_rfx_decode_component(progressive, &shiftCr, tile->crData, tile->crLen, pSrcDst[2], pCurrent[2], pSign[2], diff); /* Cr */
+	progressive_rfx_decode_component(progressive, &shiftY, tile->yData, tile->yLen,
+			pSrcDst[0], worker->temp, pCurrent[0], pSign[0], diff); /* Y */
+	progressive_rfx_decode_component(progressive, &shiftCb, tile->cbData, tile->cbLen,
+			pSrcDst[1], worker->temp, pCurrent[1], pSign[1], diff); /* Cb */
+	progressive_rfx_decode_component(progressive, &shiftCr, tile->crData, tile->crLen,
+			pSrcDst[2], worker->temp, pCurrent[2], pSign[2], diff); /* Cr */
 
 	if (!progressive->invert)
 		prims->yCbCrToRGB_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
 	else
 		prims->yCbCrToBGR_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
 
-	BufferPool_Return(progressive->bufferPool, pBuffer);
-
 	//WLog_Image(progressive->log, WLOG_TRACE, tile->data, 64, 64, 32);
 
 	return 1;
@@ -1029,10 +1048,9 @@ int progressive_rfx_upgrade_block(RFX_PROGRESSIVE_UPGRADE_STATE* state, INT16* b
 }
 
 int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMPONENT_CODEC_QUANT* shift,
-		RFX_COMPONENT_CODEC_QUANT* bitPos, RFX_COMPONENT_CODEC_QUANT* numBits, INT16* buffer,
+		RFX_COMPONENT_CODEC_QUANT* bitPos, RFX_COMPONENT_CODEC_QUANT* numBits, INT16* buffer, INT16* temp,
 		INT16* current, INT16* sign, const BYTE* srlData, int srlLen, const BYTE* rawData, int rawLen)
 {
-	INT16* temp;
 	int aRawLen;
 	int aSrlLen;
 	wBitStream s_srl;
@@ -1092,20 +1110,17 @@ int progressive_rfx_upgrade_component(PROGRESSIVE_CONTEXT* progressive, RFX_COMP
 		return -1;
 	}
 
-	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
-
 	CopyMemory(buffer, current, 4096 * 2);
 
 	progressive_rfx_dwt_2d_decode_block(&buffer[3807], temp, 3);
 	progressive_rfx_dwt_2d_decode_block(&buffer[3007], temp, 2);
 	progressive_rfx_dwt_2d_decode_block(&buffer[0], temp, 1);
 
-	BufferPool_Return(progressive->bufferPool, temp);
-
 	return 1;
 }
 
-int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, RFX_PROGRESSIVE_TILE* tile)
+int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, RFX_PROGRESSIVE_TILE* tile,
+		PROGRESSIVE_TILE_WORKER* worker)
 {
 	int status;
 	BYTE* pBuffer;
@@ -1216,25 +1231,25 @@ int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, RFX_PR
 	pCurrent[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pCurrent[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
-	pBuffer = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	pBuffer = worker->buffer;
 	pSrcDst[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
 	pSrcDst[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
 	pSrcDst[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
 
 	status = progressive_rfx_upgrade_component(progressive, &shiftY, quantProgY, &yNumBits,
-			pSrcDst[0], pCurrent[0], pSign[0], tile->ySrlData, tile->ySrlLen, tile->yRawData, tile->yRawLen); /* Y */
+			pSrcDst[0], worker->temp, pCurrent[0], pSign[0], tile->ySrlData, tile->ySrlLen, tile->yRawData, tile->yRawLen); /* Y */
 
 	if (status < 0)
 		return -1;
 
 	status = progressive_rfx_upgrade_component(progressive, &shiftCb, quantProgCb, &cbNumBits,
-			pSrcDst[1], pCurrent[1], pSign[1], tile->cbSrlData, tile->cbSrlLen, tile->cbRawData, tile->cbRawLen); /* Cb */
+			pSrcDst[1], worker->temp, pCurrent[1], pSign[1], tile->cbSrlData, tile->cbSrlLen, tile->cbRawData, tile->cbRawLen); /* Cb */
 
 	if (status < 0)
 		return -1;
 
 	status = progressive_rfx_upgrade_component(progressive, &shiftCr, quantProgCr, &crNumBits,
-			pSrcDst[2], pCurrent[2], pSign[2], tile->crSrlData, tile->crSrlLen, tile->crRawData, tile->crRawLen); /* Cr */
+			pSrcDst[2], worker->temp, pCurrent[2], pSign[2], tile->crSrlData, tile->crSrlLen, tile->crRawData, tile->crRawLen); /* Cr */
 
 	if (status < 0)
 		return -1;
@@ -1244,13 +1259,101 @@ int progressive_decompress_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, RFX_PR
 	else
 		prims->yCbCrToBGR_16s8u_P3AC4R((const INT16**) pSrcDst, 64 * 2, tile->data, 64 * 4, &roi_64x64);
 
-	BufferPool_Return(progressive->bufferPool, pBuffer);
-
 	//WLog_Image(progressive->log, WLOG_TRACE, tile->data, 64, 64, 32);
 
 	return 1;
 }
 
+/**
+ * A worker decodes the tiles whose (xIdx + yIdx) falls into its slot. A tile
+ * listed twice in a region always lands on the same worker, which keeps its
+ * passes in stream order, and neighbouring tiles land on different workers.
+ */
+
+static int progressive_decompress_worker_tiles(PROGRESSIVE_TILE_WORKER* worker)
+{
+	int status = 1;
+	UINT16 index;
+	RFX_PROGRESSIVE_TILE* tile;
+	PROGRESSIVE_BLOCK_REGION* region;
+	PROGRESSIVE_CONTEXT* progressive = worker->progressive;
+
+	region = &(progressive->region);
+
+	for (index = 0; index < region->numTiles; index++)
+	{
+		tile = region->tiles[index];
+
+		if (((tile->xIdx + tile->yIdx) % worker->count) != worker->index)
+			continue;
+
+		switch (tile->blockType)
+		{
+			case PROGRESSIVE_WBT_TILE_SIMPLE:
+			case PROGRESSIVE_WBT_TILE_FIRST:
+				status = progressive_decompress_tile_first(progressive, tile, worker);
+				break;
+
+			case PROGRESSIVE_WBT_TILE_UPGRADE:
+				status = progressive_decompress_tile_upgrade(progressive, tile, worker);
+				break;
+		}
+
+		if (status < 0)
+			return -1;
+	}
+
+	return 1;
+}
+
+static void CALLBACK progressive_tile_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	PROGRESSIVE_TILE_WORKER* worker = (PROGRESSIVE_TILE_WORKER*) context;
+
+	worker->status = progressive_decompress_worker_tiles(worker);
+}
+
+static int progressive_decompress_tiles(PROGRESSIVE_CONTEXT* progressive)
+{
+	UINT32 index;
+	UINT32 count;
+	int status = 1;
+	PROGRESSIVE_TILE_WORKER* worker;
+
+	count = progressive->UseThreads ? progressive->ThreadCount : 1;
+
+	if (count > progressive->region.numTiles)
+		count = progressive->region.numTiles;
+
+	if (count < 1)
+		return 1;
+
+	for (index = 0; index < count; index++)
+	{
+		worker = &(progressive->workers[index]);
+		worker->count = count;
+		worker->status = 1;
+	}
+
+	/* the calling thread decodes its own share instead of idling */
+
+	for (index = 1; index < count; index++)
+		SubmitThreadpoolWork(progressive->workers[index].work);
+
+	status = progressive_decompress_worker_tiles(&(progressive->workers[0]));
+
+	for (index = 1; index < count; index++)
+	{
+		worker = &(progressive->workers[index]);
+		WaitForThreadpoolWorkCallbacks(worker->work, FALSE);
+
+		if (worker->status < 0)
+			status = worker->status;
+	}
+
+	return status;
+}
+
 int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UINT32 blocksLen, PROGRESSIVE_SURFACE_CONTEXT* surface)
 {
 	int status = -1;
@@ -1258,7 +1361,6 @@ int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UI
 	UINT16 xIdx;
 	UINT16 yIdx;
 	UINT16 zIdx;
-	UINT16 index;
 	UINT32 boffset;
 	UINT16 blockType;
 	UINT32 blockLen;
@@ -1286,6 +1388,9 @@ int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UI
 		if ((blocksLen - offset) < blockLen)
 			return -1003;
 
+		if (count >= region->numTiles)
+			return -1042;
+
 		switch (blockType)
 		{
 			case PROGRESSIVE_WBT_TILE_SIMPLE:
@@ -1507,25 +1612,13 @@ int progressive_process_tiles(PROGRESSIVE_CONTEXT* progressive, BYTE* blocks, UI
 	if (offset != blocksLen)
 		return -1041;
 
-	for (index = 0; index < region->numTiles; index++)
-	{
-		tile = tiles[index];
-
-		switch (tile->blockType)
-		{
-			case PROGRESSIVE_WBT_TILE_SIMPLE:
-			case PROGRESSIVE_WBT_TILE_FIRST:
-				status = progressive_decompress_tile_first(progressive, tile);
-				break;
+	if (count != region->numTiles)
+		return -1043;
 
-			case PROGRESSIVE_WBT_TILE_UPGRADE:
-				status = progressive_decompress_tile_upgrade(progressive, tile);
-				break;
-		}
+	status = progressive_decompress_tiles(progressive);
 
-		if (status < 0)
-			return -1;
-	}
+	if (status < 0)
+		return -1;
 
 	return (int) offset;
 }
@@ -1797,106 +1890,1142 @@ int progressive_decompress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UIN
 	return 1;
 }
 
-int progressive_compress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize)
+/**
+ * Progressive Encoder
+ *
+ * A tile is first sent with TILE_FIRST at the coarsest quality of the
+ * progressive quantization table, and is then refined with TILE_UPGRADE
+ * blocks, one quality level per call to progressive_compress_upgrade(),
+ * until it reaches full quality.
+ *
+ * The encoder keeps the unquantized DWT coefficients of every tile in
+ * tile->current. The decoder keeps the coefficients it has reconstructed
+ * so far, and its sign buffer is non-zero exactly for the coefficients
+ * which are non-zero at the previous bit position, which is why the
+ * non-LL bands are quantized by truncating the magnitude rather than by
+ * rounding: the upgrade passes only ever add magnitude bits.
+ */
+
+#define PROGRESSIVE_NUM_PROG_QUANT	2
+
+static const RFX_COMPONENT_CODEC_QUANT progressive_default_quant =
 {
-	return 1;
-}
+	6, 6, 6, 6, 7, 7, 8, 8, 8, 9 /* LL3, HL3, LH3, HH3, HL2, LH2, HH2, HL1, LH1, HH1 */
+};
 
-int progressive_context_reset(PROGRESSIVE_CONTEXT* progressive)
+static const RFX_PROGRESSIVE_CODEC_QUANT progressive_default_quant_prog[PROGRESSIVE_NUM_PROG_QUANT] =
 {
-	return 1;
+	{
+		25,
+		{ 2, 2, 2, 2, 3, 3, 3, 4, 4, 4 },
+		{ 2, 2, 2, 2, 3, 3, 3, 4, 4, 4 },
+		{ 2, 2, 2, 2, 3, 3, 3, 4, 4, 4 }
+	},
+	{
+		50,
+		{ 1, 1, 1, 1, 1, 1, 1, 2, 2, 2 },
+		{ 1, 1, 1, 1, 1, 1, 1, 2, 2, 2 },
+		{ 1, 1, 1, 1, 1, 1, 1, 2, 2, 2 }
+	}
+};
+
+static void progressive_component_codec_quant_write(BYTE* block, const RFX_COMPONENT_CODEC_QUANT* quantVal)
+{
+	block[0] = (quantVal->LL3 & 0x0F) | (quantVal->HL3 << 4);
+	block[1] = (quantVal->LH3 & 0x0F) | (quantVal->HH3 << 4);
+	block[2] = (quantVal->HL2 & 0x0F) | (quantVal->LH2 << 4);
+	block[3] = (quantVal->HH2 & 0x0F) | (quantVal->HL1 << 4);
+	block[4] = (quantVal->LH1 & 0x0F) | (quantVal->HH1 << 4);
 }
 
-PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
+/**
+ * Forward transform of one line, the exact counterpart of
+ * progressive_rfx_idwt_x/progressive_rfx_idwt_y for the
+ * reduce-extrapolate band sizes (33/31, 17/16 and 9/8).
+ */
+
+static void progressive_rfx_dwt_encode_line(const INT16* pSrc, int nSrcStep, INT16* pLow, int nLowStep,
+		INT16* pHigh, int nHighStep, int nLowCount, int nHighCount)
 {
-	PROGRESSIVE_CONTEXT* progressive;
+	int j;
+	INT16 X0, X1, X2;
+	INT16 H0, H1;
 
-	progressive = (PROGRESSIVE_CONTEXT*) calloc(1, sizeof(PROGRESSIVE_CONTEXT));
+	for (j = 0; j < nHighCount; j++)
+	{
+		X0 = pSrc[(2 * j) * nSrcStep];
+		X1 = pSrc[(2 * j + 1) * nSrcStep];
+		X2 = pSrc[(2 * j + 2) * nSrcStep];
 
-	if (progressive)
+		pHigh[j * nHighStep] = (X1 - ((X0 + X2) / 2)) / 2;
+	}
+
+	H0 = pHigh[0];
+	pLow[0] = pSrc[0] + H0;
+
+	for (j = 1; j < nHighCount; j++)
 	{
-		progressive->Compressor = Compressor;
+		H1 = pHigh[j * nHighStep];
+		pLow[j * nLowStep] = pSrc[(2 * j) * nSrcStep] + ((H0 + H1) / 2);
+		H0 = H1;
+	}
 
-		progressive->log = WLog_Get(TAG);
+	X2 = pSrc[(2 * nHighCount) * nSrcStep];
 
-		progressive->bufferPool = BufferPool_New(TRUE, (8192 + 32) * 3, 16);
+	if (nLowCount <= (nHighCount + 1))
+	{
+		pLow[nHighCount * nLowStep] = X2 + H0;
+	}
+	else
+	{
+		/* even length: the last sample is extrapolated from the low band */
 
-		progressive->cRects = 64;
-		progressive->rects = (RFX_RECT*) malloc(progressive->cRects * sizeof(RFX_RECT));
+		X1 = pSrc[(2 * nHighCount + 1) * nSrcStep];
 
-		if (!progressive->rects)
-			goto cleanup;
+		pLow[nHighCount * nLowStep] = X2 + (H0 / 2);
+		pLow[(nHighCount + 1) * nLowStep] = (2 * X1) - X2;
+	}
+}
 
-		progressive->cTiles = 64;
-		progressive->tiles = (RFX_PROGRESSIVE_TILE**) malloc(progressive->cTiles * sizeof(RFX_PROGRESSIVE_TILE*));
+static void progressive_rfx_dwt_2d_encode_block(INT16* buffer, INT16* temp, int level)
+{
+	int i;
+	int nBandL;
+	int nBandH;
+	int nDstStep;
+	INT16 *HL, *LH;
+	INT16 *HH, *LL;
+	INT16 *L, *H;
 
-		if (!progressive->tiles)
-			goto cleanup;
+	nBandL = progressive_rfx_get_band_l_count(level);
+	nBandH = progressive_rfx_get_band_h_count(level);
+	nDstStep = nBandL + nBandH;
 
-		progressive->cQuant = 8;
-		progressive->quantVals = (RFX_COMPONENT_CODEC_QUANT*) malloc(progressive->cQuant * sizeof(RFX_COMPONENT_CODEC_QUANT));
+	HL = &buffer[0];
+	LH = &HL[nBandH * nBandL];
+	HH = &LH[nBandL * nBandH];
+	LL = &HH[nBandH * nBandH];
 
-		if (!progressive->quantVals)
-			goto cleanup;
+	L = &temp[0];
+	H = &temp[nBandL * nDstStep];
 
-		progressive->cProgQuant = 8;
-		progressive->quantProgVals = (RFX_PROGRESSIVE_CODEC_QUANT*) malloc(progressive->cProgQuant * sizeof(RFX_PROGRESSIVE_CODEC_QUANT));
+	/* vertical (LL -> L + H) */
 
-		if (!progressive->quantProgVals)
-			goto cleanup;
+	for (i = 0; i < nDstStep; i++)
+		progressive_rfx_dwt_encode_line(&buffer[i], nDstStep, &L[i], nDstStep, &H[i], nDstStep, nBandL, nBandH);
 
-		ZeroMemory(&(progressive->quantProgValFull), sizeof(RFX_PROGRESSIVE_CODEC_QUANT));
-		progressive->quantProgValFull.quality = 100;
+	/* horizontal (L -> LL + HL, H -> LH + HH) */
 
-		progressive->SurfaceContexts = HashTable_New(TRUE);
+	for (i = 0; i < nBandL; i++)
+		progressive_rfx_dwt_encode_line(&L[i * nDstStep], 1, &LL[i * nBandL], 1, &HL[i * nBandH], 1, nBandL, nBandH);
 
-		progressive_context_reset(progressive);
-	}
+	for (i = 0; i < nBandH; i++)
+		progressive_rfx_dwt_encode_line(&H[i * nDstStep], 1, &LH[i * nBandL], 1, &HH[i * nBandH], 1, nBandL, nBandH);
+}
 
-	return progressive;
+void progressive_rfx_dwt_2d_encode(INT16* buffer, INT16* temp)
+{
+	progressive_rfx_dwt_2d_encode_block(&buffer[0], temp, 1);
+	progressive_rfx_dwt_2d_encode_block(&buffer[3007], temp, 2);
+	progressive_rfx_dwt_2d_encode_block(&buffer[3807], temp, 3);
+}
 
-cleanup:
-	if (progressive->rects)
-		free(progressive->rects);
-	if (progressive->tiles)
-		free(progressive->tiles);
-	if (progressive->quantVals)
-		free(progressive->quantVals);
-	if (progressive->quantProgVals)
-		free(progressive->quantProgVals);
-	if (progressive)
-		free(progressive);
-	return NULL;
+static void progressive_rfx_quant_encode_block(INT16* buffer, int length, UINT32 shift)
+{
+	int index;
+	INT16 value;
+
+	for (index = 0; index < length; index++)
+	{
+		value = buffer[index];
+		buffer[index] = (value < 0) ? -((-value) >> shift) : (value >> shift);
+	}
 }
 
-void progressive_context_free(PROGRESSIVE_CONTEXT* progressive)
+static void progressive_rfx_quant_encode(INT16* buffer, const RFX_COMPONENT_CODEC_QUANT* bitPos)
 {
-	int count;
 	int index;
-	ULONG_PTR* pKeys = NULL;
-	PROGRESSIVE_SURFACE_CONTEXT* surface;
 
-	if (!progressive)
+	progressive_rfx_quant_encode_block(&buffer[0], 1023, bitPos->HL1 - 1); /* HL1 */
+	progressive_rfx_quant_encode_block(&buffer[1023], 1023, bitPos->LH1 - 1); /* LH1 */
+	progressive_rfx_quant_encode_block(&buffer[2046], 961, bitPos->HH1 - 1); /* HH1 */
+	progressive_rfx_quant_encode_block(&buffer[3007], 272, bitPos->HL2 - 1); /* HL2 */
+	progressive_rfx_quant_encode_block(&buffer[3279], 272, bitPos->LH2 - 1); /* LH2 */
+	progressive_rfx_quant_encode_block(&buffer[3551], 256, bitPos->HH2 - 1); /* HH2 */
+	progressive_rfx_quant_encode_block(&buffer[3807], 72, bitPos->HL3 - 1); /* HL3 */
+	progressive_rfx_quant_encode_block(&buffer[3879], 72, bitPos->LH3 - 1); /* LH3 */
+	progressive_rfx_quant_encode_block(&buffer[3951], 64, bitPos->HH3 - 1); /* HH3 */
+
+	/* LL3 upgrades are unsigned, so it is rounded down instead */
+
+	for (index = 4015; index < 4096; index++)
+		buffer[index] = buffer[index] >> (bitPos->LL3 - 1); /* LL3 */
+}
+
+static void progressive_rfx_write_bits(wBitStream* bs, UINT32 bits, UINT32 nbits)
+{
+	if (nbits)
+		BitStream_Write_Bits(bs, bits, nbits);
+}
+
+static void progressive_rfx_srl_write_zeros(RFX_PROGRESSIVE_UPGRADE_STATE* state)
+{
+	int k = state->kp / 8;
+
+	/* a '0' bit stands for a full run of (1 << k) zeros */
+
+	while (state->nz >= (1 << k))
+	{
+		progressive_rfx_write_bits(state->srl, 0, 1);
+		state->nz -= (1 << k);
+
+		state->kp += 4;
+
+		if (state->kp > 80)
+			state->kp = 80;
+
+		k = state->kp / 8;
+	}
+}
+
+static void progressive_rfx_srl_write(RFX_PROGRESSIVE_UPGRADE_STATE* state, INT16 value, UINT32 numBits)
+{
+	UINT32 mag;
+	UINT32 max;
+	int k;
+
+	if (!value)
+	{
+		state->nz++;
 		return;
+	}
 
-	BufferPool_Free(progressive->bufferPool);
+	progressive_rfx_srl_write_zeros(state);
 
-	free(progressive->rects);
-	free(progressive->tiles);
-	free(progressive->quantVals);
-	free(progressive->quantProgVals);
+	/* '1' bit, followed by the remaining run length in k bits */
 
-	count = HashTable_GetKeys(progressive->SurfaceContexts, &pKeys);
+	k = state->kp / 8;
 
-	for (index = 0; index < count; index++)
+	progressive_rfx_write_bits(state->srl, 1, 1);
+	progressive_rfx_write_bits(state->srl, state->nz, k);
+	state->nz = 0;
+
+	/* sign bit, followed by the magnitude in unary */
+
+	progressive_rfx_write_bits(state->srl, (value < 0) ? 1 : 0, 1);
+
+	state->kp -= 6;
+
+	if (state->kp < 0)
+		state->kp = 0;
+
+	if (numBits == 1)
+		return;
+
+	mag = (value < 0) ? -value : value;
+	max = (1 << numBits) - 1;
+
+	progressive_rfx_write_bits(state->srl, 0, mag - 1);
+
+	if (mag < max)
+		progressive_rfx_write_bits(state->srl, 1, 1);
+}
+
+static int progressive_rfx_srl_finish(RFX_PROGRESSIVE_UPGRADE_STATE* state)
+{
+	int k;
+
+	/* trailing zeros, the decoder stops reading once it has all coefficients */
+
+	while (state->nz > 0)
 	{
-		surface = (PROGRESSIVE_SURFACE_CONTEXT*) HashTable_GetItemValue(progressive->SurfaceContexts, (void*) pKeys[index]);
-		progressive_surface_context_free(surface);
+		k = state->kp / 8;
+		state->nz = (state->nz > (1 << k)) ? state->nz - (1 << k) : 0;
+		progressive_rfx_write_bits(state->srl, 0, 1);
+
+		state->kp += 4;
+
+		if (state->kp > 80)
+			state->kp = 80;
 	}
 
-	free(pKeys);
+	BitStream_Flush(state->srl);
+	BitStream_Flush(state->raw);
 
-	HashTable_Free(progressive->SurfaceContexts);
+	if ((state->srl->position > state->srl->length) || (state->raw->position > state->raw->length))
+		return -1;
+
+	return 1;
+}
+
+static void progressive_rfx_upgrade_encode_block(RFX_PROGRESSIVE_UPGRADE_STATE* state, const INT16* coeffs,
+		int length, UINT32 bitPos, UINT32 newBitPos)
+{
+	int index;
+	INT16 value;
+	UINT32 mag;
+	UINT32 mask;
+	UINT32 shift;
+	UINT32 numBits;
+
+	numBits = bitPos - newBitPos;
+
+	if (!numBits)
+		return;
+
+	shift = newBitPos - 1;
+	mask = (1 << numBits) - 1;
+
+	if (!state->nonLL)
+	{
+		for (index = 0; index < length; index++)
+			progressive_rfx_write_bits(state->raw, (coeffs[index] >> shift) & mask, numBits);
+
+		return;
+	}
+
+	for (index = 0; index < length; index++)
+	{
+		value = coeffs[index];
+		mag = (value < 0) ? -value : value;
+
+		if (mag >> (bitPos - 1))
+		{
+			/* already non-zero on the decoder side: raw magnitude bits */
+
+			progressive_rfx_write_bits(state->raw, (mag >> shift) & mask, numBits);
+		}
+		else
+		{
+			mag >>= shift;
+			progressive_rfx_srl_write(state, (value < 0) ? -((INT16) mag) : (INT16) mag, numBits);
+		}
+	}
+}
+
+static int progressive_rfx_upgrade_encode_component(const INT16* coeffs, const RFX_COMPONENT_CODEC_QUANT* bitPos,
+		const RFX_COMPONENT_CODEC_QUANT* newBitPos, BYTE* srlData, BYTE* rawData, int size, int* srlLen, int* rawLen)
+{
+	wBitStream s_srl;
+	wBitStream s_raw;
+	RFX_PROGRESSIVE_UPGRADE_STATE state;
+
+	ZeroMemory(&s_srl, sizeof(wBitStream));
+	ZeroMemory(&s_raw, sizeof(wBitStream));
+	ZeroMemory(&state, sizeof(RFX_PROGRESSIVE_UPGRADE_STATE));
+
+	ZeroMemory(srlData, size);
+	ZeroMemory(rawData, size);
+
+	state.kp = 8;
+	state.mode = 0;
+	state.srl = &s_srl;
+	state.raw = &s_raw;
+
+	BitStream_Attach(state.srl, srlData, size);
+	BitStream_Attach(state.raw, rawData, size);
+
+	state.nonLL = TRUE;
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[0], 1023, bitPos->HL1, newBitPos->HL1); /* HL1 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[1023], 1023, bitPos->LH1, newBitPos->LH1); /* LH1 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[2046], 961, bitPos->HH1, newBitPos->HH1); /* HH1 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[3007], 272, bitPos->HL2, newBitPos->HL2); /* HL2 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[3279], 272, bitPos->LH2, newBitPos->LH2); /* LH2 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[3551], 256, bitPos->HH2, newBitPos->HH2); /* HH2 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[3807], 72, bitPos->HL3, newBitPos->HL3); /* HL3 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[3879], 72, bitPos->LH3, newBitPos->LH3); /* LH3 */
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[3951], 64, bitPos->HH3, newBitPos->HH3); /* HH3 */
+
+	state.nonLL = FALSE;
+	progressive_rfx_upgrade_encode_block(&state, &coeffs[4015], 81, bitPos->LL3, newBitPos->LL3); /* LL3 */
+
+	if (progressive_rfx_srl_finish(&state) < 0)
+		return -1;
+
+	*srlLen = (state.srl->position + 7) / 8;
+	*rawLen = (state.raw->position + 7) / 8;
+
+	return 1;
+}
+
+static const RFX_PROGRESSIVE_CODEC_QUANT* progressive_get_quant_prog(PROGRESSIVE_CONTEXT* progressive, BYTE quality)
+{
+	if (quality == 0xFF)
+		return &(progressive->quantProgValFull);
+
+	return &progressive_default_quant_prog[quality];
+}
+
+static void progressive_rfx_bit_pos(const RFX_PROGRESSIVE_CODEC_QUANT* quantProg, RFX_COMPONENT_CODEC_QUANT bitPos[3])
+{
+	progressive_rfx_quant_add((RFX_COMPONENT_CODEC_QUANT*) &progressive_default_quant,
+			(RFX_COMPONENT_CODEC_QUANT*) &(quantProg->yQuantValues), &bitPos[0]);
+	progressive_rfx_quant_add((RFX_COMPONENT_CODEC_QUANT*) &progressive_default_quant,
+			(RFX_COMPONENT_CODEC_QUANT*) &(quantProg->cbQuantValues), &bitPos[1]);
+	progressive_rfx_quant_add((RFX_COMPONENT_CODEC_QUANT*) &progressive_default_quant,
+			(RFX_COMPONENT_CODEC_QUANT*) &(quantProg->crQuantValues), &bitPos[2]);
+}
+
+/**
+ * Converts one 64x64 tile of the source to YCbCr and stores its DWT
+ * coefficients in tile->current. Tiles which extend beyond the surface
+ * are padded by repeating the last column and row.
+ */
+
+static int progressive_rfx_encode_tile(PROGRESSIVE_CONTEXT* progressive, RFX_PROGRESSIVE_TILE* tile,
+		const BYTE* pSrcData, BOOL invert, int nSrcStep, int nWidth, int nHeight)
+{
+	int x, y;
+	int index;
+	int width;
+	int height;
+	BYTE* pBuffer;
+	INT16* temp;
+	INT16* pCoeffs[3];
+	const BYTE* pSrcPixel;
+	static const prim_size_t roi_64x64 = { 64, 64 };
+	const primitives_t* prims = primitives_get();
+
+	if (!tile->current)
+	{
+		tile->current = (BYTE*) _aligned_malloc((8192 + 32) * 3, 16);
+
+		if (!tile->current)
+			return -1;
+	}
+
+	pBuffer = tile->current;
+	pCoeffs[0] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
+	pCoeffs[1] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
+	pCoeffs[2] = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
+
+	width = ((tile->x + 64) > nWidth) ? (nWidth - tile->x) : 64;
+	height = ((tile->y + 64) > nHeight) ? (nHeight - tile->y) : 64;
+
+	for (y = 0; y < 64; y++)
+	{
+		pSrcPixel = &pSrcData[((tile->y + ((y < height) ? y : height - 1)) * nSrcStep) + (tile->x * 4)];
+
+		for (x = 0; x < 64; x++)
+		{
+			index = (y * 64) + x;
+
+			pCoeffs[0][index] = invert ? pSrcPixel[0] : pSrcPixel[2];
+			pCoeffs[1][index] = pSrcPixel[1];
+			pCoeffs[2][index] = invert ? pSrcPixel[2] : pSrcPixel[0];
+
+			if (x < (width - 1))
+				pSrcPixel += 4;
+		}
+	}
+
+	prims->RGBToYCbCr_16s16s_P3P3((const INT16**) pCoeffs, 64 * sizeof(INT16),
+			pCoeffs, 64 * sizeof(INT16), &roi_64x64);
+
+	temp = (INT16*) BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
+
+	progressive_rfx_dwt_2d_encode(pCoeffs[0], temp);
+	progressive_rfx_dwt_2d_encode(pCoeffs[1], temp);
+	progressive_rfx_dwt_2d_encode(pCoeffs[2], temp);
+
+	BufferPool_Return(progressive->bufferPool, temp);
+
+	return 1;
+}
+
+static int progressive_write_tile_first(PROGRESSIVE_CONTEXT* progressive, wStream* s, RFX_PROGRESSIVE_TILE* tile)
+{
+	int index;
+	int length;
+	size_t start;
+	BYTE* pBuffer;
+	INT16* pCoeffs;
+	INT16* quantized;
+	UINT16 lengths[3];
+	RFX_COMPONENT_CODEC_QUANT bitPos[3];
+
+	progressive_rfx_bit_pos(progressive_get_quant_prog(progressive, tile->quality), bitPos);
+
+	if (!Stream_EnsureRemainingCapacity(s, 6 + 17 + (3 * 8192)))
+		return -1;
+
+	start = Stream_GetPosition(s);
+
+	Stream_Seek(s, 6 + 17);
+
+	quantized = (INT16*) BufferPool_Take(progressive->bufferPool, -1);
+
+	for (index = 0; index < 3; index++)
+	{
+		pBuffer = tile->current;
+		pCoeffs = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * index) + 16]));
+
+		CopyMemory(quantized, pCoeffs, 4096 * 2);
+		progressive_rfx_quant_encode(quantized, &bitPos[index]);
+		rfx_differential_encode(&quantized[4015], 81);
+
+		/* the RLGR encoder expects a zeroed output buffer */
+
+		ZeroMemory(Stream_Pointer(s), 8192);
+		length = rfx_rlgr_encode(RLGR1, quantized, 4096, Stream_Pointer(s), 8192);
+
+		if ((length < 0) || (length > 0xFFFF))
+		{
+			BufferPool_Return(progressive->bufferPool, quantized);
+			return -1;
+		}
+
+		lengths[index] = (UINT16) length;
+		Stream_Seek(s, length);
+	}
+
+	BufferPool_Return(progressive->bufferPool, quantized);
+
+	CopyMemory(&(tile->yBitPos), &bitPos[0], sizeof(RFX_COMPONENT_CODEC_QUANT));
+	CopyMemory(&(tile->cbBitPos), &bitPos[1], sizeof(RFX_COMPONENT_CODEC_QUANT));
+	CopyMemory(&(tile->crBitPos), &bitPos[2], sizeof(RFX_COMPONENT_CODEC_QUANT));
+
+	tile->blockType = PROGRESSIVE_WBT_TILE_FIRST;
+	tile->blockLen = (UINT32) (Stream_GetPosition(s) - start);
+
+	Stream_SetPosition(s, start);
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_FIRST); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, tile->blockLen); /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0); /* quantIdxY (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCb (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCr (1 byte) */
+	Stream_Write_UINT16(s, tile->xIdx); /* xIdx (2 bytes) */
+	Stream_Write_UINT16(s, tile->yIdx); /* yIdx (2 bytes) */
+	Stream_Write_UINT8(s, 0); /* flags (1 byte) */
+	Stream_Write_UINT8(s, tile->quality); /* quality (1 byte) */
+	Stream_Write_UINT16(s, lengths[0]); /* yLen (2 bytes) */
+	Stream_Write_UINT16(s, lengths[1]); /* cbLen (2 bytes) */
+	Stream_Write_UINT16(s, lengths[2]); /* crLen (2 bytes) */
+	Stream_Write_UINT16(s, 0); /* tailLen (2 bytes) */
+	Stream_SetPosition(s, start + tile->blockLen);
+
+	return 1;
+}
+
+static int progressive_write_tile_upgrade(PROGRESSIVE_CONTEXT* progressive, wStream* s, RFX_PROGRESSIVE_TILE* tile)
+{
+	int index;
+	BYTE* pBuffer;
+	BYTE* srlData;
+	BYTE* rawData;
+	INT16* pCoeffs;
+	BYTE quality;
+	int srlLen[3];
+	int rawLen[3];
+	int status = -1;
+	RFX_COMPONENT_CODEC_QUANT* bitPos[3];
+	RFX_COMPONENT_CODEC_QUANT newBitPos[3];
+
+	quality = ((tile->quality + 1) < PROGRESSIVE_NUM_PROG_QUANT) ? tile->quality + 1 : 0xFF;
+
+	progressive_rfx_bit_pos(progressive_get_quant_prog(progressive, quality), newBitPos);
+
+	bitPos[0] = &(tile->yBitPos);
+	bitPos[1] = &(tile->cbBitPos);
+	bitPos[2] = &(tile->crBitPos);
+
+	srlData = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+	rawData = (BYTE*) BufferPool_Take(progressive->bufferPool, -1);
+
+	if (!srlData || !rawData)
+		goto out;
+
+	for (index = 0; index < 3; index++)
+	{
+		pBuffer = tile->current;
+		pCoeffs = (INT16*)((BYTE*)(&pBuffer[((8192 + 32) * index) + 16]));
+
+		if (progressive_rfx_upgrade_encode_component(pCoeffs, bitPos[index], &newBitPos[index],
+				&srlData[index * 8192], &rawData[index * 8192], 8192, &srlLen[index], &rawLen[index]) < 0)
+			goto out;
+	}
+
+	tile->blockType = PROGRESSIVE_WBT_TILE_UPGRADE;
+	tile->blockLen = 6 + 20 + srlLen[0] + rawLen[0] + srlLen[1] + rawLen[1] + srlLen[2] + rawLen[2];
+
+	if (!Stream_EnsureRemainingCapacity(s, tile->blockLen))
+		goto out;
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_UPGRADE); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, tile->blockLen); /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0); /* quantIdxY (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCb (1 byte) */
+	Stream_Write_UINT8(s, 0); /* quantIdxCr (1 byte) */
+	Stream_Write_UINT16(s, tile->xIdx); /* xIdx (2 bytes) */
+	Stream_Write_UINT16(s, tile->yIdx); /* yIdx (2 bytes) */
+	Stream_Write_UINT8(s, quality); /* quality (1 byte) */
+
+	for (index = 0; index < 3; index++)
+	{
+		Stream_Write_UINT16(s, srlLen[index]); /* srlLen (2 bytes) */
+		Stream_Write_UINT16(s, rawLen[index]); /* rawLen (2 bytes) */
+	}
+
+	for (index = 0; index < 3; index++)
+	{
+		Stream_Write(s, &srlData[index * 8192], srlLen[index]);
+		Stream_Write(s, &rawData[index * 8192], rawLen[index]);
+	}
+
+	CopyMemory(&(tile->yBitPos), &newBitPos[0], sizeof(RFX_COMPONENT_CODEC_QUANT));
+	CopyMemory(&(tile->cbBitPos), &newBitPos[1], sizeof(RFX_COMPONENT_CODEC_QUANT));
+	CopyMemory(&(tile->crBitPos), &newBitPos[2], sizeof(RFX_COMPONENT_CODEC_QUANT));
+
+	tile->quality = quality;
+	tile->pass++;
+
+	status = 1;
+
+out:
+	BufferPool_Return(progressive->bufferPool, srlData);
+	BufferPool_Return(progressive->bufferPool, rawData);
+
+	return status;
+}
+
+static int progressive_write_frame_begin(PROGRESSIVE_CONTEXT* progressive, wStream* s)
+{
+	if (!Stream_EnsureRemainingCapacity(s, 34))
+		return -1;
+
+	if (progressive->SyncPending)
+	{
+		Stream_Write_UINT16(s, PROGRESSIVE_WBT_SYNC); /* blockType (2 bytes) */
+		Stream_Write_UINT32(s, 12); /* blockLen (4 bytes) */
+		Stream_Write_UINT32(s, 0xCACCACCA); /* magic (4 bytes) */
+		Stream_Write_UINT16(s, 0x0100); /* version (2 bytes) */
+
+		Stream_Write_UINT16(s, PROGRESSIVE_WBT_CONTEXT); /* blockType (2 bytes) */
+		Stream_Write_UINT32(s, 10); /* blockLen (4 bytes) */
+		Stream_Write_UINT8(s, 0); /* ctxId (1 byte) */
+		Stream_Write_UINT16(s, 64); /* tileSize (2 bytes) */
+		Stream_Write_UINT8(s, 0); /* flags (1 byte) */
+
+		progressive->SyncPending = FALSE;
+	}
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_BEGIN); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 12); /* blockLen (4 bytes) */
+	Stream_Write_UINT32(s, progressive->frameIndex++); /* frameIndex (4 bytes) */
+	Stream_Write_UINT16(s, 1); /* regionCount (2 bytes) */
+
+	return 1;
+}
+
+/**
+ * Writes a region block header for the given rectangles and leaves room for
+ * the tile count and size, which are filled in by progressive_write_region_end.
+ */
+
+static int progressive_write_region_begin(PROGRESSIVE_CONTEXT* progressive, wStream* s,
+		const RECTANGLE_16* rects, int numRects)
+{
+	int index;
+	BYTE quant[5];
+	const RFX_PROGRESSIVE_CODEC_QUANT* quantProg;
+
+	if (!Stream_EnsureRemainingCapacity(s, 64 + (numRects * 8)))
+		return -1;
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_REGION); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 0); /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 64); /* tileSize (1 byte) */
+	Stream_Write_UINT16(s, numRects); /* numRects (2 bytes) */
+	Stream_Write_UINT8(s, 1); /* numQuant (1 byte) */
+	Stream_Write_UINT8(s, PROGRESSIVE_NUM_PROG_QUANT); /* numProgQuant (1 byte) */
+	Stream_Write_UINT8(s, RFX_DWT_REDUCE_EXTRAPOLATE); /* flags (1 byte) */
+	Stream_Write_UINT16(s, 0); /* numTiles (2 bytes) */
+	Stream_Write_UINT32(s, 0); /* tileDataSize (4 bytes) */
+
+	for (index = 0; index < numRects; index++)
+	{
+		Stream_Write_UINT16(s, rects[index].left); /* x (2 bytes) */
+		Stream_Write_UINT16(s, rects[index].top); /* y (2 bytes) */
+		Stream_Write_UINT16(s, rects[index].right - rects[index].left); /* width (2 bytes) */
+		Stream_Write_UINT16(s, rects[index].bottom - rects[index].top); /* height (2 bytes) */
+	}
+
+	progressive_component_codec_quant_write(quant, &progressive_default_quant);
+	Stream_Write(s, quant, 5);
+
+	for (index = 0; index < PROGRESSIVE_NUM_PROG_QUANT; index++)
+	{
+		quantProg = &progressive_default_quant_prog[index];
+
+		Stream_Write_UINT8(s, quantProg->quality); /* quality (1 byte) */
+		progressive_component_codec_quant_write(quant, &(quantProg->yQuantValues));
+		Stream_Write(s, quant, 5);
+		progressive_component_codec_quant_write(quant, &(quantProg->cbQuantValues));
+		Stream_Write(s, quant, 5);
+		progressive_component_codec_quant_write(quant, &(quantProg->crQuantValues));
+		Stream_Write(s, quant, 5);
+	}
+
+	return 1;
+}
+
+static int progressive_write_region_end(PROGRESSIVE_CONTEXT* progressive, wStream* s,
+		size_t regionOffset, size_t tilesOffset, int numTiles)
+{
+	size_t end;
+
+	if (!Stream_EnsureRemainingCapacity(s, 6))
+		return -1;
+
+	end = Stream_GetPosition(s);
+
+	Stream_SetPosition(s, regionOffset + 2);
+	Stream_Write_UINT32(s, (UINT32) (end - regionOffset)); /* blockLen (4 bytes) */
+	Stream_SetPosition(s, regionOffset + 12);
+	Stream_Write_UINT16(s, numTiles); /* numTiles (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32) (end - tilesOffset)); /* tileDataSize (4 bytes) */
+	Stream_SetPosition(s, end);
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_END); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 6); /* blockLen (4 bytes) */
+
+	return 1;
+}
+
+/**
+ * Encodes the tiles intersecting the given rectangles of a nWidth x nHeight
+ * surface at the coarsest quality. The decoder only updates the pixels within
+ * the rectangles, which are refined by progressive_compress_upgrade().
+ *
+ * Returns 1 if a message was produced, 0 if there is nothing to send.
+ */
+
+int progressive_compress(PROGRESSIVE_CONTEXT* progressive, BYTE* pSrcData, DWORD SrcFormat, int nSrcStep,
+		int nWidth, int nHeight, const RECTANGLE_16* rects, int numRects, UINT16 surfaceId, BYTE** ppDstData, UINT32* pDstSize)
+{
+	int index;
+	int numTiles = 0;
+	int status = -1;
+	UINT32 xIdx, yIdx;
+	BOOL invert;
+	size_t regionOffset;
+	size_t tilesOffset;
+	REGION16 region;
+	RECTANGLE_16 rect;
+	RECTANGLE_16 tileRect;
+	const RECTANGLE_16* regionRects;
+	int numRegionRects;
+	RFX_PROGRESSIVE_TILE* tile;
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+	wStream* s = progressive->Stream;
+
+	if (!progressive->Compressor || !pSrcData || !ppDstData || !pDstSize)
+		return -1;
+
+	*pDstSize = 0;
+
+	surface = (PROGRESSIVE_SURFACE_CONTEXT*) progressive_get_surface_data(progressive, surfaceId);
+
+	if (!surface || ((UINT32) nWidth > surface->width) || ((UINT32) nHeight > surface->height))
+		return -1;
+
+	invert = FREERDP_PIXEL_FORMAT_IS_ABGR(SrcFormat) ? TRUE : FALSE;
+
+	region16_init(&region);
+
+	rect.left = rect.top = 0;
+	rect.right = nWidth;
+	rect.bottom = nHeight;
+
+	for (index = 0; index < numRects; index++)
+		region16_union_rect(&region, &region, &rects[index]);
+
+	region16_intersect_rect(&region, &region, &rect);
+	regionRects = region16_rects(&region, &numRegionRects);
+
+	if (!numRegionRects)
+	{
+		region16_uninit(&region);
+		return 0;
+	}
+
+	Stream_SetPosition(s, 0);
+
+	if (progressive_write_frame_begin(progressive, s) < 0)
+		goto out;
+
+	regionOffset = Stream_GetPosition(s);
+
+	if (progressive_write_region_begin(progressive, s, regionRects, numRegionRects) < 0)
+		goto out;
+
+	tilesOffset = Stream_GetPosition(s);
+
+	for (yIdx = 0; yIdx < surface->gridHeight; yIdx++)
+	{
+		for (xIdx = 0; xIdx < surface->gridWidth; xIdx++)
+		{
+			tileRect.left = xIdx * 64;
+			tileRect.top = yIdx * 64;
+			tileRect.right = tileRect.left + 64;
+			tileRect.bottom = tileRect.top + 64;
+
+			if (!region16_intersects_rect(&region, &tileRect))
+				continue;
+
+			tile = &(surface->tiles[(yIdx * surface->gridWidth) + xIdx]);
+
+			tile->xIdx = xIdx;
+			tile->yIdx = yIdx;
+			tile->x = tileRect.left;
+			tile->y = tileRect.top;
+			tile->width = 64;
+			tile->height = 64;
+			tile->quality = 0;
+			tile->pass = 1;
+
+			if (progressive_rfx_encode_tile(progressive, tile, pSrcData, invert, nSrcStep, nWidth, nHeight) < 0)
+				goto out;
+
+			if (progressive_write_tile_first(progressive, s, tile) < 0)
+				goto out;
+
+			numTiles++;
+		}
+	}
+
+	if (progressive_write_region_end(progressive, s, regionOffset, tilesOffset, numTiles) < 0)
+		goto out;
+
+	for (index = 0; index < numRegionRects; index++)
+		region16_union_rect(&(surface->upgradeRegion), &(surface->upgradeRegion), &regionRects[index]);
+
+	*ppDstData = Stream_Buffer(s);
+	*pDstSize = (UINT32) Stream_GetPosition(s);
+
+	status = 1;
+
+out:
+	region16_uninit(&region);
+
+	return status;
+}
+
+/**
+ * Refines every tile which is not at full quality yet by one quality level.
+ *
+ * Returns 1 if a message was produced, 0 if the surface is at full quality.
+ */
+
+int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* progressive, UINT16 surfaceId,
+		BYTE** ppDstData, UINT32* pDstSize)
+{
+	UINT32 index;
+	int numTiles = 0;
+	BOOL pending = FALSE;
+	size_t regionOffset;
+	size_t tilesOffset;
+	const RECTANGLE_16* rects;
+	int numRects;
+	RFX_PROGRESSIVE_TILE* tile;
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+	wStream* s = progressive->Stream;
+
+	if (!progressive->Compressor || !ppDstData || !pDstSize)
+		return -1;
+
+	*pDstSize = 0;
+
+	surface = (PROGRESSIVE_SURFACE_CONTEXT*) progressive_get_surface_data(progressive, surfaceId);
+
+	if (!surface)
+		return -1;
+
+	rects = region16_rects(&(surface->upgradeRegion), &numRects);
+
+	if (!numRects)
+		return 0;
+
+	Stream_SetPosition(s, 0);
+
+	if (progressive_write_frame_begin(progressive, s) < 0)
+		return -1;
+
+	regionOffset = Stream_GetPosition(s);
+
+	if (progressive_write_region_begin(progressive, s, rects, numRects) < 0)
+		return -1;
+
+	tilesOffset = Stream_GetPosition(s);
+
+	for (index = 0; index < surface->gridSize; index++)
+	{
+		tile = &(surface->tiles[index]);
+
+		if (!tile->pass || (tile->quality == 0xFF))
+			continue;
+
+		if (progressive_write_tile_upgrade(progressive, s, tile) < 0)
+			return -1;
+
+		if (tile->quality != 0xFF)
+			pending = TRUE;
+
+		numTiles++;
+	}
+
+	if (!pending)
+		region16_clear(&(surface->upgradeRegion));
+
+	if (!numTiles)
+		return 0;
+
+	if (progressive_write_region_end(progressive, s, regionOffset, tilesOffset, numTiles) < 0)
+		return -1;
+
+	*ppDstData = Stream_Buffer(s);
+	*pDstSize = (UINT32) Stream_GetPosition(s);
+
+	return 1;
+}
+
+int progressive_context_reset(PROGRESSIVE_CONTEXT* progressive)
+{
+	if (!progressive)
+		return -1;
+
+	if (progressive->Compressor)
+	{
+		progressive->SyncPending = TRUE;
+		progressive->frameIndex = 0;
+	}
+
+	return 1;
+}
+
+static void progressive_free_workers(PROGRESSIVE_CONTEXT* progressive)
+{
+	UINT32 index;
+	PROGRESSIVE_TILE_WORKER* worker;
+
+	if (progressive->workers)
+	{
+		for (index = 0; index < progressive->ThreadCount; index++)
+		{
+			worker = &(progressive->workers[index]);
+
+			if (worker->work)
+			{
+				WaitForThreadpoolWorkCallbacks(worker->work, TRUE);
+				CloseThreadpoolWork(worker->work);
+			}
+
+			_aligned_free(worker->buffer);
+		}
+
+		free(progressive->workers);
+		progressive->workers = NULL;
+	}
+
+	if (progressive->ThreadPool)
+	{
+		CloseThreadpool(progressive->ThreadPool);
+		DestroyThreadpoolEnvironment(&(progressive->ThreadPoolEnv));
+		progressive->ThreadPool = NULL;
+	}
+
+	progressive->ThreadCount = 0;
+	progressive->UseThreads = FALSE;
+}
+
+/**
+ * Sets the number of threads used to decode the tiles of a region.
+ * A count of 0 uses one thread per processor, 1 decodes on the calling thread.
+ */
+
+int progressive_context_set_thread_count(PROGRESSIVE_CONTEXT* progressive, UINT32 count)
+{
+	UINT32 index;
+	SYSTEM_INFO sysinfo;
+	PROGRESSIVE_TILE_WORKER* worker;
+
+	if (!progressive)
+		return -1;
+
+	if (!count)
+	{
+		GetNativeSystemInfo(&sysinfo);
+		count = sysinfo.dwNumberOfProcessors;
+	}
+
+	if (count < 1)
+		count = 1;
+
+	progressive_free_workers(progressive);
+
+	progressive->workers = (PROGRESSIVE_TILE_WORKER*) calloc(count, sizeof(PROGRESSIVE_TILE_WORKER));
+
+	if (!progressive->workers)
+		return -1;
+
+	progressive->ThreadCount = count;
+
+	for (index = 0; index < count; index++)
+	{
+		worker = &(progressive->workers[index]);
+
+		worker->progressive = progressive;
+		worker->index = index;
+		worker->buffer = (BYTE*) _aligned_malloc((8192 + 32) * 4, 16);
+
+		if (!worker->buffer)
+			goto fail;
+
+		worker->temp = (INT16*) &(worker->buffer[(8192 + 32) * 3]);
+	}
+
+	if (count > 1)
+	{
+		/* initialize the primitives before any decoding thread calls primitives_get() */
+		primitives_get();
+
+		progressive->ThreadPool = CreateThreadpool(NULL);
+
+		if (!progressive->ThreadPool)
+			goto fail;
+
+		InitializeThreadpoolEnvironment(&(progressive->ThreadPoolEnv));
+		SetThreadpoolCallbackPool(&(progressive->ThreadPoolEnv), progressive->ThreadPool);
+		SetThreadpoolThreadMinimum(progressive->ThreadPool, count - 1);
+		SetThreadpoolThreadMaximum(progressive->ThreadPool, count - 1);
+
+		for (index = 1; index < count; index++)
+		{
+			worker = &(progressive->workers[index]);
+
+			worker->work = CreateThreadpoolWork((PTP_WORK_CALLBACK) progressive_tile_work_callback,
+					(void*) worker, &(progressive->ThreadPoolEnv));
+
+			if (!worker->work)
+				goto fail;
+		}
+
+		progressive->UseThreads = TRUE;
+	}
+
+	return 1;
+
+fail:
+	progressive_free_workers(progressive);
+	return -1;
+}
+
+PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
+{
+	PROGRESSIVE_CONTEXT* progressive;
+
+	progressive = (PROGRESSIVE_CONTEXT*) calloc(1, sizeof(PROGRESSIVE_CONTEXT));
+
+	if (progressive)
+	{
+		progressive->Compressor = Compressor;
+
+		progressive->log = WLog_Get(TAG);
+
+		progressive->bufferPool = BufferPool_New(TRUE, (8192 + 32) * 3, 16);
+
+		progressive->cRects = 64;
+		progressive->rects = (RFX_RECT*) malloc(progressive->cRects * sizeof(RFX_RECT));
+
+		if (!progressive->rects)
+			goto cleanup;
+
+		progressive->cTiles = 64;
+		progressive->tiles = (RFX_PROGRESSIVE_TILE**) malloc(progressive->cTiles * sizeof(RFX_PROGRESSIVE_TILE*));
+
+		if (!progressive->tiles)
+			goto cleanup;
+
+		progressive->cQuant = 8;
+		progressive->quantVals = (RFX_COMPONENT_CODEC_QUANT*) malloc(progressive->cQuant * sizeof(RFX_COMPONENT_CODEC_QUANT));
+
+		if (!progressive->quantVals)
+			goto cleanup;
+
+		progressive->cProgQuant = 8;
+		progressive->quantProgVals = (RFX_PROGRESSIVE_CODEC_QUANT*) malloc(progressive->cProgQuant * sizeof(RFX_PROGRESSIVE_CODEC_QUANT));
+
+		if (!progressive->quantProgVals)
+			goto cleanup;
+
+		ZeroMemory(&(progressive->quantProgValFull), sizeof(RFX_PROGRESSIVE_CODEC_QUANT));
+		progressive->quantProgValFull.quality = 100;
+
+		progressive->SurfaceContexts = HashTable_New(TRUE);
+
+		if (progressive->Compressor)
+		{
+			progressive->Stream = Stream_New(NULL, 0xFFFF);
+
+			if (!progressive->Stream)
+				goto cleanup;
+		}
+
+		if (progressive_context_set_thread_count(progressive, progressive->Compressor ? 1 : 0) < 0)
+			goto cleanup;
+
+		progressive_context_reset(progressive);
+	}
+
+	return progressive;
+
+cleanup:
+	if (progressive->rects)
+		free(progressive->rects);
+	if (progressive->tiles)
+		free(progressive->tiles);
+	if (progressive->quantVals)
+		free(progressive->quantVals);
+	if (progressive->quantProgVals)
+		free(progressive->quantProgVals);
+	if (progressive)
+		free(progressive);
+	return NULL;
+}
+
+void progressive_context_free(PROGRESSIVE_CONTEXT* progressive)
+{
+	int count;
+	int index;
+	ULONG_PTR* pKeys = NULL;
+	PROGRESSIVE_SURFACE_CONTEXT* surface;
+
+	if (!progressive)
+		return;
+
+	progressive_free_workers(progressive);
+
+	BufferPool_Free(progressive->bufferPool);
+
+	free(progressive->rects);
+	free(progressive->tiles);
+	free(progressive->quantVals);
+	free(progressive->quantProgVals);
+
+	count = HashTable_GetKeys(progressive->SurfaceContexts, &pKeys);
+
+	for (index = 0; index < count; index++)
+	{
+		surface = (PROGRESSIVE_SURFACE_CONTEXT*) HashTable_GetItemValue(progressive->SurfaceContexts, (void*) pKeys[index]);
+		progressive_surface_context_free(surface);
+	}
+
+	free(pKeys);
+
+	HashTable_Free(progressive->SurfaceContexts);
+
+	if (progressive->Stream)
+		Stream_Free(progressive->Stream, TRUE);
 
 	free(progressive);
 }
@@ -1,5 +1,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/codec/clear.h>
 
@@ -125,6 +126,360 @@ int test_ClearDecompressExample4()
 	return 1;
 }
 
+#define TEST_SCREEN_WIDTH	1024
+#define TEST_SCREEN_HEIGHT	768
+#define TEST_BENCHMARK_TIME	500
+
+static UINT32 test_random_seed = 0x2F6B1D5A;
+
+static UINT32 test_random(void)
+{
+	test_random_seed = (test_random_seed * 1103515245) + 12345;
+	return (test_random_seed >> 8);
+}
+
+static void test_fill_rect(BYTE* pData, int nStep, int x, int y, int width, int height, UINT32 color)
+{
+	int i, j;
+
+	for (j = y; j < y + height; j++)
+	{
+		for (i = x; i < x + width; i++)
+			*((UINT32*) &pData[(j * nStep) + (i * 4)]) = color;
+	}
+}
+
+static UINT32 test_blend(UINT32 fg, UINT32 bg, int level)
+{
+	UINT32 r, g, b;
+
+	r = ((((fg >> 16) & 0xFF) * level) + (((bg >> 16) & 0xFF) * (3 - level))) / 3;
+	g = ((((fg >> 8) & 0xFF) * level) + (((bg >> 8) & 0xFF) * (3 - level))) / 3;
+	b = (((fg & 0xFF) * level) + ((bg & 0xFF) * (3 - level))) / 3;
+
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+/**
+ * Draws lines of words made of pseudo-glyphs with four levels of coverage,
+ * which looks like anti-aliased text to the encoder.
+ */
+
+static void test_draw_text(BYTE* pData, int nStep, BYTE* font, int x, int y, int width, int height,
+		UINT32 fg, UINT32 bg)
+{
+	int i, j;
+	int cx, cy;
+	int glyph;
+	int length;
+	BYTE* bitmap;
+
+	for (cy = y + 2; cy + 12 <= y + height; cy += 16)
+	{
+		cx = x + 4;
+
+		while (cx + 8 <= x + width)
+		{
+			length = 2 + (test_random() % 8);
+
+			while (length-- && (cx + 8 <= x + width))
+			{
+				glyph = test_random() % 40;
+				bitmap = &font[glyph * 7 * 12];
+
+				for (j = 0; j < 12; j++)
+				{
+					for (i = 0; i < 7; i++)
+					{
+						if (bitmap[(j * 7) + i])
+						{
+							*((UINT32*) &pData[((cy + j) * nStep) + ((cx + i) * 4)]) =
+								test_blend(fg, bg, bitmap[(j * 7) + i]);
+						}
+					}
+				}
+
+				cx += 8;
+			}
+
+			cx += 8;
+		}
+	}
+}
+
+static void test_draw_screen(BYTE* pData, int nStep, int nWidth, int nHeight, BOOL photo)
+{
+	int i, j;
+	BYTE font[40 * 7 * 12];
+
+	for (i = 0; i < (int) sizeof(font); i++)
+		font[i] = ((test_random() % 3) == 0) ? (test_random() % 4) : 0;
+
+	/* desktop, one window with a title bar, a list and a text area */
+
+	test_fill_rect(pData, nStep, 0, 0, nWidth, nHeight, 0xFF3A6EA5);
+	test_fill_rect(pData, nStep, 32, 32, nWidth - 64, nHeight - 64, 0xFFF0F0F0);
+
+	for (j = 0; j < 24; j++)
+		test_fill_rect(pData, nStep, 32, 32 + j, nWidth - 64, 1, 0xFF000080 + (j * 4));
+
+	test_draw_text(pData, nStep, font, 40, 36, 400, 16, 0xFFFFFFFF, 0xFF00008C);
+
+	for (j = 0; j < 30; j++)
+	{
+		test_fill_rect(pData, nStep, 48, 72 + (j * 16), 240, 16, (j == 5) ? 0xFF3399FF : 0xFFFFFFFF);
+		test_draw_text(pData, nStep, font, 48, 72 + (j * 16), 240, 16,
+				(j == 5) ? 0xFFFFFFFF : 0xFF000000, (j == 5) ? 0xFF3399FF : 0xFFFFFFFF);
+	}
+
+	test_fill_rect(pData, nStep, 304, 72, nWidth - 352, nHeight - 120, 0xFFFFFFFF);
+	test_fill_rect(pData, nStep, 304, 72, nWidth - 352, 1, 0xFF808080);
+	test_fill_rect(pData, nStep, 304, 72, 1, nHeight - 120, 0xFF808080);
+	test_draw_text(pData, nStep, font, 308, 76, nWidth - 360, nHeight - 128, 0xFF000000, 0xFFFFFFFF);
+
+	if (!photo)
+		return;
+
+	for (j = 0; j < 200; j++)
+	{
+		for (i = 0; i < 300; i++)
+		{
+			*((UINT32*) &pData[((400 + j) * nStep) + ((600 + i) * 4)]) = 0xFF000000 |
+				(((i + (test_random() % 16)) & 0xFF) << 16) | (((j + (test_random() % 16)) & 0xFF) << 8) |
+				((i + j) / 2 & 0xFF);
+		}
+	}
+}
+
+static int test_compare_bitmaps(BYTE* pData1, BYTE* pData2, int nStep, int nWidth, int nHeight, int tolerance)
+{
+	int x, y, k;
+	int diff;
+	int maxDiff = 0;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			for (k = 0; k < 3; k++)
+			{
+				diff = abs(pData1[(y * nStep) + (x * 4) + k] - pData2[(y * nStep) + (x * 4) + k]);
+
+				if (diff > maxDiff)
+					maxDiff = diff;
+
+				if (diff > tolerance)
+				{
+					printf("pixel mismatch at %d,%d (%dx%d) diff %d\n", x, y, nWidth, nHeight, diff);
+					return -1;
+				}
+			}
+		}
+	}
+
+	return maxDiff;
+}
+
+static int test_ClearRoundTrip(CLEAR_CONTEXT* encoder, CLEAR_CONTEXT* decoder, BYTE* pSrcData,
+		int nStep, int nWidth, int nHeight, int tolerance, UINT32* pDstSize)
+{
+	int status;
+	BYTE* pDstData;
+	BYTE* pEncodedData = NULL;
+	UINT32 EncodedSize = 0;
+
+	pDstData = (BYTE*) calloc(1, nStep * nHeight);
+
+	if (!pDstData)
+		return -1;
+
+	status = clear_compress(encoder, pSrcData, PIXEL_FORMAT_XRGB32, nStep, nWidth, nHeight,
+			&pEncodedData, &EncodedSize);
+
+	if (status < 0)
+	{
+		printf("clear_compress failure: %d\n", status);
+		free(pDstData);
+		return -1;
+	}
+
+	status = clear_decompress(decoder, pEncodedData, EncodedSize, &pDstData, PIXEL_FORMAT_XRGB32,
+			nStep, 0, 0, nWidth, nHeight);
+
+	if (status < 0)
+	{
+		printf("clear_decompress failure: %d\n", status);
+		free(pDstData);
+		return -1;
+	}
+
+	status = test_compare_bitmaps(pSrcData, pDstData, nStep, nWidth, nHeight, tolerance);
+
+	free(pDstData);
+
+	if (pDstSize)
+		*pDstSize = EncodedSize;
+
+	return status;
+}
+
+int test_ClearCompressRoundTrip()
+{
+	int x;
+	int nStep;
+	int status = -1;
+	BYTE* pSrcData;
+	UINT32 size1 = 0;
+	UINT32 size2 = 0;
+	CLEAR_CONTEXT* encoder;
+	CLEAR_CONTEXT* decoder;
+
+	nStep = TEST_SCREEN_WIDTH * 4;
+	pSrcData = (BYTE*) malloc(nStep * TEST_SCREEN_HEIGHT);
+	encoder = clear_context_new(TRUE);
+	decoder = clear_context_new(FALSE);
+
+	if (!pSrcData || !encoder || !decoder)
+		return -1;
+
+	test_draw_screen(pSrcData, nStep, TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, FALSE);
+
+	/* text and user interface elements must be lossless */
+
+	if (test_ClearRoundTrip(encoder, decoder, pSrcData, nStep, TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, 0, &size1) < 0)
+		goto out;
+
+	/* the same screen again mostly hits the vBar cache */
+
+	if (test_ClearRoundTrip(encoder, decoder, pSrcData, nStep, TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, 0, &size2) < 0)
+		goto out;
+
+	printf("text screen: %d bytes, again with warm caches: %d bytes\n", size1, size2);
+
+	if (size2 >= size1)
+	{
+		printf("vBar cache did not reduce the second frame\n");
+		goto out;
+	}
+
+	/* a glyph is sent once, then referenced by its index */
+
+	if (test_ClearRoundTrip(encoder, decoder, &pSrcData[(76 * nStep) + (308 * 4)], nStep, 24, 16, 0, &size1) < 0)
+		goto out;
+
+	if (test_ClearRoundTrip(encoder, decoder, &pSrcData[(76 * nStep) + (308 * 4)], nStep, 24, 16, 0, &size2) < 0)
+		goto out;
+
+	if (size2 != 4)
+	{
+		printf("glyph was not a cache hit: %d bytes\n", size2);
+		goto out;
+	}
+
+	/* odd sizes which do not align with the bands and blocks */
+
+	for (x = 1; x < 80; x += 13)
+	{
+		if (test_ClearRoundTrip(encoder, decoder, &pSrcData[(60 * nStep) + (40 * 4)], nStep, x + 50, x, 0, NULL) < 0)
+			goto out;
+	}
+
+	/* photographic content goes through NSCodec, which is lossy */
+
+	test_draw_screen(pSrcData, nStep, TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, TRUE);
+
+	status = test_ClearRoundTrip(encoder, decoder, pSrcData, nStep, TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, 8, &size1);
+
+	if (status < 0)
+		goto out;
+
+	printf("screen with a photo: %d bytes, maximum error %d\n", size1, status);
+
+	status = 1;
+
+out:
+	clear_context_free(encoder);
+	clear_context_free(decoder);
+	free(pSrcData);
+
+	return status;
+}
+
+int test_ClearCompressSpeed()
+{
+	int nStep;
+	int iterations;
+	UINT64 begin;
+	UINT64 elapsed;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	UINT32 DstSize = 0;
+	UINT32 SrcSize;
+	CLEAR_CONTEXT* clear;
+
+	nStep = TEST_SCREEN_WIDTH * 4;
+	SrcSize = nStep * TEST_SCREEN_HEIGHT;
+	pSrcData = (BYTE*) malloc(SrcSize);
+
+	if (!pSrcData)
+		return -1;
+
+	test_draw_screen(pSrcData, nStep, TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, FALSE);
+
+	/* a new context for every frame, so that nothing is a cache hit */
+
+	iterations = 0;
+	begin = GetTickCount64();
+
+	do
+	{
+		clear = clear_context_new(TRUE);
+
+		if (!clear)
+			return -1;
+
+		if (clear_compress(clear, pSrcData, PIXEL_FORMAT_XRGB32, nStep,
+				TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, &pDstData, &DstSize) < 0)
+			return -1;
+
+		clear_context_free(clear);
+
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_BENCHMARK_TIME);
+
+	printf("clear_compress cold: %.1f MB/s, %d bytes, ratio %.1f:1\n",
+			((double) SrcSize * iterations) / (elapsed * 1000.0), DstSize, (double) SrcSize / DstSize);
+
+	clear = clear_context_new(TRUE);
+
+	if (!clear)
+		return -1;
+
+	iterations = 0;
+	begin = GetTickCount64();
+
+	do
+	{
+		if (clear_compress(clear, pSrcData, PIXEL_FORMAT_XRGB32, nStep,
+				TEST_SCREEN_WIDTH, TEST_SCREEN_HEIGHT, &pDstData, &DstSize) < 0)
+			return -1;
+
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_BENCHMARK_TIME);
+
+	printf("clear_compress warm: %.1f MB/s, %d bytes, ratio %.1f:1\n",
+			((double) SrcSize * iterations) / (elapsed * 1000.0), DstSize, (double) SrcSize / DstSize);
+
+	clear_context_free(clear);
+	free(pSrcData);
+
+	return 1;
+}
+
 int TestFreeRDPCodecClear(int argc, char* argv[])
 {
 	//test_ClearDecompressExample1();
@@ -135,6 +490,12 @@ int TestFreeRDPCodecClear(int argc, char* argv[])
 
 	test_ClearDecompressExample4();
 
+	if (test_ClearCompressRoundTrip() < 0)
+		return -1;
+
+	if (test_ClearCompressSpeed() < 0)
+		return -1;
+
 	return 0;
 }
 
@@ -0,0 +1,167 @@
+
+#include <winpr/crt.h>
+#include <winpr/print.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/h264.h>
+
+#define TEST_H264_WIDTH		1280
+#define TEST_H264_HEIGHT	720
+#define TEST_H264_FRAMES	60
+
+/**
+ * Encodes a moving synthetic desktop with h264_compress() and feeds every
+ * frame straight into h264_decompress(). H.264 is lossy, so the decoded
+ * frame is only required to stay close to the source on average.
+ */
+
+static void test_h264_fill_frame(BYTE* data, int frame)
+{
+	int x, y;
+	BYTE* pixel;
+
+	for (y = 0; y < TEST_H264_HEIGHT; y++)
+	{
+		pixel = &data[y * TEST_H264_WIDTH * 4];
+
+		for (x = 0; x < TEST_H264_WIDTH; x++)
+		{
+			pixel[0] = (BYTE) (x + frame * 4);
+			pixel[1] = (BYTE) (y + frame * 2);
+			pixel[2] = (BYTE) (((x / 32) ^ (y / 32)) & 1 ? 0xE0 : 0x20);
+			pixel[3] = 0xFF;
+			pixel += 4;
+		}
+	}
+}
+
+static int test_h264_frame_error(const BYTE* src, const BYTE* dst)
+{
+	int x, y;
+	int channel;
+	UINT64 sum = 0;
+	const BYTE* pSrc;
+	const BYTE* pDst;
+
+	for (y = 0; y < TEST_H264_HEIGHT; y++)
+	{
+		pSrc = &src[y * TEST_H264_WIDTH * 4];
+		pDst = &dst[y * TEST_H264_WIDTH * 4];
+
+		for (x = 0; x < TEST_H264_WIDTH; x++)
+		{
+			for (channel = 0; channel < 3; channel++)
+				sum += abs(pSrc[channel] - pDst[channel]);
+
+			pSrc += 4;
+			pDst += 4;
+		}
+	}
+
+	return (int) (sum / (TEST_H264_WIDTH * TEST_H264_HEIGHT * 3));
+}
+
+static int test_h264_round_trip(void)
+{
+	int index;
+	int error;
+	int status = 0;
+	UINT32 DstSize;
+	UINT64 begin;
+	UINT64 encodeTime = 0;
+	UINT64 decodeTime = 0;
+	UINT64 totalSize = 0;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	BYTE* pH264Data;
+	RDPGFX_RECT16 rect;
+	H264_CONTEXT* encoder;
+	H264_CONTEXT* decoder;
+
+	encoder = h264_context_new(TRUE);
+	decoder = h264_context_new(FALSE);
+
+	if (!encoder || !decoder)
+	{
+		/* built without an H.264 backend */
+		printf("H.264 round trip: no encoder/decoder backend available, skipping\n");
+		h264_context_free(encoder);
+		h264_context_free(decoder);
+		return 0;
+	}
+
+	pSrcData = (BYTE*) malloc(TEST_H264_WIDTH * TEST_H264_HEIGHT * 4);
+	pDstData = (BYTE*) malloc(TEST_H264_WIDTH * TEST_H264_HEIGHT * 4);
+
+	if (!pSrcData || !pDstData)
+	{
+		status = -1;
+		goto out;
+	}
+
+	rect.left = 0;
+	rect.top = 0;
+	rect.right = TEST_H264_WIDTH;
+	rect.bottom = TEST_H264_HEIGHT;
+
+	for (index = 0; index < TEST_H264_FRAMES; index++)
+	{
+		test_h264_fill_frame(pSrcData, index);
+
+		begin = GetTickCount64();
+
+		if (h264_compress(encoder, pSrcData, PIXEL_FORMAT_XRGB32, TEST_H264_WIDTH * 4,
+				TEST_H264_WIDTH, TEST_H264_HEIGHT, &pH264Data, &DstSize) < 0)
+		{
+			printf("h264_compress failure (frame %d)\n", index);
+			status = -1;
+			goto out;
+		}
+
+		encodeTime += GetTickCount64() - begin;
+		totalSize += DstSize;
+
+		begin = GetTickCount64();
+
+		if (h264_decompress(decoder, pH264Data, DstSize, &pDstData, PIXEL_FORMAT_XRGB32,
+				TEST_H264_WIDTH * 4, TEST_H264_HEIGHT, &rect, 1) < 0)
+		{
+			printf("h264_decompress failure (frame %d)\n", index);
+			status = -1;
+			goto out;
+		}
+
+		decodeTime += GetTickCount64() - begin;
+
+		error = test_h264_frame_error(pSrcData, pDstData);
+
+		if (error > 8)
+		{
+			printf("H.264 round trip: frame %d differs from the source (mean error %d)\n", index, error);
+			status = -1;
+			goto out;
+		}
+	}
+
+	printf("H.264 720p round trip (%s): encode %.1f fps, decode %.1f fps, %d bytes/frame\n",
+			encoder->subsystem->name,
+			encodeTime ? ((double) TEST_H264_FRAMES * 1000.0) / encodeTime : 0.0,
+			decodeTime ? ((double) TEST_H264_FRAMES * 1000.0) / decodeTime : 0.0,
+			(int) (totalSize / TEST_H264_FRAMES));
+
+out:
+	h264_context_free(encoder);
+	h264_context_free(decoder);
+	free(pSrcData);
+	free(pDstData);
+	return status;
+}
+
+int TestFreeRDPCodecH264(int argc, char* argv[])
+{
+	if (test_h264_round_trip() < 0)
+		return -1;
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/color.h>
@@ -3065,6 +3066,190 @@ int test_individual_planes_encoding_rle()
 	return 0;
 }
 
+/**
+ * Throughput mode: compresses and decompresses a 1920x1080 frame in 64x64
+ * tiles, the way the shadow server and the gdi use the codec, once for each
+ * format header variant. The round trip must be lossless.
+ */
+
+#define TEST_PLANAR_WIDTH	1920
+#define TEST_PLANAR_HEIGHT	1080
+#define TEST_PLANAR_ROUNDS	8
+
+static void test_planar_fill_frame(BYTE* data, int nStep)
+{
+	int x, y;
+	BYTE* p;
+
+	/* a few lines of "text" on a gradient, with a translucent band */
+
+	for (y = 0; y < TEST_PLANAR_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_PLANAR_WIDTH; x++)
+		{
+			p = &data[(y * nStep) + (x * 4)];
+
+			if (((y % 24) < 14) && (((x * 7 + y * 3) % 11) < 4) && ((x % 400) < 320))
+			{
+				p[0] = p[1] = p[2] = 0x10;
+			}
+			else
+			{
+				p[0] = (BYTE) (0xC0 + (x >> 4));
+				p[1] = (BYTE) (0xE0 - (y >> 3));
+				p[2] = 0xF0;
+			}
+
+			p[3] = ((y % 256) < 32) ? (BYTE) x : 0xFF;
+		}
+	}
+}
+
+#define TEST_PLANAR_TILES	(((TEST_PLANAR_WIDTH + 63) / 64) * ((TEST_PLANAR_HEIGHT + 63) / 64))
+#define TEST_PLANAR_TILE_SIZE	((64 * 64 * 4) + 16)
+
+static int test_planar_throughput_flags(DWORD planarFlags, const char* name, const BYTE* pSrcData, BYTE* pDstData, int nStep)
+{
+	int x, y;
+	int tile;
+	int round;
+	int width;
+	int height;
+	int status = -1;
+	BYTE* buffer;
+	BYTE* pDstTile;
+	UINT64 begin;
+	UINT64 frameBytes;
+	UINT64 encodeTime = 0;
+	UINT64 decodeTime = 0;
+	UINT64 encodedBytes = 0;
+	int sizes[TEST_PLANAR_TILES];
+	BITMAP_PLANAR_CONTEXT* encoder;
+	BITMAP_PLANAR_CONTEXT* decoder;
+
+	encoder = freerdp_bitmap_planar_context_new(planarFlags, 64, 64);
+	decoder = freerdp_bitmap_planar_context_new(0, 64, 64);
+	buffer = (BYTE*) malloc(TEST_PLANAR_TILES * TEST_PLANAR_TILE_SIZE);
+
+	if (!encoder || !decoder || !buffer)
+		goto out;
+
+	FillMemory(pDstData, nStep * TEST_PLANAR_HEIGHT, 0xFF);
+
+	for (round = 0; round < TEST_PLANAR_ROUNDS; round++)
+	{
+		begin = GetTickCount64();
+
+		for (y = 0, tile = 0; y < TEST_PLANAR_HEIGHT; y += 64)
+		{
+			for (x = 0; x < TEST_PLANAR_WIDTH; x += 64, tile++)
+			{
+				width = ((x + 64) > TEST_PLANAR_WIDTH) ? (TEST_PLANAR_WIDTH - x) : 64;
+				height = ((y + 64) > TEST_PLANAR_HEIGHT) ? (TEST_PLANAR_HEIGHT - y) : 64;
+
+				if (!freerdp_bitmap_compress_planar(encoder, (BYTE*) &pSrcData[(y * nStep) + (x * 4)],
+						PIXEL_FORMAT_ARGB32, width, height, nStep, &buffer[tile * TEST_PLANAR_TILE_SIZE], &sizes[tile]))
+				{
+					printf("%s: failed to compress tile %d,%d\n", name, x, y);
+					goto out;
+				}
+
+				encodedBytes += sizes[tile];
+			}
+		}
+
+		encodeTime += GetTickCount64() - begin;
+		begin = GetTickCount64();
+
+		for (y = 0, tile = 0; y < TEST_PLANAR_HEIGHT; y += 64)
+		{
+			for (x = 0; x < TEST_PLANAR_WIDTH; x += 64, tile++)
+			{
+				width = ((x + 64) > TEST_PLANAR_WIDTH) ? (TEST_PLANAR_WIDTH - x) : 64;
+				height = ((y + 64) > TEST_PLANAR_HEIGHT) ? (TEST_PLANAR_HEIGHT - y) : 64;
+				pDstTile = &pDstData[(y * nStep) + (x * 4)];
+
+				/* planes are stored bottom-up, so decode them flipped */
+
+				if (planar_decompress(decoder, &buffer[tile * TEST_PLANAR_TILE_SIZE], sizes[tile], &pDstTile,
+						PIXEL_FORMAT_XRGB32, nStep, 0, 0, width, height, TRUE) < 0)
+				{
+					printf("%s: failed to decompress tile %d,%d\n", name, x, y);
+					goto out;
+				}
+			}
+		}
+
+		decodeTime += GetTickCount64() - begin;
+	}
+
+	for (y = 0; y < TEST_PLANAR_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_PLANAR_WIDTH; x++)
+		{
+			const BYTE* p1 = &pSrcData[(y * nStep) + (x * 4)];
+			const BYTE* p2 = &pDstData[(y * nStep) + (x * 4)];
+
+			if ((memcmp(p1, p2, 3) != 0) ||
+				(!(planarFlags & PLANAR_FORMAT_HEADER_NA) && (p1[3] != p2[3])))
+			{
+				printf("%s: round trip mismatch at %d,%d\n", name, x, y);
+				goto out;
+			}
+		}
+	}
+
+	frameBytes = ((UINT64) nStep) * TEST_PLANAR_HEIGHT * TEST_PLANAR_ROUNDS;
+
+	printf("planar %s %dx%d: ratio %.2f, compress %.1f MB/s, decompress %.1f MB/s\n",
+			name, TEST_PLANAR_WIDTH, TEST_PLANAR_HEIGHT, ((double) frameBytes) / encodedBytes,
+			encodeTime ? (frameBytes / 1024.0 / 1024.0) * 1000.0 / encodeTime : 0.0,
+			decodeTime ? (frameBytes / 1024.0 / 1024.0) * 1000.0 / decodeTime : 0.0);
+
+	status = 0;
+
+out:
+	freerdp_bitmap_planar_context_free(encoder);
+	freerdp_bitmap_planar_context_free(decoder);
+	free(buffer);
+
+	return status;
+}
+
+int test_planar_throughput()
+{
+	int nStep;
+	int status = -1;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+
+	nStep = TEST_PLANAR_WIDTH * 4;
+	pSrcData = (BYTE*) malloc(nStep * TEST_PLANAR_HEIGHT);
+	pDstData = (BYTE*) malloc(nStep * TEST_PLANAR_HEIGHT);
+
+	if (!pSrcData || !pDstData)
+		goto out;
+
+	test_planar_fill_frame(pSrcData, nStep);
+
+	if (test_planar_throughput_flags(PLANAR_FORMAT_HEADER_RLE | PLANAR_FORMAT_HEADER_NA, "rle", pSrcData, pDstData, nStep) < 0)
+		goto out;
+
+	if (test_planar_throughput_flags(PLANAR_FORMAT_HEADER_RLE, "rle+alpha", pSrcData, pDstData, nStep) < 0)
+		goto out;
+
+	if (test_planar_throughput_flags(PLANAR_FORMAT_HEADER_NA, "raw", pSrcData, pDstData, nStep) < 0)
+		goto out;
+
+	status = 0;
+
+out:
+	free(pSrcData);
+	free(pDstData);
+
+	return status;
+}
+
 int TestFreeRDPCodecPlanar(int argc, char* argv[])
 {
 	int i;
@@ -3172,6 +3357,12 @@ int TestFreeRDPCodecPlanar(int argc, char* argv[])
 		free(decompressedBitmap);
 	}
 
+	if (test_individual_planes_encoding_rle() < 0)
+		return -1;
+
+	if (test_planar_throughput() < 0)
+		return -1;
+
 	return 0;
 
 	/* Experimental Case 01 */
@@ -3,6 +3,7 @@
 #include <winpr/image.h>
 #include <winpr/print.h>
 #include <winpr/wlog.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/codec/region.h>
 
@@ -1005,10 +1006,473 @@ int test_progressive_ms_sample(char* ms_sample_path)
 	return 0;
 }
 
+/**
+ * Encoder round trip: the tiles produced by progressive_compress() and
+ * progressive_compress_upgrade() are decoded with progressive_decompress()
+ * and composed the same way as the gdi graphics pipeline does.
+ */
+
+#define TEST_ENCODE_WIDTH	200
+#define TEST_ENCODE_HEIGHT	130
+
+static void test_encode_fill(BYTE* pData, int nStep, int nWidth, int nHeight)
+{
+	int x, y;
+	BYTE* p;
+
+	/* a smooth gradient with a band of sharp black on white stripes */
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth; x++)
+		{
+			p = &pData[(y * nStep) + (x * 4)];
+
+			if ((y >= 40) && (y < 56))
+			{
+				p[0] = p[1] = p[2] = ((x / 3) & 1) ? 0x00 : 0xFF;
+			}
+			else
+			{
+				p[0] = (BYTE) (x + y);
+				p[1] = (BYTE) (y * 2);
+				p[2] = (BYTE) (255 - x);
+			}
+
+			p[3] = 0xFF;
+		}
+	}
+}
+
+static int test_encode_compose(PROGRESSIVE_CONTEXT* decoder, BYTE* pDstData, int nDstStep)
+{
+	int i, j;
+	int nbUpdateRects;
+	REGION16 clippingRects;
+	REGION16 updateRegion;
+	RECTANGLE_16 clippingRect;
+	RECTANGLE_16 updateRect;
+	const RECTANGLE_16* updateRects;
+	RFX_RECT* rect;
+	RFX_PROGRESSIVE_TILE* tile;
+	PROGRESSIVE_BLOCK_REGION* region;
+
+	region = &(decoder->region);
+
+	region16_init(&clippingRects);
+
+	for (i = 0; i < region->numRects; i++)
+	{
+		rect = &(region->rects[i]);
+
+		clippingRect.left = rect->x;
+		clippingRect.top = rect->y;
+		clippingRect.right = rect->x + rect->width;
+		clippingRect.bottom = rect->y + rect->height;
+
+		region16_union_rect(&clippingRects, &clippingRects, &clippingRect);
+	}
+
+	for (i = 0; i < region->numTiles; i++)
+	{
+		tile = region->tiles[i];
+
+		updateRect.left = tile->x;
+		updateRect.top = tile->y;
+		updateRect.right = tile->x + 64;
+		updateRect.bottom = tile->y + 64;
+
+		region16_init(&updateRegion);
+		region16_intersect_rect(&updateRegion, &clippingRects, &updateRect);
+		updateRects = region16_rects(&updateRegion, &nbUpdateRects);
+
+		for (j = 0; j < nbUpdateRects; j++)
+		{
+			freerdp_image_copy(pDstData, PIXEL_FORMAT_XRGB32, nDstStep,
+					updateRects[j].left, updateRects[j].top,
+					updateRects[j].right - updateRects[j].left,
+					updateRects[j].bottom - updateRects[j].top,
+					tile->data, PIXEL_FORMAT_XRGB32, 64 * 4,
+					updateRects[j].left - tile->x, updateRects[j].top - tile->y, NULL);
+		}
+
+		region16_uninit(&updateRegion);
+	}
+
+	region16_uninit(&clippingRects);
+
+	return region->numTiles;
+}
+
+static int test_encode_decode(PROGRESSIVE_CONTEXT* decoder, BYTE* pSrcData, UINT32 SrcSize,
+		BYTE* pDstData, int nDstStep, int nWidth, int nHeight)
+{
+	int status;
+
+	status = progressive_decompress(decoder, pSrcData, SrcSize, &pDstData,
+			PIXEL_FORMAT_XRGB32, nDstStep, 0, 0, nWidth, nHeight, 0);
+
+	if (status < 0)
+	{
+		printf("progressive_decompress failure: %d\n", status);
+		return -1;
+	}
+
+	return test_encode_compose(decoder, pDstData, nDstStep);
+}
+
+static double test_encode_error(const BYTE* pData1, const BYTE* pData2, int nStep, int nWidth, int nHeight, int* maxError)
+{
+	int x, y;
+	int error;
+	double total = 0.0;
+
+	*maxError = 0;
+
+	for (y = 0; y < nHeight; y++)
+	{
+		for (x = 0; x < nWidth * 4; x++)
+		{
+			if ((x % 4) == 3)
+				continue;
+
+			error = pData1[(y * nStep) + x] - pData2[(y * nStep) + x];
+			error = (error < 0) ? -error : error;
+
+			if (error > *maxError)
+				*maxError = error;
+
+			total += error;
+		}
+	}
+
+	return total / (nWidth * nHeight * 3);
+}
+
+int test_progressive_encode(void)
+{
+	int pass;
+	int status;
+	int maxError;
+	int numTiles;
+	int nStep;
+	double error;
+	double lastError;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	BYTE* pRefData = NULL;
+	BYTE* pEncData;
+	UINT32 EncSize;
+	RECTANGLE_16 rect;
+	PROGRESSIVE_CONTEXT* encoder;
+	PROGRESSIVE_CONTEXT* decoder;
+
+	nStep = TEST_ENCODE_WIDTH * 4;
+	pSrcData = (BYTE*) malloc(nStep * TEST_ENCODE_HEIGHT);
+	pDstData = (BYTE*) calloc(1, nStep * TEST_ENCODE_HEIGHT);
+
+	encoder = progressive_context_new(TRUE);
+	decoder = progressive_context_new(FALSE);
+
+	if (!pSrcData || !pDstData || !encoder || !decoder)
+		return -1;
+
+	progressive_create_surface_context(encoder, 0, TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT);
+	progressive_create_surface_context(decoder, 0, TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT);
+
+	test_encode_fill(pSrcData, nStep, TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT);
+
+	rect.left = 0;
+	rect.top = 0;
+	rect.right = TEST_ENCODE_WIDTH;
+	rect.bottom = TEST_ENCODE_HEIGHT;
+
+	status = progressive_compress(encoder, pSrcData, PIXEL_FORMAT_XRGB32, nStep,
+			TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT, &rect, 1, 0, &pEncData, &EncSize);
+
+	lastError = 256.0;
+
+	for (pass = 0; status > 0; pass++)
+	{
+		numTiles = test_encode_decode(decoder, pEncData, EncSize, pDstData, nStep, TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT);
+
+		if (numTiles != 12)
+		{
+			printf("pass %d: %d tiles decoded, expected 12\n", pass, numTiles);
+			goto fail;
+		}
+
+		error = test_encode_error(pSrcData, pDstData, nStep, TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT, &maxError);
+
+		printf("progressive pass %d: %d bytes, mean error %.2f, max error %d\n", pass, EncSize, error, maxError);
+
+		if (error > lastError)
+		{
+			printf("pass %d: upgrade increased the error\n", pass);
+			goto fail;
+		}
+
+		lastError = error;
+
+		status = progressive_compress_upgrade(encoder, 0, &pEncData, &EncSize);
+	}
+
+	if ((status < 0) || (pass != 3))
+	{
+		printf("unexpected number of passes: %d (status %d)\n", pass, status);
+		goto fail;
+	}
+
+	if (lastError > 2.0)
+	{
+		printf("final pass is not close enough to the source\n");
+		goto fail;
+	}
+
+	/* a small change only sends the tile it touches, and leaves the rest alone */
+
+	pRefData = (BYTE*) malloc(nStep * TEST_ENCODE_HEIGHT);
+
+	if (!pRefData)
+		goto fail;
+
+	CopyMemory(pRefData, pDstData, nStep * TEST_ENCODE_HEIGHT);
+
+	rect.left = 70;
+	rect.top = 70;
+	rect.right = 90;
+	rect.bottom = 90;
+
+	test_image_fill(pSrcData, nStep, rect.left, rect.top, 20, 20, 0xFF204080);
+
+	status = progressive_compress(encoder, pSrcData, PIXEL_FORMAT_XRGB32, nStep,
+			TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT, &rect, 1, 0, &pEncData, &EncSize);
+
+	for (pass = 0; status > 0; pass++)
+	{
+		numTiles = test_encode_decode(decoder, pEncData, EncSize, pDstData, nStep, TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT);
+
+		if (numTiles != 1)
+		{
+			printf("partial update pass %d: %d tiles decoded, expected 1\n", pass, numTiles);
+			goto fail;
+		}
+
+		status = progressive_compress_upgrade(encoder, 0, &pEncData, &EncSize);
+	}
+
+	test_image_fill(pRefData, nStep, rect.left, rect.top, 20, 20, 0xFF204080);
+	error = test_encode_error(pRefData, pDstData, nStep, TEST_ENCODE_WIDTH, TEST_ENCODE_HEIGHT, &maxError);
+
+	if ((status < 0) || (pass != 3) || (error > 0.1))
+	{
+		printf("partial update: %d passes, mean error %.2f\n", pass, error);
+		goto fail;
+	}
+
+	free(pRefData);
+	free(pSrcData);
+	free(pDstData);
+	progressive_context_free(encoder);
+	progressive_context_free(decoder);
+
+	return 1;
+
+fail:
+	free(pRefData);
+	free(pSrcData);
+	free(pDstData);
+	progressive_context_free(encoder);
+	progressive_context_free(decoder);
+
+	return -1;
+}
+
+/**
+ * Decodes a full screen 4K update and its upgrade passes with an increasing
+ * number of tile decoding threads. Every thread count must produce the same
+ * image as the single threaded decoder.
+ */
+
+#define TEST_THREADS_WIDTH	3840
+#define TEST_THREADS_HEIGHT	2160
+#define TEST_THREADS_PASSES	3
+#define TEST_THREADS_ROUNDS	2
+
+static int test_progressive_decode_frames(PROGRESSIVE_CONTEXT* decoder, BYTE* frames[], UINT32 sizes[],
+		int count, BYTE* pDstData, int nDstStep, BOOL compose, UINT64* elapsed)
+{
+	int pass;
+	int status;
+	int numTiles = 0;
+	UINT64 begin;
+
+	for (pass = 0; pass < count; pass++)
+	{
+		begin = GetTickCount64();
+
+		status = progressive_decompress(decoder, frames[pass], sizes[pass], &pDstData,
+				PIXEL_FORMAT_XRGB32, nDstStep, 0, 0, TEST_THREADS_WIDTH, TEST_THREADS_HEIGHT, 0);
+
+		*elapsed += GetTickCount64() - begin;
+
+		if (status < 0)
+			return -1;
+
+		numTiles += decoder->region.numTiles;
+
+		if (compose)
+			test_encode_compose(decoder, pDstData, nDstStep);
+	}
+
+	return numTiles;
+}
+
+int test_progressive_decode_threads(void)
+{
+	int pass;
+	int round;
+	int count = 0;
+	int status;
+	int numTiles;
+	int nStep;
+	UINT32 index;
+	UINT32 EncSize;
+	UINT64 elapsed;
+	BYTE* pEncData;
+	BYTE* pSrcData;
+	BYTE* pDstData = NULL;
+	BYTE* pRefData = NULL;
+	BYTE* frames[TEST_THREADS_PASSES] = { NULL };
+	UINT32 sizes[TEST_THREADS_PASSES];
+	RECTANGLE_16 rect;
+	PROGRESSIVE_CONTEXT* encoder;
+	PROGRESSIVE_CONTEXT* decoder = NULL;
+	static const UINT32 threadCounts[] = { 1, 2, 4, 8 };
+
+	nStep = TEST_THREADS_WIDTH * 4;
+	pSrcData = (BYTE*) malloc(nStep * TEST_THREADS_HEIGHT);
+	pDstData = (BYTE*) calloc(1, nStep * TEST_THREADS_HEIGHT);
+	pRefData = (BYTE*) calloc(1, nStep * TEST_THREADS_HEIGHT);
+
+	encoder = progressive_context_new(TRUE);
+
+	if (!pSrcData || !pDstData || !pRefData || !encoder)
+		goto fail;
+
+	progressive_create_surface_context(encoder, 0, TEST_THREADS_WIDTH, TEST_THREADS_HEIGHT);
+
+	test_encode_fill(pSrcData, nStep, TEST_THREADS_WIDTH, TEST_THREADS_HEIGHT);
+
+	rect.left = 0;
+	rect.top = 0;
+	rect.right = TEST_THREADS_WIDTH;
+	rect.bottom = TEST_THREADS_HEIGHT;
+
+	status = progressive_compress(encoder, pSrcData, PIXEL_FORMAT_XRGB32, nStep,
+			TEST_THREADS_WIDTH, TEST_THREADS_HEIGHT, &rect, 1, 0, &pEncData, &EncSize);
+
+	for (count = 0; (status > 0) && (count < TEST_THREADS_PASSES); count++)
+	{
+		frames[count] = (BYTE*) malloc(EncSize);
+
+		if (!frames[count])
+			goto fail;
+
+		CopyMemory(frames[count], pEncData, EncSize);
+		sizes[count] = EncSize;
+
+		status = progressive_compress_upgrade(encoder, 0, &pEncData, &EncSize);
+	}
+
+	if (status < 0)
+		goto fail;
+
+	for (index = 0; index < ARRAYSIZE(threadCounts); index++)
+	{
+		decoder = progressive_context_new(FALSE);
+
+		if (!decoder || (progressive_context_set_thread_count(decoder, threadCounts[index]) < 0))
+			goto fail;
+
+		progressive_create_surface_context(decoder, 0, TEST_THREADS_WIDTH, TEST_THREADS_HEIGHT);
+
+		numTiles = 0;
+		elapsed = 0;
+
+		/* the first round allocates the surface tiles and is not counted */
+
+		for (round = 0; round <= TEST_THREADS_ROUNDS; round++)
+		{
+			if (round == 1)
+			{
+				numTiles = 0;
+				elapsed = 0;
+			}
+
+			status = test_progressive_decode_frames(decoder, frames, sizes, count, pDstData, nStep,
+					(round == TEST_THREADS_ROUNDS) ? TRUE : FALSE, &elapsed);
+
+			if (status < 0)
+			{
+				printf("%d threads: decoding failed\n", threadCounts[index]);
+				goto fail;
+			}
+
+			numTiles += status;
+		}
+
+		if (index == 0)
+		{
+			CopyMemory(pRefData, pDstData, nStep * TEST_THREADS_HEIGHT);
+		}
+		else if (memcmp(pRefData, pDstData, nStep * TEST_THREADS_HEIGHT) != 0)
+		{
+			printf("%d threads: decoded image differs from the single threaded decoder\n", threadCounts[index]);
+			goto fail;
+		}
+
+		printf("progressive decode %dx%d, %d passes, %d threads: %.0f tiles/s\n",
+				TEST_THREADS_WIDTH, TEST_THREADS_HEIGHT, count, threadCounts[index],
+				elapsed ? (numTiles * 1000.0) / elapsed : 0.0);
+
+		progressive_context_free(decoder);
+		decoder = NULL;
+	}
+
+	for (pass = 0; pass < count; pass++)
+		free(frames[pass]);
+
+	free(pSrcData);
+	free(pDstData);
+	free(pRefData);
+	progressive_context_free(encoder);
+
+	return 1;
+
+fail:
+	for (pass = 0; pass < count; pass++)
+		free(frames[pass]);
+
+	free(pSrcData);
+	free(pDstData);
+	free(pRefData);
+	progressive_context_free(encoder);
+	progressive_context_free(decoder);
+
+	return -1;
+}
+
 int TestFreeRDPCodecProgressive(int argc, char* argv[])
 {
 	char* ms_sample_path;
 
+	if (test_progressive_encode() < 0)
+		return -1;
+
+	if (test_progressive_decode_threads() < 0)
+		return -1;
+
 	ms_sample_path = _strdup("/tmp/EGFX_PROGRESSIVE_MS_SAMPLE");
 
 	if (PathFileExistsA(ms_sample_path))
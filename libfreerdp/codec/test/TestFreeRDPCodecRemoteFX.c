@@ -1,5 +1,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/rfx.h>
@@ -756,7 +757,98 @@ const UINT32 TEST_RFX_XRGB_IMAGE[4096] =
 	0x00169ff8, 0x00159ef7, 0x00149df7, 0x00139cf6, 0x00129bf5, 0x00129bf5, 0x00129bf5, 0x00129bf5
 };
 
+#define TEST_RFX_WIDTH		1920
+#define TEST_RFX_HEIGHT		1080
+#define TEST_RFX_FRAMES		20
+
+/**
+ * Decodes a full 1080p frame several times: every tile is a separate
+ * work item submitted to the thread pool of the RemoteFX context.
+ */
+
+static int test_rfx_decode_tiles(void)
+{
+	int x, y;
+	int index;
+	int status = 0;
+	UINT64 begin;
+	UINT64 elapsed;
+	BYTE* data;
+	wStream* s;
+	RFX_RECT rect;
+	RFX_MESSAGE* message;
+	RFX_CONTEXT* encoder;
+	RFX_CONTEXT* decoder;
+
+	data = (BYTE*) malloc(TEST_RFX_WIDTH * TEST_RFX_HEIGHT * 4);
+	s = Stream_New(NULL, 1024);
+	encoder = rfx_context_new(TRUE);
+	decoder = rfx_context_new(FALSE);
+
+	if (!data || !s || !encoder || !decoder)
+	{
+		status = -1;
+		goto out;
+	}
+
+	for (y = 0; y < TEST_RFX_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_RFX_WIDTH; x++)
+			((UINT32*) data)[(y * TEST_RFX_WIDTH) + x] = TEST_RFX_XRGB_IMAGE[((y % 64) * 64) + (x % 64)] ^ (x * y);
+	}
+
+	encoder->mode = RLGR3;
+	encoder->width = TEST_RFX_WIDTH;
+	encoder->height = TEST_RFX_HEIGHT;
+	rfx_context_set_pixel_format(encoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+	rfx_context_set_pixel_format(decoder, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = TEST_RFX_WIDTH;
+	rect.height = TEST_RFX_HEIGHT;
+
+	rfx_compose_message(encoder, s, &rect, 1, data, TEST_RFX_WIDTH, TEST_RFX_HEIGHT, TEST_RFX_WIDTH * 4);
+	Stream_SealLength(s);
+
+	begin = GetTickCount64();
+
+	for (index = 0; index < TEST_RFX_FRAMES; index++)
+	{
+		message = rfx_process_message(decoder, Stream_Buffer(s), Stream_Length(s));
+
+		if (!message || (rfx_message_get_tile_count(message) != (30 * 17)))
+		{
+			printf("rfx_process_message failure\n");
+			rfx_message_free(decoder, message);
+			status = -1;
+			goto out;
+		}
+
+		rfx_message_free(decoder, message);
+	}
+
+	elapsed = GetTickCount64() - begin;
+
+	printf("RemoteFX 1080p tile decode: %d frames in %d ms (%.1f fps)\n", TEST_RFX_FRAMES, (int) elapsed,
+			elapsed ? ((double) TEST_RFX_FRAMES * 1000.0) / elapsed : 0.0);
+
+out:
+	if (encoder)
+		rfx_context_free(encoder);
+
+	if (decoder)
+		rfx_context_free(decoder);
+
+	Stream_Free(s, TRUE);
+	free(data);
+	return status;
+}
+
 int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 {
+	if (test_rfx_decode_tiles() < 0)
+		return -1;
+
 	return 0;
 }
@@ -1,5 +1,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/codec/xcrush.h>
 
@@ -133,6 +134,146 @@ int test_XCrushCompressIsland()
 	return 1;
 }
 
+#define TEST_XCRUSH_PAYLOAD_SIZE	16384
+#define TEST_XCRUSH_PAYLOAD_COUNT	256
+#define TEST_XCRUSH_BENCHMARK_TIME	2000
+
+/**
+ * Synthesizes a stream of bulk payloads that looks like what a server sends
+ * for a busy desktop: rows of 32bpp text glyphs over a gradient background,
+ * scrolled a few lines between payloads, with a sprinkle of noise so that
+ * the long range matches found by level 1 are never exact copies.
+ */
+
+static void test_xcrush_fill_payloads(BYTE* data, UINT32 size)
+{
+	UINT32 index;
+	UINT32 x, y;
+	UINT32 glyph;
+	UINT32 seed = 0x1234567;
+	UINT32 width = 1024;
+	BYTE* pixel;
+
+	for (index = 0; index < size / 4; index++)
+	{
+		x = index % width;
+		y = (index / width) + ((index / (TEST_XCRUSH_PAYLOAD_SIZE / 4)) * 3);
+		glyph = ((x / 8) * 7 + (y / 16) * 13) % 23;
+		pixel = &data[index * 4];
+
+		if ((glyph < 12) && ((((x & 7) * (glyph + 3)) ^ (y & 15) * glyph) & 4))
+		{
+			pixel[0] = pixel[1] = pixel[2] = 0x10;
+		}
+		else
+		{
+			pixel[0] = (BYTE) (0xC0 + (y >> 4));
+			pixel[1] = (BYTE) (0xC0 + (x >> 5));
+			pixel[2] = 0xE0;
+		}
+
+		pixel[3] = 0xFF;
+
+		seed = seed * 1103515245 + 12345;
+
+		if (!(seed & 0x3F000))
+			pixel[seed & 3] = (BYTE) (seed >> 24);
+	}
+}
+
+int test_XCrushCompressSpeed()
+{
+	int status;
+	UINT32 Flags;
+	UINT32 index;
+	UINT32 SrcSize;
+	UINT32 DstSize;
+	UINT32 PlainSize;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	BYTE* pPlainData;
+	UINT64 begin;
+	UINT64 elapsed;
+	UINT64 totalSrc;
+	UINT64 totalDst;
+	UINT32 iterations;
+	BYTE* payloads;
+	BYTE OutputBuffer[TEST_XCRUSH_PAYLOAD_SIZE + 64];
+	XCRUSH_CONTEXT* encoder;
+	XCRUSH_CONTEXT* decoder;
+
+	payloads = (BYTE*) malloc(TEST_XCRUSH_PAYLOAD_SIZE * TEST_XCRUSH_PAYLOAD_COUNT);
+	encoder = xcrush_context_new(TRUE);
+	decoder = xcrush_context_new(FALSE);
+
+	if (!payloads || !encoder || !decoder)
+		return -1;
+
+	test_xcrush_fill_payloads(payloads, TEST_XCRUSH_PAYLOAD_SIZE * TEST_XCRUSH_PAYLOAD_COUNT);
+
+	/* one pass through a decompressor to make sure the stream round-trips */
+
+	for (index = 0; index < TEST_XCRUSH_PAYLOAD_COUNT; index++)
+	{
+		SrcSize = TEST_XCRUSH_PAYLOAD_SIZE;
+		pSrcData = &payloads[index * TEST_XCRUSH_PAYLOAD_SIZE];
+		pDstData = OutputBuffer;
+		DstSize = sizeof(OutputBuffer);
+
+		status = xcrush_compress(encoder, pSrcData, SrcSize, &pDstData, &DstSize, &Flags);
+
+		if (status < 0)
+		{
+			printf("XCrushCompressSpeed: xcrush_compress failure: %d\n", status);
+			return -1;
+		}
+
+		if (!(Flags & PACKET_COMPRESSED))
+			continue;
+
+		status = xcrush_decompress(decoder, pDstData, DstSize, &pPlainData, &PlainSize, Flags);
+
+		if ((status < 0) || (PlainSize != SrcSize) || (memcmp(pPlainData, pSrcData, SrcSize) != 0))
+		{
+			printf("XCrushCompressSpeed: payload %d does not round-trip\n", index);
+			return -1;
+		}
+	}
+
+	xcrush_context_reset(encoder, FALSE);
+
+	iterations = 0;
+	totalSrc = totalDst = 0;
+	begin = GetTickCount64();
+
+	do
+	{
+		SrcSize = TEST_XCRUSH_PAYLOAD_SIZE;
+		pSrcData = &payloads[(iterations % TEST_XCRUSH_PAYLOAD_COUNT) * TEST_XCRUSH_PAYLOAD_SIZE];
+		pDstData = OutputBuffer;
+		DstSize = sizeof(OutputBuffer);
+
+		if (xcrush_compress(encoder, pSrcData, SrcSize, &pDstData, &DstSize, &Flags) < 0)
+			return -1;
+
+		totalSrc += SrcSize;
+		totalDst += DstSize;
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_XCRUSH_BENCHMARK_TIME);
+
+	printf("xcrush_compress: %.1f MB/s, ratio %.2f:1 (%d payloads of %d bytes)\n",
+			((double) totalSrc) / (elapsed * 1000.0), (double) totalSrc / totalDst,
+			iterations, TEST_XCRUSH_PAYLOAD_SIZE);
+
+	xcrush_context_free(encoder);
+	xcrush_context_free(decoder);
+	free(payloads);
+
+	return 1;
+}
+
 int TestFreeRDPCodecXCrush(int argc, char* argv[])
 {
 	//if (test_XCrushCompressBells() < 0)
@@ -140,6 +281,9 @@ int TestFreeRDPCodecXCrush(int argc, char* argv[])
 	if (test_XCrushCompressIsland() < 0)
 		return -1;
 
+	if (test_XCrushCompressSpeed() < 0)
+		return -1;
+
 	return 0;
 }
 
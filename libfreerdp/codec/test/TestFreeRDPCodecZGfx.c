@@ -1,10 +1,318 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/codec/zgfx.h>
 
+#define TEST_BENCHMARK_TIME	200
+
+static UINT32 test_random_seed = 0x2468ACE1;
+
+static UINT32 test_random(void)
+{
+	test_random_seed = (test_random_seed * 1103515245) + 12345;
+	return (test_random_seed >> 8);
+}
+
+/**
+ * Builds a sequence of graphics pipeline PDUs resembling a desktop session:
+ * RDPGFX_WIRE_TO_SURFACE_1 headers followed by planar-like bitmap rows with
+ * long runs, glyph-like patterns repeated across PDUs and some noise.
+ */
+
+static UINT32 test_gfx_traffic(BYTE* pData, UINT32 size)
+{
+	int x, y;
+	int width;
+	int height;
+	UINT16 left;
+	UINT16 top;
+	BYTE color;
+	wStream* s;
+	UINT32 offset = 0;
+	UINT16 frameId = 0;
+	static const BYTE glyphs[4][8] =
+	{
+		{ 0x18, 0x3C, 0x66, 0x66, 0x7E, 0x66, 0x66, 0x00 },
+		{ 0x7C, 0x66, 0x66, 0x7C, 0x66, 0x66, 0x7C, 0x00 },
+		{ 0x3C, 0x66, 0x60, 0x60, 0x60, 0x66, 0x3C, 0x00 },
+		{ 0x78, 0x6C, 0x66, 0x66, 0x66, 0x6C, 0x78, 0x00 }
+	};
+
+	s = Stream_New(pData, size);
+
+	if (!s)
+		return 0;
+
+	while (offset < size)
+	{
+		width = 16 + (test_random() % 96);
+		height = 8 + (test_random() % 32);
+
+		if ((offset + 25 + (width * height * 4)) > size)
+			break;
+
+		/* RDPGFX_WIRE_TO_SURFACE_1 header (8 + 17 bytes) */
+
+		left = (UINT16) (test_random() % 1024);
+		top = (UINT16) (test_random() % 768);
+
+		Stream_SetPosition(s, offset);
+		Stream_Write_UINT16(s, 0x0001); /* cmdId */
+		Stream_Write_UINT16(s, 0); /* flags */
+		Stream_Write_UINT32(s, 25 + (width * height * 4)); /* pduLength */
+		Stream_Write_UINT16(s, 0); /* surfaceId */
+		Stream_Write_UINT16(s, 0x0008); /* codecId */
+		Stream_Write_UINT8(s, 0x20); /* pixelFormat */
+		Stream_Write_UINT16(s, left); /* left */
+		Stream_Write_UINT16(s, top); /* top */
+		Stream_Write_UINT16(s, (UINT16) width); /* right */
+		Stream_Write_UINT16(s, (UINT16) height); /* bottom */
+		Stream_Write_UINT32(s, frameId); /* bitmapDataLength */
+		frameId++;
+		offset += 25;
+
+		color = (BYTE) test_random();
+
+		for (y = 0; y < height; y++)
+		{
+			for (x = 0; x < width; x++)
+			{
+				if (glyphs[frameId % 4][y % 8] & (0x80 >> (x % 8)))
+				{
+					pData[offset + 0] = 0x00;
+					pData[offset + 1] = 0x00;
+					pData[offset + 2] = 0x00;
+				}
+				else if ((test_random() % 64) == 0)
+				{
+					pData[offset + 0] = (BYTE) test_random();
+					pData[offset + 1] = (BYTE) test_random();
+					pData[offset + 2] = (BYTE) test_random();
+				}
+				else
+				{
+					pData[offset + 0] = color;
+					pData[offset + 1] = color;
+					pData[offset + 2] = 0xFF;
+				}
+
+				pData[offset + 3] = 0xFF;
+				offset += 4;
+			}
+		}
+	}
+
+	Stream_Free(s, FALSE);
+
+	return offset;
+}
+
+static int test_zgfx_round_trip(ZGFX_CONTEXT* compressor, ZGFX_CONTEXT* decompressor,
+		BYTE* pSrcData, UINT32 SrcSize, const char* name)
+{
+	int status;
+	UINT32 flags = 0;
+	UINT32 DstSize = 0;
+	UINT32 OutSize = 0;
+	BYTE* pDstData = NULL;
+	BYTE* pOutData = NULL;
+
+	status = zgfx_compress(compressor, pSrcData, SrcSize, &pDstData, &DstSize, &flags);
+
+	if (status < 0)
+	{
+		printf("%s: zgfx_compress failure: %d\n", name, status);
+		return -1;
+	}
+
+	status = zgfx_decompress(decompressor, pDstData, DstSize, &pOutData, &OutSize, flags);
+
+	if (status < 0)
+	{
+		printf("%s: zgfx_decompress failure: %d\n", name, status);
+		free(pDstData);
+		return -1;
+	}
+
+	if ((OutSize != SrcSize) || (SrcSize && (memcmp(pOutData, pSrcData, SrcSize) != 0)))
+	{
+		printf("%s: round trip mismatch: %d bytes, expected %d\n", name, OutSize, SrcSize);
+		free(pDstData);
+		free(pOutData);
+		return -1;
+	}
+
+	free(pDstData);
+	free(pOutData);
+
+	return (int) DstSize;
+}
+
+static int test_zgfx_levels(void)
+{
+	int size;
+	int status = -1;
+	UINT32 index;
+	UINT32 level;
+	UINT32 SrcSize;
+	BYTE* pSrcData;
+	ZGFX_CONTEXT* compressor = NULL;
+	ZGFX_CONTEXT* decompressor = NULL;
+
+	SrcSize = 3 * 1024 * 1024;
+	pSrcData = (BYTE*) malloc(SrcSize);
+
+	if (!pSrcData)
+		return -1;
+
+	SrcSize = test_gfx_traffic(pSrcData, SrcSize);
+
+	for (level = ZGFX_COMPRESSION_LEVEL_NONE; level <= ZGFX_COMPRESSION_LEVEL_BEST; level++)
+	{
+		compressor = zgfx_context_new(TRUE);
+		decompressor = zgfx_context_new(FALSE);
+
+		if (!compressor || !decompressor)
+			goto out;
+
+		zgfx_set_compression_level(compressor, level);
+
+		/* small, single-segment and multipart PDUs */
+
+		if (test_zgfx_round_trip(compressor, decompressor, pSrcData, 0, "empty") < 0)
+			goto out;
+
+		if (test_zgfx_round_trip(compressor, decompressor, pSrcData, 2, "tiny") < 0)
+			goto out;
+
+		if (test_zgfx_round_trip(compressor, decompressor, pSrcData, 4096, "small") < 0)
+			goto out;
+
+		size = test_zgfx_round_trip(compressor, decompressor, pSrcData, 4096, "repeated");
+
+		if (size < 0)
+			goto out;
+
+		if (level && (size > 64))
+		{
+			printf("level %d: a PDU repeated from the history compressed to %d bytes\n", level, size);
+			goto out;
+		}
+
+		if (test_zgfx_round_trip(compressor, decompressor, pSrcData, 200000, "multipart") < 0)
+			goto out;
+
+		/* the whole traffic overflows the history window more than once */
+
+		for (index = 0; index < SrcSize; index += 150000)
+		{
+			if (test_zgfx_round_trip(compressor, decompressor, &pSrcData[index],
+					MIN(150000, SrcSize - index), "stream") < 0)
+				goto out;
+		}
+
+		/* incompressible data falls back to uncompressed segments */
+
+		for (index = 0; index < 100000; index++)
+			pSrcData[SrcSize + index - 100000] ^= (BYTE) test_random();
+
+		if (test_zgfx_round_trip(compressor, decompressor, &pSrcData[SrcSize - 100000], 100000, "random") < 0)
+			goto out;
+
+		SrcSize = test_gfx_traffic(pSrcData, SrcSize);
+
+		zgfx_context_free(compressor);
+		zgfx_context_free(decompressor);
+		compressor = decompressor = NULL;
+	}
+
+	status = 1;
+
+out:
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	free(pSrcData);
+
+	return status;
+}
+
+static int test_zgfx_benchmark(void)
+{
+	UINT32 level;
+	UINT32 index;
+	UINT32 SrcSize;
+	UINT32 DstSize;
+	UINT32 TotalSize;
+	UINT64 TotalBytes;
+	UINT64 begin;
+	UINT64 elapsed;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	ZGFX_CONTEXT* zgfx;
+
+	SrcSize = 1024 * 1024;
+	pSrcData = (BYTE*) malloc(SrcSize);
+
+	if (!pSrcData)
+		return -1;
+
+	SrcSize = test_gfx_traffic(pSrcData, SrcSize);
+
+	for (level = ZGFX_COMPRESSION_LEVEL_FAST; level <= ZGFX_COMPRESSION_LEVEL_BEST; level++)
+	{
+		zgfx = zgfx_context_new(TRUE);
+
+		if (!zgfx)
+			return -1;
+
+		zgfx_set_compression_level(zgfx, level);
+
+		TotalSize = 0;
+		TotalBytes = 0;
+		begin = GetTickCount64();
+
+		do
+		{
+			/* one PDU of 16K at a time, as the graphics pipeline would send them */
+
+			for (index = 0; index < SrcSize; index += 16384)
+			{
+				if (zgfx_compress(zgfx, &pSrcData[index], MIN(16384, SrcSize - index),
+						&pDstData, &DstSize, NULL) < 0)
+					return -1;
+
+				free(pDstData);
+
+				if (!TotalBytes)
+					TotalSize += DstSize;
+			}
+
+			TotalBytes += SrcSize;
+			elapsed = GetTickCount64() - begin;
+		}
+		while (elapsed < TEST_BENCHMARK_TIME);
+
+		printf("zgfx level %d: %.1f MB/s, ratio %.2f (%d -> %d bytes)\n", level,
+				((double) TotalBytes / (1024.0 * 1024.0)) / ((double) MAX(elapsed, 1) / 1000.0),
+				(double) SrcSize / (double) TotalSize, SrcSize, TotalSize);
+
+		zgfx_context_free(zgfx);
+	}
+
+	free(pSrcData);
+
+	return 1;
+}
+
 int TestFreeRDPCodecZGfx(int argc, char* argv[])
 {
+	if (test_zgfx_levels() < 0)
+		return -1;
+
+	if (test_zgfx_benchmark() < 0)
+		return -1;
+
 	return 0;
 }
-
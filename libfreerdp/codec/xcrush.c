@@ -28,6 +28,10 @@
 #include <freerdp/log.h>
 #include <freerdp/codec/xcrush.h>
 
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif
+
 #define TAG FREERDP_TAG("codec")
 
 const char* xcrush_get_level_2_compression_flags_string(UINT32 flags)
@@ -141,12 +145,77 @@ int xcrush_append_chunk(XCRUSH_CONTEXT* xcrush, BYTE* data, UINT32* beg, UINT32
 	return 1;
 }
 
+/**
+ * The rolling accumulator used for chunking is a 32 byte window in which every
+ * byte is rotated left by its age, and a chunk ends wherever the low 7 bits of
+ * the accumulator are all zero. Only the bytes rotated by 0-6 or 25-31 reach
+ * those 7 bits, so the boundary test for the window ending at data[i + 32]
+ * depends on 14 bytes only and does not need the serial rotation chain.
+ */
+
+static INLINE BOOL xcrush_is_chunk_boundary(const BYTE* data)
+{
+	UINT32 bits;
+
+	bits = (data[1] >> 1) ^ (data[2] >> 2) ^ (data[3] >> 3) ^ (data[4] >> 4) ^
+		(data[5] >> 5) ^ (data[6] >> 6) ^ (data[7] >> 7);
+
+	bits ^= data[32] ^ (data[31] << 1) ^ (data[30] << 2) ^ (data[29] << 3) ^
+		(data[28] << 4) ^ (data[27] << 5) ^ (data[26] << 6);
+
+	return !(bits & 0x7F);
+}
+
+#ifdef WITH_SSE2
+
+/**
+ * Evaluates xcrush_is_chunk_boundary() for the 16 windows starting at data[0]
+ * to data[15] and returns the result as a bit mask.
+ */
+
+static INLINE UINT32 xcrush_find_chunk_boundaries_sse2(const BYTE* data)
+{
+	__m128i bits;
+	__m128i value;
+
+	bits = _mm_setzero_si128();
+
+#define XCRUSH_SHR(_k) \
+	value = _mm_loadu_si128((const __m128i*) &data[_k]); \
+	value = _mm_and_si128(_mm_srli_epi16(value, _k), _mm_set1_epi8((char) (0xFF >> _k))); \
+	bits = _mm_xor_si128(bits, value)
+
+#define XCRUSH_SHL(_k) \
+	value = _mm_loadu_si128((const __m128i*) &data[32 - _k]); \
+	value = _mm_slli_epi16(_mm_and_si128(value, _mm_set1_epi8((char) (0x7F >> _k))), _k); \
+	bits = _mm_xor_si128(bits, value)
+
+	XCRUSH_SHR(1); XCRUSH_SHR(2); XCRUSH_SHR(3); XCRUSH_SHR(4);
+	XCRUSH_SHR(5); XCRUSH_SHR(6); XCRUSH_SHR(7);
+
+	XCRUSH_SHL(0); XCRUSH_SHL(1); XCRUSH_SHL(2); XCRUSH_SHL(3);
+	XCRUSH_SHL(4); XCRUSH_SHL(5); XCRUSH_SHL(6);
+
+#undef XCRUSH_SHR
+#undef XCRUSH_SHL
+
+	bits = _mm_and_si128(bits, _mm_set1_epi8(0x7F));
+	bits = _mm_cmpeq_epi8(bits, _mm_setzero_si128());
+
+	return (UINT32) _mm_movemask_epi8(bits);
+}
+
+#endif
+
 int xcrush_compute_chunks(XCRUSH_CONTEXT* xcrush, BYTE* data, UINT32 size, UINT32* pIndex)
 {
 	UINT32 i = 0;
+	UINT32 count = 0;
 	UINT32 offset = 0;
-	UINT32 rotation = 0;
-	UINT32 accumulator = 0;
+#ifdef WITH_SSE2
+	UINT32 mask;
+	UINT32 bit;
+#endif
 
 	*pIndex = 0;
 	xcrush->SignatureIndex = 0;
@@ -154,48 +223,29 @@ int xcrush_compute_chunks(XCRUSH_CONTEXT* xcrush, BYTE* data, UINT32 size, UINT3
 	if (size < 128)
 		return 0;
 
-	for (i = 0; i < 32; i++)
-	{
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i] ^ rotation;
-	}
+	/* windows are tested four at a time, so the last group may run past size - 64 */
+
+	count = (size - 64 + 3) & ~3;
 
-	for (i = 0; i < size - 64; i++)
+#ifdef WITH_SSE2
+	for (; (i + 16) <= count; i += 16)
 	{
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
+		mask = xcrush_find_chunk_boundaries_sse2(&data[i]);
 
-		if (!(accumulator & 0x7F))
+		while (mask)
 		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
-		i++;
+			bit = 31 - __lzcnt(mask & (~mask + 1));
+			mask &= mask - 1;
 
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
-
-		if (!(accumulator & 0x7F))
-		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
+			if (!xcrush_append_chunk(xcrush, data, &offset, i + bit + 32))
 				return 0;
 		}
-		i++;
-
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
-
-		if (!(accumulator & 0x7F))
-		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
-		i++;
-
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
+	}
+#endif
 
-		if (!(accumulator & 0x7F))
+	for (; i < count; i++)
+	{
+		if (xcrush_is_chunk_boundary(&data[i]))
 		{
 			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
 				return 0;
@@ -320,18 +370,78 @@ int xcrush_insert_chunk(XCRUSH_CONTEXT* xcrush, XCRUSH_SIGNATURE* signature, UIN
 	return 1;
 }
 
+/**
+ * Counts the bytes that match going forward from match and chunk, at most limit.
+ * The vector loop never loads past safeLimit bytes from chunk, which keeps it
+ * inside the history buffer; the byte loop finishes the way it always did.
+ */
+
+static INLINE UINT32 xcrush_forward_match_length(const BYTE* match, const BYTE* chunk, UINT32 limit, UINT32 safeLimit)
+{
+	UINT32 length = 0;
+#ifdef WITH_SSE2
+	UINT32 mask;
+	__m128i a, b;
+
+	if (safeLimit > limit)
+		safeLimit = limit;
+
+	while ((length + 16) <= safeLimit)
+	{
+		a = _mm_loadu_si128((const __m128i*) &match[length]);
+		b = _mm_loadu_si128((const __m128i*) &chunk[length]);
+		mask = ~((UINT32) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) & 0xFFFF;
+
+		if (mask)
+			return length + (31 - __lzcnt(mask & (~mask + 1)));
+
+		length += 16;
+	}
+#endif
+
+	while ((length < limit) && (match[length] == chunk[length]))
+		length++;
+
+	return length;
+}
+
+/**
+ * Counts the bytes that match going backward from match[-1] and chunk[-1], at most limit.
+ */
+
+static INLINE UINT32 xcrush_reverse_match_length(const BYTE* match, const BYTE* chunk, UINT32 limit)
+{
+	UINT32 length = 0;
+#ifdef WITH_SSE2
+	UINT32 mask;
+	__m128i a, b;
+
+	while ((length + 16) <= limit)
+	{
+		a = _mm_loadu_si128((const __m128i*) &match[-((int) length) - 16]);
+		b = _mm_loadu_si128((const __m128i*) &chunk[-((int) length) - 16]);
+		mask = ~((UINT32) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) & 0xFFFF;
+
+		if (mask)
+			return length + __lzcnt16((UINT16) mask);
+
+		length += 16;
+	}
+#endif
+
+	while ((length < limit) && (match[-((int) length) - 1] == chunk[-((int) length) - 1]))
+		length++;
+
+	return length;
+}
+
 int xcrush_find_match_length(XCRUSH_CONTEXT* xcrush, UINT32 MatchOffset, UINT32 ChunkOffset, UINT32 HistoryOffset, UINT32 SrcSize, UINT32 MaxMatchLength, XCRUSH_MATCH_INFO* MatchInfo)
 {
-	UINT32 MatchSymbol;
-	UINT32 ChunkSymbol;
 	BYTE* ChunkBuffer;
 	BYTE* MatchBuffer;
 	BYTE* MatchStartPtr;
-	BYTE* ForwardChunkPtr;
-	BYTE* ReverseChunkPtr;
-	BYTE* ForwardMatchPtr;
-	BYTE* ReverseMatchPtr;
 	BYTE* HistoryBufferEnd;
+	UINT32 ReverseMatchLimit;
 	UINT32 ReverseMatchLength;
 	UINT32 ForwardMatchLength;
 	UINT32 TotalMatchLength;
@@ -364,39 +474,28 @@ int xcrush_find_match_length(XCRUSH_CONTEXT* xcrush, UINT32 MatchOffset, UINT32
 	if (ChunkBuffer < HistoryBuffer)
 		return -2005; /* error */
 
-	ForwardMatchPtr = &HistoryBuffer[MatchOffset];
-	ForwardChunkPtr = &HistoryBuffer[ChunkOffset];
-
 	if ((&MatchBuffer[MaxMatchLength + 1] < HistoryBufferEnd)
 		&& (MatchBuffer[MaxMatchLength + 1] != ChunkBuffer[MaxMatchLength + 1]))
 	{
 		return 0;
 	}
 
-	while (1)
+	if (MatchBuffer < HistoryBufferEnd)
 	{
-		MatchSymbol = *ForwardMatchPtr++;
-		ChunkSymbol = *ForwardChunkPtr++;
-
-		if (MatchSymbol != ChunkSymbol)
-			break;
-
-		if (ForwardMatchPtr > HistoryBufferEnd)
-			break;
-			
-		ForwardMatchLength++;
+		ForwardMatchLength = xcrush_forward_match_length(MatchBuffer, ChunkBuffer,
+				HistoryBufferEnd - MatchBuffer, HistoryBufferSize - ChunkOffset);
 	}
 
-	ReverseMatchPtr = MatchBuffer - 1;
-	ReverseChunkPtr = ChunkBuffer - 1;
+	/* the reverse match stops before &HistoryBuffer[HistoryOffset] and HistoryBuffer */
 
-	while((ReverseMatchPtr > &HistoryBuffer[HistoryOffset])
-		&& (ReverseChunkPtr > HistoryBuffer)
-		&& (*ReverseMatchPtr == *ReverseChunkPtr))
+	if ((MatchOffset > HistoryOffset + 1) && (ChunkOffset > 1))
 	{
-		ReverseMatchLength++;
-		ReverseMatchPtr--;
-		ReverseChunkPtr--;
+		ReverseMatchLimit = MatchOffset - HistoryOffset - 1;
+
+		if (ReverseMatchLimit > ChunkOffset - 1)
+			ReverseMatchLimit = ChunkOffset - 1;
+
+		ReverseMatchLength = xcrush_reverse_match_length(MatchBuffer, ChunkBuffer, ReverseMatchLimit);
 	}
 
 	MatchStartPtr = MatchBuffer - ReverseMatchLength;
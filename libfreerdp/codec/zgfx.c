@@ -23,6 +23,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/stream.h>
 #include <winpr/bitstream.h>
 
 #include <freerdp/codec/zgfx.h>
@@ -379,14 +380,468 @@ int zgfx_decompress(ZGFX_CONTEXT* zgfx, BYTE* pSrcData, UINT32 SrcSize, BYTE** p
 	return 1;
 }
 
+/**
+ * Compressor
+ *
+ * The compressor keeps the history as a linear window rather than a ring:
+ * it only has to produce the same distances as the decoder, and a linear
+ * window lets matches be compared with plain memory accesses. When the
+ * window is full, its older half is discarded.
+ *
+ * Matches are found through hash chains over 3-byte prefixes, the
+ * compression level bounds the number of chain entries searched.
+ */
+
+#define ZGFX_HASH_BITS		17
+#define ZGFX_HASH_SIZE		(1 << ZGFX_HASH_BITS)
+#define ZGFX_MIN_MATCH		3
+
+#define zgfx_hash(_p) \
+	(((((UINT32) (_p)[0]) << 16) | (((UINT32) (_p)[1]) << 8) | ((UINT32) (_p)[2])) * 2654435761U >> (32 - ZGFX_HASH_BITS))
+
+static BOOL zgfx_write_bits(ZGFX_CONTEXT* zgfx, UINT32 bits, UINT32 nbits)
+{
+	zgfx->BitsCurrent = (zgfx->BitsCurrent << nbits) | bits;
+	zgfx->cBitsCurrent += nbits;
+
+	while (zgfx->cBitsCurrent >= 8)
+	{
+		if (zgfx->pbOutputCurrent >= zgfx->pbOutputEnd)
+			return FALSE;
+
+		zgfx->cBitsCurrent -= 8;
+		*zgfx->pbOutputCurrent++ = (BYTE) (zgfx->BitsCurrent >> zgfx->cBitsCurrent);
+	}
+
+	zgfx->BitsCurrent &= ((1 << zgfx->cBitsCurrent) - 1);
+
+	return TRUE;
+}
+
+static const ZGFX_TOKEN* zgfx_match_token(UINT32 distance)
+{
+	int opIndex;
+	const ZGFX_TOKEN* token = NULL;
+
+	for (opIndex = 0; ZGFX_TOKEN_TABLE[opIndex].prefixLength != 0; opIndex++)
+	{
+		if (ZGFX_TOKEN_TABLE[opIndex].tokenType != 1)
+			continue;
+
+		if (ZGFX_TOKEN_TABLE[opIndex].valueBase > distance)
+			break;
+
+		token = &ZGFX_TOKEN_TABLE[opIndex];
+	}
+
+	return token;
+}
+
+static UINT32 zgfx_match_length_bits(UINT32 count)
+{
+	UINT32 extra = 2;
+
+	if (count == 3)
+		return 1;
+
+	while (count >= (UINT32) (8 << (extra - 2)))
+		extra++;
+
+	return extra * 2;
+}
+
+static BOOL zgfx_write_match(ZGFX_CONTEXT* zgfx, UINT32 distance, UINT32 count)
+{
+	UINT32 base;
+	UINT32 extra;
+	const ZGFX_TOKEN* token = zgfx_match_token(distance);
+
+	if (!zgfx_write_bits(zgfx, token->prefixCode, token->prefixLength))
+		return FALSE;
+
+	if (!zgfx_write_bits(zgfx, distance - token->valueBase, token->valueBits))
+		return FALSE;
+
+	if (count == 3)
+		return zgfx_write_bits(zgfx, 0, 1);
+
+	/* '1', one more '1' for each doubling of the base length, '0', then the remainder */
+
+	base = 4;
+	extra = 2;
+
+	while (count >= (base * 2))
+	{
+		base *= 2;
+		extra++;
+	}
+
+	if (!zgfx_write_bits(zgfx, ((1 << (extra - 1)) - 1) << 1, extra))
+		return FALSE;
+
+	return zgfx_write_bits(zgfx, count - base, extra);
+}
+
+static UINT32 zgfx_literal_cost(ZGFX_CONTEXT* zgfx, const BYTE* src, UINT32 count)
+{
+	UINT32 index;
+	UINT32 cost = 0;
+
+	for (index = 0; index < count; index++)
+		cost += zgfx->LiteralBits[src[index]];
+
+	return cost;
+}
+
+static void zgfx_history_slide(ZGFX_CONTEXT* zgfx)
+{
+	UINT32 index;
+	UINT32 shift;
+	UINT32 keep;
+	UINT32* table;
+
+	keep = zgfx->HistoryBufferSize / 2;
+
+	if (zgfx->HistoryIndex <= keep)
+		return;
+
+	shift = zgfx->HistoryIndex - keep;
+
+	MoveMemory(zgfx->HistoryBuffer, &zgfx->HistoryBuffer[shift], keep);
+	MoveMemory(zgfx->MatchChainTable, &zgfx->MatchChainTable[shift], keep * sizeof(UINT32));
+
+	/* positions are stored plus one, zero marks an empty slot */
+
+	table = zgfx->MatchHashTable;
+
+	for (index = 0; index < ZGFX_HASH_SIZE; index++)
+		table[index] = (table[index] > shift) ? table[index] - shift : 0;
+
+	table = zgfx->MatchChainTable;
+
+	for (index = 0; index < keep; index++)
+		table[index] = (table[index] > shift) ? table[index] - shift : 0;
+
+	zgfx->HistoryIndex = keep;
+}
+
+/**
+ * Per-level match finder settings, in the spirit of zlib's configuration
+ * table: how many chain entries are searched, which match length is good
+ * enough to stop searching, below which length the next position is tried
+ * (lazy matching), and up to which length the positions inside a match are
+ * added to the hash chains. Lower levels must never be slower than higher
+ * ones, so all four knobs grow together.
+ */
+
+struct _ZGFX_LEVEL
+{
+	UINT16 maxChain;
+	UINT16 niceLength;
+	UINT16 lazyLength;
+	UINT16 insertLength;
+};
+typedef struct _ZGFX_LEVEL ZGFX_LEVEL;
+
+static const ZGFX_LEVEL ZGFX_LEVEL_TABLE[ZGFX_COMPRESSION_LEVEL_BEST + 1] =
+{
+	{ 0, 0, 0, 0 }, /* 0: stored */
+	{ 2, 16, 0, 4 }, /* 1 */
+	{ 2, 32, 0, 4 }, /* 2 */
+	{ 4, 32, 0, 16 }, /* 3 */
+	{ 8, 64, 0, 16 }, /* 4 */
+	{ 8, 128, 8, 32 }, /* 5 */
+	{ 16, 256, 16, 64 }, /* 6 */
+	{ 32, 512, 32, 128 }, /* 7 */
+	{ 128, 2048, 64, 0xFFFF }, /* 8 */
+	{ 1024, 0xFFFF, 256, 0xFFFF } /* 9 */
+};
+
+static void zgfx_match_insert(ZGFX_CONTEXT* zgfx, UINT32 position)
+{
+	UINT32 hash = zgfx_hash(&zgfx->HistoryBuffer[position]);
+
+	zgfx->MatchChainTable[position] = zgfx->MatchHashTable[hash];
+	zgfx->MatchHashTable[hash] = position + 1;
+}
+
+static UINT32 zgfx_match_find(ZGFX_CONTEXT* zgfx, UINT32 position, UINT32 end, UINT32* pDistance)
+{
+	UINT32 depth;
+	UINT32 length;
+	UINT32 maxLength;
+	UINT32 niceLength;
+	UINT32 candidate;
+	UINT32 bestLength = 0;
+	const BYTE* history = zgfx->HistoryBuffer;
+	const BYTE* current = &history[position];
+	const BYTE* match;
+	const ZGFX_LEVEL* level = &ZGFX_LEVEL_TABLE[zgfx->CompressionLevel];
+
+	maxLength = end - position;
+	niceLength = MIN(level->niceLength, maxLength);
+	depth = level->maxChain;
+	candidate = zgfx->MatchHashTable[zgfx_hash(current)];
+
+	while (candidate && depth--)
+	{
+		match = &history[candidate - 1];
+
+		if ((match[bestLength] == current[bestLength]) && (match[0] == current[0]) &&
+				(match[1] == current[1]) && (match[2] == current[2]))
+		{
+			length = ZGFX_MIN_MATCH;
+
+			while ((length < maxLength) && (match[length] == current[length]))
+				length++;
+
+			if (length > bestLength)
+			{
+				bestLength = length;
+				*pDistance = position - (candidate - 1);
+
+				if (length >= niceLength)
+					break;
+			}
+		}
+
+		candidate = zgfx->MatchChainTable[candidate - 1];
+	}
+
+	return bestLength;
+}
+
+static int zgfx_compress_segment(ZGFX_CONTEXT* zgfx, BYTE* pSrcData, UINT32 SrcSize, BYTE* pDstData)
+{
+	UINT32 end;
+	UINT32 index;
+	UINT32 position;
+	UINT32 length;
+	UINT32 distance = 0;
+	UINT32 nextLength;
+	UINT32 nextDistance = 0;
+	UINT32 matchCost;
+	const ZGFX_TOKEN* token;
+	const ZGFX_LEVEL* level;
+	BYTE c;
+
+	if ((zgfx->HistoryIndex + SrcSize) > zgfx->HistoryBufferSize)
+		zgfx_history_slide(zgfx);
+
+	position = zgfx->HistoryIndex;
+	end = position + SrcSize;
+
+	CopyMemory(&zgfx->HistoryBuffer[position], pSrcData, SrcSize);
+	zgfx->HistoryIndex = end;
+
+	if (zgfx->CompressionLevel == ZGFX_COMPRESSION_LEVEL_NONE)
+		goto uncompressed;
+
+	level = &ZGFX_LEVEL_TABLE[zgfx->CompressionLevel];
+
+	/* anything larger than the uncompressed segment is discarded */
+
+	zgfx->pbOutputCurrent = pDstData + 1;
+	zgfx->pbOutputEnd = pDstData + SrcSize;
+	zgfx->BitsCurrent = 0;
+	zgfx->cBitsCurrent = 0;
+
+	while (position < end)
+	{
+		length = 0;
+
+		if ((end - position) >= ZGFX_MIN_MATCH)
+		{
+			length = zgfx_match_find(zgfx, position, end, &distance);
+			zgfx_match_insert(zgfx, position);
+
+			if (length >= ZGFX_MIN_MATCH)
+			{
+				token = zgfx_match_token(distance);
+				matchCost = token->prefixLength + token->valueBits + zgfx_match_length_bits(length);
+
+				if (matchCost >= zgfx_literal_cost(zgfx, &zgfx->HistoryBuffer[position], length))
+					length = 0;
+			}
+			else
+			{
+				length = 0;
+			}
+
+			/* lazy evaluation: prefer a literal if the next position has a longer match */
+
+			if (length && (length < level->lazyLength) && ((end - position - 1) >= ZGFX_MIN_MATCH))
+			{
+				nextLength = zgfx_match_find(zgfx, position + 1, end, &nextDistance);
+
+				if (nextLength > (length + 1))
+					length = 0;
+			}
+		}
+
+		if (length)
+		{
+			if (!zgfx_write_match(zgfx, distance, length))
+				goto uncompressed;
+
+			/* lower levels do not index the bytes within long matches */
+
+			if (length <= level->insertLength)
+			{
+				for (index = position + 1; (index < (position + length)) && ((end - index) >= ZGFX_MIN_MATCH); index++)
+					zgfx_match_insert(zgfx, index);
+			}
+
+			position += length;
+		}
+		else
+		{
+			c = zgfx->HistoryBuffer[position];
+
+			if (!zgfx_write_bits(zgfx, zgfx->LiteralCodes[c], zgfx->LiteralBits[c]))
+				goto uncompressed;
+
+			position++;
+		}
+	}
+
+	/* the last byte holds the number of unused bits in the byte before it */
+
+	length = zgfx->cBitsCurrent ? (8 - zgfx->cBitsCurrent) : 0;
+
+	if (length && !zgfx_write_bits(zgfx, 0, length))
+		goto uncompressed;
+
+	if (zgfx->pbOutputCurrent >= zgfx->pbOutputEnd)
+		goto uncompressed;
+
+	*zgfx->pbOutputCurrent++ = (BYTE) length;
+
+	pDstData[0] = PACKET_COMPR_TYPE_RDP8 | PACKET_COMPRESSED; /* header (1 byte) */
+
+	return (int) (zgfx->pbOutputCurrent - pDstData);
+
+uncompressed:
+	pDstData[0] = PACKET_COMPR_TYPE_RDP8; /* header (1 byte) */
+	CopyMemory(&pDstData[1], pSrcData, SrcSize);
+
+	return (int) (SrcSize + 1);
+}
+
 int zgfx_compress(ZGFX_CONTEXT* zgfx, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
 {
+	int status;
+	UINT32 offset;
+	UINT32 segmentSize;
+	UINT32 segmentCount;
+	BYTE* pDstData;
+	BYTE* pSegment;
+	wStream* s;
+	BOOL compressed = FALSE;
+
+	if (!zgfx->Compressor || !ppDstData || !pDstSize)
+		return -1;
+
+	segmentCount = (SrcSize + ZGFX_SEGMENTED_MAXSIZE - 1) / ZGFX_SEGMENTED_MAXSIZE;
+
+	if (segmentCount > 0xFFFF)
+		return -1;
+
+	pDstData = (BYTE*) malloc(SrcSize + (segmentCount * 5) + 8);
+
+	if (!pDstData)
+		return -1;
+
+	s = Stream_New(pDstData, SrcSize + (segmentCount * 5) + 8);
+
+	if (!s)
+	{
+		free(pDstData);
+		return -1;
+	}
+
+	if (segmentCount <= 1)
+	{
+		Stream_Write_UINT8(s, ZGFX_SEGMENTED_SINGLE); /* descriptor (1 byte) */
+
+		pSegment = Stream_Pointer(s);
+		status = zgfx_compress_segment(zgfx, pSrcData, SrcSize, pSegment);
+		compressed = (pSegment[0] & PACKET_COMPRESSED) ? TRUE : FALSE;
+
+		Stream_Seek(s, status);
+	}
+	else
+	{
+		Stream_Write_UINT8(s, ZGFX_SEGMENTED_MULTIPART); /* descriptor (1 byte) */
+		Stream_Write_UINT16(s, (UINT16) segmentCount); /* segmentCount (2 bytes) */
+		Stream_Write_UINT32(s, SrcSize); /* uncompressedSize (4 bytes) */
+
+		for (offset = 0; offset < SrcSize; offset += segmentSize)
+		{
+			segmentSize = MIN(SrcSize - offset, ZGFX_SEGMENTED_MAXSIZE);
+
+			pSegment = Stream_Pointer(s) + 4;
+			status = zgfx_compress_segment(zgfx, &pSrcData[offset], segmentSize, pSegment);
+
+			if (pSegment[0] & PACKET_COMPRESSED)
+				compressed = TRUE;
+
+			Stream_Write_UINT32(s, (UINT32) status); /* segmentSize (4 bytes) */
+			Stream_Seek(s, status);
+		}
+	}
+
+	*pDstSize = (UINT32) Stream_GetPosition(s);
+	Stream_Free(s, FALSE);
+
+	*ppDstData = pDstData;
+
+	if (pFlags)
+		*pFlags = compressed ? PACKET_COMPRESSED : 0;
+
 	return 1;
 }
 
+void zgfx_set_compression_level(ZGFX_CONTEXT* zgfx, DWORD CompressionLevel)
+{
+	zgfx->CompressionLevel = MIN(CompressionLevel, ZGFX_COMPRESSION_LEVEL_BEST);
+}
+
 void zgfx_context_reset(ZGFX_CONTEXT* zgfx, BOOL flush)
 {
 	zgfx->HistoryIndex = 0;
+
+	if (zgfx->MatchHashTable)
+		ZeroMemory(zgfx->MatchHashTable, ZGFX_HASH_SIZE * sizeof(UINT32));
+}
+
+static void zgfx_init_literals(ZGFX_CONTEXT* zgfx)
+{
+	int opIndex;
+	UINT32 c;
+	const ZGFX_TOKEN* token;
+
+	/* every byte has a 9-bit code, some have shorter ones */
+
+	for (c = 0; c < 256; c++)
+	{
+		zgfx->LiteralBits[c] = 9;
+		zgfx->LiteralCodes[c] = (UINT16) c;
+	}
+
+	for (opIndex = 0; ZGFX_TOKEN_TABLE[opIndex].prefixLength != 0; opIndex++)
+	{
+		token = &ZGFX_TOKEN_TABLE[opIndex];
+
+		if ((token->tokenType != 0) || (token->valueBits != 0))
+			continue;
+
+		if (token->prefixLength < zgfx->LiteralBits[token->valueBase])
+		{
+			zgfx->LiteralBits[token->valueBase] = (BYTE) token->prefixLength;
+			zgfx->LiteralCodes[token->valueBase] = (UINT16) token->prefixCode;
+		}
+	}
 }
 
 ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
@@ -401,6 +856,22 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 
 		zgfx->HistoryBufferSize = sizeof(zgfx->HistoryBuffer);
 
+		if (Compressor)
+		{
+			zgfx->CompressionLevel = ZGFX_COMPRESSION_LEVEL_DEFAULT;
+
+			zgfx->MatchHashTable = (UINT32*) calloc(ZGFX_HASH_SIZE, sizeof(UINT32));
+			zgfx->MatchChainTable = (UINT32*) calloc(zgfx->HistoryBufferSize, sizeof(UINT32));
+
+			if (!zgfx->MatchHashTable || !zgfx->MatchChainTable)
+			{
+				zgfx_context_free(zgfx);
+				return NULL;
+			}
+
+			zgfx_init_literals(zgfx);
+		}
+
 		zgfx_context_reset(zgfx, FALSE);
 	}
 
@@ -411,6 +882,8 @@ void zgfx_context_free(ZGFX_CONTEXT* zgfx)
 {
 	if (zgfx)
 	{
+		free(zgfx->MatchHashTable);
+		free(zgfx->MatchChainTable);
 		free(zgfx);
 	}
 }
@@ -1707,6 +1707,9 @@ UINT32 freerdp_get_param_uint32(rdpSettings* settings, int id)
 		case FreeRDP_PercentScreen:
 			return settings->PercentScreen;
 
+		case FreeRDP_MetricsDumpInterval:
+			return settings->MetricsDumpInterval;
+
 		case FreeRDP_GatewayUsageMethod:
 			return settings->GatewayUsageMethod;
 
@@ -1792,6 +1795,9 @@ UINT32 freerdp_get_param_uint32(rdpSettings* settings, int id)
 		case FreeRDP_RemoteFxCodecMode:
 			return settings->RemoteFxCodecMode;
 
+		case FreeRDP_RemoteFxRlgrMode:
+			return settings->RemoteFxRlgrMode;
+
 		case FreeRDP_NSCodecId:
 			return settings->NSCodecId;
 
@@ -1992,6 +1998,10 @@ int freerdp_set_param_uint32(rdpSettings* settings, int id, UINT32 param)
 			settings->PercentScreen = param;
 			break;
 
+		case FreeRDP_MetricsDumpInterval:
+			settings->MetricsDumpInterval = param;
+			break;
+
 		case FreeRDP_GatewayUsageMethod:
 			settings->GatewayUsageMethod = param;
 			break;
@@ -2104,6 +2114,10 @@ int freerdp_set_param_uint32(rdpSettings* settings, int id, UINT32 param)
 			settings->RemoteFxCodecMode = param;
 			break;
 
+		case FreeRDP_RemoteFxRlgrMode:
+			settings->RemoteFxRlgrMode = param;
+			break;
+
 		case FreeRDP_NSCodecId:
 			settings->NSCodecId = param;
 			break;
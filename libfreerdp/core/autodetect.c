@@ -322,6 +322,8 @@ static BOOL autodetect_recv_rtt_measure_response(rdpRdp* rdp, wStream* s, AUTODE
 	if (rdp->autodetect->netCharBaseRTT == 0 || rdp->autodetect->netCharBaseRTT > rdp->autodetect->netCharAverageRTT)
 		rdp->autodetect->netCharBaseRTT = rdp->autodetect->netCharAverageRTT;
 
+	metrics_round_trip_time(rdp->context->metrics, rdp->autodetect->netCharAverageRTT);
+
 	IFCALLRET(rdp->autodetect->RTTMeasureResponse, success, rdp->context, autodetectRspPdu->sequenceNumber);
 
 	return success;
@@ -425,6 +427,8 @@ static BOOL autodetect_recv_bandwidth_measure_results(rdpRdp* rdp, wStream* s, A
 	else
 		rdp->autodetect->netCharBandwidth = 0;
 
+	metrics_bandwidth(rdp->context->metrics, rdp->autodetect->netCharBandwidth);
+
 	IFCALLRET(rdp->autodetect->BandwidthMeasureResults, success, rdp->context, autodetectRspPdu->sequenceNumber);
 
 	return success;
@@ -462,6 +466,13 @@ static BOOL autodetect_recv_netchar_result(rdpRdp* rdp, wStream* s, AUTODETECT_R
 		break;
 	}
 
+	/* the client learns about the network from the measurements of the server */
+
+	metrics_round_trip_time(rdp->context->metrics, rdp->autodetect->netCharAverageRTT);
+
+	if (autodetectReqPdu->requestType != 0x0840)
+		metrics_bandwidth(rdp->context->metrics, rdp->autodetect->netCharBandwidth);
+
 	WLog_DBG(AUTODETECT_TAG, "received Network Characteristics Result PDU -> baseRTT=%u, bandwidth=%u, averageRTT=%u", rdp->autodetect->netCharBaseRTT, rdp->autodetect->netCharBandwidth, rdp->autodetect->netCharAverageRTT);
 
 	IFCALLRET(rdp->autodetect->NetworkCharacteristicsResult, success, rdp->context, autodetectReqPdu->sequenceNumber);
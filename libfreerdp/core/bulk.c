@@ -21,6 +21,8 @@
 #include "config.h"
 #endif
 
+#include <winpr/sysinfo.h>
+
 #include "bulk.h"
 
 #define TAG "com.freerdp.core"
@@ -175,9 +177,11 @@ int bulk_decompress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstD
 	return status;
 }
 
-int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
+static int bulk_compress_buffer(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE* pOutput, UINT32 OutputSize,
+		BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
 {
 	int status = -1;
+	UINT64 begin;
 	rdpMetrics* metrics;
 	UINT32 CompressedBytes;
 	UINT32 UncompressedBytes;
@@ -191,10 +195,11 @@ int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstDat
 		return 0;
 	}
 
-	*ppDstData = bulk->OutputBuffer;
-	*pDstSize = sizeof(bulk->OutputBuffer);
+	*ppDstData = pOutput;
+	*pDstSize = OutputSize;
 	bulk_compression_level(bulk);
 	bulk_compression_max_size(bulk);
+	begin = metrics_get_timestamp();
 
 	if ((bulk->CompressionLevel == PACKET_COMPR_TYPE_8K) ||
 			(bulk->CompressionLevel == PACKET_COMPR_TYPE_64K))
@@ -215,6 +220,8 @@ int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstDat
 		status = -1;
 	}
 
+	metrics_add(&metrics->TotalCompressionTime, metrics_get_timestamp() - begin);
+
 	if (status >= 0)
 	{
 		CompressedBytes = *pDstSize;
@@ -240,6 +247,105 @@ int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstDat
 	return status;
 }
 
+int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
+{
+	return bulk_compress_buffer(bulk, pSrcData, SrcSize, bulk->OutputBuffer, sizeof(bulk->OutputBuffer),
+			ppDstData, pDstSize, pFlags);
+}
+
+/**
+ * Pipelined compression: bulk_compress_submit() hands the next fragment to a
+ * worker of the default thread pool, which every session shares, while the
+ * caller is still writing out the previous one. Each session keeps its own
+ * compression history and never has more than one fragment in flight, so the
+ * output is the same as with bulk_compress(). The two output buffers alternate,
+ * so the result of bulk_compress_wait() stays valid until the next one.
+ */
+
+static void CALLBACK bulk_compress_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	rdpBulk* bulk = (rdpBulk*) context;
+
+	bulk->PipelineStatus = bulk_compress_buffer(bulk, bulk->PipelineSrcData, bulk->PipelineSrcSize,
+			bulk->PipelineOutput, sizeof(bulk->OutputBuffer),
+			&bulk->PipelineDstData, &bulk->PipelineDstSize, &bulk->PipelineFlags);
+
+	InterlockedDecrement(&bulk->context->metrics->CompressionQueueDepth);
+}
+
+BOOL bulk_compress_submit(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize)
+{
+	bulk->PipelineSrcData = pSrcData;
+	bulk->PipelineSrcSize = SrcSize;
+	bulk->PipelineOutput = (bulk->PipelineOutput == bulk->OutputBuffer) ?
+			bulk->PipelineBuffer : bulk->OutputBuffer;
+
+	/* what the fragment goes out as if the work never runs */
+	bulk->PipelineDstData = pSrcData;
+	bulk->PipelineDstSize = SrcSize;
+	bulk->PipelineFlags = 0;
+	bulk->PipelineStatus = -1;
+
+	InterlockedIncrement(&bulk->context->metrics->CompressionQueueDepth);
+
+	if (!bulk->CompressWork)
+		return TRUE;
+
+	SubmitThreadpoolWork(bulk->CompressWork);
+	bulk->PipelinePending = TRUE;
+
+	return TRUE;
+}
+
+int bulk_compress_wait(rdpBulk* bulk, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags)
+{
+	UINT64 begin;
+
+	if (!bulk->PipelinePending)
+	{
+		bulk_compress_work_callback(NULL, bulk, NULL);
+	}
+	else
+	{
+		begin = metrics_get_timestamp();
+		WaitForThreadpoolWorkCallbacks(bulk->CompressWork, FALSE);
+		metrics_add(&bulk->context->metrics->TotalCompressionWaitTime, metrics_get_timestamp() - begin);
+		bulk->PipelinePending = FALSE;
+	}
+
+	*ppDstData = bulk->PipelineDstData;
+	*pDstSize = bulk->PipelineDstSize;
+	*pFlags = bulk->PipelineFlags;
+
+	return bulk->PipelineStatus;
+}
+
+/**
+ * Turns the pipeline on or off, without it bulk_compress_wait() compresses
+ * inline. Must not be called with a fragment in flight.
+ */
+
+BOOL bulk_set_pipeline(rdpBulk* bulk, BOOL enabled)
+{
+	if (enabled && !bulk->CompressWork)
+	{
+		bulk->CompressWork = CreateThreadpoolWork((PTP_WORK_CALLBACK) bulk_compress_work_callback,
+				(void*) bulk, NULL);
+
+		return (bulk->CompressWork) ? TRUE : FALSE;
+	}
+
+	if (!enabled && bulk->CompressWork)
+	{
+		WaitForThreadpoolWorkCallbacks(bulk->CompressWork, FALSE);
+		CloseThreadpoolWork(bulk->CompressWork);
+		bulk->CompressWork = NULL;
+		bulk->PipelinePending = FALSE;
+	}
+
+	return TRUE;
+}
+
 void bulk_reset(rdpBulk* bulk)
 {
 	mppc_context_reset(bulk->mppcSend, FALSE);
@@ -253,6 +359,7 @@ void bulk_reset(rdpBulk* bulk)
 rdpBulk* bulk_new(rdpContext* context)
 {
 	rdpBulk* bulk;
+	SYSTEM_INFO sysinfo;
 	bulk = (rdpBulk*) calloc(1, sizeof(rdpBulk));
 
 	if (bulk)
@@ -265,6 +372,12 @@ rdpBulk* bulk_new(rdpContext* context)
 		bulk->xcrushRecv = xcrush_context_new(FALSE);
 		bulk->xcrushSend = xcrush_context_new(TRUE);
 		bulk->CompressionLevel = context->settings->CompressionLevel;
+		bulk->PipelineOutput = bulk->PipelineBuffer;
+
+		GetNativeSystemInfo(&sysinfo);
+
+		/* pipelining only pays off when a worker can run next to the session thread */
+		bulk_set_pipeline(bulk, (sysinfo.dwNumberOfProcessors > 1) ? TRUE : FALSE);
 	}
 
 	return bulk;
@@ -275,6 +388,8 @@ void bulk_free(rdpBulk* bulk)
 	if (!bulk)
 		return;
 
+	bulk_set_pipeline(bulk, FALSE);
+
 	mppc_context_free(bulk->mppcSend);
 	mppc_context_free(bulk->mppcRecv);
 	ncrush_context_free(bulk->ncrushRecv);
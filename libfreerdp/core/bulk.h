@@ -28,6 +28,8 @@ typedef struct rdp_bulk rdpBulk;
 #include <freerdp/codec/ncrush.h>
 #include <freerdp/codec/xcrush.h>
 
+#include <winpr/pool.h>
+
 struct rdp_bulk
 {
 	rdpContext* context;
@@ -40,6 +42,17 @@ struct rdp_bulk
 	XCRUSH_CONTEXT* xcrushRecv;
 	XCRUSH_CONTEXT* xcrushSend;
 	BYTE OutputBuffer[65536];
+
+	PTP_WORK CompressWork;
+	BOOL PipelinePending;
+	BYTE* PipelineSrcData;
+	UINT32 PipelineSrcSize;
+	BYTE* PipelineDstData;
+	UINT32 PipelineDstSize;
+	UINT32 PipelineFlags;
+	int PipelineStatus;
+	BYTE* PipelineOutput;
+	BYTE PipelineBuffer[65536];
 };
 
 #define BULK_COMPRESSION_FLAGS_MASK	0xE0
@@ -51,6 +64,10 @@ UINT32 bulk_compression_max_size(rdpBulk* bulk);
 int bulk_decompress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32 flags);
 int bulk_compress(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags);
 
+BOOL bulk_compress_submit(rdpBulk* bulk, BYTE* pSrcData, UINT32 SrcSize);
+int bulk_compress_wait(rdpBulk* bulk, BYTE** ppDstData, UINT32* pDstSize, UINT32* pFlags);
+BOOL bulk_set_pipeline(rdpBulk* bulk, BOOL enabled);
+
 void bulk_reset(rdpBulk* bulk);
 
 rdpBulk* bulk_new(rdpContext* context);
@@ -28,6 +28,7 @@
 #include <winpr/rpc.h>
 
 #include <freerdp/log.h>
+#include <freerdp/codec/rfx.h>
 
 #define TAG FREERDP_TAG("core.capabilities")
 
@@ -2624,6 +2625,8 @@ BOOL rdp_read_bitmap_codecs_capability_set(wStream* s, UINT16 length, rdpSetting
 					UINT16 capsetType;
 					UINT16 numIcaps;
 					UINT16 icapLen;
+					BOOL rlgr1 = FALSE;
+					BOOL rlgr3 = FALSE;
 
 					/* TS_RFX_CAPS */
 
@@ -2687,7 +2690,18 @@ BOOL rdp_read_bitmap_codecs_capability_set(wStream* s, UINT16 length, rdpSetting
 
 						if (transformBits != 1)
 							return FALSE;
+
+						if (entropyBits == CLW_ENTROPY_RLGR1)
+							rlgr1 = TRUE;
+						else if (entropyBits == CLW_ENTROPY_RLGR3)
+							rlgr3 = TRUE;
 					}
+
+					/* encode with RLGR3 unless the client only accepts RLGR1 */
+					if (rlgr1 && !rlgr3)
+						settings->RemoteFxRlgrMode = RLGR1;
+					else
+						settings->RemoteFxRlgrMode = RLGR3;
 				}
 			}
 			else if (UuidEqual(&codecGuid, &CODEC_GUID_IMAGE_REMOTEFX, &rpc_status))
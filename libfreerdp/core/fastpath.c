@@ -363,6 +363,8 @@ static int fastpath_recv_update_data(rdpFastPath* fastpath, wStream* s)
 
 	fastpath_read_update_header(s, &updateCode, &fragmentation, &compression);
 
+	metrics_fastpath_read(rdp->context->metrics, fragmentation);
+
 	if (compression == FASTPATH_OUTPUT_COMPRESSION_USED)
 		Stream_Read_UINT8(s, compressionFlags);
 	else
@@ -843,6 +845,8 @@ BOOL fastpath_send_multiple_input_pdu(rdpFastPath* fastpath, wStream* s, int iNu
 	if (transport_write(fastpath->rdp->transport, s) < 0)
 		return FALSE;
 
+	metrics_channel_write(fastpath->rdp->context->metrics, MCS_GLOBAL_CHANNEL_ID, length);
+
 	return TRUE;
 }
 
@@ -855,6 +859,7 @@ wStream* fastpath_update_pdu_init(rdpFastPath* fastpath)
 {
 	wStream* s;
 	s = transport_send_stream_init(fastpath->rdp->transport, FASTPATH_MAX_PACKET_SIZE);
+	Stream_Seek(s, FASTPATH_UPDATE_HEADROOM);
 	return s;
 }
 
@@ -862,6 +867,10 @@ wStream* fastpath_update_pdu_init_new(rdpFastPath* fastpath)
 {
 	wStream* s;
 	s = Stream_New(NULL, FASTPATH_MAX_PACKET_SIZE);
+
+	if (s)
+		Stream_Seek(s, FASTPATH_UPDATE_HEADROOM);
+
 	return s;
 }
 
@@ -878,6 +887,13 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 	UINT32 fpUpdatePduHeaderSize;
 	UINT32 fpUpdateHeaderSize;
 	UINT32 CompressionMaxSize;
+	UINT32 wireLength = 0;
+	BOOL gather;
+	BOOL compress;
+	wStream view;
+	wStream* out;
+	int nchunks = 0;
+	DataChunk chunks[FASTPATH_MAX_CHUNKS];
 	FASTPATH_UPDATE_PDU_HEADER fpUpdatePduHeader = { 0 };
 	FASTPATH_UPDATE_HEADER fpUpdateHeader = { 0 };
 
@@ -885,16 +901,17 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 	settings = rdp->settings;
 
 	maxLength = FASTPATH_MAX_PACKET_SIZE - 20;
+	compress = settings->CompressionEnabled && !skipCompression;
 
-	if (settings->CompressionEnabled && !skipCompression)
+	if (compress)
 	{
 		CompressionMaxSize = bulk_compression_max_size(rdp->bulk);
 		maxLength = (maxLength < CompressionMaxSize) ? maxLength : CompressionMaxSize;
 		maxLength -= 20;
 	}
 
-	totalLength = Stream_GetPosition(s);
-	Stream_SetPosition(s, 0);
+	totalLength = Stream_GetPosition(s) - FASTPATH_UPDATE_HEADROOM;
+	Stream_SetPosition(s, FASTPATH_UPDATE_HEADROOM);
 
 	/**
 	 * TEMPORARY FIX
@@ -929,6 +946,18 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 			rdp->sec_flags |= SEC_SECURE_CHECKSUM;
 	}
 
+	/**
+	 * On a plain TCP transport without standard RDP security the fragments are
+	 * not touched after framing: only their headers are written to fs and the
+	 * whole update is handed to transport_writev() at once, with the payload
+	 * taken straight from s. Otherwise every fragment is framed in place.
+	 */
+	gather = !(rdp->sec_flags & SEC_ENCRYPT) && (rdp->transport->layer == TRANSPORT_LAYER_TCP);
+	Stream_SetPosition(fs, 0);
+
+	if (compress)
+		bulk_compress_submit(rdp->bulk, Stream_Pointer(s), (totalLength > maxLength) ? maxLength : totalLength);
+
 	for (fragment = 0; (totalLength > 0) || (fragment == 0); fragment++)
 	{
 		BYTE* pSrcData;
@@ -955,9 +984,18 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		if (rdp->sec_flags & SEC_SECURE_CHECKSUM)
 			fpUpdatePduHeader.secFlags |= FASTPATH_OUTPUT_SECURE_CHECKSUM;
 
-		if (settings->CompressionEnabled && !skipCompression)
+		if (compress)
 		{
-			if (bulk_compress(rdp->bulk, pSrcData, SrcSize, &pDstData, &DstSize, &compressionFlags) >= 0)
+			int compressStatus = bulk_compress_wait(rdp->bulk, &pDstData, &DstSize, &compressionFlags);
+
+			/* compress the next fragment while this one is being written */
+			if (totalLength > SrcSize)
+			{
+				bulk_compress_submit(rdp->bulk, pSrcData + SrcSize,
+						((totalLength - SrcSize) > maxLength) ? maxLength : (totalLength - SrcSize));
+			}
+
+			if (compressStatus >= 0)
 			{
 				if (compressionFlags)
 				{
@@ -987,12 +1025,8 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 
 		if (rdp->sec_flags & SEC_ENCRYPT)
 		{
-			pSignature = Stream_Buffer(fs) + 3;
-
 			if (rdp->settings->EncryptionMethods == ENCRYPTION_METHOD_FIPS)
 			{
-				pSignature += 4;
-
 				if ((pad = 8 - ((DstSize + fpUpdateHeaderSize) % 8)) == 8)
 					pad = 0;
 
@@ -1004,11 +1038,73 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		}
 
 		fpUpdatePduHeader.length = fpUpdateHeader.size + fpHeaderSize + pad;
+		wireLength += fpUpdatePduHeader.length;
+
+		if (gather)
+		{
+			/* compressed data lives in the bulk output buffer, which the next fragment reuses */
+			UINT32 fsSize = fpHeaderSize + (fpUpdateHeader.compression ? DstSize : 0);
+
+			if ((nchunks + 2 > FASTPATH_MAX_CHUNKS) || (Stream_Capacity(fs) - Stream_GetPosition(fs) < fsSize))
+			{
+				if (transport_writev(rdp->transport, chunks, nchunks) < 0)
+				{
+					status = FALSE;
+					break;
+				}
+
+				nchunks = 0;
+				Stream_SetPosition(fs, 0);
+			}
+
+			chunks[nchunks].data = Stream_Pointer(fs);
+			chunks[nchunks].size = fsSize;
+			nchunks++;
+
+			fastpath_write_update_pdu_header(fs, &fpUpdatePduHeader, rdp);
+			fastpath_write_update_header(fs, &fpUpdateHeader);
+
+			if (fpUpdateHeader.compression)
+			{
+				Stream_Write(fs, pDstData, DstSize);
+			}
+			else
+			{
+				chunks[nchunks].data = pDstData;
+				chunks[nchunks].size = DstSize;
+				nchunks++;
+			}
+
+			Stream_Seek(s, SrcSize);
+			continue;
+		}
 
-		Stream_SetPosition(fs, 0);
-		fastpath_write_update_pdu_header(fs, &fpUpdatePduHeader, rdp);
-		fastpath_write_update_header(fs, &fpUpdateHeader);
-		Stream_Write(fs, pDstData, DstSize);
+		if (!fpUpdateHeader.compression && !pad && (pDstData - Stream_Buffer(s) >= (int) fpHeaderSize))
+		{
+			/**
+			 * Frame the fragment in place, with its headers right in front of the
+			 * payload: in the headroom for the first fragment, over the tail of the
+			 * previous fragment, which has already been written, for the others.
+			 */
+			out = &view;
+			ZeroMemory(out, sizeof(wStream));
+			Stream_SetBuffer(out, pDstData - fpHeaderSize);
+			Stream_SetPointer(out, Stream_Buffer(out));
+			Stream_SetCapacity(out, fpHeaderSize + DstSize);
+		}
+		else
+		{
+			Stream_SetPosition(fs, 0);
+			out = fs;
+		}
+
+		fastpath_write_update_pdu_header(out, &fpUpdatePduHeader, rdp);
+		fastpath_write_update_header(out, &fpUpdateHeader);
+
+		if (out == fs)
+			Stream_Write(fs, pDstData, DstSize);
+		else
+			Stream_Seek(out, DstSize);
 
 		if (pad)
 			Stream_Zero(fs, pad);
@@ -1016,7 +1112,12 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		if (rdp->sec_flags & SEC_ENCRYPT)
 		{
 			UINT32 dataSize = fpUpdateHeaderSize + DstSize + pad;
-			BYTE *data = Stream_Pointer(fs) - dataSize;
+			BYTE *data = Stream_Pointer(out) - dataSize;
+
+			pSignature = Stream_Buffer(out) + 3;
+
+			if (rdp->settings->EncryptionMethods == ENCRYPTION_METHOD_FIPS)
+				pSignature += 4;
 
 			if (rdp->settings->EncryptionMethods == ENCRYPTION_METHOD_FIPS)
 			{
@@ -1034,9 +1135,9 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 			}
 		}
 
-		Stream_SealLength(fs);
+		Stream_SealLength(out);
 
-		if (transport_write(rdp->transport, fs) < 0)
+		if (transport_write(rdp->transport, out) < 0)
 		{
 			status = FALSE;
 			break;
@@ -1045,6 +1146,25 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		Stream_Seek(s, SrcSize);
 	}
 
+	if (status && nchunks && (transport_writev(rdp->transport, chunks, nchunks) < 0))
+		status = FALSE;
+
+	if (status)
+	{
+		metrics_fastpath_write(rdp->context->metrics, fragment);
+		metrics_channel_write(rdp->context->metrics, MCS_GLOBAL_CHANNEL_ID, wireLength);
+	}
+
+	/* a failed write can leave the next fragment in the pipeline, which still reads s */
+	if (compress && rdp->bulk->PipelinePending)
+	{
+		BYTE* pDstData;
+		UINT32 DstSize;
+		UINT32 compressionFlags;
+
+		bulk_compress_wait(rdp->bulk, &pDstData, &DstSize, &compressionFlags);
+	}
+
 	rdp->sec_flags = 0;
 
 	return status;
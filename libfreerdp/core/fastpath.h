@@ -27,6 +27,10 @@
  * fail if fast-path packages > 0x3FFF arrive.
  */
 #define FASTPATH_MAX_PACKET_SIZE 0x3FFF
+#define FASTPATH_MAX_CHUNKS 256
+
+/* room for the largest fast-path update PDU and update headers in front of an update */
+#define FASTPATH_UPDATE_HEADROOM 20
 
 /*
  *  The following size guarantees that no fast-path PDU fragmentation occurs.
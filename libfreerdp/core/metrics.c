@@ -21,14 +21,109 @@
 #include "config.h"
 #endif
 
+#include <time.h>
+
+#include <winpr/interlocked.h>
+
+#include <freerdp/log.h>
+
 #include "rdp.h"
 
+#define TAG FREERDP_TAG("core.metrics")
+
+/**
+ * Monotonic timestamp in microseconds, for the timing metrics.
+ */
+
+UINT64 metrics_get_timestamp(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count;
+	LARGE_INTEGER frequency;
+
+	if (!QueryPerformanceFrequency(&frequency) || !QueryPerformanceCounter(&count))
+		return 0;
+
+	return (UINT64) (((count.QuadPart / frequency.QuadPart) * 1000000) +
+			(((count.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart));
+#else
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (((UINT64) ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+#endif
+}
+
+/**
+ * The counters are plain 64-bit integers updated with compare-and-exchange,
+ * so that 32-bit builds never see torn values and no lock is ever taken.
+ */
+
+void metrics_add(UINT64* counter, UINT64 value)
+{
+	LONGLONG current;
+
+	do
+	{
+		current = *((volatile LONGLONG*) counter);
+	}
+	while (InterlockedCompareExchange64((LONGLONG*) counter, current + value, current) != current);
+}
+
+static UINT64 metrics_read(UINT64* counter)
+{
+	return (UINT64) InterlockedCompareExchange64((LONGLONG*) counter, 0, 0);
+}
+
+static UINT64 metrics_exchange(UINT64* counter, UINT64 value)
+{
+	LONGLONG current;
+
+	do
+	{
+		current = *((volatile LONGLONG*) counter);
+	}
+	while (InterlockedCompareExchange64((LONGLONG*) counter, value, current) != current);
+
+	return (UINT64) current;
+}
+
+static void metrics_max(UINT64* counter, UINT64 value)
+{
+	LONGLONG current;
+
+	do
+	{
+		current = *((volatile LONGLONG*) counter);
+
+		if ((UINT64) current >= value)
+			return;
+	}
+	while (InterlockedCompareExchange64((LONGLONG*) counter, value, current) != current);
+}
+
+static void metrics_min(UINT64* counter, UINT64 value)
+{
+	LONGLONG current;
+
+	do
+	{
+		current = *((volatile LONGLONG*) counter);
+
+		if (current && ((UINT64) current <= value))
+			return;
+	}
+	while (InterlockedCompareExchange64((LONGLONG*) counter, value, current) != current);
+}
+
 double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32 CompressedBytes)
 {
 	double CompressionRatio;
 
-	metrics->TotalUncompressedBytes += UncompressedBytes;
-	metrics->TotalCompressedBytes += CompressedBytes;
+	metrics_add(&metrics->TotalUncompressedBytes, UncompressedBytes);
+	metrics_add(&metrics->TotalCompressedBytes, CompressedBytes);
 
 	CompressionRatio = ((double) CompressedBytes) / ((double) UncompressedBytes);
 	metrics->TotalCompressionRatio = ((double) metrics->TotalCompressedBytes) / ((double) metrics->TotalUncompressedBytes);
@@ -36,6 +131,312 @@ double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32
 	return CompressionRatio;
 }
 
+static RDP_METRICS_CHANNEL* metrics_get_channel(rdpMetrics* metrics, UINT16 channelId)
+{
+	UINT32 index = METRICS_CHANNEL_COUNT - 1;
+	RDP_METRICS_CHANNEL* channel;
+
+	if ((channelId >= MCS_GLOBAL_CHANNEL_ID) && (channelId - MCS_GLOBAL_CHANNEL_ID < METRICS_CHANNEL_COUNT - 1))
+		index = channelId - MCS_GLOBAL_CHANNEL_ID;
+
+	channel = &metrics->Channels[index];
+
+	/* the last slot keeps METRICS_CHANNEL_ID_OTHER, set by metrics_new() */
+	if (index != METRICS_CHANNEL_COUNT - 1)
+		InterlockedCompareExchange64((LONGLONG*) &channel->ChannelId, channelId, 0);
+
+	return channel;
+}
+
+void metrics_channel_read(rdpMetrics* metrics, UINT16 channelId, UINT32 length)
+{
+	RDP_METRICS_CHANNEL* channel;
+
+	if (!metrics)
+		return;
+
+	channel = metrics_get_channel(metrics, channelId);
+	metrics_add(&channel->BytesIn, length);
+	metrics_add(&channel->PdusIn, 1);
+}
+
+void metrics_channel_write(rdpMetrics* metrics, UINT16 channelId, UINT32 length)
+{
+	RDP_METRICS_CHANNEL* channel;
+
+	if (!metrics)
+		return;
+
+	channel = metrics_get_channel(metrics, channelId);
+	metrics_add(&channel->BytesOut, length);
+	metrics_add(&channel->PdusOut, 1);
+}
+
+void metrics_fastpath_read(rdpMetrics* metrics, UINT32 fragmentation)
+{
+	if (!metrics)
+		return;
+
+	if ((fragmentation == FASTPATH_FRAGMENT_SINGLE) || (fragmentation == FASTPATH_FRAGMENT_LAST))
+		metrics_add(&metrics->FastPathUpdatesIn, 1);
+
+	metrics_add(&metrics->FastPathFragmentsIn, 1);
+}
+
+void metrics_fastpath_write(rdpMetrics* metrics, UINT32 fragments)
+{
+	if (!metrics)
+		return;
+
+	metrics_add(&metrics->FastPathUpdatesOut, 1);
+	metrics_add(&metrics->FastPathFragmentsOut, fragments);
+}
+
+void metrics_write_blocked(rdpMetrics* metrics, UINT64 elapsed)
+{
+	if (!metrics)
+		return;
+
+	metrics_add(&metrics->WriteBlockedCount, 1);
+	metrics_add(&metrics->WriteBlockedTime, elapsed);
+}
+
+void metrics_codec_encode(rdpMetrics* metrics, UINT32 codecId, UINT64 elapsed)
+{
+	if (!metrics || (codecId >= METRICS_CODEC_COUNT))
+		return;
+
+	metrics_add(&metrics->Codecs[codecId].EncodeCount, 1);
+	metrics_add(&metrics->Codecs[codecId].EncodeTime, elapsed);
+}
+
+void metrics_codec_decode(rdpMetrics* metrics, UINT32 codecId, UINT64 elapsed)
+{
+	if (!metrics || (codecId >= METRICS_CODEC_COUNT))
+		return;
+
+	metrics_add(&metrics->Codecs[codecId].DecodeCount, 1);
+	metrics_add(&metrics->Codecs[codecId].DecodeTime, elapsed);
+}
+
+void metrics_round_trip_time(rdpMetrics* metrics, UINT32 roundTripTime)
+{
+	if (!metrics)
+		return;
+
+	metrics_exchange(&metrics->RoundTripTime, roundTripTime);
+	metrics_min(&metrics->RoundTripTimeMin, roundTripTime);
+	metrics_add(&metrics->RoundTripCount, 1);
+}
+
+void metrics_bandwidth(rdpMetrics* metrics, UINT32 bandwidth)
+{
+	if (!metrics)
+		return;
+
+	metrics_exchange(&metrics->Bandwidth, bandwidth);
+}
+
+void metrics_frame_sent(rdpMetrics* metrics, UINT32 frameId)
+{
+	if (!metrics)
+		return;
+
+	metrics_exchange(&metrics->FrameSentTime[frameId % METRICS_FRAME_HISTORY], metrics_get_timestamp());
+}
+
+void metrics_frame_acknowledged(rdpMetrics* metrics, UINT32 frameId)
+{
+	UINT64 sent;
+	UINT64 latency;
+
+	if (!metrics)
+		return;
+
+	sent = metrics_exchange(&metrics->FrameSentTime[frameId % METRICS_FRAME_HISTORY], 0);
+
+	if (!sent)
+		return; /* unknown frame, or acknowledged twice */
+
+	latency = metrics_get_timestamp() - sent;
+
+	metrics_add(&metrics->FrameAckCount, 1);
+	metrics_add(&metrics->FrameAckLatency, latency);
+	metrics_max(&metrics->FrameAckLatencyMax, latency);
+}
+
+BOOL metrics_snapshot(rdpMetrics* metrics, rdpMetricsSnapshot* snapshot)
+{
+	int index;
+
+	if (!metrics || !snapshot)
+		return FALSE;
+
+	snapshot->Timestamp = metrics_get_timestamp();
+
+	snapshot->TotalCompressedBytes = metrics_read(&metrics->TotalCompressedBytes);
+	snapshot->TotalUncompressedBytes = metrics_read(&metrics->TotalUncompressedBytes);
+	snapshot->TotalCompressionTime = metrics_read(&metrics->TotalCompressionTime);
+	snapshot->TotalCompressionWaitTime = metrics_read(&metrics->TotalCompressionWaitTime);
+	snapshot->CompressionQueueDepth = (UINT64) InterlockedCompareExchange(&metrics->CompressionQueueDepth, 0, 0);
+
+	snapshot->FastPathUpdatesOut = metrics_read(&metrics->FastPathUpdatesOut);
+	snapshot->FastPathFragmentsOut = metrics_read(&metrics->FastPathFragmentsOut);
+	snapshot->FastPathUpdatesIn = metrics_read(&metrics->FastPathUpdatesIn);
+	snapshot->FastPathFragmentsIn = metrics_read(&metrics->FastPathFragmentsIn);
+
+	snapshot->WriteBlockedCount = metrics_read(&metrics->WriteBlockedCount);
+	snapshot->WriteBlockedTime = metrics_read(&metrics->WriteBlockedTime);
+
+	snapshot->RoundTripTime = metrics_read(&metrics->RoundTripTime);
+	snapshot->RoundTripTimeMin = metrics_read(&metrics->RoundTripTimeMin);
+	snapshot->RoundTripCount = metrics_read(&metrics->RoundTripCount);
+	snapshot->Bandwidth = metrics_read(&metrics->Bandwidth);
+
+	snapshot->FrameAckCount = metrics_read(&metrics->FrameAckCount);
+	snapshot->FrameAckLatency = metrics_read(&metrics->FrameAckLatency);
+	snapshot->FrameAckLatencyMax = metrics_read(&metrics->FrameAckLatencyMax);
+
+	for (index = 0; index < METRICS_CHANNEL_COUNT; index++)
+	{
+		snapshot->Channels[index].ChannelId = metrics_read(&metrics->Channels[index].ChannelId);
+		snapshot->Channels[index].BytesIn = metrics_read(&metrics->Channels[index].BytesIn);
+		snapshot->Channels[index].PdusIn = metrics_read(&metrics->Channels[index].PdusIn);
+		snapshot->Channels[index].BytesOut = metrics_read(&metrics->Channels[index].BytesOut);
+		snapshot->Channels[index].PdusOut = metrics_read(&metrics->Channels[index].PdusOut);
+	}
+
+	for (index = 0; index < METRICS_CODEC_COUNT; index++)
+	{
+		snapshot->Codecs[index].EncodeCount = metrics_read(&metrics->Codecs[index].EncodeCount);
+		snapshot->Codecs[index].EncodeTime = metrics_read(&metrics->Codecs[index].EncodeTime);
+		snapshot->Codecs[index].DecodeCount = metrics_read(&metrics->Codecs[index].DecodeCount);
+		snapshot->Codecs[index].DecodeTime = metrics_read(&metrics->Codecs[index].DecodeTime);
+	}
+
+	return TRUE;
+}
+
+static const char* METRICS_CODEC_NAMES[METRICS_CODEC_COUNT] =
+{
+	"RemoteFX", "NSCodec", "Planar", "Progressive", "ClearCodec", "H.264"
+};
+
+static const char* metrics_get_channel_name(rdpMetrics* metrics, UINT64 channelId)
+{
+	UINT32 index;
+	rdpMcs* mcs;
+
+	if (channelId == MCS_GLOBAL_CHANNEL_ID)
+		return "I/O";
+
+	if (channelId == METRICS_CHANNEL_ID_OTHER)
+		return "other";
+
+	if (!metrics->context || !metrics->context->rdp || !metrics->context->rdp->mcs)
+		return "?";
+
+	mcs = metrics->context->rdp->mcs;
+
+	if (channelId == mcs->messageChannelId)
+		return "message";
+
+	for (index = 0; index < mcs->channelCount; index++)
+	{
+		if (mcs->channels[index].ChannelId == channelId)
+			return mcs->channels[index].Name;
+	}
+
+	return "?";
+}
+
+void metrics_dump(rdpMetrics* metrics)
+{
+	int index;
+	rdpMetricsSnapshot snapshot;
+	RDP_METRICS_CHANNEL* channel;
+	RDP_METRICS_CODEC* codec;
+
+	if (!metrics_snapshot(metrics, &snapshot))
+		return;
+
+	WLog_INFO(TAG, "bulk: %llu -> %llu bytes, %llu us compressing, %llu us waiting, %llu queued",
+			snapshot.TotalUncompressedBytes, snapshot.TotalCompressedBytes,
+			snapshot.TotalCompressionTime, snapshot.TotalCompressionWaitTime,
+			snapshot.CompressionQueueDepth);
+
+	WLog_INFO(TAG, "fastpath: out %llu updates in %llu fragments, in %llu updates in %llu fragments",
+			snapshot.FastPathUpdatesOut, snapshot.FastPathFragmentsOut,
+			snapshot.FastPathUpdatesIn, snapshot.FastPathFragmentsIn);
+
+	WLog_INFO(TAG, "transport: write blocked %llu times for %llu us",
+			snapshot.WriteBlockedCount, snapshot.WriteBlockedTime);
+
+	WLog_INFO(TAG, "network: rtt %llu ms (min %llu ms, %llu samples), bandwidth %llu kbit/s",
+			snapshot.RoundTripTime, snapshot.RoundTripTimeMin, snapshot.RoundTripCount,
+			snapshot.Bandwidth);
+
+	WLog_INFO(TAG, "frame ack: %llu frames, latency avg %llu us, max %llu us", snapshot.FrameAckCount,
+			snapshot.FrameAckCount ? snapshot.FrameAckLatency / snapshot.FrameAckCount : 0,
+			snapshot.FrameAckLatencyMax);
+
+	for (index = 0; index < METRICS_CHANNEL_COUNT; index++)
+	{
+		channel = &snapshot.Channels[index];
+
+		if (!channel->PdusIn && !channel->PdusOut)
+			continue;
+
+		WLog_INFO(TAG, "channel %s (%llu): in %llu bytes / %llu pdus, out %llu bytes / %llu pdus",
+				metrics_get_channel_name(metrics, channel->ChannelId), channel->ChannelId,
+				channel->BytesIn, channel->PdusIn, channel->BytesOut, channel->PdusOut);
+	}
+
+	for (index = 0; index < METRICS_CODEC_COUNT; index++)
+	{
+		codec = &snapshot.Codecs[index];
+
+		if (!codec->EncodeCount && !codec->DecodeCount)
+			continue;
+
+		WLog_INFO(TAG, "codec %s: encode %llu x %llu us, decode %llu x %llu us", METRICS_CODEC_NAMES[index],
+				codec->EncodeCount, codec->EncodeCount ? codec->EncodeTime / codec->EncodeCount : 0,
+				codec->DecodeCount, codec->DecodeCount ? codec->DecodeTime / codec->DecodeCount : 0);
+	}
+}
+
+/**
+ * Called from the session event loop. When settings->MetricsDumpInterval is
+ * set, the first caller after each interval writes the counters to the log.
+ */
+
+void metrics_check_dump(rdpMetrics* metrics)
+{
+	UINT64 now;
+	UINT64 next;
+	UINT64 interval;
+
+	if (!metrics || !metrics->context || !metrics->context->settings)
+		return;
+
+	interval = ((UINT64) metrics->context->settings->MetricsDumpInterval) * 1000;
+
+	if (!interval)
+		return;
+
+	now = metrics_get_timestamp();
+	next = metrics_read(&metrics->NextDumpTime);
+
+	if (now < next)
+		return;
+
+	if (InterlockedCompareExchange64((LONGLONG*) &metrics->NextDumpTime, now + interval, next) != next)
+		return;
+
+	if (next)
+		metrics_dump(metrics);
+}
+
 rdpMetrics* metrics_new(rdpContext* context)
 {
 	rdpMetrics* metrics;
@@ -45,6 +446,7 @@ rdpMetrics* metrics_new(rdpContext* context)
 	if (metrics)
 	{
 		metrics->context = context;
+		metrics->Channels[METRICS_CHANNEL_COUNT - 1].ChannelId = METRICS_CHANNEL_ID_OTHER;
 	}
 
 	return metrics;
@@ -303,6 +303,7 @@ static BOOL peer_recv_data_pdu(freerdp_peer* client, wStream* s)
 			if (Stream_GetRemainingLength(s) < 4)
 				return FALSE;
 			Stream_Read_UINT32(s, client->ack_frame_id);
+			metrics_frame_acknowledged(client->context->metrics, client->ack_frame_id);
 			IFCALL(client->update->SurfaceFrameAcknowledge, client->update->context, client->ack_frame_id);
 			break;
 
@@ -344,6 +345,8 @@ static int peer_recv_tpkt_pdu(freerdp_peer* client, wStream* s)
 
 	if (rdp->disconnect)
 		return 0;
+
+	metrics_channel_read(client->context->metrics, channelId, length);
  
 	if (rdp->settings->DisableEncryption)
 	{
@@ -419,6 +422,8 @@ static int peer_recv_fastpath_pdu(freerdp_peer* client, wStream* s)
 		return -1;
 	}
 
+	metrics_channel_read(client->context->metrics, MCS_GLOBAL_CHANNEL_ID, length);
+
 	if (fastpath->encryptionFlags & FASTPATH_OUTPUT_ENCRYPTED)
 	{
 		if (!rdp_decrypt(rdp, s, length, (fastpath->encryptionFlags & FASTPATH_OUTPUT_SECURE_CHECKSUM) ? SEC_SECURE_CHECKSUM : 0))
@@ -524,6 +524,8 @@ BOOL rdp_send(rdpRdp* rdp, wStream* s, UINT16 channel_id)
 	if (transport_write(rdp->transport, s) < 0)
 		return FALSE;
 
+	metrics_channel_write(rdp->context->metrics, channel_id, length);
+
 	return TRUE;
 }
 
@@ -547,6 +549,8 @@ BOOL rdp_send_pdu(rdpRdp* rdp, wStream* s, UINT16 type, UINT16 channel_id)
 	if (transport_write(rdp->transport, s) < 0)
 		return FALSE;
 
+	metrics_channel_write(rdp->context->metrics, MCS_GLOBAL_CHANNEL_ID, length);
+
 	return TRUE;
 }
 
@@ -571,6 +575,8 @@ BOOL rdp_send_data_pdu(rdpRdp* rdp, wStream* s, BYTE type, UINT16 channel_id)
 	if (transport_write(rdp->transport, s) < 0)
 		return FALSE;
 
+	metrics_channel_write(rdp->context->metrics, MCS_GLOBAL_CHANNEL_ID, length);
+
 	return TRUE;
 }
 
@@ -593,6 +599,8 @@ BOOL rdp_send_message_channel_pdu(rdpRdp* rdp, wStream* s, UINT16 sec_flags)
 	if (transport_write(rdp->transport, s) < 0)
 		return FALSE;
 
+	metrics_channel_write(rdp->context->metrics, rdp->mcs->messageChannelId, length);
+
 	return TRUE;
 }
 
@@ -1034,6 +1042,8 @@ static int rdp_recv_tpkt_pdu(rdpRdp* rdp, wStream* s)
 
 	if (rdp->disconnect)
 		return 0;
+
+	metrics_channel_read(rdp->context->metrics, channelId, length);
  
 	if (rdp->autodetect->bandwidthMeasureStarted)
 	{
@@ -1140,6 +1150,8 @@ static int rdp_recv_fastpath_pdu(rdpRdp* rdp, wStream* s)
 		return -1;
 	}
 
+	metrics_channel_read(rdp->context->metrics, MCS_GLOBAL_CHANNEL_ID, length);
+
 	if (rdp->autodetect->bandwidthMeasureStarted)
 	{
 		rdp->autodetect->bandwidthMeasureByteCount += length;
@@ -1253,6 +1265,8 @@ int rdp_check_fds(rdpRdp* rdp)
 
 	status = transport_check_fds(rdp->transport);
 
+	metrics_check_dump(rdp->context->metrics);
+
 	if (status == 1)
 	{
 		status = rdp_client_redirect(rdp); /* session redirection */
@@ -35,6 +35,7 @@
 #include <winpr/registry.h>
 
 #include <freerdp/settings.h>
+#include <freerdp/codec/rfx.h>
 
 #ifdef _WIN32
 #pragma warning(push)
@@ -399,6 +400,8 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 		settings->FastPathInput = TRUE;
 		settings->FastPathOutput = TRUE;
 
+		settings->RemoteFxRlgrMode = RLGR3;
+
 		settings->FrameAcknowledge = 2;
 		settings->MouseMotion = TRUE;
 
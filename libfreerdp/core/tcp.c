@@ -38,6 +38,7 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <net/if.h>
@@ -125,6 +126,72 @@ static int transport_bio_simple_write(BIO* bio, const char* buf, int size)
 	return status;
 }
 
+/**
+ * Gather write of BIO_C_WRITEV, sends as much of the chunks as the socket
+ * takes with a single call.
+ */
+
+static int transport_bio_simple_writev(BIO* bio, const DataChunk* chunks, int count)
+{
+	int index;
+	int error;
+	int status;
+#ifdef _WIN32
+	DWORD sent = 0;
+	WSABUF buffers[TCP_IOV_MAX];
+#else
+	struct msghdr msg;
+	struct iovec iov[TCP_IOV_MAX];
+#endif
+
+	if (!chunks || (count <= 0) || (count > TCP_IOV_MAX))
+		return -1;
+
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
+
+#ifdef _WIN32
+	for (index = 0; index < count; index++)
+	{
+		buffers[index].buf = (char*) chunks[index].data;
+		buffers[index].len = (ULONG) chunks[index].size;
+	}
+
+	if (WSASend((SOCKET) bio->num, buffers, count, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+		status = -1;
+	else
+		status = (int) sent;
+#else
+	for (index = 0; index < count; index++)
+	{
+		iov[index].iov_base = (void*) chunks[index].data;
+		iov[index].iov_len = chunks[index].size;
+	}
+
+	ZeroMemory(&msg, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+
+	status = sendmsg(bio->num, &msg, MSG_NOSIGNAL);
+#endif
+
+	if (status <= 0)
+	{
+		error = WSAGetLastError();
+
+		if ((error == WSAEWOULDBLOCK) || (error == WSAEINTR) ||
+			(error == WSAEINPROGRESS) || (error == WSAEALREADY))
+		{
+			BIO_set_flags(bio, (BIO_FLAGS_WRITE | BIO_FLAGS_SHOULD_RETRY));
+		}
+		else
+		{
+			BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+		}
+	}
+
+	return status;
+}
+
 static int transport_bio_simple_read(BIO* bio, char* buf, int size)
 {
 	int error;
@@ -214,6 +281,10 @@ static long transport_bio_simple_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
 			status = 1;
 			break;
 
+		case BIO_C_WRITEV:
+			status = transport_bio_simple_writev(bio, (const DataChunk*) arg2, (int) arg1);
+			break;
+
 		default:
 			status = 0;
 			break;
@@ -274,91 +345,227 @@ long transport_bio_buffered_callback(BIO* bio, int mode, const char* argp, int a
 	return 1;
 }
 
-static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
+/**
+ * Output goes out through the BIO under the buffered one: the socket BIO takes
+ * whatever is still queued in xmitBuffer followed by the caller's chunks with a
+ * single sendmsg(), any other BIO one chunk at a time. Only the part that was
+ * not taken is copied into xmitBuffer, so the common case never copies the
+ * payload.
+ */
+
+static int transport_bio_buffered_sendv(BIO* bio, const DataChunk* chunks, int count)
 {
-	int status, ret;
-	rdpTcp* tcp = (rdpTcp*) bio->ptr;
-	int nchunks, committedBytes, i;
+	BIO* next = bio->next_bio;
+
+	if (BIO_method_type(next) == BIO_TYPE_SIMPLE)
+		return (int) BIO_ctrl(next, BIO_C_WRITEV, count, (void*) chunks);
+
+	return BIO_write(next, chunks[0].data, (int) chunks[0].size);
+}
+
+static int transport_bio_buffered_send(BIO* bio, const DataChunk* data, int count)
+{
+	int i;
+	int status;
+	int nchunks;
+	int niov;
+	int ret = 0;
+	size_t size;
+	size_t sent;
+	size_t length;
+	size_t offset;
+	int current;
+	int committedBytes;
 	DataChunk chunks[2];
+	DataChunk iov[TCP_IOV_MAX];
+	rdpTcp* tcp = (rdpTcp*) bio->ptr;
 
-	ret = num;
 	tcp->writeBlocked = FALSE;
 	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
 
-	/* we directly append extra bytes in the xmit buffer, this could be prevented
-	 * but for now it makes the code more simple.
-	 */
-	if (buf && num && !ringbuffer_write(&tcp->xmitBuffer, (const BYTE*) buf, num))
-	{
-		WLog_ERR(TAG,  "an error occured when writing(toWrite=%d)", num);
-		return -1;
-	}
+	for (i = 0; i < count; i++)
+		ret += data[i].size;
 
 	committedBytes = 0;
 	nchunks = ringbuffer_peek(&tcp->xmitBuffer, chunks, ringbuffer_used(&tcp->xmitBuffer));
 
-	for (i = 0; i < nchunks; i++)
+	/* current walks the queued chunks first, then the caller's */
+	current = 0;
+	offset = 0;
+
+	while (current < nchunks + count)
 	{
-		while (chunks[i].size)
+		niov = 0;
+
+		for (i = current; (i < nchunks + count) && (niov < TCP_IOV_MAX); i++)
 		{
-			status = BIO_write(bio->next_bio, chunks[i].data, chunks[i].size);
+			iov[niov] = (i < nchunks) ? chunks[i] : data[i - nchunks];
+
+			if (i == current)
+			{
+				iov[niov].data += offset;
+				iov[niov].size -= offset;
+			}
+
+			if (iov[niov].size)
+				niov++;
+		}
 
-			if (status <= 0)
+		if (!niov)
+			break;
+
+		status = transport_bio_buffered_sendv(bio, iov, niov);
+
+		if (status <= 0)
+		{
+			if (BIO_should_retry(bio->next_bio))
 			{
-				if (!BIO_should_retry(bio->next_bio))
-				{
-					BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
-					ret = -1; /* fatal error */
-					goto out;
-				}
-
-				if (BIO_should_write(bio->next_bio))
-				{
-					BIO_set_flags(bio, BIO_FLAGS_WRITE);
-					tcp->writeBlocked = TRUE;
-					goto out; /* EWOULDBLOCK */
-				}
+				BIO_set_flags(bio, BIO_FLAGS_WRITE);
+				tcp->writeBlocked = TRUE;
+				break; /* EWOULDBLOCK */
 			}
 
-			committedBytes += status;
-			chunks[i].size -= status;
-			chunks[i].data += status;
+			BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+			ringbuffer_commit_read_bytes(&tcp->xmitBuffer, committedBytes);
+			return -1; /* fatal error */
+		}
+
+		sent = (size_t) status;
+
+		while (sent && (current < nchunks + count))
+		{
+			size = (current < nchunks) ? chunks[current].size : data[current - nchunks].size;
+			length = ((size - offset) < sent) ? (size - offset) : sent;
+
+			if (current < nchunks)
+				committedBytes += length;
+
+			sent -= length;
+			offset += length;
+
+			if (offset == size)
+			{
+				current++;
+				offset = 0;
+			}
 		}
 	}
 
-out:
 	ringbuffer_commit_read_bytes(&tcp->xmitBuffer, committedBytes);
+
+	if (current < nchunks)
+	{
+		current = nchunks;
+		offset = 0;
+	}
+
+	/* keep what the socket did not take */
+	for (i = current - nchunks; i < count; i++)
+	{
+		if ((data[i].size > offset) &&
+			!ringbuffer_write(&tcp->xmitBuffer, data[i].data + offset, data[i].size - offset))
+			goto out_fail;
+
+		offset = 0;
+	}
+
 	return ret;
+
+out_fail:
+	WLog_ERR(TAG,  "an error occured when writing(toWrite=%d)", ret);
+	return -1;
 }
 
+static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
+{
+	DataChunk chunk;
+
+	chunk.data = (const BYTE*) buf;
+	chunk.size = (buf && (num > 0)) ? num : 0;
+
+	return transport_bio_buffered_send(bio, &chunk, 1);
+}
+
+/**
+ * Reads are served from recvBuffer, refilled with one large read from the
+ * socket when empty, so that the small header reads of transport_read_pdu()
+ * and of the TLS record layer do not each cost a recv() call.
+ */
+
 static int transport_bio_buffered_read(BIO* bio, char* buf, int size)
 {
+	int i;
 	int status;
+	int nchunks;
+	int committedBytes;
+	BYTE* readAhead;
+	DataChunk chunks[2];
 	rdpTcp* tcp = (rdpTcp*) bio->ptr;
 
 	tcp->readBlocked = FALSE;
 	BIO_clear_flags(bio, BIO_FLAGS_READ);
 
-	status = BIO_read(bio->next_bio, buf, size);
+	if (!buf || (size <= 0))
+		return 0;
 
-	if (status <= 0)
+	if (!ringbuffer_used(&tcp->recvBuffer))
 	{
-		if (!BIO_should_retry(bio->next_bio))
+		/* large reads go straight to the caller */
+		if (size >= TCP_READ_AHEAD_SIZE)
 		{
-			BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
-			goto out;
+			readAhead = (BYTE*) buf;
+			status = BIO_read(bio->next_bio, buf, size);
 		}
+		else
+		{
+			readAhead = ringbuffer_ensure_linear_write(&tcp->recvBuffer, TCP_READ_AHEAD_SIZE);
 
-		BIO_set_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+			if (!readAhead)
+			{
+				BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+				return -1;
+			}
+
+			status = BIO_read(bio->next_bio, readAhead, TCP_READ_AHEAD_SIZE);
+		}
 
-		if (BIO_should_read(bio->next_bio))
+		if (status <= 0)
 		{
-			BIO_set_flags(bio, BIO_FLAGS_READ);
-			tcp->readBlocked = TRUE;
+			if (!BIO_should_retry(bio->next_bio))
+			{
+				BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+				goto out;
+			}
+
+			BIO_set_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+
+			if (BIO_should_read(bio->next_bio))
+			{
+				BIO_set_flags(bio, BIO_FLAGS_READ);
+				tcp->readBlocked = TRUE;
+			}
+
 			goto out;
 		}
+
+		if (readAhead == (BYTE*) buf)
+			goto out;
+
+		ringbuffer_commit_written_bytes(&tcp->recvBuffer, status);
 	}
 
+	committedBytes = 0;
+	nchunks = ringbuffer_peek(&tcp->recvBuffer, chunks, size);
+
+	for (i = 0; i < nchunks; i++)
+	{
+		CopyMemory(&buf[committedBytes], chunks[i].data, chunks[i].size);
+		committedBytes += chunks[i].size;
+	}
+
+	ringbuffer_commit_read_bytes(&tcp->recvBuffer, committedBytes);
+	status = committedBytes;
+
 out:
 	return status;
 }
@@ -386,7 +593,7 @@ static long transport_bio_buffered_ctrl(BIO* bio, int cmd, long arg1, void* arg2
 			return ringbuffer_used(&tcp->xmitBuffer);
 
 		case BIO_CTRL_PENDING:
-			return 0;
+			return ringbuffer_used(&tcp->recvBuffer);
 
 		default:
 			return BIO_ctrl(bio->next_bio, cmd, arg1, arg2);
@@ -441,6 +648,11 @@ BOOL transport_bio_buffered_drain(BIO *bio)
 	return status >= 0;
 }
 
+int transport_bio_buffered_writev(BIO* bio, const DataChunk* chunks, int count)
+{
+	return transport_bio_buffered_send(bio, chunks, count);
+}
+
 void tcp_get_ip_address(rdpTcp* tcp)
 {
 	BYTE* ip;
@@ -850,6 +1062,7 @@ int tcp_attach(rdpTcp* tcp, int sockfd)
 	SetEventFileDescriptor(tcp->event, tcp->sockfd);
 
 	ringbuffer_commit_read_bytes(&tcp->xmitBuffer, ringbuffer_used(&tcp->xmitBuffer));
+	ringbuffer_commit_read_bytes(&tcp->recvBuffer, ringbuffer_used(&tcp->recvBuffer));
 
 	if (tcp->socketBio)
 	{
@@ -977,6 +1190,9 @@ rdpTcp* tcp_new(rdpSettings* settings)
 	if (!ringbuffer_init(&tcp->xmitBuffer, 0x10000))
 		goto out_free;
 
+	if (!ringbuffer_init(&tcp->recvBuffer, TCP_READ_AHEAD_SIZE))
+		goto out_xmit;
+
 	tcp->sockfd = -1;
 	tcp->settings = settings;
 
@@ -992,6 +1208,8 @@ rdpTcp* tcp_new(rdpSettings* settings)
 
 	return tcp;
 out_ringbuffer:
+	ringbuffer_destroy(&tcp->recvBuffer);
+out_xmit:
 	ringbuffer_destroy(&tcp->xmitBuffer);
 out_free:
 	free(tcp);
@@ -1004,6 +1222,7 @@ void tcp_free(rdpTcp* tcp)
 		return;
 
 	ringbuffer_destroy(&tcp->xmitBuffer);
+	ringbuffer_destroy(&tcp->recvBuffer);
 	CloseHandle(tcp->event);
 	free(tcp);
 }
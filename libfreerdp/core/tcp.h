@@ -41,6 +41,12 @@
 #define BIO_TYPE_SIMPLE		66
 #define BIO_TYPE_BUFFERED	67
 
+/* gather write on the simple socket BIO: arg1 is the chunk count, arg2 the chunks */
+#define BIO_C_WRITEV		1001
+
+#define TCP_READ_AHEAD_SIZE	0x10000
+#define TCP_IOV_MAX		256
+
 typedef struct rdp_tcp rdpTcp;
 
 struct rdp_tcp
@@ -53,6 +59,7 @@ struct rdp_tcp
 	BIO* socketBio;
 	BIO* bufferedBio;
 	RingBuffer xmitBuffer;
+	RingBuffer recvBuffer;
 	BOOL writeBlocked;
 	BOOL readBlocked;
 	HANDLE event;
@@ -69,6 +76,12 @@ BOOL tcp_set_keep_alive_mode(rdpTcp* tcp);
 int tcp_attach(rdpTcp* tcp, int sockfd);
 HANDLE tcp_get_event_handle(rdpTcp* tcp);
 
+BIO_METHOD* BIO_s_simple_socket(void);
+BIO_METHOD* BIO_s_buffered_socket(void);
+
+BOOL transport_bio_buffered_drain(BIO* bio);
+int transport_bio_buffered_writev(BIO* bio, const DataChunk* chunks, int count);
+
 rdpTcp* tcp_new(rdpSettings* settings);
 void tcp_free(rdpTcp* tcp);
 
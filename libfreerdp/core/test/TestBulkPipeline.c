@@ -0,0 +1,206 @@
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/bulk.h>
+
+#include "bulk.h"
+
+/**
+ * Fragments of an update are compressed one ahead of the one being sent:
+ * the fragment k + 1 is submitted before the result of fragment k is used.
+ * The session's compression history makes the output depend on the order,
+ * so the pipelined output must match, fragment for fragment, what inline
+ * compression gives, and decompress to the source on the other side.
+ */
+
+#define TEST_FRAGMENT_COUNT	10
+
+/**
+ * Cut down to the largest fragment of the level, as fast-path does; some are
+ * sent uncompressed: no larger than 50 bytes, or 16 KiB and up.
+ */
+static const UINT32 TEST_FRAGMENT_SIZES[TEST_FRAGMENT_COUNT] =
+{
+	9000, 12000, 40, 16000, 16384, 3000, 15000, 700, 8000, 11000
+};
+
+static const char* TEST_WORDS[16] =
+{
+	"surface ", "bitmap  ", "glyph   ", "pointer ", "palette ", "order   ", "cache   ", "brush   ",
+	"frame   ", "update  ", "stream  ", "channel ", "monitor ", "codec   ", "tile    ", "region  "
+};
+
+typedef struct _TEST_RESULT
+{
+	int status;
+	UINT32 flags;
+	UINT32 size;
+	BYTE* data;
+} TEST_RESULT;
+
+static void test_fill(BYTE* data, UINT32 length)
+{
+	UINT32 index;
+	UINT32 seed = 0x1234;
+
+	for (index = 0; index + 8 <= length; index += 8)
+	{
+		seed = seed * 1103515245 + 12345;
+		CopyMemory(&data[index], TEST_WORDS[(seed >> 16) & 0x0F], 8);
+	}
+
+	for (; index < length; index++)
+		data[index] = (BYTE) index;
+}
+
+static int test_bulk_pipeline_level(UINT32 level)
+{
+	int index;
+	int status = -1;
+	UINT32 length;
+	UINT32 maxSize;
+	UINT32 size;
+	UINT32 flags;
+	BYTE* pDstData;
+	BYTE* pOutData;
+	UINT32 OutSize;
+	BYTE* data = NULL;
+	rdpBulk* sender = NULL;
+	rdpBulk* reference = NULL;
+	rdpBulk* receiver = NULL;
+	rdpContext context;
+	UINT32 offsets[TEST_FRAGMENT_COUNT];
+	UINT32 sizes[TEST_FRAGMENT_COUNT];
+	TEST_RESULT results[TEST_FRAGMENT_COUNT];
+
+	ZeroMemory(&context, sizeof(context));
+	ZeroMemory(results, sizeof(results));
+
+	context.settings = freerdp_settings_new(FREERDP_SETTINGS_SERVER_MODE);
+	context.metrics = metrics_new(&context);
+
+	if (!context.settings || !context.metrics)
+		goto out;
+
+	context.settings->CompressionLevel = level;
+
+	sender = bulk_new(&context);
+	reference = bulk_new(&context);
+	receiver = bulk_new(&context);
+
+	if (!sender || !reference || !receiver)
+		goto out;
+
+	if (!bulk_set_pipeline(sender, TRUE) || !bulk_set_pipeline(reference, FALSE))
+		goto out;
+
+	length = 0;
+	maxSize = bulk_compression_max_size(sender);
+
+	for (index = 0; index < TEST_FRAGMENT_COUNT; index++)
+	{
+		offsets[index] = length;
+		sizes[index] = (TEST_FRAGMENT_SIZES[index] < maxSize) ? TEST_FRAGMENT_SIZES[index] : maxSize;
+		length += sizes[index];
+	}
+
+	data = (BYTE*) malloc(length);
+
+	if (!data)
+		goto out;
+
+	test_fill(data, length);
+
+	/* what inline compression of the same fragments gives */
+
+	for (index = 0; index < TEST_FRAGMENT_COUNT; index++)
+	{
+		flags = 0;
+		results[index].status = bulk_compress(reference, &data[offsets[index]], sizes[index],
+				&pDstData, &size, &flags);
+		results[index].flags = flags;
+		results[index].size = size;
+		results[index].data = (BYTE*) malloc(size);
+
+		if (!results[index].data)
+			goto out;
+
+		CopyMemory(results[index].data, pDstData, size);
+	}
+
+	bulk_compress_submit(sender, &data[offsets[0]], sizes[0]);
+
+	for (index = 0; index < TEST_FRAGMENT_COUNT; index++)
+	{
+		flags = 0;
+
+		if (bulk_compress_wait(sender, &pDstData, &size, &flags) != results[index].status)
+		{
+			printf("level %d fragment %d: status differs from inline compression\n", level, index);
+			goto out;
+		}
+
+		/* the next fragment compresses while this one is checked, like it is sent */
+
+		if (index + 1 < TEST_FRAGMENT_COUNT)
+			bulk_compress_submit(sender, &data[offsets[index + 1]], sizes[index + 1]);
+
+		if ((flags != results[index].flags) || (size != results[index].size) ||
+			(memcmp(pDstData, results[index].data, size) != 0))
+		{
+			printf("level %d fragment %d: %d bytes, flags 0x%02X, inline compression gives %d bytes, flags 0x%02X\n",
+					level, index, size, flags, results[index].size, results[index].flags);
+			goto out;
+		}
+
+		if (bulk_decompress(receiver, pDstData, size, &pOutData, &OutSize, flags | level) < 0)
+		{
+			printf("level %d fragment %d: decompression failure\n", level, index);
+			goto out;
+		}
+
+		if ((OutSize != sizes[index]) ||
+			(memcmp(pOutData, &data[offsets[index]], OutSize) != 0))
+		{
+			printf("level %d fragment %d: decompressed fragment differs from the source\n", level, index);
+			goto out;
+		}
+	}
+
+	if (context.metrics->CompressionQueueDepth != 0)
+	{
+		printf("level %d: %d fragments still queued\n", level, (int) context.metrics->CompressionQueueDepth);
+		goto out;
+	}
+
+	status = 0;
+out:
+	for (index = 0; index < TEST_FRAGMENT_COUNT; index++)
+		free(results[index].data);
+
+	bulk_free(sender);
+	bulk_free(reference);
+	bulk_free(receiver);
+	metrics_free(context.metrics);
+	freerdp_settings_free(context.settings);
+	free(data);
+	return status;
+}
+
+int TestBulkPipeline(int argc, char* argv[])
+{
+	if (test_bulk_pipeline_level(PACKET_COMPR_TYPE_8K) < 0)
+		return -1;
+
+	if (test_bulk_pipeline_level(PACKET_COMPR_TYPE_64K) < 0)
+		return -1;
+
+	if (test_bulk_pipeline_level(PACKET_COMPR_TYPE_RDP6) < 0)
+		return -1;
+
+	if (test_bulk_pipeline_level(PACKET_COMPR_TYPE_RDP61) < 0)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,370 @@
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <openssl/bio.h>
+
+#include "rdp.h"
+#include "fastpath.h"
+#include "transport.h"
+
+/**
+ * Fast-path updates are framed in place: every fragment's headers are
+ * written right in front of its payload inside the update stream, in the
+ * headroom for the first one and over the tail of the previous fragment
+ * for the others. The transport is replaced by a BIO that keeps a copy of
+ * every write and where it was written from.
+ */
+
+#define TEST_FRAMES_MAX		16
+#define TEST_FRAGMENT_SIZE	(FASTPATH_MAX_PACKET_SIZE - 20)
+#define TEST_HEADER_SIZE	6
+
+typedef struct _TEST_FRAME
+{
+	const BYTE* source;
+	size_t offset;
+	size_t length;
+} TEST_FRAME;
+
+typedef struct _TEST_CAPTURE
+{
+	BYTE* data;
+	size_t length;
+	size_t capacity;
+
+	int count;
+	TEST_FRAME frames[TEST_FRAMES_MAX];
+} TEST_CAPTURE;
+
+static int test_capture_write(BIO* bio, const char* buf, int size)
+{
+	TEST_FRAME* frame;
+	TEST_CAPTURE* capture = (TEST_CAPTURE*) bio->ptr;
+
+	BIO_clear_retry_flags(bio);
+
+	if ((capture->count >= TEST_FRAMES_MAX) || (capture->length + size > capture->capacity))
+		return -1;
+
+	frame = &capture->frames[(capture->count)++];
+	frame->source = (const BYTE*) buf;
+	frame->offset = capture->length;
+	frame->length = size;
+
+	CopyMemory(&capture->data[capture->length], buf, size);
+	capture->length += size;
+
+	return size;
+}
+
+static long test_capture_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
+{
+	return (cmd == BIO_CTRL_FLUSH) ? 1 : 0;
+}
+
+static int test_capture_new(BIO* bio)
+{
+	bio->init = 1;
+	bio->flags = 0;
+	return 1;
+}
+
+static int test_capture_free(BIO* bio)
+{
+	return 1;
+}
+
+static BIO_METHOD test_capture_methods =
+{
+	BIO_TYPE_SOURCE_SINK,
+	"TestCapture",
+	test_capture_write,
+	NULL,
+	NULL,
+	NULL,
+	test_capture_ctrl,
+	test_capture_new,
+	test_capture_free,
+	NULL,
+};
+
+typedef struct _TEST_SESSION
+{
+	rdpContext context;
+	rdpRdp* rdp;
+	BIO* captureBio;
+	TEST_CAPTURE capture;
+} TEST_SESSION;
+
+/**
+ * A server session whose transport looks like TLS, the case where the
+ * fragments are framed in place rather than gathered.
+ */
+
+static BOOL test_session_init(TEST_SESSION* session)
+{
+	rdpTransport* transport;
+
+	ZeroMemory(session, sizeof(TEST_SESSION));
+
+	session->capture.capacity = 0x40000;
+	session->capture.data = (BYTE*) malloc(session->capture.capacity);
+
+	if (!session->capture.data)
+		return FALSE;
+
+	session->context.ServerMode = TRUE;
+	session->rdp = rdp_new(&session->context);
+
+	if (!session->rdp)
+		return FALSE;
+
+	session->rdp->settings->CompressionEnabled = FALSE;
+	session->rdp->settings->MultifragMaxRequestSize = 0x100000;
+	session->rdp->settings->WaitForOutputBufferFlush = FALSE;
+
+	session->captureBio = BIO_new(&test_capture_methods);
+
+	if (!session->captureBio)
+		return FALSE;
+
+	session->captureBio->ptr = &session->capture;
+
+	transport = session->rdp->transport;
+	transport->layer = TRANSPORT_LAYER_TLS;
+	transport->blocking = FALSE;
+	transport->frontBio = session->captureBio;
+
+	return TRUE;
+}
+
+static void test_session_uninit(TEST_SESSION* session)
+{
+	if (session->rdp)
+	{
+		session->rdp->transport->frontBio = NULL;
+		session->rdp->transport->layer = TRANSPORT_LAYER_TCP;
+		rdp_free(session->rdp);
+	}
+
+	if (session->captureBio)
+		BIO_free(session->captureBio);
+
+	free(session->capture.data);
+}
+
+static void test_fill(BYTE* data, size_t length)
+{
+	size_t index;
+
+	for (index = 0; index < length; index++)
+		data[index] = (BYTE) ((index * 13) ^ (index >> 8));
+}
+
+/**
+ * Checks one frame: its headers, its payload against the update sent, and
+ * that it was written from the update stream, right in front of the payload.
+ */
+
+static BOOL test_check_frame(TEST_SESSION* session, int index, wStream* s,
+		const BYTE* payload, size_t offset, size_t size, BYTE fragmentation)
+{
+	UINT16 length;
+	UINT16 updateSize;
+	BYTE updateHeader;
+	const BYTE* data;
+	TEST_FRAME* frame = &session->capture.frames[index];
+
+	data = &session->capture.data[frame->offset];
+
+	if (frame->length != TEST_HEADER_SIZE + size)
+	{
+		printf("frame %d: %d bytes, expected %d\n", index, (int) frame->length,
+				(int) (TEST_HEADER_SIZE + size));
+		return FALSE;
+	}
+
+	if (frame->source != Stream_Buffer(s) + FASTPATH_UPDATE_HEADROOM + offset - TEST_HEADER_SIZE)
+	{
+		printf("frame %d: not framed in front of its payload in the update stream\n", index);
+		return FALSE;
+	}
+
+	length = ((data[1] & 0x7F) << 8) | data[2];
+	updateHeader = data[3];
+	updateSize = data[4] | (data[5] << 8);
+
+	if ((data[0] != FASTPATH_OUTPUT_ACTION_FASTPATH) || !(data[1] & 0x80) ||
+		(length != frame->length))
+	{
+		printf("frame %d: bad fast-path update PDU header\n", index);
+		return FALSE;
+	}
+
+	if (((updateHeader & 0x0F) != FASTPATH_UPDATETYPE_BITMAP) ||
+		(((updateHeader >> 4) & 0x03) != fragmentation) || (updateHeader >> 6) ||
+		(updateSize != size))
+	{
+		printf("frame %d: bad fast-path update header 0x%02X size %d\n", index,
+				updateHeader, updateSize);
+		return FALSE;
+	}
+
+	if (size && (memcmp(&data[TEST_HEADER_SIZE], &payload[offset], size) != 0))
+	{
+		printf("frame %d: payload differs from the update\n", index);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Update streams start past the headroom, which holds the largest headers:
+ * 3 bytes of fast-path update PDU header, 4 of FIPS information, an 8 byte
+ * signature and up to 4 bytes of fast-path update header.
+ */
+
+static int test_fastpath_headroom(void)
+{
+	int status = -1;
+	wStream* s = NULL;
+	wStream* ps = NULL;
+	TEST_SESSION session;
+
+	if (FASTPATH_UPDATE_HEADROOM < 3 + 4 + 8 + 4)
+	{
+		printf("%s: %d bytes of headroom are too few\n", __FUNCTION__, FASTPATH_UPDATE_HEADROOM);
+		return -1;
+	}
+
+	if (!test_session_init(&session))
+		goto out;
+
+	s = fastpath_update_pdu_init_new(session.rdp->fastpath);
+	ps = fastpath_update_pdu_init(session.rdp->fastpath);
+
+	if (!s || !ps)
+		goto out;
+
+	if ((Stream_GetPosition(s) != FASTPATH_UPDATE_HEADROOM) ||
+		(Stream_GetPosition(ps) != FASTPATH_UPDATE_HEADROOM))
+	{
+		printf("%s: update streams start at %d and %d\n", __FUNCTION__,
+				(int) Stream_GetPosition(s), (int) Stream_GetPosition(ps));
+		goto out;
+	}
+
+	/* an empty update still goes out as one fragment, framed in the headroom */
+
+	if (!fastpath_send_update_pdu(session.rdp->fastpath, FASTPATH_UPDATETYPE_BITMAP, s, FALSE))
+		goto out;
+
+	if ((session.capture.count != 1) ||
+		!test_check_frame(&session, 0, s, NULL, 0, 0, FASTPATH_FRAGMENT_SINGLE))
+		goto out;
+
+	status = 0;
+out:
+	Stream_Free(s, TRUE);
+
+	if (ps)
+		Stream_Release(ps);
+
+	test_session_uninit(&session);
+	return status;
+}
+
+/**
+ * An update that fits one fragment, and one that takes four: the first
+ * fragment's headers go into the headroom, the others' over the tail of
+ * the previous fragment once it has been written.
+ */
+
+static int test_fastpath_fragments(size_t updateSize)
+{
+	int index;
+	int count;
+	int status = -1;
+	size_t size;
+	size_t offset;
+	BYTE fragmentation;
+	BYTE* payload;
+	wStream* s = NULL;
+	TEST_SESSION session;
+
+	payload = (BYTE*) malloc(updateSize);
+
+	if (!payload)
+		return -1;
+
+	test_fill(payload, updateSize);
+
+	if (!test_session_init(&session))
+		goto out;
+
+	s = fastpath_update_pdu_init_new(session.rdp->fastpath);
+
+	if (!s || !Stream_EnsureRemainingCapacity(s, updateSize))
+		goto out;
+
+	Stream_Write(s, payload, updateSize);
+
+	if (!fastpath_send_update_pdu(session.rdp->fastpath, FASTPATH_UPDATETYPE_BITMAP, s, FALSE))
+		goto out;
+
+	count = (int) ((updateSize + TEST_FRAGMENT_SIZE - 1) / TEST_FRAGMENT_SIZE);
+
+	if (session.capture.count != count)
+	{
+		printf("%s: %d frames for %d bytes, expected %d\n", __FUNCTION__,
+				session.capture.count, (int) updateSize, count);
+		goto out;
+	}
+
+	offset = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		size = updateSize - offset;
+
+		if (size > TEST_FRAGMENT_SIZE)
+			size = TEST_FRAGMENT_SIZE;
+
+		if (count == 1)
+			fragmentation = FASTPATH_FRAGMENT_SINGLE;
+		else if (index == 0)
+			fragmentation = FASTPATH_FRAGMENT_FIRST;
+		else if (index == count - 1)
+			fragmentation = FASTPATH_FRAGMENT_LAST;
+		else
+			fragmentation = FASTPATH_FRAGMENT_NEXT;
+
+		if (!test_check_frame(&session, index, s, payload, offset, size, fragmentation))
+			goto out;
+
+		offset += size;
+	}
+
+	status = 0;
+out:
+	Stream_Free(s, TRUE);
+	test_session_uninit(&session);
+	free(payload);
+	return status;
+}
+
+int TestFastPathFraming(int argc, char* argv[])
+{
+	if (test_fastpath_headroom() < 0)
+		return -1;
+
+	if (test_fastpath_fragments(1000) < 0)
+		return -1;
+
+	if (test_fastpath_fragments(TEST_FRAGMENT_SIZE * 3 + 100) < 0)
+		return -1;
+
+	return 0;
+}
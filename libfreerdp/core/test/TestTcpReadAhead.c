@@ -0,0 +1,546 @@
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <openssl/bio.h>
+
+#include "tcp.h"
+
+/**
+ * The buffered socket BIO serves small reads from one large read of the
+ * socket. The socket is replaced by a BIO handing out a byte stream in
+ * segments, blocking once between them, so that the reads made by the
+ * buffered BIO can be counted and the stream split at chosen offsets.
+ */
+
+#define TEST_SEGMENTS_MAX	16
+
+typedef struct _TEST_SOCKET
+{
+	const BYTE* data;
+	size_t length;
+	size_t offset;
+
+	size_t segments[TEST_SEGMENTS_MAX];
+	int segmentCount;
+	int segment;
+	size_t segmentLeft;
+	BOOL blocked;
+
+	int reads;
+	int lastReadSize;
+} TEST_SOCKET;
+
+static int test_socket_write(BIO* bio, const char* buf, int size)
+{
+	return -1;
+}
+
+static int test_socket_read(BIO* bio, char* buf, int size)
+{
+	size_t length;
+	TEST_SOCKET* sock = (TEST_SOCKET*) bio->ptr;
+
+	sock->reads++;
+	sock->lastReadSize = size;
+
+	BIO_clear_retry_flags(bio);
+
+	if (sock->offset >= sock->length)
+		return 0;
+
+	if (sock->blocked)
+	{
+		sock->blocked = FALSE;
+		BIO_set_retry_read(bio);
+		return -1;
+	}
+
+	length = ((size_t) size < sock->segmentLeft) ? (size_t) size : sock->segmentLeft;
+
+	if (length > (sock->length - sock->offset))
+		length = sock->length - sock->offset;
+
+	CopyMemory(buf, &sock->data[sock->offset], length);
+	sock->offset += length;
+	sock->segmentLeft -= length;
+
+	if (!sock->segmentLeft)
+	{
+		sock->blocked = TRUE;
+
+		if (sock->segment + 1 < sock->segmentCount)
+			sock->segment++;
+
+		sock->segmentLeft = sock->segments[sock->segment];
+	}
+
+	return (int) length;
+}
+
+static long test_socket_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
+{
+	return (cmd == BIO_CTRL_FLUSH) ? 1 : 0;
+}
+
+static int test_socket_new(BIO* bio)
+{
+	bio->init = 1;
+	bio->flags = 0;
+	return 1;
+}
+
+static int test_socket_free(BIO* bio)
+{
+	return 1;
+}
+
+static BIO_METHOD test_socket_methods =
+{
+	BIO_TYPE_SOURCE_SINK,
+	"TestSocket",
+	test_socket_write,
+	test_socket_read,
+	NULL,
+	NULL,
+	test_socket_ctrl,
+	test_socket_new,
+	test_socket_free,
+	NULL,
+};
+
+typedef struct _TEST_CONNECTION
+{
+	rdpTcp* tcp;
+	BIO* socketBio;
+	TEST_SOCKET sock;
+} TEST_CONNECTION;
+
+static BOOL test_connection_init(TEST_CONNECTION* conn, const BYTE* data, size_t length,
+		const size_t* segments, int segmentCount)
+{
+	int index;
+
+	ZeroMemory(conn, sizeof(TEST_CONNECTION));
+
+	conn->sock.data = data;
+	conn->sock.length = length;
+	conn->sock.segmentCount = segmentCount;
+
+	for (index = 0; index < segmentCount; index++)
+		conn->sock.segments[index] = segments[index];
+
+	conn->sock.segmentLeft = segments[0];
+
+	conn->tcp = tcp_new(NULL);
+
+	if (!conn->tcp)
+		return FALSE;
+
+	conn->socketBio = BIO_new(&test_socket_methods);
+	conn->tcp->bufferedBio = BIO_new(BIO_s_buffered_socket());
+
+	if (!conn->socketBio || !conn->tcp->bufferedBio)
+		return FALSE;
+
+	conn->socketBio->ptr = &conn->sock;
+	conn->tcp->bufferedBio->ptr = conn->tcp;
+	conn->tcp->bufferedBio = BIO_push(conn->tcp->bufferedBio, conn->socketBio);
+
+	return TRUE;
+}
+
+static void test_connection_uninit(TEST_CONNECTION* conn)
+{
+	if (conn->tcp)
+	{
+		if (conn->tcp->bufferedBio)
+			BIO_free_all(conn->tcp->bufferedBio);
+		else if (conn->socketBio)
+			BIO_free(conn->socketBio);
+
+		tcp_free(conn->tcp);
+	}
+}
+
+/**
+ * Reads exactly length bytes the way transport_read_layer() does, going on
+ * whenever the BIO asks for a retry. Returns the number of BIO_read calls
+ * that returned data, or -1.
+ */
+
+static int test_read_full(BIO* bio, BYTE* buffer, size_t length)
+{
+	int status;
+	int calls = 0;
+	size_t offset = 0;
+
+	while (offset < length)
+	{
+		status = BIO_read(bio, &buffer[offset], (int) (length - offset));
+
+		if (status <= 0)
+		{
+			if (BIO_should_retry(bio))
+				continue;
+
+			return -1;
+		}
+
+		offset += status;
+		calls++;
+	}
+
+	return calls;
+}
+
+/**
+ * A stream of TPKT PDUs of the given payload sizes.
+ */
+
+static BYTE* test_pdus_new(const size_t* payloads, int count, size_t* length)
+{
+	int index;
+	size_t offset;
+	size_t pduLength;
+	BYTE* data;
+
+	*length = 0;
+
+	for (index = 0; index < count; index++)
+		*length += 4 + payloads[index];
+
+	data = (BYTE*) malloc(*length);
+
+	if (!data)
+		return NULL;
+
+	offset = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		pduLength = 4 + payloads[index];
+
+		data[offset] = 0x03;
+		data[offset + 1] = 0x00;
+		data[offset + 2] = (BYTE) ((pduLength >> 8) & 0xFF);
+		data[offset + 3] = (BYTE) (pduLength & 0xFF);
+
+		FillMemory(&data[offset + 4], payloads[index], (BYTE) (index + 1));
+
+		offset += pduLength;
+	}
+
+	return data;
+}
+
+/**
+ * Reads every PDU of the stream, header first, and checks them against
+ * the data sent.
+ */
+
+static int test_read_pdus(TEST_CONNECTION* conn, const BYTE* data, size_t length, int count)
+{
+	int index;
+	size_t offset;
+	size_t pduLength;
+	BYTE* pdu;
+
+	pdu = (BYTE*) malloc(0x10000);
+
+	if (!pdu)
+		return -1;
+
+	offset = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		if (test_read_full(conn->tcp->bufferedBio, pdu, 4) < 0)
+			goto fail;
+
+		pduLength = (pdu[2] << 8) | pdu[3];
+
+		if ((pduLength < 4) || (offset + pduLength > length))
+			goto fail;
+
+		if (test_read_full(conn->tcp->bufferedBio, &pdu[4], pduLength - 4) < 0)
+			goto fail;
+
+		if (memcmp(pdu, &data[offset], pduLength) != 0)
+		{
+			printf("PDU %d differs from the data sent\n", index);
+			goto fail;
+		}
+
+		offset += pduLength;
+	}
+
+	free(pdu);
+	return (offset == length) ? 0 : -1;
+
+fail:
+	printf("failed reading PDU %d at offset %d\n", index, (int) offset);
+	free(pdu);
+	return -1;
+}
+
+/**
+ * Many small PDUs arriving at once cost a single read of the socket.
+ */
+
+static int test_read_ahead_small_pdus(void)
+{
+	int index;
+	int status = -1;
+	size_t length;
+	size_t payloads[64];
+	size_t segments[1];
+	BYTE* data;
+	TEST_CONNECTION conn;
+
+	for (index = 0; index < 64; index++)
+		payloads[index] = 1 + (index * 37) % 200;
+
+	data = test_pdus_new(payloads, 64, &length);
+
+	if (!data)
+		return -1;
+
+	segments[0] = length;
+
+	if (!test_connection_init(&conn, data, length, segments, 1))
+		goto out;
+
+	if (test_read_pdus(&conn, data, length, 64) < 0)
+		goto out;
+
+	if (conn.sock.reads != 1)
+	{
+		printf("%s: %d socket reads for 64 PDUs, expected 1\n", __FUNCTION__, conn.sock.reads);
+		goto out;
+	}
+
+	status = 0;
+out:
+	test_connection_uninit(&conn);
+	free(data);
+	return status;
+}
+
+/**
+ * Segment boundaries inside a header and inside a payload: a read returns
+ * only what is buffered, the next one blocks and the one after it goes
+ * back to the socket.
+ */
+
+static int test_read_ahead_partial(void)
+{
+	int status = -1;
+	size_t length;
+	size_t payloads[4] = { 7, 1000, 3, 500 };
+	size_t segments[5] = { 13, 1, 600, 420, 0x10000 };
+	BYTE* data;
+	BYTE header[4];
+	TEST_CONNECTION conn;
+
+	data = test_pdus_new(payloads, 4, &length);
+
+	if (!data)
+		return -1;
+
+	if (!test_connection_init(&conn, data, length, segments, 5))
+		goto out;
+
+	/* the first segment ends two bytes into the second header */
+
+	if (test_read_full(conn.tcp->bufferedBio, header, 4) != 1)
+		goto out;
+
+	if (BIO_pending(conn.tcp->bufferedBio) != 9)
+	{
+		printf("%s: %d bytes buffered, expected 9\n", __FUNCTION__,
+				(int) BIO_pending(conn.tcp->bufferedBio));
+		goto out;
+	}
+
+	test_connection_uninit(&conn);
+
+	if (!test_connection_init(&conn, data, length, segments, 5))
+		goto out;
+
+	if (test_read_pdus(&conn, data, length, 4) < 0)
+		goto out;
+
+	/* one read per segment plus the one that blocked after each */
+
+	if (conn.sock.reads != 9)
+	{
+		printf("%s: %d socket reads, expected 9\n", __FUNCTION__, conn.sock.reads);
+		goto out;
+	}
+
+	status = 0;
+out:
+	test_connection_uninit(&conn);
+	free(data);
+	return status;
+}
+
+/**
+ * The read-ahead buffer fills up in the middle of a PDU: the rest of it
+ * comes with the next read of the socket.
+ */
+
+static int test_read_ahead_buffer_boundary(void)
+{
+	int index;
+	int status = -1;
+	size_t length;
+	size_t payloads[8];
+	size_t segments[1];
+	BYTE* data;
+	TEST_CONNECTION conn;
+
+	/* 7 PDUs of 9000 bytes end 2536 bytes before the buffer does */
+
+	for (index = 0; index < 7; index++)
+		payloads[index] = 9000 - 4;
+
+	payloads[7] = 30000;
+
+	data = test_pdus_new(payloads, 8, &length);
+
+	if (!data)
+		return -1;
+
+	segments[0] = length;
+
+	if (!test_connection_init(&conn, data, length, segments, 1))
+		goto out;
+
+	if (test_read_pdus(&conn, data, length, 8) < 0)
+		goto out;
+
+	if (conn.sock.reads != 2)
+	{
+		printf("%s: %d socket reads, expected 2\n", __FUNCTION__, conn.sock.reads);
+		goto out;
+	}
+
+	status = 0;
+out:
+	test_connection_uninit(&conn);
+	free(data);
+	return status;
+}
+
+/**
+ * Reads of at least the read-ahead size go straight to the socket when
+ * nothing is buffered, without a copy.
+ */
+
+static int test_read_ahead_large_read(void)
+{
+	int status = -1;
+	size_t length = TCP_READ_AHEAD_SIZE + 100;
+	size_t segments[1];
+	BYTE* data;
+	BYTE* buffer;
+	TEST_CONNECTION conn;
+
+	data = (BYTE*) malloc(length);
+	buffer = (BYTE*) malloc(length);
+
+	if (!data || !buffer)
+		goto fail;
+
+	FillMemory(data, length, 0x5A);
+	segments[0] = length;
+
+	if (!test_connection_init(&conn, data, length, segments, 1))
+		goto out;
+
+	if (BIO_read(conn.tcp->bufferedBio, buffer, (int) length) != (int) length)
+		goto out;
+
+	if ((conn.sock.lastReadSize != (int) length) || BIO_pending(conn.tcp->bufferedBio))
+	{
+		printf("%s: read of %d bytes was buffered\n", __FUNCTION__, (int) length);
+		goto out;
+	}
+
+	if (memcmp(buffer, data, length) != 0)
+		goto out;
+
+	status = 0;
+out:
+	test_connection_uninit(&conn);
+fail:
+	free(data);
+	free(buffer);
+	return status;
+}
+
+/**
+ * A socket that would block makes the buffered BIO ask for a retry, and
+ * the end of the stream does not.
+ */
+
+static int test_read_ahead_blocked(void)
+{
+	int status = -1;
+	BYTE data[8];
+	BYTE buffer[8];
+	size_t segments[1] = { 8 };
+	TEST_CONNECTION conn;
+
+	ZeroMemory(data, sizeof(data));
+
+	if (!test_connection_init(&conn, data, sizeof(data), segments, 1))
+		goto out;
+
+	conn.sock.blocked = TRUE;
+
+	if ((BIO_read(conn.tcp->bufferedBio, buffer, 4) >= 0) ||
+		!BIO_should_retry(conn.tcp->bufferedBio) || !BIO_should_read(conn.tcp->bufferedBio) ||
+		!conn.tcp->readBlocked)
+	{
+		printf("%s: blocked read not reported for retry\n", __FUNCTION__);
+		goto out;
+	}
+
+	if (test_read_full(conn.tcp->bufferedBio, buffer, 8) < 0)
+		goto out;
+
+	if ((BIO_read(conn.tcp->bufferedBio, buffer, 4) != 0) ||
+		BIO_should_retry(conn.tcp->bufferedBio) || conn.tcp->readBlocked)
+	{
+		printf("%s: end of stream reported for retry\n", __FUNCTION__);
+		goto out;
+	}
+
+	status = 0;
+out:
+	test_connection_uninit(&conn);
+	return status;
+}
+
+int TestTcpReadAhead(int argc, char* argv[])
+{
+	if (test_read_ahead_small_pdus() < 0)
+		return -1;
+
+	if (test_read_ahead_partial() < 0)
+		return -1;
+
+	if (test_read_ahead_buffer_boundary() < 0)
+		return -1;
+
+	if (test_read_ahead_large_read() < 0)
+		return -1;
+
+	if (test_read_ahead_blocked() < 0)
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,359 @@
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <openssl/bio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#include "tcp.h"
+
+/**
+ * The buffered socket BIO writes through the BIO under it: the socket BIO
+ * takes all the chunks with one gather write, any other BIO one chunk at a
+ * time. What was not taken is queued and goes out with the next write or
+ * drain, in order.
+ */
+
+#define TEST_CHUNK_SIZE		3000
+
+static void test_fill(BYTE* data, size_t length, size_t offset)
+{
+	size_t index;
+
+	for (index = 0; index < length; index++)
+		data[index] = (BYTE) (((offset + index) * 7) >> 3);
+}
+
+static BOOL test_check(const BYTE* data, size_t length, size_t offset)
+{
+	size_t index;
+
+	for (index = 0; index < length; index++)
+	{
+		if (data[index] != (BYTE) (((offset + index) * 7) >> 3))
+		{
+			printf("byte %d differs from the data written\n", (int) (offset + index));
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * A BIO that takes at most a few bytes per write and blocks every other
+ * call, keeping what it was given.
+ */
+
+typedef struct _TEST_SINK
+{
+	BYTE* data;
+	size_t length;
+	size_t capacity;
+	int writes;
+} TEST_SINK;
+
+static int test_sink_write(BIO* bio, const char* buf, int size)
+{
+	TEST_SINK* sink = (TEST_SINK*) bio->ptr;
+
+	BIO_clear_retry_flags(bio);
+
+	if ((sink->writes++ % 2) == 1)
+	{
+		BIO_set_retry_write(bio);
+		return -1;
+	}
+
+	if (size > 5)
+		size = 5;
+
+	if (sink->length + size > sink->capacity)
+		return -1;
+
+	CopyMemory(&sink->data[sink->length], buf, size);
+	sink->length += size;
+
+	return size;
+}
+
+static long test_sink_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
+{
+	return (cmd == BIO_CTRL_FLUSH) ? 1 : 0;
+}
+
+static int test_sink_new(BIO* bio)
+{
+	bio->init = 1;
+	bio->flags = 0;
+	return 1;
+}
+
+static int test_sink_free(BIO* bio)
+{
+	return 1;
+}
+
+static BIO_METHOD test_sink_methods =
+{
+	BIO_TYPE_SOURCE_SINK,
+	"TestSink",
+	test_sink_write,
+	NULL,
+	NULL,
+	NULL,
+	test_sink_ctrl,
+	test_sink_new,
+	test_sink_free,
+	NULL,
+};
+
+static int test_writev_chain(void)
+{
+	int index;
+	int status = -1;
+	size_t offset;
+	BYTE data[TEST_CHUNK_SIZE];
+	DataChunk chunks[3];
+	TEST_SINK sink;
+	BIO* sinkBio = NULL;
+	rdpTcp* tcp;
+
+	ZeroMemory(&sink, sizeof(sink));
+	sink.capacity = TEST_CHUNK_SIZE * 4;
+	sink.data = (BYTE*) malloc(sink.capacity);
+	tcp = tcp_new(NULL);
+
+	if (!sink.data || !tcp)
+		goto out;
+
+	sinkBio = BIO_new(&test_sink_methods);
+	tcp->bufferedBio = BIO_new(BIO_s_buffered_socket());
+
+	if (!sinkBio || !tcp->bufferedBio)
+		goto out;
+
+	sinkBio->ptr = &sink;
+	tcp->bufferedBio->ptr = tcp;
+	tcp->bufferedBio = BIO_push(tcp->bufferedBio, sinkBio);
+	sinkBio = NULL;
+
+	offset = 0;
+
+	for (index = 0; index < 4; index++)
+	{
+		test_fill(data, sizeof(data), offset);
+
+		chunks[0].data = data;
+		chunks[0].size = 4;
+		chunks[1].data = &data[4];
+		chunks[1].size = sizeof(data) - 8;
+		chunks[2].data = &data[sizeof(data) - 4];
+		chunks[2].size = 4;
+
+		if (transport_bio_buffered_writev(tcp->bufferedBio, chunks, 3) != sizeof(data))
+		{
+			printf("%s: write %d not queued\n", __FUNCTION__, index);
+			goto out;
+		}
+
+		if (!tcp->writeBlocked)
+		{
+			printf("%s: blocked write not reported\n", __FUNCTION__);
+			goto out;
+		}
+
+		offset += sizeof(data);
+	}
+
+	while (BIO_wpending(tcp->bufferedBio))
+	{
+		if (!transport_bio_buffered_drain(tcp->bufferedBio))
+			goto out;
+	}
+
+	if ((sink.length != offset) || !test_check(sink.data, sink.length, 0))
+		goto out;
+
+	status = 0;
+out:
+	if (tcp)
+	{
+		if (tcp->bufferedBio)
+			BIO_free_all(tcp->bufferedBio);
+
+		tcp_free(tcp);
+	}
+
+	if (sinkBio)
+		BIO_free(sinkBio);
+
+	free(sink.data);
+	return status;
+}
+
+#ifndef _WIN32
+
+/**
+ * On a socket that stops taking data: every write is accepted and queued,
+ * the socket BIO reports the retry, and the queue drains in order once the
+ * peer reads. A closed peer is an error, not a retry.
+ */
+
+static int test_writev_socket(void)
+{
+	int index;
+	int length;
+	int status = -1;
+	int sndbuf = 4096;
+	int fds[2] = { -1, -1 };
+	size_t offset;
+	size_t received;
+	BYTE* data;
+	BYTE* buffer;
+	DataChunk chunks[3];
+	BIO* socketBio = NULL;
+	rdpTcp* tcp = NULL;
+
+	data = (BYTE*) malloc(TEST_CHUNK_SIZE);
+	buffer = (BYTE*) malloc(0x10000);
+
+	if (!data || !buffer)
+		goto out;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		goto out;
+
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, (void*) &sndbuf, sizeof(sndbuf));
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+	tcp = tcp_new(NULL);
+
+	if (!tcp)
+		goto out;
+
+	socketBio = BIO_new(BIO_s_simple_socket());
+	tcp->bufferedBio = BIO_new(BIO_s_buffered_socket());
+
+	if (!socketBio || !tcp->bufferedBio)
+		goto out;
+
+	BIO_set_fd(socketBio, fds[0], BIO_CLOSE);
+	fds[0] = -1;
+
+	tcp->bufferedBio->ptr = tcp;
+	tcp->bufferedBio = BIO_push(tcp->bufferedBio, socketBio);
+
+	offset = 0;
+
+	for (index = 0; !tcp->writeBlocked; index++)
+	{
+		if (index >= 1000)
+		{
+			printf("%s: socket never blocked\n", __FUNCTION__);
+			goto out;
+		}
+
+		test_fill(data, TEST_CHUNK_SIZE, offset);
+
+		chunks[0].data = data;
+		chunks[0].size = 4;
+		chunks[1].data = &data[4];
+		chunks[1].size = TEST_CHUNK_SIZE - 4;
+		chunks[2].data = NULL;
+		chunks[2].size = 0;
+
+		if (transport_bio_buffered_writev(tcp->bufferedBio, chunks, 3) != TEST_CHUNK_SIZE)
+		{
+			printf("%s: write %d failed\n", __FUNCTION__, index);
+			goto out;
+		}
+
+		offset += TEST_CHUNK_SIZE;
+	}
+
+	if (!BIO_should_retry(socketBio) || !BIO_should_write(socketBio) ||
+		!BIO_wpending(tcp->bufferedBio))
+	{
+		printf("%s: blocked socket not reported for retry\n", __FUNCTION__);
+		goto out;
+	}
+
+	received = 0;
+
+	while (received < offset)
+	{
+		length = (int) read(fds[1], buffer, 0x10000);
+
+		if (length > 0)
+		{
+			if (!test_check(buffer, length, received))
+				goto out;
+
+			received += length;
+		}
+
+		if (!transport_bio_buffered_drain(tcp->bufferedBio))
+			goto out;
+	}
+
+	if (BIO_wpending(tcp->bufferedBio))
+		goto out;
+
+	close(fds[1]);
+	fds[1] = -1;
+
+	test_fill(data, TEST_CHUNK_SIZE, 0);
+	chunks[0].data = data;
+	chunks[0].size = TEST_CHUNK_SIZE;
+
+	if ((transport_bio_buffered_writev(tcp->bufferedBio, chunks, 1) >= 0) ||
+		BIO_should_retry(socketBio) || tcp->writeBlocked)
+	{
+		printf("%s: write to a closed peer not reported as an error\n", __FUNCTION__);
+		goto out;
+	}
+
+	status = 0;
+out:
+	if (tcp)
+	{
+		if (tcp->bufferedBio)
+			BIO_free_all(tcp->bufferedBio);
+		else if (socketBio)
+			BIO_free(socketBio);
+
+		tcp_free(tcp);
+	}
+
+	if (fds[0] >= 0)
+		close(fds[0]);
+
+	if (fds[1] >= 0)
+		close(fds[1]);
+
+	free(data);
+	free(buffer);
+	return status;
+}
+
+#endif
+
+int TestTcpWritev(int argc, char* argv[])
+{
+	if (test_writev_chain() < 0)
+		return -1;
+
+#ifndef _WIN32
+	if (test_writev_socket() < 0)
+		return -1;
+#endif
+
+	return 0;
+}
@@ -804,12 +804,52 @@ int transport_read_pdu(rdpTransport* transport, wStream* s)
 	return Stream_Length(s);
 }
 
-BOOL transport_bio_buffered_drain(BIO* bio);
+static rdpMetrics* transport_get_metrics(rdpTransport* transport)
+{
+	rdpRdp* rdp = (rdpRdp*) transport->rdp;
+
+	if (!rdp || !rdp->context)
+		return NULL;
+
+	return rdp->context->metrics;
+}
+
+static int transport_flush_output(rdpTransport* transport)
+{
+	/* blocking transport, we must ensure the write buffer is really empty */
+	UINT64 begin;
+	rdpTcp* out = transport->TcpOut;
+
+	if (!out->writeBlocked)
+		return 0;
+
+	begin = metrics_get_timestamp();
+
+	while (out->writeBlocked)
+	{
+		if (transport_wait_for_write(transport) < 0)
+		{
+			WLog_ERR(TAG, "error when selecting for write");
+			return -1;
+		}
+
+		if (!transport_bio_buffered_drain(out->bufferedBio))
+		{
+			WLog_ERR(TAG, "error when draining outputBuffer");
+			return -1;
+		}
+	}
+
+	metrics_write_blocked(transport_get_metrics(transport), metrics_get_timestamp() - begin);
+
+	return 0;
+}
 
 int transport_write(rdpTransport* transport, wStream* s)
 {
 	int length;
 	int status = -1;
+	UINT64 begin;
 	EnterCriticalSection(&(transport->WriteLock));
 	length = Stream_GetPosition(s);
 	Stream_SetPosition(s, 0);
@@ -845,38 +885,113 @@ int transport_write(rdpTransport* transport, wStream* s)
 			if (!transport->blocking)
 				return status;
 
+			begin = metrics_get_timestamp();
+
 			if (transport_wait_for_write(transport) < 0)
 			{
 				WLog_ERR(TAG, "error when selecting for write");
 				return -1;
 			}
 
+			metrics_write_blocked(transport_get_metrics(transport), metrics_get_timestamp() - begin);
+
 			continue;
 		}
 
 		if (transport->blocking || transport->settings->WaitForOutputBufferFlush)
 		{
-			/* blocking transport, we must ensure the write buffer is really empty */
-			rdpTcp* out = transport->TcpOut;
+			if (transport_flush_output(transport) < 0)
+				return -1;
+		}
 
-			while (out->writeBlocked)
+		length -= status;
+		Stream_Seek(s, status);
+	}
+
+	if (status < 0)
+	{
+		/* A write error indicates that the peer has dropped the connection */
+		transport->layer = TRANSPORT_LAYER_CLOSED;
+	}
+
+	if (s->pool)
+		Stream_Release(s);
+
+	LeaveCriticalSection(&(transport->WriteLock));
+	return status;
+}
+
+/**
+ * Gather write: on a plain TCP transport the chunks go out with one sendmsg()
+ * straight from the caller's buffers. The TLS and gateway BIOs need contiguous
+ * input, so for them the chunks are coalesced into full-sized records, one
+ * BIO_write() each.
+ */
+
+int transport_writev(rdpTransport* transport, const DataChunk* chunks, int count)
+{
+	int index;
+	int status = 0;
+	size_t size;
+	size_t offset;
+	wStream* s = NULL;
+
+	if (transport->frontBio != transport->TcpOut->bufferedBio)
+	{
+		for (index = 0; index < count; index++)
+		{
+			offset = 0;
+
+			while (offset < chunks[index].size)
 			{
-				if (transport_wait_for_write(transport) < 0)
+				if (!s)
 				{
-					WLog_ERR(TAG, "error when selecting for write");
-					return -1;
+					s = transport_send_stream_init(transport, SSL3_RT_MAX_PLAIN_LENGTH);
+
+					if (!s)
+						return -1;
 				}
 
-				if (!transport_bio_buffered_drain(out->bufferedBio))
+				size = chunks[index].size - offset;
+
+				if (size > Stream_Capacity(s) - Stream_GetPosition(s))
+					size = Stream_Capacity(s) - Stream_GetPosition(s);
+
+				Stream_Write(s, &chunks[index].data[offset], size);
+				offset += size;
+
+				if (Stream_GetPosition(s) == Stream_Capacity(s))
 				{
-					WLog_ERR(TAG, "error when draining outputBuffer");
-					return -1;
+					status = transport_write(transport, s);
+					s = NULL;
+
+					if (status < 0)
+						return status;
 				}
 			}
 		}
 
-		length -= status;
-		Stream_Seek(s, status);
+		if (s)
+			status = transport_write(transport, s);
+
+		return status;
+	}
+
+	EnterCriticalSection(&(transport->WriteLock));
+
+	for (index = 0; index < count; index++)
+	{
+		if (chunks[index].size > 0)
+			WLog_Packet(transport->log, WLOG_TRACE, (BYTE*) chunks[index].data,
+					chunks[index].size, WLOG_PACKET_OUTBOUND);
+	}
+
+	status = transport_bio_buffered_writev(transport->frontBio, chunks, count);
+
+	if ((status >= 0) && (transport->blocking || transport->settings->WaitForOutputBufferFlush))
+	{
+		if (transport_flush_output(transport) < 0)
+			status = -1;
 	}
 
 	if (status < 0)
@@ -885,9 +1000,6 @@ int transport_write(rdpTransport* transport, wStream* s)
 		transport->layer = TRANSPORT_LAYER_CLOSED;
 	}
 
-	if (s->pool)
-		Stream_Release(s);
-
 	LeaveCriticalSection(&(transport->WriteLock));
 	return status;
 }
@@ -1045,6 +1157,13 @@ int transport_check_fds(rdpTransport* transport)
 		/* session redirection or activation */
 		if (recv_status == 1 || recv_status == 2)
 		{
+			/**
+			 * PDUs already read ahead from the socket will not signal it again,
+			 * wake up the next wait through the receive event instead.
+			 */
+			if (transport->frontBio && (BIO_pending(transport->frontBio) > 0))
+				SetEvent(transport->ReceiveEvent);
+
 			return recv_status;
 		}
 
@@ -1076,6 +1195,10 @@ BOOL transport_set_blocking_mode(rdpTransport* transport, BOOL blocking)
 		tsg_set_blocking_mode(transport->tsg, blocking);
 	}
 
+	/* data read ahead by blocking reads is not signalled by the socket */
+	if (!blocking && transport->frontBio && (BIO_pending(transport->frontBio) > 0))
+		SetEvent(transport->ReceiveEvent);
+
 	return status;
 }
 
@@ -1089,11 +1212,41 @@ void transport_set_nla_mode(rdpTransport* transport, BOOL NlaMode)
 	transport->NlaMode = NlaMode;
 }
 
+static BOOL transport_client_thread_handles_changed(HANDLE* registered, int* fds,
+		DWORD* pCount, HANDLE* handles, DWORD nCount)
+{
+	int fd;
+	DWORD index;
+	BOOL changed = (*pCount != nCount);
+
+	/* an event handle can be kept while its file descriptor is replaced */
+
+	for (index = 0; index < nCount; index++)
+	{
+		fd = GetEventFileDescriptor(handles[index]);
+
+		if ((registered[index] != handles[index]) || (fds[index] != fd))
+			changed = TRUE;
+
+		registered[index] = handles[index];
+		fds[index] = fd;
+	}
+
+	*pCount = nCount;
+	return changed;
+}
+
 static void* transport_client_thread(void* arg)
 {
+	DWORD index;
 	DWORD status;
 	DWORD nCount;
+	UINT64 signaled;
 	HANDLE handles[8];
+	HANDLE registered[8];
+	int fds[8];
+	DWORD nRegistered = 0;
+	wWaitSet* waitSet;
 	freerdp* instance;
 	rdpContext* context;
 	rdpTransport* transport;
@@ -1119,12 +1272,41 @@ static void* transport_client_thread(void* arg)
 
 	WLog_Print(transport->log, WLOG_DEBUG, "Asynchronous transport activated");
 
+	waitSet = WaitSet_New();
+
+	if (!waitSet)
+	{
+		WLog_Print(transport->log, WLOG_ERROR, "Failed to create the transport wait set");
+		ExitThread(0);
+		return NULL;
+	}
+
 	while (1)
 	{
 		nCount = 0;
 		handles[nCount++] = transport->stopEvent;
 		transport_get_read_handles(transport, (HANDLE*) &handles, &nCount);
-		status = WaitForMultipleObjects(nCount, handles, FALSE, INFINITE);
+
+		/* the read handles rarely change: register them again only when they do */
+
+		if (transport_client_thread_handles_changed(registered, fds, &nRegistered, handles, nCount))
+		{
+			WaitSet_Clear(waitSet);
+
+			for (index = 0; index < nCount; index++)
+			{
+				if (WaitSet_Add(waitSet, handles[index]) < 0)
+					break;
+			}
+
+			if (index < nCount)
+			{
+				WLog_Print(transport->log, WLOG_ERROR, "Failed to register the transport handles");
+				break;
+			}
+		}
+
+		status = WaitSet_Wait(waitSet, INFINITE, &signaled);
 
 		if (transport->layer == TRANSPORT_LAYER_CLOSED)
 		{
@@ -1132,9 +1314,15 @@ static void* transport_client_thread(void* arg)
 			rdp_set_error_info(rdp, ERRINFO_PEER_DISCONNECTED);
 			break;
 		}
+		else if (status == WAIT_FAILED)
+		{
+			WLog_Print(transport->log, WLOG_ERROR, "WaitSet_Wait failed");
+			break;
+		}
 		else if (status != WAIT_TIMEOUT)
 		{
-			if (WaitForSingleObject(transport->stopEvent, 0) == WAIT_OBJECT_0)
+			/* the stop event is always the first handle */
+			if (signaled & 1)
 				break;
 
 			if (!freerdp_check_fds(instance))
@@ -1143,6 +1331,7 @@ static void* transport_client_thread(void* arg)
 		}
 	}
 
+	WaitSet_Free(waitSet);
 	WLog_Print(transport->log, WLOG_DEBUG, "Terminating transport thread");
 	ExitThread(0);
 	return NULL;
@@ -897,6 +897,9 @@ static void update_send_surface_frame_marker(rdpContext* context, SURFACE_FRAME_
 	update_write_surfcmd_frame_marker(s, surfaceFrameMarker->frameAction, surfaceFrameMarker->frameId);
 	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_SURFCMDS, s, FALSE);
 
+	if (surfaceFrameMarker->frameAction == SURFACECMD_FRAMEACTION_END)
+		metrics_frame_sent(context->metrics, surfaceFrameMarker->frameId);
+
 	update_force_flush(context);
 
 	Stream_Release(s);
@@ -924,6 +927,9 @@ static void update_send_surface_frame_bits(rdpContext* context, SURFACE_BITS_COM
 
 	fastpath_send_update_pdu(rdp->fastpath, FASTPATH_UPDATETYPE_SURFCMDS, s, cmd->skipCompression);
 
+	if (last)
+		metrics_frame_sent(context->metrics, frameId);
+
 	update_force_flush(context);
 
 	Stream_Release(s);
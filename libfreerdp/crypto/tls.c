@@ -877,7 +877,7 @@ BIO *findBufferedBio(BIO *front)
 
 int tls_write_all(rdpTls* tls, const BYTE* data, int length)
 {
-	int status, nchunks, commitedBytes;
+	int status;
 	rdpTcp *tcp;
 #ifdef HAVE_POLL_H
 	struct pollfd pollfds;
@@ -887,8 +887,6 @@ int tls_write_all(rdpTls* tls, const BYTE* data, int length)
 	struct timeval tv;
 #endif
 	BIO* bio = tls->bio;
-	DataChunk chunks[2];
-
 	BIO* bufferedBio = findBufferedBio(bio);
 
 	if (!bufferedBio)
@@ -967,59 +965,37 @@ int tls_write_all(rdpTls* tls, const BYTE* data, int length)
 	while (TRUE);
 
 	/* make sure the output buffer is empty */
-	commitedBytes = 0;
-	while ((nchunks = ringbuffer_peek(&tcp->xmitBuffer, chunks, ringbuffer_used(&tcp->xmitBuffer))))
+	while (ringbuffer_used(&tcp->xmitBuffer))
 	{
-		int i;
-
-		for (i = 0; i < nchunks; i++)
-		{
-			while (chunks[i].size)
-			{
-				status = BIO_write(tcp->socketBio, chunks[i].data, chunks[i].size);
-
-				if (status > 0)
-				{
-					chunks[i].size -= status;
-					chunks[i].data += status;
-					commitedBytes += status;
-					continue;
-				}
+		if (!transport_bio_buffered_drain(bufferedBio))
+			return -1;
 
-				if (!BIO_should_retry(tcp->socketBio))
-					goto out_fail;
+		if (!tcp->writeBlocked)
+			continue;
 
 #ifdef HAVE_POLL_H
-				pollfds.fd = tcp->sockfd;
-				pollfds.events = POLLIN;
-				pollfds.revents = 0;
+		pollfds.fd = tcp->sockfd;
+		pollfds.events = POLLOUT;
+		pollfds.revents = 0;
 
-				do
-				{
-					status = poll(&pollfds, 1, 100);
-				}
-				while ((status < 0) && (errno == EINTR));
+		do
+		{
+			status = poll(&pollfds, 1, 100);
+		}
+		while ((status < 0) && (errno == EINTR));
 #else
-				FD_ZERO(&rset);
-				FD_SET(tcp->sockfd, &rset);
-				tv.tv_sec = 0;
-				tv.tv_usec = 100 * 1000;
+		FD_ZERO(&wset);
+		FD_SET(tcp->sockfd, &wset);
+		tv.tv_sec = 0;
+		tv.tv_usec = 100 * 1000;
 
-				status = _select(tcp->sockfd + 1, &rset, NULL, NULL, &tv);
+		status = _select(tcp->sockfd + 1, NULL, &wset, NULL, &tv);
 #endif
-				if (status < 0)
-					goto out_fail;
-			}
-
-		}
+		if (status < 0)
+			return -1;
 	}
 
-	ringbuffer_commit_read_bytes(&tcp->xmitBuffer, commitedBytes);
 	return length;
-
-out_fail:
-	ringbuffer_commit_read_bytes(&tcp->xmitBuffer, commitedBytes);
-	return -1;
 }
 
 int tls_set_alert_code(rdpTls* tls, int level, int description)
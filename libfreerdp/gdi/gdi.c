@@ -26,12 +26,15 @@
 #include <stdlib.h>
 
 #include <winpr/crt.h>
+#include <winpr/pool.h>
 #include <winpr/image.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/api.h>
 #include <freerdp/log.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/constants.h>
+#include <freerdp/primitives.h>
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/rfx.h>
@@ -440,46 +443,240 @@ void gdi_bitmap_free_ex(gdiBitmap* bitmap)
 	}
 }
 
-static void gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmapUpdate)
+/**
+ * Bitmap updates with several rectangles are decoded by a set of workers,
+ * each with its own interleaved and planar contexts and output buffer.
+ * Rectangle i goes to worker (i % count), and the decoded rectangles are
+ * copied to the primary surface in update order once every worker is done.
+ */
+
+struct gdi_bitmap_worker
+{
+	rdpGdi* gdi;
+	PTP_WORK work;
+	UINT32 index;
+	UINT32 count;
+	BITMAP_UPDATE* bitmapUpdate;
+	BITMAP_INTERLEAVED_CONTEXT* interleaved;
+	BITMAP_PLANAR_CONTEXT* planar;
+	size_t size;
+	BYTE* buffer;
+};
+typedef struct gdi_bitmap_worker gdiBitmapWorker;
+
+struct gdi_bitmap_decoder
+{
+	UINT32 count;
+	PTP_POOL pool;
+	TP_CALLBACK_ENVIRON environment;
+	gdiBitmapWorker* workers;
+	UINT32 maxRects;
+	size_t* offsets; /* offset of each decoded rectangle in its worker buffer */
+};
+
+#define GDI_BITMAP_DECODE_FAILED	((size_t) -1)
+
+static int gdi_bitmap_decode(rdpGdi* gdi, BITMAP_DATA* bitmap, BITMAP_INTERLEAVED_CONTEXT* interleaved,
+		BITMAP_PLANAR_CONTEXT* planar, BYTE* pDstData)
 {
 	int status;
-	int nXDst;
-	int nYDst;
-	int nXSrc;
-	int nYSrc;
+	UINT64 begin;
+	UINT32 SrcFormat;
+
+	if (bitmap->compressed)
+	{
+		if (bitmap->bitsPerPixel < 32)
+		{
+			status = interleaved_decompress(interleaved, bitmap->bitmapDataStream, bitmap->bitmapLength,
+					bitmap->bitsPerPixel, &pDstData, gdi->format, -1, 0, 0, bitmap->width, bitmap->height,
+					gdi->palette);
+		}
+		else
+		{
+			begin = metrics_get_timestamp();
+
+			status = planar_decompress(planar, bitmap->bitmapDataStream, bitmap->bitmapLength, &pDstData,
+					gdi->format, -1, 0, 0, bitmap->width, bitmap->height, TRUE);
+
+			metrics_codec_decode(gdi->context->metrics, METRICS_CODEC_PLANAR, metrics_get_timestamp() - begin);
+		}
+	}
+	else
+	{
+		SrcFormat = gdi_get_pixel_format(bitmap->bitsPerPixel, TRUE);
+
+		status = freerdp_image_copy(pDstData, gdi->format, -1, 0, 0,
+				bitmap->width, bitmap->height, bitmap->bitmapDataStream, SrcFormat, -1, 0, 0, gdi->palette);
+	}
+
+	return status;
+}
+
+static void gdi_bitmap_blit(rdpGdi* gdi, BITMAP_DATA* bitmap, BYTE* pSrcData)
+{
 	int nWidth;
 	int nHeight;
 	int nSrcStep;
 	int nDstStep;
+
+	nSrcStep = bitmap->width * gdi->bytesPerPixel;
+	nDstStep = gdi->width * gdi->bytesPerPixel;
+
+	nWidth = bitmap->destRight - bitmap->destLeft + 1; /* clip width */
+	nHeight = bitmap->destBottom - bitmap->destTop + 1; /* clip height */
+
+	freerdp_image_copy(gdi->primary_buffer, gdi->format, nDstStep, bitmap->destLeft, bitmap->destTop,
+			nWidth, nHeight, pSrcData, gdi->format, nSrcStep, 0, 0, gdi->palette);
+
+	gdi_InvalidateRegion(gdi->primary->hdc, bitmap->destLeft, bitmap->destTop, nWidth, nHeight);
+}
+
+/**
+ * Size of a decoded rectangle in a worker buffer, 16-byte aligned.
+ * Fails when it does not fit a size_t.
+ */
+
+static BOOL gdi_bitmap_decoded_size(BITMAP_DATA* bitmap, size_t* pSize)
+{
+	if (bitmap->width && (bitmap->height > ((((size_t) -1) - 15) / 4) / bitmap->width))
+		return FALSE;
+
+	*pSize = ((((size_t) bitmap->width) * bitmap->height * 4) + 15) & ~((size_t) 15);
+	return TRUE;
+}
+
+static void gdi_bitmap_decode_worker(gdiBitmapWorker* worker)
+{
 	UINT32 index;
-	BYTE* pSrcData;
-	BYTE* pDstData;
-	UINT32 SrcSize;
-	BOOL compressed;
-	UINT32 SrcFormat;
-	UINT32 bitsPerPixel;
+	size_t size = 0;
+	size_t offset = 0;
+	size_t length;
 	BITMAP_DATA* bitmap;
-	rdpGdi* gdi = context->gdi;
-	rdpCodecs* codecs = context->codecs;
+	rdpGdi* gdi = worker->gdi;
+	BITMAP_UPDATE* bitmapUpdate = worker->bitmapUpdate;
+	size_t* offsets = gdi->bitmapDecoder->offsets;
+
+	for (index = worker->index; index < bitmapUpdate->number; index += worker->count)
+	{
+		bitmap = &(bitmapUpdate->rectangles[index]);
+
+		if (!gdi_bitmap_decoded_size(bitmap, &length) || (length > ((size_t) -1) - size))
+		{
+			WLog_ERR(TAG, "bitmap update too large");
+			return;
+		}
+
+		size += length;
+	}
+
+	if (worker->size < size)
+	{
+		BYTE* buffer = (BYTE*) _aligned_realloc(worker->buffer, size, 16);
+
+		if (!buffer)
+			return;
+
+		worker->buffer = buffer;
+		worker->size = size;
+	}
+
+	for (index = worker->index; index < bitmapUpdate->number; index += worker->count)
+	{
+		bitmap = &(bitmapUpdate->rectangles[index]);
+
+		if (gdi_bitmap_decode(gdi, bitmap, worker->interleaved, worker->planar, &(worker->buffer[offset])) < 0)
+			return;
+
+		gdi_bitmap_decoded_size(bitmap, &length);
+		offsets[index] = offset;
+		offset += length;
+	}
+}
+
+static void CALLBACK gdi_bitmap_decode_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	gdi_bitmap_decode_worker((gdiBitmapWorker*) context);
+}
+
+static BOOL gdi_bitmap_update_parallel(rdpGdi* gdi, BITMAP_UPDATE* bitmapUpdate)
+{
+	UINT32 index;
+	UINT32 count;
+	BITMAP_DATA* bitmap;
+	gdiBitmapWorker* worker;
+	gdiBitmapDecoder* decoder = gdi->bitmapDecoder;
+
+	if (decoder->maxRects < bitmapUpdate->number)
+	{
+		size_t* offsets = (size_t*) realloc(decoder->offsets, bitmapUpdate->number * sizeof(size_t));
+
+		if (!offsets)
+			return FALSE;
+
+		decoder->offsets = offsets;
+		decoder->maxRects = bitmapUpdate->number;
+	}
+
+	for (index = 0; index < bitmapUpdate->number; index++)
+		decoder->offsets[index] = GDI_BITMAP_DECODE_FAILED;
+
+	count = (decoder->count < bitmapUpdate->number) ? decoder->count : bitmapUpdate->number;
+
+	for (index = 0; index < count; index++)
+	{
+		worker = &(decoder->workers[index]);
+		worker->count = count;
+		worker->bitmapUpdate = bitmapUpdate;
+	}
+
+	for (index = 1; index < count; index++)
+		SubmitThreadpoolWork(decoder->workers[index].work);
+
+	gdi_bitmap_decode_worker(&(decoder->workers[0]));
+
+	for (index = 1; index < count; index++)
+		WaitForThreadpoolWorkCallbacks(decoder->workers[index].work, FALSE);
+
+	/* blit in update order, so that overlapping rectangles end up as if decoded serially */
 
 	for (index = 0; index < bitmapUpdate->number; index++)
 	{
 		bitmap = &(bitmapUpdate->rectangles[index]);
 
-		nXSrc = 0;
-		nYSrc = 0;
+		if (decoder->offsets[index] == GDI_BITMAP_DECODE_FAILED)
+			return FALSE;
 
-		nXDst = bitmap->destLeft;
-		nYDst = bitmap->destTop;
+		worker = &(decoder->workers[index % count]);
+		gdi_bitmap_blit(gdi, bitmap, &(worker->buffer[decoder->offsets[index]]));
+	}
 
-		nWidth = bitmap->width;
-		nHeight = bitmap->height;
+	return TRUE;
+}
+
+static void gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmapUpdate)
+{
+	int status;
+	int nWidth;
+	int nHeight;
+	UINT32 index;
+	BITMAP_DATA* bitmap;
+	rdpGdi* gdi = context->gdi;
+	rdpCodecs* codecs = context->codecs;
+
+	if (gdi->bitmapDecoder && (bitmapUpdate->number > 1))
+	{
+		if (!gdi_bitmap_update_parallel(gdi, bitmapUpdate))
+			WLog_ERR(TAG, "bitmap decompression failure");
+
+		return;
+	}
 
-		pSrcData = bitmap->bitmapDataStream;
-		SrcSize = bitmap->bitmapLength;
+	for (index = 0; index < bitmapUpdate->number; index++)
+	{
+		bitmap = &(bitmapUpdate->rectangles[index]);
 
-		compressed = bitmap->compressed;
-		bitsPerPixel = bitmap->bitsPerPixel;
+		nWidth = bitmap->width;
+		nHeight = bitmap->height;
 
 		if (gdi->bitmap_size < (nWidth * nHeight * 4))
 		{
@@ -490,57 +687,142 @@ static void gdi_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmapUpdate)
 				return;
 		}
 
-		if (compressed)
+		if (bitmap->compressed)
+			freerdp_client_codecs_prepare(codecs, (bitmap->bitsPerPixel < 32) ?
+					FREERDP_CODEC_INTERLEAVED : FREERDP_CODEC_PLANAR);
+
+		status = gdi_bitmap_decode(gdi, bitmap, codecs->interleaved, codecs->planar, gdi->bitmap_buffer);
+
+		if (status < 0)
 		{
-			pDstData = gdi->bitmap_buffer;
+			WLog_ERR(TAG, "bitmap decompression failure");
+			return;
+		}
 
-			if (bitsPerPixel < 32)
-			{
-				freerdp_client_codecs_prepare(codecs, FREERDP_CODEC_INTERLEAVED);
+		gdi_bitmap_blit(gdi, bitmap, gdi->bitmap_buffer);
+	}
+}
 
-				status = interleaved_decompress(codecs->interleaved, pSrcData, SrcSize, bitsPerPixel,
-						&pDstData, gdi->format, -1, 0, 0, nWidth, nHeight, gdi->palette);
-			}
-			else
-			{
-				freerdp_client_codecs_prepare(codecs, FREERDP_CODEC_PLANAR);
+static void gdi_bitmap_decoder_free(gdiBitmapDecoder* decoder)
+{
+	UINT32 index;
+	gdiBitmapWorker* worker;
 
-				status = planar_decompress(codecs->planar, pSrcData, SrcSize, &pDstData,
-						gdi->format, -1, 0, 0, nWidth, nHeight, TRUE);
-			}
+	if (!decoder)
+		return;
+
+	if (decoder->workers)
+	{
+		for (index = 0; index < decoder->count; index++)
+		{
+			worker = &(decoder->workers[index]);
 
-			if (status < 0)
+			if (worker->work)
 			{
-				WLog_ERR(TAG, "bitmap decompression failure");
-				return;
+				WaitForThreadpoolWorkCallbacks(worker->work, TRUE);
+				CloseThreadpoolWork(worker->work);
 			}
 
-			pSrcData = gdi->bitmap_buffer;
+			bitmap_interleaved_context_free(worker->interleaved);
+			freerdp_bitmap_planar_context_free(worker->planar);
+			_aligned_free(worker->buffer);
 		}
-		else
-		{
-			pDstData = gdi->bitmap_buffer;
-			SrcFormat = gdi_get_pixel_format(bitsPerPixel, TRUE);
 
-			status = freerdp_image_copy(pDstData, gdi->format, -1, 0, 0,
-						nWidth, nHeight, pSrcData, SrcFormat, -1, 0, 0, gdi->palette);
+		free(decoder->workers);
+	}
 
-			pSrcData = gdi->bitmap_buffer;
-		}
+	if (decoder->pool)
+	{
+		CloseThreadpool(decoder->pool);
+		DestroyThreadpoolEnvironment(&(decoder->environment));
+	}
+
+	free(decoder->offsets);
+	free(decoder);
+}
+
+/**
+ * Sets the number of threads decoding multi-rectangle bitmap updates.
+ * A count of 0 uses one thread per processor, 1 decodes every rectangle
+ * on the calling thread.
+ */
+
+int gdi_set_bitmap_decode_threads(rdpGdi* gdi, UINT32 count)
+{
+	UINT32 index;
+	SYSTEM_INFO sysinfo;
+	gdiBitmapWorker* worker;
+	gdiBitmapDecoder* decoder;
+
+	if (!gdi)
+		return -1;
+
+	gdi_bitmap_decoder_free(gdi->bitmapDecoder);
+	gdi->bitmapDecoder = NULL;
+
+	if (!count)
+	{
+		GetNativeSystemInfo(&sysinfo);
+		count = sysinfo.dwNumberOfProcessors;
+	}
 
-		nSrcStep = nWidth * gdi->bytesPerPixel;
+	if (count < 2)
+		return 1;
 
-		pDstData = gdi->primary_buffer;
-		nDstStep = gdi->width * gdi->bytesPerPixel;
+	decoder = (gdiBitmapDecoder*) calloc(1, sizeof(gdiBitmapDecoder));
 
-		nWidth = bitmap->destRight - bitmap->destLeft + 1; /* clip width */
-		nHeight = bitmap->destBottom - bitmap->destTop + 1; /* clip height */
+	if (!decoder)
+		return -1;
+
+	decoder->workers = (gdiBitmapWorker*) calloc(count, sizeof(gdiBitmapWorker));
+
+	if (!decoder->workers)
+		goto fail;
+
+	decoder->count = count;
+
+	/* initialize the primitives before any worker calls primitives_get() */
+	primitives_get();
+
+	decoder->pool = CreateThreadpool(NULL);
+
+	if (!decoder->pool)
+		goto fail;
+
+	InitializeThreadpoolEnvironment(&(decoder->environment));
+	SetThreadpoolCallbackPool(&(decoder->environment), decoder->pool);
+	SetThreadpoolThreadMinimum(decoder->pool, count - 1);
+	SetThreadpoolThreadMaximum(decoder->pool, count - 1);
+
+	for (index = 0; index < count; index++)
+	{
+		worker = &(decoder->workers[index]);
+
+		worker->gdi = gdi;
+		worker->index = index;
+		worker->interleaved = bitmap_interleaved_context_new(FALSE);
+		worker->planar = freerdp_bitmap_planar_context_new(FALSE, 64, 64);
 
-		status = freerdp_image_copy(pDstData, gdi->format, nDstStep, nXDst, nYDst,
-				nWidth, nHeight, pSrcData, gdi->format, nSrcStep, nXSrc, nYSrc, gdi->palette);
+		if (!worker->interleaved || !worker->planar)
+			goto fail;
 
-		gdi_InvalidateRegion(gdi->primary->hdc, nXDst, nYDst, nWidth, nHeight);
+		if (index > 0)
+		{
+			worker->work = CreateThreadpoolWork((PTP_WORK_CALLBACK) gdi_bitmap_decode_work_callback,
+					(void*) worker, &(decoder->environment));
+
+			if (!worker->work)
+				goto fail;
+		}
 	}
+
+	gdi->bitmapDecoder = decoder;
+
+	return 1;
+
+fail:
+	gdi_bitmap_decoder_free(decoder);
+	return -1;
 }
 
 static void gdi_palette_update(rdpContext* context, PALETTE_UPDATE* palette)
@@ -912,6 +1194,7 @@ static void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
 	int tx, ty;
 	BYTE* pSrcData;
 	BYTE* pDstData;
+	UINT64 begin;
 	RFX_MESSAGE* message;
 	rdpGdi* gdi = context->gdi;
 
@@ -924,8 +1207,12 @@ static void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
 	{
 		freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_REMOTEFX);
 
+		begin = metrics_get_timestamp();
+
 		message = rfx_process_message(gdi->codecs->rfx, cmd->bitmapData, cmd->bitmapDataLength);
 
+		metrics_codec_decode(context->metrics, METRICS_CODEC_RFX, metrics_get_timestamp() - begin);
+
 		/* blit each tile */
 		for (i = 0; i < message->numTiles; i++)
 		{
@@ -965,8 +1252,12 @@ static void gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
 	{
 		freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_NSCODEC);
 
+		begin = metrics_get_timestamp();
+
 		nsc_process_message(gdi->codecs->nsc, cmd->bpp, cmd->width, cmd->height, cmd->bitmapData, cmd->bitmapDataLength);
 
+		metrics_codec_decode(context->metrics, METRICS_CODEC_NSC, metrics_get_timestamp() - begin);
+
 		if (gdi->bitmap_size < (cmd->width * cmd->height * 4))
 		{
 			gdi->bitmap_size = cmd->width * cmd->height * 4;
@@ -1226,6 +1517,8 @@ int gdi_init(freerdp* instance, UINT32 flags, BYTE* buffer)
 
 	instance->update->BitmapUpdate = gdi_bitmap_update;
 
+	gdi_set_bitmap_decode_threads(gdi, 0);
+
 	return 0;
 }
 
@@ -1240,6 +1533,7 @@ void gdi_free(freerdp* instance)
 		gdi_bitmap_free_ex(gdi->image);
 		gdi_DeleteDC(gdi->hdc);
 		_aligned_free(gdi->bitmap_buffer);
+		gdi_bitmap_decoder_free(gdi->bitmapDecoder);
 		free(gdi);
 	}
 	
@@ -177,6 +177,7 @@ int gdi_SurfaceCommand_Uncompressed(rdpGdi* gdi, RdpgfxClientContext* context, R
 
 int gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
+	UINT64 begin;
 	int j;
 	UINT16 i;
 	RFX_RECT* rect;
@@ -199,8 +200,12 @@ int gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* context, RDPGF
 	if (!surface)
 		return -1;
 
+	begin = metrics_get_timestamp();
+
 	message = rfx_process_message(gdi->codecs->rfx, cmd->data, cmd->length);
 
+	metrics_codec_decode(gdi->context->metrics, METRICS_CODEC_RFX, metrics_get_timestamp() - begin);
+
 	if (!message)
 		return -1;
 
@@ -258,6 +263,7 @@ int gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* context, RDPGF
 
 int gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
+	UINT64 begin;
 	int status;
 	BYTE* DstData = NULL;
 	gdiGfxSurface* surface;
@@ -272,9 +278,13 @@ int gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, RdpgfxClientContext* context, RDP
 
 	DstData = surface->data;
 
+	begin = metrics_get_timestamp();
+
 	status = clear_decompress(gdi->codecs->clear, cmd->data, cmd->length, &DstData,
 			surface->format, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height);
 
+	metrics_codec_decode(gdi->context->metrics, METRICS_CODEC_CLEAR, metrics_get_timestamp() - begin);
+
 	if (status < 0)
 	{
 		WLog_ERR(TAG, "clear_decompress failure: %d", status);
@@ -297,6 +307,7 @@ int gdi_SurfaceCommand_ClearCodec(rdpGdi* gdi, RdpgfxClientContext* context, RDP
 
 int gdi_SurfaceCommand_Planar(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
+	UINT64 begin;
 	int status;
 	BYTE* DstData = NULL;
 	gdiGfxSurface* surface;
@@ -311,9 +322,13 @@ int gdi_SurfaceCommand_Planar(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_
 
 	DstData = surface->data;
 
+	begin = metrics_get_timestamp();
+
 	status = planar_decompress(gdi->codecs->planar, cmd->data, cmd->length, &DstData,
 			PIXEL_FORMAT_XRGB32, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height, FALSE);
 
+	metrics_codec_decode(gdi->context->metrics, METRICS_CODEC_PLANAR, metrics_get_timestamp() - begin);
+
 	invalidRect.left = cmd->left;
 	invalidRect.top = cmd->top;
 	invalidRect.right = cmd->right;
@@ -329,6 +344,7 @@ int gdi_SurfaceCommand_Planar(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_
 
 int gdi_SurfaceCommand_H264(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
+	UINT64 begin;
 	int status;
 	UINT32 i;
 	BYTE* DstData = NULL;
@@ -355,9 +371,13 @@ int gdi_SurfaceCommand_H264(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SU
 
 	DstData = surface->data;
 
+	begin = metrics_get_timestamp();
+
 	status = h264_decompress(gdi->codecs->h264, bs->data, bs->length, &DstData,
 			PIXEL_FORMAT_XRGB32, surface->scanline , surface->height, meta->regionRects, meta->numRegionRects);
 
+	metrics_codec_decode(gdi->context->metrics, METRICS_CODEC_H264, metrics_get_timestamp() - begin);
+
 	if (status < 0)
 	{
 		WLog_ERR(TAG, "h264_decompress failure: %d",status);
@@ -410,6 +430,7 @@ int gdi_SurfaceCommand_Alpha(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_S
 
 int gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* context, RDPGFX_SURFACE_COMMAND* cmd)
 {
+	UINT64 begin;
 	int i, j;
 	int status;
 	BYTE* DstData;
@@ -438,9 +459,13 @@ int gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* context, RD
 
 	DstData = surface->data;
 
+	begin = metrics_get_timestamp();
+
 	status = progressive_decompress(gdi->codecs->progressive, cmd->data, cmd->length, &DstData,
 			PIXEL_FORMAT_XRGB32, surface->scanline, cmd->left, cmd->top, cmd->width, cmd->height, cmd->surfaceId);
 
+	metrics_codec_decode(gdi->context->metrics, METRICS_CODEC_PROGRESSIVE, metrics_get_timestamp() - begin);
+
 	if (status < 0)
 	{
 		WLog_ERR(TAG, "progressive_decompress failure: %d", status);
@@ -157,6 +157,7 @@ void gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap,
 	UINT32 SrcSize;
 	UINT32 SrcFormat;
 	UINT32 bytesPerPixel;
+	UINT64 begin;
 	rdpGdi* gdi = context->gdi;
 
 	bytesPerPixel = (bpp + 7) / 8;
@@ -181,8 +182,12 @@ void gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap,
 		{
 			freerdp_client_codecs_prepare(gdi->codecs, FREERDP_CODEC_PLANAR);
 
+			begin = metrics_get_timestamp();
+
 			status = planar_decompress(gdi->codecs->planar, pSrcData, SrcSize, &pDstData,
 					gdi->format, -1, 0, 0, width, height, TRUE);
+
+			metrics_codec_decode(context->metrics, METRICS_CODEC_PLANAR, metrics_get_timestamp() - begin);
 		}
 
 		if (status < 0)
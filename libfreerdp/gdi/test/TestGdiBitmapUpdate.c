@@ -0,0 +1,332 @@
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/planar.h>
+#include <freerdp/codec/interleaved.h>
+
+/**
+ * Replays a recording of slow-path bitmap updates through the gdi
+ * BitmapUpdate callback, the way a server without surface commands paints
+ * a scrolling desktop: every frame is a full screen of 64x64 rectangles,
+ * mostly planar, with one interleaved 16 bpp frame and one frame whose
+ * rectangles overlap. Each decoding thread count must leave exactly the
+ * same image in the primary buffer.
+ */
+
+#define TEST_BITMAP_WIDTH	1920
+#define TEST_BITMAP_HEIGHT	1080
+#define TEST_BITMAP_FRAMES	8
+#define TEST_BITMAP_ROUNDS	4
+
+struct test_bitmap_recording
+{
+	int count;
+	UINT64 bytes;
+	BITMAP_UPDATE updates[TEST_BITMAP_FRAMES];
+};
+typedef struct test_bitmap_recording TEST_BITMAP_RECORDING;
+
+static void test_bitmap_fill_frame(BYTE* data, int nStep, int frame)
+{
+	int x, y;
+	BYTE* p;
+
+	/* a few lines of "text" on a gradient, scrolling up by 8 pixels per frame */
+
+	for (y = 0; y < TEST_BITMAP_HEIGHT; y++)
+	{
+		int row = y + (frame * 8);
+
+		for (x = 0; x < TEST_BITMAP_WIDTH; x++)
+		{
+			p = &data[(y * nStep) + (x * 4)];
+
+			if (((row % 24) < 14) && (((x * 7 + row * 3) % 11) < 4) && ((x % 400) < 320))
+			{
+				p[0] = p[1] = p[2] = 0x10;
+			}
+			else
+			{
+				p[0] = (BYTE) (0xC0 + (x >> 4));
+				p[1] = (BYTE) (0xE0 - (row >> 3));
+				p[2] = 0xF0;
+			}
+
+			p[3] = 0xFF;
+		}
+	}
+}
+
+static BOOL test_bitmap_record_frame(TEST_BITMAP_RECORDING* recording, BYTE* data, int nStep,
+		BITMAP_PLANAR_CONTEXT* planar, BITMAP_INTERLEAVED_CONTEXT* interleaved, int bpp, BOOL overlap)
+{
+	int x, y;
+	int size;
+	UINT32 DstSize;
+	UINT32 count = 0;
+	BYTE* buffer;
+	BITMAP_DATA* bitmap;
+	BITMAP_UPDATE* update;
+	int cols = (TEST_BITMAP_WIDTH + 63) / 64;
+	int rows = (TEST_BITMAP_HEIGHT + 63) / 64;
+
+	update = &(recording->updates[recording->count]);
+	update->rectangles = (BITMAP_DATA*) calloc((cols * rows) + cols, sizeof(BITMAP_DATA));
+
+	if (!update->rectangles)
+		return FALSE;
+
+	for (y = 0; y < rows; y++)
+	{
+		for (x = 0; x < cols; x++)
+		{
+			bitmap = &(update->rectangles[count++]);
+
+			bitmap->destLeft = x * 64;
+			bitmap->destTop = y * 64;
+			bitmap->width = 64;
+			bitmap->height = ((bitmap->destTop + 64) > TEST_BITMAP_HEIGHT) ? (TEST_BITMAP_HEIGHT - bitmap->destTop) : 64;
+
+			/* overlapping frames move odd columns half a tile left, over the previous rectangle */
+
+			if (overlap && (x & 1))
+				bitmap->destLeft -= 32;
+
+			bitmap->destRight = bitmap->destLeft + bitmap->width - 1;
+			bitmap->destBottom = bitmap->destTop + bitmap->height - 1;
+			bitmap->compressed = TRUE;
+
+			buffer = (BYTE*) malloc(64 * 64 * 4);
+
+			if (!buffer)
+				return FALSE;
+
+			if (bpp == 32)
+			{
+				bitmap->bitmapDataStream = freerdp_bitmap_compress_planar(planar,
+						&data[(bitmap->destTop * nStep) + (bitmap->destLeft * 4)], PIXEL_FORMAT_RGB32,
+						bitmap->width, bitmap->height, nStep, buffer, &size);
+				bitmap->bitmapLength = size;
+			}
+			else
+			{
+				DstSize = 64 * 64 * 4;
+				interleaved_compress(interleaved, buffer, &DstSize, bitmap->width, bitmap->height,
+						data, PIXEL_FORMAT_RGB32, nStep, bitmap->destLeft, bitmap->destTop, NULL, bpp);
+				bitmap->bitmapDataStream = buffer;
+				bitmap->bitmapLength = DstSize;
+			}
+
+			if (!bitmap->bitmapDataStream)
+				return FALSE;
+
+			bitmap->bitsPerPixel = bpp;
+			recording->bytes += bitmap->bitmapLength;
+		}
+	}
+
+	update->number = update->count = count;
+	recording->count++;
+
+	return TRUE;
+}
+
+static void test_bitmap_free_recording(TEST_BITMAP_RECORDING* recording)
+{
+	int index;
+	UINT32 rect;
+	BITMAP_UPDATE* update;
+
+	for (index = 0; index < recording->count; index++)
+	{
+		update = &(recording->updates[index]);
+
+		for (rect = 0; rect < update->number; rect++)
+			free(update->rectangles[rect].bitmapDataStream);
+
+		free(update->rectangles);
+	}
+}
+
+static BOOL test_bitmap_record(TEST_BITMAP_RECORDING* recording, BYTE* data, int nStep)
+{
+	int frame;
+	BOOL status = TRUE;
+	BITMAP_PLANAR_CONTEXT* planar;
+	BITMAP_INTERLEAVED_CONTEXT* interleaved;
+
+	planar = freerdp_bitmap_planar_context_new(PLANAR_FORMAT_HEADER_RLE | PLANAR_FORMAT_HEADER_NA, 64, 64);
+	interleaved = bitmap_interleaved_context_new(TRUE);
+
+	if (!planar || !interleaved)
+		status = FALSE;
+
+	for (frame = 0; status && (frame < TEST_BITMAP_FRAMES); frame++)
+	{
+		test_bitmap_fill_frame(data, nStep, frame);
+
+		status = test_bitmap_record_frame(recording, data, nStep, planar, interleaved,
+				(frame == 2) ? 16 : 32, (frame == 4) ? TRUE : FALSE);
+	}
+
+	freerdp_bitmap_planar_context_free(planar);
+	bitmap_interleaved_context_free(interleaved);
+
+	return status;
+}
+
+static int test_bitmap_compare(const BYTE* data1, const BYTE* data2, int nStep)
+{
+	int x, y;
+
+	for (y = 0; y < TEST_BITMAP_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_BITMAP_WIDTH; x++)
+		{
+			if (memcmp(&data1[(y * nStep) + (x * 4)], &data2[(y * nStep) + (x * 4)], 3) != 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+int TestGdiBitmapUpdate(int argc, char* argv[])
+{
+	int round;
+	int frame;
+	int status = -1;
+	int nStep;
+	UINT32 index;
+	UINT64 begin;
+	UINT64 elapsed;
+	UINT64 rects;
+	BYTE* pSrcData;
+	BYTE* pRefData;
+	rdpGdi* gdi;
+	freerdp* instance;
+	TEST_BITMAP_RECORDING recording;
+	BITMAP_UPDATE overflow;
+	BITMAP_DATA rectangles[2];
+	static const UINT32 threadCounts[] = { 1, 2, 4, 8 };
+
+	ZeroMemory(&recording, sizeof(TEST_BITMAP_RECORDING));
+
+	nStep = TEST_BITMAP_WIDTH * 4;
+	pSrcData = (BYTE*) calloc(1, nStep * TEST_BITMAP_HEIGHT);
+	pRefData = (BYTE*) calloc(1, nStep * TEST_BITMAP_HEIGHT);
+	instance = freerdp_new();
+
+	if (!pSrcData || !pRefData || !instance || (freerdp_context_new(instance) != 0))
+		goto out;
+
+	instance->settings->DesktopWidth = TEST_BITMAP_WIDTH;
+	instance->settings->DesktopHeight = TEST_BITMAP_HEIGHT;
+	instance->settings->ColorDepth = 32;
+
+	if (gdi_init(instance, CLRCONV_ALPHA | CLRBUF_32BPP, NULL) < 0)
+		goto out;
+
+	gdi = instance->context->gdi;
+
+	if (!test_bitmap_record(&recording, pSrcData, nStep))
+	{
+		printf("failed to record the bitmap updates\n");
+		goto out;
+	}
+
+	for (index = 0; index < ARRAYSIZE(threadCounts); index++)
+	{
+		if (gdi_set_bitmap_decode_threads(gdi, threadCounts[index]) < 0)
+			goto out;
+
+		ZeroMemory(gdi->primary_buffer, nStep * TEST_BITMAP_HEIGHT);
+
+		rects = 0;
+		begin = GetTickCount64();
+
+		for (round = 0; round < TEST_BITMAP_ROUNDS; round++)
+		{
+			for (frame = 0; frame < recording.count; frame++)
+			{
+				instance->update->BitmapUpdate(instance->context, &(recording.updates[frame]));
+				rects += recording.updates[frame].number;
+			}
+		}
+
+		elapsed = GetTickCount64() - begin;
+
+		if (index == 0)
+		{
+			/* the last frame is planar and lossless, so it has to match the source */
+
+			if (test_bitmap_compare(pSrcData, gdi->primary_buffer, nStep) < 0)
+			{
+				printf("decoded bitmap updates differ from the source frame\n");
+				goto out;
+			}
+
+			CopyMemory(pRefData, gdi->primary_buffer, nStep * TEST_BITMAP_HEIGHT);
+		}
+		else if (memcmp(pRefData, gdi->primary_buffer, nStep * TEST_BITMAP_HEIGHT) != 0)
+		{
+			printf("%d threads: image differs from the single threaded decoder\n", threadCounts[index]);
+			goto out;
+		}
+
+		printf("bitmap update replay %dx%d, %d threads: %.0f rects/s, %.1f MB/s compressed\n",
+				TEST_BITMAP_WIDTH, TEST_BITMAP_HEIGHT, threadCounts[index],
+				elapsed ? (rects * 1000.0) / elapsed : 0.0,
+				elapsed ? ((recording.bytes * TEST_BITMAP_ROUNDS) / 1024.0 / 1024.0) * 1000.0 / elapsed : 0.0);
+	}
+
+	/* rectangles whose decoded size does not fit are rejected, the screen is left alone */
+
+	ZeroMemory(rectangles, sizeof(rectangles));
+	ZeroMemory(&overflow, sizeof(BITMAP_UPDATE));
+
+	for (index = 0; index < ARRAYSIZE(rectangles); index++)
+	{
+		rectangles[index].width = 0xFFFFFFFF;
+		rectangles[index].height = 0xFFFFFFFF;
+		rectangles[index].destRight = 63;
+		rectangles[index].destBottom = 63;
+		rectangles[index].bitsPerPixel = 32;
+	}
+
+	overflow.number = ARRAYSIZE(rectangles);
+	overflow.rectangles = rectangles;
+
+	instance->update->BitmapUpdate(instance->context, &overflow);
+
+	if (memcmp(pRefData, gdi->primary_buffer, nStep * TEST_BITMAP_HEIGHT) != 0)
+	{
+		printf("oversized bitmap update was drawn\n");
+		goto out;
+	}
+
+	status = 0;
+
+out:
+	test_bitmap_free_recording(&recording);
+
+	if (instance)
+	{
+		if (instance->context)
+		{
+			gdi_free(instance);
+			freerdp_context_free(instance);
+		}
+
+		freerdp_free(instance);
+	}
+
+	free(pSrcData);
+	free(pRefData);
+
+	return status;
+}
@@ -265,9 +265,76 @@ pstatus_t general_YUV420ToRGB_8u_P3AC4R(const BYTE* pSrc[3], int srcStep[3],
 	return PRIMITIVES_SUCCESS;
 }
 
+/**
+ * Chroma is computed from the sum of each 2x2 block, hence the extra shift by 2.
+ * An odd last row or column is repeated to complete its block.
+ */
+
+pstatus_t general_RGBToYUV420_8u_P3AC4R(const BYTE* pSrc, INT32 srcStep,
+		BYTE* pDst[3], INT32 dstStep[3], const prim_size_t* roi)
+{
+	int x, y;
+	int x1, y1;
+	int R, G, B;
+	int Rs, Gs, Bs;
+	const BYTE* pRGB[2];
+	const BYTE* pixel;
+	BYTE* pY[2];
+	BYTE* pU;
+	BYTE* pV;
+	int i, j;
+	int nWidth = roi->width;
+	int nHeight = roi->height;
+
+	for (y = 0; y < nHeight; y += 2)
+	{
+		y1 = (y + 1 < nHeight) ? 1 : 0;
+
+		pRGB[0] = &pSrc[y * srcStep];
+		pRGB[1] = &pSrc[(y + y1) * srcStep];
+
+		pY[0] = &pDst[0][y * dstStep[0]];
+		pY[1] = &pDst[0][(y + y1) * dstStep[0]];
+
+		pU = &pDst[1][(y / 2) * dstStep[1]];
+		pV = &pDst[2][(y / 2) * dstStep[2]];
+
+		for (x = 0; x < nWidth; x += 2)
+		{
+			x1 = (x + 1 < nWidth) ? 1 : 0;
+
+			Rs = Gs = Bs = 0;
+
+			for (j = 0; j < 2; j++)
+			{
+				for (i = 0; i < 2; i++)
+				{
+					pixel = &pRGB[j][(x + (i ? x1 : 0)) * 4];
+
+					B = pixel[0];
+					G = pixel[1];
+					R = pixel[2];
+
+					pY[j][x + (i ? x1 : 0)] = (BYTE) (((54 * R) + (183 * G) + (18 * B)) >> 8);
+
+					Rs += R;
+					Gs += G;
+					Bs += B;
+				}
+			}
+
+			*pU++ = (BYTE) ((((-29 * Rs) - (99 * Gs) + (128 * Bs)) >> 10) + 128);
+			*pV++ = (BYTE) ((((128 * Rs) - (116 * Gs) - (12 * Bs)) >> 10) + 128);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
 void primitives_init_YUV(primitives_t* prims)
 {
 	prims->YUV420ToRGB_8u_P3AC4R = general_YUV420ToRGB_8u_P3AC4R;
+	prims->RGBToYUV420_8u_P3AC4R = general_RGBToYUV420_8u_P3AC4R;
 	
 	primitives_init_YUV_opt(prims);
 }
@@ -20,6 +20,13 @@
 #define FREERDP_PRIMITIVES_YUV_H
 
 pstatus_t general_yCbCrToRGB_16s8u_P3AC4R(const INT16* pSrc[3], int srcStep, BYTE* pDst, int dstStep, const prim_size_t* roi);
+pstatus_t general_RGBToYUV420_8u_P3AC4R(const BYTE* pSrc, INT32 srcStep,
+		BYTE* pDst[3], INT32 dstStep[3], const prim_size_t* roi);
+
+#ifdef WITH_AVX2
+pstatus_t avx2_YUV420ToRGB_8u_P3AC4R(const BYTE* pSrc[3], int srcStep[3],
+		BYTE* pDst, int dstStep, const prim_size_t* roi);
+#endif
 
 void primitives_init_YUV(primitives_t* prims);
 void primitives_init_YUV_opt(primitives_t* prims);
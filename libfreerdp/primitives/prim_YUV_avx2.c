@@ -0,0 +1,130 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * AVX2 YUV420 to RGB conversion
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef WITH_AVX2
+#include <immintrin.h>
+#endif /* WITH_AVX2 */
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_YUV.h"
+
+#ifdef WITH_AVX2
+
+#define YUV_CLIP(_v_) \
+	((_v_) < 0 ? 0 : ((_v_) > 255 ? 255 : (_v_)))
+
+/**
+ * Converts one row with the coefficients of the general version: sixteen
+ * pixels per iteration, each chroma sample covering two of them.  Every
+ * product is summed exactly with pmaddwd and the packs clamp to 0..255
+ * just like the scalar code, so the output is bit-exact.
+ */
+static void avx2_YUV420ToRGB_row(const BYTE* pY, const BYTE* pU, const BYTE* pV,
+		BYTE* pRGB, int width)
+{
+	int x;
+	const __m256i c128 = _mm256_set1_epi16(128);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi16((short) 0xFF00);
+	/* (Y, V), (Y, U), (U, V) and (Y, U) coefficient pairs */
+	const __m256i k_r = _mm256_set1_epi32((403 << 16) | 256);
+	const __m256i k_g = _mm256_set1_epi32((int) ((((UINT32) -120) << 16) | (UINT16) -48));
+	const __m256i k_b = _mm256_set1_epi32((475 << 16) | 256);
+	const __m256i y_g = _mm256_set1_epi32(256);
+
+	for (x = 0; x + 16 <= width; x += 16)
+	{
+		__m128i u8, v8;
+		__m256i Y, U, V, lo, hi, R, G, B, BG, RA;
+
+		Y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) &pY[x]));
+		u8 = _mm_loadl_epi64((const __m128i*) &pU[x / 2]);
+		v8 = _mm_loadl_epi64((const __m128i*) &pV[x / 2]);
+		U = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u8, u8)), c128);
+		V = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v8, v8)), c128);
+
+		/* R = (256 * Y + 403 * V) >> 8 */
+		lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(Y, V), k_r), 8);
+		hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(Y, V), k_r), 8);
+		R = _mm256_packs_epi32(lo, hi);
+
+		/* G = (256 * Y - 48 * U - 120 * V) >> 8 */
+		lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(Y, zero), y_g),
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(U, V), k_g));
+		hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(Y, zero), y_g),
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(U, V), k_g));
+		G = _mm256_packs_epi32(_mm256_srai_epi32(lo, 8), _mm256_srai_epi32(hi, 8));
+
+		/* B = (256 * Y + 475 * U) >> 8 */
+		lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(Y, U), k_b), 8);
+		hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(Y, U), k_b), 8);
+		B = _mm256_packs_epi32(lo, hi);
+
+		/* clamp to 0..255 */
+		R = _mm256_min_epi16(_mm256_max_epi16(R, zero), _mm256_set1_epi16(255));
+		G = _mm256_min_epi16(_mm256_max_epi16(G, zero), _mm256_set1_epi16(255));
+		B = _mm256_min_epi16(_mm256_max_epi16(B, zero), _mm256_set1_epi16(255));
+
+		/* B | G << 8 and R | A << 8, then interleave to BGRA */
+		BG = _mm256_or_si256(B, _mm256_slli_epi16(G, 8));
+		RA = _mm256_or_si256(R, alpha);
+		lo = _mm256_unpacklo_epi16(BG, RA);
+		hi = _mm256_unpackhi_epi16(BG, RA);
+
+		/* the unpacks work per 128-bit lane: lo holds pixels 0-3 and 8-11 */
+		_mm256_storeu_si256((__m256i*) &pRGB[x * 4], _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*) &pRGB[x * 4 + 32], _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	for (; x < width; x++)
+	{
+		int Yp = pY[x] << 8;
+		int Up = pU[x / 2] - 128;
+		int Vp = pV[x / 2] - 128;
+		int R = (Yp + Vp * 403) >> 8;
+		int G = (Yp - Up * 48 - Vp * 120) >> 8;
+		int B = (Yp + Up * 475) >> 8;
+
+		pRGB[x * 4 + 0] = (BYTE) YUV_CLIP(B);
+		pRGB[x * 4 + 1] = (BYTE) YUV_CLIP(G);
+		pRGB[x * 4 + 2] = (BYTE) YUV_CLIP(R);
+		pRGB[x * 4 + 3] = 0xFF;
+	}
+}
+
+pstatus_t avx2_YUV420ToRGB_8u_P3AC4R(const BYTE* pSrc[3], int srcStep[3],
+		BYTE* pDst, int dstStep, const prim_size_t* roi)
+{
+	int y;
+
+	for (y = 0; y < roi->height; y++)
+	{
+		avx2_YUV420ToRGB_row(&pSrc[0][y * srcStep[0]],
+			&pSrc[1][(y / 2) * srcStep[1]], &pSrc[2][(y / 2) * srcStep[2]],
+			&pDst[y * dstStep], roi->width);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+#endif /* WITH_AVX2 */
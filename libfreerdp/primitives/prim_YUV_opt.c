@@ -16,6 +16,8 @@
 #include <freerdp/types.h>
 #include <freerdp/primitives.h>
 
+#include "prim_YUV.h"
+
 
 #ifdef WITH_SSE2
 
@@ -357,6 +359,120 @@ pstatus_t ssse3_YUV420ToRGB_8u_P3AC4R(const BYTE **pSrc, int *srcStep,
 	
 	return PRIMITIVES_SUCCESS;
 }
+
+/**
+ * Converts blocks of 8x2 pixels at a time, the odd last row and the columns
+ * which do not fill a block are left to the generic code.
+ */
+
+pstatus_t ssse3_RGBToYUV420_8u_P3AC4R(const BYTE* pSrc, INT32 srcStep,
+		BYTE* pDst[3], INT32 dstStep[3], const prim_size_t* roi)
+{
+	int x, y, j;
+	int nWidth;
+	int nHeight;
+	prim_size_t size;
+	BYTE* pStrip[3];
+	const BYTE* pRGB;
+	BYTE* pY;
+	__m128i p0, p1;
+	__m128i a[4], s[4];
+	__m128i y0, y1;
+	__m128i c0, c1;
+	__m128i u, v;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i yCoeffs = _mm_set_epi16(0, 54, 183, 18, 0, 54, 183, 18);
+	const __m128i uCoeffs = _mm_set_epi16(0, -29, -99, 128, 0, -29, -99, 128);
+	const __m128i vCoeffs = _mm_set_epi16(0, 128, -116, -12, 0, 128, -116, -12);
+	const __m128i offset = _mm_set1_epi32(128);
+
+	nWidth = roi->width & ~7;
+	nHeight = roi->height & ~1;
+
+	for (y = 0; y < nHeight; y += 2)
+	{
+		for (x = 0; x < nWidth; x += 8)
+		{
+			for (j = 0; j < 2; j++)
+			{
+				pRGB = &pSrc[((y + j) * srcStep) + (x * 4)];
+				pY = &pDst[0][((y + j) * dstStep[0]) + x];
+
+				p0 = _mm_loadu_si128((const __m128i*) pRGB);
+				p1 = _mm_loadu_si128((const __m128i*) &pRGB[16]);
+
+				a[0] = _mm_unpacklo_epi8(p0, zero);
+				a[1] = _mm_unpackhi_epi8(p0, zero);
+				a[2] = _mm_unpacklo_epi8(p1, zero);
+				a[3] = _mm_unpackhi_epi8(p1, zero);
+
+				y0 = _mm_hadd_epi32(_mm_madd_epi16(a[0], yCoeffs), _mm_madd_epi16(a[1], yCoeffs));
+				y1 = _mm_hadd_epi32(_mm_madd_epi16(a[2], yCoeffs), _mm_madd_epi16(a[3], yCoeffs));
+
+				y0 = _mm_packs_epi32(_mm_srli_epi32(y0, 8), _mm_srli_epi32(y1, 8));
+				_mm_storel_epi64((__m128i*) pY, _mm_packus_epi16(y0, y0));
+
+				if (!j)
+				{
+					s[0] = a[0];
+					s[1] = a[1];
+					s[2] = a[2];
+					s[3] = a[3];
+				}
+				else
+				{
+					s[0] = _mm_add_epi16(s[0], a[0]);
+					s[1] = _mm_add_epi16(s[1], a[1]);
+					s[2] = _mm_add_epi16(s[2], a[2]);
+					s[3] = _mm_add_epi16(s[3], a[3]);
+				}
+			}
+
+			/* sums of each 2x2 block */
+
+			c0 = _mm_add_epi16(_mm_unpacklo_epi64(s[0], s[1]), _mm_unpackhi_epi64(s[0], s[1]));
+			c1 = _mm_add_epi16(_mm_unpacklo_epi64(s[2], s[3]), _mm_unpackhi_epi64(s[2], s[3]));
+
+			u = _mm_hadd_epi32(_mm_madd_epi16(c0, uCoeffs), _mm_madd_epi16(c1, uCoeffs));
+			v = _mm_hadd_epi32(_mm_madd_epi16(c0, vCoeffs), _mm_madd_epi16(c1, vCoeffs));
+
+			u = _mm_add_epi32(_mm_srai_epi32(u, 10), offset);
+			v = _mm_add_epi32(_mm_srai_epi32(v, 10), offset);
+
+			u = _mm_packs_epi32(u, u);
+			v = _mm_packs_epi32(v, v);
+
+			*((UINT32*) &pDst[1][((y / 2) * dstStep[1]) + (x / 2)]) = _mm_cvtsi128_si32(_mm_packus_epi16(u, u));
+			*((UINT32*) &pDst[2][((y / 2) * dstStep[2]) + (x / 2)]) = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+		}
+	}
+
+	if (nWidth < (int) roi->width)
+	{
+		size.width = roi->width - nWidth;
+		size.height = roi->height;
+
+		pStrip[0] = &pDst[0][nWidth];
+		pStrip[1] = &pDst[1][nWidth / 2];
+		pStrip[2] = &pDst[2][nWidth / 2];
+
+		general_RGBToYUV420_8u_P3AC4R(&pSrc[nWidth * 4], srcStep, pStrip, dstStep, &size);
+	}
+
+	if (nWidth && (nHeight < (int) roi->height))
+	{
+		size.width = nWidth;
+		size.height = 1;
+
+		pStrip[0] = &pDst[0][nHeight * dstStep[0]];
+		pStrip[1] = &pDst[1][(nHeight / 2) * dstStep[1]];
+		pStrip[2] = &pDst[2][(nHeight / 2) * dstStep[2]];
+
+		general_RGBToYUV420_8u_P3AC4R(&pSrc[nHeight * srcStep], srcStep, pStrip, dstStep, &size);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
 #endif
 
 void primitives_init_YUV_opt(primitives_t *prims)
@@ -365,6 +481,13 @@ void primitives_init_YUV_opt(primitives_t *prims)
 	if (IsProcessorFeaturePresentEx(PF_EX_SSSE3) && IsProcessorFeaturePresent(PF_SSE3_INSTRUCTIONS_AVAILABLE))
 	{
 		prims->YUV420ToRGB_8u_P3AC4R = ssse3_YUV420ToRGB_8u_P3AC4R;
+		prims->RGBToYUV420_8u_P3AC4R = ssse3_RGBToYUV420_8u_P3AC4R;
+	}
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		prims->YUV420ToRGB_8u_P3AC4R = avx2_YUV420ToRGB_8u_P3AC4R;
 	}
+#endif /* WITH_AVX2 */
 #endif
 }
@@ -24,6 +24,10 @@
 
 pstatus_t general_add_16s(const INT16 *pSrc1, const INT16 *pSrc2, INT16 *pDst, INT32 len);
 
+#ifdef WITH_AVX2
+pstatus_t avx2_add_16s(const INT16 *pSrc1, const INT16 *pSrc2, INT16 *pDst, INT32 len);
+#endif
+
 void primitives_init_add_opt(primitives_t *prims);
 
 #endif /* !__PRIM_ADD_H_INCLUDED__ */
@@ -56,5 +56,11 @@ void primitives_init_add_opt(
 	{
 		prims->add_16s = sse3_add_16s;
 	}
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		prims->add_16s = avx2_add_16s;
+	}
+#endif /* WITH_AVX2 */
 #endif
 }
@@ -24,6 +24,10 @@
 
 pstatus_t general_alphaComp_argb(const BYTE *pSrc1, INT32 src1Step, const BYTE *pSrc2, INT32 src2Step, BYTE *pDst, INT32 dstStep, INT32 width, INT32 height);
 
+#ifdef WITH_AVX2
+pstatus_t avx2_alphaComp_argb(const BYTE *pSrc1, INT32 src1Step, const BYTE *pSrc2, INT32 src2Step, BYTE *pDst, INT32 dstStep, INT32 width, INT32 height);
+#endif
+
 void primitives_init_alphaComp_opt(primitives_t* prims);
 
 #endif /* !__PRIM_ALPHACOMP_H_INCLUDED__ */
@@ -0,0 +1,115 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * AVX2 alpha blending routines.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Like the SSE2 version, this assumes the second operand is fully opaque.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef WITH_AVX2
+#include <immintrin.h>
+#endif /* WITH_AVX2 */
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_alphaComp.h"
+
+#ifdef WITH_AVX2
+/* ------------------------------------------------------------------------- */
+static INLINE __m256i avx2_alphaComp_half(__m256i src1, __m256i src2, __m256i one)
+{
+	__m256i diff, alpha;
+
+	/* src1 - src2, per 16-bit channel */
+	diff = _mm256_subs_epi16(src1, src2);
+	/* broadcast each pixel's alpha over its four channels */
+	alpha = _mm256_shufflelo_epi16(src1, 0xff);
+	alpha = _mm256_shufflehi_epi16(alpha, 0xff);
+	/* ((alpha + 1) * (src1 - src2) >> 8) + src2 */
+	alpha = _mm256_adds_epi16(alpha, one);
+	alpha = _mm256_mullo_epi16(alpha, diff);
+	alpha = _mm256_srai_epi16(alpha, 8);
+	alpha = _mm256_adds_epi16(alpha, src2);
+
+	/* mask off remainders or pack gets confused */
+	return _mm256_and_si256(alpha, _mm256_set1_epi16(0x00ffU));
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t avx2_alphaComp_argb(
+	const BYTE *pSrc1,  INT32 src1Step,
+	const BYTE *pSrc2,  INT32 src2Step,
+	BYTE *pDst,  INT32 dstStep,
+	INT32 width,  INT32 height)
+{
+	const BYTE *sptr1;
+	const BYTE *sptr2;
+	BYTE *dptr;
+	int x, y, count;
+	__m256i zero, one;
+
+	if ((width <= 0) || (height <= 0)) return PRIMITIVES_SUCCESS;
+
+	if (width < 8)     /* pointless if too small */
+	{
+		return general_alphaComp_argb(pSrc1, src1Step, pSrc2, src2Step,
+			pDst, dstStep, width, height);
+	}
+
+	zero = _mm256_setzero_si256();
+	one = _mm256_set1_epi16(1);
+	count = width >> 3;
+
+	for (y = 0; y < height; ++y)
+	{
+		sptr1 = pSrc1 + (y * src1Step);
+		sptr2 = pSrc2 + (y * src2Step);
+		dptr = pDst + (y * dstStep);
+
+		/* Use AVX registers to do 8 pixels at a time. */
+		for (x = 0; x < count; x++)
+		{
+			__m256i ymm0, ymm1, lo, hi;
+
+			ymm0 = _mm256_loadu_si256((const __m256i *) sptr1); sptr1 += 32;
+			ymm1 = _mm256_loadu_si256((const __m256i *) sptr2); sptr2 += 32;
+
+			/* unpack and pack both work within 128-bit lanes, so the
+			 * pixel order survives the round trip */
+			lo = avx2_alphaComp_half(_mm256_unpacklo_epi8(ymm0, zero),
+				_mm256_unpacklo_epi8(ymm1, zero), one);
+			hi = avx2_alphaComp_half(_mm256_unpackhi_epi8(ymm0, zero),
+				_mm256_unpackhi_epi8(ymm1, zero), one);
+
+			_mm256_storeu_si256((__m256i *) dptr, _mm256_packus_epi16(lo, hi));
+			dptr += 32;
+		}
+
+		/* Finish off the remainder. */
+		if (width & 7)
+		{
+			general_alphaComp_argb(sptr1, src1Step, sptr2, src2Step,
+				dptr, dstStep, width & 7, 1);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif /* WITH_AVX2 */
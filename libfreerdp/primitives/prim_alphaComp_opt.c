@@ -221,6 +221,12 @@ void primitives_init_alphaComp_opt(primitives_t* prims)
 	{
 		prims->alphaComp_argb = sse2_alphaComp_argb;
 	}
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		prims->alphaComp_argb = avx2_alphaComp_argb;
+	}
+#endif /* WITH_AVX2 */
 #endif
 }
 
@@ -45,7 +45,7 @@ pstatus_t general_yCbCrToRGB_16s8u_P3AC4R(const INT16* pSrc[3], int srcStep,
 	const INT16* pCb = pSrc[1];
 	const INT16* pCr = pSrc[2];
 	int srcPad = (srcStep - (roi->width * 2)) / 2;
-	int dstPad = (dstStep - (roi->width * 4)) / 4;
+	int dstPad = (dstStep - (roi->width * 4));
 
 	for (y = 0; y < roi->height; y++)
 	{
@@ -104,7 +104,7 @@ pstatus_t general_yCbCrToBGR_16s8u_P3AC4R(const INT16* pSrc[3], int srcStep,
 	const INT16* pCb = pSrc[1];
 	const INT16* pCr = pSrc[2];
 	int srcPad = (srcStep - (roi->width * 2)) / 2;
-	int dstPad = (dstStep - (roi->width * 4)) / 4;
+	int dstPad = (dstStep - (roi->width * 4));
 
 	for (y = 0; y < roi->height; y++)
 	{
@@ -0,0 +1,220 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * AVX2 color conversion operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef WITH_AVX2
+#include <immintrin.h>
+#endif /* WITH_AVX2 */
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_colors.h"
+
+#ifdef WITH_AVX2
+/*---------------------------------------------------------------------------*/
+/* Same arithmetic as the general version, eight pixels at a time in single
+ * precision, so the results are bit-exact.
+ */
+pstatus_t avx2_yCbCrToRGB_16s8u_P3AC4R(
+	const INT16* pSrc[3], int srcStep,
+	BYTE* pDst, int dstStep,
+	const prim_size_t* roi)
+{
+	int x, y;
+	int count = roi->width >> 3;
+	int rest = roi->width & 7;
+	const __m256 cr_r = _mm256_set1_ps(1.402525f);
+	const __m256 cb_g = _mm256_set1_ps(0.343730f);
+	const __m256 cr_g = _mm256_set1_ps(0.714401f);
+	const __m256 cb_b = _mm256_set1_ps(1.769905f);
+	const __m256 round = _mm256_set1_ps(16.0f);
+	const __m256i y_offset = _mm256_set1_epi32(4096);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(255);
+	const __m256i alpha = _mm256_set1_epi32((int) 0xFF000000U);
+
+	for (y = 0; y < roi->height; y++)
+	{
+		const INT16* pY  = (const INT16*) (((const BYTE*) pSrc[0]) + y * srcStep);
+		const INT16* pCb = (const INT16*) (((const BYTE*) pSrc[1]) + y * srcStep);
+		const INT16* pCr = (const INT16*) (((const BYTE*) pSrc[2]) + y * srcStep);
+		BYTE* pRGB = pDst + y * dstStep;
+
+		for (x = 0; x < count; x++)
+		{
+			__m256 Y, Cb, Cr;
+			__m256i R, G, B;
+
+			Y = _mm256_cvtepi32_ps(_mm256_add_epi32(y_offset,
+				_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) pY))));
+			Cb = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) pCb)));
+			Cr = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) pCr)));
+
+			/* R = ((Cr * 1.402525) + Y + 16) >> 5 */
+			R = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(Cr, cr_r), Y), round));
+			/* G = (Y - (Cb * 0.343730) - (Cr * 0.714401) + 16) >> 5 */
+			G = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(
+				Y, _mm256_mul_ps(Cb, cb_g)), _mm256_mul_ps(Cr, cr_g)), round));
+			/* B = ((Cb * 1.769905) + Y + 16) >> 5 */
+			B = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(Cb, cb_b), Y), round));
+
+			/* (INT16) value >> 5: sign extend the low word, then shift */
+			R = _mm256_srai_epi32(_mm256_slli_epi32(R, 16), 16 + 5);
+			G = _mm256_srai_epi32(_mm256_slli_epi32(G, 16), 16 + 5);
+			B = _mm256_srai_epi32(_mm256_slli_epi32(B, 16), 16 + 5);
+
+			R = _mm256_min_epi32(_mm256_max_epi32(R, zero), max);
+			G = _mm256_min_epi32(_mm256_max_epi32(G, zero), max);
+			B = _mm256_min_epi32(_mm256_max_epi32(B, zero), max);
+
+			/* BGRA */
+			B = _mm256_or_si256(B, _mm256_slli_epi32(G, 8));
+			B = _mm256_or_si256(B, _mm256_slli_epi32(R, 16));
+			B = _mm256_or_si256(B, alpha);
+			_mm256_storeu_si256((__m256i*) pRGB, B);
+
+			pY += 8;
+			pCb += 8;
+			pCr += 8;
+			pRGB += 32;
+		}
+
+		if (rest)
+		{
+			const INT16* pTail[3];
+			prim_size_t tail;
+
+			pTail[0] = pY;
+			pTail[1] = pCb;
+			pTail[2] = pCr;
+			tail.width = rest;
+			tail.height = 1;
+
+			general_yCbCrToRGB_16s8u_P3AC4R(pTail, srcStep, pRGB, dstStep, &tail);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Unlike the SSE2 version, which sums three truncated high words, this
+ * computes the 32-bit sums of the general version with pmaddwd and is
+ * therefore bit-exact.  Interleaving with unpack and narrowing with pack
+ * both stay within 128-bit lanes, so the pixel order is preserved.
+ */
+static INLINE __m256i avx2_RGBToYCbCr_channel(__m256i rg_lo, __m256i rg_hi,
+	__m256i b_lo, __m256i b_hi, __m256i k_rg, __m256i k_b, __m256i offset,
+	__m256i min, __m256i max)
+{
+	__m256i lo, hi;
+
+	lo = _mm256_add_epi32(_mm256_madd_epi16(rg_lo, k_rg), _mm256_madd_epi16(b_lo, k_b));
+	hi = _mm256_add_epi32(_mm256_madd_epi16(rg_hi, k_rg), _mm256_madd_epi16(b_hi, k_b));
+	lo = _mm256_sub_epi32(_mm256_srai_epi32(lo, 10), offset);
+	hi = _mm256_sub_epi32(_mm256_srai_epi32(hi, 10), offset);
+
+	return _mm256_min_epi16(_mm256_max_epi16(_mm256_packs_epi32(lo, hi), min), max);
+}
+
+pstatus_t avx2_RGBToYCbCr_16s16s_P3P3(
+	const INT16 *pSrc[3],  INT32 srcStep,
+	INT16 *pDst[3],  INT32 dstStep,
+	const prim_size_t *roi)
+{
+	int x, y;
+	int count = roi->width >> 4;
+	int rest = roi->width & 15;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i min = _mm256_set1_epi16(-4096);
+	const __m256i max = _mm256_set1_epi16(4095);
+	const __m256i y_offset = _mm256_set1_epi32(4096);
+	/* (r, g) and (b, 0) coefficient pairs, see the general version */
+	const __m256i y_rg  = _mm256_set1_epi32((19235 << 16) | 9798);
+	const __m256i y_b   = _mm256_set1_epi32(3735);
+	const __m256i cb_rg = _mm256_set1_epi32((int) ((((UINT32) -10868) << 16) | (UINT16) -5535));
+	const __m256i cb_b  = _mm256_set1_epi32(16403);
+	const __m256i cr_rg = _mm256_set1_epi32((int) ((((UINT32) -13714) << 16) | 16377));
+	const __m256i cr_b  = _mm256_set1_epi32((UINT16) -2663);
+
+	for (y = 0; y < roi->height; y++)
+	{
+		const INT16* rptr = (const INT16*) (((const BYTE*) pSrc[0]) + y * srcStep);
+		const INT16* gptr = (const INT16*) (((const BYTE*) pSrc[1]) + y * srcStep);
+		const INT16* bptr = (const INT16*) (((const BYTE*) pSrc[2]) + y * srcStep);
+		INT16* yptr  = (INT16*) (((BYTE*) pDst[0]) + y * dstStep);
+		INT16* cbptr = (INT16*) (((BYTE*) pDst[1]) + y * dstStep);
+		INT16* crptr = (INT16*) (((BYTE*) pDst[2]) + y * dstStep);
+
+		for (x = 0; x < count; x++)
+		{
+			__m256i r, g, b, rg_lo, rg_hi, b_lo, b_hi;
+
+			r = _mm256_loadu_si256((const __m256i*) rptr);
+			g = _mm256_loadu_si256((const __m256i*) gptr);
+			b = _mm256_loadu_si256((const __m256i*) bptr);
+
+			rg_lo = _mm256_unpacklo_epi16(r, g);
+			rg_hi = _mm256_unpackhi_epi16(r, g);
+			b_lo = _mm256_unpacklo_epi16(b, zero);
+			b_hi = _mm256_unpackhi_epi16(b, zero);
+
+			/* the stores may alias the loads: RFX converts in place */
+			_mm256_storeu_si256((__m256i*) yptr, avx2_RGBToYCbCr_channel(
+				rg_lo, rg_hi, b_lo, b_hi, y_rg, y_b, y_offset, min, max));
+			_mm256_storeu_si256((__m256i*) cbptr, avx2_RGBToYCbCr_channel(
+				rg_lo, rg_hi, b_lo, b_hi, cb_rg, cb_b, zero, min, max));
+			_mm256_storeu_si256((__m256i*) crptr, avx2_RGBToYCbCr_channel(
+				rg_lo, rg_hi, b_lo, b_hi, cr_rg, cr_b, zero, min, max));
+
+			rptr += 16;
+			gptr += 16;
+			bptr += 16;
+			yptr += 16;
+			cbptr += 16;
+			crptr += 16;
+		}
+
+		if (rest)
+		{
+			const INT16* pTailSrc[3];
+			INT16* pTailDst[3];
+			prim_size_t tail;
+
+			pTailSrc[0] = rptr;
+			pTailSrc[1] = gptr;
+			pTailSrc[2] = bptr;
+			pTailDst[0] = yptr;
+			pTailDst[1] = cbptr;
+			pTailDst[2] = crptr;
+			tail.width = rest;
+			tail.height = 1;
+
+			general_RGBToYCbCr_16s16s_P3P3(pTailSrc, srcStep, pTailDst, dstStep, &tail);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif /* WITH_AVX2 */
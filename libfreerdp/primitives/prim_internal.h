@@ -68,4 +68,7 @@ extern void primitives_deinit_YUV(primitives_t *prims);
 extern void primitives_init_16to32bpp(primitives_t *prims);
 extern void primitives_deinit_16to32bpp(primitives_t *prims);
 
+extern void primitives_init_planar(primitives_t *prims);
+extern void primitives_deinit_planar(primitives_t *prims);
+
 #endif /* !__PRIM_INTERNAL_H_INCLUDED__ */
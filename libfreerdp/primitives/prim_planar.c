@@ -0,0 +1,222 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * RDP6 planar codec operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_planar.h"
+
+/* ----------------------------------------------------------------------------
+ * Split 32-bit BGRA pixels into the A, R, G and B planes of pDst.  Without
+ * alpha the alpha plane is filled with 0xFF.  A negative srcStep walks the
+ * source bottom-up, which is how the encoder lays out its planes.
+ */
+pstatus_t general_planarSplit_8u_AC4P4R(
+	const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep,
+	UINT32 width, UINT32 height,
+	BOOL alpha)
+{
+	UINT32 x, y;
+	const BYTE* sptr;
+	BYTE* pA = pDst[0];
+	BYTE* pR = pDst[1];
+	BYTE* pG = pDst[2];
+	BYTE* pB = pDst[3];
+
+	for (y = 0; y < height; y++)
+	{
+		sptr = pSrc;
+
+		for (x = 0; x < width; x++)
+		{
+			pB[x] = *sptr++;
+			pG[x] = *sptr++;
+			pR[x] = *sptr++;
+			pA[x] = alpha ? *sptr : 0xFF;
+			sptr++;
+		}
+
+		pSrc += srcStep;
+		pA += dstStep;
+		pR += dstStep;
+		pG += dstStep;
+		pB += dstStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Merge the A, R, G and B planes of pSrc into 32-bit BGRA pixels.  When
+ * pSrc[0] is NULL the alpha bytes of pDst are left as they are.  A negative
+ * dstStep writes the destination bottom-up.
+ */
+pstatus_t general_planarJoin_8u_P4AC4R(
+	const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep,
+	UINT32 width, UINT32 height)
+{
+	UINT32 x, y;
+	BYTE* dptr;
+	const BYTE* pA = pSrc[0];
+	const BYTE* pR = pSrc[1];
+	const BYTE* pG = pSrc[2];
+	const BYTE* pB = pSrc[3];
+
+	for (y = 0; y < height; y++)
+	{
+		dptr = pDst;
+
+		for (x = 0; x < width; x++)
+		{
+			dptr[0] = pB[x];
+			dptr[1] = pG[x];
+			dptr[2] = pR[x];
+
+			if (pA)
+				dptr[3] = pA[x];
+
+			dptr += 4;
+		}
+
+		pDst += dstStep;
+		pR += srcStep;
+		pG += srcStep;
+		pB += srcStep;
+
+		if (pA)
+			pA += srcStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Delta-encode a scanline against the previous one: the byte difference is
+ * stored as a sign-magnitude value with the sign in the low bit
+ * (2 * delta for delta >= 0, -2 * delta - 1 otherwise).
+ */
+pstatus_t general_planarDeltaEncode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	INT8 delta;
+
+	while (len--)
+	{
+		delta = (INT8) (*pSrc++ - *pPrev++);
+		*pDst++ = (BYTE) ((delta << 1) ^ (delta >> 7));
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Inverse of planarDeltaEncode_8u.  pDst may alias pSrc.
+ */
+pstatus_t general_planarDeltaDecode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	BYTE value;
+
+	while (len--)
+	{
+		value = *pSrc++;
+		value = (value >> 1) ^ ((value & 1) ? 0xFF : 0x00);
+		*pDst++ = (BYTE) (*pPrev++ + value);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+ * Find the first run of at least three bytes that repeat their predecessor,
+ * prev standing in for the byte before pSrc[0].  These are the runs the RLE
+ * encoder emits; shorter repetitions are stored as raw bytes.  On return
+ * *pOffset is the index of the first repeated byte and *pLength the number
+ * of repeats, or *pOffset is len and *pLength 0 if there is no such run.
+ */
+pstatus_t general_planarFindRun_8u(
+	const BYTE* pSrc,
+	INT32 len,
+	BYTE prev,
+	INT32* pOffset,
+	INT32* pLength)
+{
+	INT32 x;
+	INT32 start;
+	INT32 count = 0;
+	BYTE symbol = prev;
+
+	for (x = 0; x < len; x++)
+	{
+		if (pSrc[x] != symbol)
+		{
+			symbol = pSrc[x];
+			count = 0;
+		}
+		else if (++count == 3)
+		{
+			break;
+		}
+	}
+
+	if (count < 3)
+	{
+		*pOffset = len;
+		*pLength = 0;
+		return PRIMITIVES_SUCCESS;
+	}
+
+	start = x - 2;
+
+	for (x++; (x < len) && (pSrc[x] == symbol); x++);
+
+	*pOffset = start;
+	*pLength = x - start;
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_planar(primitives_t* prims)
+{
+	prims->planarSplit_8u_AC4P4R = general_planarSplit_8u_AC4P4R;
+	prims->planarJoin_8u_P4AC4R = general_planarJoin_8u_P4AC4R;
+	prims->planarDeltaEncode_8u = general_planarDeltaEncode_8u;
+	prims->planarDeltaDecode_8u = general_planarDeltaDecode_8u;
+	prims->planarFindRun_8u = general_planarFindRun_8u;
+
+	primitives_init_planar_opt(prims);
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_deinit_planar(primitives_t* prims)
+{
+	/* Nothing to do. */
+}
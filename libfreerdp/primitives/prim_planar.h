@@ -0,0 +1,41 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * RDP6 planar codec operations.
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef __GNUC__
+# pragma once
+#endif
+
+#ifndef __PRIM_PLANAR_H_INCLUDED__
+#define __PRIM_PLANAR_H_INCLUDED__
+
+pstatus_t general_planarSplit_8u_AC4P4R(const BYTE* pSrc, INT32 srcStep, BYTE* pDst[4], INT32 dstStep, UINT32 width, UINT32 height, BOOL alpha);
+pstatus_t general_planarJoin_8u_P4AC4R(const BYTE* pSrc[4], INT32 srcStep, BYTE* pDst, INT32 dstStep, UINT32 width, UINT32 height);
+pstatus_t general_planarDeltaEncode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+pstatus_t general_planarDeltaDecode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+pstatus_t general_planarFindRun_8u(const BYTE* pSrc, INT32 len, BYTE prev, INT32* pOffset, INT32* pLength);
+
+#ifdef WITH_AVX2
+pstatus_t avx2_planarSplit_8u_AC4P4R(const BYTE* pSrc, INT32 srcStep, BYTE* pDst[4], INT32 dstStep, UINT32 width, UINT32 height, BOOL alpha);
+pstatus_t avx2_planarJoin_8u_P4AC4R(const BYTE* pSrc[4], INT32 srcStep, BYTE* pDst, INT32 dstStep, UINT32 width, UINT32 height);
+pstatus_t avx2_planarDeltaEncode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+pstatus_t avx2_planarDeltaDecode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+pstatus_t avx2_planarFindRun_8u(const BYTE* pSrc, INT32 len, BYTE prev, INT32* pOffset, INT32* pLength);
+#endif
+
+void primitives_init_planar_opt(primitives_t* prims);
+
+#endif /* !__PRIM_PLANAR_H_INCLUDED__ */
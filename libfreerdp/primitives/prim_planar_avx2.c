@@ -0,0 +1,341 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * AVX2 RDP6 planar codec operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef WITH_AVX2
+#include <immintrin.h>
+#endif /* WITH_AVX2 */
+
+#include <winpr/crt.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_planar.h"
+
+#ifdef WITH_AVX2
+
+/* Index of the lowest set bit of a non-zero movemask. */
+#define AVX2_FIRST_BIT(_mask) (31 - __lzcnt((_mask) & (~(_mask) + 1)))
+
+/* ------------------------------------------------------------------------- */
+pstatus_t avx2_planarSplit_8u_AC4P4R(
+	const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep,
+	UINT32 width, UINT32 height,
+	BOOL alpha)
+{
+	UINT32 x, y;
+	const BYTE* sptr;
+	BYTE* pA = pDst[0];
+	BYTE* pR = pDst[1];
+	BYTE* pG = pDst[2];
+	BYTE* pB = pDst[3];
+	__m256i x0, x1, x2, x3, t0, t1, t2, t3;
+	const __m256i shuffle = _mm256_set_epi8(
+		15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0,
+		15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
+	const __m256i order = _mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0);
+	const __m256i opaque = _mm256_set1_epi8((char) 0xFF);
+
+	for (y = 0; y < height; y++)
+	{
+		sptr = pSrc;
+
+		/* Thirty-two pixels per iteration. */
+		for (x = 0; (x + 32) <= width; x += 32)
+		{
+			x0 = _mm256_loadu_si256((const __m256i*) &sptr[0]);
+			x1 = _mm256_loadu_si256((const __m256i*) &sptr[32]);
+			x2 = _mm256_loadu_si256((const __m256i*) &sptr[64]);
+			x3 = _mm256_loadu_si256((const __m256i*) &sptr[96]);
+			sptr += 128;
+
+			/* b3b2b1b0 g3g2g1g0 r3r2r1r0 a3a2a1a0 in each 128-bit lane */
+			x0 = _mm256_shuffle_epi8(x0, shuffle);
+			x1 = _mm256_shuffle_epi8(x1, shuffle);
+			x2 = _mm256_shuffle_epi8(x2, shuffle);
+			x3 = _mm256_shuffle_epi8(x3, shuffle);
+
+			/**
+			 * Same 4x4 transpose as the SSSE3 version, within each lane.
+			 * Each plane then holds its groups of four pixels in the order
+			 * 0 2 4 6 1 3 5 7, which a single permute puts right.
+			 */
+			t0 = _mm256_unpacklo_epi32(x0, x1);
+			t1 = _mm256_unpackhi_epi32(x0, x1);
+			t2 = _mm256_unpacklo_epi32(x2, x3);
+			t3 = _mm256_unpackhi_epi32(x2, x3);
+
+			_mm256_storeu_si256((__m256i*) &pB[x],
+				_mm256_permutevar8x32_epi32(_mm256_unpacklo_epi64(t0, t2), order));
+			_mm256_storeu_si256((__m256i*) &pG[x],
+				_mm256_permutevar8x32_epi32(_mm256_unpackhi_epi64(t0, t2), order));
+			_mm256_storeu_si256((__m256i*) &pR[x],
+				_mm256_permutevar8x32_epi32(_mm256_unpacklo_epi64(t1, t3), order));
+			_mm256_storeu_si256((__m256i*) &pA[x], alpha ?
+				_mm256_permutevar8x32_epi32(_mm256_unpackhi_epi64(t1, t3), order) : opaque);
+		}
+
+		for (; x < width; x++)
+		{
+			pB[x] = *sptr++;
+			pG[x] = *sptr++;
+			pR[x] = *sptr++;
+			pA[x] = alpha ? *sptr : 0xFF;
+			sptr++;
+		}
+
+		pSrc += srcStep;
+		pA += dstStep;
+		pR += dstStep;
+		pG += dstStep;
+		pB += dstStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t avx2_planarJoin_8u_P4AC4R(
+	const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep,
+	UINT32 width, UINT32 height)
+{
+	UINT32 x, y;
+	BYTE* dptr;
+	const BYTE* pA = pSrc[0];
+	const BYTE* pR = pSrc[1];
+	const BYTE* pG = pSrc[2];
+	const BYTE* pB = pSrc[3];
+	__m256i a, r, g, b, bg, ra, px[4];
+	const __m256i alphaMask = _mm256_set1_epi32(0xFF000000);
+
+	a = _mm256_setzero_si256();
+
+	for (y = 0; y < height; y++)
+	{
+		dptr = pDst;
+
+		/* Thirty-two pixels per iteration. */
+		for (x = 0; (x + 32) <= width; x += 32)
+		{
+			r = _mm256_loadu_si256((const __m256i*) &pR[x]);
+			g = _mm256_loadu_si256((const __m256i*) &pG[x]);
+			b = _mm256_loadu_si256((const __m256i*) &pB[x]);
+
+			if (pA)
+				a = _mm256_loadu_si256((const __m256i*) &pA[x]);
+
+			/* the unpacks work per 128-bit lane: px[0] holds pixels 0-3 and 16-19 */
+			bg = _mm256_unpacklo_epi8(b, g);
+			ra = _mm256_unpacklo_epi8(r, a);
+			px[0] = _mm256_unpacklo_epi16(bg, ra);
+			px[1] = _mm256_unpackhi_epi16(bg, ra);
+
+			bg = _mm256_unpackhi_epi8(b, g);
+			ra = _mm256_unpackhi_epi8(r, a);
+			px[2] = _mm256_unpacklo_epi16(bg, ra);
+			px[3] = _mm256_unpackhi_epi16(bg, ra);
+
+			bg = px[0];
+			ra = px[2];
+			px[0] = _mm256_permute2x128_si256(bg, px[1], 0x20);
+			px[2] = _mm256_permute2x128_si256(bg, px[1], 0x31);
+			px[1] = _mm256_permute2x128_si256(ra, px[3], 0x20);
+			px[3] = _mm256_permute2x128_si256(ra, px[3], 0x31);
+
+			if (!pA)
+			{
+				/* keep the alpha already in the destination */
+				px[0] = _mm256_or_si256(px[0], _mm256_and_si256(_mm256_loadu_si256((const __m256i*) &dptr[0]), alphaMask));
+				px[1] = _mm256_or_si256(px[1], _mm256_and_si256(_mm256_loadu_si256((const __m256i*) &dptr[32]), alphaMask));
+				px[2] = _mm256_or_si256(px[2], _mm256_and_si256(_mm256_loadu_si256((const __m256i*) &dptr[64]), alphaMask));
+				px[3] = _mm256_or_si256(px[3], _mm256_and_si256(_mm256_loadu_si256((const __m256i*) &dptr[96]), alphaMask));
+			}
+
+			_mm256_storeu_si256((__m256i*) &dptr[0], px[0]);
+			_mm256_storeu_si256((__m256i*) &dptr[32], px[1]);
+			_mm256_storeu_si256((__m256i*) &dptr[64], px[2]);
+			_mm256_storeu_si256((__m256i*) &dptr[96], px[3]);
+
+			dptr += 128;
+		}
+
+		for (; x < width; x++)
+		{
+			dptr[0] = pB[x];
+			dptr[1] = pG[x];
+			dptr[2] = pR[x];
+
+			if (pA)
+				dptr[3] = pA[x];
+
+			dptr += 4;
+		}
+
+		pDst += dstStep;
+		pR += srcStep;
+		pG += srcStep;
+		pB += srcStep;
+
+		if (pA)
+			pA += srcStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t avx2_planarDeltaEncode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	__m256i delta, sign;
+	const __m256i zero = _mm256_setzero_si256();
+
+	while (len >= 32)
+	{
+		delta = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*) pSrc),
+				_mm256_loadu_si256((const __m256i*) pPrev));
+
+		/* (delta << 1) ^ (delta >> 7), per byte */
+		sign = _mm256_cmpgt_epi8(zero, delta);
+		_mm256_storeu_si256((__m256i*) pDst, _mm256_xor_si256(_mm256_add_epi8(delta, delta), sign));
+
+		pSrc += 32;
+		pPrev += 32;
+		pDst += 32;
+		len -= 32;
+	}
+
+	return general_planarDeltaEncode_8u(pSrc, pPrev, pDst, len);
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t avx2_planarDeltaDecode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	__m256i value, sign;
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i low7 = _mm256_set1_epi8(0x7F);
+
+	while (len >= 32)
+	{
+		value = _mm256_loadu_si256((const __m256i*) pSrc);
+
+		/* (value >> 1) ^ -(value & 1), per byte */
+		sign = _mm256_cmpeq_epi8(_mm256_and_si256(value, one), one);
+		value = _mm256_and_si256(_mm256_srli_epi16(value, 1), low7);
+		value = _mm256_xor_si256(value, sign);
+		_mm256_storeu_si256((__m256i*) pDst, _mm256_add_epi8(value,
+				_mm256_loadu_si256((const __m256i*) pPrev)));
+
+		pSrc += 32;
+		pPrev += 32;
+		pDst += 32;
+		len -= 32;
+	}
+
+	return general_planarDeltaDecode_8u(pSrc, pPrev, pDst, len);
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t avx2_planarFindRun_8u(
+	const BYTE* pSrc,
+	INT32 len,
+	BYTE prev,
+	INT32* pOffset,
+	INT32* pLength)
+{
+	INT32 x;
+	INT32 start;
+	UINT32 mask;
+	__m256i symbol;
+
+	if ((len >= 3) && (pSrc[0] == prev) && (pSrc[1] == prev) && (pSrc[2] == prev))
+	{
+		start = 0;
+		goto found;
+	}
+
+	/* See the SSE2 version; with 32-bit masks the window advances by 30. */
+
+	for (x = 1; (x + 32) <= len; x += 30)
+	{
+		mask = (UINT32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+				_mm256_loadu_si256((const __m256i*) &pSrc[x]),
+				_mm256_loadu_si256((const __m256i*) &pSrc[x - 1])));
+
+		mask = mask & (mask >> 1) & (mask >> 2) & 0x3FFFFFFF;
+
+		if (mask)
+		{
+			start = x + AVX2_FIRST_BIT(mask);
+			goto found;
+		}
+	}
+
+	for (; (x + 2) < len; x++)
+	{
+		if ((pSrc[x] == pSrc[x - 1]) && (pSrc[x + 1] == pSrc[x]) && (pSrc[x + 2] == pSrc[x]))
+		{
+			start = x;
+			goto found;
+		}
+	}
+
+	*pOffset = len;
+	*pLength = 0;
+
+	return PRIMITIVES_SUCCESS;
+
+found:
+	symbol = _mm256_set1_epi8((char) pSrc[start]);
+
+	for (x = start + 3; (x + 32) <= len; x += 32)
+	{
+		mask = ~((UINT32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+				_mm256_loadu_si256((const __m256i*) &pSrc[x]), symbol)));
+
+		if (mask)
+		{
+			x += AVX2_FIRST_BIT(mask);
+			break;
+		}
+	}
+
+	for (; (x < len) && (pSrc[x] == pSrc[start]); x++);
+
+	*pOffset = start;
+	*pLength = x - start;
+
+	return PRIMITIVES_SUCCESS;
+}
+
+#undef AVX2_FIRST_BIT
+
+#endif /* WITH_AVX2 */
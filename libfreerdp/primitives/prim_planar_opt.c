@@ -0,0 +1,528 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Optimized RDP6 planar codec operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#elif defined(WITH_NEON)
+#include <arm_neon.h>
+#endif /* WITH_SSE2 else WITH_NEON */
+
+#include "prim_internal.h"
+#include "prim_planar.h"
+
+#ifdef WITH_SSE2
+
+/* Index of the lowest set bit of a non-zero movemask. */
+#define SSE2_FIRST_BIT(_mask) (31 - __lzcnt((_mask) & (~(_mask) + 1)))
+
+/* ------------------------------------------------------------------------- */
+pstatus_t ssse3_planarSplit_8u_AC4P4R(
+	const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep,
+	UINT32 width, UINT32 height,
+	BOOL alpha)
+{
+	UINT32 x, y;
+	const BYTE* sptr;
+	BYTE* pA = pDst[0];
+	BYTE* pR = pDst[1];
+	BYTE* pG = pDst[2];
+	BYTE* pB = pDst[3];
+	__m128i x0, x1, x2, x3, t0, t1, t2, t3;
+	const __m128i shuffle = _mm_set_epi8(15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
+	const __m128i opaque = _mm_set1_epi8((char) 0xFF);
+
+	for (y = 0; y < height; y++)
+	{
+		sptr = pSrc;
+
+		/* Sixteen pixels per iteration. */
+		for (x = 0; (x + 16) <= width; x += 16)
+		{
+			x0 = _mm_loadu_si128((const __m128i*) &sptr[0]);
+			x1 = _mm_loadu_si128((const __m128i*) &sptr[16]);
+			x2 = _mm_loadu_si128((const __m128i*) &sptr[32]);
+			x3 = _mm_loadu_si128((const __m128i*) &sptr[48]);
+			sptr += 64;
+
+			/* b3b2b1b0 g3g2g1g0 r3r2r1r0 a3a2a1a0 in each register */
+			x0 = _mm_shuffle_epi8(x0, shuffle);
+			x1 = _mm_shuffle_epi8(x1, shuffle);
+			x2 = _mm_shuffle_epi8(x2, shuffle);
+			x3 = _mm_shuffle_epi8(x3, shuffle);
+
+			/* transpose the 4x4 block of 32-bit channel groups */
+			t0 = _mm_unpacklo_epi32(x0, x1);	/* b0-3 b4-7 g0-3 g4-7 */
+			t1 = _mm_unpackhi_epi32(x0, x1);	/* r0-3 r4-7 a0-3 a4-7 */
+			t2 = _mm_unpacklo_epi32(x2, x3);	/* b8-11 b12-15 g8-11 g12-15 */
+			t3 = _mm_unpackhi_epi32(x2, x3);	/* r8-11 r12-15 a8-11 a12-15 */
+
+			_mm_storeu_si128((__m128i*) &pB[x], _mm_unpacklo_epi64(t0, t2));
+			_mm_storeu_si128((__m128i*) &pG[x], _mm_unpackhi_epi64(t0, t2));
+			_mm_storeu_si128((__m128i*) &pR[x], _mm_unpacklo_epi64(t1, t3));
+			_mm_storeu_si128((__m128i*) &pA[x], alpha ? _mm_unpackhi_epi64(t1, t3) : opaque);
+		}
+
+		for (; x < width; x++)
+		{
+			pB[x] = *sptr++;
+			pG[x] = *sptr++;
+			pR[x] = *sptr++;
+			pA[x] = alpha ? *sptr : 0xFF;
+			sptr++;
+		}
+
+		pSrc += srcStep;
+		pA += dstStep;
+		pR += dstStep;
+		pG += dstStep;
+		pB += dstStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t sse2_planarJoin_8u_P4AC4R(
+	const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep,
+	UINT32 width, UINT32 height)
+{
+	UINT32 x, y;
+	BYTE* dptr;
+	const BYTE* pA = pSrc[0];
+	const BYTE* pR = pSrc[1];
+	const BYTE* pG = pSrc[2];
+	const BYTE* pB = pSrc[3];
+	__m128i a, r, g, b, bg, ra, px[4];
+	const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+
+	a = _mm_setzero_si128();
+
+	for (y = 0; y < height; y++)
+	{
+		dptr = pDst;
+
+		/* Sixteen pixels per iteration. */
+		for (x = 0; (x + 16) <= width; x += 16)
+		{
+			r = _mm_loadu_si128((const __m128i*) &pR[x]);
+			g = _mm_loadu_si128((const __m128i*) &pG[x]);
+			b = _mm_loadu_si128((const __m128i*) &pB[x]);
+
+			if (pA)
+				a = _mm_loadu_si128((const __m128i*) &pA[x]);
+
+			bg = _mm_unpacklo_epi8(b, g);	/* g7b7 ... g0b0 */
+			ra = _mm_unpacklo_epi8(r, a);	/* a7r7 ... a0r0 */
+			px[0] = _mm_unpacklo_epi16(bg, ra);
+			px[1] = _mm_unpackhi_epi16(bg, ra);
+
+			bg = _mm_unpackhi_epi8(b, g);	/* g15b15 ... g8b8 */
+			ra = _mm_unpackhi_epi8(r, a);	/* a15r15 ... a8r8 */
+			px[2] = _mm_unpacklo_epi16(bg, ra);
+			px[3] = _mm_unpackhi_epi16(bg, ra);
+
+			if (!pA)
+			{
+				/* keep the alpha already in the destination */
+				px[0] = _mm_or_si128(px[0], _mm_and_si128(_mm_loadu_si128((const __m128i*) &dptr[0]), alphaMask));
+				px[1] = _mm_or_si128(px[1], _mm_and_si128(_mm_loadu_si128((const __m128i*) &dptr[16]), alphaMask));
+				px[2] = _mm_or_si128(px[2], _mm_and_si128(_mm_loadu_si128((const __m128i*) &dptr[32]), alphaMask));
+				px[3] = _mm_or_si128(px[3], _mm_and_si128(_mm_loadu_si128((const __m128i*) &dptr[48]), alphaMask));
+			}
+
+			_mm_storeu_si128((__m128i*) &dptr[0], px[0]);
+			_mm_storeu_si128((__m128i*) &dptr[16], px[1]);
+			_mm_storeu_si128((__m128i*) &dptr[32], px[2]);
+			_mm_storeu_si128((__m128i*) &dptr[48], px[3]);
+
+			dptr += 64;
+		}
+
+		for (; x < width; x++)
+		{
+			dptr[0] = pB[x];
+			dptr[1] = pG[x];
+			dptr[2] = pR[x];
+
+			if (pA)
+				dptr[3] = pA[x];
+
+			dptr += 4;
+		}
+
+		pDst += dstStep;
+		pR += srcStep;
+		pG += srcStep;
+		pB += srcStep;
+
+		if (pA)
+			pA += srcStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t sse2_planarDeltaEncode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	__m128i delta, sign;
+	const __m128i zero = _mm_setzero_si128();
+
+	while (len >= 16)
+	{
+		delta = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) pSrc),
+				_mm_loadu_si128((const __m128i*) pPrev));
+
+		/* (delta << 1) ^ (delta >> 7), per byte */
+		sign = _mm_cmpgt_epi8(zero, delta);
+		_mm_storeu_si128((__m128i*) pDst, _mm_xor_si128(_mm_add_epi8(delta, delta), sign));
+
+		pSrc += 16;
+		pPrev += 16;
+		pDst += 16;
+		len -= 16;
+	}
+
+	return general_planarDeltaEncode_8u(pSrc, pPrev, pDst, len);
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t sse2_planarDeltaDecode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	__m128i value, sign;
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i low7 = _mm_set1_epi8(0x7F);
+
+	while (len >= 16)
+	{
+		value = _mm_loadu_si128((const __m128i*) pSrc);
+
+		/* (value >> 1) ^ -(value & 1), per byte */
+		sign = _mm_cmpeq_epi8(_mm_and_si128(value, one), one);
+		value = _mm_and_si128(_mm_srli_epi16(value, 1), low7);
+		value = _mm_xor_si128(value, sign);
+		_mm_storeu_si128((__m128i*) pDst, _mm_add_epi8(value,
+				_mm_loadu_si128((const __m128i*) pPrev)));
+
+		pSrc += 16;
+		pPrev += 16;
+		pDst += 16;
+		len -= 16;
+	}
+
+	return general_planarDeltaDecode_8u(pSrc, pPrev, pDst, len);
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t sse2_planarFindRun_8u(
+	const BYTE* pSrc,
+	INT32 len,
+	BYTE prev,
+	INT32* pOffset,
+	INT32* pLength)
+{
+	INT32 x;
+	INT32 start;
+	UINT32 mask;
+	__m128i symbol;
+
+	if ((len >= 3) && (pSrc[0] == prev) && (pSrc[1] == prev) && (pSrc[2] == prev))
+	{
+		start = 0;
+		goto found;
+	}
+
+	/**
+	 * Bit i of mask is set when pSrc[x + i] repeats pSrc[x + i - 1]; three
+	 * consecutive set bits start a run.  Only the first 14 bits have all the
+	 * bits they need, so the window advances by 14.
+	 */
+
+	for (x = 1; (x + 16) <= len; x += 14)
+	{
+		mask = (UINT32) _mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i*) &pSrc[x]),
+				_mm_loadu_si128((const __m128i*) &pSrc[x - 1])));
+
+		mask = mask & (mask >> 1) & (mask >> 2) & 0x3FFF;
+
+		if (mask)
+		{
+			start = x + SSE2_FIRST_BIT(mask);
+			goto found;
+		}
+	}
+
+	for (; (x + 2) < len; x++)
+	{
+		if ((pSrc[x] == pSrc[x - 1]) && (pSrc[x + 1] == pSrc[x]) && (pSrc[x + 2] == pSrc[x]))
+		{
+			start = x;
+			goto found;
+		}
+	}
+
+	*pOffset = len;
+	*pLength = 0;
+
+	return PRIMITIVES_SUCCESS;
+
+found:
+	symbol = _mm_set1_epi8((char) pSrc[start]);
+
+	for (x = start + 3; (x + 16) <= len; x += 16)
+	{
+		mask = ~((UINT32) _mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i*) &pSrc[x]), symbol))) & 0xFFFF;
+
+		if (mask)
+		{
+			x += SSE2_FIRST_BIT(mask);
+			break;
+		}
+	}
+
+	for (; (x < len) && (pSrc[x] == pSrc[start]); x++);
+
+	*pOffset = start;
+	*pLength = x - start;
+
+	return PRIMITIVES_SUCCESS;
+}
+
+#undef SSE2_FIRST_BIT
+
+#endif /* WITH_SSE2 */
+
+#ifdef WITH_NEON
+
+/* ------------------------------------------------------------------------- */
+pstatus_t neon_planarSplit_8u_AC4P4R(
+	const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep,
+	UINT32 width, UINT32 height,
+	BOOL alpha)
+{
+	UINT32 x, y;
+	const BYTE* sptr;
+	uint8x16x4_t bgra;
+	BYTE* pA = pDst[0];
+	BYTE* pR = pDst[1];
+	BYTE* pG = pDst[2];
+	BYTE* pB = pDst[3];
+	const uint8x16_t opaque = vdupq_n_u8(0xFF);
+
+	for (y = 0; y < height; y++)
+	{
+		sptr = pSrc;
+
+		for (x = 0; (x + 16) <= width; x += 16)
+		{
+			bgra = vld4q_u8(sptr);
+			sptr += 64;
+
+			vst1q_u8(&pB[x], bgra.val[0]);
+			vst1q_u8(&pG[x], bgra.val[1]);
+			vst1q_u8(&pR[x], bgra.val[2]);
+			vst1q_u8(&pA[x], alpha ? bgra.val[3] : opaque);
+		}
+
+		for (; x < width; x++)
+		{
+			pB[x] = *sptr++;
+			pG[x] = *sptr++;
+			pR[x] = *sptr++;
+			pA[x] = alpha ? *sptr : 0xFF;
+			sptr++;
+		}
+
+		pSrc += srcStep;
+		pA += dstStep;
+		pR += dstStep;
+		pG += dstStep;
+		pB += dstStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t neon_planarJoin_8u_P4AC4R(
+	const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep,
+	UINT32 width, UINT32 height)
+{
+	UINT32 x, y;
+	BYTE* dptr;
+	uint8x16x4_t bgra;
+	const BYTE* pA = pSrc[0];
+	const BYTE* pR = pSrc[1];
+	const BYTE* pG = pSrc[2];
+	const BYTE* pB = pSrc[3];
+
+	for (y = 0; y < height; y++)
+	{
+		dptr = pDst;
+
+		for (x = 0; (x + 16) <= width; x += 16)
+		{
+			/* without an alpha plane, keep the alpha already in the destination */
+			if (pA)
+				bgra.val[3] = vld1q_u8(&pA[x]);
+			else
+				bgra = vld4q_u8(dptr);
+
+			bgra.val[0] = vld1q_u8(&pB[x]);
+			bgra.val[1] = vld1q_u8(&pG[x]);
+			bgra.val[2] = vld1q_u8(&pR[x]);
+
+			vst4q_u8(dptr, bgra);
+			dptr += 64;
+		}
+
+		for (; x < width; x++)
+		{
+			dptr[0] = pB[x];
+			dptr[1] = pG[x];
+			dptr[2] = pR[x];
+
+			if (pA)
+				dptr[3] = pA[x];
+
+			dptr += 4;
+		}
+
+		pDst += dstStep;
+		pR += srcStep;
+		pG += srcStep;
+		pB += srcStep;
+
+		if (pA)
+			pA += srcStep;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t neon_planarDeltaEncode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	int8x16_t delta;
+
+	while (len >= 16)
+	{
+		delta = vreinterpretq_s8_u8(vsubq_u8(vld1q_u8(pSrc), vld1q_u8(pPrev)));
+		vst1q_u8(pDst, vreinterpretq_u8_s8(veorq_s8(vshlq_n_s8(delta, 1), vshrq_n_s8(delta, 7))));
+
+		pSrc += 16;
+		pPrev += 16;
+		pDst += 16;
+		len -= 16;
+	}
+
+	return general_planarDeltaEncode_8u(pSrc, pPrev, pDst, len);
+}
+
+/* ------------------------------------------------------------------------- */
+pstatus_t neon_planarDeltaDecode_8u(
+	const BYTE* pSrc,
+	const BYTE* pPrev,
+	BYTE* pDst,
+	INT32 len)
+{
+	uint8x16_t value, sign;
+
+	while (len >= 16)
+	{
+		value = vld1q_u8(pSrc);
+		sign = vreinterpretq_u8_s8(vnegq_s8(vreinterpretq_s8_u8(vandq_u8(value, vdupq_n_u8(1)))));
+		value = veorq_u8(vshrq_n_u8(value, 1), sign);
+		vst1q_u8(pDst, vaddq_u8(value, vld1q_u8(pPrev)));
+
+		pSrc += 16;
+		pPrev += 16;
+		pDst += 16;
+		len -= 16;
+	}
+
+	return general_planarDeltaDecode_8u(pSrc, pPrev, pDst, len);
+}
+
+#endif /* WITH_NEON */
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_planar_opt(primitives_t* prims)
+{
+#if defined(WITH_SSE2)
+	if (IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->planarJoin_8u_P4AC4R = sse2_planarJoin_8u_P4AC4R;
+		prims->planarDeltaEncode_8u = sse2_planarDeltaEncode_8u;
+		prims->planarDeltaDecode_8u = sse2_planarDeltaDecode_8u;
+		prims->planarFindRun_8u = sse2_planarFindRun_8u;
+	}
+
+	if (IsProcessorFeaturePresentEx(PF_EX_SSSE3)
+			&& IsProcessorFeaturePresent(PF_SSE3_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->planarSplit_8u_AC4P4R = ssse3_planarSplit_8u_AC4P4R;
+	}
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		prims->planarSplit_8u_AC4P4R = avx2_planarSplit_8u_AC4P4R;
+		prims->planarJoin_8u_P4AC4R = avx2_planarJoin_8u_P4AC4R;
+		prims->planarDeltaEncode_8u = avx2_planarDeltaEncode_8u;
+		prims->planarDeltaDecode_8u = avx2_planarDeltaDecode_8u;
+		prims->planarFindRun_8u = avx2_planarFindRun_8u;
+	}
+#endif /* WITH_AVX2 */
+#elif defined(WITH_NEON)
+	if (IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+	{
+		prims->planarSplit_8u_AC4P4R = neon_planarSplit_8u_AC4P4R;
+		prims->planarJoin_8u_P4AC4R = neon_planarJoin_8u_P4AC4R;
+		prims->planarDeltaEncode_8u = neon_planarDeltaEncode_8u;
+		prims->planarDeltaDecode_8u = neon_planarDeltaDecode_8u;
+	}
+#endif /* WITH_SSE2 else WITH_NEON */
+}
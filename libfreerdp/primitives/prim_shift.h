@@ -29,6 +29,13 @@ pstatus_t general_rShiftC_16u(const UINT16 *pSrc, INT32 val, UINT16 *pDst, INT32
 pstatus_t general_shiftC_16s(const INT16 *pSrc, INT32 val, INT16 *pDst, INT32 len);
 pstatus_t general_shiftC_16u(const UINT16 *pSrc, INT32 val, UINT16 *pDst, INT32 len);
 
+#ifdef WITH_AVX2
+pstatus_t avx2_lShiftC_16s(const INT16 *pSrc, INT32 val, INT16 *pDst, INT32 len);
+pstatus_t avx2_rShiftC_16s(const INT16 *pSrc, INT32 val, INT16 *pDst, INT32 len);
+pstatus_t avx2_lShiftC_16u(const UINT16 *pSrc, INT32 val, UINT16 *pDst, INT32 len);
+pstatus_t avx2_rShiftC_16u(const UINT16 *pSrc, INT32 val, UINT16 *pDst, INT32 len);
+#endif
+
 void primitives_init_shift_opt(primitives_t *prims);
 
 #endif /* !__PRIM_SHIFT_H_INCLUDED__ */
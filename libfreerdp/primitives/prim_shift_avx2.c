@@ -0,0 +1,46 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * AVX2 shift operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef WITH_AVX2
+#include <immintrin.h>
+#endif /* WITH_AVX2 */
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_templates.h"
+#include "prim_shift.h"
+
+#ifdef WITH_AVX2
+/* ------------------------------------------------------------------------- */
+AVX2_SCD_ROUTINE(avx2_lShiftC_16s, INT16, general_lShiftC_16s,
+	_mm256_slli_epi16, *dptr++ = *sptr++ << val)
+/* ------------------------------------------------------------------------- */
+AVX2_SCD_ROUTINE(avx2_rShiftC_16s, INT16, general_rShiftC_16s,
+	_mm256_srai_epi16, *dptr++ = *sptr++ >> val)
+/* ------------------------------------------------------------------------- */
+AVX2_SCD_ROUTINE(avx2_lShiftC_16u, UINT16, general_lShiftC_16u,
+	_mm256_slli_epi16, *dptr++ = *sptr++ << val)
+/* ------------------------------------------------------------------------- */
+AVX2_SCD_ROUTINE(avx2_rShiftC_16u, UINT16, general_rShiftC_16u,
+	_mm256_srli_epi16, *dptr++ = *sptr++ >> val)
+#endif /* WITH_AVX2 */
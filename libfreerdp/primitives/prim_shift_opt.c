@@ -75,6 +75,15 @@ void primitives_init_shift_opt(primitives_t *prims)
 		prims->lShiftC_16u = sse2_lShiftC_16u;
 		prims->rShiftC_16u = sse2_rShiftC_16u;
 	}
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		prims->lShiftC_16s = avx2_lShiftC_16s;
+		prims->rShiftC_16s = avx2_rShiftC_16s;
+		prims->lShiftC_16u = avx2_lShiftC_16u;
+		prims->rShiftC_16u = avx2_rShiftC_16u;
+	}
+#endif /* WITH_AVX2 */
 #endif
 }
 
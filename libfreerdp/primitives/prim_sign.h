@@ -24,6 +24,10 @@
 
 pstatus_t general_sign_16s(const INT16 *pSrc, INT16 *pDst, INT32 len);
 
+#ifdef WITH_AVX2
+pstatus_t avx2_sign_16s(const INT16 *pSrc, INT16 *pDst, INT32 len);
+#endif
+
 void primitives_init_sign_opt(primitives_t *prims);
 
 #endif /* !__PRIM_SIGN_H_INCLUDED__ */
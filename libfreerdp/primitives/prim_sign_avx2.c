@@ -0,0 +1,92 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * AVX2 sign operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef WITH_AVX2
+#include <immintrin.h>
+#endif /* WITH_AVX2 */
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_sign.h"
+
+#ifdef WITH_AVX2
+/* ------------------------------------------------------------------------- */
+pstatus_t avx2_sign_16s(
+	const INT16 *pSrc,
+	INT16 *pDst,
+	INT32 len)
+{
+	const INT16 *sptr = pSrc;
+	INT16 *dptr = pDst;
+	size_t count;
+	__m256i ones;
+
+	if (len < 32)
+	{
+		return general_sign_16s(pSrc, pDst, len);
+	}
+
+	ones = _mm256_set1_epi16(0x0001U);
+
+	/* Do 64-short chunks using 4 YMM registers. */
+	count = len >> 6;
+	len -= count << 6;
+
+	while (count--)
+	{
+		__m256i ymm0, ymm1, ymm2, ymm3;
+		ymm0 = _mm256_loadu_si256((const __m256i *) sptr); sptr += 16;
+		ymm1 = _mm256_loadu_si256((const __m256i *) sptr); sptr += 16;
+		ymm2 = _mm256_loadu_si256((const __m256i *) sptr); sptr += 16;
+		ymm3 = _mm256_loadu_si256((const __m256i *) sptr); sptr += 16;
+		ymm0 = _mm256_sign_epi16(ones, ymm0);
+		ymm1 = _mm256_sign_epi16(ones, ymm1);
+		ymm2 = _mm256_sign_epi16(ones, ymm2);
+		ymm3 = _mm256_sign_epi16(ones, ymm3);
+		_mm256_storeu_si256((__m256i *) dptr, ymm0); dptr += 16;
+		_mm256_storeu_si256((__m256i *) dptr, ymm1); dptr += 16;
+		_mm256_storeu_si256((__m256i *) dptr, ymm2); dptr += 16;
+		_mm256_storeu_si256((__m256i *) dptr, ymm3); dptr += 16;
+	}
+
+	/* Do 16-short chunks using a single YMM register. */
+	count = len >> 4;
+	len -= count << 4;
+
+	while (count--)
+	{
+		__m256i ymm0 = _mm256_loadu_si256((const __m256i *) sptr); sptr += 16;
+		ymm0 = _mm256_sign_epi16(ones, ymm0);
+		_mm256_storeu_si256((__m256i *) dptr, ymm0); dptr += 16;
+	}
+
+	/* Do leftovers. */
+	while (len--)
+	{
+		INT16 src = *sptr++;
+		*dptr++ = (src < 0) ? -1 : ((src > 0) ? 1 : 0);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+#endif /* WITH_AVX2 */
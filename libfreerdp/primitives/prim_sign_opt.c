@@ -145,6 +145,12 @@ void primitives_init_sign_opt(primitives_t *prims)
 	{
 		prims->sign_16s  = ssse3_sign_16s;
 	}
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		prims->sign_16s  = avx2_sign_16s;
+	}
+#endif /* WITH_AVX2 */
 #endif
 }
 
@@ -413,4 +413,128 @@ pstatus_t _name_(const _type_ *pSrc1, const _type_ *pSrc2, _type_ *pDst, INT32 l
 	return PRIMITIVES_SUCCESS; \
 }
 
+/* ----------------------------------------------------------------------------
+ * AVX2 versions of the SCD and SSD routines.  AVX2 hardware handles
+ * unaligned 256-bit accesses at nearly full speed, so unlike the SSE3
+ * versions these neither seek alignment nor need separate aligned loops.
+ */
+#define AVX2_SCD_ROUTINE(_name_, _type_, _fallback_, _op_, _slowWay_) \
+pstatus_t _name_(const _type_ *pSrc, INT32 val, _type_ *pDst, INT32 len) \
+{ \
+	const _type_ *sptr = pSrc; \
+	_type_ *dptr = pDst; \
+	size_t count; \
+	if (len < 32)   /* pointless if too small */ \
+	{ \
+		return _fallback_(pSrc, val, pDst, len); \
+	} \
+	/* Use 4 256-bit AVX registers. */ \
+	count = len / (128/sizeof(_type_)); \
+	len -= count * (128/sizeof(_type_)); \
+	while (count--) \
+	{ \
+		__m256i ymm0, ymm1, ymm2, ymm3; \
+		ymm0 = _mm256_loadu_si256((const __m256i *) sptr); \
+		sptr += (32/sizeof(_type_)); \
+		ymm1 = _mm256_loadu_si256((const __m256i *) sptr); \
+		sptr += (32/sizeof(_type_)); \
+		ymm2 = _mm256_loadu_si256((const __m256i *) sptr); \
+		sptr += (32/sizeof(_type_)); \
+		ymm3 = _mm256_loadu_si256((const __m256i *) sptr); \
+		sptr += (32/sizeof(_type_)); \
+		ymm0 = _op_(ymm0, val); \
+		ymm1 = _op_(ymm1, val); \
+		ymm2 = _op_(ymm2, val); \
+		ymm3 = _op_(ymm3, val); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm0); \
+		dptr += (32/sizeof(_type_)); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm1); \
+		dptr += (32/sizeof(_type_)); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm2); \
+		dptr += (32/sizeof(_type_)); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm3); \
+		dptr += (32/sizeof(_type_)); \
+	} \
+	/* Use a single 256-bit AVX register. */ \
+	count = len / (32/sizeof(_type_)); \
+	len -= count * (32/sizeof(_type_)); \
+	while (count--) \
+	{ \
+		__m256i ymm0 = _mm256_loadu_si256((const __m256i *) sptr); \
+		sptr += (32/sizeof(_type_)); \
+		ymm0 = _op_(ymm0, val); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm0); \
+		dptr += (32/sizeof(_type_)); \
+	} \
+	/* Finish off the remainder. */ \
+	while (len--) { _slowWay_; } \
+	return PRIMITIVES_SUCCESS; \
+}
+
+/* ------------------------------------------------------------------------- */
+#define AVX2_SSD_ROUTINE(_name_, _type_, _fallback_, _op_, _slowWay_) \
+pstatus_t _name_(const _type_ *pSrc1, const _type_ *pSrc2, _type_ *pDst, INT32 len) \
+{ \
+	const _type_ *sptr1 = pSrc1; \
+	const _type_ *sptr2 = pSrc2; \
+	_type_ *dptr = pDst; \
+	size_t count; \
+	if (len < 32) /* pointless if too small */ \
+	{ \
+		return _fallback_(pSrc1, pSrc2, pDst, len); \
+	} \
+	/* Use 4 pairs of 256-bit AVX registers. */ \
+	count = len / (128/sizeof(_type_)); \
+	len -= count * (128/sizeof(_type_)); \
+	while (count--) \
+	{ \
+		__m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7; \
+		ymm0 = _mm256_loadu_si256((const __m256i *) sptr1); \
+		sptr1 += (32/sizeof(_type_)); \
+		ymm1 = _mm256_loadu_si256((const __m256i *) sptr1); \
+		sptr1 += (32/sizeof(_type_)); \
+		ymm2 = _mm256_loadu_si256((const __m256i *) sptr1); \
+		sptr1 += (32/sizeof(_type_)); \
+		ymm3 = _mm256_loadu_si256((const __m256i *) sptr1); \
+		sptr1 += (32/sizeof(_type_)); \
+		ymm4 = _mm256_loadu_si256((const __m256i *) sptr2); \
+		sptr2 += (32/sizeof(_type_)); \
+		ymm5 = _mm256_loadu_si256((const __m256i *) sptr2); \
+		sptr2 += (32/sizeof(_type_)); \
+		ymm6 = _mm256_loadu_si256((const __m256i *) sptr2); \
+		sptr2 += (32/sizeof(_type_)); \
+		ymm7 = _mm256_loadu_si256((const __m256i *) sptr2); \
+		sptr2 += (32/sizeof(_type_)); \
+		ymm0 = _op_(ymm0, ymm4); \
+		ymm1 = _op_(ymm1, ymm5); \
+		ymm2 = _op_(ymm2, ymm6); \
+		ymm3 = _op_(ymm3, ymm7); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm0); \
+		dptr += (32/sizeof(_type_)); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm1); \
+		dptr += (32/sizeof(_type_)); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm2); \
+		dptr += (32/sizeof(_type_)); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm3); \
+		dptr += (32/sizeof(_type_)); \
+	} \
+	/* Use a single pair of 256-bit AVX registers. */ \
+	count = len / (32/sizeof(_type_)); \
+	len -= count * (32/sizeof(_type_)); \
+	while (count--) \
+	{ \
+		__m256i ymm0, ymm1; \
+		ymm0 = _mm256_loadu_si256((const __m256i *) sptr1); \
+		sptr1 += (32/sizeof(_type_)); \
+		ymm1 = _mm256_loadu_si256((const __m256i *) sptr2); \
+		sptr2 += (32/sizeof(_type_)); \
+		ymm0 = _op_(ymm0, ymm1); \
+		_mm256_storeu_si256((__m256i *) dptr, ymm0); \
+		dptr += (32/sizeof(_type_)); \
+	} \
+	/* Finish off the remainder. */ \
+	while (len--) { _slowWay_; } \
+	return PRIMITIVES_SUCCESS; \
+}
+
 #endif /* !__PRIM_TEMPLATES_H_INCLUDED__ */
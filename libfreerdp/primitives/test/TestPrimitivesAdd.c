@@ -29,6 +29,8 @@ extern pstatus_t general_add_16s(
 	const INT16 *pSrc1, const INT16 *pSrc2, INT16 *pDst, int len);
 extern pstatus_t sse3_add_16s(
 	const INT16 *pSrc1, const INT16 *pSrc2, INT16 *pDst, int len);
+extern pstatus_t avx2_add_16s(
+	const INT16 *pSrc1, const INT16 *pSrc2, INT16 *pDst, int len);
 
 /* ========================================================================= */
 int test_add16s_func(void)
@@ -36,7 +38,7 @@ int test_add16s_func(void)
 	INT16 ALIGN(src1[FUNC_TEST_SIZE+3]), ALIGN(src2[FUNC_TEST_SIZE+3]), 
 		ALIGN(d1[FUNC_TEST_SIZE+3]), ALIGN(d2[FUNC_TEST_SIZE+3]);
 	int failed = 0;
-#if defined(WITH_SSE2) || defined(WITH_IPP)
+#if defined(WITH_SSE2) || defined(WITH_AVX2) || defined(WITH_IPP)
 	int i;
 #endif
 	char testStr[256];
@@ -75,6 +77,40 @@ int test_add16s_func(void)
 		}
 	}
 #endif
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		strcat(testStr, " AVX2");
+		/* Unaligned */
+		avx2_add_16s(src1+1, src2+1, d2+2, FUNC_TEST_SIZE);
+		for (i=1; i<FUNC_TEST_SIZE; ++i)
+		{
+			if (d1[i] != d2[i+1])
+			{
+				printf("ADD16S-AVX2-unaligned FAIL[%d] %d+%d=%d, got %d\n",
+					i, src1[i], src2[i], d1[i], d2[i+1]);
+				++failed;
+			}
+		}
+		/* Odd length, so the scalar tail is used */
+		memset(d2, 0, sizeof(d2));
+		avx2_add_16s(src1+1, src2+1, d2+3, 77);
+		for (i=1; i<=77; ++i)
+		{
+			if (d1[i] != d2[i+2])
+			{
+				printf("ADD16S-AVX2-odd FAIL[%d] %d+%d=%d, got %d\n",
+					i, src1[i], src2[i], d1[i], d2[i+2]);
+				++failed;
+			}
+		}
+		if (d2[80] != 0)
+		{
+			printf("ADD16S-AVX2-odd FAIL: wrote past the end\n");
+			++failed;
+		}
+	}
+#endif
 #ifdef WITH_IPP
 	strcat(testStr, " IPP");
 	ippsAdd_16s(src1+1, src2+1, d2+1, FUNC_TEST_SIZE);
@@ -93,12 +129,17 @@ int test_add16s_func(void)
 }
  
 /* ------------------------------------------------------------------------- */
-STD_SPEED_TEST(add16s_speed_test, INT16, INT16, dst=dst,
+STD_SPEED_TEST_EX(add16s_speed_test, INT16, INT16, dst=dst,
 	TRUE, general_add_16s(src1, src2, dst, size),
 #ifdef WITH_SSE2
 	TRUE, sse3_add_16s(src1, src2, dst, size), PF_SSE3_INSTRUCTIONS_AVAILABLE, FALSE,
 #else
 	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_add_16s(src1, src2, dst, size),
+#else
+	FALSE, PRIM_NOP,
 #endif
 	TRUE, ippsAdd_16s(src1, src2, dst, size));
 
@@ -39,6 +39,11 @@ extern pstatus_t sse2_alphaComp_argb(
 	const BYTE *pSrc2,  int src2Step,
 	BYTE *pDst,  int dstStep,
 	int width,  int height);
+extern pstatus_t avx2_alphaComp_argb(
+	const BYTE *pSrc1,  int src1Step,
+	const BYTE *pSrc2,  int src2Step,
+	BYTE *pDst,  int dstStep,
+	int width,  int height);
 extern pstatus_t ipp_alphaComp_argb(
 	const BYTE *pSrc1,  int src1Step,
 	const BYTE *pSrc2,  int src2Step,
@@ -203,9 +208,61 @@ int test_alphaComp_func(void)
 	return (error > 0) ? FAILURE : SUCCESS;
 }
 
+/* ------------------------------------------------------------------------- */
+#ifdef WITH_AVX2
+/* The AVX2 version blends eight pixels at a time, so use a region wider
+ * than that with a ragged right edge and a misaligned destination.
+ */
+#define AVX2_WIDTH 67
+#define AVX2_HEIGHT 7
+#define AVX2_STRIDE (AVX2_WIDTH+5)
+
+static int test_alphaComp_avx2_func(void)
+{
+	UINT32 ALIGN(src1[AVX2_STRIDE*AVX2_HEIGHT]);
+	UINT32 ALIGN(src2[AVX2_STRIDE*AVX2_HEIGHT]);
+	UINT32 ALIGN(dst[AVX2_STRIDE*AVX2_HEIGHT+1]);
+	int error = 0;
+	int i, x, y;
+
+	if (!IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		return SUCCESS;
+
+	get_random_data(src1, sizeof(src1));
+	src1[0] &= 0x00FFFFFFU;
+	src1[1] |= 0xFF000000U;
+	get_random_data(src2, sizeof(src2));
+	for (i=0; i<AVX2_STRIDE*AVX2_HEIGHT; ++i) src2[i] |= 0xFF000000U;
+	memset(dst, 0, sizeof(dst));
+
+	avx2_alphaComp_argb((const BYTE *) src1, 4*AVX2_STRIDE,
+		(const BYTE *) src2, 4*AVX2_STRIDE,
+		(BYTE *) (dst+1), 4*AVX2_STRIDE, AVX2_WIDTH, AVX2_HEIGHT);
+
+	for (y=0; y<AVX2_HEIGHT; ++y)
+	{
+		for (x=0; x<AVX2_STRIDE; ++x)
+		{
+			UINT32 s1 = *PIXEL(src1, 4*AVX2_STRIDE, x, y);
+			UINT32 s2 = *PIXEL(src2, 4*AVX2_STRIDE, x, y);
+			UINT32 c0 = (x < AVX2_WIDTH) ? alpha_add(s1, s2) : 0;
+			UINT32 c1 = *PIXEL(dst+1, 4*AVX2_STRIDE, x, y);
+			if ((x < AVX2_WIDTH) ? (colordist(c0, c1) > TOLERANCE) : (c1 != 0))
+			{
+				printf("alphaComp-AVX2: [%d,%d] 0x%08x+0x%08x=0x%08x, got 0x%08x\n",
+					x, y, s1, s2, c0, c1);
+				error = 1;
+			}
+		}
+	}
+	if (!error) printf("All alphaComp tests passed ( AVX2).\n");
+	return (error > 0) ? FAILURE : SUCCESS;
+}
+#endif /* WITH_AVX2 */
+
 
 /* ------------------------------------------------------------------------- */
-STD_SPEED_TEST(alphaComp_speed, BYTE, BYTE, int bytes __attribute__((unused)) = size*4,
+STD_SPEED_TEST_EX(alphaComp_speed, BYTE, BYTE, int bytes __attribute__((unused)) = size*4,
 	TRUE, general_alphaComp_argb(src1, bytes, src2, bytes, dst, bytes,
 		size, size),
 #ifdef WITH_SSE2
@@ -213,6 +270,12 @@ STD_SPEED_TEST(alphaComp_speed, BYTE, BYTE, int bytes __attribute__((unused)) =
 		size, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
 #else
 	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_alphaComp_argb(src1, bytes, src2, bytes, dst, bytes,
+		size, size),
+#else
+	FALSE, PRIM_NOP,
 #endif
 	TRUE, ipp_alphaComp_argb(src1, bytes, src2, bytes, dst, bytes,
 		size, size));
@@ -245,6 +308,13 @@ int TestPrimitivesAlphaComp(int argc, char* argv[])
 	if (status != SUCCESS)
 		return 1;
 
+#ifdef WITH_AVX2
+	status = test_alphaComp_avx2_func();
+
+	if (status != SUCCESS)
+		return 1;
+#endif
+
 	if (g_TestPrimitivesPerformance)
 	{
 		status = test_alphaComp_speed();
@@ -35,6 +35,16 @@ extern pstatus_t sse2_yCbCrToRGB_16s16s_P3P3(const INT16 *pSrc[3],
 	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
 extern pstatus_t neon_yCbCrToRGB_16s16s_P3P3(const INT16 *pSrc[3],
 	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
+extern pstatus_t general_yCbCrToRGB_16s8u_P3AC4R(const INT16 *pSrc[3],
+	int srcStep, BYTE *pDst, int dstStep, const prim_size_t *roi);
+extern pstatus_t avx2_yCbCrToRGB_16s8u_P3AC4R(const INT16 *pSrc[3],
+	int srcStep, BYTE *pDst, int dstStep, const prim_size_t *roi);
+extern pstatus_t general_RGBToYCbCr_16s16s_P3P3(const INT16 *pSrc[3],
+	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
+extern pstatus_t sse2_RGBToYCbCr_16s16s_P3P3(const INT16 *pSrc[3],
+	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
+extern pstatus_t avx2_RGBToYCbCr_16s16s_P3P3(const INT16 *pSrc[3],
+	int srcStep, INT16 *pDst[3], int dstStep, const prim_size_t *roi);
 
 /* ------------------------------------------------------------------------- */
 int test_RGBToRGB_16s8u_P3AC4R_func(void)
@@ -244,6 +254,227 @@ int test_yCbCrToRGB_16s16s_P3P3_speed(void)
 	return SUCCESS;
 }
 
+/* ========================================================================= */
+/* Odd-sized region inside 64x64 planes, starting one sample in, so the
+ * vector loops run misaligned and leave a scalar tail on every row.
+ */
+static const prim_size_t roi61x9 = { 61, 9 };
+
+int test_yCbCrToRGB_16s8u_P3AC4R_func(void)
+{
+	INT16 ALIGN(y[4096]), ALIGN(cb[4096]), ALIGN(cr[4096]);
+	UINT32 ALIGN(out1[4096]);
+#ifdef WITH_AVX2
+	UINT32 ALIGN(out2[4096]);
+	int i;
+#endif
+	int failed = 0;
+	char testStr[256];
+	const INT16 *in[3];
+
+	testStr[0] = '\0';
+	/* full INT16 range, so the clamping and wrap-around are exercised */
+	get_random_data(y, sizeof(y));
+	get_random_data(cb, sizeof(cb));
+	get_random_data(cr, sizeof(cr));
+	memset(out1, 0, sizeof(out1));
+
+	in[0] = y + 1;
+	in[1] = cb + 1;
+	in[2] = cr + 1;
+
+	general_yCbCrToRGB_16s8u_P3AC4R(in, 64*2, (BYTE *) (out1+1), 64*4, &roi61x9);
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		strcat(testStr, " AVX2");
+		memset(out2, 0, sizeof(out2));
+		avx2_yCbCrToRGB_16s8u_P3AC4R(in, 64*2, (BYTE *) (out2+1), 64*4, &roi61x9);
+		for (i=0; i<4096; ++i)
+		{
+			if (out1[i] != out2[i])
+			{
+				printf("YCbCrToRGB_16s8u-AVX2 FAIL[%d]: 0x%08x vs 0x%08x\n",
+					i, out1[i], out2[i]);
+				failed = 1;
+			}
+		}
+	}
+#endif /* WITH_AVX2 */
+	if (!failed) printf("All yCbCrToRGB_16s8u_P3AC4R tests passed (%s).\n", testStr);
+	return (failed > 0) ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+STD_SPEED_TEST_EX(
+	ycbcr_to_rgb8_speed, INT16*, UINT32, dst=dst,
+	TRUE, general_yCbCrToRGB_16s8u_P3AC4R(
+		(const INT16 **) src1, 64*2, (BYTE *) dst, 64*4, &roi64x64),
+	FALSE, PRIM_NOP, 0, FALSE,
+#ifdef WITH_AVX2
+	TRUE, avx2_yCbCrToRGB_16s8u_P3AC4R(
+		(const INT16 **) src1, 64*2, (BYTE *) dst, 64*4, &roi64x64),
+#else
+	FALSE, PRIM_NOP,
+#endif
+	FALSE, dst=dst);
+
+int test_yCbCrToRGB_16s8u_P3AC4R_speed(void)
+{
+	INT16 ALIGN(y[4096]), ALIGN(cb[4096]), ALIGN(cr[4096]);
+	UINT32 ALIGN(dst[4096]);
+	int i;
+	INT16 *input[3];
+	int size_array[] = { 64 };
+
+	get_random_data(y, sizeof(y));
+	get_random_data(cb, sizeof(cb));
+	get_random_data(cr, sizeof(cr));
+	/* Normalize to 11.5 fixed radix */
+	for (i=0; i<4096; ++i)
+	{
+		y[i]  &= 0x1FE0U;
+		cb[i] &= 0x1FE0U;
+		cr[i] &= 0x1FE0U;
+	}
+
+	input[0] = y;
+	input[1] = cb;
+	input[2] = cr;
+
+	ycbcr_to_rgb8_speed("yCbCrToRGB_16s8u", "aligned",
+		(const INT16 **) input, NULL, 0, dst,
+		size_array, 1, YCBCR_TRIAL_ITERATIONS, TEST_TIME);
+	return SUCCESS;
+}
+
+/* ========================================================================= */
+int test_RGBToYCbCr_16s16s_P3P3_func(void)
+{
+	INT16 ALIGN(r[4096]), ALIGN(g[4096]), ALIGN(b[4096]);
+	INT16 ALIGN(y1[4096]), ALIGN(cb1[4096]), ALIGN(cr1[4096]);
+#ifdef WITH_AVX2
+	INT16 ALIGN(y2[4096]), ALIGN(cb2[4096]), ALIGN(cr2[4096]);
+	INT16 *out2[3];
+	int i;
+#endif
+	int failed = 0;
+	char testStr[256];
+	const INT16 *in[3];
+	INT16 *out1[3];
+
+	testStr[0] = '\0';
+	get_random_data(r, sizeof(r));
+	get_random_data(g, sizeof(g));
+	get_random_data(b, sizeof(b));
+	memset(y1, 0, sizeof(y1));
+	memset(cb1, 0, sizeof(cb1));
+	memset(cr1, 0, sizeof(cr1));
+
+	in[0] = r + 1;
+	in[1] = g + 1;
+	in[2] = b + 1;
+	out1[0] = y1 + 1;
+	out1[1] = cb1 + 1;
+	out1[2] = cr1 + 1;
+
+	general_RGBToYCbCr_16s16s_P3P3(in, 64*2, out1, 64*2, &roi61x9);
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		strcat(testStr, " AVX2");
+		memset(y2, 0, sizeof(y2));
+		memset(cb2, 0, sizeof(cb2));
+		memset(cr2, 0, sizeof(cr2));
+		out2[0] = y2 + 1;
+		out2[1] = cb2 + 1;
+		out2[2] = cr2 + 1;
+		avx2_RGBToYCbCr_16s16s_P3P3(in, 64*2, out2, 64*2, &roi61x9);
+		for (i=0; i<4096; ++i)
+		{
+			if ((y1[i] != y2[i]) || (cb1[i] != cb2[i]) || (cr1[i] != cr2[i]))
+			{
+				printf("RGBToYCbCr-AVX2 FAIL[%d]: %d,%d,%d vs %d,%d,%d\n", i,
+					y1[i], cb1[i], cr1[i], y2[i], cb2[i], cr2[i]);
+				failed = 1;
+			}
+		}
+
+		/* RemoteFX converts in place */
+		memcpy(y2, r, sizeof(r));
+		memcpy(cb2, g, sizeof(g));
+		memcpy(cr2, b, sizeof(b));
+		avx2_RGBToYCbCr_16s16s_P3P3((const INT16 **) out2, 64*2, out2, 64*2, &roi61x9);
+		for (i=0; i<4096; ++i)
+		{
+			int x = i % 64;
+			int row = i / 64;
+
+			if ((x == 0) || (x > 61) || (row >= 9))
+				continue;
+
+			if ((y1[i] != y2[i]) || (cb1[i] != cb2[i]) || (cr1[i] != cr2[i]))
+			{
+				printf("RGBToYCbCr-AVX2-inplace FAIL[%d]: %d,%d,%d vs %d,%d,%d\n", i,
+					y1[i], cb1[i], cr1[i], y2[i], cb2[i], cr2[i]);
+				failed = 1;
+			}
+		}
+	}
+#endif /* WITH_AVX2 */
+	if (!failed) printf("All RGBToYCbCr_16s16s_P3P3 tests passed (%s).\n", testStr);
+	return (failed > 0) ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+STD_SPEED_TEST_EX(
+	rgb_to_ycbcr_speed, INT16*, INT16*, dst=dst,
+	TRUE, general_RGBToYCbCr_16s16s_P3P3(src1, 64*2, dst, 64*2, &roi64x64),
+#ifdef WITH_SSE2
+	TRUE, sse2_RGBToYCbCr_16s16s_P3P3(src1, 64*2, dst, 64*2, &roi64x64),
+		PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
+#else
+	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_RGBToYCbCr_16s16s_P3P3(src1, 64*2, dst, 64*2, &roi64x64),
+#else
+	FALSE, PRIM_NOP,
+#endif
+	FALSE, dst=dst);
+
+int test_RGBToYCbCr_16s16s_P3P3_speed(void)
+{
+	INT16 ALIGN(r[4096]), ALIGN(g[4096]), ALIGN(b[4096]);
+	INT16 ALIGN(y[4096]), ALIGN(cb[4096]), ALIGN(cr[4096]);
+	int i;
+	const INT16 *input[3];
+	INT16 *output[3];
+	int size_array[] = { 64 };
+
+	get_random_data(r, sizeof(r));
+	get_random_data(g, sizeof(g));
+	get_random_data(b, sizeof(b));
+	/* 8-bit samples, scaled << 5 like the RemoteFX encoder's input */
+	for (i=0; i<4096; ++i)
+	{
+		r[i] &= 0x1FE0U;
+		g[i] &= 0x1FE0U;
+		b[i] &= 0x1FE0U;
+	}
+
+	input[0] = r;
+	input[1] = g;
+	input[2] = b;
+	output[0] = y;
+	output[1] = cb;
+	output[2] = cr;
+
+	rgb_to_ycbcr_speed("RGBToYCbCr", "aligned", input, NULL, NULL, output,
+		size_array, 1, YCBCR_TRIAL_ITERATIONS, TEST_TIME);
+	return SUCCESS;
+}
+
 int TestPrimitivesColors(int argc, char* argv[])
 {
 	int status;
@@ -274,5 +505,31 @@ int TestPrimitivesColors(int argc, char* argv[])
 			return 1;
 	}
 
+	status = test_yCbCrToRGB_16s8u_P3AC4R_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		status = test_yCbCrToRGB_16s8u_P3AC4R_speed();
+
+		if (status != SUCCESS)
+			return 1;
+	}
+
+	status = test_RGBToYCbCr_16s16s_P3P3_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		status = test_RGBToYCbCr_16s16s_P3P3_speed();
+
+		if (status != SUCCESS)
+			return 1;
+	}
+
 	return 0;
 }
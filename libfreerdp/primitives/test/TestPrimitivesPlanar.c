@@ -0,0 +1,459 @@
+/* test_planar.c
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include "prim_test.h"
+
+static const int PLANAR_PRETEST_ITERATIONS = 100000;
+static const float TEST_TIME = 1.0;
+
+extern BOOL g_TestPrimitivesPerformance;
+
+extern pstatus_t general_planarSplit_8u_AC4P4R(const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep, UINT32 width, UINT32 height, BOOL alpha);
+extern pstatus_t general_planarJoin_8u_P4AC4R(const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep, UINT32 width, UINT32 height);
+extern pstatus_t general_planarDeltaEncode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+extern pstatus_t general_planarDeltaDecode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+extern pstatus_t general_planarFindRun_8u(const BYTE* pSrc, INT32 len, BYTE prev, INT32* pOffset, INT32* pLength);
+#ifdef WITH_SSE2
+extern pstatus_t ssse3_planarSplit_8u_AC4P4R(const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep, UINT32 width, UINT32 height, BOOL alpha);
+extern pstatus_t sse2_planarJoin_8u_P4AC4R(const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep, UINT32 width, UINT32 height);
+extern pstatus_t sse2_planarDeltaEncode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+extern pstatus_t sse2_planarDeltaDecode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+extern pstatus_t sse2_planarFindRun_8u(const BYTE* pSrc, INT32 len, BYTE prev, INT32* pOffset, INT32* pLength);
+#endif
+#ifdef WITH_AVX2
+extern pstatus_t avx2_planarSplit_8u_AC4P4R(const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[4], INT32 dstStep, UINT32 width, UINT32 height, BOOL alpha);
+extern pstatus_t avx2_planarJoin_8u_P4AC4R(const BYTE* pSrc[4], INT32 srcStep,
+	BYTE* pDst, INT32 dstStep, UINT32 width, UINT32 height);
+extern pstatus_t avx2_planarDeltaEncode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+extern pstatus_t avx2_planarDeltaDecode_8u(const BYTE* pSrc, const BYTE* pPrev, BYTE* pDst, INT32 len);
+extern pstatus_t avx2_planarFindRun_8u(const BYTE* pSrc, INT32 len, BYTE prev, INT32* pOffset, INT32* pLength);
+#endif
+
+#define PLANAR_TEST_WIDTH	67
+#define PLANAR_TEST_HEIGHT	13
+#define PLANAR_TEST_STEP	(PLANAR_TEST_WIDTH * 4 + 12)
+
+/* ------------------------------------------------------------------------- */
+int test_planarSplit_func(void)
+{
+	BYTE ALIGN(src[PLANAR_TEST_STEP * PLANAR_TEST_HEIGHT]);
+	BYTE ALIGN(p1[4 * PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT]);
+	BYTE* planes1[4];
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+	BYTE ALIGN(p2[4 * PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT]);
+	BYTE* planes2[4];
+	int i;
+#endif
+	int alpha;
+	int failed = 0;
+	char testStr[256];
+
+	testStr[0] = '\0';
+	get_random_data(src, sizeof(src));
+
+	for (alpha = 0; alpha < 2; alpha++)
+	{
+		planes1[0] = &p1[0];
+		planes1[1] = &p1[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT];
+		planes1[2] = &p1[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 2];
+		planes1[3] = &p1[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 3];
+
+		/* bottom-up, as the encoder does it */
+		general_planarSplit_8u_AC4P4R(&src[PLANAR_TEST_STEP * (PLANAR_TEST_HEIGHT - 1)], -PLANAR_TEST_STEP,
+			planes1, PLANAR_TEST_WIDTH, PLANAR_TEST_WIDTH, PLANAR_TEST_HEIGHT, alpha);
+#ifdef WITH_SSE2
+		if (IsProcessorFeaturePresentEx(PF_EX_SSSE3))
+		{
+			if (alpha)
+				strcat(testStr, " SSSE3");
+
+			planes2[0] = &p2[0];
+			planes2[1] = &p2[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT];
+			planes2[2] = &p2[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 2];
+			planes2[3] = &p2[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 3];
+
+			ssse3_planarSplit_8u_AC4P4R(&src[PLANAR_TEST_STEP * (PLANAR_TEST_HEIGHT - 1)], -PLANAR_TEST_STEP,
+				planes2, PLANAR_TEST_WIDTH, PLANAR_TEST_WIDTH, PLANAR_TEST_HEIGHT, alpha);
+
+			for (i = 0; i < 4 * PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT; ++i)
+			{
+				if (p1[i] != p2[i])
+				{
+					printf("planarSplit-SSSE3 FAIL[%d] alpha %d: want 0x%02x, got 0x%02x\n",
+						i, alpha, p1[i], p2[i]);
+					++failed;
+				}
+			}
+		}
+#endif /* WITH_SSE2 */
+#ifdef WITH_AVX2
+		if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		{
+			if (alpha)
+				strcat(testStr, " AVX2");
+
+			planes2[0] = &p2[0];
+			planes2[1] = &p2[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT];
+			planes2[2] = &p2[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 2];
+			planes2[3] = &p2[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 3];
+
+			avx2_planarSplit_8u_AC4P4R(&src[PLANAR_TEST_STEP * (PLANAR_TEST_HEIGHT - 1)], -PLANAR_TEST_STEP,
+				planes2, PLANAR_TEST_WIDTH, PLANAR_TEST_WIDTH, PLANAR_TEST_HEIGHT, alpha);
+
+			for (i = 0; i < 4 * PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT; ++i)
+			{
+				if (p1[i] != p2[i])
+				{
+					printf("planarSplit-AVX2 FAIL[%d] alpha %d: want 0x%02x, got 0x%02x\n",
+						i, alpha, p1[i], p2[i]);
+					++failed;
+				}
+			}
+		}
+#endif /* WITH_AVX2 */
+	}
+
+	if (!failed) printf("All planarSplit tests passed (%s).\n", testStr);
+	return (failed > 0) ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+int test_planarJoin_func(void)
+{
+	BYTE ALIGN(src[4 * PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT]);
+	BYTE ALIGN(d1[PLANAR_TEST_STEP * PLANAR_TEST_HEIGHT]);
+	const BYTE* planes[4];
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+	BYTE ALIGN(d2[PLANAR_TEST_STEP * PLANAR_TEST_HEIGHT]);
+	int i;
+#endif
+#ifdef WITH_AVX2
+	BYTE ALIGN(d3[PLANAR_TEST_STEP * PLANAR_TEST_HEIGHT]);
+#endif
+	int alpha;
+	int failed = 0;
+	char testStr[256];
+
+	testStr[0] = '\0';
+	get_random_data(src, sizeof(src));
+
+	planes[1] = &src[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT];
+	planes[2] = &src[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 2];
+	planes[3] = &src[PLANAR_TEST_WIDTH * PLANAR_TEST_HEIGHT * 3];
+
+	for (alpha = 0; alpha < 2; alpha++)
+	{
+		/* without an alpha plane the destination alpha must survive */
+		planes[0] = alpha ? src : NULL;
+
+		get_random_data(d1, sizeof(d1));
+#ifdef WITH_SSE2
+		CopyMemory(d2, d1, sizeof(d1));
+#endif
+#ifdef WITH_AVX2
+		CopyMemory(d3, d1, sizeof(d1));
+#endif
+		general_planarJoin_8u_P4AC4R(planes, PLANAR_TEST_WIDTH,
+			&d1[PLANAR_TEST_STEP * (PLANAR_TEST_HEIGHT - 1)], -PLANAR_TEST_STEP,
+			PLANAR_TEST_WIDTH, PLANAR_TEST_HEIGHT);
+#ifdef WITH_SSE2
+		if (IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE))
+		{
+			if (alpha)
+				strcat(testStr, " SSE2");
+
+			sse2_planarJoin_8u_P4AC4R(planes, PLANAR_TEST_WIDTH,
+				&d2[PLANAR_TEST_STEP * (PLANAR_TEST_HEIGHT - 1)], -PLANAR_TEST_STEP,
+				PLANAR_TEST_WIDTH, PLANAR_TEST_HEIGHT);
+
+			for (i = 0; i < PLANAR_TEST_STEP * PLANAR_TEST_HEIGHT; ++i)
+			{
+				if (d1[i] != d2[i])
+				{
+					printf("planarJoin-SSE2 FAIL[%d] alpha %d: want 0x%02x, got 0x%02x\n",
+						i, alpha, d1[i], d2[i]);
+					++failed;
+				}
+			}
+		}
+#endif /* WITH_SSE2 */
+#ifdef WITH_AVX2
+		if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		{
+			if (alpha)
+				strcat(testStr, " AVX2");
+
+			avx2_planarJoin_8u_P4AC4R(planes, PLANAR_TEST_WIDTH,
+				&d3[PLANAR_TEST_STEP * (PLANAR_TEST_HEIGHT - 1)], -PLANAR_TEST_STEP,
+				PLANAR_TEST_WIDTH, PLANAR_TEST_HEIGHT);
+
+			for (i = 0; i < PLANAR_TEST_STEP * PLANAR_TEST_HEIGHT; ++i)
+			{
+				if (d1[i] != d3[i])
+				{
+					printf("planarJoin-AVX2 FAIL[%d] alpha %d: want 0x%02x, got 0x%02x\n",
+						i, alpha, d1[i], d3[i]);
+					++failed;
+				}
+			}
+		}
+#endif /* WITH_AVX2 */
+	}
+
+	if (!failed) printf("All planarJoin tests passed (%s).\n", testStr);
+	return (failed > 0) ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+int test_planarDelta_func(void)
+{
+	BYTE ALIGN(src[4096]), ALIGN(prev[4096]);
+	BYTE ALIGN(enc1[4096]), ALIGN(dec1[4096]);
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+	BYTE ALIGN(enc2[4096]), ALIGN(dec2[4096]);
+#endif
+	int i;
+	int len;
+	int failed = 0;
+	char testStr[256];
+
+	testStr[0] = '\0';
+	get_random_data(src, sizeof(src));
+	get_random_data(prev, sizeof(prev));
+
+	for (len = 1; len < 200; len += 7)
+	{
+		general_planarDeltaEncode_8u(src + 1, prev + 3, enc1 + 1, len);
+		general_planarDeltaDecode_8u(enc1 + 1, prev + 3, dec1 + 1, len);
+
+		for (i = 1; i <= len; ++i)
+		{
+			if (dec1[i] != src[i])
+			{
+				printf("planarDelta round trip FAIL[%d] len %d: want 0x%02x, got 0x%02x\n",
+					i, len, src[i], dec1[i]);
+				++failed;
+			}
+		}
+#ifdef WITH_SSE2
+		if (IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE))
+		{
+			if (len == 1)
+				strcat(testStr, " SSE2");
+
+			sse2_planarDeltaEncode_8u(src + 1, prev + 3, enc2 + 1, len);
+
+			/* decoding in place, like the planar decoder does */
+			CopyMemory(dec2, enc2, len + 1);
+			sse2_planarDeltaDecode_8u(dec2 + 1, prev + 3, dec2 + 1, len);
+
+			for (i = 1; i <= len; ++i)
+			{
+				if ((enc1[i] != enc2[i]) || (dec1[i] != dec2[i]))
+				{
+					printf("planarDelta-SSE2 FAIL[%d] len %d: want 0x%02x/0x%02x, got 0x%02x/0x%02x\n",
+						i, len, enc1[i], dec1[i], enc2[i], dec2[i]);
+					++failed;
+				}
+			}
+		}
+#endif /* WITH_SSE2 */
+#ifdef WITH_AVX2
+		if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		{
+			if (len == 1)
+				strcat(testStr, " AVX2");
+
+			avx2_planarDeltaEncode_8u(src + 1, prev + 3, enc2 + 1, len);
+			CopyMemory(dec2, enc2, len + 1);
+			avx2_planarDeltaDecode_8u(dec2 + 1, prev + 3, dec2 + 1, len);
+
+			for (i = 1; i <= len; ++i)
+			{
+				if ((enc1[i] != enc2[i]) || (dec1[i] != dec2[i]))
+				{
+					printf("planarDelta-AVX2 FAIL[%d] len %d: want 0x%02x/0x%02x, got 0x%02x/0x%02x\n",
+						i, len, enc1[i], dec1[i], enc2[i], dec2[i]);
+					++failed;
+				}
+			}
+		}
+#endif /* WITH_AVX2 */
+	}
+
+	if (!failed) printf("All planarDelta tests passed (%s).\n", testStr);
+	return (failed > 0) ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+int test_planarFindRun_func(void)
+{
+	BYTE ALIGN(src[256]);
+	INT32 offset1, length1;
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
+	INT32 offset2, length2;
+#endif
+	int i;
+	int trial;
+	int len;
+	BYTE prev;
+	int failed = 0;
+	char testStr[256];
+
+	testStr[0] = '\0';
+
+	for (trial = 0; trial < 2000; trial++)
+	{
+		/* few distinct symbols, so runs of every length show up */
+		get_random_data(src, sizeof(src));
+
+		for (i = 0; i < (int) sizeof(src); i++)
+			src[i] = (src[i] & 0x0F) ? src[i - ((i > 0) ? 1 : 0)] : src[i] & 0x30;
+
+		prev = (trial & 1) ? src[0] : (BYTE) trial;
+		len = 1 + (trial % (int) sizeof(src));
+
+		general_planarFindRun_8u(src, len, prev, &offset1, &length1);
+
+		if ((offset1 > len) || ((offset1 < len) && (length1 < 3)) || ((offset1 + length1) > len))
+		{
+			printf("planarFindRun FAIL trial %d: offset %d length %d len %d\n",
+				trial, offset1, length1, len);
+			++failed;
+		}
+#ifdef WITH_SSE2
+		if (IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE))
+		{
+			if (trial == 0)
+				strcat(testStr, " SSE2");
+
+			sse2_planarFindRun_8u(src, len, prev, &offset2, &length2);
+
+			if ((offset1 != offset2) || (length1 != length2))
+			{
+				printf("planarFindRun-SSE2 FAIL trial %d: want %d+%d, got %d+%d\n",
+					trial, offset1, length1, offset2, length2);
+				++failed;
+			}
+		}
+#endif /* WITH_SSE2 */
+#ifdef WITH_AVX2
+		if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		{
+			if (trial == 0)
+				strcat(testStr, " AVX2");
+
+			avx2_planarFindRun_8u(src, len, prev, &offset2, &length2);
+
+			if ((offset1 != offset2) || (length1 != length2))
+			{
+				printf("planarFindRun-AVX2 FAIL trial %d: want %d+%d, got %d+%d\n",
+					trial, offset1, length1, offset2, length2);
+				++failed;
+			}
+		}
+#endif /* WITH_AVX2 */
+	}
+
+	if (!failed) printf("All planarFindRun tests passed (%s).\n", testStr);
+	return (failed > 0) ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+STD_SPEED_TEST_EX(planarDeltaEncode_speed_test, BYTE, BYTE, dst=dst,
+	TRUE, general_planarDeltaEncode_8u(src1, src2, dst, size),
+#ifdef WITH_SSE2
+	TRUE, sse2_planarDeltaEncode_8u(src1, src2, dst, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
+#else
+	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_planarDeltaEncode_8u(src1, src2, dst, size),
+#else
+	FALSE, PRIM_NOP,
+#endif
+	FALSE, dst=dst);
+
+STD_SPEED_TEST_EX(planarDeltaDecode_speed_test, BYTE, BYTE, dst=dst,
+	TRUE, general_planarDeltaDecode_8u(src1, src2, dst, size),
+#ifdef WITH_SSE2
+	TRUE, sse2_planarDeltaDecode_8u(src1, src2, dst, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
+#else
+	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_planarDeltaDecode_8u(src1, src2, dst, size),
+#else
+	FALSE, PRIM_NOP,
+#endif
+	FALSE, dst=dst);
+
+int test_planarDelta_speed(void)
+{
+	BYTE ALIGN(src1[MAX_TEST_SIZE]), ALIGN(src2[MAX_TEST_SIZE]), ALIGN(dst[MAX_TEST_SIZE]);
+	get_random_data(src1, sizeof(src1));
+	get_random_data(src2, sizeof(src2));
+	planarDeltaEncode_speed_test("planarDeltaEncode", "aligned", src1, src2, 0, dst,
+		test_sizes, NUM_TEST_SIZES, PLANAR_PRETEST_ITERATIONS, TEST_TIME);
+	planarDeltaDecode_speed_test("planarDeltaDecode", "aligned", src1, src2, 0, dst,
+		test_sizes, NUM_TEST_SIZES, PLANAR_PRETEST_ITERATIONS, TEST_TIME);
+	return SUCCESS;
+}
+
+int TestPrimitivesPlanar(int argc, char* argv[])
+{
+	int status;
+
+	status = test_planarSplit_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	status = test_planarJoin_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	status = test_planarDelta_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	status = test_planarFindRun_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		status = test_planarDelta_speed();
+
+		if (status != SUCCESS)
+			return 1;
+	}
+
+	return 0;
+}
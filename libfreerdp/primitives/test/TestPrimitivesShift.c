@@ -49,9 +49,54 @@ extern pstatus_t sse2_rShiftC_16u(
 	const UINT16 *pSrc, int val, UINT16 *pDst, int len);
 extern pstatus_t sse2_shiftC_16u(
 	const UINT16 *pSrc, int val, UINT16 *pDst, int len);
+extern pstatus_t avx2_lShiftC_16s(
+	const INT16 *pSrc, int val, INT16 *pDst, int len);
+extern pstatus_t avx2_rShiftC_16s(
+	const INT16 *pSrc, int val, INT16 *pDst, int len);
+extern pstatus_t avx2_lShiftC_16u(
+	const UINT16 *pSrc, int val, UINT16 *pDst, int len);
+extern pstatus_t avx2_rShiftC_16u(
+	const UINT16 *pSrc, int val, UINT16 *pDst, int len);
+
+#ifdef WITH_AVX2
+#define SHIFT_TEST_AVX2(_str_, _f3_) \
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2)) \
+	{ \
+		strcat(testStr, " AVX2"); \
+		/* Unaligned */ \
+		_f3_(src+1, 3, d2+2, FUNC_TEST_SIZE); \
+		for (i=1; i<=FUNC_TEST_SIZE; ++i) \
+		{ \
+			if (d1[i] != d2[i+1]) \
+			{  \
+				printf("%s-AVX2-unaligned FAIL[%d]: 0x%x>>3=0x%x, got 0x%x\n", \
+					_str_, i, src[i], d1[i], d2[i+1]);  \
+				++failed; \
+			} \
+		} \
+		/* Odd length, so the scalar tail is used */ \
+		_f3_(src+1, 3, d2+1, 77); \
+		for (i=1; i<=77; ++i) \
+		{ \
+			if (d1[i] != d2[i]) \
+			{  \
+				printf("%s-AVX2-odd FAIL[%d]: 0x%x>>3=0x%x, got 0x%x\n", \
+					_str_, i, src[i], d1[i], d2[i]);  \
+				++failed; \
+			} \
+		} \
+		if (d2[78] != d1[77]) \
+		{  \
+			printf("%s-AVX2-odd FAIL: wrote past the end\n", _str_);  \
+			++failed; \
+		} \
+	}
+#else
+#define SHIFT_TEST_AVX2(_str_, _f3_)
+#endif
 
 #ifdef WITH_SSE2
-#define SHIFT_TEST_FUNC(_name_, _type_, _str_, _f1_, _f2_) \
+#define SHIFT_TEST_FUNC(_name_, _type_, _str_, _f1_, _f2_, _f3_) \
 int _name_(void) \
 { \
 	_type_ ALIGN(src[FUNC_TEST_SIZE+3]), \
@@ -88,11 +133,12 @@ int _name_(void) \
 			} \
 		} \
 	} \
+	SHIFT_TEST_AVX2(_str_, _f3_) \
 	if (!failed) printf("All %s tests passed (%s).\n", _str_, testStr); \
 	return (failed > 0) ? FAILURE : SUCCESS; \
 }
 #else
-#define SHIFT_TEST_FUNC(_name_, _type_, _str_, _f1_, _f2_) \
+#define SHIFT_TEST_FUNC(_name_, _type_, _str_, _f1_, _f2_, _f3_) \
 int _name_(void) \
 { \
 	return SUCCESS; \
@@ -100,45 +146,65 @@ int _name_(void) \
 #endif /* i386 */
 
 SHIFT_TEST_FUNC(test_lShift_16s_func, INT16, "lshift_16s", general_lShiftC_16s,
-    sse2_lShiftC_16s)
+    sse2_lShiftC_16s, avx2_lShiftC_16s)
 SHIFT_TEST_FUNC(test_lShift_16u_func, UINT16, "lshift_16u", general_lShiftC_16u,
-    sse2_lShiftC_16u)
+    sse2_lShiftC_16u, avx2_lShiftC_16u)
 SHIFT_TEST_FUNC(test_rShift_16s_func, INT16, "rshift_16s", general_rShiftC_16s,
-    sse2_rShiftC_16s)
+    sse2_rShiftC_16s, avx2_rShiftC_16s)
 SHIFT_TEST_FUNC(test_rShift_16u_func, UINT16, "rshift_16u", general_rShiftC_16u,
-    sse2_rShiftC_16u)
+    sse2_rShiftC_16u, avx2_rShiftC_16u)
 
 /* ========================================================================= */
-STD_SPEED_TEST(speed_lShift_16s, INT16, INT16, dst=dst,
+STD_SPEED_TEST_EX(speed_lShift_16s, INT16, INT16, dst=dst,
     TRUE, general_lShiftC_16s(src1, constant, dst, size),
 #ifdef WITH_SSE2
 	TRUE, sse2_lShiftC_16s(src1, constant, dst, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
 #else
 	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_lShiftC_16s(src1, constant, dst, size),
+#else
+	FALSE, PRIM_NOP,
 #endif
 	TRUE, ippsLShiftC_16s(src1, constant, dst, size));
-STD_SPEED_TEST(speed_lShift_16u, UINT16, UINT16, dst=dst,
+STD_SPEED_TEST_EX(speed_lShift_16u, UINT16, UINT16, dst=dst,
     TRUE, general_lShiftC_16u(src1, constant, dst, size),
 #ifdef WITH_SSE2
 	TRUE, sse2_lShiftC_16u(src1, constant, dst, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
 #else
 	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_lShiftC_16u(src1, constant, dst, size),
+#else
+	FALSE, PRIM_NOP,
 #endif
 	TRUE, ippsLShiftC_16u(src1, constant, dst, size));
-STD_SPEED_TEST(speed_rShift_16s, INT16, INT16, dst=dst,
+STD_SPEED_TEST_EX(speed_rShift_16s, INT16, INT16, dst=dst,
     TRUE, general_rShiftC_16s(src1, constant, dst, size),
 #ifdef WITH_SSE2
 	TRUE, sse2_rShiftC_16s(src1, constant, dst, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
 #else
 	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_rShiftC_16s(src1, constant, dst, size),
+#else
+	FALSE, PRIM_NOP,
 #endif
 	TRUE, ippsRShiftC_16s(src1, constant, dst, size));
-STD_SPEED_TEST(speed_rShift_16u, UINT16, UINT16, dst=dst,
+STD_SPEED_TEST_EX(speed_rShift_16u, UINT16, UINT16, dst=dst,
     TRUE, general_rShiftC_16u(src1, constant, dst, size),
 #ifdef WITH_SSE2
 	TRUE, sse2_rShiftC_16u(src1, constant, dst, size), PF_SSE2_INSTRUCTIONS_AVAILABLE, FALSE,
 #else
 	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_rShiftC_16u(src1, constant, dst, size),
+#else
+	FALSE, PRIM_NOP,
 #endif
 	TRUE, ippsRShiftC_16u(src1, constant, dst, size));
 
@@ -28,12 +28,15 @@ extern pstatus_t general_sign_16s(const INT16 *pSrc, INT16 *pDst, int len);
 #ifdef WITH_SSE2
 extern pstatus_t ssse3_sign_16s(const INT16 *pSrc, INT16 *pDst, int len);
 #endif
+#ifdef WITH_AVX2
+extern pstatus_t avx2_sign_16s(const INT16 *pSrc, INT16 *pDst, int len);
+#endif
 
 /* ------------------------------------------------------------------------- */
 int test_sign16s_func(void)
 {
 	INT16 ALIGN(src[65535]), ALIGN(d1[65535]);
-#ifdef WITH_SSE2
+#if defined(WITH_SSE2) || defined(WITH_AVX2)
 	INT16 ALIGN(d2[65535]);
 	int i;
 #endif
@@ -60,6 +63,22 @@ int test_sign16s_func(void)
 		}
 	}
 #endif /* i386 */
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		strcat(testStr, " AVX2");
+		avx2_sign_16s(src+1, d2+1, 65535);
+		for (i=1; i<65535; ++i)
+		{
+			if (d1[i] != d2[i])
+			{
+				printf("SIGN16s-AVX2-aligned FAIL[%d] of %d: want %d, got %d\n",
+					i, src[i], d1[i], d2[i]);
+				++failed;
+			}
+		}
+	}
+#endif /* WITH_AVX2 */
 
 	/* Test when we cannot reach 16-byte alignment */
 	get_random_data(src, sizeof(src));
@@ -79,17 +98,37 @@ int test_sign16s_func(void)
 		}
 	}
 #endif /* i386 */
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		avx2_sign_16s(src+1, d2+2, 65535);
+		for (i=2; i<65535; ++i)
+		{
+			if (d1[i] != d2[i])
+			{
+				printf("SIGN16s-AVX2-unaligned FAIL[%d] of %d: want %d, got %d\n",
+					i, src[i-1], d1[i], d2[i]);
+				++failed;
+			}
+		}
+	}
+#endif /* WITH_AVX2 */
 	if (!failed) printf("All sign16s tests passed (%s).\n", testStr);
 	return (failed > 0) ? FAILURE : SUCCESS;
 }
 
 /* ------------------------------------------------------------------------- */
-STD_SPEED_TEST(sign16s_speed_test, INT16, INT16, dst=dst,
+STD_SPEED_TEST_EX(sign16s_speed_test, INT16, INT16, dst=dst,
 	TRUE, general_sign_16s(src1, dst, size),
 #ifdef WITH_SSE2
 	TRUE, ssse3_sign_16s(src1, dst, size), PF_EX_SSSE3, TRUE,
 #else
 	FALSE, PRIM_NOP, 0, FALSE,
+#endif
+#ifdef WITH_AVX2
+	TRUE, avx2_sign_16s(src1, dst, size),
+#else
+	FALSE, PRIM_NOP,
 #endif
 	FALSE, dst=dst);
 
@@ -0,0 +1,453 @@
+/* test_YUV.c
+ * vi:ts=4 sw=4
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/sysinfo.h>
+#include "prim_test.h"
+
+#define YUV_TEST_WIDTH		1920
+#define YUV_TEST_HEIGHT		1080
+#define YUV_TEST_TIME		500
+
+extern BOOL g_TestPrimitivesPerformance;
+
+extern pstatus_t general_RGBToYUV420_8u_P3AC4R(const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[3], INT32 dstStep[3], const prim_size_t* roi);
+extern pstatus_t general_YUV420ToRGB_8u_P3AC4R(const BYTE* pSrc[3], INT32 srcStep[3],
+	BYTE* pDst, INT32 dstStep, const prim_size_t* roi);
+#ifdef WITH_SSE2
+extern pstatus_t ssse3_RGBToYUV420_8u_P3AC4R(const BYTE* pSrc, INT32 srcStep,
+	BYTE* pDst[3], INT32 dstStep[3], const prim_size_t* roi);
+#endif
+#ifdef WITH_AVX2
+extern pstatus_t avx2_YUV420ToRGB_8u_P3AC4R(const BYTE* pSrc[3], INT32 srcStep[3],
+	BYTE* pDst, INT32 dstStep, const prim_size_t* roi);
+#endif
+
+/* ------------------------------------------------------------------------- */
+static int test_RGBToYUV420_8u_P3AC4R_size(int width, int height, const BYTE* pRGB, char* testStr)
+{
+	int x, y;
+	int plane;
+	BOOL failed = FALSE;
+	prim_size_t roi;
+	INT32 step[3];
+	BYTE* out_c[3];
+	BYTE* out_sse[3];
+
+	roi.width = width;
+	roi.height = height;
+
+	step[0] = width + 16;
+	step[1] = step[2] = (width + 1) / 2 + 16;
+
+	for (plane = 0; plane < 3; plane++)
+	{
+		out_c[plane] = (BYTE*) calloc(step[plane] * height, 1);
+		out_sse[plane] = (BYTE*) calloc(step[plane] * height, 1);
+	}
+
+	general_RGBToYUV420_8u_P3AC4R(pRGB, width * 4, out_c, step, &roi);
+
+#ifdef WITH_SSE2
+	if (IsProcessorFeaturePresentEx(PF_EX_SSSE3))
+	{
+		ssse3_RGBToYUV420_8u_P3AC4R(pRGB, width * 4, out_sse, step, &roi);
+
+		for (plane = 0; plane < 3; plane++)
+		{
+			int planeWidth = plane ? (width + 1) / 2 : width;
+			int planeHeight = plane ? (height + 1) / 2 : height;
+
+			for (y = 0; y < planeHeight; y++)
+			{
+				for (x = 0; x < planeWidth; x++)
+				{
+					if (out_c[plane][(y * step[plane]) + x] != out_sse[plane][(y * step[plane]) + x])
+					{
+						printf("RGBToYUV420-SSE FAIL[%dx%d] plane %d (%d,%d): C 0x%02x vs SSE 0x%02x\n",
+							width, height, plane, x, y, out_c[plane][(y * step[plane]) + x],
+							out_sse[plane][(y * step[plane]) + x]);
+						failed = TRUE;
+						y = planeHeight;
+						break;
+					}
+				}
+			}
+		}
+
+		if (!strstr(testStr, "SSSE3"))
+			strcat(testStr, " SSSE3");
+	}
+#endif
+
+	for (plane = 0; plane < 3; plane++)
+	{
+		free(out_c[plane]);
+		free(out_sse[plane]);
+	}
+
+	return failed ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static int test_RGBToYUV420_8u_P3AC4R_round_trip(void)
+{
+	int x, y, c;
+	int delta;
+	int maxDelta = 0;
+	BYTE* pRGB;
+	BYTE* pOut;
+	BYTE* pYUV[3];
+	INT32 step[3];
+	prim_size_t roi;
+
+	/* a smooth gradient, which is what 4:2:0 subsampling is meant for */
+
+	roi.width = 256;
+	roi.height = 64;
+
+	pRGB = (BYTE*) malloc(roi.width * roi.height * 4);
+	pOut = (BYTE*) malloc(roi.width * roi.height * 4);
+
+	step[0] = roi.width;
+	step[1] = step[2] = roi.width / 2;
+
+	pYUV[0] = (BYTE*) malloc(step[0] * roi.height);
+	pYUV[1] = (BYTE*) malloc(step[1] * roi.height / 2);
+	pYUV[2] = (BYTE*) malloc(step[2] * roi.height / 2);
+
+	for (y = 0; y < (int) roi.height; y++)
+	{
+		for (x = 0; x < (int) roi.width; x++)
+		{
+			pRGB[(y * roi.width + x) * 4 + 0] = (BYTE) x;
+			pRGB[(y * roi.width + x) * 4 + 1] = (BYTE) (y * 4);
+			pRGB[(y * roi.width + x) * 4 + 2] = (BYTE) (255 - x);
+			pRGB[(y * roi.width + x) * 4 + 3] = 0xFF;
+		}
+	}
+
+	general_RGBToYUV420_8u_P3AC4R(pRGB, roi.width * 4, pYUV, step, &roi);
+	general_YUV420ToRGB_8u_P3AC4R((const BYTE**) pYUV, step, pOut, roi.width * 4, &roi);
+
+	for (x = 0; x < (int) (roi.width * roi.height); x++)
+	{
+		for (c = 0; c < 3; c++)
+		{
+			delta = ABS(pRGB[x * 4 + c] - pOut[x * 4 + c]);
+
+			if (delta > maxDelta)
+				maxDelta = delta;
+		}
+	}
+
+	free(pRGB);
+	free(pOut);
+	free(pYUV[0]);
+	free(pYUV[1]);
+	free(pYUV[2]);
+
+	if (maxDelta > 12)
+	{
+		printf("RGBToYUV420 round trip FAIL: maximum error %d\n", maxDelta);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+int test_RGBToYUV420_8u_P3AC4R_func(void)
+{
+	int index;
+	BYTE* pRGB;
+	char testStr[256];
+	BOOL failed = FALSE;
+	static const int sizes[][2] = { { 64, 64 }, { 63, 61 }, { 8, 1 }, { 1, 8 }, { 17, 3 }, { 250, 33 } };
+
+	testStr[0] = '\0';
+
+	pRGB = (BYTE*) malloc(256 * 64 * 4);
+
+	if (!pRGB)
+		return FAILURE;
+
+	get_random_data(pRGB, 256 * 64 * 4);
+
+	for (index = 0; index < (int) (sizeof(sizes) / sizeof(sizes[0])); index++)
+	{
+		if (test_RGBToYUV420_8u_P3AC4R_size(sizes[index][0], sizes[index][1], pRGB, testStr) != SUCCESS)
+			failed = TRUE;
+	}
+
+	free(pRGB);
+
+	if (test_RGBToYUV420_8u_P3AC4R_round_trip() != SUCCESS)
+		failed = TRUE;
+
+	if (!failed) printf("All RGBToYUV420_8u_P3AC4R tests passed (%s).\n", testStr);
+	return failed ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static void test_RGBToYUV420_8u_P3AC4R_fps(const char* name, __RGBToYUV420_8u_P3AC4R_t fn,
+	const BYTE* pRGB, BYTE* pYUV[3], INT32 step[3], const prim_size_t* roi)
+{
+	int frames = 0;
+	UINT64 begin;
+	UINT64 elapsed;
+
+	begin = GetTickCount64();
+
+	do
+	{
+		fn(pRGB, roi->width * 4, pYUV, step, roi);
+		frames++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < YUV_TEST_TIME);
+
+	printf("RGBToYUV420 %s %dx%d: %.1f frames/s\n", name, roi->width, roi->height,
+		(double) frames * 1000.0 / (double) elapsed);
+}
+
+int test_RGBToYUV420_8u_P3AC4R_speed(void)
+{
+	BYTE* pRGB;
+	BYTE* pYUV[3];
+	INT32 step[3];
+	prim_size_t roi;
+
+	roi.width = YUV_TEST_WIDTH;
+	roi.height = YUV_TEST_HEIGHT;
+
+	step[0] = roi.width;
+	step[1] = step[2] = roi.width / 2;
+
+	pRGB = (BYTE*) malloc(roi.width * roi.height * 4);
+	pYUV[0] = (BYTE*) malloc(step[0] * roi.height);
+	pYUV[1] = (BYTE*) malloc(step[1] * roi.height / 2);
+	pYUV[2] = (BYTE*) malloc(step[2] * roi.height / 2);
+
+	if (!pRGB || !pYUV[0] || !pYUV[1] || !pYUV[2])
+		return FAILURE;
+
+	get_random_data(pRGB, roi.width * roi.height * 4);
+
+	test_RGBToYUV420_8u_P3AC4R_fps("C", general_RGBToYUV420_8u_P3AC4R, pRGB, pYUV, step, &roi);
+#ifdef WITH_SSE2
+	if (IsProcessorFeaturePresentEx(PF_EX_SSSE3))
+		test_RGBToYUV420_8u_P3AC4R_fps("SSSE3", ssse3_RGBToYUV420_8u_P3AC4R, pRGB, pYUV, step, &roi);
+#endif
+
+	free(pRGB);
+	free(pYUV[0]);
+	free(pYUV[1]);
+	free(pYUV[2]);
+
+	return SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+#ifdef WITH_AVX2
+static int test_YUV420ToRGB_8u_P3AC4R_size(int width, int height, char* testStr)
+{
+	int x, y;
+	int plane;
+	BOOL failed = FALSE;
+	prim_size_t roi;
+	INT32 step[3];
+	INT32 dstStep;
+	BYTE* pYUV[3];
+	BYTE* out_c;
+	BYTE* out_avx2;
+
+	roi.width = width;
+	roi.height = height;
+
+	step[0] = width + 16;
+	step[1] = step[2] = (width + 1) / 2 + 16;
+	dstStep = width * 4 + 12;
+
+	for (plane = 0; plane < 3; plane++)
+	{
+		int planeHeight = plane ? (height + 1) / 2 : height + 1;
+
+		pYUV[plane] = (BYTE*) malloc(step[plane] * planeHeight);
+		get_random_data(pYUV[plane], step[plane] * planeHeight);
+	}
+
+	/* the general version writes a whole extra row for odd heights */
+	out_c = (BYTE*) calloc(dstStep * (height + 1), 1);
+	out_avx2 = (BYTE*) calloc(dstStep * (height + 1), 1);
+
+	general_YUV420ToRGB_8u_P3AC4R((const BYTE**) pYUV, step, out_c, dstStep, &roi);
+	avx2_YUV420ToRGB_8u_P3AC4R((const BYTE**) pYUV, step, out_avx2, dstStep, &roi);
+
+	for (y = 0; (y < height) && !failed; y++)
+	{
+		for (x = 0; x < dstStep; x++)
+		{
+			BYTE c = (x < width * 4) ? out_c[y * dstStep + x] : 0;
+
+			if (c != out_avx2[y * dstStep + x])
+			{
+				printf("YUV420ToRGB-AVX2 FAIL[%dx%d] (%d,%d): C 0x%02x vs AVX2 0x%02x\n",
+					width, height, x / 4, y, c, out_avx2[y * dstStep + x]);
+				failed = TRUE;
+				break;
+			}
+		}
+	}
+
+	if (!strstr(testStr, "AVX2"))
+		strcat(testStr, " AVX2");
+
+	for (plane = 0; plane < 3; plane++)
+		free(pYUV[plane]);
+
+	free(out_c);
+	free(out_avx2);
+
+	return failed ? FAILURE : SUCCESS;
+}
+#endif /* WITH_AVX2 */
+
+int test_YUV420ToRGB_8u_P3AC4R_func(void)
+{
+	char testStr[256];
+	BOOL failed = FALSE;
+#ifdef WITH_AVX2
+	int index;
+	static const int sizes[][2] = { { 64, 64 }, { 63, 61 }, { 16, 1 }, { 1, 8 }, { 17, 3 }, { 250, 33 } };
+#endif
+
+	testStr[0] = '\0';
+
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+	{
+		for (index = 0; index < (int) (sizeof(sizes) / sizeof(sizes[0])); index++)
+		{
+			if (test_YUV420ToRGB_8u_P3AC4R_size(sizes[index][0], sizes[index][1], testStr) != SUCCESS)
+				failed = TRUE;
+		}
+	}
+#endif
+
+	if (!failed) printf("All YUV420ToRGB_8u_P3AC4R tests passed (%s).\n", testStr);
+	return failed ? FAILURE : SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+static void test_YUV420ToRGB_8u_P3AC4R_fps(const char* name, __YUV420ToRGB_8u_P3AC4R_t fn,
+	const BYTE* pYUV[3], INT32 step[3], BYTE* pRGB, const prim_size_t* roi)
+{
+	int frames = 0;
+	UINT64 begin;
+	UINT64 elapsed;
+
+	begin = GetTickCount64();
+
+	do
+	{
+		fn(pYUV, step, pRGB, roi->width * 4, roi);
+		frames++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < YUV_TEST_TIME);
+
+	printf("YUV420ToRGB %s %dx%d: %.1f frames/s\n", name, roi->width, roi->height,
+		(double) frames * 1000.0 / (double) elapsed);
+}
+
+int test_YUV420ToRGB_8u_P3AC4R_speed(void)
+{
+	BYTE* pRGB;
+	BYTE* pYUV[3];
+	INT32 step[3];
+	prim_size_t roi;
+
+	roi.width = YUV_TEST_WIDTH;
+	roi.height = YUV_TEST_HEIGHT;
+
+	step[0] = roi.width;
+	step[1] = step[2] = roi.width / 2;
+
+	pRGB = (BYTE*) malloc(roi.width * roi.height * 4);
+	pYUV[0] = (BYTE*) malloc(step[0] * roi.height);
+	pYUV[1] = (BYTE*) malloc(step[1] * roi.height / 2);
+	pYUV[2] = (BYTE*) malloc(step[2] * roi.height / 2);
+
+	if (!pRGB || !pYUV[0] || !pYUV[1] || !pYUV[2])
+		return FAILURE;
+
+	get_random_data(pYUV[0], step[0] * roi.height);
+	get_random_data(pYUV[1], step[1] * roi.height / 2);
+	get_random_data(pYUV[2], step[2] * roi.height / 2);
+
+	test_YUV420ToRGB_8u_P3AC4R_fps("C", general_YUV420ToRGB_8u_P3AC4R,
+		(const BYTE**) pYUV, step, pRGB, &roi);
+#ifdef WITH_AVX2
+	if (IsProcessorFeaturePresentEx(PF_EX_AVX2))
+		test_YUV420ToRGB_8u_P3AC4R_fps("AVX2", avx2_YUV420ToRGB_8u_P3AC4R,
+			(const BYTE**) pYUV, step, pRGB, &roi);
+#endif
+
+	free(pRGB);
+	free(pYUV[0]);
+	free(pYUV[1]);
+	free(pYUV[2]);
+
+	return SUCCESS;
+}
+
+int TestPrimitivesYUV(int argc, char* argv[])
+{
+	int status;
+
+	status = test_RGBToYUV420_8u_P3AC4R_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		status = test_RGBToYUV420_8u_P3AC4R_speed();
+
+		if (status != SUCCESS)
+			return 1;
+	}
+
+	status = test_YUV420ToRGB_8u_P3AC4R_func();
+
+	if (status != SUCCESS)
+		return 1;
+
+	if (g_TestPrimitivesPerformance)
+	{
+		status = test_YUV420ToRGB_8u_P3AC4R_speed();
+
+		if (status != SUCCESS)
+			return 1;
+	}
+
+	return 0;
+}
@@ -66,6 +66,7 @@
 
 extern float _delta_time(const struct timespec *t0, const struct timespec *t1);
 extern void _floatprint(float t, char *output);
+extern void _speedupprint(float base, float t, char *output);
 
 #ifndef CLOCK_MONOTONIC_RAW
 #define CLOCK_MONOTONIC_RAW 4
@@ -126,3 +126,11 @@ void _floatprint(float t, char *output)
 			i/1000000000, (i % 1000000000) / 1000000);
 	else sprintf(output, "%f", t);
 }
+
+/* ------------------------------------------------------------------------- */
+/* Prints how many times faster t is than the base rate. */
+void _speedupprint(float base, float t, char *output)
+{
+	if (base <= 0.0) strcpy(output, "N/A");
+	else sprintf(output, "%.2fx", t / base);
+}
@@ -80,8 +80,16 @@ extern int test_RGBToRGB_16s8u_P3AC4R_func(void);
 extern int test_RGBToRGB_16s8u_P3AC4R_speed(void);
 extern int test_yCbCrToRGB_16s16s_P3P3_func(void);
 extern int test_yCbCrToRGB_16s16s_P3P3_speed(void);
+extern int test_yCbCrToRGB_16s8u_P3AC4R_func(void);
+extern int test_yCbCrToRGB_16s8u_P3AC4R_speed(void);
+extern int test_RGBToYCbCr_16s16s_P3P3_func(void);
+extern int test_RGBToYCbCr_16s16s_P3P3_speed(void);
 extern int test_YCoCgRToRGB_8u_AC4R_func(void);
 extern int test_YCoCgRToRGB_8u_AC4R_speed(void);
+extern int test_RGBToYUV420_8u_P3AC4R_func(void);
+extern int test_RGBToYUV420_8u_P3AC4R_speed(void);
+extern int test_YUV420ToRGB_8u_P3AC4R_func(void);
+extern int test_YUV420ToRGB_8u_P3AC4R_speed(void);
 
 extern int test_RGB565ToARGB_16u32u_C3C4_func(void);
 extern int test_RGB565ToARGB_16u32u_C3C4_speed(void);
@@ -156,20 +164,45 @@ extern int test_or_32u_speed(void);
 #define DO_IPP_MEASUREMENTS(_funcIPP_, _prework_)
 #endif
 
+#if defined(_M_IX86_AMD64) && defined(WITH_AVX2)
+#define DO_AVX2_MEASUREMENTS(_funcAVX2_, _prework_) \
+	do { \
+		for (s=0; s<num_sizes; ++s) \
+		{ \
+			int iter; \
+			char label[256]; \
+			int size = size_array[s]; \
+			_prework_; \
+			iter = iterations/size; \
+			sprintf(label, "AVX2-%s-%-4d", oplabel, size); \
+			MEASURE_TIMED(label, iter, test_time, resultAVX2[s],  \
+				_funcAVX2_); \
+		} \
+	} while (0)
+#else
+#define DO_AVX2_MEASUREMENTS(_funcAVX2_, _prework_)
+#endif
+
 #define PRIM_NOP do {} while (0)
 /* ------------------------------------------------------------------------- */
 
+/* STD_SPEED_TEST_EX additionally measures an AVX2 variant, which is only
+ * run if the processor supports it.  The summary prints the throughput of
+ * every variant followed by its speedup over the general code.
+ */
 #ifdef _WIN32
-#define STD_SPEED_TEST( \
+#define STD_SPEED_TEST_EX( \
 	_name_, _srctype_, _dsttype_, _prework_, \
 	_doNormal_, _funcNormal_, \
 	_doOpt_,    _funcOpt_,  _flagOpt_, _flagExt_, \
+	_doAVX2_,   _funcAVX2_, \
 	_doIPP_,    _funcIPP_)
 #else
-#define STD_SPEED_TEST( \
+#define STD_SPEED_TEST_EX( \
 	_name_, _srctype_, _dsttype_, _prework_, \
 	_doNormal_, _funcNormal_, \
 	_doOpt_,    _funcOpt_,  _flagOpt_, _flagExt_, \
+	_doAVX2_,   _funcAVX2_, \
 	_doIPP_,    _funcIPP_) \
 static void _name_( \
 	const char *oplabel, const char *type, \
@@ -179,9 +212,10 @@ static void _name_( \
 	int iterations, float test_time) \
 { \
 	int s; \
-	float *resultNormal, *resultOpt, *resultIPP; \
+	float *resultNormal, *resultOpt, *resultAVX2, *resultIPP; \
 	resultNormal = (float *) calloc(num_sizes, sizeof(float)); \
 	resultOpt = (float *) calloc(num_sizes, sizeof(float)); \
+	resultAVX2 = (float *) calloc(num_sizes, sizeof(float)); \
 	resultIPP = (float *) calloc(num_sizes, sizeof(float)); \
 	printf("******************** %s %s ******************\n",  \
 		oplabel, type); \
@@ -203,39 +237,56 @@ static void _name_( \
 			} \
 		} \
 	} \
+	if (_doAVX2_) \
+	{ \
+		if (IsProcessorFeaturePresentEx(PF_EX_AVX2)) \
+		{ \
+			DO_AVX2_MEASUREMENTS(_funcAVX2_, _prework_); \
+		} \
+	} \
 	if (_doIPP_)    { DO_IPP_MEASUREMENTS(_funcIPP_, _prework_); } \
 	printf("----------------------- SUMMARY ----------------------------\n"); \
-	printf("%8s: %15s %15s %5s %15s %5s\n", \
-		"size", "general", SIMD_TYPE, "%", "IPP", "%"); \
+	printf("%8s: %15s %15s %7s %15s %7s %15s %7s\n", \
+		"size", "general", SIMD_TYPE, "x", "AVX2", "x", "IPP", "x"); \
 	for (s=0; s<num_sizes; ++s) \
 	{ \
-		char sN[32], sSN[32], sSNp[8], sIPP[32], sIPPp[8]; \
-		strcpy(sN, "N/A"); strcpy(sSN, "N/A"); strcpy(sSNp, "N/A"); \
-		strcpy(sIPP, "N/A"); strcpy(sIPPp, "N/A"); \
+		char sN[32], sSN[32], sSNx[16], sAVX2[32], sAVX2x[16], \
+			sIPP[32], sIPPx[16]; \
+		strcpy(sN, "N/A"); strcpy(sSN, "N/A"); strcpy(sSNx, "N/A"); \
+		strcpy(sAVX2, "N/A"); strcpy(sAVX2x, "N/A"); \
+		strcpy(sIPP, "N/A"); strcpy(sIPPx, "N/A"); \
 		if (resultNormal[s] > 0.0) _floatprint(resultNormal[s], sN); \
 		if (resultOpt[s] > 0.0) \
 		{ \
 			_floatprint(resultOpt[s], sSN); \
-			if (resultNormal[s] > 0.0) \
-			{ \
-				sprintf(sSNp, "%d%%", \
-					(int) (resultOpt[s] / resultNormal[s] * 100.0 + 0.5)); \
-			} \
+			_speedupprint(resultNormal[s], resultOpt[s], sSNx); \
+		} \
+		if (resultAVX2[s] > 0.0) \
+		{ \
+			_floatprint(resultAVX2[s], sAVX2); \
+			_speedupprint(resultNormal[s], resultAVX2[s], sAVX2x); \
 		} \
 		if (resultIPP[s] > 0.0) \
 		{ \
 			_floatprint(resultIPP[s], sIPP); \
-			if (resultNormal[s] > 0.0) \
-			{ \
-				sprintf(sIPPp, "%d%%", \
-					(int) (resultIPP[s] / resultNormal[s] * 100.0 + 0.5)); \
-			} \
+			_speedupprint(resultNormal[s], resultIPP[s], sIPPx); \
 		} \
-		printf("%8d: %15s %15s %5s %15s %5s\n",  \
-			size_array[s], sN, sSN, sSNp, sIPP, sIPPp); \
+		printf("%8d: %15s %15s %7s %15s %7s %15s %7s\n",  \
+			size_array[s], sN, sSN, sSNx, sAVX2, sAVX2x, sIPP, sIPPx); \
 	} \
-	free(resultNormal); free(resultOpt);  free(resultIPP); \
+	free(resultNormal); free(resultOpt); free(resultAVX2); free(resultIPP); \
 }
 #endif
 
+#define STD_SPEED_TEST( \
+	_name_, _srctype_, _dsttype_, _prework_, \
+	_doNormal_, _funcNormal_, \
+	_doOpt_,    _funcOpt_,  _flagOpt_, _flagExt_, \
+	_doIPP_,    _funcIPP_) \
+	STD_SPEED_TEST_EX(_name_, _srctype_, _dsttype_, _prework_, \
+		_doNormal_, _funcNormal_, \
+		_doOpt_, _funcOpt_, _flagOpt_, _flagExt_, \
+		FALSE, PRIM_NOP, \
+		_doIPP_, _funcIPP_)
+
 #endif // !__PRIMTEST_H_INCLUDED__
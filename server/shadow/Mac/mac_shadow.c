@@ -358,17 +358,11 @@ void (^mac_capture_stream_handler)(CGDisplayStreamFrameStatus, uint64_t, IOSurfa
 		
 		IOSurfaceUnlock(frameSurface, kIOSurfaceLockReadOnly, NULL);
 			
+		shadow_subsystem_frame_update((rdpShadowSubsystem*) subsystem);
+
 		ArrayList_Lock(server->clients);
 			
 		count = ArrayList_Count(server->clients);
-			
-		InitializeSynchronizationBarrier(&(subsystem->barrier), count + 1, -1);
-			
-		SetEvent(subsystem->updateEvent);
-			
-		EnterSynchronizationBarrier(&(subsystem->barrier), 0);
-		
-		DeleteSynchronizationBarrier(&(subsystem->barrier));
 		
 		if (count == 1)
 		{
@@ -382,8 +376,6 @@ void (^mac_capture_stream_handler)(CGDisplayStreamFrameStatus, uint64_t, IOSurfa
 			}
 		}
 		
-		ResetEvent(subsystem->updateEvent);
-			
 		ArrayList_Unlock(server->clients);
 			
 		region16_clear(&(subsystem->invalidRegion));
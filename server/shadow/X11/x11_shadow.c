@@ -33,6 +33,7 @@
 #include <winpr/crt.h>
 #include <winpr/path.h>
 #include <winpr/synch.h>
+#include <winpr/pool.h>
 #include <winpr/image.h>
 #include <winpr/sysinfo.h>
 
@@ -478,6 +479,48 @@ int x11_shadow_query_cursor(x11ShadowSubsystem* subsystem, BOOL getImage)
 	return 1;
 }
 
+#ifdef WITH_XDAMAGE
+static void x11_shadow_handle_damage(x11ShadowSubsystem* subsystem, XDamageNotifyEvent* notify)
+{
+	int left, top;
+	int right, bottom;
+	RECTANGLE_16 damageRect;
+	rdpShadowSurface* surface = subsystem->server->surface;
+
+	if (!surface)
+		return;
+
+	/* damage is reported in root window coordinates */
+
+	left = notify->area.x - surface->x;
+	top = notify->area.y - surface->y;
+	right = left + notify->area.width;
+	bottom = top + notify->area.height;
+
+	if (left < 0)
+		left = 0;
+
+	if (top < 0)
+		top = 0;
+
+	if (right > surface->width)
+		right = surface->width;
+
+	if (bottom > surface->height)
+		bottom = surface->height;
+
+	if ((left >= right) || (top >= bottom))
+		return;
+
+	damageRect.left = left;
+	damageRect.top = top;
+	damageRect.right = right;
+	damageRect.bottom = bottom;
+
+	region16_union_rect(&(subsystem->damageRegion), &(subsystem->damageRegion), &damageRect);
+}
+#endif
+
 int x11_shadow_handle_xevent(x11ShadowSubsystem* subsystem, XEvent* xevent)
 {
 	if (xevent->type == MotionNotify)
@@ -489,6 +532,12 @@ int x11_shadow_handle_xevent(x11ShadowSubsystem* subsystem, XEvent* xevent)
 	{
 		x11_shadow_query_cursor(subsystem, TRUE);
 	}
+#endif
+#ifdef WITH_XDAMAGE
+	else if (xevent->type == subsystem->xdamage_notify_event)
+	{
+		x11_shadow_handle_damage(subsystem, (XDamageNotifyEvent*) xevent);
+	}
 #endif
 	else
 	{
@@ -500,6 +549,7 @@ int x11_shadow_handle_xevent(x11ShadowSubsystem* subsystem, XEvent* xevent)
 
 void x11_shadow_validate_region(x11ShadowSubsystem* subsystem, int x, int y, int width, int height)
 {
+#if defined(WITH_XDAMAGE) && defined(WITH_XFIXES)
 	XRectangle region;
 
 	if (!subsystem->use_xfixes || !subsystem->use_xdamage)
@@ -510,7 +560,6 @@ void x11_shadow_validate_region(x11ShadowSubsystem* subsystem, int x, int y, int
 	region.width = width;
 	region.height = height;
 
-#ifdef WITH_XFIXES
 	XFixesSetRegion(subsystem->display, subsystem->xdamage_region, &region, 1);
 	XDamageSubtract(subsystem->display, subsystem->xdamage, subsystem->xdamage_region, None);
 #endif
@@ -631,36 +680,19 @@ int x11_shadow_blend_cursor(x11ShadowSubsystem* subsystem)
 	return 1;
 }
 
-int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
+static int x11_shadow_screen_grab_full(x11ShadowSubsystem* subsystem, RECTANGLE_16* surfaceRect)
 {
-	int count;
+	int index;
 	int status;
-	int x, y;
-	int width, height;
+	int numRects = 0;
 	XImage* image;
-	rdpShadowScreen* screen;
+	BYTE* pSrcData;
 	rdpShadowServer* server;
 	rdpShadowSurface* surface;
-	RECTANGLE_16 invalidRect;
-	RECTANGLE_16 surfaceRect;
-	const RECTANGLE_16 *extents;
+	const RECTANGLE_16* rects;
 
 	server = subsystem->server;
 	surface = server->surface;
-	screen = server->screen;
-
-	count = ArrayList_Count(server->clients);
-
-	if (count < 1)
-		return 1;
-
-	if ((count == 1) && subsystem->suppressOutput)
-		return 1;
-
-	surfaceRect.left = 0;
-	surfaceRect.top = 0;
-	surfaceRect.right = surface->width;
-	surfaceRect.bottom = surface->height;
 
 	XLockDisplay(subsystem->display);
 
@@ -671,50 +703,231 @@ int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 		XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap,
 				subsystem->xshm_gc, 0, 0, subsystem->width, subsystem->height, 0, 0);
 
-		status = shadow_capture_compare(surface->data, surface->scanline, surface->width, surface->height,
-				(BYTE*) &(image->data[surface->width * 4]), image->bytes_per_line, &invalidRect);
+		pSrcData = (BYTE*) &(image->data[surface->width * 4]);
 	}
 	else
 	{
 		image = XGetImage(subsystem->display, subsystem->root_window,
 					surface->x, surface->y, surface->width, surface->height, AllPlanes, ZPixmap);
 
-		status = shadow_capture_compare(surface->data, surface->scanline, surface->width, surface->height,
-				(BYTE*) image->data, image->bytes_per_line, &invalidRect);
+		if (!image)
+		{
+			XUnlockDisplay(subsystem->display);
+			return -1;
+		}
+
+		pSrcData = (BYTE*) image->data;
 	}
 
 	XSync(subsystem->display, False);
 
 	XUnlockDisplay(subsystem->display);
 
-	region16_union_rect(&(subsystem->invalidRegion), &(subsystem->invalidRegion), &invalidRect);
-	region16_intersect_rect(&(subsystem->invalidRegion), &(subsystem->invalidRegion), &surfaceRect);
+	status = shadow_capture_compare_region(server->capture, surface->data, surface->scanline,
+			surface->width, surface->height, pSrcData, image->bytes_per_line, &(subsystem->invalidRegion));
 
-	if (!region16_is_empty(&(subsystem->invalidRegion)))
+	if (status >= 0)
 	{
-		extents = region16_extents(&(subsystem->invalidRegion));
+		region16_intersect_rect(&(subsystem->invalidRegion), &(subsystem->invalidRegion), surfaceRect);
 
-		x = extents->left;
-		y = extents->top;
-		width = extents->right - extents->left;
-		height = extents->bottom - extents->top;
+		rects = region16_rects(&(subsystem->invalidRegion), &numRects);
 
-		freerdp_image_copy(surface->data, PIXEL_FORMAT_XRGB32,
-				surface->scanline, x, y, width, height,
-				(BYTE*) image->data, PIXEL_FORMAT_XRGB32,
-				image->bytes_per_line, x, y, NULL);
+		for (index = 0; index < numRects; index++)
+		{
+			freerdp_image_copy(surface->data, PIXEL_FORMAT_XRGB32, surface->scanline,
+					rects[index].left, rects[index].top,
+					rects[index].right - rects[index].left, rects[index].bottom - rects[index].top,
+					(BYTE*) image->data, PIXEL_FORMAT_XRGB32, image->bytes_per_line,
+					rects[index].left, rects[index].top, NULL);
+		}
+	}
 
-		//x11_shadow_blend_cursor(subsystem);
+	if (!subsystem->use_xshm)
+		XDestroyImage(image);
 
-		count = ArrayList_Count(server->clients);
+	return (status < 0) ? -1 : 1;
+}
+
+#ifdef WITH_XDAMAGE
+/**
+ * Only grabs the areas reported by XDamage since the last grab. The surface
+ * is kept up to date even while it is not published, so an area which was
+ * not damaged never needs to be read back from the X server.
+ */
+
+static int x11_shadow_screen_grab_damage(x11ShadowSubsystem* subsystem, RECTANGLE_16* surfaceRect)
+{
+	int index;
+	int status;
+	int numRects = 0;
+	int nXSrc, nYSrc;
+	int nWidth, nHeight;
+	BYTE* pSrcData;
+	BYTE* pDstData;
+	int nSrcStep;
+	int changedIndex;
+	int numChangedRects = 0;
+	XImage* image;
+	REGION16 damage;
+	REGION16 changed;
+	RECTANGLE_16 rect;
+	RECTANGLE_16 invalidRect;
+	const RECTANGLE_16* rects;
+	const RECTANGLE_16* changedRects;
+	rdpShadowSurface* surface;
+
+	surface = subsystem->server->surface;
+
+	if (region16_is_empty(&(subsystem->damageRegion)))
+		return 1;
+
+	/* align on the tile grid used by the comparison and the codecs */
+
+	region16_init(&damage);
+	region16_init(&changed);
+
+	rects = region16_rects(&(subsystem->damageRegion), &numRects);
+
+	for (index = 0; index < numRects; index++)
+	{
+		rect = rects[index];
+		shadow_capture_align_clip_rect(&rect, surfaceRect);
+		region16_union_rect(&damage, &damage, &rect);
+	}
+
+	region16_clear(&(subsystem->damageRegion));
+
+	XLockDisplay(subsystem->display);
+
+	/* anything drawn from now on will be reported by new notify events */
+
+	XDamageSubtract(subsystem->display, subsystem->xdamage, None, None);
+
+	rects = region16_rects(&damage, &numRects);
+
+	if (subsystem->use_xshm)
+	{
+		for (index = 0; index < numRects; index++)
+		{
+			XCopyArea(subsystem->display, subsystem->root_window, subsystem->fb_pixmap, subsystem->xshm_gc,
+					surface->x + rects[index].left, surface->y + rects[index].top,
+					rects[index].right - rects[index].left, rects[index].bottom - rects[index].top,
+					surface->x + rects[index].left, surface->y + rects[index].top);
+		}
+
+		XSync(subsystem->display, False);
+	}
+
+	for (index = 0; index < numRects; index++)
+	{
+		nXSrc = rects[index].left;
+		nYSrc = rects[index].top;
+		nWidth = rects[index].right - rects[index].left;
+		nHeight = rects[index].bottom - rects[index].top;
+
+		if (subsystem->use_xshm)
+		{
+			image = subsystem->fb_image;
+			nSrcStep = image->bytes_per_line;
+			pSrcData = (BYTE*) &image->data[((surface->y + nYSrc) * nSrcStep) + ((surface->x + nXSrc) * 4)];
+		}
+		else
+		{
+			image = XGetImage(subsystem->display, subsystem->root_window,
+					surface->x + nXSrc, surface->y + nYSrc, nWidth, nHeight, AllPlanes, ZPixmap);
+
+			if (!image)
+				continue;
+
+			nSrcStep = image->bytes_per_line;
+			pSrcData = (BYTE*) image->data;
+		}
+
+		pDstData = &surface->data[(nYSrc * surface->scanline) + (nXSrc * 4)];
+
+		region16_clear(&changed);
+
+		status = shadow_capture_compare_region(subsystem->server->capture, pDstData, surface->scanline,
+				nWidth, nHeight, pSrcData, nSrcStep, &changed);
+
+		changedRects = region16_rects(&changed, &numChangedRects);
+
+		for (changedIndex = 0; (status > 0) && (changedIndex < numChangedRects); changedIndex++)
+		{
+			invalidRect = changedRects[changedIndex];
+
+			freerdp_image_copy(pDstData, PIXEL_FORMAT_XRGB32, surface->scanline,
+					invalidRect.left, invalidRect.top,
+					invalidRect.right - invalidRect.left, invalidRect.bottom - invalidRect.top,
+					pSrcData, PIXEL_FORMAT_XRGB32, nSrcStep,
+					invalidRect.left, invalidRect.top, NULL);
+
+			invalidRect.left += nXSrc;
+			invalidRect.top += nYSrc;
+			invalidRect.right += nXSrc;
+			invalidRect.bottom += nYSrc;
+
+			region16_union_rect(&(subsystem->invalidRegion), &(subsystem->invalidRegion), &invalidRect);
+		}
+
+		if (!subsystem->use_xshm)
+			XDestroyImage(image);
+	}
+
+	XUnlockDisplay(subsystem->display);
+
+	region16_uninit(&changed);
+	region16_uninit(&damage);
 
-		InitializeSynchronizationBarrier(&(subsystem->barrier), count + 1, -1);
+	return 1;
+}
+#endif
+
+int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
+{
+	int count;
+	int status;
+	rdpShadowServer* server;
+	rdpShadowSurface* surface;
+	RECTANGLE_16 surfaceRect;
+
+	server = subsystem->server;
+	surface = server->surface;
+
+	count = ArrayList_Count(server->clients);
+
+	if (count < 1)
+		return 1;
 
-		SetEvent(subsystem->updateEvent);
+	if ((count == 1) && subsystem->suppressOutput)
+		return 1;
 
-		EnterSynchronizationBarrier(&(subsystem->barrier), 0);
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = surface->width;
+	surfaceRect.bottom = surface->height;
+
+#ifdef WITH_XDAMAGE
+	if (subsystem->use_xdamage)
+		status = x11_shadow_screen_grab_damage(subsystem, &surfaceRect);
+	else
+#endif
+		status = x11_shadow_screen_grab_full(subsystem, &surfaceRect);
 
-		DeleteSynchronizationBarrier(&(subsystem->barrier));
+	if (status < 0)
+		return status;
+
+	region16_intersect_rect(&(subsystem->invalidRegion), &(subsystem->invalidRegion), &surfaceRect);
+
+	if (!region16_is_empty(&(subsystem->invalidRegion)))
+	{
+		//x11_shadow_blend_cursor(subsystem);
+
+		shadow_subsystem_frame_update((rdpShadowSubsystem*) subsystem);
+
+		ArrayList_Lock(server->clients);
+
+		count = ArrayList_Count(server->clients);
 
 		if (count == 1)
 		{
@@ -728,14 +941,11 @@ int x11_shadow_screen_grab(x11ShadowSubsystem* subsystem)
 			}
 		}
 
-		ResetEvent(subsystem->updateEvent);
+		ArrayList_Unlock(server->clients);
 
 		region16_clear(&(subsystem->invalidRegion));
 	}
 
-	if (!subsystem->use_xshm)
-		XDestroyImage(image);
-
 	return 1;
 }
 
@@ -786,68 +996,86 @@ int x11_shadow_subsystem_process_message(x11ShadowSubsystem* subsystem, wMessage
 	return 1;
 }
 
-void* x11_shadow_subsystem_thread(x11ShadowSubsystem* subsystem)
+static void x11_shadow_set_capture_timer(x11ShadowSubsystem* subsystem)
 {
-	XEvent xevent;
-	DWORD status;
-	DWORD nCount;
-	UINT64 cTime;
-	DWORD dwTimeout;
-	DWORD dwInterval;
-	UINT64 frameTime;
-	HANDLE events[32];
-	wMessage message;
-	wMessagePipe* MsgPipe;
+	FILETIME dueTime;
+	ULARGE_INTEGER due;
 
-	MsgPipe = subsystem->MsgPipe;
+	subsystem->captureInterval = 1000 / subsystem->captureFrameRate;
 
-	nCount = 0;
-	events[nCount++] = subsystem->event;
-	events[nCount++] = MessageQueue_Event(MsgPipe->In);
+	/* negative due times are relative, in 100-nanosecond intervals */
 
-	subsystem->captureFrameRate = 16;
-	dwInterval = 1000 / subsystem->captureFrameRate;
-	frameTime = GetTickCount64() + dwInterval;
+	due.QuadPart = (ULONGLONG) (-((LONGLONG) subsystem->captureInterval * 10000));
+	dueTime.dwLowDateTime = due.LowPart;
+	dueTime.dwHighDateTime = due.HighPart;
+
+	SetThreadpoolTimer(subsystem->captureTimer, &dueTime, subsystem->captureInterval, 0);
+}
+
+/**
+ * Screen capture, X events and subsystem messages are callbacks of the
+ * default thread pool instead of a dedicated thread per subsystem. They
+ * may run on different worker threads, the subsystem lock serializes them.
+ */
+
+static VOID CALLBACK x11_shadow_capture_timer_callback(PTP_CALLBACK_INSTANCE instance,
+		PVOID context, PTP_TIMER timer)
+{
+	x11ShadowSubsystem* subsystem = (x11ShadowSubsystem*) context;
+
+	EnterCriticalSection(&subsystem->lock);
+
+	x11_shadow_screen_grab(subsystem);
+	x11_shadow_query_cursor(subsystem, FALSE);
+
+	if (!subsystem->stopping && (subsystem->captureInterval != (DWORD) (1000 / subsystem->captureFrameRate)))
+		x11_shadow_set_capture_timer(subsystem);
+
+	LeaveCriticalSection(&subsystem->lock);
+}
+
+static VOID CALLBACK x11_shadow_xevent_callback(PTP_CALLBACK_INSTANCE instance, PVOID context,
+		PVOID overlapped, ULONG ioResult, ULONG_PTR numberOfBytesTransferred, PTP_IO io)
+{
+	XEvent xevent;
+	x11ShadowSubsystem* subsystem = (x11ShadowSubsystem*) context;
+
+	EnterCriticalSection(&subsystem->lock);
+
+	/* drain everything, damage notifications come in bursts */
 
-	while (1)
+	while (XPending(subsystem->display) > 0)
 	{
-		cTime = GetTickCount64();
-		dwTimeout = (cTime > frameTime) ? 0 : frameTime - cTime;
+		XNextEvent(subsystem->display, &xevent);
+		x11_shadow_handle_xevent(subsystem, &xevent);
+	}
 
-		status = WaitForMultipleObjects(nCount, events, FALSE, dwTimeout);
+	if (!subsystem->stopping)
+		StartThreadpoolIo(io);
 
-		if (WaitForSingleObject(MessageQueue_Event(MsgPipe->In), 0) == WAIT_OBJECT_0)
-		{
-			if (MessageQueue_Peek(MsgPipe->In, &message, TRUE))
-			{
-				if (message.id == WMQ_QUIT)
-					break;
+	LeaveCriticalSection(&subsystem->lock);
+}
 
-				x11_shadow_subsystem_process_message(subsystem, &message);
-			}
-		}
+static VOID CALLBACK x11_shadow_message_callback(PTP_CALLBACK_INSTANCE instance, PVOID context,
+		PVOID overlapped, ULONG ioResult, ULONG_PTR numberOfBytesTransferred, PTP_IO io)
+{
+	wMessage message;
+	x11ShadowSubsystem* subsystem = (x11ShadowSubsystem*) context;
 
-		if (WaitForSingleObject(subsystem->event, 0) == WAIT_OBJECT_0)
-		{
-			if (XEventsQueued(subsystem->display, QueuedAlready))
-			{
-				XNextEvent(subsystem->display, &xevent);
-				x11_shadow_handle_xevent(subsystem, &xevent);
-			}
-		}
+	EnterCriticalSection(&subsystem->lock);
 
-		if ((status == WAIT_TIMEOUT) || (GetTickCount64() > frameTime))
-		{
-			x11_shadow_screen_grab(subsystem);
-			x11_shadow_query_cursor(subsystem, FALSE);
+	while (MessageQueue_Peek(subsystem->MsgPipe->In, &message, TRUE))
+	{
+		if (message.id == WMQ_QUIT)
+			continue;
 
-			dwInterval = 1000 / subsystem->captureFrameRate;
-			frameTime += dwInterval;
-		}
+		x11_shadow_subsystem_process_message(subsystem, &message);
 	}
 
-	ExitThread(0);
-	return NULL;
+	if (!subsystem->stopping)
+		StartThreadpoolIo(io);
+
+	LeaveCriticalSection(&subsystem->lock);
 }
 
 int x11_shadow_subsystem_base_init(x11ShadowSubsystem* subsystem)
@@ -934,6 +1162,7 @@ int x11_shadow_xdamage_init(x11ShadowSubsystem* subsystem)
 	int major, minor;
 	int damage_event;
 	int damage_error;
+	RECTANGLE_16 damageRect;
 
 	if (!subsystem->use_xfixes)
 		return -1;
@@ -960,6 +1189,15 @@ int x11_shadow_xdamage_init(x11ShadowSubsystem* subsystem)
 		return -1;
 #endif
 
+	/* the first grab has to read back the whole screen */
+
+	damageRect.left = 0;
+	damageRect.top = 0;
+	damageRect.right = subsystem->width;
+	damageRect.bottom = subsystem->height;
+
+	region16_union_rect(&(subsystem->damageRegion), &(subsystem->damageRegion), &damageRect);
+
 	return 1;
 #else
 	return -1;
@@ -1116,6 +1354,18 @@ int x11_shadow_enum_monitors(MONITOR_DEF* monitors, int maxMonitors)
 	return numMonitors;
 }
 
+static BOOL x11_shadow_compositing_manager_active(x11ShadowSubsystem* subsystem)
+{
+	Atom atom;
+	char name[32];
+
+	sprintf_s(name, sizeof(name), "_NET_WM_CM_S%d", subsystem->number);
+
+	atom = XInternAtom(subsystem->display, name, False);
+
+	return (XGetSelectionOwner(subsystem->display, atom) != None) ? TRUE : FALSE;
+}
+
 int x11_shadow_subsystem_init(x11ShadowSubsystem* subsystem)
 {
 	int i;
@@ -1153,7 +1403,12 @@ int x11_shadow_subsystem_init(x11ShadowSubsystem* subsystem)
 
 	XFreeExtensionList(extensions);
 
-	if (subsystem->composite)
+	/**
+	 * Root window damage misses the content of redirected windows,
+	 * which only matters when a compositing manager is running.
+	 */
+
+	if (subsystem->composite && x11_shadow_compositing_manager_active(subsystem))
 		subsystem->use_xdamage = FALSE;
 
 	pfs = XListPixmapFormats(subsystem->display, &pf_count);
@@ -1278,31 +1533,76 @@ int x11_shadow_subsystem_uninit(x11ShadowSubsystem* subsystem)
 	return 1;
 }
 
-int x11_shadow_subsystem_start(x11ShadowSubsystem* subsystem)
+int x11_shadow_subsystem_stop(x11ShadowSubsystem* subsystem)
 {
 	if (!subsystem)
 		return -1;
 
-	subsystem->thread = CreateThread(NULL, 0,
-			(LPTHREAD_START_ROUTINE) x11_shadow_subsystem_thread,
-			(void*) subsystem, 0, NULL);
+	if (!subsystem->started)
+		return 1;
+
+	EnterCriticalSection(&subsystem->lock);
+	subsystem->stopping = TRUE;
+	LeaveCriticalSection(&subsystem->lock);
+
+	if (subsystem->captureTimer)
+	{
+		SetThreadpoolTimer(subsystem->captureTimer, NULL, 0, 0);
+		WaitForThreadpoolTimerCallbacks(subsystem->captureTimer, TRUE);
+		CloseThreadpoolTimer(subsystem->captureTimer);
+		subsystem->captureTimer = NULL;
+	}
+
+	if (subsystem->xeventIo)
+	{
+		WaitForThreadpoolIoCallbacks(subsystem->xeventIo, TRUE);
+		CloseThreadpoolIo(subsystem->xeventIo);
+		subsystem->xeventIo = NULL;
+	}
+
+	if (subsystem->messageIo)
+	{
+		WaitForThreadpoolIoCallbacks(subsystem->messageIo, TRUE);
+		CloseThreadpoolIo(subsystem->messageIo);
+		subsystem->messageIo = NULL;
+	}
+
+	DeleteCriticalSection(&subsystem->lock);
+	subsystem->started = FALSE;
 
 	return 1;
 }
 
-int x11_shadow_subsystem_stop(x11ShadowSubsystem* subsystem)
+int x11_shadow_subsystem_start(x11ShadowSubsystem* subsystem)
 {
 	if (!subsystem)
 		return -1;
 
-	if (subsystem->thread)
+	if (!InitializeCriticalSectionAndSpinCount(&subsystem->lock, 4000))
+		return -1;
+
+	subsystem->started = TRUE;
+	subsystem->stopping = FALSE;
+	subsystem->captureFrameRate = 16;
+
+	subsystem->captureTimer = CreateThreadpoolTimer(x11_shadow_capture_timer_callback,
+			(void*) subsystem, NULL);
+	subsystem->xeventIo = CreateThreadpoolIo(subsystem->event, x11_shadow_xevent_callback,
+			(void*) subsystem, NULL);
+	subsystem->messageIo = CreateThreadpoolIo(MessageQueue_Event(subsystem->MsgPipe->In),
+			x11_shadow_message_callback, (void*) subsystem, NULL);
+
+	if (!subsystem->captureTimer || !subsystem->xeventIo || !subsystem->messageIo)
 	{
-		MessageQueue_PostQuit(subsystem->MsgPipe->In, 0);
-		WaitForSingleObject(subsystem->thread, INFINITE);
-		CloseHandle(subsystem->thread);
-		subsystem->thread = NULL;
+		WLog_ERR(TAG, "failed to create thread pool callbacks");
+		x11_shadow_subsystem_stop(subsystem);
+		return -1;
 	}
 
+	StartThreadpoolIo(subsystem->xeventIo);
+	StartThreadpoolIo(subsystem->messageIo);
+	x11_shadow_set_capture_timer(subsystem);
+
 	return 1;
 }
 
@@ -1328,9 +1628,13 @@ x11ShadowSubsystem* x11_shadow_subsystem_new()
 	subsystem->composite = FALSE;
 	subsystem->use_xshm = FALSE; /* temporarily disabled */
 	subsystem->use_xfixes = TRUE;
-	subsystem->use_xdamage = FALSE;
+	subsystem->use_xdamage = TRUE;
 	subsystem->use_xinerama = TRUE;
 
+#ifdef WITH_XDAMAGE
+	region16_init(&(subsystem->damageRegion));
+#endif
+
 	return subsystem;
 }
 
@@ -1341,6 +1645,10 @@ void x11_shadow_subsystem_free(x11ShadowSubsystem* subsystem)
 
 	x11_shadow_subsystem_uninit(subsystem);
 
+#ifdef WITH_XDAMAGE
+	region16_uninit(&(subsystem->damageRegion));
+#endif
+
 	free(subsystem);
 }
 
@@ -26,6 +26,7 @@ typedef struct x11_shadow_subsystem x11ShadowSubsystem;
 #include <winpr/crt.h>
 #include <winpr/synch.h>
 #include <winpr/thread.h>
+#include <winpr/pool.h>
 #include <winpr/stream.h>
 #include <winpr/collections.h>
 
@@ -55,7 +56,13 @@ struct x11_shadow_subsystem
 {
 	RDP_SHADOW_SUBSYSTEM_COMMON();
 
-	HANDLE thread;
+	BOOL started;
+	BOOL stopping;
+	CRITICAL_SECTION lock;
+	DWORD captureInterval;
+	PTP_TIMER captureTimer;
+	PTP_IO xeventIo;
+	PTP_IO messageIo;
 
 	int bpp;
 	int xfds;
@@ -75,6 +82,7 @@ struct x11_shadow_subsystem
 	BOOL use_xdamage;
 	BOOL use_xinerama;
 
+	GC xshm_gc;
 	XImage* fb_image;
 	Pixmap fb_pixmap;
 	Window root_window;
@@ -90,10 +98,10 @@ struct x11_shadow_subsystem
 	int cursorMaxHeight;
 
 #ifdef WITH_XDAMAGE
-	GC xshm_gc;
 	Damage xdamage;
 	int xdamage_notify_event;
 	XserverRegion xdamage_region;
+	REGION16 damageRegion;
 #endif
 
 #ifdef WITH_XFIXES
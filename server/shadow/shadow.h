@@ -26,7 +26,9 @@
 #include "shadow_screen.h"
 #include "shadow_surface.h"
 #include "shadow_encoder.h"
+#include "shadow_encoder_cache.h"
 #include "shadow_capture.h"
+#include "shadow_mailbox.h"
 #include "shadow_channels.h"
 #include "shadow_subsystem.h"
 #include "shadow_lobby.h"
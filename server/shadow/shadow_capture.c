@@ -22,8 +22,15 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/log.h>
+#include <freerdp/codec/color.h>
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "shadow_surface.h"
 
@@ -31,6 +38,9 @@
 
 #define TAG SERVER_TAG("shadow")
 
+/* below this number of tiles a comparison is not worth splitting */
+#define SHADOW_CAPTURE_PARALLEL_TILES	4096
+
 int shadow_capture_align_clip_rect(RECTANGLE_16* rect, RECTANGLE_16* clip)
 {
 	int dx, dy;
@@ -80,98 +90,336 @@ int shadow_capture_align_clip_rect(RECTANGLE_16* rect, RECTANGLE_16* clip)
 	return 1;
 }
 
-int shadow_capture_compare(BYTE* pData1, int nStep1, int nWidth, int nHeight, BYTE* pData2, int nStep2, RECTANGLE_16* rect)
+static BOOL shadow_capture_tile_equal_c(const BYTE* pData1, int nStep1,
+		const BYTE* pData2, int nStep2, int nWidth, int nHeight)
 {
-	BOOL equal;
-	BOOL allEqual;
-	int tw, th;
-	int tx, ty, k;
-	int nrow, ncol;
-	int l, t, r, b;
-	BYTE *p1, *p2;
-	BOOL rows[1024];
-	BOOL cols[1024];
-	BOOL grid[1024][1024];
+	int y;
 
-	allEqual = TRUE;
-	ZeroMemory(rect, sizeof(RECTANGLE_16));
-	FillMemory(rows, sizeof(rows), 0xFF);
-	FillMemory(cols, sizeof(cols), 0xFF);
-	FillMemory(grid, sizeof(grid), 0xFF);
+	for (y = 0; y < nHeight; y++)
+	{
+		if (memcmp(pData1, pData2, nWidth * 4) != 0)
+			return FALSE;
 
-	nrow = (nHeight + 15) / 16;
-	ncol = (nWidth + 15) / 16;
+		pData1 += nStep1;
+		pData2 += nStep2;
+	}
 
-	l = ncol + 1;
-	r = -1;
+	return TRUE;
+}
 
-	t = nrow + 1;
-	b = -1;
+#ifdef WITH_SSE2
+static BOOL shadow_capture_tile_equal_sse2(const BYTE* pData1, int nStep1,
+		const BYTE* pData2, int nStep2, int nWidth, int nHeight)
+{
+	int y;
+	__m128i diff;
+	__m128i zero;
 
-	for (ty = 0; ty < nrow; ty++)
+	if (nWidth != SHADOW_CAPTURE_TILE_SIZE)
+		return shadow_capture_tile_equal_c(pData1, nStep1, pData2, nStep2, nWidth, nHeight);
+
+	/* accumulate the differences over the whole tile, equal tiles are the common case */
+
+	diff = _mm_setzero_si128();
+
+	for (y = 0; y < nHeight; y++)
+	{
+		diff = _mm_or_si128(diff, _mm_xor_si128(
+				_mm_loadu_si128((const __m128i*) &pData1[0]),
+				_mm_loadu_si128((const __m128i*) &pData2[0])));
+		diff = _mm_or_si128(diff, _mm_xor_si128(
+				_mm_loadu_si128((const __m128i*) &pData1[16]),
+				_mm_loadu_si128((const __m128i*) &pData2[16])));
+		diff = _mm_or_si128(diff, _mm_xor_si128(
+				_mm_loadu_si128((const __m128i*) &pData1[32]),
+				_mm_loadu_si128((const __m128i*) &pData2[32])));
+		diff = _mm_or_si128(diff, _mm_xor_si128(
+				_mm_loadu_si128((const __m128i*) &pData1[48]),
+				_mm_loadu_si128((const __m128i*) &pData2[48])));
+
+		pData1 += nStep1;
+		pData2 += nStep2;
+	}
+
+	zero = _mm_setzero_si128();
+
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) == 0xFFFF) ? TRUE : FALSE;
+}
+#endif
+
+static pfnShadowTileEqual shadow_capture_get_tile_equal(void)
+{
+#ifdef WITH_SSE2
+	if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+		return shadow_capture_tile_equal_sse2;
+#endif
+
+	return shadow_capture_tile_equal_c;
+}
+
+/**
+ * Marks the tiles of rows [firstRow, lastRow) which differ between both buffers
+ * in the tile map, one byte per tile, and returns the number of dirty tiles.
+ */
+
+static int shadow_capture_compare_tiles(SHADOW_CAPTURE_COMPARE_PARAM* param)
+{
+	int tx, ty;
+	int tw, th;
+	int ncol, nrow;
+	int count = 0;
+	const BYTE* p1;
+	const BYTE* p2;
+	BYTE* tiles;
+
+	ncol = (param->nWidth + (SHADOW_CAPTURE_TILE_SIZE - 1)) / SHADOW_CAPTURE_TILE_SIZE;
+	nrow = (param->nHeight + (SHADOW_CAPTURE_TILE_SIZE - 1)) / SHADOW_CAPTURE_TILE_SIZE;
+
+	for (ty = param->firstRow; ty < param->lastRow; ty++)
 	{
-		th = ((ty + 1) == nrow) ? (nHeight % 16) : 16;
+		th = SHADOW_CAPTURE_TILE_SIZE;
+
+		if (((ty + 1) == nrow) && (param->nHeight % SHADOW_CAPTURE_TILE_SIZE))
+			th = param->nHeight % SHADOW_CAPTURE_TILE_SIZE;
 
-		if (!th)
-			th = 16;
+		tiles = &param->tiles[ty * ncol];
 
 		for (tx = 0; tx < ncol; tx++)
 		{
-			equal = TRUE;
+			tw = SHADOW_CAPTURE_TILE_SIZE;
 
-			tw = ((tx + 1) == ncol) ? (nWidth % 16) : 16;
+			if (((tx + 1) == ncol) && (param->nWidth % SHADOW_CAPTURE_TILE_SIZE))
+				tw = param->nWidth % SHADOW_CAPTURE_TILE_SIZE;
 
-			if (!tw)
-				tw = 16;
+			p1 = &param->pData1[(ty * SHADOW_CAPTURE_TILE_SIZE * param->nStep1) + (tx * SHADOW_CAPTURE_TILE_SIZE * 4)];
+			p2 = &param->pData2[(ty * SHADOW_CAPTURE_TILE_SIZE * param->nStep2) + (tx * SHADOW_CAPTURE_TILE_SIZE * 4)];
 
-			p1 = &pData1[(ty * 16 * nStep1) + (tx * 16 * 4)];
-			p2 = &pData2[(ty * 16 * nStep2) + (tx * 16 * 4)];
+			tiles[tx] = param->TileEqual(p1, param->nStep1, p2, param->nStep2, tw, th) ? 0 : 1;
 
-			for (k = 0; k < th; k++)
-			{
-				if (memcmp(p1, p2, tw * 4) != 0)
-				{
-					equal = FALSE;
-					break;
-				}
+			count += tiles[tx];
+		}
+	}
 
-				p1 += nStep1;
-				p2 += nStep2;
-			}
+	param->count = count;
 
-			if (!equal)
-			{
-				grid[ty][tx] = FALSE;
-				rows[ty] = FALSE;
-				cols[tx] = FALSE;
+	return count;
+}
 
-				if (l > tx)
-					l = tx;
+static void CALLBACK shadow_capture_compare_work_callback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	shadow_capture_compare_tiles((SHADOW_CAPTURE_COMPARE_PARAM*) context);
+}
 
-				if (r < tx)
-					r = tx;
-			}
+/**
+ * Compares both buffers tile by tile and adds every dirty tile to the region,
+ * adjacent dirty tiles of a tile row are merged into a single rectangle.
+ *
+ * Large surfaces are split in bands of tile rows compared in parallel.
+ * Returns the number of dirty tiles, or -1 on failure. The region may be
+ * NULL when only the number of dirty tiles is of interest.
+ */
+
+int shadow_capture_compare_region(rdpShadowCapture* capture, BYTE* pData1, int nStep1,
+		int nWidth, int nHeight, BYTE* pData2, int nStep2, REGION16* region)
+{
+	int tx, ty;
+	int index;
+	int count = 0;
+	int numBands;
+	int ncol, nrow;
+	int numTiles;
+	BYTE* tiles;
+	RECTANGLE_16 rect;
+	pfnShadowTileEqual TileEqual;
+	SHADOW_CAPTURE_COMPARE_PARAM* params;
+
+	if ((nWidth < 1) || (nHeight < 1))
+		return 0;
+
+	ncol = (nWidth + (SHADOW_CAPTURE_TILE_SIZE - 1)) / SHADOW_CAPTURE_TILE_SIZE;
+	nrow = (nHeight + (SHADOW_CAPTURE_TILE_SIZE - 1)) / SHADOW_CAPTURE_TILE_SIZE;
+	numTiles = ncol * nrow;
+
+	TileEqual = shadow_capture_get_tile_equal();
+
+	EnterCriticalSection(&(capture->lock));
+
+	if (numTiles > capture->maxTiles)
+	{
+		tiles = (BYTE*) realloc(capture->tiles, numTiles);
+
+		if (!tiles)
+		{
+			LeaveCriticalSection(&(capture->lock));
+			return -1;
 		}
 
-		if (!rows[ty])
+		capture->tiles = tiles;
+		capture->maxTiles = numTiles;
+	}
+
+	numBands = 1;
+
+	if (capture->ThreadPool && (numTiles >= SHADOW_CAPTURE_PARALLEL_TILES))
+	{
+		numBands = capture->numBands;
+
+		if (numBands > nrow)
+			numBands = nrow;
+	}
+
+	params = capture->params;
+
+	for (index = 0; index < numBands; index++)
+	{
+		params[index].TileEqual = TileEqual;
+		params[index].pData1 = pData1;
+		params[index].nStep1 = nStep1;
+		params[index].pData2 = pData2;
+		params[index].nStep2 = nStep2;
+		params[index].nWidth = nWidth;
+		params[index].nHeight = nHeight;
+		params[index].tiles = capture->tiles;
+		params[index].firstRow = (nrow * index) / numBands;
+		params[index].lastRow = (nrow * (index + 1)) / numBands;
+		params[index].count = 0;
+	}
+
+	if (numBands > 1)
+	{
+		for (index = 0; index < numBands; index++)
+		{
+			params[index].work = CreateThreadpoolWork(shadow_capture_compare_work_callback,
+					(void*) &params[index], &(capture->ThreadPoolEnv));
+
+			if (params[index].work)
+				SubmitThreadpoolWork(params[index].work);
+			else
+				shadow_capture_compare_tiles(&params[index]);
+		}
+
+		for (index = 0; index < numBands; index++)
 		{
-			allEqual = FALSE;
+			if (!params[index].work)
+				continue;
+
+			WaitForThreadpoolWorkCallbacks(params[index].work, FALSE);
+			CloseThreadpoolWork(params[index].work);
+			params[index].work = NULL;
+		}
+	}
+	else
+	{
+		shadow_capture_compare_tiles(&params[0]);
+	}
+
+	for (index = 0; index < numBands; index++)
+		count += params[index].count;
+
+	tiles = capture->tiles;
+
+	for (ty = 0; region && count && (ty < nrow); ty++)
+	{
+		for (tx = 0; tx < ncol; tx++)
+		{
+			if (!tiles[(ty * ncol) + tx])
+				continue;
+
+			rect.left = tx * SHADOW_CAPTURE_TILE_SIZE;
+			rect.top = ty * SHADOW_CAPTURE_TILE_SIZE;
+
+			while (((tx + 1) < ncol) && tiles[(ty * ncol) + tx + 1])
+				tx++;
+
+			rect.right = (tx + 1) * SHADOW_CAPTURE_TILE_SIZE;
+			rect.bottom = (ty + 1) * SHADOW_CAPTURE_TILE_SIZE;
+
+			if (rect.right > nWidth)
+				rect.right = nWidth;
+
+			if (rect.bottom > nHeight)
+				rect.bottom = nHeight;
+
+			region16_union_rect(region, region, &rect);
+		}
+	}
+
+	LeaveCriticalSection(&(capture->lock));
+
+	return count;
+}
+
+/**
+ * Single threaded variant returning the bounding rectangle of the dirty tiles.
+ */
+
+int shadow_capture_compare(BYTE* pData1, int nStep1, int nWidth, int nHeight, BYTE* pData2, int nStep2, RECTANGLE_16* rect)
+{
+	int tx, ty;
+	int ncol, nrow;
+	int l, t, r, b;
+	SHADOW_CAPTURE_COMPARE_PARAM param;
+
+	ZeroMemory(rect, sizeof(RECTANGLE_16));
+
+	if ((nWidth < 1) || (nHeight < 1))
+		return 0;
+
+	ncol = (nWidth + (SHADOW_CAPTURE_TILE_SIZE - 1)) / SHADOW_CAPTURE_TILE_SIZE;
+	nrow = (nHeight + (SHADOW_CAPTURE_TILE_SIZE - 1)) / SHADOW_CAPTURE_TILE_SIZE;
+
+	ZeroMemory(&param, sizeof(SHADOW_CAPTURE_COMPARE_PARAM));
+
+	param.TileEqual = shadow_capture_get_tile_equal();
+	param.pData1 = pData1;
+	param.nStep1 = nStep1;
+	param.pData2 = pData2;
+	param.nStep2 = nStep2;
+	param.nWidth = nWidth;
+	param.nHeight = nHeight;
+	param.firstRow = 0;
+	param.lastRow = nrow;
+	param.tiles = (BYTE*) malloc(ncol * nrow);
+
+	if (!param.tiles)
+		return -1;
+
+	if (shadow_capture_compare_tiles(&param) < 1)
+	{
+		free(param.tiles);
+		return 0;
+	}
+
+	l = ncol;
+	t = nrow;
+	r = b = -1;
+
+	for (ty = 0; ty < nrow; ty++)
+	{
+		for (tx = 0; tx < ncol; tx++)
+		{
+			if (!param.tiles[(ty * ncol) + tx])
+				continue;
+
+			if (l > tx)
+				l = tx;
+
+			if (r < tx)
+				r = tx;
 
 			if (t > ty)
 				t = ty;
 
-			if (b < ty)
-				b = ty;
+			b = ty;
 		}
 	}
 
-	if (allEqual)
-		return 0;
+	free(param.tiles);
 
-	rect->left = l * 16;
-	rect->top = t * 16;
-	rect->right = (r + 1) * 16;
-	rect->bottom = (b + 1) * 16;
+	rect->left = l * SHADOW_CAPTURE_TILE_SIZE;
+	rect->top = t * SHADOW_CAPTURE_TILE_SIZE;
+	rect->right = (r + 1) * SHADOW_CAPTURE_TILE_SIZE;
+	rect->bottom = (b + 1) * SHADOW_CAPTURE_TILE_SIZE;
 
 	if (rect->right > nWidth)
 		rect->right = nWidth;
@@ -179,45 +427,243 @@ int shadow_capture_compare(BYTE* pData1, int nStep1, int nWidth, int nHeight, BY
 	if (rect->bottom > nHeight)
 		rect->bottom = nHeight;
 
-	if (0)
+	return 1;
+}
+
+static UINT32 shadow_capture_rect_area(const RECTANGLE_16* rect)
+{
+	return (UINT32) (rect->right - rect->left) * (UINT32) (rect->bottom - rect->top);
+}
+
+static BOOL shadow_capture_merge_is_cheaper(const RECTANGLE_16* rect1, const RECTANGLE_16* rect2,
+		UINT32 overhead, RECTANGLE_16* merged)
+{
+	merged->left = MIN(rect1->left, rect2->left);
+	merged->top = MIN(rect1->top, rect2->top);
+	merged->right = MAX(rect1->right, rect2->right);
+	merged->bottom = MAX(rect1->bottom, rect2->bottom);
+
+	return (shadow_capture_rect_area(merged) <= (shadow_capture_rect_area(rect1) +
+			shadow_capture_rect_area(rect2) + overhead)) ? TRUE : FALSE;
+}
+
+/**
+ * Turns a region into the list of rectangles to encode. Two rectangles are replaced
+ * by their bounding box whenever encoding the additional area costs less than the
+ * fixed cost of a separate update, given in pixels by overhead.
+ *
+ * Returns the number of rectangles, the caller must free *ppRects.
+ */
+
+int shadow_capture_merge_rects(const REGION16* region, UINT32 overhead, RECTANGLE_16** ppRects)
+{
+	int i, j;
+	int count = 0;
+	int numRects = 0;
+	BOOL merged;
+	RECTANGLE_16 bounds;
+	RECTANGLE_16* rects;
+	const RECTANGLE_16* regionRects;
+
+	*ppRects = NULL;
+
+	regionRects = region16_rects(region, &numRects);
+
+	if (numRects < 1)
+		return 0;
+
+	rects = (RECTANGLE_16*) malloc(numRects * sizeof(RECTANGLE_16));
+
+	if (!rects)
+		return -1;
+
+	/* region rectangles come in band order, so neighbours are usually close */
+
+	for (i = 0; i < numRects; i++)
+	{
+		if (count && shadow_capture_merge_is_cheaper(&rects[count - 1], &regionRects[i], overhead, &bounds))
+			rects[count - 1] = bounds;
+		else
+			rects[count++] = regionRects[i];
+	}
+
+	if (count <= SHADOW_CAPTURE_MAX_MERGE_RECTS)
 	{
-		char *col_str = calloc(ncol + 1, sizeof(char));
-		if (!col_str)
+		do
 		{
-			WLog_ERR(TAG, "calloc failed!");
-			return 1;
+			merged = FALSE;
+
+			for (i = 0; i < count; i++)
+			{
+				for (j = i + 1; j < count; j++)
+				{
+					if (!shadow_capture_merge_is_cheaper(&rects[i], &rects[j], overhead, &bounds))
+						continue;
+
+					rects[i] = bounds;
+					rects[j] = rects[--count];
+					merged = TRUE;
+					j = i;
+				}
+			}
 		}
+		while (merged);
+	}
 
-		for (tx = 0; tx < ncol; tx++)
-			sprintf(&col_str[tx], "-");
-		WLog_INFO(TAG, "%s", col_str);
+	*ppRects = rects;
 
-		for (tx = 0; tx < ncol; tx++)
-			sprintf(&col_str[tx], "%c", cols[tx] ? 'O' : 'X');
-		WLog_INFO(TAG, "%s", col_str);
+	return count;
+}
 
-		for (tx = 0; tx < ncol; tx++)
-			sprintf(&col_str[tx], "-");
-		WLog_INFO(TAG, "%s", col_str);
+static void shadow_capture_union_rects(REGION16* region, const RECTANGLE_16* rects, int numRects)
+{
+	int index;
+
+	for (index = 0; index < numRects; index++)
+		region16_union_rect(region, region, &rects[index]);
+}
+
+static rdpShadowFrame* shadow_frame_new(rdpShadowServer* server, rdpShadowSurface* surface)
+{
+	rdpShadowFrame* frame;
+	RECTANGLE_16 surfaceRect;
+
+	frame = (rdpShadowFrame*) calloc(1, sizeof(rdpShadowFrame));
+
+	if (!frame)
+		return NULL;
+
+	frame->surface = shadow_surface_new(server, surface->x, surface->y, surface->width, surface->height);
+
+	if (!frame->surface)
+	{
+		free(frame);
+		return NULL;
+	}
+
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = surface->width;
+	surfaceRect.bottom = surface->height;
+
+	region16_init(&(frame->staleRegion));
+	region16_union_rect(&(frame->staleRegion), &(frame->staleRegion), &surfaceRect);
+
+	return frame;
+}
+
+static void shadow_frame_free(rdpShadowFrame* frame)
+{
+	if (!frame)
+		return;
+
+	shadow_surface_free(frame->surface);
+	region16_uninit(&(frame->staleRegion));
+
+	free(frame);
+}
 
-		for (ty = 0; ty < nrow; ty++)
+void shadow_frame_release(rdpShadowFrame* frame)
+{
+	if (!frame)
+		return;
+
+	InterlockedDecrement(&(frame->refCount));
+}
+
+/**
+ * Publishes the current content of the surface as a new frame generation.
+ *
+ * Frames are recycled once nobody holds a reference on them anymore. Each frame
+ * keeps track of the areas which changed since its last use, so bringing a
+ * recycled frame up to date only copies what was invalidated in the meantime.
+ *
+ * The returned frame holds one reference for the caller.
+ */
+
+rdpShadowFrame* shadow_capture_snapshot(rdpShadowCapture* capture, rdpShadowSurface* surface, REGION16* invalidRegion)
+{
+	int index;
+	int count;
+	int numRects = 0;
+	rdpShadowFrame* frame;
+	rdpShadowFrame* current = NULL;
+	RECTANGLE_16 surfaceRect;
+	const RECTANGLE_16* rects;
+
+	EnterCriticalSection(&(capture->lock));
+
+	rects = region16_rects(invalidRegion, &numRects);
+
+	count = ArrayList_Count(capture->frames);
+
+	for (index = 0; index < count; index++)
+	{
+		frame = (rdpShadowFrame*) ArrayList_GetItem(capture->frames, index);
+
+		/* references are only ever added by the capture thread, so zero is final */
+
+		if (!current && (frame->refCount == 0))
+			current = frame;
+	}
+
+	if (!current)
+	{
+		current = shadow_frame_new(capture->server, surface);
+
+		if (!current)
 		{
-			for (tx = 0; tx < ncol; tx++)
-				sprintf(&col_str[tx], "%c", cols[tx] ? 'O' : 'X');
-			WLog_INFO(TAG, "%s", col_str);
-			WLog_INFO(TAG, "|%s|", rows[ty] ? "O" : "X");
+			LeaveCriticalSection(&(capture->lock));
+			return NULL;
 		}
 
-		WLog_INFO(TAG, "left: %d top: %d right: %d bottom: %d ncol: %d nrow: %d",
-				l, t, r, b, ncol, nrow);
-		free(col_str);
+		ArrayList_Add(capture->frames, (void*) current);
+		count++;
 	}
 
-	return 1;
+	for (index = 0; index < count; index++)
+	{
+		frame = (rdpShadowFrame*) ArrayList_GetItem(capture->frames, index);
+
+		if (frame == current)
+			continue;
+
+		shadow_capture_union_rects(&(frame->staleRegion), rects, numRects);
+	}
+
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = surface->width;
+	surfaceRect.bottom = surface->height;
+
+	shadow_capture_union_rects(&(current->staleRegion), rects, numRects);
+	region16_intersect_rect(&(current->staleRegion), &(current->staleRegion), &surfaceRect);
+
+	rects = region16_rects(&(current->staleRegion), &numRects);
+
+	for (index = 0; index < numRects; index++)
+	{
+		freerdp_image_copy(current->surface->data, PIXEL_FORMAT_XRGB32, current->surface->scanline,
+				rects[index].left, rects[index].top,
+				rects[index].right - rects[index].left, rects[index].bottom - rects[index].top,
+				surface->data, PIXEL_FORMAT_XRGB32, surface->scanline,
+				rects[index].left, rects[index].top, NULL);
+	}
+
+	region16_clear(&(current->staleRegion));
+
+	current->generation = ++capture->generation;
+	current->surface->generation = current->generation;
+	current->refCount = 1;
+
+	LeaveCriticalSection(&(capture->lock));
+
+	return current;
 }
 
 rdpShadowCapture* shadow_capture_new(rdpShadowServer* server)
 {
+	SYSTEM_INFO sysinfo;
 	rdpShadowCapture* capture;
 
 	capture = (rdpShadowCapture*) calloc(1, sizeof(rdpShadowCapture));
@@ -228,16 +674,65 @@ rdpShadowCapture* shadow_capture_new(rdpShadowServer* server)
 	capture->server = server;
 
 	if (!InitializeCriticalSectionAndSpinCount(&(capture->lock), 4000))
+	{
+		free(capture);
 		return NULL;
+	}
+
+	capture->frames = ArrayList_New(FALSE);
+
+	if (!capture->frames)
+	{
+		DeleteCriticalSection(&(capture->lock));
+		free(capture);
+		return NULL;
+	}
+
+	GetNativeSystemInfo(&sysinfo);
+
+	capture->numBands = sysinfo.dwNumberOfProcessors;
+
+	if (capture->numBands > SHADOW_CAPTURE_MAX_BANDS)
+		capture->numBands = SHADOW_CAPTURE_MAX_BANDS;
+
+	if (capture->numBands > 1)
+	{
+		capture->ThreadPool = CreateThreadpool(NULL);
+
+		if (capture->ThreadPool)
+		{
+			InitializeThreadpoolEnvironment(&(capture->ThreadPoolEnv));
+			SetThreadpoolCallbackPool(&(capture->ThreadPoolEnv), capture->ThreadPool);
+			SetThreadpoolThreadMaximum(capture->ThreadPool, capture->numBands);
+		}
+	}
 
 	return capture;
 }
 
 void shadow_capture_free(rdpShadowCapture* capture)
 {
+	int index;
+	int count;
+
 	if (!capture)
 		return;
 
+	count = ArrayList_Count(capture->frames);
+
+	for (index = 0; index < count; index++)
+		shadow_frame_free((rdpShadowFrame*) ArrayList_GetItem(capture->frames, index));
+
+	ArrayList_Free(capture->frames);
+
+	if (capture->ThreadPool)
+	{
+		CloseThreadpool(capture->ThreadPool);
+		DestroyThreadpoolEnvironment(&(capture->ThreadPoolEnv));
+	}
+
+	free(capture->tiles);
+
 	DeleteCriticalSection(&(capture->lock));
 
 	free(capture);
@@ -23,6 +23,43 @@
 
 #include <winpr/crt.h>
 #include <winpr/synch.h>
+#include <winpr/pool.h>
+#include <winpr/collections.h>
+
+struct rdp_shadow_frame
+{
+	LONG refCount;
+	UINT32 generation;
+	rdpShadowSurface* surface;
+	REGION16 staleRegion;
+};
+
+#define SHADOW_CAPTURE_TILE_SIZE	16
+#define SHADOW_CAPTURE_MAX_BANDS	16
+#define SHADOW_CAPTURE_MAX_MERGE_RECTS	64
+
+typedef BOOL (*pfnShadowTileEqual)(const BYTE* pData1, int nStep1,
+		const BYTE* pData2, int nStep2, int nWidth, int nHeight);
+
+struct _SHADOW_CAPTURE_COMPARE_PARAM
+{
+	pfnShadowTileEqual TileEqual;
+
+	const BYTE* pData1;
+	int nStep1;
+	const BYTE* pData2;
+	int nStep2;
+	int nWidth;
+	int nHeight;
+
+	BYTE* tiles;
+	int firstRow;
+	int lastRow;
+	int count;
+
+	PTP_WORK work;
+};
+typedef struct _SHADOW_CAPTURE_COMPARE_PARAM SHADOW_CAPTURE_COMPARE_PARAM;
 
 struct rdp_shadow_capture
 {
@@ -32,6 +69,17 @@ struct rdp_shadow_capture
 	int height;
 
 	CRITICAL_SECTION lock;
+
+	UINT32 generation;
+	wArrayList* frames;
+
+	BYTE* tiles;
+	int maxTiles;
+
+	int numBands;
+	PTP_POOL ThreadPool;
+	TP_CALLBACK_ENVIRON ThreadPoolEnv;
+	SHADOW_CAPTURE_COMPARE_PARAM params[SHADOW_CAPTURE_MAX_BANDS];
 };
 
 #ifdef __cplusplus
@@ -40,6 +88,12 @@ extern "C" {
 
 int shadow_capture_align_clip_rect(RECTANGLE_16* rect, RECTANGLE_16* clip);
 int shadow_capture_compare(BYTE* pData1, int nStep1, int nWidth, int nHeight, BYTE* pData2, int nStep2, RECTANGLE_16* rect);
+int shadow_capture_compare_region(rdpShadowCapture* capture, BYTE* pData1, int nStep1,
+		int nWidth, int nHeight, BYTE* pData2, int nStep2, REGION16* region);
+int shadow_capture_merge_rects(const REGION16* region, UINT32 overhead, RECTANGLE_16** ppRects);
+
+rdpShadowFrame* shadow_capture_snapshot(rdpShadowCapture* capture, rdpShadowSurface* surface, REGION16* invalidRegion);
+void shadow_frame_release(rdpShadowFrame* frame);
 
 rdpShadowCapture* shadow_capture_new(rdpShadowServer* server);
 void shadow_capture_free(rdpShadowCapture* capture);
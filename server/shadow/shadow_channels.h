@@ -26,6 +26,7 @@
 
 #include "shadow_encomsp.h"
 #include "shadow_remdesk.h"
+#include "shadow_rdpgfx.h"
 
 #ifdef __cplusplus
 extern "C" {
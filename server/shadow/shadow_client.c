@@ -50,7 +50,7 @@ void shadow_client_context_new(freerdp_peer* peer, rdpShadowClient* client)
 	settings->BitmapCacheV3Enabled = TRUE;
 	settings->FrameMarkerCommandEnabled = TRUE;
 	settings->SurfaceFrameMarkerEnabled = TRUE;
-	settings->SupportGraphicsPipeline = FALSE;
+	settings->SupportGraphicsPipeline = TRUE;
 
 	settings->DrawAllowSkipAlpha = TRUE;
 	settings->DrawAllowColorSubsampling = TRUE;
@@ -58,6 +58,8 @@ void shadow_client_context_new(freerdp_peer* peer, rdpShadowClient* client)
 
 	settings->CompressionLevel = PACKET_COMPR_TYPE_RDP6;
 
+	settings->MetricsDumpInterval = server->metricsInterval * 1000;
+
 	settings->RdpSecurity = TRUE;
 	settings->TlsSecurity = TRUE;
 	settings->NlaSecurity = FALSE;
@@ -79,6 +81,8 @@ void shadow_client_context_new(freerdp_peer* peer, rdpShadowClient* client)
 
 	client->StopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
+	client->mailbox = shadow_mailbox_new();
+
 	client->encoder = shadow_encoder_new(client);
 
 	ArrayList_Add(server->clients, (void*) client);
@@ -90,6 +94,8 @@ void shadow_client_context_free(freerdp_peer* peer, rdpShadowClient* client)
 
 	ArrayList_Remove(server->clients, (void*) client);
 
+	shadow_client_rdpgfx_uninit(client);
+
 	DeleteCriticalSection(&(client->lock));
 
 	region16_uninit(&(client->invalidRegion));
@@ -98,6 +104,12 @@ void shadow_client_context_free(freerdp_peer* peer, rdpShadowClient* client)
 
 	CloseHandle(client->StopEvent);
 
+	if (client->mailbox)
+	{
+		shadow_mailbox_free(client->mailbox);
+		client->mailbox = NULL;
+	}
+
 	if (client->lobby)
 	{
 		shadow_surface_free(client->lobby);
@@ -329,7 +341,7 @@ int shadow_client_send_surface_frame_marker(rdpShadowClient* client, UINT32 acti
 	return 1;
 }
 
-int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* surface, int nXSrc, int nYSrc, int nWidth, int nHeight)
+int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* surface, REGION16* region)
 {
 	int i;
 	BOOL first;
@@ -337,8 +349,12 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 	wStream* s;
 	int nSrcStep;
 	BYTE* pSrcData;
+	int numRects;
 	int numMessages;
+	int subX, subY;
 	UINT32 frameId = 0;
+	UINT64 begin;
+	RECTANGLE_16* rects;
 	rdpUpdate* update;
 	rdpContext* context;
 	rdpSettings* settings;
@@ -356,18 +372,30 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 	pSrcData = surface->data;
 	nSrcStep = surface->scanline;
 
+	/**
+	 * RemoteFX encodes whole tiles whatever the rectangles are, so only merge
+	 * when it saves area. NSCodec sends one command per rectangle.
+	 */
+
+	numRects = shadow_capture_merge_rects(region, settings->RemoteFxCodec ? 0 :
+			SHADOW_ENCODER_RECT_OVERHEAD, &rects);
+
+	if (numRects < 1)
+		return (numRects < 0) ? -1 : 1;
+
 	if (server->shareSubRect)
 	{
-		int subX, subY;
-		int subWidth, subHeight;
-
 		subX = server->subRect.left;
 		subY = server->subRect.top;
-		subWidth = server->subRect.right - server->subRect.left;
-		subHeight = server->subRect.bottom - server->subRect.top;
 
-		nXSrc -= subX;
-		nYSrc -= subY;
+		for (i = 0; i < numRects; i++)
+		{
+			rects[i].left -= subX;
+			rects[i].top -= subY;
+			rects[i].right -= subX;
+			rects[i].bottom -= subY;
+		}
+
 		pSrcData = &pSrcData[(subY * nSrcStep) + (subX * 4)];
 	}
 
@@ -376,21 +404,57 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 
 	if (settings->RemoteFxCodec)
 	{
-		RFX_RECT rect;
-		RFX_MESSAGE* messages;
+		RFX_RECT* rfxRects;
+		RFX_MESSAGE* messages = NULL;
+		SHADOW_ENCODED_UPDATE* shared = NULL;
 
 		shadow_encoder_prepare(encoder, FREERDP_CODEC_REMOTEFX);
 
 		s = encoder->bs;
 
-		rect.x = nXSrc;
-		rect.y = nYSrc;
-		rect.width = nWidth;
-		rect.height = nHeight;
+		if (!client->inLobby)
+		{
+			shared = shadow_encoder_cache_encode(server->encoderCache, client, FREERDP_CODEC_REMOTEFX,
+					surface, pSrcData, nSrcStep, rects, numRects);
+		}
 
-		messages = rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
-				surface->width, surface->height, nSrcStep, &numMessages,
-				settings->MultifragMaxRequestSize);
+		if (shared)
+		{
+			messages = shared->messages;
+			numMessages = shared->numMessages;
+		}
+		else
+		{
+			rfxRects = (RFX_RECT*) malloc(numRects * sizeof(RFX_RECT));
+
+			if (rfxRects)
+			{
+				for (i = 0; i < numRects; i++)
+				{
+					rfxRects[i].x = rects[i].left;
+					rfxRects[i].y = rects[i].top;
+					rfxRects[i].width = rects[i].right - rects[i].left;
+					rfxRects[i].height = rects[i].bottom - rects[i].top;
+				}
+
+				begin = metrics_get_timestamp();
+
+				messages = rfx_encode_messages(encoder->rfx, rfxRects, numRects, pSrcData,
+						surface->width, surface->height, nSrcStep, &numMessages,
+						settings->MultifragMaxRequestSize);
+
+				metrics_codec_encode(context->metrics, METRICS_CODEC_RFX,
+						metrics_get_timestamp() - begin);
+
+				free(rfxRects);
+			}
+
+			if (!messages)
+			{
+				free(rects);
+				return -1;
+			}
+		}
 
 		cmd.codecID = settings->RemoteFxCodecId;
 
@@ -407,7 +471,9 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 		{
 			Stream_SetPosition(s, 0);
 			rfx_write_message(encoder->rfx, s, &messages[i]);
-			rfx_message_free(encoder->rfx, &messages[i]);
+
+			if (!shared)
+				rfx_message_free(encoder->rfx, &messages[i]);
 
 			cmd.bitmapDataLength = Stream_GetPosition(s);
 			cmd.bitmapData = Stream_Buffer(s);
@@ -421,40 +487,84 @@ int shadow_client_send_surface_bits(rdpShadowClient* client, rdpShadowSurface* s
 				IFCALL(update->SurfaceFrameBits, update->context, &cmd, first, last, frameId);
 		}
 
-		free(messages);
+		if (shared)
+			shadow_encoded_update_release(shared);
+		else
+			free(messages);
 	}
 	else if (settings->NSCodec)
 	{
+		int nXSrc, nYSrc;
+		int nWidth, nHeight;
+		SHADOW_ENCODED_UPDATE* shared;
+
 		shadow_encoder_prepare(encoder, FREERDP_CODEC_NSCODEC);
 
-		s = encoder->bs;
-		Stream_SetPosition(s, 0);
+		for (i = 0; i < numRects; i++)
+		{
+			nXSrc = rects[i].left;
+			nYSrc = rects[i].top;
+			nWidth = rects[i].right - rects[i].left;
+			nHeight = rects[i].bottom - rects[i].top;
 
-		pSrcData = &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)];
+			shared = NULL;
 
-		nsc_compose_message(encoder->nsc, s, pSrcData, nWidth, nHeight, nSrcStep);
+			if (!client->inLobby)
+			{
+				shared = shadow_encoder_cache_encode(server->encoderCache, client, FREERDP_CODEC_NSCODEC,
+						surface, pSrcData, nSrcStep, &rects[i], 1);
+			}
 
-		cmd.bpp = 32;
-		cmd.codecID = settings->NSCodecId;
-		cmd.destLeft = nXSrc;
-		cmd.destTop = nYSrc;
-		cmd.destRight = cmd.destLeft + nWidth;
-		cmd.destBottom = cmd.destTop + nHeight;
-		cmd.width = nWidth;
-		cmd.height = nHeight;
-
-		cmd.bitmapDataLength = Stream_GetPosition(s);
-		cmd.bitmapData = Stream_Buffer(s);
-
-		first = TRUE;
-		last = TRUE;
-
-		if (!encoder->frameAck)
-			IFCALL(update->SurfaceBits, update->context, &cmd);
-		else
-			IFCALL(update->SurfaceFrameBits, update->context, &cmd, first, last, frameId);
+			if (shared)
+			{
+				s = shared->bs;
+			}
+			else
+			{
+				s = encoder->bs;
+				Stream_SetPosition(s, 0);
+
+				begin = metrics_get_timestamp();
+
+				if (!nsc_compose_message(encoder->nsc, s, &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)],
+						nWidth, nHeight, nSrcStep))
+				{
+					WLog_ERR(TAG, "nsc_compose_message failed");
+					free(rects);
+					return -1;
+				}
+
+				metrics_codec_encode(context->metrics, METRICS_CODEC_NSC,
+						metrics_get_timestamp() - begin);
+			}
+
+			cmd.bpp = 32;
+			cmd.codecID = settings->NSCodecId;
+			cmd.destLeft = nXSrc;
+			cmd.destTop = nYSrc;
+			cmd.destRight = cmd.destLeft + nWidth;
+			cmd.destBottom = cmd.destTop + nHeight;
+			cmd.width = nWidth;
+			cmd.height = nHeight;
+
+			cmd.bitmapDataLength = Stream_GetPosition(s);
+			cmd.bitmapData = Stream_Buffer(s);
+
+			first = (i == 0) ? TRUE : FALSE;
+			last = ((i + 1) == numRects) ? TRUE : FALSE;
+
+			if (!encoder->frameAck)
+				IFCALL(update->SurfaceBits, update->context, &cmd);
+			else
+				IFCALL(update->SurfaceFrameBits, update->context, &cmd, first, last, frameId);
+
+			if (shared)
+				shadow_encoded_update_release(shared);
+		}
 	}
 
+	free(rects);
+
 	return 1;
 }
 
@@ -467,6 +577,7 @@ int shadow_client_send_bitmap_update(rdpShadowClient* client, rdpShadowSurface*
 	int nSrcStep;
 	BYTE* pSrcData;
 	UINT32 DstSize;
+	UINT64 begin;
 	UINT32 SrcFormat;
 	BITMAP_DATA* bitmap;
 	rdpUpdate* update;
@@ -583,9 +694,14 @@ int shadow_client_send_bitmap_update(rdpShadowClient* client, rdpShadowSurface*
 				buffer = encoder->grid[k];
 				data = &pSrcData[(bitmap->destTop * nSrcStep) + (bitmap->destLeft * 4)];
 
+				begin = metrics_get_timestamp();
+
 				buffer = freerdp_bitmap_compress_planar(encoder->planar, data, SrcFormat,
 						bitmap->width, bitmap->height, nSrcStep, buffer, &dstSize);
 
+				metrics_codec_encode(context->metrics, METRICS_CODEC_PLANAR,
+						metrics_get_timestamp() - begin);
+
 				bitmap->bitmapDataStream = buffer;
 				bitmap->bitmapLength = dstSize;
 				bitmap->bitsPerPixel = 32;
@@ -654,35 +770,269 @@ int shadow_client_send_bitmap_update(rdpShadowClient* client, rdpShadowSurface*
 	return 1;
 }
 
-int shadow_client_send_surface_update(rdpShadowClient* client)
+/**
+ * Graphics pipeline clients get ClearCodec when it was asked for or when the
+ * client is too old for the progressive codec. Progressive frames carry the
+ * first quality pass, the remaining passes follow as separate frames so the
+ * client shows a coarse image first and refines it as they arrive.
+ */
+
+int shadow_client_send_surface_gfx(rdpShadowClient* client, rdpShadowSurface* surface, REGION16* region)
 {
-	int status = -1;
+	int i;
+	int status = 1;
+	int nSrcStep;
+	BYTE* pSrcData;
+	int numRects;
+	int subX, subY;
 	int nXSrc, nYSrc;
 	int nWidth, nHeight;
+	int frameId;
+	UINT64 begin;
+	BOOL progressive;
+	UINT32 DstSize;
+	BYTE* pDstData = NULL;
+	RECTANGLE_16* rects;
+	rdpContext* context;
+	rdpSettings* settings;
+	rdpShadowServer* server;
+	rdpShadowEncoder* encoder;
+	RdpgfxServerContext* rdpgfx;
+	RDPGFX_SURFACE_COMMAND cmd;
+	RDPGFX_START_FRAME_PDU startFrame;
+	RDPGFX_END_FRAME_PDU endFrame;
+
+	context = (rdpContext*) client;
+	settings = context->settings;
+
+	server = client->server;
+	encoder = client->encoder;
+	rdpgfx = client->rdpgfx;
+
+	pSrcData = surface->data;
+	nSrcStep = surface->scanline;
+
+	progressive = (!server->clearCodec && (client->gfxCapsVersion >= RDPGFX_CAPVERSION_81)) ? TRUE : FALSE;
+
+	if (shadow_encoder_prepare(encoder, progressive ? FREERDP_CODEC_PROGRESSIVE : FREERDP_CODEC_CLEARCODEC) < 0)
+		return -1;
+
+	/* the progressive codec works on whole tiles, like RemoteFX */
+
+	numRects = shadow_capture_merge_rects(region, progressive ? 0 :
+			SHADOW_ENCODER_RECT_OVERHEAD, &rects);
+
+	if (numRects < 1)
+		return (numRects < 0) ? -1 : 1;
+
+	if (server->shareSubRect)
+	{
+		subX = server->subRect.left;
+		subY = server->subRect.top;
+
+		for (i = 0; i < numRects; i++)
+		{
+			rects[i].left -= subX;
+			rects[i].top -= subY;
+			rects[i].right -= subX;
+			rects[i].bottom -= subY;
+		}
+
+		pSrcData = &pSrcData[(subY * nSrcStep) + (subX * 4)];
+	}
+
+	ZeroMemory(&cmd, sizeof(RDPGFX_SURFACE_COMMAND));
+	cmd.surfaceId = SHADOW_ENCODER_GFX_SURFACE_ID;
+	cmd.format = PIXEL_FORMAT_XRGB_8888;
+
+	frameId = shadow_encoder_create_frame_id(encoder);
+
+	if (frameId < 0)
+	{
+		free(rects);
+		return -1;
+	}
+
+	startFrame.frameId = (UINT32) frameId;
+	startFrame.timestamp = 0;
+	rdpgfx->StartFrame(rdpgfx, &startFrame);
+
+	if (progressive)
+	{
+		begin = metrics_get_timestamp();
+
+		status = progressive_compress(encoder->progressive, pSrcData, PIXEL_FORMAT_XRGB32, nSrcStep,
+				settings->DesktopWidth, settings->DesktopHeight, rects, numRects,
+				SHADOW_ENCODER_GFX_SURFACE_ID, &pDstData, &DstSize);
+
+		metrics_codec_encode(context->metrics, METRICS_CODEC_PROGRESSIVE,
+				metrics_get_timestamp() - begin);
+
+		if (status > 0)
+		{
+			cmd.codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+			cmd.length = DstSize;
+			cmd.data = pDstData;
+
+			status = rdpgfx->SurfaceCommand(rdpgfx, &cmd);
+		}
+	}
+	else
+	{
+		for (i = 0; (status >= 0) && (i < numRects); i++)
+		{
+			nXSrc = rects[i].left;
+			nYSrc = rects[i].top;
+			nWidth = rects[i].right - rects[i].left;
+			nHeight = rects[i].bottom - rects[i].top;
+
+			begin = metrics_get_timestamp();
+
+			status = clear_compress(encoder->clear, &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)],
+					PIXEL_FORMAT_XRGB32, nSrcStep, nWidth, nHeight, &pDstData, &DstSize);
+
+			metrics_codec_encode(context->metrics, METRICS_CODEC_CLEAR,
+					metrics_get_timestamp() - begin);
+
+			if (status < 0)
+				break;
+
+			cmd.codecId = RDPGFX_CODECID_CLEARCODEC;
+			cmd.left = nXSrc;
+			cmd.top = nYSrc;
+			cmd.right = rects[i].right;
+			cmd.bottom = rects[i].bottom;
+			cmd.width = nWidth;
+			cmd.height = nHeight;
+			cmd.length = DstSize;
+			cmd.data = pDstData;
+
+			status = rdpgfx->SurfaceCommand(rdpgfx, &cmd);
+		}
+	}
+
+	endFrame.frameId = (UINT32) frameId;
+	rdpgfx->EndFrame(rdpgfx, &endFrame);
+	metrics_frame_sent(client->context.metrics, endFrame.frameId);
+
+	free(rects);
+
+	if (status < 0)
+		return -1;
+
+	if (progressive)
+		client->gfxUpgrade = TRUE;
+
+	return 1;
+}
+
+/**
+ * Progressive refinement passes are paced by the client: at most one pass is
+ * sent per encoder tick, and only once every outstanding frame has been
+ * acknowledged, so refinement never queues up behind the client's decoder.
+ */
+
+int shadow_client_send_surface_gfx_upgrade(rdpShadowClient* client)
+{
+	int status;
+	int frameId;
+	UINT64 begin;
+	UINT32 DstSize;
+	BYTE* pDstData = NULL;
+	rdpShadowEncoder* encoder;
+	RdpgfxServerContext* rdpgfx;
+	RDPGFX_SURFACE_COMMAND cmd;
+	RDPGFX_START_FRAME_PDU startFrame;
+	RDPGFX_END_FRAME_PDU endFrame;
+
+	encoder = client->encoder;
+	rdpgfx = client->rdpgfx;
+
+	if (!client->gfxUpgrade || !encoder->progressive)
+		return 1;
+
+	if (ListDictionary_Count(encoder->frameList) > 0)
+		return 1;
+
+	begin = metrics_get_timestamp();
+
+	status = progressive_compress_upgrade(encoder->progressive,
+			SHADOW_ENCODER_GFX_SURFACE_ID, &pDstData, &DstSize);
+
+	metrics_codec_encode(client->context.metrics, METRICS_CODEC_PROGRESSIVE,
+			metrics_get_timestamp() - begin);
+
+	if (status <= 0)
+	{
+		client->gfxUpgrade = FALSE;
+		return (status < 0) ? -1 : 1;
+	}
+
+	frameId = shadow_encoder_create_frame_id(encoder);
+
+	if (frameId < 0)
+		return -1;
+
+	startFrame.frameId = (UINT32) frameId;
+	startFrame.timestamp = 0;
+	rdpgfx->StartFrame(rdpgfx, &startFrame);
+
+	ZeroMemory(&cmd, sizeof(RDPGFX_SURFACE_COMMAND));
+	cmd.surfaceId = SHADOW_ENCODER_GFX_SURFACE_ID;
+	cmd.format = PIXEL_FORMAT_XRGB_8888;
+	cmd.codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+	cmd.length = DstSize;
+	cmd.data = pDstData;
+
+	status = rdpgfx->SurfaceCommand(rdpgfx, &cmd);
+
+	endFrame.frameId = (UINT32) frameId;
+	rdpgfx->EndFrame(rdpgfx, &endFrame);
+	metrics_frame_sent(client->context.metrics, endFrame.frameId);
+
+	return (status < 0) ? -1 : 1;
+}
+
+int shadow_client_send_surface_update(rdpShadowClient* client)
+{
+	BOOL gfx;
+	int status = -1;
 	rdpContext* context;
 	rdpSettings* settings;
 	rdpShadowServer* server;
+	rdpShadowFrame* frame;
 	rdpShadowSurface* surface;
 	rdpShadowEncoder* encoder;
 	REGION16 invalidRegion;
 	RECTANGLE_16 surfaceRect;
-	const RECTANGLE_16* extents;
 
 	context = (rdpContext*) client;
 	settings = context->settings;
 	server = client->server;
 	encoder = client->encoder;
 
-	surface = client->inLobby ? client->lobby : server->surface;
-
 	EnterCriticalSection(&(client->lock));
 
+	/* coalesce every frame published since the last update into the latest one */
+	frame = shadow_mailbox_take(client->mailbox, &(client->invalidRegion));
+
+	if (!client->activated || (!frame && !client->inLobby))
+	{
+		LeaveCriticalSection(&(client->lock));
+		shadow_frame_release(frame);
+		return 1;
+	}
+
 	region16_init(&invalidRegion);
 	region16_copy(&invalidRegion, &(client->invalidRegion));
 	region16_clear(&(client->invalidRegion));
 
+	gfx = client->gfxReady;
+
 	LeaveCriticalSection(&(client->lock));
 
+	surface = client->inLobby ? client->lobby : frame->surface;
+
 	surfaceRect.left = 0;
 	surfaceRect.top = 0;
 	surfaceRect.right = surface->width;
@@ -698,51 +1048,42 @@ int shadow_client_send_surface_update(rdpShadowClient* client)
 	if (region16_is_empty(&invalidRegion))
 	{
 		region16_uninit(&invalidRegion);
+		shadow_frame_release(frame);
 		return 1;
 	}
 
-	extents = region16_extents(&invalidRegion);
-
-	nXSrc = extents->left - 0;
-	nYSrc = extents->top - 0;
-	nWidth = extents->right - extents->left;
-	nHeight = extents->bottom - extents->top;
-
-	//WLog_INFO(TAG, "shadow_client_send_surface_update: x: %d y: %d width: %d height: %d right: %d bottom: %d",
-	//	nXSrc, nYSrc, nWidth, nHeight, nXSrc + nWidth, nYSrc + nHeight);
-
-	if (settings->RemoteFxCodec || settings->NSCodec)
+	if (gfx)
 	{
-		status = shadow_client_send_surface_bits(client, surface, nXSrc, nYSrc, nWidth, nHeight);
+		status = shadow_client_send_surface_gfx(client, surface, &invalidRegion);
 	}
-	else
+	else if (settings->RemoteFxCodec || settings->NSCodec)
 	{
-		status = shadow_client_send_bitmap_update(client, surface, nXSrc, nYSrc, nWidth, nHeight);
+		status = shadow_client_send_surface_bits(client, surface, &invalidRegion);
 	}
+	else
+	{
+		int index;
+		int numRects;
+		RECTANGLE_16* rects;
 
-	region16_uninit(&invalidRegion);
-
-	return status;
-}
-
-int shadow_client_surface_update(rdpShadowClient* client, REGION16* region)
-{
-	int index;
-	int numRects = 0;
-	const RECTANGLE_16* rects;
+		numRects = shadow_capture_merge_rects(&invalidRegion, SHADOW_ENCODER_RECT_OVERHEAD, &rects);
 
-	EnterCriticalSection(&(client->lock));
+		status = (numRects < 0) ? -1 : 1;
 
-	rects = region16_rects(region, &numRects);
+		for (index = 0; (status > 0) && (index < numRects); index++)
+		{
+			status = shadow_client_send_bitmap_update(client, surface, rects[index].left, rects[index].top,
+					rects[index].right - rects[index].left, rects[index].bottom - rects[index].top);
+		}
 
-	for (index = 0; index < numRects; index++)
-	{
-		region16_union_rect(&(client->invalidRegion), &(client->invalidRegion), &rects[index]);
+		free(rects);
 	}
 
-	LeaveCriticalSection(&(client->lock));
+	region16_uninit(&invalidRegion);
 
-	return 1;
+	shadow_frame_release(frame);
+
+	return status;
 }
 
 int shadow_client_convert_alpha_pointer_data(BYTE* pixels, BOOL premultiplied,
@@ -885,12 +1226,19 @@ int shadow_client_subsystem_process_message(rdpShadowClient* client, wMessage* m
 	return 1;
 }
 
+#define SHADOW_CLIENT_STOP_EVENT	0
+#define SHADOW_CLIENT_UPDATE_EVENT	1
+#define SHADOW_CLIENT_PEER_EVENT	2
+#define SHADOW_CLIENT_CHANNEL_EVENT	3
+#define SHADOW_CLIENT_MESSAGE_EVENT	4
+
 void* shadow_client_thread(rdpShadowClient* client)
 {
 	DWORD status;
-	DWORD nCount;
+	UINT64 signaled;
+	DWORD dwTimeout;
 	wMessage message;
-	HANDLE events[32];
+	wWaitSet* waitSet;
 	HANDLE StopEvent;
 	HANDLE ClientEvent;
 	HANDLE ChannelEvent;
@@ -926,55 +1274,55 @@ void* shadow_client_thread(rdpShadowClient* client)
 	peer->update->SurfaceFrameAcknowledge = (pSurfaceFrameAcknowledge) shadow_client_surface_frame_acknowledge;
 
 	StopEvent = client->StopEvent;
-	UpdateEvent = subsystem->updateEvent;
+	UpdateEvent = client->mailbox->event;
 	ClientEvent = peer->GetEventHandle(peer);
 	ChannelEvent = WTSVirtualChannelManagerGetEventHandle(client->vcm);
 
+	/* the handles do not change for the lifetime of the client */
+
+	waitSet = WaitSet_New();
+
+	if (!waitSet)
+		goto out;
+
+	if ((WaitSet_Add(waitSet, StopEvent) != SHADOW_CLIENT_STOP_EVENT) ||
+		(WaitSet_Add(waitSet, UpdateEvent) != SHADOW_CLIENT_UPDATE_EVENT) ||
+		(WaitSet_Add(waitSet, ClientEvent) != SHADOW_CLIENT_PEER_EVENT) ||
+		(WaitSet_Add(waitSet, ChannelEvent) != SHADOW_CLIENT_CHANNEL_EVENT) ||
+		(WaitSet_Add(waitSet, MessageQueue_Event(MsgPipe->Out)) != SHADOW_CLIENT_MESSAGE_EVENT))
+	{
+		WLog_ERR(TAG, "Failed to register the client event handles");
+		goto out;
+	}
+
 	while (1)
 	{
-		nCount = 0;
-		events[nCount++] = StopEvent;
-		events[nCount++] = UpdateEvent;
-		events[nCount++] = ClientEvent;
-		events[nCount++] = ChannelEvent;
-		events[nCount++] = MessageQueue_Event(MsgPipe->Out);
+		/* while progressive refinement is pending, wake up once per encoder tick */
+		dwTimeout = client->gfxUpgrade ? (DWORD) (1000 / encoder->fps) : INFINITE;
 
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+		status = WaitSet_Wait(waitSet, dwTimeout, &signaled);
 
-		if (WaitForSingleObject(StopEvent, 0) == WAIT_OBJECT_0)
+		if (status == WAIT_FAILED)
 		{
-			if (WaitForSingleObject(UpdateEvent, 0) == WAIT_OBJECT_0)
-			{
-				EnterSynchronizationBarrier(&(subsystem->barrier), 0);
-			}
-
+			WLog_ERR(TAG, "WaitSet_Wait failed");
 			break;
 		}
 
-		if (WaitForSingleObject(UpdateEvent, 0) == WAIT_OBJECT_0)
+		if (signaled & (1 << SHADOW_CLIENT_STOP_EVENT))
 		{
-			if (client->activated)
-			{
-				int index;
-				int numRects = 0;
-				const RECTANGLE_16* rects;
-
-				rects = region16_rects(&(subsystem->invalidRegion), &numRects);
-
-				for (index = 0; index < numRects; index++)
-				{
-					region16_union_rect(&(client->invalidRegion), &(client->invalidRegion), &rects[index]);
-				}
-
-				shadow_client_send_surface_update(client);
-			}
-
-			EnterSynchronizationBarrier(&(subsystem->barrier), 0);
+			break;
+		}
 
-			while (WaitForSingleObject(UpdateEvent, 0) == WAIT_OBJECT_0);
+		if (signaled & (1 << SHADOW_CLIENT_UPDATE_EVENT))
+		{
+			shadow_client_send_surface_update(client);
+		}
+		else if (status == WAIT_TIMEOUT)
+		{
+			shadow_client_send_surface_gfx_upgrade(client);
 		}
 
-		if (WaitForSingleObject(ClientEvent, 0) == WAIT_OBJECT_0)
+		if (signaled & (1 << SHADOW_CLIENT_PEER_EVENT))
 		{
 			if (!peer->CheckFileDescriptor(peer))
 			{
@@ -983,7 +1331,7 @@ void* shadow_client_thread(rdpShadowClient* client)
 			}
 		}
 
-		if (WaitForSingleObject(ChannelEvent, 0) == WAIT_OBJECT_0)
+		if (signaled & (1 << SHADOW_CLIENT_CHANNEL_EVENT))
 		{
 			if (!WTSVirtualChannelManagerCheckFileDescriptor(client->vcm))
 			{
@@ -992,7 +1340,7 @@ void* shadow_client_thread(rdpShadowClient* client)
 			}
 		}
 
-		if (WaitForSingleObject(MessageQueue_Event(MsgPipe->Out), 0) == WAIT_OBJECT_0)
+		if (signaled & (1 << SHADOW_CLIENT_MESSAGE_EVENT))
 		{
 			if (MessageQueue_Peek(MsgPipe->Out, &message, TRUE))
 			{
@@ -1004,6 +1352,9 @@ void* shadow_client_thread(rdpShadowClient* client)
 		}
 	}
 
+out:
+	WaitSet_Free(waitSet);
+
 	peer->Disconnect(peer);
 	
 	freerdp_peer_context_free(peer);
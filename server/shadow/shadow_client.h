@@ -25,9 +25,11 @@
 extern "C" {
 #endif
 
-int shadow_client_surface_update(rdpShadowClient* client, REGION16* region);
 void shadow_client_accepted(freerdp_listener* instance, freerdp_peer* client);
 
+void shadow_client_refresh_rect(rdpShadowClient* client, BYTE count, RECTANGLE_16* areas);
+void shadow_client_surface_frame_acknowledge(rdpShadowClient* client, UINT32 frameId);
+
 #ifdef __cplusplus
 }
 #endif
@@ -123,7 +123,7 @@ int shadow_encoder_init_rfx(rdpShadowEncoder* encoder)
 	if (!encoder->rfx)
 		return -1;
 
-	encoder->rfx->mode = RLGR3;
+	encoder->rfx->mode = settings->RemoteFxRlgrMode;
 	encoder->rfx->width = encoder->width;
 	encoder->rfx->height = encoder->height;
 
@@ -212,6 +212,60 @@ int shadow_encoder_init_interleaved(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+int shadow_encoder_init_clear(rdpShadowEncoder* encoder)
+{
+	if (!encoder->clear)
+		encoder->clear = clear_context_new(TRUE);
+
+	if (!encoder->clear)
+		return -1;
+
+	if (!encoder->frameList)
+	{
+		encoder->fps = 16;
+		encoder->maxFps = 32;
+		encoder->frameId = 0;
+		encoder->frameList = ListDictionary_New(TRUE);
+		encoder->frameAck = TRUE; /* graphics pipeline frames are always acknowledged */
+	}
+
+	encoder->codecs |= FREERDP_CODEC_CLEARCODEC;
+
+	return 1;
+}
+
+int shadow_encoder_init_progressive(rdpShadowEncoder* encoder)
+{
+	if (!encoder->progressive)
+	{
+		encoder->progressive = progressive_context_new(TRUE);
+
+		if (!encoder->progressive)
+			return -1;
+
+		if (progressive_create_surface_context(encoder->progressive,
+				SHADOW_ENCODER_GFX_SURFACE_ID, encoder->width, encoder->height) < 0)
+		{
+			progressive_context_free(encoder->progressive);
+			encoder->progressive = NULL;
+			return -1;
+		}
+	}
+
+	if (!encoder->frameList)
+	{
+		encoder->fps = 16;
+		encoder->maxFps = 32;
+		encoder->frameId = 0;
+		encoder->frameList = ListDictionary_New(TRUE);
+		encoder->frameAck = TRUE; /* graphics pipeline frames are always acknowledged */
+	}
+
+	encoder->codecs |= FREERDP_CODEC_PROGRESSIVE;
+
+	return 1;
+}
+
 int shadow_encoder_init(rdpShadowEncoder* encoder)
 {
 	encoder->maxTileWidth = 64;
@@ -292,6 +346,44 @@ int shadow_encoder_uninit_interleaved(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+int shadow_encoder_uninit_clear(rdpShadowEncoder* encoder)
+{
+	if (encoder->clear)
+	{
+		clear_context_free(encoder->clear);
+		encoder->clear = NULL;
+	}
+
+	if (encoder->frameList)
+	{
+		ListDictionary_Free(encoder->frameList);
+		encoder->frameList = NULL;
+	}
+
+	encoder->codecs &= ~FREERDP_CODEC_CLEARCODEC;
+
+	return 1;
+}
+
+int shadow_encoder_uninit_progressive(rdpShadowEncoder* encoder)
+{
+	if (encoder->progressive)
+	{
+		progressive_context_free(encoder->progressive);
+		encoder->progressive = NULL;
+	}
+
+	if (encoder->frameList)
+	{
+		ListDictionary_Free(encoder->frameList);
+		encoder->frameList = NULL;
+	}
+
+	encoder->codecs &= ~FREERDP_CODEC_PROGRESSIVE;
+
+	return 1;
+}
+
 int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 {
 	shadow_encoder_uninit_grid(encoder);
@@ -322,6 +414,16 @@ int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 		shadow_encoder_uninit_interleaved(encoder);
 	}
 
+	if (encoder->codecs & FREERDP_CODEC_CLEARCODEC)
+	{
+		shadow_encoder_uninit_clear(encoder);
+	}
+
+	if (encoder->codecs & FREERDP_CODEC_PROGRESSIVE)
+	{
+		shadow_encoder_uninit_progressive(encoder);
+	}
+
 	return 1;
 }
 
@@ -384,6 +486,22 @@ int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs)
 			return -1;
 	}
 
+	if ((codecs & FREERDP_CODEC_CLEARCODEC) && !(encoder->codecs & FREERDP_CODEC_CLEARCODEC))
+	{
+		status = shadow_encoder_init_clear(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
+	if ((codecs & FREERDP_CODEC_PROGRESSIVE) && !(encoder->codecs & FREERDP_CODEC_PROGRESSIVE))
+	{
+		status = shadow_encoder_init_progressive(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
 	return 1;
 }
 
@@ -27,6 +27,19 @@
 
 #include <freerdp/server/shadow.h>
 
+/**
+ * Fixed cost of sending a rectangle as a separate update, in pixels.
+ * Rectangles are merged when the area added by merging is smaller.
+ */
+
+#define SHADOW_ENCODER_RECT_OVERHEAD	4096
+
+/**
+ * Graphics pipeline clients get a single surface mapped to the desktop.
+ */
+
+#define SHADOW_ENCODER_GFX_SURFACE_ID	0
+
 struct rdp_shadow_encoder
 {
 	rdpShadowClient* client;
@@ -47,6 +60,8 @@ struct rdp_shadow_encoder
 
 	RFX_CONTEXT* rfx;
 	NSC_CONTEXT* nsc;
+	CLEAR_CONTEXT* clear;
+	PROGRESSIVE_CONTEXT* progressive;
 	BITMAP_PLANAR_CONTEXT* planar;
 	BITMAP_INTERLEAVED_CONTEXT* interleaved;
 
@@ -0,0 +1,458 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/log.h>
+
+#include "shadow.h"
+
+#include "shadow_encoder_cache.h"
+
+#define TAG SERVER_TAG("shadow")
+
+/**
+ * Number of distinct updates kept per surface generation. RemoteFX clients
+ * normally encode the same rectangles for a given generation, NSCodec clients
+ * encode one update per rectangle. The extra slots cover clients with pending
+ * refresh requests.
+ */
+
+#define SHADOW_ENCODER_CACHE_MAX_UPDATES	64
+
+static void shadow_encoder_cache_get_profile(rdpShadowClient* client, UINT32 codecId, SHADOW_ENCODER_PROFILE* profile)
+{
+	rdpSettings* settings = ((rdpContext*) client)->settings;
+
+	ZeroMemory(profile, sizeof(SHADOW_ENCODER_PROFILE));
+
+	profile->codecId = codecId;
+
+	if (codecId == FREERDP_CODEC_REMOTEFX)
+	{
+		profile->rfxMode = settings->RemoteFxRlgrMode;
+		profile->maxRequestSize = settings->MultifragMaxRequestSize;
+	}
+	else if (codecId == FREERDP_CODEC_NSCODEC)
+	{
+		/* NSCodec messages are never fragmented */
+
+		profile->nscColorLossLevel = settings->NSCodecColorLossLevel;
+		profile->nscChromaSubsamplingLevel = settings->NSCodecAllowSubsampling ? 1 : 0;
+		profile->nscDynamicColorFidelity = settings->NSCodecAllowDynamicColorFidelity;
+	}
+}
+
+static void shadow_shared_encoder_free(SHADOW_SHARED_ENCODER* encoder)
+{
+	int index;
+	int count;
+	SHADOW_ENCODED_UPDATE* update;
+
+	if (!encoder)
+		return;
+
+	if (encoder->updates)
+	{
+		count = ArrayList_Count(encoder->updates);
+
+		for (index = 0; index < count; index++)
+		{
+			update = (SHADOW_ENCODED_UPDATE*) ArrayList_GetItem(encoder->updates, index);
+			shadow_encoded_update_release(update);
+		}
+
+		ArrayList_Free(encoder->updates);
+	}
+
+	if (encoder->rfx)
+		rfx_context_free(encoder->rfx);
+
+	if (encoder->nsc)
+		nsc_context_free(encoder->nsc);
+
+	DeleteCriticalSection(&(encoder->lock));
+
+	free(encoder);
+}
+
+static SHADOW_SHARED_ENCODER* shadow_shared_encoder_new(rdpShadowEncoderCache* cache, SHADOW_ENCODER_PROFILE* profile)
+{
+	SHADOW_SHARED_ENCODER* encoder;
+
+	encoder = (SHADOW_SHARED_ENCODER*) calloc(1, sizeof(SHADOW_SHARED_ENCODER));
+
+	if (!encoder)
+		return NULL;
+
+	CopyMemory(&(encoder->profile), profile, sizeof(SHADOW_ENCODER_PROFILE));
+
+	if (!InitializeCriticalSectionAndSpinCount(&(encoder->lock), 4000))
+	{
+		free(encoder);
+		return NULL;
+	}
+
+	encoder->updates = ArrayList_New(FALSE);
+
+	if (!encoder->updates)
+		goto fail;
+
+	if (profile->codecId == FREERDP_CODEC_REMOTEFX)
+	{
+		encoder->rfx = rfx_context_new(TRUE);
+
+		if (!encoder->rfx)
+			goto fail;
+
+		encoder->rfx->mode = profile->rfxMode;
+		encoder->rfx->width = cache->width;
+		encoder->rfx->height = cache->height;
+
+		rfx_context_set_pixel_format(encoder->rfx, RDP_PIXEL_FORMAT_B8G8R8A8);
+	}
+	else if (profile->codecId == FREERDP_CODEC_NSCODEC)
+	{
+		encoder->nsc = nsc_context_new();
+
+		if (!encoder->nsc)
+			goto fail;
+
+		nsc_context_set_pixel_format(encoder->nsc, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+		encoder->nsc->ColorLossLevel = profile->nscColorLossLevel;
+		encoder->nsc->ChromaSubsamplingLevel = profile->nscChromaSubsamplingLevel;
+		encoder->nsc->DynamicColorFidelity = profile->nscDynamicColorFidelity;
+	}
+	else
+	{
+		goto fail;
+	}
+
+	return encoder;
+
+fail:
+	shadow_shared_encoder_free(encoder);
+	return NULL;
+}
+
+static SHADOW_SHARED_ENCODER* shadow_encoder_cache_get_encoder(rdpShadowEncoderCache* cache, SHADOW_ENCODER_PROFILE* profile)
+{
+	int index;
+	int count;
+	SHADOW_SHARED_ENCODER* encoder = NULL;
+
+	EnterCriticalSection(&(cache->lock));
+
+	count = ArrayList_Count(cache->encoders);
+
+	for (index = 0; index < count; index++)
+	{
+		encoder = (SHADOW_SHARED_ENCODER*) ArrayList_GetItem(cache->encoders, index);
+
+		if (memcmp(&(encoder->profile), profile, sizeof(SHADOW_ENCODER_PROFILE)) == 0)
+			break;
+
+		encoder = NULL;
+	}
+
+	if (!encoder)
+	{
+		encoder = shadow_shared_encoder_new(cache, profile);
+
+		if (encoder)
+			ArrayList_Add(cache->encoders, (void*) encoder);
+	}
+
+	LeaveCriticalSection(&(cache->lock));
+
+	return encoder;
+}
+
+static SHADOW_ENCODED_UPDATE* shadow_shared_encoder_encode(SHADOW_SHARED_ENCODER* encoder, rdpMetrics* metrics,
+		rdpShadowSurface* surface, BYTE* pSrcData, int nSrcStep, const RECTANGLE_16* rects, int numRects)
+{
+	int index;
+	int nWidth, nHeight;
+	UINT64 begin;
+	SHADOW_ENCODED_UPDATE* update;
+
+	update = (SHADOW_ENCODED_UPDATE*) calloc(1, sizeof(SHADOW_ENCODED_UPDATE));
+
+	if (!update)
+		return NULL;
+
+	update->encoder = encoder;
+	update->generation = surface->generation;
+
+	update->numRects = numRects;
+	update->rects = (RECTANGLE_16*) malloc(numRects * sizeof(RECTANGLE_16));
+
+	if (!update->rects)
+	{
+		free(update);
+		return NULL;
+	}
+
+	CopyMemory(update->rects, rects, numRects * sizeof(RECTANGLE_16));
+
+	if (encoder->profile.codecId == FREERDP_CODEC_REMOTEFX)
+	{
+		RFX_RECT* rfxRects;
+
+		rfxRects = (RFX_RECT*) malloc(numRects * sizeof(RFX_RECT));
+
+		if (!rfxRects)
+			goto fail;
+
+		for (index = 0; index < numRects; index++)
+		{
+			rfxRects[index].x = rects[index].left;
+			rfxRects[index].y = rects[index].top;
+			rfxRects[index].width = rects[index].right - rects[index].left;
+			rfxRects[index].height = rects[index].bottom - rects[index].top;
+		}
+
+		begin = metrics_get_timestamp();
+
+		update->messages = rfx_encode_messages(encoder->rfx, rfxRects, numRects, pSrcData,
+				surface->width, surface->height, nSrcStep, &(update->numMessages),
+				encoder->profile.maxRequestSize);
+
+		metrics_codec_encode(metrics, METRICS_CODEC_RFX,
+				metrics_get_timestamp() - begin);
+
+		free(rfxRects);
+
+		if (!update->messages)
+			goto fail;
+	}
+	else
+	{
+		/* NSCodec updates always cover a single rectangle */
+
+		nWidth = rects[0].right - rects[0].left;
+		nHeight = rects[0].bottom - rects[0].top;
+
+		update->bs = Stream_New(NULL, nWidth * nHeight * 4);
+
+		if (!update->bs)
+			goto fail;
+
+		pSrcData = &pSrcData[(rects[0].top * nSrcStep) + (rects[0].left * 4)];
+
+		begin = metrics_get_timestamp();
+
+		if (!nsc_compose_message(encoder->nsc, update->bs, pSrcData, nWidth, nHeight, nSrcStep))
+		{
+			/* never cache a partial message, other clients would receive it */
+			WLog_ERR(TAG, "nsc_compose_message failed");
+			goto fail;
+		}
+
+		metrics_codec_encode(metrics, METRICS_CODEC_NSC,
+				metrics_get_timestamp() - begin);
+	}
+
+	return update;
+
+fail:
+	if (update->bs)
+		Stream_Free(update->bs, TRUE);
+
+	free(update->rects);
+	free(update);
+	return NULL;
+}
+
+/**
+ * Returns the encoded form of the given surface rectangles for the encoder profile
+ * negotiated by the client. The rectangles are encoded at most once per surface
+ * generation and profile, all other clients receive a new reference to the same
+ * encoded update. NSCodec updates are limited to a single rectangle.
+ *
+ * The caller must release the update with shadow_encoded_update_release().
+ */
+
+SHADOW_ENCODED_UPDATE* shadow_encoder_cache_encode(rdpShadowEncoderCache* cache, rdpShadowClient* client,
+		UINT32 codecId, rdpShadowSurface* surface, BYTE* pSrcData, int nSrcStep,
+		const RECTANGLE_16* rects, int numRects)
+{
+	int index;
+	int count;
+	SHADOW_ENCODER_PROFILE profile;
+	SHADOW_SHARED_ENCODER* encoder;
+	SHADOW_ENCODED_UPDATE* update = NULL;
+
+	if (!cache || (numRects < 1))
+		return NULL;
+
+	if ((codecId == FREERDP_CODEC_NSCODEC) && (numRects != 1))
+		return NULL;
+
+	shadow_encoder_cache_get_profile(client, codecId, &profile);
+
+	encoder = shadow_encoder_cache_get_encoder(cache, &profile);
+
+	if (!encoder)
+		return NULL;
+
+	EnterCriticalSection(&(encoder->lock));
+
+	count = ArrayList_Count(encoder->updates);
+
+	if (encoder->generation != surface->generation)
+	{
+		for (index = 0; index < count; index++)
+		{
+			update = (SHADOW_ENCODED_UPDATE*) ArrayList_GetItem(encoder->updates, index);
+			shadow_encoded_update_release(update);
+		}
+
+		ArrayList_Clear(encoder->updates);
+		encoder->generation = surface->generation;
+		count = 0;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		update = (SHADOW_ENCODED_UPDATE*) ArrayList_GetItem(encoder->updates, index);
+
+		if ((update->numRects == numRects) &&
+				(memcmp(update->rects, rects, numRects * sizeof(RECTANGLE_16)) == 0))
+			break;
+
+		update = NULL;
+	}
+
+	if (update)
+	{
+		InterlockedIncrement(&(update->refCount));
+		InterlockedIncrement(&(cache->hits));
+	}
+	else
+	{
+		update = shadow_shared_encoder_encode(encoder, client->context.metrics,
+				surface, pSrcData, nSrcStep, rects, numRects);
+
+		if (update)
+		{
+			/* one reference for the cache, one for the caller */
+			update->refCount = 2;
+
+			if (count >= SHADOW_ENCODER_CACHE_MAX_UPDATES)
+			{
+				shadow_encoded_update_release((SHADOW_ENCODED_UPDATE*)
+						ArrayList_GetItem(encoder->updates, 0));
+				ArrayList_RemoveAt(encoder->updates, 0);
+			}
+
+			ArrayList_Add(encoder->updates, (void*) update);
+		}
+
+		InterlockedIncrement(&(cache->misses));
+	}
+
+	LeaveCriticalSection(&(encoder->lock));
+
+	return update;
+}
+
+void shadow_encoded_update_release(SHADOW_ENCODED_UPDATE* update)
+{
+	int index;
+
+	if (!update)
+		return;
+
+	if (InterlockedDecrement(&(update->refCount)) > 0)
+		return;
+
+	if (update->messages)
+	{
+		for (index = 0; index < update->numMessages; index++)
+			rfx_message_free(update->encoder->rfx, &(update->messages[index]));
+
+		free(update->messages);
+	}
+
+	if (update->bs)
+		Stream_Free(update->bs, TRUE);
+
+	free(update->rects);
+	free(update);
+}
+
+rdpShadowEncoderCache* shadow_encoder_cache_new(rdpShadowServer* server)
+{
+	rdpShadowEncoderCache* cache;
+
+	cache = (rdpShadowEncoderCache*) calloc(1, sizeof(rdpShadowEncoderCache));
+
+	if (!cache)
+		return NULL;
+
+	cache->server = server;
+
+	cache->width = server->screen->width;
+	cache->height = server->screen->height;
+
+	if (!InitializeCriticalSectionAndSpinCount(&(cache->lock), 4000))
+	{
+		free(cache);
+		return NULL;
+	}
+
+	cache->encoders = ArrayList_New(FALSE);
+
+	if (!cache->encoders)
+	{
+		DeleteCriticalSection(&(cache->lock));
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void shadow_encoder_cache_free(rdpShadowEncoderCache* cache)
+{
+	int index;
+	int count;
+
+	if (!cache)
+		return;
+
+	WLog_DBG(TAG, "encoder cache: %d hits %d misses", cache->hits, cache->misses);
+
+	count = ArrayList_Count(cache->encoders);
+
+	for (index = 0; index < count; index++)
+		shadow_shared_encoder_free((SHADOW_SHARED_ENCODER*) ArrayList_GetItem(cache->encoders, index));
+
+	ArrayList_Free(cache->encoders);
+
+	DeleteCriticalSection(&(cache->lock));
+
+	free(cache);
+}
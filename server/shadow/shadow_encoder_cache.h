@@ -0,0 +1,116 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SHADOW_SERVER_ENCODER_CACHE_H
+#define FREERDP_SHADOW_SERVER_ENCODER_CACHE_H
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+#include <winpr/collections.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codecs.h>
+
+#include <freerdp/server/shadow.h>
+
+/**
+ * Encoder settings which influence the encoded output. Clients which
+ * negotiated identical profiles can share the result of a single encode.
+ *
+ * The shadow server always uses the default RemoteFX quantization values,
+ * which leaves the RLGR mode and the fragmentation size as the only
+ * RemoteFX settings that change the encoded messages.
+ */
+
+struct _SHADOW_ENCODER_PROFILE
+{
+	UINT32 codecId;
+	UINT32 maxRequestSize;
+	UINT32 rfxMode;
+	UINT32 nscColorLossLevel;
+	UINT32 nscChromaSubsamplingLevel;
+	BOOL nscDynamicColorFidelity;
+};
+typedef struct _SHADOW_ENCODER_PROFILE SHADOW_ENCODER_PROFILE;
+
+typedef struct _SHADOW_SHARED_ENCODER SHADOW_SHARED_ENCODER;
+
+struct _SHADOW_ENCODED_UPDATE
+{
+	LONG refCount;
+	SHADOW_SHARED_ENCODER* encoder;
+
+	UINT32 generation;
+	int numRects;
+	RECTANGLE_16* rects;
+
+	/* FREERDP_CODEC_REMOTEFX */
+	int numMessages;
+	RFX_MESSAGE* messages;
+
+	/* FREERDP_CODEC_NSCODEC */
+	wStream* bs;
+};
+typedef struct _SHADOW_ENCODED_UPDATE SHADOW_ENCODED_UPDATE;
+
+struct _SHADOW_SHARED_ENCODER
+{
+	SHADOW_ENCODER_PROFILE profile;
+
+	CRITICAL_SECTION lock;
+
+	RFX_CONTEXT* rfx;
+	NSC_CONTEXT* nsc;
+
+	UINT32 generation;
+	wArrayList* updates;
+};
+
+struct rdp_shadow_encoder_cache
+{
+	rdpShadowServer* server;
+
+	int width;
+	int height;
+
+	CRITICAL_SECTION lock;
+	wArrayList* encoders;
+
+	LONG hits;
+	LONG misses;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SHADOW_ENCODED_UPDATE* shadow_encoder_cache_encode(rdpShadowEncoderCache* cache, rdpShadowClient* client,
+		UINT32 codecId, rdpShadowSurface* surface, BYTE* pSrcData, int nSrcStep,
+		const RECTANGLE_16* rects, int numRects);
+
+void shadow_encoded_update_release(SHADOW_ENCODED_UPDATE* update);
+
+rdpShadowEncoderCache* shadow_encoder_cache_new(rdpShadowServer* server);
+void shadow_encoder_cache_free(rdpShadowEncoderCache* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SHADOW_SERVER_ENCODER_CACHE_H */
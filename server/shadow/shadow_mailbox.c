@@ -0,0 +1,161 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/interlocked.h>
+
+#include "shadow_capture.h"
+
+#include "shadow_mailbox.h"
+
+int shadow_mailbox_post(rdpShadowMailbox* mailbox, rdpShadowFrame* frame, REGION16* invalidRegion)
+{
+	int index;
+	int numRects = 0;
+	const RECTANGLE_16* rects;
+
+	EnterCriticalSection(&(mailbox->lock));
+
+	if (mailbox->frame)
+	{
+		shadow_frame_release(mailbox->frame);
+		mailbox->dropped++;
+	}
+
+	InterlockedIncrement(&(frame->refCount));
+	mailbox->frame = frame;
+	mailbox->posted++;
+
+	rects = region16_rects(invalidRegion, &numRects);
+
+	for (index = 0; index < numRects; index++)
+	{
+		region16_union_rect(&(mailbox->invalidRegion), &(mailbox->invalidRegion), &rects[index]);
+	}
+
+	SetEvent(mailbox->event);
+
+	LeaveCriticalSection(&(mailbox->lock));
+
+	return 1;
+}
+
+/**
+ * Takes the pending frame out of the mailbox and adds the region accumulated
+ * since the last call to invalidRegion. The caller owns the returned reference.
+ */
+
+rdpShadowFrame* shadow_mailbox_take(rdpShadowMailbox* mailbox, REGION16* invalidRegion)
+{
+	int index;
+	int numRects = 0;
+	rdpShadowFrame* frame;
+	const RECTANGLE_16* rects;
+
+	EnterCriticalSection(&(mailbox->lock));
+
+	frame = mailbox->frame;
+	mailbox->frame = NULL;
+
+	rects = region16_rects(&(mailbox->invalidRegion), &numRects);
+
+	for (index = 0; index < numRects; index++)
+	{
+		region16_union_rect(invalidRegion, invalidRegion, &rects[index]);
+	}
+
+	region16_clear(&(mailbox->invalidRegion));
+
+	ResetEvent(mailbox->event);
+
+	LeaveCriticalSection(&(mailbox->lock));
+
+	return frame;
+}
+
+int shadow_mailbox_broadcast(wArrayList* clients, rdpShadowFrame* frame, REGION16* invalidRegion)
+{
+	int index;
+	int count;
+	rdpShadowClient* client;
+
+	ArrayList_Lock(clients);
+
+	count = ArrayList_Count(clients);
+
+	for (index = 0; index < count; index++)
+	{
+		client = (rdpShadowClient*) ArrayList_GetItem(clients, index);
+
+		if (client->mailbox)
+			shadow_mailbox_post(client->mailbox, frame, invalidRegion);
+	}
+
+	ArrayList_Unlock(clients);
+
+	return count;
+}
+
+rdpShadowMailbox* shadow_mailbox_new(void)
+{
+	rdpShadowMailbox* mailbox;
+
+	mailbox = (rdpShadowMailbox*) calloc(1, sizeof(rdpShadowMailbox));
+
+	if (!mailbox)
+		return NULL;
+
+	mailbox->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!mailbox->event)
+	{
+		free(mailbox);
+		return NULL;
+	}
+
+	if (!InitializeCriticalSectionAndSpinCount(&(mailbox->lock), 4000))
+	{
+		CloseHandle(mailbox->event);
+		free(mailbox);
+		return NULL;
+	}
+
+	region16_init(&(mailbox->invalidRegion));
+
+	return mailbox;
+}
+
+void shadow_mailbox_free(rdpShadowMailbox* mailbox)
+{
+	if (!mailbox)
+		return;
+
+	shadow_frame_release(mailbox->frame);
+
+	region16_uninit(&(mailbox->invalidRegion));
+
+	DeleteCriticalSection(&(mailbox->lock));
+
+	CloseHandle(mailbox->event);
+
+	free(mailbox);
+}
@@ -0,0 +1,63 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SHADOW_SERVER_MAILBOX_H
+#define FREERDP_SHADOW_SERVER_MAILBOX_H
+
+#include <freerdp/server/shadow.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/collections.h>
+
+/**
+ * Latest-frame mailbox between the capture thread and a client thread.
+ *
+ * The capture thread replaces the pending frame and accumulates the dirty
+ * region without ever waiting for the client. The client takes whatever is
+ * pending when it is ready to encode, frames it did not get to are dropped.
+ */
+
+struct rdp_shadow_mailbox
+{
+	HANDLE event;
+	CRITICAL_SECTION lock;
+	rdpShadowFrame* frame;
+	REGION16 invalidRegion;
+
+	UINT32 posted;
+	UINT32 dropped;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int shadow_mailbox_post(rdpShadowMailbox* mailbox, rdpShadowFrame* frame, REGION16* invalidRegion);
+rdpShadowFrame* shadow_mailbox_take(rdpShadowMailbox* mailbox, REGION16* invalidRegion);
+
+int shadow_mailbox_broadcast(wArrayList* clients, rdpShadowFrame* frame, REGION16* invalidRegion);
+
+rdpShadowMailbox* shadow_mailbox_new(void);
+void shadow_mailbox_free(rdpShadowMailbox* mailbox);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SHADOW_SERVER_MAILBOX_H */
@@ -0,0 +1,159 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Copyright 2014 Marc-Andre Moreau <marcandre.moreau@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <freerdp/log.h>
+#include "shadow.h"
+
+#include "shadow_rdpgfx.h"
+
+#define TAG SERVER_TAG("shadow")
+
+/**
+ * The graphics pipeline only starts once the capabilities are confirmed:
+ * the client is then given a single surface covering the desktop, and the
+ * whole desktop is refreshed through it.
+ */
+
+static int rdpgfx_caps_advertise(RdpgfxServerContext* context, RDPGFX_CAPS_ADVERTISE_PDU* capsAdvertise)
+{
+	UINT16 index;
+	MONITOR_DEF monitor;
+	RECTANGLE_16 refreshRect;
+	RDPGFX_CAPSET* capsSet = NULL;
+	RDPGFX_CAPS_CONFIRM_PDU capsConfirm;
+	RDPGFX_RESET_GRAPHICS_PDU resetGraphics;
+	RDPGFX_CREATE_SURFACE_PDU createSurface;
+	RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU surfaceToOutput;
+	rdpShadowClient* client = (rdpShadowClient*) context->custom;
+	rdpSettings* settings = ((rdpContext*) client)->settings;
+	rdpShadowServer* server = client->server;
+
+	for (index = 0; index < capsAdvertise->capsSetCount; index++)
+	{
+		if ((capsAdvertise->capsSets[index].version != RDPGFX_CAPVERSION_8) &&
+				(capsAdvertise->capsSets[index].version != RDPGFX_CAPVERSION_81))
+			continue;
+
+		if (!capsSet || (capsAdvertise->capsSets[index].version > capsSet->version))
+			capsSet = &(capsAdvertise->capsSets[index]);
+	}
+
+	if (!capsSet)
+	{
+		WLog_ERR(TAG, "no supported graphics pipeline capability set");
+		return -1;
+	}
+
+	WLog_INFO(TAG, "CapsAdvertise: version: 0x%04X flags: 0x%04X", capsSet->version, capsSet->flags);
+
+	capsConfirm.capsSet = capsSet;
+
+	if (context->CapsConfirm(context, &capsConfirm) < 0)
+		return -1;
+
+	monitor.left = 0;
+	monitor.top = 0;
+	monitor.right = settings->DesktopWidth - 1;
+	monitor.bottom = settings->DesktopHeight - 1;
+	monitor.flags = MONITOR_PRIMARY;
+
+	resetGraphics.width = settings->DesktopWidth;
+	resetGraphics.height = settings->DesktopHeight;
+	resetGraphics.monitorCount = 1;
+	resetGraphics.monitorDefArray = &monitor;
+
+	if (context->ResetGraphics(context, &resetGraphics) < 0)
+		return -1;
+
+	createSurface.surfaceId = SHADOW_ENCODER_GFX_SURFACE_ID;
+	createSurface.width = settings->DesktopWidth;
+	createSurface.height = settings->DesktopHeight;
+	createSurface.pixelFormat = PIXEL_FORMAT_XRGB_8888;
+
+	if (context->CreateSurface(context, &createSurface) < 0)
+		return -1;
+
+	surfaceToOutput.surfaceId = SHADOW_ENCODER_GFX_SURFACE_ID;
+	surfaceToOutput.reserved = 0;
+	surfaceToOutput.outputOriginX = 0;
+	surfaceToOutput.outputOriginY = 0;
+
+	if (context->MapSurfaceToOutput(context, &surfaceToOutput) < 0)
+		return -1;
+
+	EnterCriticalSection(&(client->lock));
+	client->gfxCapsVersion = capsSet->version;
+	client->gfxReady = TRUE;
+	LeaveCriticalSection(&(client->lock));
+
+	refreshRect.left = 0;
+	refreshRect.top = 0;
+	refreshRect.right = server->screen->width;
+	refreshRect.bottom = server->screen->height;
+
+	shadow_client_refresh_rect(client, 1, &refreshRect);
+
+	return 1;
+}
+
+static int rdpgfx_frame_acknowledge(RdpgfxServerContext* context, RDPGFX_FRAME_ACKNOWLEDGE_PDU* frameAcknowledge)
+{
+	rdpShadowClient* client = (rdpShadowClient*) context->custom;
+
+	metrics_frame_acknowledged(client->context.metrics, frameAcknowledge->frameId);
+	shadow_client_surface_frame_acknowledge(client, frameAcknowledge->frameId);
+
+	return 1;
+}
+
+int shadow_client_rdpgfx_init(rdpShadowClient* client)
+{
+	RdpgfxServerContext* rdpgfx;
+
+	rdpgfx = client->rdpgfx = rdpgfx_server_context_new(client->vcm);
+
+	if (!rdpgfx)
+		return -1;
+
+	rdpgfx->custom = (void*) client;
+
+	rdpgfx->CapsAdvertise = rdpgfx_caps_advertise;
+	rdpgfx->FrameAcknowledge = rdpgfx_frame_acknowledge;
+
+	if (rdpgfx->Open(rdpgfx) < 0)
+		return -1;
+
+	return 1;
+}
+
+void shadow_client_rdpgfx_uninit(rdpShadowClient* client)
+{
+	if (client->rdpgfx)
+	{
+		client->rdpgfx->Close(client->rdpgfx);
+		rdpgfx_server_context_free(client->rdpgfx);
+		client->rdpgfx = NULL;
+	}
+
+	client->gfxReady = FALSE;
+	client->gfxUpgrade = FALSE;
+}
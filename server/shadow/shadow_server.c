@@ -50,6 +50,8 @@ static COMMAND_LINE_ARGUMENT_A shadow_args[] =
 	{ "auth", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Clients must authenticate" },
 	{ "may-view", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "Clients may view without prompt" },
 	{ "may-interact", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueTrue, NULL, -1, NULL, "Clients may interact without prompt" },
+	{ "clear", COMMAND_LINE_VALUE_BOOL, NULL, BoolValueFalse, NULL, -1, NULL, "Use ClearCodec for graphics pipeline clients" },
+	{ "metrics", COMMAND_LINE_VALUE_REQUIRED, "<seconds>", NULL, NULL, -1, NULL, "Log per-session metrics every <seconds>" },
 	{ "version", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_VERSION, NULL, NULL, NULL, -1, NULL, "Print version" },
 	{ "help", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_HELP, NULL, NULL, NULL, -1, "?", "Print help" },
 	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
@@ -183,6 +185,14 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 		{
 			server->mayInteract = arg->Value ? TRUE : FALSE;
 		}
+		CommandLineSwitchCase(arg, "clear")
+		{
+			server->clearCodec = arg->Value ? TRUE : FALSE;
+		}
+		CommandLineSwitchCase(arg, "metrics")
+		{
+			server->metricsInterval = (DWORD) atoi(arg->Value);
+		}
 		CommandLineSwitchCase(arg, "rect")
 		{
 			char* p;
@@ -298,10 +308,14 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 
 void* shadow_server_thread(rdpShadowServer* server)
 {
+	DWORD index;
 	DWORD status;
 	DWORD nCount;
+	int stopIndex = -1;
+	UINT64 signaled;
 	HANDLE events[32];
 	HANDLE StopEvent;
+	wWaitSet* waitSet;
 	freerdp_listener* listener;
 	rdpShadowSubsystem* subsystem;
 
@@ -311,21 +325,39 @@ void* shadow_server_thread(rdpShadowServer* server)
 
 	shadow_subsystem_start(server->subsystem);
 
+	/* the listening sockets do not change once the listener is open */
+
+	nCount = 0;
+	waitSet = WaitSet_New();
+
+	if (!waitSet || (listener->GetEventHandles(listener, events, &nCount) < 0))
+	{
+		WLog_ERR(TAG, "Failed to get FreeRDP file descriptor");
+		goto out;
+	}
+
+	for (index = 0; index < nCount; index++)
+	{
+		if (WaitSet_Add(waitSet, events[index]) < 0)
+			goto out;
+	}
+
+	stopIndex = WaitSet_Add(waitSet, StopEvent);
+
+	if (stopIndex < 0)
+		goto out;
+
 	while (1)
 	{
-		nCount = 0;
+		status = WaitSet_Wait(waitSet, INFINITE, &signaled);
 
-		if (listener->GetEventHandles(listener, events, &nCount) < 0)
+		if (status == WAIT_FAILED)
 		{
-			WLog_ERR(TAG, "Failed to get FreeRDP file descriptor");
+			WLog_ERR(TAG, "WaitSet_Wait failed");
 			break;
 		}
 
-		events[nCount++] = server->StopEvent;
-
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
-
-		if (WaitForSingleObject(server->StopEvent, 0) == WAIT_OBJECT_0)
+		if (signaled & (((UINT64) 1) << stopIndex))
 		{
 			break;
 		}
@@ -341,6 +373,9 @@ void* shadow_server_thread(rdpShadowServer* server)
 #endif
 	}
 
+out:
+	WaitSet_Free(waitSet);
+
 	listener->Close(listener);
 
 	shadow_subsystem_stop(server->subsystem);
@@ -372,6 +407,11 @@ int shadow_server_start(rdpShadowServer* server)
 	if (!server->capture)
 		return -1;
 
+	server->encoderCache = shadow_encoder_cache_new(server);
+
+	if (!server->encoderCache)
+		return -1;
+
 	if (!server->ipcSocket)
 		status = server->listener->Open(server->listener, NULL, (UINT16) server->port);
 	else
@@ -410,6 +450,12 @@ int shadow_server_stop(rdpShadowServer* server)
 		server->capture = NULL;
 	}
 
+	if (server->encoderCache)
+	{
+		shadow_encoder_cache_free(server->encoderCache);
+		server->encoderCache = NULL;
+	}
+
 	return 0;
 }
 
@@ -138,7 +138,6 @@ int shadow_subsystem_init(rdpShadowSubsystem* subsystem, rdpShadowServer* server
 	subsystem->selectedMonitor = server->selectedMonitor;
 
 	subsystem->MsgPipe = MessagePipe_New();
-	subsystem->updateEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
 	region16_init(&(subsystem->invalidRegion));
 
@@ -161,12 +160,6 @@ void shadow_subsystem_uninit(rdpShadowSubsystem* subsystem)
 		subsystem->MsgPipe = NULL;
 	}
 
-	if (subsystem->updateEvent)
-	{
-		CloseHandle(subsystem->updateEvent);
-		subsystem->updateEvent = NULL;
-	}
-
 	if (subsystem->invalidRegion.data)
 		region16_uninit(&(subsystem->invalidRegion));
 }
@@ -195,6 +188,29 @@ int shadow_subsystem_stop(rdpShadowSubsystem* subsystem)
 	return status;
 }
 
+/**
+ * Publishes the server surface and the accumulated invalid region to every client.
+ * This never waits for the clients: each of them picks up the latest frame when it
+ * is ready to send, so a slow client cannot hold back capture for the others.
+ */
+
+int shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem)
+{
+	rdpShadowFrame* frame;
+	rdpShadowServer* server = subsystem->server;
+
+	frame = shadow_capture_snapshot(server->capture, server->surface, &(subsystem->invalidRegion));
+
+	if (!frame)
+		return -1;
+
+	shadow_mailbox_broadcast(server->clients, frame, &(subsystem->invalidRegion));
+
+	shadow_frame_release(frame);
+
+	return 1;
+}
+
 int shadow_enum_monitors(MONITOR_DEF* monitors, int maxMonitors, const char* name)
 {
 	int numMonitors = 0;
@@ -76,6 +76,8 @@ void shadow_subsystem_uninit(rdpShadowSubsystem* subsystem);
 int shadow_subsystem_start(rdpShadowSubsystem* subsystem);
 int shadow_subsystem_stop(rdpShadowSubsystem* subsystem);
 
+int shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem);
+
 #ifdef __cplusplus
 }
 #endif
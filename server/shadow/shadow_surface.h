@@ -34,6 +34,7 @@ struct rdp_shadow_surface
 	int height;
 	int scanline;
 	BYTE* data;
+	UINT32 generation;
 
 	CRITICAL_SECTION lock;
 	REGION16 invalidRegion;
@@ -0,0 +1,294 @@
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/server/shadow.h>
+
+#include "shadow_capture.h"
+
+#define TEST_FRAME_WIDTH	3840
+#define TEST_FRAME_HEIGHT	2160
+#define TEST_DIRTY_PERCENT	3
+#define TEST_BENCHMARK_TIME	250
+
+static UINT32 test_random_seed = 0x12345678;
+
+static UINT32 test_random(void)
+{
+	test_random_seed = (test_random_seed * 1103515245) + 12345;
+	return (test_random_seed >> 8);
+}
+
+/**
+ * Changes one pixel in a random subset of the tiles and records which ones.
+ */
+
+static int test_dirty_tiles(BYTE* pData, int nStep, int nWidth, int nHeight, BYTE* dirty, int percent)
+{
+	int x, y;
+	int tx, ty;
+	int tw, th;
+	int ncol, nrow;
+	int count = 0;
+
+	ncol = (nWidth + 15) / 16;
+	nrow = (nHeight + 15) / 16;
+
+	for (ty = 0; ty < nrow; ty++)
+	{
+		th = ((ty + 1) * 16 > nHeight) ? (nHeight - (ty * 16)) : 16;
+
+		for (tx = 0; tx < ncol; tx++)
+		{
+			tw = ((tx + 1) * 16 > nWidth) ? (nWidth - (tx * 16)) : 16;
+
+			dirty[(ty * ncol) + tx] = 0;
+
+			if ((int) (test_random() % 100) >= percent)
+				continue;
+
+			x = (tx * 16) + (test_random() % tw);
+			y = (ty * 16) + (test_random() % th);
+
+			pData[(y * nStep) + (x * 4) + (test_random() % 4)] ^= 0x5A;
+
+			dirty[(ty * ncol) + tx] = 1;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static BOOL test_check_region(REGION16* region, int nWidth, int nHeight, BYTE* dirty)
+{
+	int tx, ty;
+	int ncol, nrow;
+	BOOL covered;
+	RECTANGLE_16 tile;
+
+	ncol = (nWidth + 15) / 16;
+	nrow = (nHeight + 15) / 16;
+
+	for (ty = 0; ty < nrow; ty++)
+	{
+		for (tx = 0; tx < ncol; tx++)
+		{
+			tile.left = tx * 16;
+			tile.top = ty * 16;
+			tile.right = ((tx + 1) * 16 > nWidth) ? nWidth : (tx + 1) * 16;
+			tile.bottom = ((ty + 1) * 16 > nHeight) ? nHeight : (ty + 1) * 16;
+
+			covered = region16_intersects_rect(region, &tile);
+
+			if (covered != (dirty[(ty * ncol) + tx] ? TRUE : FALSE))
+			{
+				printf("tile %d,%d: expected %s\n", tx, ty, covered ? "clean" : "dirty");
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static int test_compare(rdpShadowCapture* capture, int nWidth, int nHeight, int percent)
+{
+	int status;
+	int nStep;
+	int count;
+	int numTiles;
+	BYTE* pData1;
+	BYTE* pData2;
+	BYTE* dirty;
+	REGION16 region;
+	RECTANGLE_16 rect;
+
+	nStep = nWidth * 4;
+	numTiles = ((nWidth + 15) / 16) * ((nHeight + 15) / 16);
+
+	pData1 = (BYTE*) malloc(nStep * nHeight);
+	pData2 = (BYTE*) malloc(nStep * nHeight);
+	dirty = (BYTE*) malloc(numTiles);
+
+	if (!pData1 || !pData2 || !dirty)
+		return -1;
+
+	for (count = 0; count < (nStep * nHeight); count++)
+		pData1[count] = (BYTE) test_random();
+
+	CopyMemory(pData2, pData1, nStep * nHeight);
+
+	count = test_dirty_tiles(pData2, nStep, nWidth, nHeight, dirty, percent);
+
+	region16_init(&region);
+
+	status = shadow_capture_compare_region(capture, pData1, nStep, nWidth, nHeight, pData2, nStep, &region);
+
+	if (status != count)
+	{
+		printf("%dx%d: %d dirty tiles reported, expected %d\n", nWidth, nHeight, status, count);
+		status = -1;
+		goto out;
+	}
+
+	if (!test_check_region(&region, nWidth, nHeight, dirty))
+	{
+		status = -1;
+		goto out;
+	}
+
+	status = shadow_capture_compare(pData1, nStep, nWidth, nHeight, pData2, nStep, &rect);
+
+	if ((status > 0) != (count > 0))
+	{
+		printf("%dx%d: shadow_capture_compare status mismatch\n", nWidth, nHeight);
+		status = -1;
+		goto out;
+	}
+
+	if (count && (memcmp(&rect, region16_extents(&region), sizeof(RECTANGLE_16)) != 0))
+	{
+		printf("%dx%d: shadow_capture_compare extents mismatch\n", nWidth, nHeight);
+		status = -1;
+		goto out;
+	}
+
+	status = 1;
+
+out:
+	region16_uninit(&region);
+	free(pData1);
+	free(pData2);
+	free(dirty);
+
+	return status;
+}
+
+static int test_compare_speed(rdpShadowCapture* capture)
+{
+	int nStep;
+	int count;
+	int numTiles;
+	int iterations;
+	UINT64 begin;
+	UINT64 elapsed;
+	BYTE* pData1;
+	BYTE* pData2;
+	BYTE* dirty;
+	REGION16 region;
+	RECTANGLE_16 rect;
+
+	nStep = TEST_FRAME_WIDTH * 4;
+	numTiles = (TEST_FRAME_WIDTH / 16) * ((TEST_FRAME_HEIGHT + 15) / 16);
+
+	pData1 = (BYTE*) calloc(1, nStep * TEST_FRAME_HEIGHT);
+	pData2 = (BYTE*) calloc(1, nStep * TEST_FRAME_HEIGHT);
+	dirty = (BYTE*) malloc(numTiles);
+
+	if (!pData1 || !pData2 || !dirty)
+		return -1;
+
+	count = test_dirty_tiles(pData2, nStep, TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT, dirty, TEST_DIRTY_PERCENT);
+
+	region16_init(&region);
+
+	iterations = 0;
+	begin = GetTickCount64();
+
+	do
+	{
+		region16_clear(&region);
+		shadow_capture_compare_region(capture, pData1, nStep, TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT,
+				pData2, nStep, &region);
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_BENCHMARK_TIME);
+
+	printf("shadow_capture_compare_region: %dx%d, %d of %d tiles dirty: %.2f ms/frame, %.1f ns/tile\n",
+			TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT, count, numTiles,
+			(double) elapsed / iterations, ((double) elapsed * 1000000.0) / ((double) iterations * numTiles));
+
+	/* tile comparison alone, without building the region */
+
+	iterations = 0;
+	begin = GetTickCount64();
+
+	do
+	{
+		shadow_capture_compare_region(capture, pData1, nStep, TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT,
+				pData2, nStep, NULL);
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_BENCHMARK_TIME);
+
+	printf("shadow_capture_compare_region (tiles only): %.2f ms/frame, %.1f ns/tile\n",
+			(double) elapsed / iterations, ((double) elapsed * 1000000.0) / ((double) iterations * numTiles));
+
+	iterations = 0;
+	begin = GetTickCount64();
+
+	do
+	{
+		shadow_capture_compare(pData1, nStep, TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT, pData2, nStep, &rect);
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_BENCHMARK_TIME);
+
+	printf("shadow_capture_compare (single thread): %.2f ms/frame, %.1f ns/tile\n",
+			(double) elapsed / iterations, ((double) elapsed * 1000000.0) / ((double) iterations * numTiles));
+
+	region16_uninit(&region);
+	free(pData1);
+	free(pData2);
+	free(dirty);
+
+	return 1;
+}
+
+int TestShadowCapture(int argc, char* argv[])
+{
+	int status = -1;
+	rdpShadowServer* server;
+	rdpShadowCapture* capture;
+
+	server = (rdpShadowServer*) calloc(1, sizeof(rdpShadowServer));
+
+	if (!server)
+		return -1;
+
+	capture = shadow_capture_new(server);
+
+	if (!capture)
+		return -1;
+
+	/* partial tiles on the right and bottom edges */
+
+	if (test_compare(capture, 100, 37, 30) < 0)
+		goto out;
+
+	if (test_compare(capture, 64, 64, 0) < 0)
+		goto out;
+
+	if (test_compare(capture, 64, 64, 100) < 0)
+		goto out;
+
+	/* large enough to be split across threads */
+
+	if (test_compare(capture, TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT, TEST_DIRTY_PERCENT) < 0)
+		goto out;
+
+	if (test_compare_speed(capture) < 0)
+		goto out;
+
+	status = 0;
+
+out:
+	shadow_capture_free(capture);
+	free(server);
+
+	return status;
+}
@@ -0,0 +1,292 @@
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/rfx.h>
+#include <freerdp/codec/nsc.h>
+#include <freerdp/server/shadow.h>
+
+#include "shadow_capture.h"
+#include "shadow_encoder.h"
+
+#define TEST_SURFACE_WIDTH	1920
+#define TEST_SURFACE_HEIGHT	1080
+#define TEST_BENCHMARK_TIME	200
+
+struct test_encode_result
+{
+	UINT32 bytes;
+	double milliseconds;
+};
+typedef struct test_encode_result TEST_ENCODE_RESULT;
+
+static int test_encode_rfx(RFX_CONTEXT* rfx, BYTE* pSrcData, int nSrcStep,
+		const RECTANGLE_16* rects, int numRects, TEST_ENCODE_RESULT* result)
+{
+	int i;
+	int iterations = 0;
+	int numMessages;
+	UINT64 begin;
+	UINT64 elapsed;
+	wStream* s;
+	RFX_RECT* rfxRects;
+	RFX_MESSAGE* messages;
+
+	s = Stream_New(NULL, 1024 * 1024);
+	rfxRects = (RFX_RECT*) malloc(numRects * sizeof(RFX_RECT));
+
+	if (!s || !rfxRects)
+		return -1;
+
+	for (i = 0; i < numRects; i++)
+	{
+		rfxRects[i].x = rects[i].left;
+		rfxRects[i].y = rects[i].top;
+		rfxRects[i].width = rects[i].right - rects[i].left;
+		rfxRects[i].height = rects[i].bottom - rects[i].top;
+	}
+
+	begin = GetTickCount64();
+
+	do
+	{
+		result->bytes = 0;
+
+		messages = rfx_encode_messages(rfx, rfxRects, numRects, pSrcData,
+				TEST_SURFACE_WIDTH, TEST_SURFACE_HEIGHT, nSrcStep, &numMessages, 0x3F0000);
+
+		if (!messages)
+			return -1;
+
+		for (i = 0; i < numMessages; i++)
+		{
+			Stream_SetPosition(s, 0);
+			rfx_write_message(rfx, s, &messages[i]);
+			rfx_message_free(rfx, &messages[i]);
+			result->bytes += Stream_GetPosition(s);
+		}
+
+		free(messages);
+
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_BENCHMARK_TIME);
+
+	result->milliseconds = (double) elapsed / iterations;
+
+	free(rfxRects);
+	Stream_Free(s, TRUE);
+
+	return 1;
+}
+
+static int test_encode_nsc(NSC_CONTEXT* nsc, BYTE* pSrcData, int nSrcStep,
+		const RECTANGLE_16* rects, int numRects, TEST_ENCODE_RESULT* result)
+{
+	int i;
+	int iterations = 0;
+	int nWidth, nHeight;
+	UINT64 begin;
+	UINT64 elapsed;
+	wStream* s;
+
+	s = Stream_New(NULL, TEST_SURFACE_WIDTH * TEST_SURFACE_HEIGHT * 4);
+
+	if (!s)
+		return -1;
+
+	begin = GetTickCount64();
+
+	do
+	{
+		result->bytes = 0;
+
+		for (i = 0; i < numRects; i++)
+		{
+			nWidth = rects[i].right - rects[i].left;
+			nHeight = rects[i].bottom - rects[i].top;
+
+			Stream_SetPosition(s, 0);
+
+			nsc_compose_message(nsc, s, &pSrcData[(rects[i].top * nSrcStep) + (rects[i].left * 4)],
+					nWidth, nHeight, nSrcStep);
+
+			/* surface bits command header */
+			result->bytes += Stream_GetPosition(s) + 22;
+		}
+
+		iterations++;
+		elapsed = GetTickCount64() - begin;
+	}
+	while (elapsed < TEST_BENCHMARK_TIME);
+
+	result->milliseconds = (double) elapsed / iterations;
+
+	Stream_Free(s, TRUE);
+
+	return 1;
+}
+
+static int test_merge_rects(void)
+{
+	int numRects;
+	REGION16 region;
+	RECTANGLE_16 rect;
+	RECTANGLE_16* rects;
+
+	region16_init(&region);
+
+	/* two small rectangles a few pixels apart end up in one update */
+
+	rect.left = 100;
+	rect.top = 100;
+	rect.right = 164;
+	rect.bottom = 164;
+	region16_union_rect(&region, &region, &rect);
+
+	rect.left = 172;
+	rect.right = 236;
+	region16_union_rect(&region, &region, &rect);
+
+	numRects = shadow_capture_merge_rects(&region, SHADOW_ENCODER_RECT_OVERHEAD, &rects);
+	free(rects);
+
+	if (numRects != 1)
+	{
+		printf("adjacent rectangles were not merged: %d\n", numRects);
+		return -1;
+	}
+
+	/* without overhead, only merging that adds no area is allowed */
+
+	numRects = shadow_capture_merge_rects(&region, 0, &rects);
+	free(rects);
+
+	if (numRects != 2)
+	{
+		printf("rectangles were merged without overhead: %d\n", numRects);
+		return -1;
+	}
+
+	region16_uninit(&region);
+
+	return 1;
+}
+
+int TestShadowEncode(int argc, char* argv[])
+{
+	int x, y;
+	int nSrcStep;
+	int numRects;
+	int status = -1;
+	BYTE* pSrcData;
+	REGION16 region;
+	RECTANGLE_16 rect;
+	RECTANGLE_16* rects = NULL;
+	const RECTANGLE_16* extents;
+	RFX_CONTEXT* rfx;
+	NSC_CONTEXT* nsc;
+	TEST_ENCODE_RESULT rfxExtents;
+	TEST_ENCODE_RESULT rfxRects;
+	TEST_ENCODE_RESULT nscExtents;
+	TEST_ENCODE_RESULT nscRects;
+
+	if (test_merge_rects() < 0)
+		return -1;
+
+	nSrcStep = TEST_SURFACE_WIDTH * 4;
+	pSrcData = (BYTE*) malloc(nSrcStep * TEST_SURFACE_HEIGHT);
+
+	if (!pSrcData)
+		return -1;
+
+	/* a smooth gradient with some texture, closer to a desktop than noise */
+
+	for (y = 0; y < TEST_SURFACE_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_SURFACE_WIDTH; x++)
+		{
+			pSrcData[(y * nSrcStep) + (x * 4) + 0] = (BYTE) (x / 8);
+			pSrcData[(y * nSrcStep) + (x * 4) + 1] = (BYTE) (y / 5);
+			pSrcData[(y * nSrcStep) + (x * 4) + 2] = (BYTE) (((x ^ y) & 0x10) ? 0xC0 : 0x40);
+			pSrcData[(y * nSrcStep) + (x * 4) + 3] = 0xFF;
+		}
+	}
+
+	rfx = rfx_context_new(TRUE);
+	nsc = nsc_context_new();
+
+	if (!rfx || !nsc)
+		return -1;
+
+	rfx->mode = RLGR3;
+	rfx->width = TEST_SURFACE_WIDTH;
+	rfx->height = TEST_SURFACE_HEIGHT;
+	rfx_context_set_pixel_format(rfx, RDP_PIXEL_FORMAT_B8G8R8A8);
+	nsc_context_set_pixel_format(nsc, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	/* two small changes in opposite corners of the screen */
+
+	region16_init(&region);
+
+	rect.left = 16;
+	rect.top = 16;
+	rect.right = 80;
+	rect.bottom = 48;
+	region16_union_rect(&region, &region, &rect);
+
+	rect.left = TEST_SURFACE_WIDTH - 96;
+	rect.top = TEST_SURFACE_HEIGHT - 40;
+	rect.right = TEST_SURFACE_WIDTH - 16;
+	rect.bottom = TEST_SURFACE_HEIGHT - 8;
+	region16_union_rect(&region, &region, &rect);
+
+	extents = region16_extents(&region);
+
+	if (test_encode_rfx(rfx, pSrcData, nSrcStep, extents, 1, &rfxExtents) < 0)
+		goto out;
+
+	if (test_encode_nsc(nsc, pSrcData, nSrcStep, extents, 1, &nscExtents) < 0)
+		goto out;
+
+	numRects = shadow_capture_merge_rects(&region, 0, &rects);
+
+	if (test_encode_rfx(rfx, pSrcData, nSrcStep, rects, numRects, &rfxRects) < 0)
+		goto out;
+
+	free(rects);
+
+	numRects = shadow_capture_merge_rects(&region, SHADOW_ENCODER_RECT_OVERHEAD, &rects);
+
+	if (numRects != 2)
+	{
+		printf("opposite corners were merged into %d rectangles\n", numRects);
+		goto out;
+	}
+
+	if (test_encode_nsc(nsc, pSrcData, nSrcStep, rects, numRects, &nscRects) < 0)
+		goto out;
+
+	printf("RemoteFX bounding box: %d bytes, %.2f ms\n", rfxExtents.bytes, rfxExtents.milliseconds);
+	printf("RemoteFX rectangles:   %d bytes, %.2f ms\n", rfxRects.bytes, rfxRects.milliseconds);
+	printf("NSCodec bounding box:  %d bytes, %.2f ms\n", nscExtents.bytes, nscExtents.milliseconds);
+	printf("NSCodec rectangles:    %d bytes, %.2f ms\n", nscRects.bytes, nscRects.milliseconds);
+
+	if ((rfxRects.bytes >= rfxExtents.bytes) || (nscRects.bytes >= nscExtents.bytes))
+	{
+		printf("encoding the rectangles was not cheaper than the bounding box\n");
+		goto out;
+	}
+
+	status = 0;
+
+out:
+	free(rects);
+	region16_uninit(&region);
+	rfx_context_free(rfx);
+	nsc_context_free(nsc);
+	free(pSrcData);
+
+	return status;
+}
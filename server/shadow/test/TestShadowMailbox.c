@@ -0,0 +1,289 @@
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/collections.h>
+
+#include <freerdp/server/shadow.h>
+
+#include "shadow_surface.h"
+#include "shadow_capture.h"
+#include "shadow_mailbox.h"
+
+#define TEST_SURFACE_WIDTH	64
+#define TEST_SURFACE_HEIGHT	64
+#define TEST_CLIENT_COUNT	4
+#define TEST_FRAME_COUNT	60
+#define TEST_FRAME_INTERVAL	5
+#define TEST_SLOW_CLIENT_DELAY	100
+
+struct test_peer
+{
+	rdpShadowClient* client;
+	HANDLE thread;
+	DWORD delay;
+	BOOL stop;
+	UINT32 received;
+	UINT32 lastGeneration;
+	BOOL corrupted;
+};
+typedef struct test_peer TEST_PEER;
+
+static BOOL test_frame_is_consistent(rdpShadowFrame* frame)
+{
+	int x, y;
+	UINT32* pixel;
+	rdpShadowSurface* surface = frame->surface;
+
+	for (y = 0; y < surface->height; y++)
+	{
+		pixel = (UINT32*) &surface->data[y * surface->scanline];
+
+		for (x = 0; x < surface->width; x++)
+		{
+			if (pixel[x] != frame->generation)
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void* test_peer_thread(void* arg)
+{
+	REGION16 invalidRegion;
+	rdpShadowFrame* frame;
+	TEST_PEER* peer = (TEST_PEER*) arg;
+	rdpShadowMailbox* mailbox = peer->client->mailbox;
+
+	region16_init(&invalidRegion);
+
+	while (!peer->stop)
+	{
+		if (WaitForSingleObject(mailbox->event, 10) != WAIT_OBJECT_0)
+			continue;
+
+		frame = shadow_mailbox_take(mailbox, &invalidRegion);
+		region16_clear(&invalidRegion);
+
+		if (!frame)
+			continue;
+
+		if (!test_frame_is_consistent(frame))
+			peer->corrupted = TRUE;
+
+		/* simulate encoding and sending, the snapshot must not change meanwhile */
+
+		if (peer->delay)
+			Sleep(peer->delay);
+
+		if (!test_frame_is_consistent(frame))
+			peer->corrupted = TRUE;
+
+		peer->received++;
+		peer->lastGeneration = frame->generation;
+
+		shadow_frame_release(frame);
+	}
+
+	region16_uninit(&invalidRegion);
+
+	ExitThread(0);
+	return NULL;
+}
+
+static void test_surface_fill(rdpShadowSurface* surface, UINT32 value)
+{
+	int x, y;
+	UINT32* pixel;
+
+	for (y = 0; y < surface->height; y++)
+	{
+		pixel = (UINT32*) &surface->data[y * surface->scanline];
+
+		for (x = 0; x < surface->width; x++)
+			pixel[x] = value;
+	}
+}
+
+int TestShadowMailbox(int argc, char* argv[])
+{
+	int index;
+	int status = -1;
+	BOOL done;
+	UINT32 frameIndex;
+	UINT64 begin;
+	UINT64 elapsed;
+	UINT64 maxPublishTime = 0;
+	rdpShadowFrame* frame;
+	rdpShadowServer* server;
+	rdpShadowSurface* surface;
+	rdpShadowCapture* capture;
+	REGION16 invalidRegion;
+	RECTANGLE_16 surfaceRect;
+	TEST_PEER peers[TEST_CLIENT_COUNT];
+
+	ZeroMemory(peers, sizeof(peers));
+
+	server = (rdpShadowServer*) calloc(1, sizeof(rdpShadowServer));
+
+	if (!server)
+		return -1;
+
+	server->clients = ArrayList_New(TRUE);
+	surface = shadow_surface_new(server, 0, 0, TEST_SURFACE_WIDTH, TEST_SURFACE_HEIGHT);
+	capture = shadow_capture_new(server);
+
+	if (!server->clients || !surface || !capture)
+		return -1;
+
+	surfaceRect.left = 0;
+	surfaceRect.top = 0;
+	surfaceRect.right = TEST_SURFACE_WIDTH;
+	surfaceRect.bottom = TEST_SURFACE_HEIGHT;
+
+	region16_init(&invalidRegion);
+
+	for (index = 0; index < TEST_CLIENT_COUNT; index++)
+	{
+		peers[index].client = (rdpShadowClient*) calloc(1, sizeof(rdpShadowClient));
+
+		if (!peers[index].client)
+			return -1;
+
+		peers[index].client->mailbox = shadow_mailbox_new();
+
+		if (!peers[index].client->mailbox)
+			return -1;
+
+		/* the last peer is much slower than the capture rate */
+
+		if (index == (TEST_CLIENT_COUNT - 1))
+			peers[index].delay = TEST_SLOW_CLIENT_DELAY;
+
+		ArrayList_Add(server->clients, (void*) peers[index].client);
+
+		peers[index].thread = CreateThread(NULL, 0,
+				(LPTHREAD_START_ROUTINE) test_peer_thread, (void*) &peers[index], 0, NULL);
+	}
+
+	for (frameIndex = 1; frameIndex <= TEST_FRAME_COUNT; frameIndex++)
+	{
+		test_surface_fill(surface, frameIndex);
+		region16_union_rect(&invalidRegion, &invalidRegion, &surfaceRect);
+
+		begin = GetTickCount64();
+
+		frame = shadow_capture_snapshot(capture, surface, &invalidRegion);
+
+		if (!frame)
+		{
+			printf("shadow_capture_snapshot failure\n");
+			break;
+		}
+
+		shadow_mailbox_broadcast(server->clients, frame, &invalidRegion);
+		shadow_frame_release(frame);
+
+		elapsed = GetTickCount64() - begin;
+
+		if (elapsed > maxPublishTime)
+			maxPublishTime = elapsed;
+
+		region16_clear(&invalidRegion);
+
+		Sleep(TEST_FRAME_INTERVAL);
+	}
+
+	/* every peer must eventually catch up with the latest frame */
+
+	begin = GetTickCount64();
+
+	do
+	{
+		done = TRUE;
+
+		for (index = 0; index < TEST_CLIENT_COUNT; index++)
+		{
+			if (peers[index].lastGeneration != TEST_FRAME_COUNT)
+				done = FALSE;
+		}
+
+		if (!done)
+			Sleep(10);
+	}
+	while (!done && ((GetTickCount64() - begin) < 5000));
+
+	for (index = 0; index < TEST_CLIENT_COUNT; index++)
+	{
+		peers[index].stop = TRUE;
+		WaitForSingleObject(peers[index].thread, INFINITE);
+		CloseHandle(peers[index].thread);
+	}
+
+	for (index = 0; index < TEST_CLIENT_COUNT; index++)
+	{
+		printf("peer %d: received %d frames, last generation %d, dropped %d\n", index,
+				peers[index].received, peers[index].lastGeneration, peers[index].client->mailbox->dropped);
+	}
+
+	printf("maximum publish time: %d ms\n", (int) maxPublishTime);
+
+	if (maxPublishTime > (TEST_SLOW_CLIENT_DELAY / 2))
+	{
+		printf("capture was blocked by a slow peer\n");
+		goto out;
+	}
+
+	for (index = 0; index < TEST_CLIENT_COUNT; index++)
+	{
+		if (peers[index].corrupted)
+		{
+			printf("peer %d saw a frame change while holding it\n", index);
+			goto out;
+		}
+
+		if (peers[index].lastGeneration != TEST_FRAME_COUNT)
+		{
+			printf("peer %d did not receive the latest frame\n", index);
+			goto out;
+		}
+
+		if (peers[index].client->mailbox->posted != TEST_FRAME_COUNT)
+		{
+			printf("peer %d mailbox was not posted every frame\n", index);
+			goto out;
+		}
+	}
+
+	if (peers[TEST_CLIENT_COUNT - 1].received >= (TEST_FRAME_COUNT / 2))
+	{
+		printf("slow peer did not skip intermediate frames\n");
+		goto out;
+	}
+
+	if (peers[0].received <= peers[TEST_CLIENT_COUNT - 1].received)
+	{
+		printf("fast peer was held back by the slow peer\n");
+		goto out;
+	}
+
+	status = 0;
+
+out:
+	for (index = 0; index < TEST_CLIENT_COUNT; index++)
+	{
+		shadow_mailbox_free(peers[index].client->mailbox);
+		free(peers[index].client);
+	}
+
+	region16_uninit(&invalidRegion);
+
+	shadow_capture_free(capture);
+	shadow_surface_free(surface);
+	ArrayList_Free(server->clients);
+	free(server);
+
+	return status;
+}
@@ -107,9 +107,12 @@ static INLINE UINT32 __lzcnt(UINT32 _val32) {
 	return _val32 ? ((UINT32) __builtin_clz(_val32)) : 32;
 }
 
+/* <immintrin.h> may already have brought in the compiler's own version */
+#ifndef _LZCNTINTRIN_H_INCLUDED
 static INLINE UINT16 __lzcnt16(UINT16 _val16) {
 	return _val16 ? ((UINT16) (__builtin_clz((UINT32) _val16) - 16)) : 16;
 }
+#endif
 
 #else
 
@@ -44,8 +44,8 @@ struct _wStream
 };
 typedef struct _wStream wStream;
 
-WINPR_API void Stream_EnsureCapacity(wStream* s, size_t size);
-WINPR_API void Stream_EnsureRemainingCapacity(wStream* s, size_t size);
+WINPR_API BOOL Stream_EnsureCapacity(wStream* s, size_t size);
+WINPR_API BOOL Stream_EnsureRemainingCapacity(wStream* s, size_t size);
 
 WINPR_API wStream* Stream_New(BYTE* buffer, size_t size);
 WINPR_API void Stream_Free(wStream* s, BOOL bFreeBuffer);
@@ -227,21 +227,50 @@ static INLINE BOOL Stream_SafeSeek(wStream* s, size_t size) {
 
 /* StreamPool */
 
+/**
+ * Available streams are kept in power-of-two size classes: class n holds
+ * the streams with a capacity in [2^n, 2^(n+1)). Each thread taking from
+ * or returning to a synchronized pool also keeps a few streams in a cache
+ * of its own, reached without taking the pool lock.
+ */
+
+#define STREAM_POOL_CLASSES	64
+
+typedef struct _wStreamPoolCache wStreamPoolCache;
+
 struct _wStreamPool
 {
-	int aSize;
-	int aCapacity;
-	wStream** aArray;
+	int aSize[STREAM_POOL_CLASSES];
+	int aCapacity[STREAM_POOL_CLASSES];
+	wStream** aArray[STREAM_POOL_CLASSES];
+
+	int tSize;
+	int tCapacity;
+	wStream** tArray;
 
-	int uSize;
-	int uCapacity;
-	wStream** uArray;
+	UINT64 id;
+	wStreamPoolCache* caches;
+
+	UINT64 hits;
+	UINT64 misses;
+	LONG used;
+	LONG highWater;
 
 	CRITICAL_SECTION lock;
 	BOOL synchronized;
 	size_t defaultSize;
 };
 
+struct _wStreamPoolStatistics
+{
+	UINT64 hits;
+	UINT64 misses;
+	UINT32 used;
+	UINT32 highWater;
+	UINT32 total;
+};
+typedef struct _wStreamPoolStatistics wStreamPoolStatistics;
+
 WINPR_API wStream* StreamPool_Take(wStreamPool* pool, size_t size);
 WINPR_API void StreamPool_Return(wStreamPool* pool, wStream* s);
 
@@ -254,6 +283,8 @@ WINPR_API void StreamPool_Release(wStreamPool* pool, BYTE* ptr);
 
 WINPR_API void StreamPool_Clear(wStreamPool* pool);
 
+WINPR_API void StreamPool_GetStatistics(wStreamPool* pool, wStreamPoolStatistics* stats);
+
 WINPR_API wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize);
 WINPR_API void StreamPool_Free(wStreamPool* pool);
 
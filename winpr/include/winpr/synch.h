@@ -354,6 +354,22 @@ WINPR_API int SetEventFileDescriptor(HANDLE hEvent, int FileDescriptor);
 
 WINPR_API void* GetEventWaitObject(HANDLE hEvent);
 
+/**
+ * Wait sets keep the handles of an event loop registered between waits and
+ * report every signalled handle as a bit in pSignaled, by order of addition.
+ */
+
+typedef struct _wWaitSet wWaitSet;
+
+WINPR_API wWaitSet* WaitSet_New(void);
+WINPR_API void WaitSet_Free(wWaitSet* waitSet);
+
+WINPR_API int WaitSet_Add(wWaitSet* waitSet, HANDLE handle);
+WINPR_API void WaitSet_Clear(wWaitSet* waitSet);
+WINPR_API DWORD WaitSet_Count(wWaitSet* waitSet);
+
+WINPR_API DWORD WaitSet_Wait(wWaitSet* waitSet, DWORD dwMilliseconds, UINT64* pSignaled);
+
 #ifdef __cplusplus
 }
 #endif
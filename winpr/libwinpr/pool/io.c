@@ -23,32 +23,394 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/interlocked.h>
+
+#include "pool.h"
+#include "../log.h"
+#define TAG WINPR_TAG("pool")
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#endif
+
+#ifdef _WIN32
+
+static BOOL module_initialized = FALSE;
+static BOOL module_available = FALSE;
+static HMODULE kernel32_module = NULL;
+
+static PTP_IO (WINAPI * pCreateThreadpoolIo)(HANDLE fl, PTP_WIN32_IO_CALLBACK pfnio, PVOID pv, PTP_CALLBACK_ENVIRON pcbe);
+static VOID (WINAPI * pCloseThreadpoolIo)(PTP_IO pio);
+static VOID (WINAPI * pStartThreadpoolIo)(PTP_IO pio);
+static VOID (WINAPI * pCancelThreadpoolIo)(PTP_IO pio);
+static VOID (WINAPI * pWaitForThreadpoolIoCallbacks)(PTP_IO pio, BOOL fCancelPendingCallbacks);
+
+static void module_init()
+{
+	if (module_initialized)
+		return;
+
+	kernel32_module = LoadLibraryA("kernel32.dll");
+	module_initialized = TRUE;
+
+	if (!kernel32_module)
+		return;
+
+	module_available = TRUE;
+	pCreateThreadpoolIo = (void*) GetProcAddress(kernel32_module, "CreateThreadpoolIo");
+	pCloseThreadpoolIo = (void*) GetProcAddress(kernel32_module, "CloseThreadpoolIo");
+	pStartThreadpoolIo = (void*) GetProcAddress(kernel32_module, "StartThreadpoolIo");
+	pCancelThreadpoolIo = (void*) GetProcAddress(kernel32_module, "CancelThreadpoolIo");
+	pWaitForThreadpoolIoCallbacks = (void*) GetProcAddress(kernel32_module, "WaitForThreadpoolIoCallbacks");
+}
+
+#else
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#define TP_IO_EVENT_COUNT	64
+
+static void thread_pool_io_free_closed(TP_IO_QUEUE* queue)
+{
+	PTP_IO io;
+
+	while (queue->Closed)
+	{
+		io = queue->Closed;
+		queue->Closed = io->Next;
+		free(io);
+	}
+}
+
+static void* thread_pool_io_thread(void* arg)
+{
+	int index;
+	int status;
+	PTP_IO io;
+	struct epoll_event events[TP_IO_EVENT_COUNT];
+	TP_IO_QUEUE* queue = (TP_IO_QUEUE*) arg;
+
+	while (1)
+	{
+		status = epoll_wait(queue->EpollFd, events, TP_IO_EVENT_COUNT, -1);
+
+		if ((status < 0) && (errno != EINTR))
+		{
+			WLog_ERR(TAG, "epoll_wait failure: %d", errno);
+			break;
+		}
+
+		/**
+		 * Closed I/O objects are only freed here, once the events returned
+		 * by epoll_wait have been processed: they may still refer to them.
+		 */
+
+		EnterCriticalSection(&queue->Lock);
+
+		if (queue->Terminate)
+		{
+			LeaveCriticalSection(&queue->Lock);
+			break;
+		}
+
+		for (index = 0; index < status; index++)
+		{
+			io = (PTP_IO) events[index].data.ptr;
+
+			if (!io)
+			{
+				ResetEvent(queue->Event);
+				continue;
+			}
+
+			if (io->Closed || (InterlockedCompareExchange(&io->Started, 0, 1) != 1))
+				continue;
+
+			if ((events[index].events & (EPOLLERR | EPOLLHUP)) && !(events[index].events & EPOLLIN))
+				io->IoResult = ERROR_BROKEN_PIPE;
+			else
+				io->IoResult = NO_ERROR;
+
+			SubmitThreadpoolWork(io->Work);
+		}
+
+		thread_pool_io_free_closed(queue);
+
+		LeaveCriticalSection(&queue->Lock);
+	}
+
+	return NULL;
+}
+
+static TP_IO_QUEUE* thread_pool_io_queue(PTP_POOL pool)
+{
+	TP_IO_QUEUE* queue;
+	struct epoll_event event;
+
+	if (pool->IoQueue)
+		return pool->IoQueue;
+
+	EnterCriticalSection(&pool->Lock);
+
+	queue = pool->IoQueue;
+
+	if (!queue)
+	{
+		queue = (TP_IO_QUEUE*) calloc(1, sizeof(TP_IO_QUEUE));
+
+		if (!queue)
+			goto out;
+
+		if (!InitializeCriticalSectionAndSpinCount(&queue->Lock, 4000))
+		{
+			free(queue);
+			queue = NULL;
+			goto out;
+		}
+
+		queue->EpollFd = epoll_create(TP_IO_EVENT_COUNT);
+		queue->Event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		ZeroMemory(&event, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = NULL;
+
+		if ((queue->EpollFd >= 0) && queue->Event &&
+				!epoll_ctl(queue->EpollFd, EPOLL_CTL_ADD, GetEventFileDescriptor(queue->Event), &event))
+		{
+			queue->Thread = CreateThread(NULL, 0,
+					(LPTHREAD_START_ROUTINE) thread_pool_io_thread,
+					(void*) queue, 0, NULL);
+		}
+
+		if (!queue->Thread)
+		{
+			WLog_ERR(TAG, "failed to start the thread pool I/O thread");
+
+			if (queue->EpollFd >= 0)
+				close(queue->EpollFd);
+
+			if (queue->Event)
+				CloseHandle(queue->Event);
+
+			DeleteCriticalSection(&queue->Lock);
+			free(queue);
+			queue = NULL;
+			goto out;
+		}
+
+		pool->IoQueue = queue;
+	}
+
+out:
+	LeaveCriticalSection(&pool->Lock);
+	return queue;
+}
+
+static VOID CALLBACK thread_pool_io_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	PTP_IO io = (PTP_IO) context;
+
+	io->IoCallback(instance, io->CallbackParameter, NULL, io->IoResult, 0, io);
+}
+
+static BOOL thread_pool_io_arm(PTP_IO io, BOOL arm)
+{
+	struct epoll_event event;
+
+	ZeroMemory(&event, sizeof(event));
+	event.events = EPOLLONESHOT | (arm ? EPOLLIN : 0);
+	event.data.ptr = (void*) io;
+
+	return !epoll_ctl(io->Pool->IoQueue->EpollFd, EPOLL_CTL_MOD, io->FileDescriptor, &event);
+}
+
+#endif
+
+VOID ThreadpoolIoQueueFree(PTP_POOL pool)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	TP_IO_QUEUE* queue = pool->IoQueue;
+
+	if (!queue)
+		return;
+
+	EnterCriticalSection(&queue->Lock);
+	queue->Terminate = TRUE;
+	SetEvent(queue->Event);
+	LeaveCriticalSection(&queue->Lock);
+
+	WaitForSingleObject(queue->Thread, INFINITE);
+	CloseHandle(queue->Thread);
+
+	thread_pool_io_free_closed(queue);
+
+	close(queue->EpollFd);
+	CloseHandle(queue->Event);
+	DeleteCriticalSection(&queue->Lock);
+	free(queue);
+
+	pool->IoQueue = NULL;
+#endif
+}
+
+#endif
 
 #ifdef WINPR_THREAD_POOL
 
+/**
+ * On POSIX systems the handle has to be backed by a file descriptor
+ * (events, including those created with CreateFileDescriptorEvent, and
+ * named pipes). The callback reports the handle as readable: it is passed
+ * no OVERLAPPED structure, and performs the read itself.
+ */
+
 PTP_IO CreateThreadpoolIo(HANDLE fl, PTP_WIN32_IO_CALLBACK pfnio, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
 {
-	return NULL;
+	PTP_IO io = NULL;
+#ifdef _WIN32
+	module_init();
+
+	if (pCreateThreadpoolIo)
+		return pCreateThreadpoolIo(fl, pfnio, pv, pcbe);
+
+#elif defined(HAVE_SYS_EPOLL_H)
+	struct epoll_event event;
+
+	io = (PTP_IO) calloc(1, sizeof(TP_IO));
+
+	if (io)
+	{
+		io->Handle = fl;
+		io->IoCallback = pfnio;
+		io->CallbackParameter = pv;
+		io->FileDescriptor = GetEventFileDescriptor(fl);
+
+		if (!pcbe)
+			pcbe = GetDefaultThreadpoolEnvironment();
+
+		io->CallbackEnvironment = pcbe;
+		io->Pool = pcbe->Pool ? pcbe->Pool : GetDefaultThreadpool();
+
+		if ((io->FileDescriptor < 0) || !io->Pool || !thread_pool_io_queue(io->Pool))
+		{
+			WLog_ERR(TAG, "handle does not support thread pool I/O");
+			free(io);
+			return NULL;
+		}
+
+		io->Work = CreateThreadpoolWork(thread_pool_io_callback, (PVOID) io, pcbe);
+
+		if (!io->Work)
+		{
+			free(io);
+			return NULL;
+		}
+
+		/* registered disarmed, StartThreadpoolIo arms it for one notification */
+
+		ZeroMemory(&event, sizeof(event));
+		event.events = EPOLLONESHOT;
+		event.data.ptr = (void*) io;
+
+		if (epoll_ctl(io->Pool->IoQueue->EpollFd, EPOLL_CTL_ADD, io->FileDescriptor, &event) < 0)
+		{
+			WLog_ERR(TAG, "epoll_ctl failure: %d", errno);
+			CloseThreadpoolWork(io->Work);
+			free(io);
+			return NULL;
+		}
+	}
+
+#else
+	WLog_ERR(TAG, "thread pool I/O is not supported on this platform");
+#endif
+	return io;
 }
 
 VOID CloseThreadpoolIo(PTP_IO pio)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pCloseThreadpoolIo)
+		pCloseThreadpoolIo(pio);
+
+#elif defined(HAVE_SYS_EPOLL_H)
+	TP_IO_QUEUE* queue;
+
+	if (!pio)
+		return;
 
+	queue = pio->Pool->IoQueue;
+
+	EnterCriticalSection(&queue->Lock);
+	epoll_ctl(queue->EpollFd, EPOLL_CTL_DEL, pio->FileDescriptor, NULL);
+	pio->Closed = TRUE;
+	LeaveCriticalSection(&queue->Lock);
+
+	WaitForThreadpoolWorkCallbacks(pio->Work, FALSE);
+	CloseThreadpoolWork(pio->Work);
+
+	/* the I/O thread frees it once no returned event can refer to it anymore */
+
+	EnterCriticalSection(&queue->Lock);
+	pio->Next = queue->Closed;
+	queue->Closed = pio;
+	SetEvent(queue->Event);
+	LeaveCriticalSection(&queue->Lock);
+#endif
 }
 
 VOID StartThreadpoolIo(PTP_IO pio)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pStartThreadpoolIo)
+		pStartThreadpoolIo(pio);
+
+#elif defined(HAVE_SYS_EPOLL_H)
+	InterlockedExchange(&pio->Started, 1);
 
+	if (!thread_pool_io_arm(pio, TRUE))
+	{
+		WLog_ERR(TAG, "epoll_ctl failure: %d", errno);
+		InterlockedExchange(&pio->Started, 0);
+	}
+#endif
 }
 
 VOID CancelThreadpoolIo(PTP_IO pio)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pCancelThreadpoolIo)
+		pCancelThreadpoolIo(pio);
 
+#elif defined(HAVE_SYS_EPOLL_H)
+	if (InterlockedCompareExchange(&pio->Started, 0, 1) == 1)
+		thread_pool_io_arm(pio, FALSE);
+#endif
 }
 
 VOID WaitForThreadpoolIoCallbacks(PTP_IO pio, BOOL fCancelPendingCallbacks)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pWaitForThreadpoolIoCallbacks)
+		pWaitForThreadpoolIoCallbacks(pio, fCancelPendingCallbacks);
 
+#elif defined(HAVE_SYS_EPOLL_H)
+	if (fCancelPendingCallbacks)
+		CancelThreadpoolIo(pio);
+
+	WaitForThreadpoolWorkCallbacks(pio->Work, fCancelPendingCallbacks);
+#endif
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -23,6 +23,8 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
 #include "pool.h"
 
@@ -58,96 +60,522 @@ static void module_init()
 
 #else
 
-static TP_POOL DEFAULT_POOL =
+static TP_POOL DEFAULT_POOL;
+static INIT_ONCE DefaultPoolInitOnce = INIT_ONCE_STATIC_INIT;
+static INIT_ONCE WorkerTlsInitOnce = INIT_ONCE_STATIC_INIT;
+static DWORD WorkerTlsIndex = TLS_OUT_OF_INDEXES;
+
+#define thread_pool_barrier()	__sync_synchronize()
+
+/* number of empty passes over the queues before a worker goes to sleep */
+#define TP_WORKER_SPIN_COUNT	32
+
+static BOOL CALLBACK thread_pool_tls_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WorkerTlsIndex = TlsAlloc();
+	return (WorkerTlsIndex != TLS_OUT_OF_INDEXES);
+}
+
+static TP_WORK_ARRAY* thread_pool_array_new(LONG size)
 {
-	0, /* Minimum */
-	500, /* Maximum */
-	NULL, /* Threads */
-	0, /* ThreadCount */
-};
+	TP_WORK_ARRAY* array;
 
-static void* thread_pool_work_func(void* arg)
+	array = (TP_WORK_ARRAY*) calloc(1, sizeof(TP_WORK_ARRAY) + ((size - 1) * sizeof(PTP_WORK)));
+
+	if (array)
+		array->Size = size;
+
+	return array;
+}
+
+/**
+ * Deque indices only ever grow: they are compared through their unsigned
+ * difference so that wrapping around is harmless.
+ */
+
+#define TP_DEQUE_LENGTH(_bottom, _top)	((LONG) ((ULONG) (_bottom) - (ULONG) (_top)))
+
+/**
+ * Frees the arrays the deque has outgrown. A thief counted in after the new
+ * array was published can only read the new one, so the old ones are unused
+ * as soon as no thief is counted.
+ */
+
+static void thread_pool_deque_reclaim(TP_WORKER* worker)
+{
+	TP_WORK_ARRAY* array;
+	TP_WORK_ARRAY* previous;
+
+	array = worker->Array;
+
+	if (!array->Previous)
+		return;
+
+	thread_pool_barrier();
+
+	if (worker->Thieves != 0)
+		return;
+
+	previous = array->Previous;
+	array->Previous = NULL;
+
+	while (previous)
+	{
+		array = previous;
+		previous = array->Previous;
+		free(array);
+	}
+}
+
+static BOOL thread_pool_deque_push(TP_WORKER* worker, PTP_WORK work)
 {
-	DWORD status;
-	PTP_POOL pool;
+	LONG top;
+	LONG index;
+	LONG bottom;
+	TP_WORK_ARRAY* array;
+	TP_WORK_ARRAY* newArray;
+
+	bottom = worker->Bottom;
+	top = worker->Top;
+	array = worker->Array;
+
+	if (TP_DEQUE_LENGTH(bottom, top) >= array->Size)
+	{
+		/* thieves may still be reading the old array, it is kept until they are gone */
+
+		newArray = thread_pool_array_new(array->Size * 2);
+
+		if (!newArray)
+			return FALSE;
+
+		for (index = top; index != bottom; index = (LONG) ((ULONG) index + 1))
+			newArray->Items[index & (newArray->Size - 1)] = array->Items[index & (array->Size - 1)];
+
+		newArray->Previous = array;
+		array = newArray;
+
+		thread_pool_barrier();
+		worker->Array = array;
+	}
+
+	array->Items[bottom & (array->Size - 1)] = work;
+
+	thread_pool_barrier();
+	worker->Bottom = (LONG) ((ULONG) bottom + 1);
+
+	thread_pool_deque_reclaim(worker);
+
+	return TRUE;
+}
+
+static PTP_WORK thread_pool_deque_pop(TP_WORKER* worker)
+{
+	LONG top;
+	LONG bottom;
 	PTP_WORK work;
-	HANDLE events[2];
-	PTP_CALLBACK_INSTANCE callbackInstance;
+	TP_WORK_ARRAY* array;
 
-	pool = (PTP_POOL) arg;
+	array = worker->Array;
+	bottom = (LONG) ((ULONG) worker->Bottom - 1);
+	InterlockedExchange(&worker->Bottom, bottom);
+	top = worker->Top;
+
+	if (TP_DEQUE_LENGTH(bottom, top) < 0)
+	{
+		worker->Bottom = (LONG) ((ULONG) bottom + 1);
+		thread_pool_deque_reclaim(worker);
+		return NULL;
+	}
 
-	events[0] = pool->TerminateEvent;
-	events[1] = Queue_Event(pool->PendingQueue);
+	work = array->Items[bottom & (array->Size - 1)];
 
-	while (1)
+	if (bottom == top)
 	{
-		status = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+		/* last item: race against the thieves for it */
 
-		if (status == WAIT_OBJECT_0)
-			break;
+		if (InterlockedCompareExchange(&worker->Top, (LONG) ((ULONG) top + 1), top) != top)
+			work = NULL;
 
-		if (status != (WAIT_OBJECT_0 + 1))
-			break;
+		worker->Bottom = (LONG) ((ULONG) bottom + 1);
+	}
 
-		callbackInstance = (PTP_CALLBACK_INSTANCE) Queue_Dequeue(pool->PendingQueue);
+	return work;
+}
+
+static PTP_WORK thread_pool_deque_steal(TP_WORKER* worker)
+{
+	LONG top;
+	LONG bottom;
+	PTP_WORK work;
+	TP_WORK_ARRAY* array;
 
-		if (callbackInstance)
+	top = worker->Top;
+	thread_pool_barrier();
+	bottom = worker->Bottom;
+
+	if (TP_DEQUE_LENGTH(bottom, top) <= 0)
+		return NULL;
+
+	InterlockedIncrement(&worker->Thieves);
+
+	array = worker->Array;
+	work = array->Items[top & (array->Size - 1)];
+
+	InterlockedDecrement(&worker->Thieves);
+
+	if (InterlockedCompareExchange(&worker->Top, (LONG) ((ULONG) top + 1), top) != top)
+		return NULL;
+
+	return work;
+}
+
+static void thread_pool_inject(PTP_POOL pool, PTP_WORK work)
+{
+	PTP_WORK head;
+
+	do
+	{
+		head = pool->Injected;
+		work->Next = head;
+	}
+	while (InterlockedCompareExchangePointer((PVOID volatile*) &pool->Injected, work, head) != head);
+}
+
+static void thread_pool_wake(PTP_POOL pool)
+{
+	if (pool->IdleCount < 1)
+		return;
+
+	pthread_mutex_lock(&pool->WakeMutex);
+	pool->WakeCount++;
+	pthread_cond_signal(&pool->WakeCond);
+	pthread_mutex_unlock(&pool->WakeMutex);
+}
+
+static PTP_WORK thread_pool_find_work(TP_WORKER* worker)
+{
+	LONG index;
+	LONG count;
+	PTP_WORK work;
+	PTP_WORK next;
+	PTP_POOL pool = worker->Pool;
+
+	work = thread_pool_deque_pop(worker);
+
+	if (work)
+		return work;
+
+	/**
+	 * Take everything submitted from outside of the pool at once, and move it
+	 * to the own deque where other workers can steal it. The injected list is
+	 * last-in first-out, pushing it in that order leaves the oldest at the bottom.
+	 */
+
+	if (pool->Injected)
+	{
+		do
 		{
-			work = callbackInstance->Work;
-			work->WorkCallback(callbackInstance, work->CallbackParameter, work);
-			CountdownEvent_Signal(pool->WorkComplete, 1);
-			free(callbackInstance);
+			work = pool->Injected;
 		}
+		while (work && (InterlockedCompareExchangePointer((PVOID volatile*) &pool->Injected, NULL, work) != work));
+
+		for (; work; work = next)
+		{
+			next = work->Next;
+
+			if (!thread_pool_deque_push(worker, work))
+				thread_pool_inject(pool, work);
+		}
+
+		work = thread_pool_deque_pop(worker);
+
+		if (work)
+		{
+			thread_pool_wake(pool);
+			return work;
+		}
+	}
+
+	count = pool->WorkerCount;
+
+	if (count < 2)
+		return NULL;
+
+	worker->Seed = (worker->Seed * 1103515245) + 12345;
+	index = (LONG) ((worker->Seed >> 16) % count);
+
+	for (count = pool->WorkerCount; count > 0; count--)
+	{
+		if (pool->Workers[index] != worker)
+		{
+			work = thread_pool_deque_steal(pool->Workers[index]);
+
+			if (work)
+				return work;
+		}
+
+		index = (index + 1) % pool->WorkerCount;
 	}
 
-	ExitThread(0);
 	return NULL;
 }
 
-static void threads_close(void *thread)
+static void thread_pool_post(PTP_POOL pool, TP_WORKER* worker, PTP_WORK work)
+{
+	if (!worker || !thread_pool_deque_push(worker, work))
+		thread_pool_inject(pool, work);
+
+	/**
+	 * The work has to be visible before the idle count is read, pairing with
+	 * the increment of the idle count before the last look of a sleeping worker.
+	 */
+
+	thread_pool_barrier();
+	thread_pool_wake(pool);
+}
+
+static TP_WORKER* thread_pool_current_worker(PTP_POOL pool)
+{
+	TP_WORKER* worker;
+
+	if (WorkerTlsIndex == TLS_OUT_OF_INDEXES)
+		return NULL;
+
+	worker = (TP_WORKER*) TlsGetValue(WorkerTlsIndex);
+
+	return (worker && (worker->Pool == pool)) ? worker : NULL;
+}
+
+/**
+ * Takes the work object out of the queue it was popped from: it is queued
+ * again right away if it was submitted in the meantime, otherwise the
+ * reference held on behalf of the queue is released.
+ */
+
+static void thread_pool_work_dequeued(TP_WORKER* worker, PTP_WORK work)
 {
-	WaitForSingleObject(thread, INFINITE);
-	CloseHandle(thread);
+	InterlockedExchange(&work->InQueue, 0);
+
+	if ((work->Queued > 0) && (InterlockedCompareExchange(&work->InQueue, 1, 0) == 0))
+	{
+		thread_pool_post(worker->Pool, worker, work);
+		return;
+	}
+
+	ThreadpoolWorkRelease(work, 1);
 }
 
-void InitializeThreadpool(PTP_POOL pool)
+static void thread_pool_run_work(TP_WORKER* worker, PTP_WORK work)
 {
-	int index;
-	HANDLE thread;
+	LONG queued;
+	TP_CALLBACK_INSTANCE callbackInstance;
 
-	if (!pool->Threads)
+	do
 	{
-		pool->Minimum = 0;
-		pool->Maximum = 500;
+		queued = work->Queued;
 
-		pool->Threads = ArrayList_New(TRUE);
-		pool->Threads->object.fnObjectFree = threads_close;
+		if (queued < 1)
+		{
+			/* all pending callbacks were cancelled */
+			thread_pool_work_dequeued(worker, work);
+			return;
+		}
+	}
+	while (InterlockedCompareExchange(&work->Queued, queued - 1, queued) != queued);
+
+	/* leave the remaining callbacks of this work object to other workers */
 
-		pool->PendingQueue = Queue_New(TRUE, -1, -1);
-		pool->WorkComplete = CountdownEvent_New(0);
+	if (queued > 1)
+		thread_pool_post(worker->Pool, worker, work);
+	else
+		thread_pool_work_dequeued(worker, work);
 
-		pool->TerminateEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	callbackInstance.Work = work;
+	work->WorkCallback(&callbackInstance, work->CallbackParameter, work);
+
+	ThreadpoolWorkRelease(work, 1);
+}
 
-		for (index = 0; index < 4; index++)
+static void* thread_pool_work_func(void* arg)
+{
+	int spin;
+	PTP_WORK work;
+	TP_WORKER* worker = (TP_WORKER*) arg;
+	PTP_POOL pool = worker->Pool;
+
+	TlsSetValue(WorkerTlsIndex, worker);
+
+	while (!pool->Terminate)
+	{
+		work = thread_pool_find_work(worker);
+
+		for (spin = 0; !work && (spin < TP_WORKER_SPIN_COUNT); spin++)
+		{
+			SwitchToThread();
+			work = thread_pool_find_work(worker);
+		}
+
+		if (!work)
 		{
-			thread = CreateThread(NULL, 0,
-					(LPTHREAD_START_ROUTINE) thread_pool_work_func,
-					(void*) pool, 0, NULL);
+			/**
+			 * Announce being idle before looking a last time: a submitter either
+			 * sees the idle count and leaves a wake-up, or its work is found here.
+			 */
 
-			ArrayList_Add(pool->Threads, thread);
+			InterlockedIncrement(&pool->IdleCount);
+
+			work = thread_pool_find_work(worker);
+
+			if (!work)
+			{
+				pthread_mutex_lock(&pool->WakeMutex);
+
+				while (!pool->WakeCount && !pool->Terminate)
+					pthread_cond_wait(&pool->WakeCond, &pool->WakeMutex);
+
+				if (pool->WakeCount)
+					pool->WakeCount--;
+
+				pthread_mutex_unlock(&pool->WakeMutex);
+			}
+
+			InterlockedDecrement(&pool->IdleCount);
 		}
+
+		if (work)
+			thread_pool_run_work(worker, work);
 	}
+
+	return NULL;
 }
 
-PTP_POOL GetDefaultThreadpool()
+static BOOL thread_pool_add_worker(PTP_POOL pool)
 {
-	PTP_POOL pool = NULL;
+	TP_WORKER* worker;
+	DWORD index = (DWORD) pool->WorkerCount;
 
-	pool = &DEFAULT_POOL;
+	if ((index >= pool->Maximum) || (index >= TP_POOL_MAX_WORKERS))
+		return FALSE;
 
-	InitializeThreadpool(pool);
+	worker = (TP_WORKER*) calloc(1, sizeof(TP_WORKER));
 
-	return pool;
+	if (!worker)
+		return FALSE;
+
+	worker->Pool = pool;
+	worker->Index = index;
+	worker->Seed = index + 1;
+	worker->Array = thread_pool_array_new(TP_WORKER_DEQUE_SIZE);
+
+	if (!worker->Array)
+	{
+		free(worker);
+		return FALSE;
+	}
+
+	pool->Workers[index] = worker;
+
+	worker->Thread = CreateThread(NULL, 0,
+			(LPTHREAD_START_ROUTINE) thread_pool_work_func,
+			(void*) worker, 0, NULL);
+
+	if (!worker->Thread)
+	{
+		pool->Workers[index] = NULL;
+		free(worker->Array);
+		free(worker);
+		return FALSE;
+	}
+
+	InterlockedIncrement(&pool->WorkerCount);
+
+	return TRUE;
+}
+
+/**
+ * Workers are started on demand, up to one per processor within the limits
+ * set with SetThreadpoolThreadMinimum and SetThreadpoolThreadMaximum.
+ */
+
+static void thread_pool_grow(PTP_POOL pool, DWORD count)
+{
+	if ((DWORD) pool->WorkerCount >= count)
+		return;
+
+	EnterCriticalSection(&pool->Lock);
+
+	while ((DWORD) pool->WorkerCount < count)
+	{
+		if (!thread_pool_add_worker(pool))
+			break;
+	}
+
+	LeaveCriticalSection(&pool->Lock);
+}
+
+static DWORD thread_pool_target(PTP_POOL pool)
+{
+	DWORD count = pool->Processors;
+
+	if (count < pool->Minimum)
+		count = pool->Minimum;
+
+	if (count > pool->Maximum)
+		count = pool->Maximum;
+
+	return count ? count : 1;
+}
+
+BOOL ThreadpoolPostWork(PTP_POOL pool, PTP_WORK work)
+{
+	thread_pool_grow(pool, thread_pool_target(pool));
+
+	if (pool->WorkerCount < 1)
+		return FALSE;
+
+	thread_pool_post(pool, thread_pool_current_worker(pool), work);
+
+	return TRUE;
+}
+
+BOOL InitializeThreadpool(PTP_POOL pool)
+{
+	SYSTEM_INFO sysinfo;
+
+	if (pool->Initialized)
+		return TRUE;
+
+	if (!InitOnceExecuteOnce(&WorkerTlsInitOnce, thread_pool_tls_init, NULL, NULL))
+		return FALSE;
+
+	GetNativeSystemInfo(&sysinfo);
+
+	pool->Minimum = 0;
+	pool->Maximum = 500;
+	pool->Processors = sysinfo.dwNumberOfProcessors;
+
+	if (!InitializeCriticalSectionAndSpinCount(&pool->Lock, 4000))
+		return FALSE;
+
+	pthread_mutex_init(&pool->WakeMutex, NULL);
+	pthread_cond_init(&pool->WakeCond, NULL);
+
+	pool->Initialized = TRUE;
+
+	return TRUE;
+}
+
+static BOOL CALLBACK thread_pool_default_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	return InitializeThreadpool(&DEFAULT_POOL);
+}
+
+PTP_POOL GetDefaultThreadpool()
+{
+	if (!InitOnceExecuteOnce(&DefaultPoolInitOnce, thread_pool_default_init, NULL, NULL))
+		return NULL;
+
+	return &DEFAULT_POOL;
 }
 
 #endif
@@ -166,8 +594,11 @@ PTP_POOL CreateThreadpool(PVOID reserved)
 #else
 	pool = (PTP_POOL) calloc(1, sizeof(TP_POOL));
 
-	if (pool)
-		InitializeThreadpool(pool);
+	if (pool && !InitializeThreadpool(pool))
+	{
+		free(pool);
+		pool = NULL;
+	}
 #endif
 
 	return pool;
@@ -181,12 +612,44 @@ VOID CloseThreadpool(PTP_POOL ptpp)
 	if (pCloseThreadpool)
 		pCloseThreadpool(ptpp);
 #else
-	SetEvent(ptpp->TerminateEvent);
+	LONG index;
+	TP_WORKER* worker;
+	TP_WORK_ARRAY* array;
+
+	ThreadpoolTimerQueueFree(ptpp);
+	ThreadpoolIoQueueFree(ptpp);
+
+	pthread_mutex_lock(&ptpp->WakeMutex);
+	ptpp->Terminate = TRUE;
+	pthread_cond_broadcast(&ptpp->WakeCond);
+	pthread_mutex_unlock(&ptpp->WakeMutex);
+
+	/* workers steal from each other until they exit, all of them are joined first */
+
+	for (index = 0; index < ptpp->WorkerCount; index++)
+	{
+		worker = ptpp->Workers[index];
+		WaitForSingleObject(worker->Thread, INFINITE);
+	}
+
+	for (index = 0; index < ptpp->WorkerCount; index++)
+	{
+		worker = ptpp->Workers[index];
+		CloseHandle(worker->Thread);
 
-	ArrayList_Free(ptpp->Threads);
-	Queue_Free(ptpp->PendingQueue);
-	CountdownEvent_Free(ptpp->WorkComplete);
-	CloseHandle(ptpp->TerminateEvent);
+		while (worker->Array)
+		{
+			array = worker->Array;
+			worker->Array = array->Previous;
+			free(array);
+		}
+
+		free(worker);
+	}
+
+	pthread_cond_destroy(&ptpp->WakeCond);
+	pthread_mutex_destroy(&ptpp->WakeMutex);
+	DeleteCriticalSection(&ptpp->Lock);
 
 	free(ptpp);
 #endif
@@ -200,18 +663,19 @@ BOOL SetThreadpoolThreadMinimum(PTP_POOL ptpp, DWORD cthrdMic)
 	if (pSetThreadpoolThreadMinimum)
 		return pSetThreadpoolThreadMinimum(ptpp, cthrdMic);
 #else
-	HANDLE thread;
+	EnterCriticalSection(&ptpp->Lock);
 
 	ptpp->Minimum = cthrdMic;
 
-	while (ArrayList_Count(ptpp->Threads) < ptpp->Minimum)
-	{
-		thread = CreateThread(NULL, 0,
-				(LPTHREAD_START_ROUTINE) thread_pool_work_func,
-				(void*) ptpp, 0, NULL);
+	if (ptpp->Maximum < ptpp->Minimum)
+		ptpp->Maximum = ptpp->Minimum;
 
-		ArrayList_Add(ptpp->Threads, thread);
-	}
+	LeaveCriticalSection(&ptpp->Lock);
+
+	thread_pool_grow(ptpp, cthrdMic);
+
+	if (((DWORD) ptpp->WorkerCount < cthrdMic) && (ptpp->WorkerCount < TP_POOL_MAX_WORKERS))
+		return FALSE;
 #endif
 	return TRUE;
 }
@@ -224,7 +688,16 @@ VOID SetThreadpoolThreadMaximum(PTP_POOL ptpp, DWORD cthrdMost)
 	if (pSetThreadpoolThreadMaximum)
 		pSetThreadpoolThreadMaximum(ptpp, cthrdMost);
 #else
+	/* workers which are already running are kept */
+
+	EnterCriticalSection(&ptpp->Lock);
+
 	ptpp->Maximum = cthrdMost;
+
+	if (ptpp->Minimum > ptpp->Maximum)
+		ptpp->Minimum = ptpp->Maximum;
+
+	LeaveCriticalSection(&ptpp->Lock);
 #endif
 }
 
@@ -25,31 +25,128 @@
 #include <winpr/thread.h>
 #include <winpr/collections.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#define TP_POOL_MAX_WORKERS		256
+#define TP_WORKER_DEQUE_SIZE		64
+
+#define TP_TIMER_WHEEL_SIZE		256
+
+typedef struct _TP_WORKER TP_WORKER;
+typedef struct _TP_WORK_ARRAY TP_WORK_ARRAY;
+typedef struct _TP_TIMER_QUEUE TP_TIMER_QUEUE;
+typedef struct _TP_IO_QUEUE TP_IO_QUEUE;
+
+/**
+ * Callback instances only live for the duration of a callback,
+ * they are kept on the stack of the worker thread running it.
+ */
+
 struct _TP_CALLBACK_INSTANCE
 {
 	PTP_WORK Work;
 };
 
+struct _TP_WORK_ARRAY
+{
+	LONG Size;
+	TP_WORK_ARRAY* Previous;
+	PTP_WORK Items[1];
+};
+
+/**
+ * Each worker owns a work-stealing deque (Chase-Lev): the owner pushes
+ * and pops at the bottom without locking, idle workers steal from the top.
+ * Thieves count themselves in while they may hold the array, outgrown
+ * arrays are freed by the owner once none is left.
+ */
+
+struct _TP_WORKER
+{
+	PTP_POOL Pool;
+	HANDLE Thread;
+	DWORD Index;
+	UINT32 Seed;
+	volatile LONG Top;
+	volatile LONG Bottom;
+	volatile LONG Thieves;
+	TP_WORK_ARRAY* volatile Array;
+};
+
 struct _TP_POOL
 {
 	DWORD Minimum;
 	DWORD Maximum;
-	wArrayList* Threads;
-	wQueue* PendingQueue;
-	HANDLE TerminateEvent;
-	wCountdownEvent* WorkComplete;
+	DWORD Processors;
+	BOOL Initialized;
+	CRITICAL_SECTION Lock;
+	TP_WORKER* Workers[TP_POOL_MAX_WORKERS];
+	volatile LONG WorkerCount;
+	PTP_WORK volatile Injected;
+	volatile LONG Terminate;
+	volatile LONG IdleCount;
+	TP_TIMER_QUEUE* TimerQueue;
+	TP_IO_QUEUE* IoQueue;
+#ifndef _WIN32
+	LONG WakeCount;
+	pthread_mutex_t WakeMutex;
+	pthread_cond_t WakeCond;
+#endif
 };
 
+/**
+ * Submissions of the same work object are coalesced: Queued counts the
+ * callbacks which have yet to start, and the work object itself sits in at
+ * most one queue at a time (InQueue). Pending counts the queued and running
+ * callbacks, plus one while the work object is queued, so that waiting on
+ * a work object does not depend on any other work submitted to the pool.
+ */
+
 struct _TP_WORK
 {
 	PVOID CallbackParameter;
 	PTP_WORK_CALLBACK WorkCallback;
 	PTP_CALLBACK_ENVIRON CallbackEnvironment;
+	PTP_POOL Pool;
+	PTP_WORK Next;
+	volatile LONG Queued;
+	volatile LONG InQueue;
+	volatile LONG Pending;
+	CRITICAL_SECTION Lock;
+	HANDLE CompletionEvent;
+};
+
+/**
+ * Timers of a pool are kept in a hashed timing wheel with one slot per
+ * millisecond, serviced by a single thread which submits the expired ones.
+ */
+
+struct _TP_TIMER_QUEUE
+{
+	CRITICAL_SECTION Lock;
+	HANDLE Thread;
+	HANDLE Event;
+	BOOL Terminate;
+	UINT64 Current;
+	UINT64 Wakeup;
+	DWORD Count;
+	PTP_TIMER Slots[TP_TIMER_WHEEL_SIZE];
 };
 
 struct _TP_TIMER
 {
-	void* dummy;
+	PVOID CallbackParameter;
+	PTP_TIMER_CALLBACK TimerCallback;
+	PTP_CALLBACK_ENVIRON CallbackEnvironment;
+	PTP_POOL Pool;
+	PTP_WORK Work;
+	BOOL Armed;
+	UINT64 DueTime;
+	DWORD Period;
+	PTP_TIMER Prev;
+	PTP_TIMER Next;
 };
 
 struct _TP_WAIT
@@ -57,9 +154,35 @@ struct _TP_WAIT
 	void* dummy;
 };
 
+/**
+ * I/O objects are readiness based: StartThreadpoolIo arms a one-shot
+ * notification on the file descriptor of the handle, and the callback
+ * is run on the pool once the handle becomes readable.
+ */
+
+struct _TP_IO_QUEUE
+{
+	CRITICAL_SECTION Lock;
+	HANDLE Thread;
+	HANDLE Event;
+	int EpollFd;
+	BOOL Terminate;
+	PTP_IO Closed;
+};
+
 struct _TP_IO
 {
-	void* dummy;
+	PVOID CallbackParameter;
+	PTP_WIN32_IO_CALLBACK IoCallback;
+	PTP_CALLBACK_ENVIRON CallbackEnvironment;
+	PTP_POOL Pool;
+	PTP_WORK Work;
+	HANDLE Handle;
+	int FileDescriptor;
+	BOOL Closed;
+	ULONG IoResult;
+	volatile LONG Started;
+	PTP_IO Next;
 };
 
 struct _TP_CLEANUP_GROUP
@@ -69,9 +192,16 @@ struct _TP_CLEANUP_GROUP
 
 #ifndef _WIN32
 
+BOOL InitializeThreadpool(PTP_POOL pool);
 PTP_POOL GetDefaultThreadpool(void);
 PTP_CALLBACK_ENVIRON GetDefaultThreadpoolEnvironment(void);
 
+BOOL ThreadpoolPostWork(PTP_POOL pool, PTP_WORK work);
+VOID ThreadpoolWorkRelease(PTP_WORK work, LONG count);
+
+VOID ThreadpoolTimerQueueFree(PTP_POOL pool);
+VOID ThreadpoolIoQueueFree(PTP_POOL pool);
+
 #endif
 
 #endif /* WINPR_POOL_PRIVATE_H */
@@ -1,9 +1,87 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+static LONG count = 0;
+
+void CALLBACK test_IoCallback(PTP_CALLBACK_INSTANCE instance, void* context, void* overlapped,
+		ULONG ioResult, ULONG_PTR numberOfBytesTransferred, PTP_IO io)
+{
+	InterlockedIncrement(&count);
+	SetEvent((HANDLE) context);
+}
 
 int TestPoolIO(int argc, char* argv[])
 {
+#ifndef _WIN32
+	PTP_IO io;
+	HANDLE handle;
+	HANDLE done;
+
+	/* on POSIX systems, any handle backed by a file descriptor can be used */
+
+	handle = CreateEvent(NULL, TRUE, FALSE, NULL);
+	done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	io = CreateThreadpoolIo(handle, (PTP_WIN32_IO_CALLBACK) test_IoCallback, (void*) done, NULL);
+
+	if (!io)
+	{
+		printf("CreateThreadpoolIo failure\n");
+		return -1;
+	}
+
+	StartThreadpoolIo(io);
+	SetEvent(handle);
+
+	if (WaitForSingleObject(done, 5000) != WAIT_OBJECT_0)
+	{
+		printf("I/O callback was not called\n");
+		return -1;
+	}
+
+	WaitForThreadpoolIoCallbacks(io, FALSE);
+
+	/* notifications are one-shot, and a cancelled one is never delivered */
+
+	ResetEvent(done);
+	ResetEvent(handle);
+	StartThreadpoolIo(io);
+	CancelThreadpoolIo(io);
+	SetEvent(handle);
+
+	Sleep(100);
+
+	if ((count != 1) || (WaitForSingleObject(done, 0) == WAIT_OBJECT_0))
+	{
+		printf("I/O callback called %d times, expected 1\n", count);
+		return -1;
+	}
+
+	/* and an armed one is delivered again once the handle is readable */
+
+	StartThreadpoolIo(io);
+
+	if (WaitForSingleObject(done, 5000) != WAIT_OBJECT_0)
+	{
+		printf("I/O callback was not called again\n");
+		return -1;
+	}
+
+	WaitForThreadpoolIoCallbacks(io, FALSE);
+
+	if (count != 2)
+	{
+		printf("I/O callback called %d times, expected 2\n", count);
+		return -1;
+	}
+
+	CloseThreadpoolIo(io);
+	CloseHandle(handle);
+	CloseHandle(done);
+#endif
 	return 0;
 }
 
@@ -1,9 +1,113 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+
+struct _TEST_TIMER
+{
+	LONG count;
+	LONG expected;
+	HANDLE event;
+};
+typedef struct _TEST_TIMER TEST_TIMER;
+
+void CALLBACK test_TimerCallback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_TIMER timer)
+{
+	TEST_TIMER* test = (TEST_TIMER*) context;
+
+	if (InterlockedIncrement(&test->count) == test->expected)
+		SetEvent(test->event);
+}
+
+static void test_due_time(FILETIME* dueTime, LONGLONG ms)
+{
+	ULARGE_INTEGER due;
+
+	/* negative due times are relative, in 100-nanosecond intervals */
+
+	due.QuadPart = (ULONGLONG) (-ms * 10000);
+	dueTime->dwLowDateTime = due.LowPart;
+	dueTime->dwHighDateTime = due.HighPart;
+}
 
 int TestPoolTimer(int argc, char* argv[])
 {
+	FILETIME dueTime;
+	PTP_TIMER timer;
+	TEST_TIMER test;
+
+	ZeroMemory(&test, sizeof(test));
+	test.expected = 10;
+	test.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	timer = CreateThreadpoolTimer((PTP_TIMER_CALLBACK) test_TimerCallback, (void*) &test, NULL);
+
+	if (!timer)
+	{
+		printf("CreateThreadpoolTimer failure\n");
+		return -1;
+	}
+
+	if (IsThreadpoolTimerSet(timer))
+	{
+		printf("IsThreadpoolTimerSet: new timer is set\n");
+		return -1;
+	}
+
+	/* periodic timer */
+
+	test_due_time(&dueTime, 10);
+	SetThreadpoolTimer(timer, &dueTime, 10, 0);
+
+	if (!IsThreadpoolTimerSet(timer))
+	{
+		printf("IsThreadpoolTimerSet: periodic timer is not set\n");
+		return -1;
+	}
+
+	if (WaitForSingleObject(test.event, 5000) != WAIT_OBJECT_0)
+	{
+		printf("periodic timer: %d callbacks, expected %d\n", test.count, test.expected);
+		return -1;
+	}
+
+	SetThreadpoolTimer(timer, NULL, 0, 0);
+	WaitForThreadpoolTimerCallbacks(timer, TRUE);
+
+	if (IsThreadpoolTimerSet(timer))
+	{
+		printf("IsThreadpoolTimerSet: stopped timer is set\n");
+		return -1;
+	}
+
+	/* one-shot timer */
+
+	test.count = 0;
+	test.expected = 1;
+	ResetEvent(test.event);
+
+	test_due_time(&dueTime, 20);
+	SetThreadpoolTimer(timer, &dueTime, 0, 0);
+
+	if (WaitForSingleObject(test.event, 5000) != WAIT_OBJECT_0)
+	{
+		printf("one-shot timer did not expire\n");
+		return -1;
+	}
+
+	Sleep(50);
+	WaitForThreadpoolTimerCallbacks(timer, FALSE);
+
+	if ((test.count != 1) || IsThreadpoolTimerSet(timer))
+	{
+		printf("one-shot timer: %d callbacks, expected 1\n", test.count);
+		return -1;
+	}
+
+	CloseThreadpoolTimer(timer);
+	CloseHandle(test.event);
+
 	return 0;
 }
 
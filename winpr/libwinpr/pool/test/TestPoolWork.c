@@ -2,9 +2,26 @@
 #include <winpr/crt.h>
 #include <winpr/pool.h>
 #include <winpr/interlocked.h>
+#include <winpr/sysinfo.h>
+
+#define TEST_SUBMITTER_COUNT	8
+#define TEST_SUBMIT_COUNT	2000
+#define TEST_GROWTH_WORK_COUNT	1000
+#define TEST_GROWTH_ROUNDS	50
 
 static LONG count = 0;
 
+struct _TEST_SUBMITTER
+{
+	PTP_WORK work;
+	PTP_WORK fanout;
+	volatile LONG count;
+	volatile LONG fanoutCount;
+	LONG expected;
+	BOOL failed;
+};
+typedef struct _TEST_SUBMITTER TEST_SUBMITTER;
+
 void CALLBACK test_WorkCallback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
 {
 	int index;
@@ -27,6 +44,198 @@ void CALLBACK test_WorkCallback(PTP_CALLBACK_INSTANCE instance, void* context, P
 	}
 }
 
+void CALLBACK test_CountCallback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	InterlockedIncrement((LONG*) context);
+}
+
+void CALLBACK test_FanoutCallback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+{
+	int index;
+	TEST_SUBMITTER* submitter = (TEST_SUBMITTER*) context;
+
+	/* work submitted from a callback goes to the worker's own queue */
+
+	for (index = 0; index < 4; index++)
+		SubmitThreadpoolWork(submitter->work);
+
+	InterlockedIncrement(&submitter->fanoutCount);
+}
+
+static void* test_submitter_thread(void* arg)
+{
+	int index;
+	TEST_SUBMITTER* submitter = (TEST_SUBMITTER*) arg;
+
+	for (index = 0; index < TEST_SUBMIT_COUNT; index++)
+	{
+		SubmitThreadpoolWork(submitter->work);
+
+		if ((index % 100) == 0)
+			SubmitThreadpoolWork(submitter->fanout);
+
+		if ((index % 500) == 499)
+		{
+			/* only the callbacks of the fan-out work object are waited for */
+
+			WaitForThreadpoolWorkCallbacks(submitter->fanout, FALSE);
+		}
+	}
+
+	WaitForThreadpoolWorkCallbacks(submitter->fanout, FALSE);
+	WaitForThreadpoolWorkCallbacks(submitter->work, FALSE);
+
+	submitter->expected = TEST_SUBMIT_COUNT + (submitter->fanoutCount * 4);
+
+	if (submitter->count != submitter->expected)
+		submitter->failed = TRUE;
+
+	return NULL;
+}
+
+static int test_concurrent_submitters(PTP_CALLBACK_ENVIRON environment, const char* name)
+{
+	int index;
+	int status = 0;
+	UINT64 begin;
+	HANDLE threads[TEST_SUBMITTER_COUNT];
+	TEST_SUBMITTER submitters[TEST_SUBMITTER_COUNT];
+
+	ZeroMemory(submitters, sizeof(submitters));
+
+	begin = GetTickCount64();
+
+	for (index = 0; index < TEST_SUBMITTER_COUNT; index++)
+	{
+		submitters[index].work = CreateThreadpoolWork((PTP_WORK_CALLBACK) test_CountCallback,
+				(void*) &submitters[index].count, environment);
+		submitters[index].fanout = CreateThreadpoolWork((PTP_WORK_CALLBACK) test_FanoutCallback,
+				(void*) &submitters[index], environment);
+
+		if (!submitters[index].work || !submitters[index].fanout)
+		{
+			printf("CreateThreadpoolWork failure\n");
+			return -1;
+		}
+	}
+
+	for (index = 0; index < TEST_SUBMITTER_COUNT; index++)
+	{
+		threads[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_submitter_thread,
+				(void*) &submitters[index], 0, NULL);
+	}
+
+	for (index = 0; index < TEST_SUBMITTER_COUNT; index++)
+	{
+		WaitForSingleObject(threads[index], INFINITE);
+		CloseHandle(threads[index]);
+
+		if (submitters[index].failed)
+		{
+			printf("%s: submitter %d counted %d callbacks, expected %d\n", name, index,
+					submitters[index].count, submitters[index].expected);
+			status = -1;
+		}
+
+		CloseThreadpoolWork(submitters[index].work);
+		CloseThreadpoolWork(submitters[index].fanout);
+	}
+
+	printf("%s: %d concurrent submitters: %d ms\n", name, TEST_SUBMITTER_COUNT,
+			(int) (GetTickCount64() - begin));
+
+	return status;
+}
+
+static int test_cancel_pending(PTP_CALLBACK_ENVIRON environment)
+{
+	int index;
+	LONG counter = 0;
+	PTP_WORK work;
+
+	work = CreateThreadpoolWork((PTP_WORK_CALLBACK) test_CountCallback, (void*) &counter, environment);
+
+	if (!work)
+		return -1;
+
+	for (index = 0; index < 10000; index++)
+		SubmitThreadpoolWork(work);
+
+	WaitForThreadpoolWorkCallbacks(work, TRUE);
+
+	if ((counter < 0) || (counter > 10000))
+	{
+		printf("cancel: unexpected callback count %d\n", counter);
+		return -1;
+	}
+
+	/* a cancelled work object can be submitted again */
+
+	counter = 0;
+
+	for (index = 0; index < 100; index++)
+		SubmitThreadpoolWork(work);
+
+	WaitForThreadpoolWorkCallbacks(work, FALSE);
+	CloseThreadpoolWork(work);
+
+	if (counter != 100)
+	{
+		printf("cancel: %d callbacks after resubmission, expected 100\n", counter);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * A worker moves all work submitted from outside of the pool to its own
+ * queue: many distinct work objects at once grow it while the other
+ * workers steal from it, and the outgrown arrays are freed under them.
+ */
+
+static int test_deque_growth(PTP_CALLBACK_ENVIRON environment)
+{
+	int index;
+	int round;
+	int status = 0;
+	LONG counter = 0;
+	PTP_WORK works[TEST_GROWTH_WORK_COUNT];
+
+	for (index = 0; index < TEST_GROWTH_WORK_COUNT; index++)
+	{
+		works[index] = CreateThreadpoolWork((PTP_WORK_CALLBACK) test_CountCallback,
+				(void*) &counter, environment);
+
+		if (!works[index])
+		{
+			printf("CreateThreadpoolWork failure\n");
+			return -1;
+		}
+	}
+
+	for (round = 0; round < TEST_GROWTH_ROUNDS; round++)
+	{
+		for (index = 0; index < TEST_GROWTH_WORK_COUNT; index++)
+			SubmitThreadpoolWork(works[index]);
+
+		for (index = 0; index < TEST_GROWTH_WORK_COUNT; index++)
+			WaitForThreadpoolWorkCallbacks(works[index], FALSE);
+	}
+
+	for (index = 0; index < TEST_GROWTH_WORK_COUNT; index++)
+		CloseThreadpoolWork(works[index]);
+
+	if (counter != (TEST_GROWTH_WORK_COUNT * TEST_GROWTH_ROUNDS))
+	{
+		printf("deque growth: %d callbacks, expected %d\n", counter,
+				TEST_GROWTH_WORK_COUNT * TEST_GROWTH_ROUNDS);
+		status = -1;
+	}
+
+	return status;
+}
+
 int TestPoolWork(int argc, char* argv[])
 {
 	int index;
@@ -56,6 +265,15 @@ int TestPoolWork(int argc, char* argv[])
 	WaitForThreadpoolWorkCallbacks(work, FALSE);
 	CloseThreadpoolWork(work);
 
+	if (test_concurrent_submitters(NULL, "global") < 0)
+		return -1;
+
+	if (test_cancel_pending(NULL) < 0)
+		return -1;
+
+	if (test_deque_growth(NULL) < 0)
+		return -1;
+
 	printf("Private Thread Pool\n");
 
 	pool = CreateThreadpool(NULL);
@@ -89,6 +307,12 @@ int TestPoolWork(int argc, char* argv[])
 
 	WaitForThreadpoolWorkCallbacks(work, FALSE);
 
+	if (test_concurrent_submitters(&environment, "private") < 0)
+		return -1;
+
+	if (test_deque_growth(&environment) < 0)
+		return -1;
+
 	CloseThreadpoolCleanupGroupMembers(cleanupGroup, TRUE, NULL);
 
 	CloseThreadpoolCleanupGroup(cleanupGroup);
@@ -23,32 +23,441 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/sysinfo.h>
+
+#include "pool.h"
+#include "../log.h"
+#define TAG WINPR_TAG("pool")
+
+#ifdef _WIN32
+
+static BOOL module_initialized = FALSE;
+static BOOL module_available = FALSE;
+static HMODULE kernel32_module = NULL;
+
+static PTP_TIMER (WINAPI * pCreateThreadpoolTimer)(PTP_TIMER_CALLBACK pfnti, PVOID pv, PTP_CALLBACK_ENVIRON pcbe);
+static VOID (WINAPI * pCloseThreadpoolTimer)(PTP_TIMER pti);
+static BOOL (WINAPI * pIsThreadpoolTimerSet)(PTP_TIMER pti);
+static VOID (WINAPI * pSetThreadpoolTimer)(PTP_TIMER pti, PFILETIME pftDueTime, DWORD msPeriod, DWORD msWindowLength);
+static VOID (WINAPI * pWaitForThreadpoolTimerCallbacks)(PTP_TIMER pti, BOOL fCancelPendingCallbacks);
+
+static void module_init()
+{
+	if (module_initialized)
+		return;
+
+	kernel32_module = LoadLibraryA("kernel32.dll");
+	module_initialized = TRUE;
+
+	if (!kernel32_module)
+		return;
+
+	module_available = TRUE;
+	pCreateThreadpoolTimer = (void*) GetProcAddress(kernel32_module, "CreateThreadpoolTimer");
+	pCloseThreadpoolTimer = (void*) GetProcAddress(kernel32_module, "CloseThreadpoolTimer");
+	pIsThreadpoolTimerSet = (void*) GetProcAddress(kernel32_module, "IsThreadpoolTimerSet");
+	pSetThreadpoolTimer = (void*) GetProcAddress(kernel32_module, "SetThreadpoolTimer");
+	pWaitForThreadpoolTimerCallbacks = (void*) GetProcAddress(kernel32_module, "WaitForThreadpoolTimerCallbacks");
+}
+
+#else
+
+static void thread_pool_timer_insert(TP_TIMER_QUEUE* queue, PTP_TIMER timer)
+{
+	PTP_TIMER* slot;
+
+	if (timer->DueTime < queue->Current)
+		timer->DueTime = queue->Current;
+
+	slot = &queue->Slots[timer->DueTime & (TP_TIMER_WHEEL_SIZE - 1)];
+
+	timer->Prev = NULL;
+	timer->Next = *slot;
+
+	if (*slot)
+		(*slot)->Prev = timer;
+
+	*slot = timer;
+	timer->Armed = TRUE;
+	queue->Count++;
+
+	/* the timer thread only needs to be woken up if it sleeps past the new due time */
+
+	if (timer->DueTime < queue->Wakeup)
+	{
+		queue->Wakeup = timer->DueTime;
+		SetEvent(queue->Event);
+	}
+}
+
+static void thread_pool_timer_remove(TP_TIMER_QUEUE* queue, PTP_TIMER timer)
+{
+	if (!timer->Armed)
+		return;
+
+	if (timer->Prev)
+		timer->Prev->Next = timer->Next;
+	else
+		queue->Slots[timer->DueTime & (TP_TIMER_WHEEL_SIZE - 1)] = timer->Next;
+
+	if (timer->Next)
+		timer->Next->Prev = timer->Prev;
+
+	timer->Prev = timer->Next = NULL;
+	timer->Armed = FALSE;
+	queue->Count--;
+}
+
+static void thread_pool_timer_expire(TP_TIMER_QUEUE* queue, UINT64 now)
+{
+	UINT64 end;
+	PTP_TIMER next;
+	PTP_TIMER timer;
+
+	/* a full turn of the wheel visits every slot once */
+
+	end = now;
+
+	if ((end - queue->Current) >= TP_TIMER_WHEEL_SIZE)
+		end = queue->Current + TP_TIMER_WHEEL_SIZE - 1;
+
+	for (; queue->Current <= end; queue->Current++)
+	{
+		timer = queue->Slots[queue->Current & (TP_TIMER_WHEEL_SIZE - 1)];
+
+		for (; timer; timer = next)
+		{
+			next = timer->Next;
+
+			if (timer->DueTime > now)
+				continue;
+
+			thread_pool_timer_remove(queue, timer);
+			SubmitThreadpoolWork(timer->Work);
+
+			if (timer->Period)
+			{
+				/* periods missed while the timer thread was late are skipped */
+
+				timer->DueTime += (((now - timer->DueTime) / timer->Period) + 1) * timer->Period;
+				thread_pool_timer_insert(queue, timer);
+			}
+		}
+	}
+
+	queue->Current = now + 1;
+}
+
+static UINT64 thread_pool_timer_next(TP_TIMER_QUEUE* queue)
+{
+	UINT64 tick;
+	PTP_TIMER timer;
+
+	if (!queue->Count)
+		return (UINT64) -1;
+
+	for (tick = queue->Current; tick < queue->Current + TP_TIMER_WHEEL_SIZE; tick++)
+	{
+		timer = queue->Slots[tick & (TP_TIMER_WHEEL_SIZE - 1)];
+
+		for (; timer; timer = timer->Next)
+		{
+			if (timer->DueTime == tick)
+				return tick;
+		}
+	}
+
+	/* nothing is due within this turn of the wheel, look again after it */
+
+	return tick;
+}
+
+static void* thread_pool_timer_thread(void* arg)
+{
+	UINT64 now;
+	DWORD timeout;
+	TP_TIMER_QUEUE* queue = (TP_TIMER_QUEUE*) arg;
+
+	EnterCriticalSection(&queue->Lock);
+
+	while (!queue->Terminate)
+	{
+		now = GetTickCount64();
+
+		if (now >= queue->Current)
+			thread_pool_timer_expire(queue, now);
+
+		queue->Wakeup = thread_pool_timer_next(queue);
+
+		if (queue->Wakeup == (UINT64) -1)
+			timeout = INFINITE;
+		else
+			timeout = (DWORD) (queue->Wakeup - now);
+
+		ResetEvent(queue->Event);
+		LeaveCriticalSection(&queue->Lock);
+
+		WaitForSingleObject(queue->Event, timeout);
+
+		EnterCriticalSection(&queue->Lock);
+	}
+
+	LeaveCriticalSection(&queue->Lock);
+
+	return NULL;
+}
+
+static TP_TIMER_QUEUE* thread_pool_timer_queue(PTP_POOL pool)
+{
+	TP_TIMER_QUEUE* queue;
+
+	if (pool->TimerQueue)
+		return pool->TimerQueue;
+
+	EnterCriticalSection(&pool->Lock);
+
+	queue = pool->TimerQueue;
+
+	if (!queue)
+	{
+		queue = (TP_TIMER_QUEUE*) calloc(1, sizeof(TP_TIMER_QUEUE));
+
+		if (!queue)
+			goto out;
+
+		queue->Current = GetTickCount64();
+		queue->Wakeup = (UINT64) -1;
+
+		if (!InitializeCriticalSectionAndSpinCount(&queue->Lock, 4000))
+		{
+			free(queue);
+			queue = NULL;
+			goto out;
+		}
+
+		queue->Event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		if (queue->Event)
+		{
+			queue->Thread = CreateThread(NULL, 0,
+					(LPTHREAD_START_ROUTINE) thread_pool_timer_thread,
+					(void*) queue, 0, NULL);
+		}
+
+		if (!queue->Thread)
+		{
+			WLog_ERR(TAG, "failed to start the thread pool timer thread");
+
+			if (queue->Event)
+				CloseHandle(queue->Event);
+
+			DeleteCriticalSection(&queue->Lock);
+			free(queue);
+			queue = NULL;
+			goto out;
+		}
+
+		pool->TimerQueue = queue;
+	}
+
+out:
+	LeaveCriticalSection(&pool->Lock);
+	return queue;
+}
+
+VOID ThreadpoolTimerQueueFree(PTP_POOL pool)
+{
+	TP_TIMER_QUEUE* queue = pool->TimerQueue;
+
+	if (!queue)
+		return;
+
+	EnterCriticalSection(&queue->Lock);
+	queue->Terminate = TRUE;
+	SetEvent(queue->Event);
+	LeaveCriticalSection(&queue->Lock);
+
+	WaitForSingleObject(queue->Thread, INFINITE);
+	CloseHandle(queue->Thread);
+	CloseHandle(queue->Event);
+
+	DeleteCriticalSection(&queue->Lock);
+	free(queue);
+
+	pool->TimerQueue = NULL;
+}
+
+static VOID CALLBACK thread_pool_timer_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	PTP_TIMER timer = (PTP_TIMER) context;
+
+	timer->TimerCallback(instance, timer->CallbackParameter, timer);
+}
+
+#endif
 
 #ifdef WINPR_THREAD_POOL
 
 PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK pfnti, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
 {
-	return NULL;
+	PTP_TIMER timer = NULL;
+#ifdef _WIN32
+	module_init();
+
+	if (pCreateThreadpoolTimer)
+		return pCreateThreadpoolTimer(pfnti, pv, pcbe);
+
+#else
+	timer = (PTP_TIMER) calloc(1, sizeof(TP_TIMER));
+
+	if (timer)
+	{
+		timer->TimerCallback = pfnti;
+		timer->CallbackParameter = pv;
+
+		if (!pcbe)
+			pcbe = GetDefaultThreadpoolEnvironment();
+
+		timer->CallbackEnvironment = pcbe;
+		timer->Pool = pcbe->Pool ? pcbe->Pool : GetDefaultThreadpool();
+
+		/* expired timers are run as a work object of the pool */
+
+		if (!timer->Pool || !thread_pool_timer_queue(timer->Pool))
+		{
+			free(timer);
+			return NULL;
+		}
+
+		timer->Work = CreateThreadpoolWork(thread_pool_timer_callback, (PVOID) timer, pcbe);
+
+		if (!timer->Work)
+		{
+			free(timer);
+			return NULL;
+		}
+	}
+
+#endif
+	return timer;
 }
 
 VOID CloseThreadpoolTimer(PTP_TIMER pti)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pCloseThreadpoolTimer)
+		pCloseThreadpoolTimer(pti);
+
+#else
+	TP_TIMER_QUEUE* queue;
+
+	if (!pti)
+		return;
+
+	queue = pti->Pool->TimerQueue;
+
+	EnterCriticalSection(&queue->Lock);
+	thread_pool_timer_remove(queue, pti);
+	LeaveCriticalSection(&queue->Lock);
 
+	/* must not be called from the timer callback, the callbacks already queued are run first */
+
+	WaitForThreadpoolWorkCallbacks(pti->Work, FALSE);
+	CloseThreadpoolWork(pti->Work);
+
+	free(pti);
+#endif
 }
 
 BOOL IsThreadpoolTimerSet(PTP_TIMER pti)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pIsThreadpoolTimerSet)
+		return pIsThreadpoolTimerSet(pti);
+
 	return FALSE;
+#else
+	BOOL armed;
+	TP_TIMER_QUEUE* queue = pti->Pool->TimerQueue;
+
+	EnterCriticalSection(&queue->Lock);
+	armed = pti->Armed;
+	LeaveCriticalSection(&queue->Lock);
+
+	return armed;
+#endif
 }
 
+/**
+ * The due time is either relative (negative) or absolute (positive),
+ * in 100-nanosecond intervals. A zero due time expires immediately,
+ * and a NULL due time stops the timer. The window length is accepted
+ * but not used: timers already have a resolution of one millisecond.
+ */
+
 VOID SetThreadpoolTimer(PTP_TIMER pti, PFILETIME pftDueTime, DWORD msPeriod, DWORD msWindowLength)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pSetThreadpoolTimer)
+		pSetThreadpoolTimer(pti, pftDueTime, msPeriod, msWindowLength);
+
+#else
+	INT64 due;
+	UINT64 delay = 0;
+	FILETIME current;
+	TP_TIMER_QUEUE* queue = pti->Pool->TimerQueue;
+
+	if (pftDueTime)
+	{
+		due = (INT64) ((((UINT64) pftDueTime->dwHighDateTime) << 32) | pftDueTime->dwLowDateTime);
+
+		if (due < 0)
+		{
+			delay = (UINT64) (-due) / 10000;
+		}
+		else if (due > 0)
+		{
+			GetSystemTimeAsFileTime(&current);
+			due -= (INT64) ((((UINT64) current.dwHighDateTime) << 32) | current.dwLowDateTime);
+
+			if (due > 0)
+				delay = (UINT64) due / 10000;
+		}
+	}
 
+	EnterCriticalSection(&queue->Lock);
+
+	thread_pool_timer_remove(queue, pti);
+
+	if (pftDueTime)
+	{
+		pti->Period = msPeriod;
+		pti->DueTime = GetTickCount64() + delay;
+		thread_pool_timer_insert(queue, pti);
+	}
+
+	LeaveCriticalSection(&queue->Lock);
+
+#endif
 }
 
 VOID WaitForThreadpoolTimerCallbacks(PTP_TIMER pti, BOOL fCancelPendingCallbacks)
 {
+#ifdef _WIN32
+	module_init();
+
+	if (pWaitForThreadpoolTimerCallbacks)
+		pWaitForThreadpoolTimerCallbacks(pti, fCancelPendingCallbacks);
 
+#else
+	WaitForThreadpoolWorkCallbacks(pti->Work, fCancelPendingCallbacks);
+#endif
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -23,6 +23,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/pool.h>
+#include <winpr/interlocked.h>
 
 #include "pool.h"
 #include "../log.h"
@@ -59,6 +60,42 @@ static void module_init()
 	pWaitForThreadpoolWorkCallbacks = (void*) GetProcAddress(kernel32_module, "WaitForThreadpoolWorkCallbacks");
 }
 
+#else
+
+/**
+ * Releases count references on the completion of a work object,
+ * waking up WaitForThreadpoolWorkCallbacks when none are left.
+ */
+
+VOID ThreadpoolWorkRelease(PTP_WORK work, LONG count)
+{
+	LONG pending;
+
+	do
+	{
+		pending = work->Pending;
+
+		if (pending <= count)
+			break;
+	}
+	while (InterlockedCompareExchange(&work->Pending, pending - count, pending) != pending);
+
+	if (pending > count)
+		return;
+
+	/**
+	 * The last references are dropped with the lock held: the work object
+	 * may be closed as soon as a waiter can acquire it and sees no pending callbacks.
+	 */
+
+	EnterCriticalSection(&work->Lock);
+
+	if ((InterlockedExchangeAdd(&work->Pending, -count) == count) && work->CompletionEvent)
+		SetEvent(work->CompletionEvent);
+
+	LeaveCriticalSection(&work->Lock);
+}
+
 #endif
 
 #ifdef WINPR_THREAD_POOL
@@ -73,7 +110,7 @@ PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK pfnwk, PVOID pv, PTP_CALLBACK_EN
 		return pCreateThreadpoolWork(pfnwk, pv, pcbe);
 
 #else
-	work = (PTP_WORK) malloc(sizeof(TP_WORK));
+	work = (PTP_WORK) calloc(1, sizeof(TP_WORK));
 
 	if (work)
 	{
@@ -84,6 +121,13 @@ PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK pfnwk, PVOID pv, PTP_CALLBACK_EN
 			pcbe = GetDefaultThreadpoolEnvironment();
 
 		work->CallbackEnvironment = pcbe;
+		work->Pool = pcbe->Pool ? pcbe->Pool : GetDefaultThreadpool();
+
+		if (!work->Pool || !InitializeCriticalSectionAndSpinCount(&work->Lock, 4000))
+		{
+			free(work);
+			return NULL;
+		}
 	}
 
 #endif
@@ -99,6 +143,13 @@ VOID CloseThreadpoolWork(PTP_WORK pwk)
 		pCloseThreadpoolWork(pwk);
 
 #else
+	if (!pwk)
+		return;
+
+	if (pwk->CompletionEvent)
+		CloseHandle(pwk->CompletionEvent);
+
+	DeleteCriticalSection(&pwk->Lock);
 	free(pwk);
 #endif
 }
@@ -112,16 +163,22 @@ VOID SubmitThreadpoolWork(PTP_WORK pwk)
 		pSubmitThreadpoolWork(pwk);
 
 #else
-	PTP_POOL pool;
-	PTP_CALLBACK_INSTANCE callbackInstance;
-	pool = pwk->CallbackEnvironment->Pool;
-	callbackInstance = (PTP_CALLBACK_INSTANCE) malloc(sizeof(TP_CALLBACK_INSTANCE));
+	InterlockedIncrement(&pwk->Pending);
+	InterlockedIncrement(&pwk->Queued);
 
-	if (callbackInstance)
+	/* the work object is queued once, no matter how many times it is submitted */
+
+	if (InterlockedCompareExchange(&pwk->InQueue, 1, 0) == 0)
 	{
-		callbackInstance->Work = pwk;
-		CountdownEvent_AddCount(pool->WorkComplete, 1);
-		Queue_Enqueue(pool->PendingQueue, callbackInstance);
+		InterlockedIncrement(&pwk->Pending);
+
+		if (!ThreadpoolPostWork(pwk->Pool, pwk))
+		{
+			WLog_ERR(TAG, "failed to start a thread pool worker");
+			InterlockedExchange(&pwk->InQueue, 0);
+			InterlockedDecrement(&pwk->Queued);
+			ThreadpoolWorkRelease(pwk, 2);
+		}
 	}
 
 #endif
@@ -149,13 +206,50 @@ VOID WaitForThreadpoolWorkCallbacks(PTP_WORK pwk, BOOL fCancelPendingCallbacks)
 		pWaitForThreadpoolWorkCallbacks(pwk, fCancelPendingCallbacks);
 
 #else
-	HANDLE event;
-	PTP_POOL pool;
-	pool = pwk->CallbackEnvironment->Pool;
-	event = CountdownEvent_WaitHandle(pool->WorkComplete);
+	int spin;
+	LONG queued;
+
+	if (fCancelPendingCallbacks)
+	{
+		queued = InterlockedExchange(&pwk->Queued, 0);
+
+		if (queued > 0)
+			ThreadpoolWorkRelease(pwk, queued);
+	}
+
+	/* callbacks are usually short, avoid creating the completion event if possible */
+
+	for (spin = 0; (pwk->Pending > 0) && (spin < 16); spin++)
+		SwitchToThread();
+
+	EnterCriticalSection(&pwk->Lock);
+
+	if (!pwk->CompletionEvent && (pwk->Pending > 0))
+		pwk->CompletionEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	while (pwk->Pending > 0)
+	{
+		if (!pwk->CompletionEvent)
+		{
+			LeaveCriticalSection(&pwk->Lock);
+			Sleep(1);
+			EnterCriticalSection(&pwk->Lock);
+			continue;
+		}
+
+		ResetEvent(pwk->CompletionEvent);
+		LeaveCriticalSection(&pwk->Lock);
+
+		if (WaitForSingleObject(pwk->CompletionEvent, INFINITE) != WAIT_OBJECT_0)
+		{
+			WLog_ERR(TAG, "error waiting on work completion");
+			return;
+		}
+
+		EnterCriticalSection(&pwk->Lock);
+	}
 
-	if (WaitForSingleObject(event, INFINITE) != WAIT_OBJECT_0)
-		WLog_ERR(TAG, "error waiting on work completion");
+	LeaveCriticalSection(&pwk->Lock);
 
 #endif
 }
@@ -0,0 +1,238 @@
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#define TEST_WAIT_SET_ITERATIONS	10000
+
+static void* test_wait_set_thread(void* arg)
+{
+	ExitThread(0);
+	return NULL;
+}
+
+static int test_wait_set_events(void)
+{
+	int index;
+	DWORD status;
+	UINT64 signaled;
+	HANDLE events[8];
+	wWaitSet* waitSet;
+
+	waitSet = WaitSet_New();
+
+	if (!waitSet)
+	{
+		printf("WaitSet_New failure\n");
+		return -1;
+	}
+
+	for (index = 0; index < 8; index++)
+	{
+		events[index] = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		if (WaitSet_Add(waitSet, events[index]) != index)
+		{
+			printf("WaitSet_Add failure\n");
+			return -1;
+		}
+	}
+
+	if (WaitSet_Wait(waitSet, 0, &signaled) != WAIT_TIMEOUT)
+	{
+		printf("WaitSet_Wait(0) on a quiet set did not time out\n");
+		return -1;
+	}
+
+	SetEvent(events[2]);
+	SetEvent(events[6]);
+
+	status = WaitSet_Wait(waitSet, INFINITE, &signaled);
+
+	if ((status != WAIT_OBJECT_0 + 2) || (signaled != ((1 << 2) | (1 << 6))))
+	{
+		printf("WaitSet_Wait returned 0x%08X with mask 0x%08X, expected 0x%08X with mask 0x%08X\n",
+				status, (UINT32) signaled, WAIT_OBJECT_0 + 2, (1 << 2) | (1 << 6));
+		return -1;
+	}
+
+	/* manual reset events stay signalled */
+
+	if (WaitSet_Wait(waitSet, 0, &signaled) != WAIT_OBJECT_0 + 2)
+	{
+		printf("WaitSet_Wait consumed a manual reset event\n");
+		return -1;
+	}
+
+	ResetEvent(events[2]);
+	ResetEvent(events[6]);
+
+	if (WaitSet_Count(waitSet) != 8)
+	{
+		printf("WaitSet_Count failure\n");
+		return -1;
+	}
+
+	WaitSet_Clear(waitSet);
+
+	if (WaitSet_Add(waitSet, events[5]) != 0)
+	{
+		printf("WaitSet_Add after WaitSet_Clear failure\n");
+		return -1;
+	}
+
+	SetEvent(events[5]);
+
+	if ((WaitSet_Wait(waitSet, 0, &signaled) != WAIT_OBJECT_0) || (signaled != 1))
+	{
+		printf("WaitSet_Wait after WaitSet_Clear failure\n");
+		return -1;
+	}
+
+	WaitSet_Free(waitSet);
+
+	for (index = 0; index < 8; index++)
+		CloseHandle(events[index]);
+
+	return 0;
+}
+
+static int test_wait_set_thread_handle(void)
+{
+	DWORD status;
+	UINT64 signaled;
+	HANDLE event;
+	HANDLE thread;
+	wWaitSet* waitSet;
+
+	waitSet = WaitSet_New();
+	event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_wait_set_thread, NULL, 0, NULL);
+
+	if (!waitSet || !event || !thread)
+	{
+		printf("test_wait_set_thread_handle: allocation failure\n");
+		return -1;
+	}
+
+	WaitSet_Add(waitSet, event);
+	WaitSet_Add(waitSet, thread);
+
+	status = WaitSet_Wait(waitSet, 5000, &signaled);
+
+	if ((status != WAIT_OBJECT_0 + 1) || (signaled != 2))
+	{
+		printf("WaitSet_Wait on a terminated thread returned 0x%08X\n", status);
+		return -1;
+	}
+
+	if (WaitForSingleObject(thread, 0) != WAIT_OBJECT_0)
+	{
+		printf("thread not joined after WaitSet_Wait\n");
+		return -1;
+	}
+
+	WaitSet_Free(waitSet);
+	CloseHandle(thread);
+	CloseHandle(event);
+
+	return 0;
+}
+
+/**
+ * Compares the usual event loop pattern, WaitForMultipleObjects() followed by
+ * WaitForSingleObject(h, 0) on every handle, with a single WaitSet_Wait().
+ * The last handle is kept signalled so that both loops never block.
+ */
+
+static int test_wait_set_benchmark(int count)
+{
+	int index;
+	int iteration;
+	UINT64 begin;
+	UINT64 signaled;
+	UINT64 pollTime;
+	UINT64 waitSetTime;
+	HANDLE events[64];
+	wWaitSet* waitSet;
+
+	waitSet = WaitSet_New();
+
+	if (!waitSet)
+		return -1;
+
+	for (index = 0; index < count; index++)
+	{
+		events[index] = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		if (!events[index] || (WaitSet_Add(waitSet, events[index]) < 0))
+			return -1;
+	}
+
+	SetEvent(events[count - 1]);
+
+	begin = GetTickCount64();
+
+	for (iteration = 0; iteration < TEST_WAIT_SET_ITERATIONS; iteration++)
+	{
+		if (WaitForMultipleObjects(count, events, FALSE, INFINITE) == WAIT_FAILED)
+			return -1;
+
+		signaled = 0;
+
+		for (index = 0; index < count; index++)
+		{
+			if (WaitForSingleObject(events[index], 0) == WAIT_OBJECT_0)
+				signaled |= ((UINT64) 1) << index;
+		}
+
+		if (!signaled)
+			return -1;
+	}
+
+	pollTime = GetTickCount64() - begin;
+	begin = GetTickCount64();
+
+	for (iteration = 0; iteration < TEST_WAIT_SET_ITERATIONS; iteration++)
+	{
+		if (WaitSet_Wait(waitSet, INFINITE, &signaled) == WAIT_FAILED)
+			return -1;
+
+		if (!signaled)
+			return -1;
+	}
+
+	waitSetTime = GetTickCount64() - begin;
+
+	printf("%2d handles: WaitForMultipleObjects + WaitForSingleObject %6.2f us/wait, WaitSet_Wait %6.2f us/wait\n",
+			count, (pollTime * 1000.0) / TEST_WAIT_SET_ITERATIONS,
+			(waitSetTime * 1000.0) / TEST_WAIT_SET_ITERATIONS);
+
+	WaitSet_Free(waitSet);
+
+	for (index = 0; index < count; index++)
+		CloseHandle(events[index]);
+
+	return 0;
+}
+
+int TestSynchWaitSet(int argc, char* argv[])
+{
+	if (test_wait_set_events() < 0)
+		return -1;
+
+	if (test_wait_set_thread_handle() < 0)
+		return -1;
+
+	if (test_wait_set_benchmark(1) < 0)
+		return -1;
+
+	if (test_wait_set_benchmark(8) < 0)
+		return -1;
+
+	if (test_wait_set_benchmark(64) < 0)
+		return -1;
+
+	return 0;
+}
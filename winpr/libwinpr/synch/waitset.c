@@ -0,0 +1,485 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Synchronization Functions (Wait Sets)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include "../log.h"
+#define TAG WINPR_TAG("sync.waitset")
+
+/**
+ * A wait set keeps the handles of an event loop registered between waits.
+ * WaitForMultipleObjects() resolves every handle and rebuilds its poll array
+ * on each call and only reports the first signalled handle, so loops probe
+ * every other handle with WaitForSingleObject(h, 0) afterwards. A wait set
+ * resolves the handles once, is backed by epoll where available, and
+ * reports all the signalled handles of a wait as a bit mask indexed by the
+ * order in which they were added.
+ *
+ * Semaphores, timers and threads reported as signalled are acquired, like
+ * the handle returned by WaitForMultipleObjects(). The file descriptor
+ * behind a handle is looked up when it is added: a handle whose descriptor
+ * changes (SetEventFileDescriptor) must be added again.
+ */
+
+#define WAIT_SET_MAX_HANDLES	64
+
+#ifndef _WIN32
+
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#elif defined(HAVE_POLL_H)
+#include <poll.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include "synch.h"
+#include "../handle/handle.h"
+#include "../thread/thread.h"
+#include "../pipe/pipe.h"
+
+struct _wWaitSet
+{
+	DWORD count;
+	HANDLE handles[WAIT_SET_MAX_HANDLES];
+	ULONG types[WAIT_SET_MAX_HANDLES];
+	int fds[WAIT_SET_MAX_HANDLES];
+#ifdef HAVE_SYS_EPOLL_H
+	int epollFd;
+#elif defined(HAVE_POLL_H)
+	struct pollfd pollfds[WAIT_SET_MAX_HANDLES];
+#endif
+};
+
+static int wait_set_handle_fd(HANDLE handle, ULONG* pType)
+{
+	PVOID Object;
+
+	if (!winpr_Handle_GetInfo(handle, pType, &Object))
+		return -1;
+
+	switch (*pType)
+	{
+		case HANDLE_TYPE_EVENT:
+			return ((WINPR_EVENT*) Object)->pipe_fd[0];
+
+		case HANDLE_TYPE_SEMAPHORE:
+#ifdef WINPR_PIPE_SEMAPHORE
+			return ((WINPR_SEMAPHORE*) Object)->pipe_fd[0];
+#else
+			return -1;
+#endif
+
+		case HANDLE_TYPE_TIMER:
+			return ((WINPR_TIMER*) Object)->fd;
+
+		case HANDLE_TYPE_THREAD:
+			return ((WINPR_THREAD*) Object)->pipe_fd[0];
+
+		case HANDLE_TYPE_NAMED_PIPE:
+			return (((WINPR_NAMED_PIPE*) Object)->ServerMode) ?
+					((WINPR_NAMED_PIPE*) Object)->serverfd : ((WINPR_NAMED_PIPE*) Object)->clientfd;
+
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Acquires a handle found signalled, the same way WaitForMultipleObjects() does.
+ */
+
+static BOOL wait_set_acquire(wWaitSet* waitSet, DWORD index)
+{
+	int length;
+	int status;
+	UINT64 expirations;
+	WINPR_THREAD* thread;
+
+	switch (waitSet->types[index])
+	{
+		case HANDLE_TYPE_SEMAPHORE:
+			length = read(waitSet->fds[index], &length, 1);
+
+			if (length != 1)
+			{
+				WLog_ERR(TAG, "semaphore read() failure [%d] %s", errno, strerror(errno));
+				return FALSE;
+			}
+
+			break;
+
+		case HANDLE_TYPE_TIMER:
+			length = read(waitSet->fds[index], (void*) &expirations, sizeof(UINT64));
+
+			if (length != 8)
+			{
+				WLog_ERR(TAG, "timer read() failure [%d] %s", errno, strerror(errno));
+				return FALSE;
+			}
+
+			break;
+
+		case HANDLE_TYPE_THREAD:
+			thread = (WINPR_THREAD*) waitSet->handles[index];
+			pthread_mutex_lock(&thread->mutex);
+
+			if (!thread->joined)
+			{
+				status = pthread_join(thread->thread, NULL);
+
+				if (status != 0)
+				{
+					WLog_ERR(TAG, "pthread_join failure: [%d] %s", status, strerror(status));
+					pthread_mutex_unlock(&thread->mutex);
+					return FALSE;
+				}
+
+				thread->joined = TRUE;
+			}
+
+			pthread_mutex_unlock(&thread->mutex);
+			break;
+
+		default:
+			break;
+	}
+
+	return TRUE;
+}
+
+int WaitSet_Add(wWaitSet* waitSet, HANDLE handle)
+{
+	int fd;
+	ULONG Type;
+	DWORD index;
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event event;
+#endif
+
+	if (waitSet->count >= WAIT_SET_MAX_HANDLES)
+	{
+		WLog_ERR(TAG, "too many handles in wait set");
+		return -1;
+	}
+
+	fd = wait_set_handle_fd(handle, &Type);
+
+	if (fd < 0)
+	{
+		WLog_ERR(TAG, "unsupported handle in wait set");
+		return -1;
+	}
+
+	index = waitSet->count;
+
+#ifdef HAVE_SYS_EPOLL_H
+	ZeroMemory(&event, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = index;
+
+	if (epoll_ctl(waitSet->epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+	{
+		/* the same descriptor may be behind several handles */
+
+		if (errno != EEXIST)
+		{
+			WLog_ERR(TAG, "epoll_ctl failure [%d] %s", errno, strerror(errno));
+			return -1;
+		}
+	}
+#elif defined(HAVE_POLL_H)
+	waitSet->pollfds[index].fd = fd;
+	waitSet->pollfds[index].events = POLLIN;
+	waitSet->pollfds[index].revents = 0;
+#endif
+
+	waitSet->handles[index] = handle;
+	waitSet->types[index] = Type;
+	waitSet->fds[index] = fd;
+	waitSet->count++;
+
+	return (int) index;
+}
+
+void WaitSet_Clear(wWaitSet* waitSet)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	DWORD index;
+
+	for (index = 0; index < waitSet->count; index++)
+		epoll_ctl(waitSet->epollFd, EPOLL_CTL_DEL, waitSet->fds[index], NULL);
+#endif
+
+	waitSet->count = 0;
+}
+
+DWORD WaitSet_Count(wWaitSet* waitSet)
+{
+	return waitSet->count;
+}
+
+DWORD WaitSet_Wait(wWaitSet* waitSet, DWORD dwMilliseconds, UINT64* pSignaled)
+{
+	int index;
+	int status;
+	DWORD first = WAIT_SET_MAX_HANDLES;
+	UINT64 signaled = 0;
+#ifdef HAVE_SYS_EPOLL_H
+	DWORD other;
+	struct epoll_event events[WAIT_SET_MAX_HANDLES];
+#elif !defined(HAVE_POLL_H)
+	int maxfd = 0;
+	fd_set fds;
+	struct timeval timeout;
+#endif
+
+	if (pSignaled)
+		*pSignaled = 0;
+
+	if (!waitSet->count)
+	{
+		WLog_ERR(TAG, "empty wait set");
+		return WAIT_FAILED;
+	}
+
+#ifdef HAVE_SYS_EPOLL_H
+	do
+	{
+		status = epoll_wait(waitSet->epollFd, events, waitSet->count,
+				(dwMilliseconds == INFINITE) ? -1 : (int) dwMilliseconds);
+	}
+	while ((status < 0) && (errno == EINTR));
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "epoll_wait failure [%d] %s", errno, strerror(errno));
+		return WAIT_FAILED;
+	}
+
+	for (index = 0; index < status; index++)
+	{
+		DWORD slot = events[index].data.u32;
+
+		/* epoll reports a descriptor once, for the first handle added with it */
+
+		for (other = slot; other < waitSet->count; other++)
+		{
+			if ((other != slot) && (waitSet->fds[other] != waitSet->fds[slot]))
+				continue;
+
+			if (!wait_set_acquire(waitSet, other))
+				return WAIT_FAILED;
+
+			signaled |= ((UINT64) 1) << other;
+		}
+	}
+#elif defined(HAVE_POLL_H)
+	do
+	{
+		status = poll(waitSet->pollfds, waitSet->count,
+				(dwMilliseconds == INFINITE) ? -1 : (int) dwMilliseconds);
+	}
+	while ((status < 0) && (errno == EINTR));
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "poll failure [%d] %s", errno, strerror(errno));
+		return WAIT_FAILED;
+	}
+
+	for (index = 0; (status > 0) && (index < (int) waitSet->count); index++)
+	{
+		if (!(waitSet->pollfds[index].revents & POLLIN))
+			continue;
+
+		if (!wait_set_acquire(waitSet, index))
+			return WAIT_FAILED;
+
+		signaled |= ((UINT64) 1) << index;
+	}
+#else
+	FD_ZERO(&fds);
+	ZeroMemory(&timeout, sizeof(timeout));
+
+	for (index = 0; index < (int) waitSet->count; index++)
+	{
+		FD_SET(waitSet->fds[index], &fds);
+
+		if (waitSet->fds[index] > maxfd)
+			maxfd = waitSet->fds[index];
+	}
+
+	if (dwMilliseconds != INFINITE)
+	{
+		timeout.tv_sec = dwMilliseconds / 1000;
+		timeout.tv_usec = (dwMilliseconds % 1000) * 1000;
+	}
+
+	do
+	{
+		status = select(maxfd + 1, &fds, NULL, NULL, (dwMilliseconds == INFINITE) ? NULL : &timeout);
+	}
+	while ((status < 0) && (errno == EINTR));
+
+	if (status < 0)
+	{
+		WLog_ERR(TAG, "select failure [%d] %s", errno, strerror(errno));
+		return WAIT_FAILED;
+	}
+
+	for (index = 0; (status > 0) && (index < (int) waitSet->count); index++)
+	{
+		if (!FD_ISSET(waitSet->fds[index], &fds))
+			continue;
+
+		if (!wait_set_acquire(waitSet, index))
+			return WAIT_FAILED;
+
+		signaled |= ((UINT64) 1) << index;
+	}
+#endif
+
+	if (!signaled)
+		return WAIT_TIMEOUT;
+
+	for (first = 0; !(signaled & (((UINT64) 1) << first)); first++);
+
+	if (pSignaled)
+		*pSignaled = signaled;
+
+	return WAIT_OBJECT_0 + first;
+}
+
+wWaitSet* WaitSet_New(void)
+{
+	wWaitSet* waitSet;
+
+	waitSet = (wWaitSet*) calloc(1, sizeof(wWaitSet));
+
+	if (!waitSet)
+		return NULL;
+
+#ifdef HAVE_SYS_EPOLL_H
+	waitSet->epollFd = epoll_create(WAIT_SET_MAX_HANDLES);
+
+	if (waitSet->epollFd < 0)
+	{
+		WLog_ERR(TAG, "epoll_create failure [%d] %s", errno, strerror(errno));
+		free(waitSet);
+		return NULL;
+	}
+#endif
+
+	return waitSet;
+}
+
+void WaitSet_Free(wWaitSet* waitSet)
+{
+	if (!waitSet)
+		return;
+
+#ifdef HAVE_SYS_EPOLL_H
+	close(waitSet->epollFd);
+#endif
+
+	free(waitSet);
+}
+
+#else
+
+struct _wWaitSet
+{
+	DWORD count;
+	HANDLE handles[WAIT_SET_MAX_HANDLES];
+};
+
+int WaitSet_Add(wWaitSet* waitSet, HANDLE handle)
+{
+	if (waitSet->count >= WAIT_SET_MAX_HANDLES)
+	{
+		WLog_ERR(TAG, "too many handles in wait set");
+		return -1;
+	}
+
+	waitSet->handles[waitSet->count] = handle;
+
+	return (int) waitSet->count++;
+}
+
+void WaitSet_Clear(wWaitSet* waitSet)
+{
+	waitSet->count = 0;
+}
+
+DWORD WaitSet_Count(wWaitSet* waitSet)
+{
+	return waitSet->count;
+}
+
+DWORD WaitSet_Wait(wWaitSet* waitSet, DWORD dwMilliseconds, UINT64* pSignaled)
+{
+	DWORD index;
+	DWORD status;
+	UINT64 signaled;
+
+	if (pSignaled)
+		*pSignaled = 0;
+
+	status = WaitForMultipleObjects(waitSet->count, waitSet->handles, FALSE, dwMilliseconds);
+
+	if ((status < WAIT_OBJECT_0) || (status >= (WAIT_OBJECT_0 + waitSet->count)))
+		return status;
+
+	/* handles before the one returned were not signalled */
+
+	signaled = ((UINT64) 1) << (status - WAIT_OBJECT_0);
+
+	for (index = status - WAIT_OBJECT_0 + 1; index < waitSet->count; index++)
+	{
+		if (WaitForSingleObject(waitSet->handles[index], 0) == WAIT_OBJECT_0)
+			signaled |= ((UINT64) 1) << index;
+	}
+
+	if (pSignaled)
+		*pSignaled = signaled;
+
+	return status;
+}
+
+wWaitSet* WaitSet_New(void)
+{
+	return (wWaitSet*) calloc(1, sizeof(wWaitSet));
+}
+
+void WaitSet_Free(wWaitSet* waitSet)
+{
+	free(waitSet);
+}
+
+#endif
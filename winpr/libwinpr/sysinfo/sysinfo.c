@@ -390,9 +390,21 @@ ULONGLONG GetTickCount64(void)
 /* If x86 */
 #ifdef _M_IX86_AMD64
 
-#if defined(__GNUC__) && defined(__AVX__)
+/**
+ * XGETBV is only executed once CPUID reports OSXSAVE, so it does not need
+ * the compiler to target AVX: the AVX checks below are made at runtime.
+ */
+#if defined(__GNUC__)
 #define xgetbv(_func_, _lo_, _hi_) \
 	__asm__ __volatile__ ("xgetbv" : "=a" (_lo_), "=d" (_hi_) : "c" (_func_))
+#elif defined(_MSC_VER) && (_MSC_FULL_VER >= 160040219)
+#include <immintrin.h>
+#define xgetbv(_func_, _lo_, _hi_) \
+	do { \
+		unsigned __int64 _val_ = _xgetbv(_func_); \
+		_lo_ = (unsigned) _val_; \
+		_hi_ = (unsigned) (_val_ >> 32); \
+	} while (0)
 #endif
 
 #define D_BIT_MMX       (1<<23)
@@ -415,6 +427,7 @@ ULONGLONG GetTickCount64(void)
 #define E_BIT_XMM       (1<<1)
 #define E_BIT_YMM       (1<<2)
 #define E_BITS_AVX      (E_BIT_XMM|E_BIT_YMM)
+#define B7_BIT_AVX2     (1<<5)
 
 static void cpuid(
 	unsigned info,
@@ -440,11 +453,11 @@ static void cpuid(
 		"xchg %%rbx, %%rsi;"
 #endif
 	: "=a"(*eax), "=S"(*ebx), "=c"(*ecx), "=d"(*edx)
-			: "0"(info)
+			: "0"(info), "2"(0)
 		);
 #elif defined(_MSC_VER)
 	int a[4];
-	__cpuid(a, info);
+	__cpuidex(a, info, 0);
 	*eax = a[0];
 	*ebx = a[1];
 	*ecx = a[2];
@@ -730,18 +743,20 @@ BOOL IsProcessorFeaturePresentEx(DWORD ProcessorFeature)
 				ret = TRUE;
 
 			break;
-#if defined(__GNUC__) && defined(__AVX__)
+#ifdef xgetbv
 
 		case PF_EX_AVX:
 		case PF_EX_FMA:
 		case PF_EX_AVX_AES:
 		case PF_EX_AVX_PCLMULQDQ:
+		case PF_EX_AVX2:
 			{
+				unsigned e, f;
+
 				/* Check for general AVX support */
 				if ((c & C_BITS_AVX) != C_BITS_AVX)
 					break;
 
-				int e, f;
 				xgetbv(0, e, f);
 
 				/* XGETBV enabled for applications and XMM/YMM states enabled */
@@ -770,11 +785,26 @@ BOOL IsProcessorFeaturePresentEx(DWORD ProcessorFeature)
 								ret = TRUE;
 
 							break;
+
+						case PF_EX_AVX2:
+							{
+								unsigned a7, b7, c7, d7;
+								cpuid(0, &a7, &b7, &c7, &d7);
+
+								if (a7 < 7)
+									break;
+
+								cpuid(7, &a7, &b7, &c7, &d7);
+
+								if (b7 & B7_BIT_AVX2)
+									ret = TRUE;
+							}
+							break;
 					}
 				}
 			}
 			break;
-#endif //__AVX__
+#endif // xgetbv
 
 		default:
 			break;
@@ -284,12 +284,16 @@ static void winpr_StartThread(WINPR_THREAD *thread)
 	if (thread->dwStackSize > 0)
 		pthread_attr_setstacksize(&attr, (size_t) thread->dwStackSize);
 
-	pthread_create(&thread->thread, &attr, thread_launcher, thread);
-	pthread_attr_destroy(&attr);
+	/* the thread may exit before pthread_create returns: its event is reset
+	 * and it is marked started first, ExitThread waits for it to be listed */
+	ListDictionary_Lock(thread_list);
 	reset_event(thread);
+	thread->started = TRUE;
+	pthread_create(&thread->thread, &attr, thread_launcher, thread);
 	ListDictionary_Add(thread_list, &thread->thread, thread);
+	ListDictionary_Unlock(thread_list);
+	pthread_attr_destroy(&attr);
 	dump_thread(thread);
-	thread->started = TRUE;
 }
 
 HANDLE CreateThread(LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize,
@@ -22,98 +22,270 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
 
 #include <winpr/collections.h>
 
+/**
+ * Per-thread cache of available streams.
+ *
+ * A cache is only ever used by the thread that created it, so it is
+ * accessed without locking. The pool owns and links every cache so that it
+ * can release the cached streams when it is freed: the streams cached by a
+ * thread that exits stay there until then.
+ */
+
+#define STREAM_POOL_CACHE_SIZE	8
+
+struct _wStreamPoolCache
+{
+	wStreamPoolCache* next;
+
+	DWORD threadId;
+	DWORD count;
+	wStream* streams[STREAM_POOL_CACHE_SIZE];
+};
+
+/**
+ * Caches of the calling thread, most recently used first.
+ *
+ * All the pools share a single TLS index. Entries are matched by pool id,
+ * which is never reused, so the entries of a freed pool are never followed
+ * and simply age out. An entry pushed out of a full table leaves its cache
+ * with the pool, which hands it back to the same thread on its next use.
+ */
+
+#define STREAM_POOL_THREAD_CACHES	16
+
+typedef struct _wStreamPoolThreadCaches
+{
+	DWORD count;
+	UINT64 ids[STREAM_POOL_THREAD_CACHES];
+	wStreamPoolCache* caches[STREAM_POOL_THREAD_CACHES];
+} wStreamPoolThreadCaches;
+
+static DWORD StreamPoolTlsIndex = TLS_OUT_OF_INDEXES;
+static INIT_ONCE StreamPoolTlsInitOnce = INIT_ONCE_STATIC_INIT;
+static UINT64 StreamPoolNextId = 0;
+
 /**
  * Methods
  */
 
-void StreamPool_ShiftUsed(wStreamPool* pool, int index, int count)
+static INLINE int StreamPool_FloorClass(size_t size)
 {
-	if (count > 0)
+#if defined(__GNUC__)
+	return size ? (int) ((sizeof(unsigned long long) * 8) - 1 - __builtin_clzll(size)) : 0;
+#else
+	int sizeClass = 0;
+
+	while (size >>= 1)
+		sizeClass++;
+
+	return sizeClass;
+#endif
+}
+
+static int StreamPool_CeilClass(size_t size)
+{
+	int sizeClass = StreamPool_FloorClass(size);
+
+	if (size > ((size_t) 1 << sizeClass))
+		sizeClass++;
+
+	return sizeClass;
+}
+
+static BOOL CALLBACK StreamPool_TlsInit(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	StreamPoolTlsIndex = TlsAlloc();
+
+	return (StreamPoolTlsIndex != TLS_OUT_OF_INDEXES) ? TRUE : FALSE;
+}
+
+static UINT64 StreamPool_Counter(UINT64* counter)
+{
+	return (UINT64) InterlockedCompareExchange64((LONGLONG*) counter, 0, 0);
+}
+
+static UINT64 StreamPool_CounterIncrement(UINT64* counter)
+{
+	LONGLONG current;
+
+	do
 	{
-		if (pool->uSize + count > pool->uCapacity)
+		current = *((volatile LONGLONG*) counter);
+	}
+	while (InterlockedCompareExchange64((LONGLONG*) counter, current + 1, current) != current);
+
+	return (UINT64) (current + 1);
+}
+
+/**
+ * Gets the cache of the calling thread, the cache the pool keeps for it
+ * or a new one when it has none yet and create is set.
+ */
+
+static wStreamPoolCache* StreamPool_GetCache(wStreamPool* pool, BOOL create)
+{
+	DWORD index;
+	DWORD threadId;
+	wStreamPoolCache* cache;
+	wStreamPoolThreadCaches* table;
+
+	if (!pool->synchronized)
+		return NULL;
+
+	table = (wStreamPoolThreadCaches*) TlsGetValue(StreamPoolTlsIndex);
+
+	if (table)
+	{
+		for (index = 0; index < table->count; index++)
 		{
-			pool->uCapacity *= 2;
-			pool->uArray = (wStream**) realloc(pool->uArray, sizeof(wStream*) * pool->uCapacity);
-		}
+			if (table->ids[index] != pool->id)
+				continue;
+
+			cache = table->caches[index];
 
-		MoveMemory(&pool->uArray[index + count], &pool->uArray[index], (pool->uSize - index) * sizeof(wStream*));
-		pool->uSize += count;
+			if (index > 0)
+			{
+				MoveMemory(&table->ids[1], &table->ids[0], sizeof(UINT64) * index);
+				MoveMemory(&table->caches[1], &table->caches[0], sizeof(wStreamPoolCache*) * index);
+				table->ids[0] = pool->id;
+				table->caches[0] = cache;
+			}
+
+			return cache;
+		}
 	}
-	else if (count < 0)
+
+	if (!create)
+		return NULL;
+
+	if (!table)
 	{
-		if (pool->uSize - index + count > 0)
+		table = (wStreamPoolThreadCaches*) calloc(1, sizeof(wStreamPoolThreadCaches));
+
+		if (!table)
+			return NULL;
+
+		if (!TlsSetValue(StreamPoolTlsIndex, table))
 		{
-			MoveMemory(&pool->uArray[index], &pool->uArray[index - count],
-					(pool->uSize - index + count) * sizeof(wStream*));
+			free(table);
+			return NULL;
 		}
-
-		pool->uSize += count;
 	}
-}
 
-/**
- * Adds a used stream to the pool.
- */
+	threadId = GetCurrentThreadId();
 
-void StreamPool_AddUsed(wStreamPool* pool, wStream* s)
-{
-	if ((pool->uSize + 1) >= pool->uCapacity)
+	EnterCriticalSection(&pool->lock);
+
+	for (cache = pool->caches; cache; cache = cache->next)
+	{
+		if (cache->threadId == threadId)
+			break;
+	}
+
+	if (!cache)
 	{
-		pool->uCapacity *= 2;
-		pool->uArray = (wStream**) realloc(pool->uArray, sizeof(wStream*) * pool->uCapacity);
+		cache = (wStreamPoolCache*) calloc(1, sizeof(wStreamPoolCache));
+
+		if (cache)
+		{
+			cache->threadId = threadId;
+			cache->next = pool->caches;
+			pool->caches = cache;
+		}
 	}
 
-	pool->uArray[(pool->uSize)++] = s;
+	LeaveCriticalSection(&pool->lock);
+
+	if (!cache)
+		return NULL;
+
+	if (table->count < STREAM_POOL_THREAD_CACHES)
+		(table->count)++;
+
+	MoveMemory(&table->ids[1], &table->ids[0], sizeof(UINT64) * (table->count - 1));
+	MoveMemory(&table->caches[1], &table->caches[0], sizeof(wStreamPoolCache*) * (table->count - 1));
+	table->ids[0] = pool->id;
+	table->caches[0] = cache;
+
+	return cache;
 }
 
 /**
- * Removes a used stream from the pool.
+ * Removes a stream from the streams owned by the pool. Only used when a stream
+ * cannot be kept, this is not on the take/return path.
  */
 
-void StreamPool_RemoveUsed(wStreamPool* pool, wStream* s)
+static void StreamPool_Untrack(wStreamPool* pool, wStream* s)
 {
 	int index;
-	BOOL found = FALSE;
 
-	for (index = 0; index < pool->uSize; index++)
+	for (index = 0; index < pool->tSize; index++)
 	{
-		if (pool->uArray[index] == s)
+		if (pool->tArray[index] == s)
 		{
-			found = TRUE;
+			pool->tArray[index] = pool->tArray[--(pool->tSize)];
 			break;
 		}
 	}
-
-	if (found)
-		StreamPool_ShiftUsed(pool, index, -1);
 }
 
-void StreamPool_ShiftAvailable(wStreamPool* pool, int index, int count)
+static BOOL StreamPool_Track(wStreamPool* pool, wStream* s)
 {
-	if (count > 0)
+	int newCapacity;
+	wStream** newArray;
+
+	if (pool->tSize >= pool->tCapacity)
 	{
-		if (pool->aSize + count > pool->aCapacity)
-		{
-			pool->aCapacity *= 2;
-			pool->aArray = (wStream**) realloc(pool->aArray, sizeof(wStream*) * pool->aCapacity);
-		}
+		newCapacity = pool->tCapacity * 2;
+		newArray = (wStream**) realloc(pool->tArray, sizeof(wStream*) * newCapacity);
 
-		MoveMemory(&pool->aArray[index + count], &pool->aArray[index], (pool->aSize - index) * sizeof(wStream*));
-		pool->aSize += count;
+		if (!newArray)
+			return FALSE;
+
+		pool->tCapacity = newCapacity;
+		pool->tArray = newArray;
 	}
-	else if (count < 0)
+
+	pool->tArray[(pool->tSize)++] = s;
+
+	return TRUE;
+}
+
+/**
+ * Makes a stream available in its size class, the pool lock must be held.
+ */
+
+static void StreamPool_PushAvailable(wStreamPool* pool, wStream* s)
+{
+	int sizeClass;
+	int newCapacity;
+	wStream** newArray;
+
+	sizeClass = StreamPool_FloorClass(Stream_Capacity(s));
+
+	if (pool->aSize[sizeClass] >= pool->aCapacity[sizeClass])
 	{
-		if (pool->aSize - index + count > 0)
+		newCapacity = pool->aCapacity[sizeClass] ? pool->aCapacity[sizeClass] * 2 : 8;
+		newArray = (wStream**) realloc(pool->aArray[sizeClass], sizeof(wStream*) * newCapacity);
+
+		if (!newArray)
 		{
-			MoveMemory(&pool->aArray[index], &pool->aArray[index - count],
-					(pool->aSize - index + count) * sizeof(wStream*));
+			StreamPool_Untrack(pool, s);
+			Stream_Free(s, TRUE);
+			return;
 		}
 
-		pool->aSize += count;
+		pool->aCapacity[sizeClass] = newCapacity;
+		pool->aArray[sizeClass] = newArray;
 	}
+
+	pool->aArray[sizeClass][(pool->aSize[sizeClass])++] = s;
 }
 
 /**
@@ -122,48 +294,93 @@ void StreamPool_ShiftAvailable(wStreamPool* pool, int index, int count)
 
 wStream* StreamPool_Take(wStreamPool* pool, size_t size)
 {
-	int index;
-	int foundIndex;
+	DWORD index;
+	int sizeClass;
+	LONG used;
+	LONG highWater;
+	size_t capacity;
+	size_t minCapacity;
 	wStream* s = NULL;
-
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	wStreamPoolCache* cache;
 
 	if (size == 0)
 		size = pool->defaultSize;
 
-	foundIndex = -1;
+	if (size == 0)
+		size = 1;
+
+	/* every stream of this class is at least as large as requested */
+	sizeClass = StreamPool_CeilClass(size);
+
+	if (sizeClass >= STREAM_POOL_CLASSES)
+		return NULL;
 
-	for (index = 0; index < pool->aSize; index++)
+	cache = StreamPool_GetCache(pool, TRUE);
+
+	if (cache)
 	{
-		s = pool->aArray[index];
+		minCapacity = ((size_t) 1) << sizeClass;
 
-		if (Stream_Capacity(s) >= size)
+		for (index = 0; index < cache->count; index++)
 		{
-			foundIndex = index;
-			break;
+			capacity = Stream_Capacity(cache->streams[index]);
+
+			if ((capacity >= minCapacity) && ((capacity >> 1) < minCapacity))
+			{
+				s = cache->streams[index];
+				cache->streams[index] = cache->streams[--(cache->count)];
+				StreamPool_CounterIncrement(&pool->hits);
+				break;
+			}
 		}
 	}
 
-	if (foundIndex < 0)
+	if (!s)
 	{
-		s = Stream_New(NULL, size);
-	}
-	else
-	{
-		StreamPool_ShiftAvailable(pool, foundIndex, -1);
+		if (pool->synchronized)
+			EnterCriticalSection(&pool->lock);
+
+		if (pool->aSize[sizeClass] > 0)
+		{
+			s = pool->aArray[sizeClass][--(pool->aSize[sizeClass])];
+			StreamPool_CounterIncrement(&pool->hits);
+		}
+		else
+		{
+			/* round up so that the stream can serve any request of its class */
+			s = Stream_New(NULL, ((size_t) 1) << sizeClass);
 
-		Stream_SetPosition(s, 0);
-		Stream_EnsureCapacity(s, size);
+			if (s && (!s->buffer || !StreamPool_Track(pool, s)))
+			{
+				Stream_Free(s, TRUE);
+				s = NULL;
+			}
+
+			pool->misses++;
+		}
+
+		if (pool->synchronized)
+			LeaveCriticalSection(&pool->lock);
+
+		if (!s)
+			return NULL;
 	}
 
+	Stream_SetPosition(s, 0);
+
 	s->pool = pool;
 	s->count = 1;
 
-	StreamPool_AddUsed(pool, s);
+	used = InterlockedIncrement(&pool->used);
 
-	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+	do
+	{
+		highWater = pool->highWater;
+
+		if (used <= highWater)
+			break;
+	}
+	while (InterlockedCompareExchange(&pool->highWater, used, highWater) != highWater);
 
 	return s;
 }
@@ -174,22 +391,34 @@ wStream* StreamPool_Take(wStreamPool* pool, size_t size)
 
 void StreamPool_Return(wStreamPool* pool, wStream* s)
 {
-	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+	DWORD index;
+	wStreamPoolCache* cache;
 
-	if ((pool->aSize + 1) >= pool->aCapacity)
+	s->count = 0;
+	InterlockedDecrement(&pool->used);
+
+	cache = StreamPool_GetCache(pool, TRUE);
+
+	if (cache && (cache->count < STREAM_POOL_CACHE_SIZE))
 	{
-		pool->aCapacity *= 2;
-		pool->aArray = (wStream**) realloc(pool->aArray, sizeof(wStream*) * pool->aCapacity);
+		cache->streams[(cache->count)++] = s;
+		return;
 	}
-	else if ((pool->aSize + 1) * 3 < pool->aCapacity)
+
+	if (pool->synchronized)
+		EnterCriticalSection(&pool->lock);
+
+	/* a full cache is handed back to the pool as a whole */
+
+	if (cache)
 	{
-		pool->aCapacity /= 2;
-		pool->aArray = (wStream**) realloc(pool->aArray, sizeof(wStream*) * pool->aCapacity);
+		for (index = 0; index < cache->count; index++)
+			StreamPool_PushAvailable(pool, cache->streams[index]);
+
+		cache->count = 0;
 	}
 
-	pool->aArray[(pool->aSize)++] = s;
-	StreamPool_RemoveUsed(pool, s);
+	StreamPool_PushAvailable(pool, s);
 
 	if (pool->synchronized)
 		LeaveCriticalSection(&pool->lock);
@@ -220,11 +449,7 @@ void StreamPool_Unlock(wStreamPool* pool)
 void Stream_AddRef(wStream* s)
 {
 	if (s->pool)
-	{
-		StreamPool_Lock(s->pool);
-		s->count++;
-		StreamPool_Unlock(s->pool);
-	}
+		InterlockedIncrement((LONG*) &s->count);
 }
 
 /**
@@ -233,15 +458,9 @@ void Stream_AddRef(wStream* s)
 
 void Stream_Release(wStream* s)
 {
-	DWORD count;
-
 	if (s->pool)
 	{
-		StreamPool_Lock(s->pool);
-		count = --(s->count);
-		StreamPool_Unlock(s->pool);
-
-		if (count == 0)
+		if (InterlockedDecrement((LONG*) &s->count) == 0)
 			StreamPool_Return(s->pool, s);
 	}
 }
@@ -258,9 +477,12 @@ wStream* StreamPool_Find(wStreamPool* pool, BYTE* ptr)
 
 	EnterCriticalSection(&pool->lock);
 
-	for (index = 0; index < pool->uSize; index++)
+	for (index = 0; index < pool->tSize; index++)
 	{
-		s = pool->uArray[index];
+		s = pool->tArray[index];
+
+		if (!s->count)
+			continue;
 
 		if ((ptr >= Stream_Buffer(s)) && (ptr < (Stream_Buffer(s) + Stream_Capacity(s))))
 		{
@@ -303,24 +525,78 @@ void StreamPool_Release(wStreamPool* pool, BYTE* ptr)
 }
 
 /**
- * Releases the streams currently cached in the pool.
+ * Releases the streams currently available in the pool, including the
+ * ones cached by the calling thread.
  */
 
 void StreamPool_Clear(wStreamPool* pool)
 {
+	int index;
+	int sizeClass;
+	wStreamPoolCache* cache = NULL;
+
 	if (pool->synchronized)
+	{
+		cache = StreamPool_GetCache(pool, FALSE);
 		EnterCriticalSection(&pool->lock);
+	}
+
+	if (cache)
+	{
+		for (index = 0; index < (int) cache->count; index++)
+			StreamPool_PushAvailable(pool, cache->streams[index]);
+
+		cache->count = 0;
+	}
 
-	while (pool->aSize > 0)
+	/* available streams are marked before being dropped from the owned streams */
+
+	for (sizeClass = 0; sizeClass < STREAM_POOL_CLASSES; sizeClass++)
 	{
-		(pool->aSize)--;
-		Stream_Free(pool->aArray[pool->aSize], TRUE);
+		for (index = 0; index < pool->aSize[sizeClass]; index++)
+			pool->aArray[sizeClass][index]->pool = NULL;
+	}
+
+	for (index = 0; index < pool->tSize; )
+	{
+		if (!pool->tArray[index]->pool)
+			pool->tArray[index] = pool->tArray[--(pool->tSize)];
+		else
+			index++;
+	}
+
+	for (sizeClass = 0; sizeClass < STREAM_POOL_CLASSES; sizeClass++)
+	{
+		while (pool->aSize[sizeClass] > 0)
+		{
+			(pool->aSize[sizeClass])--;
+			Stream_Free(pool->aArray[sizeClass][pool->aSize[sizeClass]], TRUE);
+		}
 	}
 
 	if (pool->synchronized)
 		LeaveCriticalSection(&pool->lock);
 }
 
+/**
+ * Gets the pool statistics: a hit is a take served by an available stream,
+ * a miss one that allocated a new stream.
+ */
+
+void StreamPool_GetStatistics(wStreamPool* pool, wStreamPoolStatistics* stats)
+{
+	EnterCriticalSection(&pool->lock);
+
+	stats->hits = StreamPool_Counter(&pool->hits);
+	stats->misses = pool->misses;
+
+	stats->used = (UINT32) pool->used;
+	stats->highWater = (UINT32) pool->highWater;
+	stats->total = (UINT32) pool->tSize;
+
+	LeaveCriticalSection(&pool->lock);
+}
+
 /**
  * Construction, Destruction
  */
@@ -336,25 +612,26 @@ wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize)
 		pool->synchronized = synchronized;
 		pool->defaultSize = defaultSize;
 
-		pool->aSize = 0;
-		pool->aCapacity = 32;
-		pool->aArray = (wStream**) calloc(pool->aCapacity, sizeof(wStream*));
+		pool->tSize = 0;
+		pool->tCapacity = 32;
+		pool->tArray = (wStream**) calloc(pool->tCapacity, sizeof(wStream*));
 
-		if (!pool->aArray)
+		if (!pool->tArray)
 		{
 			free(pool);
 			return NULL;
 		}
 
-		pool->uSize = 0;
-		pool->uCapacity = 32;
-		pool->uArray = (wStream**) calloc(pool->uCapacity, sizeof(wStream*));
-
-		if (!pool->uArray)
+		if (synchronized)
 		{
-			free(pool->aArray);
-			free(pool);
-			return NULL;
+			if (!InitOnceExecuteOnce(&StreamPoolTlsInitOnce, StreamPool_TlsInit, NULL, NULL))
+			{
+				free(pool->tArray);
+				free(pool);
+				return NULL;
+			}
+
+			pool->id = StreamPool_CounterIncrement(&StreamPoolNextId);
 		}
 
 		InitializeCriticalSectionAndSpinCount(&pool->lock, 4000);
@@ -365,14 +642,31 @@ wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize)
 
 void StreamPool_Free(wStreamPool* pool)
 {
+	DWORD index;
+	int sizeClass;
+	wStreamPoolCache* cache;
+
 	if (pool)
 	{
 		StreamPool_Clear(pool);
 
+		while (pool->caches)
+		{
+			cache = pool->caches;
+			pool->caches = cache->next;
+
+			for (index = 0; index < cache->count; index++)
+				Stream_Free(cache->streams[index], TRUE);
+
+			free(cache);
+		}
+
 		DeleteCriticalSection(&pool->lock);
 
-		free(pool->aArray);
-		free(pool->uArray);
+		for (sizeClass = 0; sizeClass < STREAM_POOL_CLASSES; sizeClass++)
+			free(pool->aArray[sizeClass]);
+
+		free(pool->tArray);
 
 		free(pool);
 	}
@@ -25,10 +25,16 @@
 #include <winpr/crt.h>
 #include <winpr/stream.h>
 
-void Stream_EnsureCapacity(wStream* s, size_t size)
+/**
+ * Grows the stream buffer to hold at least size bytes. On failure the
+ * stream is left untouched and FALSE is returned.
+ */
+
+BOOL Stream_EnsureCapacity(wStream* s, size_t size)
 {
 	if (s->capacity < size)
 	{
+		BYTE* buffer;
 		size_t position;
 		size_t old_capacity;
 		size_t new_capacity;
@@ -42,23 +48,31 @@ void Stream_EnsureCapacity(wStream* s, size_t size)
 		}
 		while (new_capacity < size);
 
-		s->capacity = new_capacity;
-		s->length = new_capacity;
-
 		position = Stream_GetPosition(s);
 
-		s->buffer = (BYTE*) realloc(s->buffer, s->capacity);
+		buffer = (BYTE*) realloc(s->buffer, new_capacity);
+
+		if (!buffer)
+			return FALSE;
+
+		s->buffer = buffer;
+		s->capacity = new_capacity;
+		s->length = new_capacity;
 
 		ZeroMemory(&s->buffer[old_capacity], s->capacity - old_capacity);
 
 		Stream_SetPosition(s, position);
 	}
+
+	return TRUE;
 }
 
-void Stream_EnsureRemainingCapacity(wStream* s, size_t size)
+BOOL Stream_EnsureRemainingCapacity(wStream* s, size_t size)
 {
 	if (Stream_GetPosition(s) + size > Stream_Capacity(s))
-		Stream_EnsureCapacity(s, Stream_Capacity(s) + size);
+		return Stream_EnsureCapacity(s, Stream_Capacity(s) + size);
+
+	return TRUE;
 }
 
 wStream* Stream_New(BYTE* buffer, size_t size)
@@ -1,10 +1,193 @@
 
 #include <winpr/crt.h>
 #include <winpr/stream.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
 #include <winpr/collections.h>
 
 #define BUFFER_SIZE 16384
 
+#define TEST_POOL_THREADS	4
+#define TEST_POOL_ITERATIONS	200000
+#define TEST_POOL_COUNT		2000
+
+static void test_stream_pool_print(wStreamPool* pool)
+{
+	wStreamPoolStatistics stats;
+
+	StreamPool_GetStatistics(pool, &stats);
+
+	printf("StreamPool: used: %d total: %d hits: %d misses: %d high water: %d\n",
+			(int) stats.used, (int) stats.total, (int) stats.hits, (int) stats.misses,
+			(int) stats.highWater);
+}
+
+/**
+ * Every thread keeps a few streams of mixed sizes alive at once, like the
+ * transport and channel threads sharing a receive pool do.
+ */
+
+static void* test_stream_pool_thread(void* arg)
+{
+	int index;
+	UINT32 seed;
+	size_t size;
+	wStream* s[4] = { NULL, NULL, NULL, NULL };
+	wStreamPool* pool = (wStreamPool*) arg;
+
+	seed = GetCurrentThreadId();
+
+	for (index = 0; index < TEST_POOL_ITERATIONS; index++)
+	{
+		seed = seed * 1103515245 + 12345;
+		size = ((seed >> 16) & 1) ? BUFFER_SIZE : 64 + ((seed >> 8) % 4096);
+
+		if (s[index % 4])
+			Stream_Release(s[index % 4]);
+
+		s[index % 4] = StreamPool_Take(pool, size);
+
+		if (!s[index % 4] || (Stream_Capacity(s[index % 4]) < size))
+		{
+			printf("StreamPool_Take failure\n");
+			ExitThread(1);
+			return NULL;
+		}
+
+		Stream_Write_UINT32(s[index % 4], index);
+	}
+
+	for (index = 0; index < 4; index++)
+		Stream_Release(s[index]);
+
+	ExitThread(0);
+	return NULL;
+}
+
+static int test_stream_pool_contention(void)
+{
+	int index;
+	DWORD exitCode;
+	UINT64 begin;
+	UINT64 elapsed;
+	wStreamPool* pool;
+	wStreamPoolStatistics stats;
+	HANDLE threads[TEST_POOL_THREADS];
+
+	pool = StreamPool_New(TRUE, BUFFER_SIZE);
+
+	if (!pool)
+		return -1;
+
+	begin = GetTickCount64();
+
+	for (index = 0; index < TEST_POOL_THREADS; index++)
+	{
+		threads[index] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) test_stream_pool_thread,
+				(void*) pool, 0, NULL);
+
+		if (!threads[index])
+			return -1;
+	}
+
+	for (index = 0; index < TEST_POOL_THREADS; index++)
+	{
+		WaitForSingleObject(threads[index], INFINITE);
+		GetExitCodeThread(threads[index], &exitCode);
+		CloseHandle(threads[index]);
+
+		if (exitCode != 0)
+			return -1;
+	}
+
+	elapsed = GetTickCount64() - begin;
+
+	StreamPool_GetStatistics(pool, &stats);
+
+	printf("StreamPool: %d threads, %d take/release each: %d ms (%.1f ns/op), hits: %d misses: %d high water: %d\n",
+			TEST_POOL_THREADS, TEST_POOL_ITERATIONS, (int) elapsed,
+			(elapsed * 1000000.0) / (TEST_POOL_THREADS * TEST_POOL_ITERATIONS),
+			(int) stats.hits, (int) stats.misses, (int) stats.highWater);
+
+	if (stats.used != 0)
+	{
+		printf("StreamPool: %d streams still in use\n", (int) stats.used);
+		return -1;
+	}
+
+	StreamPool_Free(pool);
+
+	return 0;
+}
+
+/**
+ * A server keeps a synchronized pool per session, more than there are TLS
+ * indexes, and each thread goes through more pools than it keeps caches for.
+ */
+
+static int test_stream_pool_many(void)
+{
+	int index;
+	int round;
+	int status = 0;
+	wStream* s;
+	wStreamPool** pools;
+	wStreamPoolStatistics stats;
+
+	pools = (wStreamPool**) calloc(TEST_POOL_COUNT, sizeof(wStreamPool*));
+
+	if (!pools)
+		return -1;
+
+	for (index = 0; index < TEST_POOL_COUNT; index++)
+	{
+		pools[index] = StreamPool_New(TRUE, BUFFER_SIZE);
+
+		if (!pools[index])
+		{
+			printf("StreamPool_New failure after %d pools\n", index);
+			status = -1;
+			goto out;
+		}
+	}
+
+	for (round = 0; round < 3; round++)
+	{
+		for (index = 0; index < TEST_POOL_COUNT; index++)
+		{
+			s = StreamPool_Take(pools[index], 0);
+
+			if (!s)
+			{
+				status = -1;
+				goto out;
+			}
+
+			Stream_Release(s);
+		}
+	}
+
+	for (index = 0; index < TEST_POOL_COUNT; index++)
+	{
+		StreamPool_GetStatistics(pools[index], &stats);
+
+		if ((stats.hits != 2) || (stats.misses != 1) || (stats.total != 1))
+		{
+			printf("StreamPool %d: hits: %d misses: %d total: %d\n", index,
+					(int) stats.hits, (int) stats.misses, (int) stats.total);
+			status = -1;
+			goto out;
+		}
+	}
+
+out:
+	for (index = 0; index < TEST_POOL_COUNT; index++)
+		StreamPool_Free(pools[index]);
+
+	free(pools);
+	return status;
+}
+
 int TestStreamPool(int argc, char* argv[])
 {
 	wStream* s[5];
@@ -16,29 +199,29 @@ int TestStreamPool(int argc, char* argv[])
 	s[1] = StreamPool_Take(pool, 0);
 	s[2] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	Stream_Release(s[0]);
 	Stream_Release(s[1]);
 	Stream_Release(s[2]);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	s[3] = StreamPool_Take(pool, 0);
 	s[4] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	Stream_Release(s[3]);
 	Stream_Release(s[4]);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	s[2] = StreamPool_Take(pool, 0);
 	s[3] = StreamPool_Take(pool, 0);
 	s[4] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	Stream_AddRef(s[2]);
 
@@ -61,13 +244,13 @@ int TestStreamPool(int argc, char* argv[])
 	Stream_Release(s[4]);
 	Stream_Release(s[4]);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	s[2] = StreamPool_Take(pool, 0);
 	s[3] = StreamPool_Take(pool, 0);
 	s[4] = StreamPool_Take(pool, 0);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	StreamPool_AddRef(pool, s[2]->buffer + 1024);
 
@@ -78,7 +261,7 @@ int TestStreamPool(int argc, char* argv[])
 	StreamPool_AddRef(pool, s[4]->buffer + 1024 * 2);
 	StreamPool_AddRef(pool, s[4]->buffer + 1024 * 3);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	StreamPool_Release(pool, s[2]->buffer + 2048);
 	StreamPool_Release(pool, s[2]->buffer + 2048 * 2);
@@ -92,10 +275,16 @@ int TestStreamPool(int argc, char* argv[])
 	StreamPool_Release(pool, s[4]->buffer + 2048 * 3);
 	StreamPool_Release(pool, s[4]->buffer + 2048 * 4);
 
-	printf("StreamPool: aSize: %d uSize: %d\n", pool->aSize, pool->uSize);
+	test_stream_pool_print(pool);
 
 	StreamPool_Free(pool);
 
+	if (test_stream_pool_contention() < 0)
+		return -1;
+
+	if (test_stream_pool_many() < 0)
+		return -1;
+
 	return 0;
 }
 